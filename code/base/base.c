@@ -277,20 +277,45 @@ void _init_timestamp_for_process()
    //log_line("Current timestamp: %lld", lt);
 }
 
+// The timestamps are u32 and wrap around, so they are computed with 32 bit math only: same result as
+// the 64 bit one, without the 64 bit division helpers calls on 32 bit ARM (these run on every loop/packet).
 u32 get_current_timestamp_micros()
 {
    struct timespec t;
    clock_gettime(CLOCK_MONOTONIC, &t);
-   long long lt = t.tv_sec*1000LL*1000LL + t.tv_nsec/1000LL;
-   return (lt - sStartTimeStamp);
+   return ((u32)t.tv_sec)*1000000 + ((u32)t.tv_nsec)/1000 - (u32)sStartTimeStamp;
 }
 
 u32 get_current_timestamp_ms()
 {
    struct timespec t;
    clock_gettime(CLOCK_MONOTONIC, &t);
-   long long lt = t.tv_sec*1000LL + t.tv_nsec/1000LL/1000LL;
-   return (lt - sStartTimeStamp_ms);
+   return ((u32)t.tv_sec)*1000 + ((u32)t.tv_nsec)/1000000 - (u32)sStartTimeStamp_ms;
+}
+
+// Both timestamps from a single clock read
+void get_current_timestamps(u32* puTimeMs, u32* puTimeMicros)
+{
+   struct timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   if ( NULL != puTimeMs )
+      *puTimeMs = ((u32)t.tv_sec)*1000 + ((u32)t.tv_nsec)/1000000 - (u32)sStartTimeStamp_ms;
+   if ( NULL != puTimeMicros )
+      *puTimeMicros = ((u32)t.tv_sec)*1000000 + ((u32)t.tv_nsec)/1000 - (u32)sStartTimeStamp;
+}
+
+// Same time base as get_current_timestamp_ms, but only updated once per kernel tick (a few ms),
+// so it can lag behind get_current_timestamp_ms by up to a tick. Reading it never goes to the
+// hardware clock, so it's the cheap one to use for log throttling, spin timeouts and other checks
+// that only compare it with itself, in hot loops.
+u32 get_current_timestamp_ms_coarse()
+{
+   struct timespec t;
+   #ifdef CLOCK_MONOTONIC_COARSE
+   if ( 0 != clock_gettime(CLOCK_MONOTONIC_COARSE, &t) )
+   #endif
+      clock_gettime(CLOCK_MONOTONIC, &t);
+   return ((u32)t.tv_sec)*1000 + ((u32)t.tv_nsec)/1000000 - (u32)sStartTimeStamp_ms;
 }
 
 u32 get_boot_timestamp_ms()
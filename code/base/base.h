@@ -77,6 +77,9 @@ int is_sw_version_atleast(u32 uSWVersion, int iMajor, int iMinor);
 
 u32 get_current_timestamp_micros();
 u32 get_current_timestamp_ms();
+// Cheaper, kernel tick resolution. Only compare it with values it returned.
+u32 get_current_timestamp_ms_coarse();
+void get_current_timestamps(u32* puTimeMs, u32* puTimeMicros);
 u32 get_boot_timestamp_ms();
 int is_first_boot();
 
@@ -261,6 +261,13 @@ typedef struct
 
 #define COMMAND_ID_CLEAR_LOGS 213
 
+// Windowed file transfers (see base/file_transfer.h). Param: file ID.
+// Download: controller sends acks (t_file_transfer_ack) as oneway commands; vehicle responds with zero or more
+// file segments (t_file_transfer_segment_header then segment data) to each ack.
+// Upload: controller sends file segments as oneway commands; vehicle responds with an ack to each segment.
+#define COMMAND_ID_FILE_TRANSFER_ACK 214
+#define COMMAND_ID_FILE_TRANSFER_SEGMENT 215
+
 
 #define COMMAND_ID_MANUAL_SWITCH_TO_VIDEO_LINK_QUALITY_LOW 220
 #define COMMAND_ID_MANUAL_SWITCH_TO_VIDEO_LINK_QUALITY_MED 221
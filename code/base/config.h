@@ -14,7 +14,6 @@
 #define FEATURE_RELAYING 1
 //#define FEATURE_CHECK_LICENCES 1
 //#define FEATURE_VEHICLE_COMPUTES_ADAPTIVE_VIDEO 1
-//#define FEATURE_CONCATENATE_SMALL_RADIO_PACKETS
 //#define FEATURE_LOCAL_AUDIO_RECORDING 1
 //#define FEATURE_RADIO_SYNCHRONIZE_RXTX_THREADS
 //#define LOG_RAW_TELEMETRY
@@ -23,7 +22,7 @@
 // dword: BB.BB.MM.mm  (BB.BB: build number, MM: major ver, mm: minor ver) 
 #define SYSTEM_SW_VERSION_MAJOR 9
 #define SYSTEM_SW_VERSION_MINOR 70
-#define SYSTEM_SW_BUILD_NUMBER  239
+#define SYSTEM_SW_BUILD_NUMBER  240
 
 #define LOGGER_MESSAGE_QUEUE_ID 123
 #define RADIO_TX_MESSAGE_QUEUE_ID 117
@@ -137,6 +136,7 @@
 #define RAW_TELEMETRY_MAX_BUFFER 512  // bytes
 #define RAW_TELEMETRY_SEND_TIMEOUT 200 // miliseconds. how much to wait until to send whatever is in a telemetry serial buffer to the radio
 #define RAW_TELEMETRY_MIN_SEND_LENGTH 255 // minimum data length to send right away to radio
+#define RAW_TELEMETRY_FRAMED_SEND_INTERVAL 20 // miliseconds. framed (MAVLink/LTM) telemetry is sent at this interval when the read data ends on a complete message
 
 #define AUXILIARY_DATA_LINK_SEND_TIMEOUT 100 // miliseconds. how much to wait until to send whatever is in a data link serial buffer to the radio
 #define AUXILIARY_DATA_LINK_MIN_SEND_LENGTH 255 // minimum data length to send right away to radio
@@ -33,6 +33,7 @@
 #define FILE_CONFIG_BOARD_TYPE "board.txt"
 #define FILE_VEHICLE_SPECTATOR "spect-%d.mdl"
 #define FILE_VEHICLE_CONTROLL "ctrl-%d.mdl"
+#define FILE_CONFIG_MODELS_INDEX "models.idx"
 #define FILE_CONFIG_ACTIVE_CONTROLLER_MODEL "controller_active_model.cfg"
 #define FILE_CONFIG_CURRENT_VEHICLE_MODEL "current_vehicle.mdl"
 #define FILE_CONFIG_CURRENT_VEHICLE_MODEL_BACKUP "current_vehicle.bak"
@@ -3,6 +3,14 @@
 #define DEFAULT_MAX_LOOP_TIME_MILISECONDS 30
 #define DEFAULT_MAX_RX_LOOP_TIMEOUT_MILISECONDS 49
 
+// Controller router event loop timers
+#define ROUTER_LOOP_MAX_WAIT_MS 20
+#define ROUTER_TIMER_INTERVAL_IPC_MS 2
+#define ROUTER_TIMER_INTERVAL_VIDEO_RX_MS 2
+#define ROUTER_TIMER_INTERVAL_VIDEO_LINK_MS 5
+#define ROUTER_TIMER_INTERVAL_AUDIO_MS 5
+#define ROUTER_TIMER_INTERVAL_HOUSEKEEPING_MS 10
+
 #define DEFAULT_DELAY_WIFI_CHANGE 60
 
 #define TIMEOUT_TELEMETRY_LOST 2000 // miliseconds
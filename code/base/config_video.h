@@ -21,6 +21,14 @@
 #define DEFAULT_VIDEO_MIN_AUTO_KEYFRAME_INTERVAL 100 // in miliseconds
 #define DEFAULT_VIDEO_AUTO_INITIAL_KEYFRAME_INTERVAL 250 // in miliseconds
 #define DEFAULT_VIDEO_KEYFRAME_INTERVAL_WHEN_RELAYING 100 // in miliseconds
+// Keyframes requested by the controller on unrecoverable video loss
+#define DEFAULT_VIDEO_KEYFRAME_REQUEST_RETRY_MS 40 // resend the request until acknowledged
+#define DEFAULT_VIDEO_KEYFRAME_REQUEST_MAX_RETRIES 10
+#define VIDEO_KEYFRAME_REQUEST_ACK_MIN_SW_BUILD 240 // older vehicles don't acknowledge keyframe requests
+#define DEFAULT_VIDEO_MIN_FORCED_KEYFRAME_INTERVAL 250 // in miliseconds, vehicle does not generate forced keyframes more often
+#define DEFAULT_VIDEO_FORCED_KEYFRAME_MIN_GAIN 100 // in miliseconds, do not force a keyframe if the regular one is due sooner
+#define DEFAULT_VIDEO_STREAM_OUTPUT_SWITCH_TIMEOUT_MS 300 // in miliseconds, a video stream not received for this long is not used for output (if the vehicle has other video streams)
+#define DEFAULT_VIDEO_LATENCY_TRACE_BLOCKS_INTERVAL 8 // one video packet in this many video blocks carries a latency trace
 
 #define DEFAULT_VIDEO_RETRANS_MS5_HP ((u32)17)  // 17*5 = 85 milisec
 #define DEFAULT_VIDEO_RETRANS_MS5_HQ ((u32)28)  // 20*5 = 100 milisec
@@ -69,6 +77,8 @@
 #define DEFAULT_LQ_VIDEO_FPS 30
 
 #define MAX_BUFFERED_AUDIO_PACKETS 32
+#define DEFAULT_AUDIO_RX_JITTER_BLOCKS 4 // how many audio blocks can be reordered/repaired at the same time
+#define DEFAULT_AUDIO_RX_PLAYOUT_DELAY_MS 80 // how long audio is buffered before being played
 
 #define MAX_BLOCKS_TO_OUTPUT_IF_AVAILABLE 20
 
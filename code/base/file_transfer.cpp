@@ -0,0 +1,752 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "file_transfer.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define FILE_TRANSFER_STATE_MAGIC 0x52465453
+#define FILE_TRANSFER_INITIAL_RTO_MS 1000
+#define FILE_TRANSFER_STATE_SAVE_INTERVAL 32
+
+typedef struct
+{
+   u32 uMagic;
+   u32 uTransferId;
+   u32 uFileSize;
+   u32 uSegmentSize;
+   u32 uFECGroupSize;
+   u32 uTotalSegments;
+} __attribute__((packed)) t_file_transfer_state;
+
+static u8 s_uFileTransferSegmentBuffer[sizeof(t_file_transfer_segment_header) + FILE_TRANSFER_MAX_SEGMENT_SIZE];
+
+static int _file_transfer_get_segment_length(u32 uFileSize, int iSegmentSize, u32 uSegmentIndex)
+{
+   u32 uStart = uSegmentIndex * (u32)iSegmentSize;
+   if ( uStart >= uFileSize )
+      return 0;
+   if ( uFileSize - uStart < (u32)iSegmentSize )
+      return (int)(uFileSize - uStart);
+   return iSegmentSize;
+}
+
+static u32 _file_transfer_get_total_segments(u32 uFileSize, int iSegmentSize)
+{
+   if ( 0 == uFileSize )
+      return 1;
+   return (uFileSize + (u32)iSegmentSize - 1) / (u32)iSegmentSize;
+}
+
+//---------------------------------------------------
+// Sender
+
+static int _file_transfer_sender_init(t_file_transfer_sender* pSender, u32 uTransferId, u32 uSize, int iSegmentSize, int iFECGroupSize, file_transfer_send_callback pCallback, void* pContext)
+{
+   if ( (iSegmentSize <= 0) || (iSegmentSize > FILE_TRANSFER_MAX_SEGMENT_SIZE) )
+      iSegmentSize = FILE_TRANSFER_DEFAULT_SEGMENT_SIZE;
+   if ( iFECGroupSize < 2 )
+      iFECGroupSize = 0;
+   if ( iFECGroupSize > 255 )
+      iFECGroupSize = 255;
+
+   pSender->uTransferId = uTransferId;
+   pSender->uFileSize = uSize;
+   pSender->iSegmentSize = iSegmentSize;
+   pSender->uTotalSegments = _file_transfer_get_total_segments(uSize, iSegmentSize);
+   pSender->iFECGroupSize = iFECGroupSize;
+   pSender->iWindow = FILE_TRANSFER_DEFAULT_WINDOW;
+   pSender->iPeerWindow = FILE_TRANSFER_DEFAULT_WINDOW;
+   pSender->iRTO = FILE_TRANSFER_INITIAL_RTO_MS;
+   pSender->pSendCallback = pCallback;
+   pSender->pContext = pContext;
+
+   if ( pSender->uTotalSegments > FILE_TRANSFER_MAX_SEGMENTS )
+   {
+      log_softerror_and_alarm("[FileTransfer] File too big to transfer: %u bytes, %u segments (max %d segments).", uSize, pSender->uTotalSegments, FILE_TRANSFER_MAX_SEGMENTS);
+      return -1;
+   }
+   pSender->pSegmentState = (u8*) calloc(pSender->uTotalSegments, sizeof(u8));
+   pSender->pSegmentSendTime = (u32*) calloc(pSender->uTotalSegments, sizeof(u32));
+   if ( (NULL == pSender->pSegmentState) || (NULL == pSender->pSegmentSendTime) )
+   {
+      log_softerror_and_alarm("[FileTransfer] Failed to allocate segments state.");
+      return -1;
+   }
+   if ( 0 == pSender->uTransferId )
+      pSender->uTransferId = (NULL != pSender->pData)?base_compute_crc32((u8*)pSender->pData, (int)uSize):1;
+   if ( 0 == pSender->uTransferId )
+      pSender->uTransferId = 1;
+   return 0;
+}
+
+int file_transfer_sender_open_file(t_file_transfer_sender* pSender, u32 uTransferId, const char* szFile, int iSegmentSize, int iFECGroupSize, file_transfer_send_callback pCallback, void* pContext)
+{
+   if ( (NULL == pSender) || (NULL == szFile) )
+      return -1;
+   memset(pSender, 0, sizeof(t_file_transfer_sender));
+   pSender->iFd = open(szFile, O_RDONLY);
+   if ( pSender->iFd < 0 )
+   {
+      log_softerror_and_alarm("[FileTransfer] Failed to open file to send: %s", szFile);
+      return -1;
+   }
+   struct stat statFile;
+   if ( 0 != fstat(pSender->iFd, &statFile) )
+   {
+      log_softerror_and_alarm("[FileTransfer] Failed to get size of file to send: %s", szFile);
+      file_transfer_sender_close(pSender);
+      return -1;
+   }
+   u32 uSize = (u32)statFile.st_size;
+   if ( uSize > 0 )
+   {
+      void* pMap = mmap(NULL, uSize, PROT_READ, MAP_PRIVATE, pSender->iFd, 0);
+      if ( MAP_FAILED == pMap )
+      {
+         log_softerror_and_alarm("[FileTransfer] Failed to map file to send: %s, error: %s", szFile, strerror(errno));
+         file_transfer_sender_close(pSender);
+         return -1;
+      }
+      madvise(pMap, uSize, MADV_SEQUENTIAL);
+      pSender->pMap = (u8*)pMap;
+      pSender->pData = pSender->pMap;
+   }
+   if ( 0 != _file_transfer_sender_init(pSender, uTransferId, uSize, iSegmentSize, iFECGroupSize, pCallback, pContext) )
+   {
+      file_transfer_sender_close(pSender);
+      return -1;
+   }
+   log_line("[FileTransfer] Opened file to send: %s, %u bytes, %u segments of %d bytes, FEC group: %d, transfer id: %u",
+      szFile, uSize, pSender->uTotalSegments, pSender->iSegmentSize, pSender->iFECGroupSize, pSender->uTransferId);
+   return 0;
+}
+
+int file_transfer_sender_open_buffer(t_file_transfer_sender* pSender, u32 uTransferId, const u8* pData, u32 uSize, int iSegmentSize, int iFECGroupSize, file_transfer_send_callback pCallback, void* pContext)
+{
+   if ( NULL == pSender )
+      return -1;
+   memset(pSender, 0, sizeof(t_file_transfer_sender));
+   pSender->iFd = -1;
+   pSender->pData = (uSize > 0)?pData:NULL;
+   if ( 0 != _file_transfer_sender_init(pSender, uTransferId, uSize, iSegmentSize, iFECGroupSize, pCallback, pContext) )
+   {
+      file_transfer_sender_close(pSender);
+      return -1;
+   }
+   return 0;
+}
+
+void file_transfer_sender_close(t_file_transfer_sender* pSender)
+{
+   if ( NULL == pSender )
+      return;
+   if ( NULL != pSender->pMap )
+      munmap(pSender->pMap, pSender->uFileSize);
+   if ( pSender->iFd >= 0 )
+      close(pSender->iFd);
+   if ( NULL != pSender->pSegmentState )
+      free(pSender->pSegmentState);
+   if ( NULL != pSender->pSegmentSendTime )
+      free(pSender->pSegmentSendTime);
+   memset(pSender, 0, sizeof(t_file_transfer_sender));
+   pSender->iFd = -1;
+}
+
+static void _file_transfer_sender_fill_header(t_file_transfer_sender* pSender, t_file_transfer_segment_header* pHeader, u32 uTimeNow)
+{
+   pHeader->uTransferId = pSender->uTransferId;
+   pHeader->uFileSize = pSender->uFileSize;
+   pHeader->uSegmentSize = (u16)pSender->iSegmentSize;
+   pHeader->uFECGroupSize = (u8)pSender->iFECGroupSize;
+   pHeader->uFlags = 0;
+   pHeader->uSendTime = uTimeNow;
+}
+
+static int _file_transfer_sender_send_segment(t_file_transfer_sender* pSender, u32 uSegmentIndex, u32 uTimeNow)
+{
+   t_file_transfer_segment_header* pHeader = (t_file_transfer_segment_header*)s_uFileTransferSegmentBuffer;
+   _file_transfer_sender_fill_header(pSender, pHeader, uTimeNow);
+   pHeader->uSegmentIndex = uSegmentIndex;
+   pHeader->uDataLength = (u16)_file_transfer_get_segment_length(pSender->uFileSize, pSender->iSegmentSize, uSegmentIndex);
+   if ( pHeader->uDataLength > 0 )
+      memcpy(s_uFileTransferSegmentBuffer + sizeof(t_file_transfer_segment_header), pSender->pData + uSegmentIndex * (u32)pSender->iSegmentSize, pHeader->uDataLength);
+
+   pSender->pSegmentState[uSegmentIndex] = FILE_TRANSFER_SEGMENT_IN_FLIGHT;
+   pSender->pSegmentSendTime[uSegmentIndex] = uTimeNow;
+   pSender->iInFlight++;
+   pSender->stats.uCountSegmentsSent++;
+   if ( NULL != pSender->pSendCallback )
+      pSender->pSendCallback(pSender->pContext, s_uFileTransferSegmentBuffer, sizeof(t_file_transfer_segment_header) + pHeader->uDataLength);
+   return 1;
+}
+
+// Parity segments are sent once, right after the last data segment of the group; they are not resent.
+static void _file_transfer_sender_send_parity(t_file_transfer_sender* pSender, u32 uGroupIndex, u32 uTimeNow)
+{
+   t_file_transfer_segment_header* pHeader = (t_file_transfer_segment_header*)s_uFileTransferSegmentBuffer;
+   u8* pParity = s_uFileTransferSegmentBuffer + sizeof(t_file_transfer_segment_header);
+   _file_transfer_sender_fill_header(pSender, pHeader, uTimeNow);
+   pHeader->uFlags = FILE_TRANSFER_SEGMENT_FLAG_PARITY;
+   pHeader->uSegmentIndex = uGroupIndex;
+   pHeader->uDataLength = 0;
+   memset(pParity, 0, pSender->iSegmentSize);
+
+   u32 uFirst = uGroupIndex * (u32)pSender->iFECGroupSize;
+   for( u32 u=uFirst; (u < uFirst + (u32)pSender->iFECGroupSize) && (u < pSender->uTotalSegments); u++ )
+   {
+      int iLength = _file_transfer_get_segment_length(pSender->uFileSize, pSender->iSegmentSize, u);
+      const u8* pData = pSender->pData + u * (u32)pSender->iSegmentSize;
+      for( int i=0; i<iLength; i++ )
+         pParity[i] ^= pData[i];
+      if ( iLength > pHeader->uDataLength )
+         pHeader->uDataLength = (u16)iLength;
+   }
+   pSender->stats.uCountParitySent++;
+   if ( NULL != pSender->pSendCallback )
+      pSender->pSendCallback(pSender->pContext, s_uFileTransferSegmentBuffer, sizeof(t_file_transfer_segment_header) + pHeader->uDataLength);
+}
+
+static void _file_transfer_sender_mark_acked(t_file_transfer_sender* pSender, u32 uSegmentIndex)
+{
+   if ( FILE_TRANSFER_SEGMENT_ACKED == pSender->pSegmentState[uSegmentIndex] )
+      return;
+   if ( FILE_TRANSFER_SEGMENT_IN_FLIGHT == pSender->pSegmentState[uSegmentIndex] )
+      pSender->iInFlight--;
+   pSender->pSegmentState[uSegmentIndex] = FILE_TRANSFER_SEGMENT_ACKED;
+   if ( uSegmentIndex + 1 > pSender->uHighestAcked )
+      pSender->uHighestAcked = uSegmentIndex + 1;
+}
+
+static void _file_transfer_sender_update_rtt(t_file_transfer_sender* pSender, int iSample)
+{
+   if ( iSample < 1 )
+      iSample = 1;
+   if ( 0 == pSender->iSRTT )
+   {
+      pSender->iSRTT = iSample;
+      pSender->iRTTVar = iSample/2;
+   }
+   else
+   {
+      int iDelta = pSender->iSRTT - iSample;
+      if ( iDelta < 0 )
+         iDelta = -iDelta;
+      pSender->iRTTVar = (3*pSender->iRTTVar + iDelta)/4;
+      pSender->iSRTT = (7*pSender->iSRTT + iSample)/8;
+   }
+   pSender->iRTO = pSender->iSRTT + 4*pSender->iRTTVar;
+   if ( pSender->iRTO < FILE_TRANSFER_MIN_RTO_MS )
+      pSender->iRTO = FILE_TRANSFER_MIN_RTO_MS;
+   if ( pSender->iRTO > FILE_TRANSFER_MAX_RTO_MS )
+      pSender->iRTO = FILE_TRANSFER_MAX_RTO_MS;
+}
+
+void file_transfer_sender_on_ack(t_file_transfer_sender* pSender, t_file_transfer_ack* pAck, u32 uTimeNow)
+{
+   if ( (NULL == pSender) || (NULL == pAck) || (NULL == pSender->pSegmentState) )
+      return;
+   if ( pAck->uTransferId != pSender->uTransferId )
+      return;
+   pSender->stats.uCountAcks++;
+
+   if ( pAck->uFlags & FILE_TRANSFER_ACK_FLAG_ABORT )
+   {
+      log_line("[FileTransfer] Transfer %u aborted by the receiver.", pSender->uTransferId);
+      pSender->iAborted = 1;
+      return;
+   }
+   if ( pAck->uWindow > 0 )
+      pSender->iPeerWindow = (pAck->uWindow > FILE_TRANSFER_MAX_WINDOW)?FILE_TRANSFER_MAX_WINDOW:pAck->uWindow;
+   if ( 0 != pAck->uEchoSendTime )
+      _file_transfer_sender_update_rtt(pSender, (int)(uTimeNow - pAck->uEchoSendTime));
+
+   // Receiver has no state yet (or the state of another file)
+   if ( pAck->uFileSize != pSender->uFileSize )
+      return;
+
+   u32 uCumulative = pAck->uCumulativeAck;
+   if ( uCumulative > pSender->uTotalSegments )
+      uCumulative = pSender->uTotalSegments;
+   for( u32 u=pSender->uCumulativeAck; u<uCumulative; u++ )
+      _file_transfer_sender_mark_acked(pSender, u);
+   if ( uCumulative > pSender->uCumulativeAck )
+      pSender->uCumulativeAck = uCumulative;
+
+   for( int i=0; i<FILE_TRANSFER_SACK_SEGMENTS; i++ )
+   {
+      u32 uSegment = uCumulative + 1 + (u32)i;
+      if ( uSegment >= pSender->uTotalSegments )
+         break;
+      if ( pAck->uSackBitmap[i/32] & (((u32)1) << (i%32)) )
+         _file_transfer_sender_mark_acked(pSender, uSegment);
+   }
+
+   // A segment in flight is lost once enough segments sent after it were received
+   int iCountAckedAfter = 0;
+   u32 uOldestAckedSendTime = 0;
+   for( u32 u=pSender->uHighestAcked; u>pSender->uCumulativeAck; u-- )
+   {
+      u32 uSegment = u-1;
+      if ( FILE_TRANSFER_SEGMENT_ACKED == pSender->pSegmentState[uSegment] )
+      {
+         if ( (0 == iCountAckedAfter) || ((int)(pSender->pSegmentSendTime[uSegment] - uOldestAckedSendTime) < 0) )
+            uOldestAckedSendTime = pSender->pSegmentSendTime[uSegment];
+         iCountAckedAfter++;
+         continue;
+      }
+      if ( FILE_TRANSFER_SEGMENT_IN_FLIGHT != pSender->pSegmentState[uSegment] )
+         continue;
+      if ( iCountAckedAfter < FILE_TRANSFER_DUP_ACK_THRESHOLD )
+         continue;
+      // Only if it was sent before the acked ones (not an already resent segment)
+      if ( (int)(uOldestAckedSendTime - pSender->pSegmentSendTime[uSegment]) < 0 )
+         continue;
+      pSender->pSegmentState[uSegment] = FILE_TRANSFER_SEGMENT_LOST;
+      pSender->iInFlight--;
+   }
+
+   if ( (pSender->uCumulativeAck >= pSender->uTotalSegments) || (pAck->uFlags & FILE_TRANSFER_ACK_FLAG_COMPLETE) )
+   if ( ! pSender->iComplete )
+   {
+      pSender->iComplete = 1;
+      log_line("[FileTransfer] Transfer %u complete: %u segments sent, %u resent, %u parity, %u acks, %u timeouts.",
+         pSender->uTransferId, pSender->stats.uCountSegmentsSent, pSender->stats.uCountSegmentsResent,
+         pSender->stats.uCountParitySent, pSender->stats.uCountAcks, pSender->stats.uCountTimeouts);
+   }
+}
+
+int file_transfer_sender_send(t_file_transfer_sender* pSender, u32 uTimeNow)
+{
+   if ( (NULL == pSender) || (NULL == pSender->pSegmentState) || pSender->iComplete || pSender->iAborted )
+      return 0;
+
+   int iTimedOut = 0;
+   for( u32 u=pSender->uCumulativeAck; u<pSender->uNextNewSegment; u++ )
+   {
+      if ( FILE_TRANSFER_SEGMENT_IN_FLIGHT != pSender->pSegmentState[u] )
+         continue;
+      if ( (int)(uTimeNow - pSender->pSegmentSendTime[u]) < pSender->iRTO )
+         continue;
+      pSender->pSegmentState[u] = FILE_TRANSFER_SEGMENT_LOST;
+      pSender->iInFlight--;
+      iTimedOut = 1;
+   }
+   if ( iTimedOut )
+   {
+      pSender->stats.uCountTimeouts++;
+      pSender->iRTO *= 2;
+      if ( pSender->iRTO > FILE_TRANSFER_MAX_RTO_MS )
+         pSender->iRTO = FILE_TRANSFER_MAX_RTO_MS;
+   }
+
+   int iWindow = pSender->iWindow;
+   if ( pSender->iPeerWindow < iWindow )
+      iWindow = pSender->iPeerWindow;
+
+   int iCountSent = 0;
+   for( u32 u=pSender->uCumulativeAck; (u<pSender->uNextNewSegment) && (pSender->iInFlight < iWindow); u++ )
+   {
+      if ( FILE_TRANSFER_SEGMENT_LOST != pSender->pSegmentState[u] )
+         continue;
+      iCountSent += _file_transfer_sender_send_segment(pSender, u, uTimeNow);
+      pSender->stats.uCountSegmentsResent++;
+   }
+
+   // New segments, only as far as the receiver can report them in its acks
+   while ( (pSender->uNextNewSegment < pSender->uTotalSegments) && (pSender->iInFlight < iWindow) &&
+           (pSender->uNextNewSegment <= pSender->uCumulativeAck + FILE_TRANSFER_SACK_SEGMENTS) )
+   {
+      if ( FILE_TRANSFER_SEGMENT_ACKED != pSender->pSegmentState[pSender->uNextNewSegment] )
+         iCountSent += _file_transfer_sender_send_segment(pSender, pSender->uNextNewSegment, uTimeNow);
+      pSender->uNextNewSegment++;
+      if ( pSender->iFECGroupSize > 0 )
+      if ( (0 == (pSender->uNextNewSegment % pSender->iFECGroupSize)) || (pSender->uNextNewSegment == pSender->uTotalSegments) )
+         _file_transfer_sender_send_parity(pSender, (pSender->uNextNewSegment-1)/pSender->iFECGroupSize, uTimeNow);
+   }
+   return iCountSent;
+}
+
+int file_transfer_sender_is_complete(t_file_transfer_sender* pSender)
+{
+   if ( NULL == pSender )
+      return 0;
+   return pSender->iComplete;
+}
+
+//---------------------------------------------------
+// Receiver
+
+static void _file_transfer_receiver_free_parity(t_file_transfer_receiver* pReceiver)
+{
+   if ( NULL == pReceiver->ppParity )
+      return;
+   u32 uGroups = pReceiver->uTotalSegments/pReceiver->iFECGroupSize + 1;
+   for( u32 u=0; u<uGroups; u++ )
+   {
+      if ( NULL != pReceiver->ppParity[u] )
+         free(pReceiver->ppParity[u]);
+   }
+   free(pReceiver->ppParity);
+   pReceiver->ppParity = NULL;
+}
+
+static void _file_transfer_receiver_free_state(t_file_transfer_receiver* pReceiver)
+{
+   _file_transfer_receiver_free_parity(pReceiver);
+   if ( NULL != pReceiver->pReceived )
+      free(pReceiver->pReceived);
+   pReceiver->pReceived = NULL;
+   if ( pReceiver->iFd >= 0 )
+      close(pReceiver->iFd);
+   pReceiver->iFd = -1;
+   pReceiver->iStarted = 0;
+   pReceiver->uCountReceived = 0;
+   pReceiver->uCumulativeAck = 0;
+   pReceiver->iComplete = 0;
+}
+
+static int _file_transfer_receiver_alloc_state(t_file_transfer_receiver* pReceiver)
+{
+   pReceiver->pReceived = (u8*) calloc(pReceiver->uTotalSegments, sizeof(u8));
+   if ( NULL == pReceiver->pReceived )
+      return -1;
+   if ( pReceiver->iFECGroupSize > 0 )
+   {
+      pReceiver->ppParity = (u8**) calloc(pReceiver->uTotalSegments/pReceiver->iFECGroupSize + 1, sizeof(u8*));
+      if ( NULL == pReceiver->ppParity )
+         return -1;
+   }
+   return 0;
+}
+
+static void _file_transfer_receiver_save_state(t_file_transfer_receiver* pReceiver)
+{
+   pReceiver->uCountSinceStateSave = 0;
+   FILE* fd = fopen(pReceiver->szStateFile, "wb");
+   if ( NULL == fd )
+      return;
+   t_file_transfer_state state;
+   state.uMagic = FILE_TRANSFER_STATE_MAGIC;
+   state.uTransferId = pReceiver->uTransferId;
+   state.uFileSize = pReceiver->uFileSize;
+   state.uSegmentSize = (u32)pReceiver->iSegmentSize;
+   state.uFECGroupSize = (u32)pReceiver->iFECGroupSize;
+   state.uTotalSegments = pReceiver->uTotalSegments;
+   fwrite(&state, 1, sizeof(state), fd);
+   fwrite(pReceiver->pReceived, 1, pReceiver->uTotalSegments, fd);
+   fclose(fd);
+}
+
+// Loads the state of a previous partial transfer of the same output file
+static void _file_transfer_receiver_load_state(t_file_transfer_receiver* pReceiver)
+{
+   FILE* fd = fopen(pReceiver->szStateFile, "rb");
+   if ( NULL == fd )
+      return;
+   t_file_transfer_state state;
+   int iValid = 0;
+   if ( sizeof(state) == fread(&state, 1, sizeof(state), fd) )
+   if ( state.uMagic == FILE_TRANSFER_STATE_MAGIC )
+   if ( (state.uSegmentSize > 0) && (state.uSegmentSize <= FILE_TRANSFER_MAX_SEGMENT_SIZE) && (state.uFECGroupSize <= 255) )
+   if ( state.uTotalSegments == _file_transfer_get_total_segments(state.uFileSize, (int)state.uSegmentSize) )
+   if ( state.uTotalSegments <= FILE_TRANSFER_MAX_SEGMENTS )
+   if ( (0 == pReceiver->uTransferId) || (state.uTransferId == pReceiver->uTransferId) )
+      iValid = 1;
+
+   if ( iValid )
+   {
+      pReceiver->uTransferId = state.uTransferId;
+      pReceiver->uFileSize = state.uFileSize;
+      pReceiver->iSegmentSize = (int)state.uSegmentSize;
+      pReceiver->iFECGroupSize = (int)state.uFECGroupSize;
+      pReceiver->uTotalSegments = state.uTotalSegments;
+      pReceiver->iFd = open(pReceiver->szFile, O_RDWR);
+      if ( (pReceiver->iFd < 0) || (0 != _file_transfer_receiver_alloc_state(pReceiver)) )
+         iValid = 0;
+      else if ( pReceiver->uTotalSegments != fread(pReceiver->pReceived, 1, pReceiver->uTotalSegments, fd) )
+         iValid = 0;
+   }
+   fclose(fd);
+
+   if ( ! iValid )
+   {
+      _file_transfer_receiver_free_state(pReceiver);
+      unlink(pReceiver->szStateFile);
+      return;
+   }
+
+   pReceiver->iStarted = 1;
+   for( u32 u=0; u<pReceiver->uTotalSegments; u++ )
+   {
+      if ( pReceiver->pReceived[u] )
+         pReceiver->uCountReceived++;
+   }
+   while ( (pReceiver->uCumulativeAck < pReceiver->uTotalSegments) && pReceiver->pReceived[pReceiver->uCumulativeAck] )
+      pReceiver->uCumulativeAck++;
+   pReceiver->stats.uCountResumedSegments = pReceiver->uCountReceived;
+   log_line("[FileTransfer] Resuming transfer %u of file %s: %u of %u segments already received.",
+      pReceiver->uTransferId, pReceiver->szFile, pReceiver->uCountReceived, pReceiver->uTotalSegments);
+}
+
+static int _file_transfer_receiver_start(t_file_transfer_receiver* pReceiver, t_file_transfer_segment_header* pHeader)
+{
+   _file_transfer_receiver_free_state(pReceiver);
+   unlink(pReceiver->szStateFile);
+
+   pReceiver->uTransferId = pHeader->uTransferId;
+   pReceiver->uFileSize = pHeader->uFileSize;
+   pReceiver->iSegmentSize = pHeader->uSegmentSize;
+   pReceiver->iFECGroupSize = pHeader->uFECGroupSize;
+   pReceiver->uTotalSegments = _file_transfer_get_total_segments(pReceiver->uFileSize, pReceiver->iSegmentSize);
+   if ( (pReceiver->iSegmentSize <= 0) || (pReceiver->iSegmentSize > FILE_TRANSFER_MAX_SEGMENT_SIZE) || (pReceiver->uTotalSegments > FILE_TRANSFER_MAX_SEGMENTS) )
+   {
+      log_softerror_and_alarm("[FileTransfer] Invalid transfer params: %u bytes, segment size: %d", pReceiver->uFileSize, pReceiver->iSegmentSize);
+      return -1;
+   }
+   pReceiver->iFd = open(pReceiver->szFile, O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if ( pReceiver->iFd < 0 )
+   {
+      log_softerror_and_alarm("[FileTransfer] Failed to create output file: %s", pReceiver->szFile);
+      return -1;
+   }
+   if ( 0 != _file_transfer_receiver_alloc_state(pReceiver) )
+   {
+      log_softerror_and_alarm("[FileTransfer] Failed to allocate segments state.");
+      _file_transfer_receiver_free_state(pReceiver);
+      return -1;
+   }
+   pReceiver->iStarted = 1;
+   log_line("[FileTransfer] Started receiving transfer %u to file %s: %u bytes, %u segments, FEC group: %d",
+      pReceiver->uTransferId, pReceiver->szFile, pReceiver->uFileSize, pReceiver->uTotalSegments, pReceiver->iFECGroupSize);
+   return 0;
+}
+
+int file_transfer_receiver_open(t_file_transfer_receiver* pReceiver, u32 uTransferId, const char* szFile, int iWindow)
+{
+   if ( (NULL == pReceiver) || (NULL == szFile) )
+      return -1;
+   memset(pReceiver, 0, sizeof(t_file_transfer_receiver));
+   pReceiver->iFd = -1;
+   pReceiver->uTransferId = uTransferId;
+   pReceiver->iWindow = iWindow;
+   if ( (pReceiver->iWindow <= 0) || (pReceiver->iWindow > FILE_TRANSFER_MAX_WINDOW) )
+      pReceiver->iWindow = FILE_TRANSFER_DEFAULT_WINDOW;
+   strncpy(pReceiver->szFile, szFile, MAX_FILE_PATH_SIZE-1);
+   snprintf(pReceiver->szStateFile, MAX_FILE_PATH_SIZE-1, "%s.part", szFile);
+   _file_transfer_receiver_load_state(pReceiver);
+   return 0;
+}
+
+void file_transfer_receiver_close(t_file_transfer_receiver* pReceiver)
+{
+   if ( NULL == pReceiver )
+      return;
+   if ( pReceiver->iStarted && (! pReceiver->iComplete) )
+      _file_transfer_receiver_save_state(pReceiver);
+   _file_transfer_receiver_free_state(pReceiver);
+}
+
+static void _file_transfer_receiver_check_complete(t_file_transfer_receiver* pReceiver)
+{
+   while ( (pReceiver->uCumulativeAck < pReceiver->uTotalSegments) && pReceiver->pReceived[pReceiver->uCumulativeAck] )
+      pReceiver->uCumulativeAck++;
+   if ( pReceiver->uCountReceived < pReceiver->uTotalSegments )
+      return;
+   if ( 0 != ftruncate(pReceiver->iFd, pReceiver->uFileSize) )
+      log_softerror_and_alarm("[FileTransfer] Failed to set size of output file %s", pReceiver->szFile);
+   close(pReceiver->iFd);
+   pReceiver->iFd = -1;
+   _file_transfer_receiver_free_parity(pReceiver);
+   unlink(pReceiver->szStateFile);
+   pReceiver->iComplete = 1;
+   log_line("[FileTransfer] Received transfer %u, file %s: %u segments (%u duplicates, %u rebuilt from %u parity segments, %u resumed).",
+      pReceiver->uTransferId, pReceiver->szFile, pReceiver->uTotalSegments, pReceiver->stats.uCountDuplicates,
+      pReceiver->stats.uCountRecovered, pReceiver->stats.uCountParityReceived, pReceiver->stats.uCountResumedSegments);
+}
+
+static int _file_transfer_receiver_store_segment(t_file_transfer_receiver* pReceiver, u32 uSegmentIndex, u8* pData, int iLength)
+{
+   if ( iLength > 0 )
+   if ( iLength != pwrite(pReceiver->iFd, pData, iLength, (off_t)uSegmentIndex * pReceiver->iSegmentSize) )
+   {
+      log_softerror_and_alarm("[FileTransfer] Failed to write segment %u to file %s", uSegmentIndex, pReceiver->szFile);
+      return -1;
+   }
+   pReceiver->pReceived[uSegmentIndex] = 1;
+   pReceiver->uCountReceived++;
+   pReceiver->uCountSinceStateSave++;
+   if ( pReceiver->uCountSinceStateSave >= FILE_TRANSFER_STATE_SAVE_INTERVAL )
+      _file_transfer_receiver_save_state(pReceiver);
+   return 0;
+}
+
+// Rebuilds the missing segment of a group if it's the only one missing and the parity segment was received
+static void _file_transfer_receiver_check_group(t_file_transfer_receiver* pReceiver, u32 uGroupIndex)
+{
+   u8** ppParity = &(pReceiver->ppParity[uGroupIndex]);
+   u32 uFirst = uGroupIndex * (u32)pReceiver->iFECGroupSize;
+   u32 uLast = uFirst + (u32)pReceiver->iFECGroupSize;
+   if ( uLast > pReceiver->uTotalSegments )
+      uLast = pReceiver->uTotalSegments;
+
+   int iCountMissing = 0;
+   u32 uMissing = 0;
+   for( u32 u=uFirst; u<uLast; u++ )
+   {
+      if ( ! pReceiver->pReceived[u] )
+      {
+         iCountMissing++;
+         uMissing = u;
+      }
+   }
+   if ( (0 != iCountMissing) && ((1 != iCountMissing) || (NULL == *ppParity)) )
+      return;
+
+   if ( 1 == iCountMissing )
+   {
+      u8 uBuffer[FILE_TRANSFER_MAX_SEGMENT_SIZE];
+      u8* pParity = *ppParity;
+      for( u32 u=uFirst; u<uLast; u++ )
+      {
+         if ( u == uMissing )
+            continue;
+         int iLength = _file_transfer_get_segment_length(pReceiver->uFileSize, pReceiver->iSegmentSize, u);
+         if ( iLength != pread(pReceiver->iFd, uBuffer, iLength, (off_t)u * pReceiver->iSegmentSize) )
+            return;
+         for( int i=0; i<iLength; i++ )
+            pParity[i] ^= uBuffer[i];
+      }
+      int iLength = _file_transfer_get_segment_length(pReceiver->uFileSize, pReceiver->iSegmentSize, uMissing);
+      if ( 0 == _file_transfer_receiver_store_segment(pReceiver, uMissing, pParity, iLength) )
+         pReceiver->stats.uCountRecovered++;
+   }
+   if ( NULL != *ppParity )
+      free(*ppParity);
+   *ppParity = NULL;
+}
+
+int file_transfer_receiver_on_segment(t_file_transfer_receiver* pReceiver, u8* pData, int iLength)
+{
+   if ( (NULL == pReceiver) || (NULL == pData) || (iLength < (int)sizeof(t_file_transfer_segment_header)) )
+      return -1;
+   t_file_transfer_segment_header* pHeader = (t_file_transfer_segment_header*)pData;
+   u8* pSegmentData = pData + sizeof(t_file_transfer_segment_header);
+   if ( (int)(sizeof(t_file_transfer_segment_header) + pHeader->uDataLength) > iLength )
+      return -1;
+
+   if ( (! pReceiver->iStarted) || (pHeader->uTransferId != pReceiver->uTransferId) ||
+        (pHeader->uFileSize != pReceiver->uFileSize) || (pHeader->uSegmentSize != pReceiver->iSegmentSize) ||
+        (pHeader->uFECGroupSize != pReceiver->iFECGroupSize) )
+   {
+      if ( pReceiver->iStarted )
+         log_line("[FileTransfer] New transfer %u replaces the partial transfer %u of file %s", pHeader->uTransferId, pReceiver->uTransferId, pReceiver->szFile);
+      if ( 0 != _file_transfer_receiver_start(pReceiver, pHeader) )
+         return -1;
+   }
+   pReceiver->uLastEchoSendTime = pHeader->uSendTime;
+   if ( pReceiver->iComplete )
+   {
+      pReceiver->stats.uCountDuplicates++;
+      return 0;
+   }
+
+   if ( pHeader->uFlags & FILE_TRANSFER_SEGMENT_FLAG_PARITY )
+   {
+      if ( (0 == pReceiver->iFECGroupSize) || (pHeader->uSegmentIndex > pReceiver->uTotalSegments/pReceiver->iFECGroupSize) ||
+           (pHeader->uDataLength > pReceiver->iSegmentSize) )
+         return -1;
+      pReceiver->stats.uCountParityReceived++;
+      u8** ppParity = &(pReceiver->ppParity[pHeader->uSegmentIndex]);
+      if ( NULL == *ppParity )
+      {
+         *ppParity = (u8*) malloc(pReceiver->iSegmentSize);
+         if ( NULL == *ppParity )
+            return -1;
+         memset(*ppParity, 0, pReceiver->iSegmentSize);
+         memcpy(*ppParity, pSegmentData, pHeader->uDataLength);
+      }
+      u32 uCountBefore = pReceiver->uCountReceived;
+      _file_transfer_receiver_check_group(pReceiver, pHeader->uSegmentIndex);
+      _file_transfer_receiver_check_complete(pReceiver);
+      return (pReceiver->uCountReceived != uCountBefore)?1:0;
+   }
+
+   if ( pHeader->uSegmentIndex >= pReceiver->uTotalSegments )
+      return -1;
+   if ( pHeader->uDataLength != _file_transfer_get_segment_length(pReceiver->uFileSize, pReceiver->iSegmentSize, pHeader->uSegmentIndex) )
+      return -1;
+   if ( pReceiver->pReceived[pHeader->uSegmentIndex] )
+   {
+      pReceiver->stats.uCountDuplicates++;
+      return 0;
+   }
+   if ( 0 != _file_transfer_receiver_store_segment(pReceiver, pHeader->uSegmentIndex, pSegmentData, pHeader->uDataLength) )
+      return -1;
+   pReceiver->stats.uCountSegmentsReceived++;
+   if ( pReceiver->iFECGroupSize > 0 )
+      _file_transfer_receiver_check_group(pReceiver, pHeader->uSegmentIndex/pReceiver->iFECGroupSize);
+   _file_transfer_receiver_check_complete(pReceiver);
+   return 1;
+}
+
+void file_transfer_receiver_get_ack(t_file_transfer_receiver* pReceiver, t_file_transfer_ack* pAck)
+{
+   if ( (NULL == pReceiver) || (NULL == pAck) )
+      return;
+   memset(pAck, 0, sizeof(t_file_transfer_ack));
+   pAck->uTransferId = pReceiver->uTransferId;
+   pAck->uWindow = (u8)pReceiver->iWindow;
+   pAck->uEchoSendTime = pReceiver->uLastEchoSendTime;
+   if ( ! pReceiver->iStarted )
+      return;
+   pAck->uFileSize = pReceiver->uFileSize;
+   pAck->uCumulativeAck = pReceiver->uCumulativeAck;
+   for( int i=0; i<FILE_TRANSFER_SACK_SEGMENTS; i++ )
+   {
+      u32 uSegment = pReceiver->uCumulativeAck + 1 + (u32)i;
+      if ( uSegment >= pReceiver->uTotalSegments )
+         break;
+      if ( pReceiver->pReceived[uSegment] )
+         pAck->uSackBitmap[i/32] |= ((u32)1) << (i%32);
+   }
+   if ( pReceiver->iComplete )
+      pAck->uFlags |= FILE_TRANSFER_ACK_FLAG_COMPLETE;
+}
+
+int file_transfer_receiver_is_complete(t_file_transfer_receiver* pReceiver)
+{
+   if ( NULL == pReceiver )
+      return 0;
+   return pReceiver->iComplete;
+}
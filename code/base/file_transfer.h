@@ -0,0 +1,157 @@
+#pragma once
+#include "base.h"
+#include "config_file_names.h"
+
+// Windowed file transfer engine (used for vehicle logs download and file uploads to the vehicle).
+// The sender keeps up to a window of segments in flight and the receiver acknowledges them with a
+// cumulative ack plus a selective ack bitmap, so lost segments are resent without stopping the flow.
+// Optionally, after each group of data segments the sender adds a XOR parity segment, so a single lost
+// segment in a group is rebuilt by the receiver without a resend.
+// The sender reads the file through a read only memory map; the receiver writes segments straight to
+// the output file and keeps a state file next to it, so an interrupted transfer resumes where it stopped.
+// The engine does no I/O on the link: segments and acks go through the owner callback / structures.
+// Transfer ids are the CRC of the file content (unless the owner sets one), so a partial transfer
+// is only resumed for the same file content.
+
+#define FILE_TRANSFER_DEFAULT_SEGMENT_SIZE 1024
+#define FILE_TRANSFER_MAX_SEGMENT_SIZE 1100
+#define FILE_TRANSFER_MAX_SEGMENTS 16384
+#define FILE_TRANSFER_DEFAULT_WINDOW 16
+#define FILE_TRANSFER_MAX_WINDOW 64
+#define FILE_TRANSFER_SACK_SEGMENTS 64
+#define FILE_TRANSFER_DEFAULT_FEC_GROUP 8
+#define FILE_TRANSFER_MIN_RTO_MS 100
+#define FILE_TRANSFER_MAX_RTO_MS 4000
+// A segment is considered lost once this many later segments were acknowledged
+#define FILE_TRANSFER_DUP_ACK_THRESHOLD 3
+
+#define FILE_TRANSFER_SEGMENT_FLAG_PARITY 0x01
+
+#define FILE_TRANSFER_ACK_FLAG_COMPLETE 0x01
+#define FILE_TRANSFER_ACK_FLAG_ABORT 0x02
+
+typedef struct
+{
+   u32 uTransferId;
+   u32 uFileSize;
+   u16 uSegmentSize;
+   u8  uFECGroupSize; // data segments per parity segment, 0 for no parity segments
+   u8  uFlags;
+   u32 uSegmentIndex; // data segment index, or group index for parity segments
+   u16 uDataLength;
+   u32 uSendTime; // sender time, echoed back in the acks (RTT)
+} __attribute__((packed)) t_file_transfer_segment_header;
+
+typedef struct
+{
+   u32 uTransferId;
+   u32 uFileSize; // 0 if the receiver has no state for this transfer yet
+   u32 uCumulativeAck; // all data segments before this one are received
+   u32 uSackBitmap[FILE_TRANSFER_SACK_SEGMENTS/32]; // bit i: segment uCumulativeAck+1+i is received
+   u32 uEchoSendTime;
+   u8  uWindow;
+   u8  uFlags;
+} __attribute__((packed)) t_file_transfer_ack;
+
+// Sends one segment (header and data) on the link. Returns the number of bytes sent.
+typedef int (*file_transfer_send_callback)(void* pContext, u8* pData, int iLength);
+
+#define FILE_TRANSFER_SEGMENT_NOT_SENT 0
+#define FILE_TRANSFER_SEGMENT_IN_FLIGHT 1
+#define FILE_TRANSFER_SEGMENT_LOST 2
+#define FILE_TRANSFER_SEGMENT_ACKED 3
+
+typedef struct
+{
+   u32 uCountSegmentsSent;
+   u32 uCountSegmentsResent;
+   u32 uCountParitySent;
+   u32 uCountAcks;
+   u32 uCountTimeouts;
+} t_file_transfer_sender_stats;
+
+typedef struct
+{
+   u32 uTransferId;
+   u32 uFileSize;
+   int iSegmentSize;
+   u32 uTotalSegments;
+   int iFECGroupSize;
+   int iWindow;
+   int iPeerWindow;
+
+   int iFd;
+   u8* pMap;
+   const u8* pData;
+
+   u8* pSegmentState;
+   u32* pSegmentSendTime;
+   u32 uCumulativeAck;
+   u32 uHighestAcked;
+   u32 uNextNewSegment;
+   u32 uNextParityGroup;
+   int iInFlight;
+
+   int iSRTT; // ms, 0 until the first sample
+   int iRTTVar;
+   int iRTO;
+   int iComplete;
+   int iAborted;
+
+   file_transfer_send_callback pSendCallback;
+   void* pContext;
+   t_file_transfer_sender_stats stats;
+} t_file_transfer_sender;
+
+typedef struct
+{
+   u32 uCountSegmentsReceived;
+   u32 uCountDuplicates;
+   u32 uCountRecovered; // rebuilt from parity
+   u32 uCountParityReceived;
+   u32 uCountResumedSegments;
+} t_file_transfer_receiver_stats;
+
+typedef struct
+{
+   u32 uTransferId;
+   u32 uFileSize;
+   int iSegmentSize;
+   u32 uTotalSegments;
+   int iFECGroupSize;
+   int iWindow;
+   int iStarted; // transfer params are known (from a segment or the resume state)
+
+   int iFd;
+   char szFile[MAX_FILE_PATH_SIZE];
+   char szStateFile[MAX_FILE_PATH_SIZE];
+
+   u8* pReceived;
+   u32 uCountReceived;
+   u32 uCumulativeAck;
+   u8** ppParity; // received parity segment of each group, until the group is complete
+   u32 uLastEchoSendTime;
+   u32 uCountSinceStateSave;
+   int iComplete;
+
+   t_file_transfer_receiver_stats stats;
+} t_file_transfer_receiver;
+
+// uTransferId 0: use the CRC of the file content as the transfer id
+int file_transfer_sender_open_file(t_file_transfer_sender* pSender, u32 uTransferId, const char* szFile, int iSegmentSize, int iFECGroupSize, file_transfer_send_callback pCallback, void* pContext);
+int file_transfer_sender_open_buffer(t_file_transfer_sender* pSender, u32 uTransferId, const u8* pData, u32 uSize, int iSegmentSize, int iFECGroupSize, file_transfer_send_callback pCallback, void* pContext);
+void file_transfer_sender_close(t_file_transfer_sender* pSender);
+void file_transfer_sender_on_ack(t_file_transfer_sender* pSender, t_file_transfer_ack* pAck, u32 uTimeNow);
+// Resends timed out and lost segments, then sends new ones, as the window allows. Returns the count of segments sent.
+int file_transfer_sender_send(t_file_transfer_sender* pSender, u32 uTimeNow);
+int file_transfer_sender_is_complete(t_file_transfer_sender* pSender);
+
+// The transfer params come with the first segment; a previous partial transfer of the same file is resumed.
+// uTransferId 0: accept any transfer (the id comes with the first segment)
+int file_transfer_receiver_open(t_file_transfer_receiver* pReceiver, u32 uTransferId, const char* szFile, int iWindow);
+// Keeps the state file if the transfer is not complete
+void file_transfer_receiver_close(t_file_transfer_receiver* pReceiver);
+// Returns 1 if the segment brought new data, 0 if not, -1 on error
+int file_transfer_receiver_on_segment(t_file_transfer_receiver* pReceiver, u8* pData, int iLength);
+void file_transfer_receiver_get_ack(t_file_transfer_receiver* pReceiver, t_file_transfer_ack* pAck);
+int file_transfer_receiver_is_complete(t_file_transfer_receiver* pReceiver);
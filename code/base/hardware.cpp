@@ -119,6 +119,9 @@ u32 s_TimeLastRecordingLedBlink = 0;
 
 bool s_bHarwareHasDetectedSystemType = false;
 u32  s_uHardwareBoardType = 0;
+// The board type does not change while running, detect it (it runs shell commands) only once per process
+bool s_bHardwareOnlyBoardTypeDetected = false;
+u32  s_uHardwareOnlyBoardTypeDetected = 0;
 int  s_iHardwareSystemIsVehicle = 0;
 
 int s_iHardwareJoystickCount = 0;
@@ -450,6 +453,12 @@ void hardware_swap_buttons(int swap)
 
 u32 hardware_getOnlyBoardType()
 {
+   if ( s_bHardwareOnlyBoardTypeDetected )
+   {
+      s_uHardwareBoardType = s_uHardwareOnlyBoardTypeDetected;
+      return s_uHardwareBoardType;
+   }
+
    #ifdef HW_PLATFORM_RASPBERRY
    char szBuff[256];
    hw_execute_bash_command("cat /proc/cpuinfo | grep 'Revision' | awk '{print $3}'", szBuff);
@@ -524,6 +533,8 @@ u32 hardware_getOnlyBoardType()
 
    #endif
 
+   s_bHardwareOnlyBoardTypeDetected = true;
+   s_uHardwareOnlyBoardTypeDetected = s_uHardwareBoardType;
    return s_uHardwareBoardType;
 }
 
@@ -35,6 +35,7 @@
 #include "hardware_camera.h"
 #include "hw_procs.h"
 #include "hardware_i2c.h"
+#include "majestic_config.h"
 #include "../common/string_utils.h"
 
 #include <ctype.h>
@@ -341,59 +342,54 @@ int hardware_isCameraHDMI()
 }
 
 
-void hardware_camera_apply_all_majestic_camera_settings(camera_profile_parameters_t* pCameraParams, bool bForceUpdate)
+static void _hardware_camera_add_majestic_camera_settings(t_majestic_config_batch* pBatch, camera_profile_parameters_t* pCameraParams)
 {
-   if ( NULL == pCameraParams )
-   {
-      log_softerror_and_alarm("Received invalid params to set majestic camera settings.");
-      return;
-   }
-   char szComm[128];
-
-   sprintf(szComm, "cli -s .image.luminance %d", pCameraParams->brightness);
-   hw_execute_bash_command_raw(szComm, NULL);
-
-   sprintf(szComm, "cli -s .image.contrast %d", pCameraParams->contrast);
-   hw_execute_bash_command_raw(szComm, NULL);
+   majestic_config_batch_set_int(pBatch, ".image.luminance", pCameraParams->brightness);
+   majestic_config_batch_set_int(pBatch, ".image.contrast", pCameraParams->contrast);
+   majestic_config_batch_set_int(pBatch, ".image.saturation", 50 + (pCameraParams->saturation-100)/2);
+   majestic_config_batch_set_int(pBatch, ".image.hue", pCameraParams->hue);
+   majestic_config_batch_set_bool(pBatch, ".image.flip", pCameraParams->flip_image);
+   majestic_config_batch_set_bool(pBatch, ".image.mirror", pCameraParams->flip_image);
 
-   sprintf(szComm, "cli -s .image.saturation %d", 50 + (pCameraParams->saturation-100)/2);
-   hw_execute_bash_command_raw(szComm, NULL);
-
-   sprintf(szComm, "cli -s .image.hue %d", pCameraParams->hue);
-   hw_execute_bash_command_raw(szComm, NULL);
+   if ( 0 == pCameraParams->shutterspeed )
+      majestic_config_batch_delete(pBatch, ".isp.exposure");
+   // exposure is in milisec for ssc338q
+   else if ( hardware_board_is_sigmastar(hardware_getBoardType()) )
+      majestic_config_batch_set_int(pBatch, ".isp.exposure", pCameraParams->shutterspeed);
+}
 
-   if ( pCameraParams->flip_image )
-   {
-      hw_execute_bash_command_raw("cli -s .image.flip true", NULL);
-      hw_execute_bash_command_raw("cli -s .image.mirror true", NULL);
-   }
-   else
+static void _hardware_camera_commit_majestic_batch(t_majestic_config_batch* pBatch, bool bReload)
+{
+   u32 uTimeStart = get_current_timestamp_ms();
+   int iCountChanged = majestic_config_batch_apply(pBatch, MAJESTIC_CONFIG_FILE);
+   if ( iCountChanged < 0 )
    {
-      hw_execute_bash_command_raw("cli -s .image.flip false", NULL);
-      hw_execute_bash_command_raw("cli -s .image.mirror false", NULL);
+      log_softerror_and_alarm("Hardware camera: failed to update majestic config file directly, use majestic cli instead.");
+      majestic_config_batch_apply_using_cli(pBatch);
+      iCountChanged = pBatch->iCountChanges;
    }
+   int iCountSignaled = 0;
+   if ( bReload && (iCountChanged > 0) )
+      iCountSignaled = majestic_config_signal_reload(MAJESTIC_PROCESS_NAME);
+   log_line("Hardware camera: applied %d majestic settings (%d changed) in %u ms, reload signaled to %d processes.",
+      pBatch->iCountChanges, iCountChanged, get_current_timestamp_ms() - uTimeStart, iCountSignaled);
+}
 
-   if ( 0 == pCameraParams->shutterspeed )
+void hardware_camera_apply_all_majestic_camera_settings(camera_profile_parameters_t* pCameraParams, bool bForceUpdate)
+{
+   if ( NULL == pCameraParams )
    {
-      sprintf(szComm, "cli -d .isp.exposure");
-      hw_execute_bash_command_raw(szComm, NULL);      
+      log_softerror_and_alarm("Received invalid params to set majestic camera settings.");
+      return;
    }
-   else
-   {
-      //if ( hardware_board_is_goke(hardware_getBoardType()) )
-      //   sprintf(szComm, "cli -s .isp.exposure %.2f", (float)pCameraParams->shutterspeed/1000.0);
 
-      // exposure is in milisec for ssc338q
-      if ( hardware_board_is_sigmastar(hardware_getBoardType()) )
-         sprintf(szComm, "cli -s .isp.exposure %d", pCameraParams->shutterspeed);
-      hw_execute_bash_command_raw(szComm, NULL);
-   }
+   t_majestic_config_batch batch;
+   majestic_config_batch_init(&batch);
+   _hardware_camera_add_majestic_camera_settings(&batch, pCameraParams);
+   _hardware_camera_commit_majestic_batch(&batch, bForceUpdate);
 
    hardware_camera_set_irfilter_off(pCameraParams->uFlags & CAMERA_FLAG_IR_FILTER_OFF);
    hardware_camera_set_daylight_off(pCameraParams->uFlags & CAMERA_FLAG_OPENIPC_DAYLIGHT_OFF);
-
-   if ( bForceUpdate )
-      hw_execute_bash_command_raw("killall -1 majestic", NULL);
 }
 
 void hardware_camera_apply_all_majestic_settings(Model* pModel, camera_profile_parameters_t* pCameraParams, int iVideoProfile, video_parameters_t* pVideoParams)
@@ -403,41 +399,43 @@ void hardware_camera_apply_all_majestic_settings(Model* pModel, camera_profile_p
       log_softerror_and_alarm("Received invalid params to set majestic settings.");
       return;
    }
-   char szComm[128];
+   char szValue[64];
+   t_majestic_config_batch batch;
+   majestic_config_batch_init(&batch);
 
-   hw_execute_bash_command_raw("cli -s .watchdog.enabled false", NULL);
-   hw_execute_bash_command_raw("cli -s .system.logLevel info", NULL);
-   hw_execute_bash_command_raw("cli -s .rtsp.enabled false", NULL);
-   hw_execute_bash_command_raw("cli -s .video1.enabled false", NULL);
-   hw_execute_bash_command_raw("cli -s .video0.enabled true", NULL);
-   hw_execute_bash_command_raw("cli -s .video0.rcMode cbr", NULL);
+   majestic_config_batch_set_bool(&batch, ".watchdog.enabled", 0);
+   majestic_config_batch_set(&batch, ".system.logLevel", "info");
+   majestic_config_batch_set_bool(&batch, ".rtsp.enabled", 0);
+   majestic_config_batch_set_bool(&batch, ".video1.enabled", 0);
+   majestic_config_batch_set_bool(&batch, ".video0.enabled", 1);
+   majestic_config_batch_set(&batch, ".video0.rcMode", "cbr");
 
    if ( pVideoParams->uVideoExtraFlags & VIDEO_FLAG_GENERATE_H265 )
-      hw_execute_bash_command_raw("cli -s .video0.codec h265", NULL);
+      majestic_config_batch_set(&batch, ".video0.codec", "h265");
    else
-      hw_execute_bash_command_raw("cli -s .video0.codec h264", NULL);
-
-   sprintf(szComm, "cli -s .video0.fps %d", pModel->video_link_profiles[iVideoProfile].fps);
-   hw_execute_bash_command_raw(szComm, NULL);
+      majestic_config_batch_set(&batch, ".video0.codec", "h264");
 
-   sprintf(szComm, "cli -s .video0.bitrate %d", pModel->video_link_profiles[iVideoProfile].bitrate_fixed_bps/1000);
-   hw_execute_bash_command_raw(szComm, NULL);
+   majestic_config_batch_set_int(&batch, ".video0.fps", pModel->video_link_profiles[iVideoProfile].fps);
+   majestic_config_batch_set_int(&batch, ".video0.bitrate", pModel->video_link_profiles[iVideoProfile].bitrate_fixed_bps/1000);
 
-   sprintf(szComm, "cli -s .video0.size %dx%d", pModel->video_link_profiles[iVideoProfile].width, pModel->video_link_profiles[iVideoProfile].height);
-   hw_execute_bash_command_raw(szComm, NULL);
+   sprintf(szValue, "%dx%d", pModel->video_link_profiles[iVideoProfile].width, pModel->video_link_profiles[iVideoProfile].height);
+   majestic_config_batch_set(&batch, ".video0.size", szValue);
 
    float fGOP = 0.5;
    int keyframe_ms = pModel->getInitialKeyframeIntervalMs(iVideoProfile);
    fGOP = ((float)keyframe_ms) / 1000.0;
    
    log_line("Hardware camera: set majestic NAL size to %d bytes (for video profile index: %d)", pModel->video_link_profiles[iVideoProfile].video_data_length, iVideoProfile);
-   sprintf(szComm, "cli -s .outgoing.naluSize %d", pModel->video_link_profiles[iVideoProfile].video_data_length);
-   hw_execute_bash_command_raw(szComm, NULL);
+   majestic_config_batch_set_int(&batch, ".outgoing.naluSize", pModel->video_link_profiles[iVideoProfile].video_data_length);
 
-   sprintf(szComm, "cli -s .video0.gopSize %.1f", fGOP);
-   hw_execute_bash_command_raw(szComm, NULL);
+   sprintf(szValue, "%.1f", fGOP);
+   majestic_config_batch_set(&batch, ".video0.gopSize", szValue);
 
-   hardware_camera_apply_all_majestic_camera_settings(pCameraParams, true);
+   _hardware_camera_add_majestic_camera_settings(&batch, pCameraParams);
+   _hardware_camera_commit_majestic_batch(&batch, true);
+
+   hardware_camera_set_irfilter_off(pCameraParams->uFlags & CAMERA_FLAG_IR_FILTER_OFF);
+   hardware_camera_set_daylight_off(pCameraParams->uFlags & CAMERA_FLAG_OPENIPC_DAYLIGHT_OFF);
 }
 
 void hardware_camera_set_irfilter_off(int iOff)
@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include "config_hw.h"
 
 #ifdef HW_CAPABILITY_I2C
@@ -117,6 +118,120 @@ void hardware_i2c_log_devices()
       log_line("[Hardware] Dev I2CAddress/Type: %s", szBuff);
 }
 
+#ifdef HW_CAPABILITY_I2C
+typedef struct
+{
+   int iBusIndex;
+   u32 uBoardType;
+   int iCountDevices;
+   int iCountKnownDevices;
+   int iCountConfigurableDevices;
+} t_i2c_bus_scan_info;
+
+static void* _thread_hardware_i2c_scan_bus(void *argument)
+{
+   t_i2c_bus_scan_info* pScanInfo = (t_i2c_bus_scan_info*)argument;
+   if ( NULL == pScanInfo )
+      return NULL;
+
+   int i = pScanInfo->iBusIndex;
+   u32 uBoardType = pScanInfo->uBoardType;
+   char szBuff[256];
+   char szOutput[1024];
+
+   for( int k=0; k<128; k++ )
+      s_HardwareI2CBusInfo[i].devices[k] = 0;
+   int iCountDevicesFoundOnThisBus = 0;
+   int iCountKnownDevices = 0;
+   int iCountConfigurableDevices = 0;
+
+   for( int k=0; k<8; k++ )
+   {
+      int addrStart = k*16;
+      int addrEnd = k*16+15;
+      if ( k == 0 )
+         addrStart = 3;
+      if ( k == 7 )
+         addrEnd = (7*16)+7;
+
+      if ( ((uBoardType & BOARD_TYPE_MASK) == BOARD_TYPE_PI4B) && (0 == s_HardwareI2CBusInfo[i].nBusNumber) )
+      {
+         if ( k == 0 )
+            addrStart = addrEnd = I2C_DEVICE_ADDRESS_CAMERA_HDMI;
+         if ( k == 1 )
+            addrStart = addrEnd = I2C_DEVICE_ADDRESS_CAMERA_CSI;
+         if ( k == 2 )
+            addrStart = addrEnd = I2C_DEVICE_ADDRESS_CAMERA_VEYE;
+         if ( k == 3 )
+            addrStart = addrEnd = I2C_DEVICE_ADDRESS_PICO_EXTENDER;
+         if ( k > 3 )
+            break;
+         log_line("[Hardware]: Pi4: Searching for device on bus %d at address: 0x%02X", s_HardwareI2CBusInfo[i].nBusNumber, addrStart);
+      }
+
+      sprintf( szBuff, "i2cdetect -y %d 0x%02X 0x%02X | tr '\n' ' ' | sed -e 's/[^0-9a-fA-F]/ /g' -e 's/^ *//g' -e 's/ *$//g' | tr -s ' ' | sed $'s/ /\\\n/g'", s_HardwareI2CBusInfo[i].nBusNumber, addrStart, addrEnd);
+      hw_execute_bash_command_raw_silent(szBuff, szOutput);
+
+      if ( 0 == szOutput[0] )
+         continue;
+      const char* szTokens = " \n";
+      char* szContext = szOutput;
+      char* szWord = NULL;
+      int count = 0;
+      int toSkip = 16 + k + 1;
+      while ( (szWord = strtok_r(szContext, szTokens, &szContext)) )
+      {
+         count++;
+         if ( count <= toSkip )
+           continue;
+         long l = strtol(szWord,NULL, 16);
+         if ( l >= 16*(k+1) )
+           break;
+         if ( l >= addrStart && l <= addrEnd && l >= 0 && l < 128 )
+         {
+            s_HardwareI2CBusInfo[i].devices[l] = 1;
+            log_line("[Hardware]: Found I2C Device on bus i2c-%d at address 0x%02X", s_HardwareI2CBusInfo[i].nBusNumber, l);
+            if ( hardware_is_known_i2c_device((u8)l) )
+               iCountKnownDevices++;
+            if ( (l == I2C_DEVICE_ADDRESS_PICO_EXTENDER) ||
+                 (l == I2C_DEVICE_ADDRESS_INA219_1) ||
+                 (l == I2C_DEVICE_ADDRESS_INA219_2) ||
+                 ((l >= I2C_DEVICE_MIN_ADDRESS_RANGE) && (l <= I2C_DEVICE_MAX_ADDRESS_RANGE)) )
+               iCountConfigurableDevices++;
+
+            if ( l == I2C_DEVICE_ADDRESS_PICO_EXTENDER )
+            {
+               log_line("[Hardware]: Found Pico Extender I2C device. Getting version info...");
+               int nFile = wiringPiI2CSetup(I2C_DEVICE_ADDRESS_PICO_EXTENDER);
+               int nVersion = 0;
+               if ( nFile > 0 )
+               {
+                  nVersion = wiringPiI2CReadReg8(nFile, I2C_DEVICE_COMMAND_ID_GET_VERSION);
+                  close(nFile);
+               }
+               log_line("[Hardware]: Got Pico Extender version: %d.%d", nVersion>>4, nVersion & 0x0F);
+               s_HardwareI2CBusInfo[i].picoExtenderVersion = (u8)nVersion;
+            }
+            iCountDevicesFoundOnThisBus++;
+         }
+      }
+   }
+   if ( iCountDevicesFoundOnThisBus > 50 )
+   {
+      log_softerror_and_alarm("[Hardware]: Found too many I2C devices on a single I2C Bus. Probabbly it's broken. Invalidate all detected devices on this bus.");
+      for( int k=0; k<128; k++ )
+         s_HardwareI2CBusInfo[i].devices[k] = 0;
+      iCountDevicesFoundOnThisBus = 0;
+      iCountKnownDevices = 0;
+      iCountConfigurableDevices = 0;
+   }
+   pScanInfo->iCountDevices = iCountDevicesFoundOnThisBus;
+   pScanInfo->iCountKnownDevices = iCountKnownDevices;
+   pScanInfo->iCountConfigurableDevices = iCountConfigurableDevices;
+   return NULL;
+}
+#endif
+
 void hardware_enumerate_i2c_busses()
 {
    if ( 0 != s_iHardwareI2CBussesEnumerated )
@@ -189,93 +304,32 @@ void hardware_enumerate_i2c_busses()
    int countDevicesTotal = 0;
 
 #ifdef HW_CAPABILITY_I2C
+   // Each bus is scanned on its own thread, as each scan runs several i2cdetect commands
    u32 uBoardType = hardware_getOnlyBoardType();
-   char szOutput[1024];
+   t_i2c_bus_scan_info scanInfo[MAX_I2C_BUS_COUNT];
+   pthread_t pThreads[MAX_I2C_BUS_COUNT];
+   int bThreadStarted[MAX_I2C_BUS_COUNT];
+
    for( int i=0; i<s_iHardwareI2CBusCount; i++ )
    {
-      for( int k=0; k<128; k++ )
-         s_HardwareI2CBusInfo[i].devices[k] = 0;
-      int iCountDevicesFoundOnThisBus = 0;
-
-      for( int k=0; k<8; k++ )
-      {
-         int addrStart = k*16;
-         int addrEnd = k*16+15;
-         if ( k == 0 )
-            addrStart = 3;
-         if ( k == 7 )
-            addrEnd = (7*16)+7;
-
-         if ( ((uBoardType & BOARD_TYPE_MASK) == BOARD_TYPE_PI4B) && (0 == s_HardwareI2CBusInfo[i].nBusNumber) )
-         {
-            if ( k == 0 )
-               addrStart = addrEnd = I2C_DEVICE_ADDRESS_CAMERA_HDMI;
-            if ( k == 1 )
-               addrStart = addrEnd = I2C_DEVICE_ADDRESS_CAMERA_CSI;
-            if ( k == 2 )
-               addrStart = addrEnd = I2C_DEVICE_ADDRESS_CAMERA_VEYE;
-            if ( k == 3 )
-               addrStart = addrEnd = I2C_DEVICE_ADDRESS_PICO_EXTENDER;
-            if ( k > 3 )
-               break;
-            log_line("[Hardware]: Pi4: Searching for device on bus %d at address: 0x%02X", s_HardwareI2CBusInfo[i].nBusNumber, addrStart);
-         }
-
-         sprintf( szBuff, "i2cdetect -y %d 0x%02X 0x%02X | tr '\n' ' ' | sed -e 's/[^0-9a-fA-F]/ /g' -e 's/^ *//g' -e 's/ *$//g' | tr -s ' ' | sed $'s/ /\\\n/g'", s_HardwareI2CBusInfo[i].nBusNumber, addrStart, addrEnd);
-         hw_execute_bash_command_raw_silent(szBuff, szOutput);
+      memset(&scanInfo[i], 0, sizeof(t_i2c_bus_scan_info));
+      scanInfo[i].iBusIndex = i;
+      scanInfo[i].uBoardType = uBoardType;
+      bThreadStarted[i] = 0;
+      if ( s_iHardwareI2CBusCount > 1 )
+      if ( 0 == pthread_create(&pThreads[i], NULL, &_thread_hardware_i2c_scan_bus, &scanInfo[i]) )
+         bThreadStarted[i] = 1;
+      if ( ! bThreadStarted[i] )
+         _thread_hardware_i2c_scan_bus(&scanInfo[i]);
+   }
 
-         if ( 0 == szOutput[0] )
-            continue;
-         const char* szTokens = " \n";
-         char* szContext = szOutput;
-         char* szWord = NULL;
-         int count = 0;
-         int toSkip = 16 + k + 1;
-         while ( (szWord = strtok_r(szContext, szTokens, &szContext)) )
-         {
-            count++;
-            if ( count <= toSkip )
-              continue;
-            long l = strtol(szWord,NULL, 16);
-            if ( l >= 16*(k+1) )
-              break;
-            if ( l >= addrStart && l <= addrEnd && l >= 0 && l < 128 )
-            {
-               s_HardwareI2CBusInfo[i].devices[l] = 1;
-               log_line("[Hardware]: Found I2C Device on bus i2c-%d at address 0x%02X", s_HardwareI2CBusInfo[i].nBusNumber, l);
-               if ( hardware_is_known_i2c_device((u8)l) )
-                  s_iKnownDevicesFound++;
-               if ( (l == I2C_DEVICE_ADDRESS_PICO_EXTENDER) ||
-                    (l == I2C_DEVICE_ADDRESS_INA219_1) ||
-                    (l == I2C_DEVICE_ADDRESS_INA219_2) ||
-                    ((l >= I2C_DEVICE_MIN_ADDRESS_RANGE) && (l <= I2C_DEVICE_MAX_ADDRESS_RANGE)) )
-                  s_iKnownConfigurableDevicesFound++;
-
-               if ( l == I2C_DEVICE_ADDRESS_PICO_EXTENDER )
-               {
-                  log_line("[Hardware]: Found Pico Extender I2C device. Getting version info...");
-                  int nFile = wiringPiI2CSetup(I2C_DEVICE_ADDRESS_PICO_EXTENDER);
-                  int nVersion = 0;
-                  if ( nFile > 0 )
-                  {
-                     nVersion = wiringPiI2CReadReg8(nFile, I2C_DEVICE_COMMAND_ID_GET_VERSION);
-                     close(nFile);
-                  }
-                  log_line("[Hardware]: Got Pico Extender version: %d.%d", nVersion>>4, nVersion & 0x0F);
-                  s_HardwareI2CBusInfo[i].picoExtenderVersion = (u8)nVersion;
-               }
-               countDevicesTotal++;
-               iCountDevicesFoundOnThisBus++;
-            }
-         }
-      }
-      if ( iCountDevicesFoundOnThisBus > 50 )
-      {
-         log_softerror_and_alarm("[Hardware]: Found too many I2C devices on a single I2C Bus. Probabbly it's broken. Invalidate all detected devices on this bus.");
-         for( int k=0; k<128; k++ )
-            s_HardwareI2CBusInfo[i].devices[k] = 0;
-         countDevicesTotal -= iCountDevicesFoundOnThisBus;
-      }
+   for( int i=0; i<s_iHardwareI2CBusCount; i++ )
+   {
+      if ( bThreadStarted[i] )
+         pthread_join(pThreads[i], NULL);
+      countDevicesTotal += scanInfo[i].iCountDevices;
+      s_iKnownDevicesFound += scanInfo[i].iCountKnownDevices;
+      s_iKnownConfigurableDevicesFound += scanInfo[i].iCountConfigurableDevices;
    }
 #endif
    log_line("[Hardware]: Found a total of %d I2C devices on all busses.", countDevicesTotal);
@@ -1,8 +1,13 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/resource.h>
 #include <ctype.h>
 #include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
 
 #include "base.h"
 #include "config.h"
@@ -312,6 +317,150 @@ void hw_get_proc_priority(const char* szProgName, char* szOutput)
    strcat(szOutput, ";");
 }
 
+static int _hw_read_int_from_file(const char* szFile, int iDefault)
+{
+   FILE* fd = fopen(szFile, "r");
+   if ( NULL == fd )
+      return iDefault;
+   int iValue = iDefault;
+   if ( 1 != fscanf(fd, "%d", &iValue) )
+      iValue = iDefault;
+   fclose(fd);
+   return iValue;
+}
+
+// Parses a kernel cpu list (i.e. "0-3,6"). Returns the count of cpus added to piCPUs
+static int _hw_parse_cpus_list(const char* szList, int* piCPUs, int iMaxCPUs)
+{
+   int iCount = 0;
+   const char* pTmp = szList;
+   while ( (NULL != pTmp) && (*pTmp) && (iCount < iMaxCPUs) )
+   {
+      int iStart = 0, iEnd = 0;
+      if ( 1 != sscanf(pTmp, "%d", &iStart) )
+         break;
+      iEnd = iStart;
+      while ( isdigit(*pTmp) )
+         pTmp++;
+      if ( '-' == *pTmp )
+      {
+         pTmp++;
+         if ( 1 != sscanf(pTmp, "%d", &iEnd) )
+            break;
+         while ( isdigit(*pTmp) )
+            pTmp++;
+      }
+      for( int i=iStart; (i<=iEnd) && (iCount < iMaxCPUs); i++ )
+      {
+         if ( (i >= 0) && (i < HW_MAX_CPUS) )
+            piCPUs[iCount++] = i;
+      }
+      if ( ',' != *pTmp )
+         break;
+      pTmp++;
+   }
+   return iCount;
+}
+
+int hw_read_cpu_topology(const char* szCPUsFolder, t_hw_cpu_topology* pTopology)
+{
+   if ( NULL == pTopology )
+      return 0;
+   memset(pTopology, 0, sizeof(t_hw_cpu_topology));
+   if ( NULL == szCPUsFolder )
+      szCPUsFolder = "/sys/devices/system/cpu";
+
+   char szFile[MAX_FILE_PATH_SIZE];
+   char szList[256];
+   szList[0] = 0;
+   snprintf(szFile, sizeof(szFile), "%s/online", szCPUsFolder);
+   FILE* fd = fopen(szFile, "r");
+   if ( NULL != fd )
+   {
+      if ( NULL == fgets(szList, sizeof(szList), fd) )
+         szList[0] = 0;
+      fclose(fd);
+   }
+   pTopology->iCountCPUs = _hw_parse_cpus_list(szList, pTopology->iCPUs, HW_MAX_CPUS);
+   if ( 0 == pTopology->iCountCPUs )
+   {
+      int iCount = (int) sysconf(_SC_NPROCESSORS_ONLN);
+      if ( iCount < 1 )
+         iCount = 1;
+      if ( iCount > HW_MAX_CPUS )
+         iCount = HW_MAX_CPUS;
+      for( int i=0; i<iCount; i++ )
+         pTopology->iCPUs[i] = i;
+      pTopology->iCountCPUs = iCount;
+   }
+
+   // Relative performance: cpu_capacity on asymmetric (big.LITTLE) ARM SoCs, max frequency otherwise
+   for( int i=0; i<pTopology->iCountCPUs; i++ )
+   {
+      int iCPU = pTopology->iCPUs[i];
+      snprintf(szFile, sizeof(szFile), "%s/cpu%d/cpu_capacity", szCPUsFolder, iCPU);
+      pTopology->iCapacity[i] = _hw_read_int_from_file(szFile, 0);
+      if ( pTopology->iCapacity[i] <= 0 )
+      {
+         snprintf(szFile, sizeof(szFile), "%s/cpu%d/cpufreq/cpuinfo_max_freq", szCPUsFolder, iCPU);
+         pTopology->iCapacity[i] = _hw_read_int_from_file(szFile, 0);
+      }
+   }
+
+   // Fastest cpus first; same speed cpus keep their kernel order (insertion sort is stable)
+   for( int i=1; i<pTopology->iCountCPUs; i++ )
+   {
+      int iCPU = pTopology->iCPUs[i];
+      int iCapacity = pTopology->iCapacity[i];
+      int k = i-1;
+      while ( (k >= 0) && (pTopology->iCapacity[k] < iCapacity) )
+      {
+         pTopology->iCPUs[k+1] = pTopology->iCPUs[k];
+         pTopology->iCapacity[k+1] = pTopology->iCapacity[k];
+         k--;
+      }
+      pTopology->iCPUs[k+1] = iCPU;
+      pTopology->iCapacity[k+1] = iCapacity;
+   }
+
+   pTopology->iCountFastCPUs = 0;
+   for( int i=0; i<pTopology->iCountCPUs; i++ )
+   {
+      if ( pTopology->iCapacity[i] == pTopology->iCapacity[0] )
+         pTopology->iCountFastCPUs++;
+   }
+   return pTopology->iCountCPUs;
+}
+
+static t_hw_cpu_topology s_HWCPUTopology;
+static int s_iHWCPUTopologyRead = 0;
+
+const t_hw_cpu_topology* hw_get_cpu_topology()
+{
+   if ( s_iHWCPUTopologyRead )
+      return &s_HWCPUTopology;
+
+   hw_read_cpu_topology(NULL, &s_HWCPUTopology);
+   s_iHWCPUTopologyRead = 1;
+
+   char szCPUs[256];
+   szCPUs[0] = 0;
+   for( int i=0; i<s_HWCPUTopology.iCountCPUs; i++ )
+   {
+      char szTmp[32];
+      snprintf(szTmp, sizeof(szTmp), "%s%d(%d)", (i>0)?", ":"", s_HWCPUTopology.iCPUs[i], s_HWCPUTopology.iCapacity[i]);
+      strncat(szCPUs, szTmp, sizeof(szCPUs) - strlen(szCPUs) - 1);
+   }
+   log_line("CPU topology: %d online CPUs, %d fastest ones. CPUs (capacity), fastest first: %s",
+      s_HWCPUTopology.iCountCPUs, s_HWCPUTopology.iCountFastCPUs, szCPUs);
+   return &s_HWCPUTopology;
+}
+
+int hw_get_cpu_cores_count()
+{
+   return hw_get_cpu_topology()->iCountCPUs;
+}
+
 void hw_set_proc_affinity(const char* szProgName, int iCoreStart, int iCoreEnd)
 {
    if ( NULL == szProgName || 0 == szProgName[0] )
@@ -321,6 +470,27 @@ void hw_set_proc_affinity(const char* szProgName, int iCoreStart, int iCoreEnd)
    }
    log_line("Adjusting affinity for process [%s]...", szProgName);
 
+   // Core positions are in the topology order (fastest cpus first), not kernel cpu numbers
+   const t_hw_cpu_topology* pTopology = hw_get_cpu_topology();
+   cpu_set_t cpuSet;
+   CPU_ZERO(&cpuSet);
+   char szCPUs[128];
+   szCPUs[0] = 0;
+   for( int i=iCoreStart; i<=iCoreEnd; i++ )
+   {
+      if ( (i < 1) || (i > pTopology->iCountCPUs) )
+         continue;
+      CPU_SET(pTopology->iCPUs[i-1], &cpuSet);
+      char szTmp[16];
+      snprintf(szTmp, sizeof(szTmp), "%s%d", (0 != szCPUs[0])?",":"", pTopology->iCPUs[i-1]);
+      strncat(szCPUs, szTmp, sizeof(szCPUs) - strlen(szCPUs) - 1);
+   }
+   if ( 0 == szCPUs[0] )
+   {
+      log_softerror_and_alarm("Failed to set process affinity for process [%s], invalid cores %d-%d (%d CPUs).", szProgName, iCoreStart, iCoreEnd, pTopology->iCountCPUs);
+      return;
+   }
+
    char szComm[128];
    char szOutput[256];
    sprintf(szComm, "pidof %s", szProgName);
@@ -338,59 +508,33 @@ void hw_set_proc_affinity(const char* szProgName, int iCoreStart, int iCoreEnd)
       return;
    }
 
-   sprintf(szComm, "ls /proc/%d/task 2>/dev/null", iPID);
-   hw_execute_bash_command_raw_silent(szComm, szOutput);
-   
-   if ( strlen(szOutput) < 3 )
+   // Each thread of the process has its own affinity; threads created later inherit it
+   sprintf(szComm, "/proc/%d/task", iPID);
+   DIR* pDir = opendir(szComm);
+   if ( NULL == pDir )
    {
-      log_softerror_and_alarm("Failed to set process affinity for process [%s], invalid tasks: [%s].", szProgName, szOutput);
+      log_softerror_and_alarm("Failed to set process affinity for process [%s], can't read its tasks.", szProgName);
       return;
    }
 
-   for( int i=0; i<strlen(szOutput); i++ )
-      if ( szOutput[i] == 10 || szOutput[i] == 13 )
-         szOutput[i] = ' ';
-   
-   char* pTmp = &szOutput[0];
-   while ( (*pTmp) == ' ' )
-      pTmp++;
+   int iCountTasks = 0;
+   int iCountFailed = 0;
+   struct dirent* pEntry = NULL;
+   while ( NULL != (pEntry = readdir(pDir)) )
+   {
+      int iTask = atoi(pEntry->d_name);
+      if ( iTask <= 0 )
+         continue;
+      iCountTasks++;
+      if ( 0 != sched_setaffinity(iTask, sizeof(cpu_set_t), &cpuSet) )
+      {
+         log_softerror_and_alarm("Failed to set affinity of task %d of process [%s], error: %d", iTask, szProgName, errno);
+         iCountFailed++;
+      }
+   }
+   closedir(pDir);
 
-   log_line("Child processes to adjust affinity for, for process [%s] %d: [%s]", szProgName, iPID, szOutput);
-   do
-   {
-       int iTask = 0;
-       if ( 1 != sscanf(pTmp, "%d", &iTask) )
-       {
-          log_softerror_and_alarm("Failed to set process affinity for process [%s], invalid parsing tasks from [%s].", szProgName, pTmp);
-          return;
-       }
-       if ( iTask < 100 )
-       {
-          log_softerror_and_alarm("Failed to set process affinity for process [%s], read invalid parsing tasks (%d) from [%s].", szProgName, iTask, pTmp);
-          return;
-       }
-
-       // Set affinity
-       if ( iCoreStart == iCoreEnd )
-       {
-          sprintf(szComm, "taskset -cp %d %d 2>/dev/null", iCoreStart-1, iTask);
-          hw_execute_bash_command(szComm, NULL);
-       }
-       else
-       {
-          sprintf(szComm, "taskset -cp %d-%d %d", iCoreStart-1, iCoreEnd-1, iTask);
-          hw_execute_bash_command(szComm, NULL);        
-       }
-       // Go to next task in string
-       while ( (*pTmp) && (*pTmp != ' ') )
-          pTmp++;
-
-       while ( (*pTmp) && (*pTmp == ' ') )
-          pTmp++;
-   }
-   while(*pTmp);
-
-   log_line("Done adjusting affinity for process [%s].", szProgName);
+   log_line("Done adjusting affinity for process [%s] (pid %d): %d tasks set to CPUs %s, %d failed.", szProgName, iPID, iCountTasks, szCPUs, iCountFailed);
 }
 
 
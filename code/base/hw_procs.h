@@ -1,5 +1,17 @@
 #pragma once
 
+#define HW_MAX_CPUS 32
+
+// Online CPUs, ordered fastest first (by capacity on asymmetric SoCs, or by max frequency).
+// CPUs with the same capacity keep the kernel order.
+typedef struct
+{
+   int iCountCPUs;
+   int iCountFastCPUs; // CPUs with the highest capacity
+   int iCPUs[HW_MAX_CPUS]; // kernel CPU numbers
+   int iCapacity[HW_MAX_CPUS]; // 0 if not known
+} t_hw_cpu_topology;
+
 #ifdef __cplusplus
 extern "C" {
 #endif 
@@ -19,8 +31,15 @@ void hw_set_priority_current_proc(int nice);
 void hw_set_proc_priority(const char* szProgName, int nice, int ionice, int waitForProcess);
 void hw_get_proc_priority(const char* szProgName, char* szOutput);
 
+// iCoreStart, iCoreEnd: 1 based core positions in the CPU topology order (fastest CPUs first)
 void hw_set_proc_affinity(const char* szProgName, int iCoreStart, int iCoreEnd);
 
+// szCPUsFolder: NULL for the system one (/sys/devices/system/cpu). Returns the count of online CPUs
+int hw_read_cpu_topology(const char* szCPUsFolder, t_hw_cpu_topology* pTopology);
+// Read once, then cached
+const t_hw_cpu_topology* hw_get_cpu_topology();
+int hw_get_cpu_cores_count();
+
 int hw_execute_bash_command(const char* command, char* outBuffer);
 int hw_execute_bash_command_raw(const char* command, char* outBuffer);
 int hw_execute_bash_command_raw_silent(const char* command, char* outBuffer);
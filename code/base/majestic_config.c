@@ -0,0 +1,458 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <dirent.h>
+#include <signal.h>
+#include <ctype.h>
+#include "base.h"
+#include "hw_procs.h"
+#include "majestic_config.h"
+
+// Not reentrant: the config file is edited in these static line buffers
+#define MAJESTIC_CONFIG_MAX_LINES 512
+#define MAJESTIC_CONFIG_MAX_LINE_LENGTH 160
+#define MAJESTIC_CONFIG_MAX_DEPTH 4
+
+static char s_szMajesticLines[MAJESTIC_CONFIG_MAX_LINES][MAJESTIC_CONFIG_MAX_LINE_LENGTH];
+static int s_iMajesticCountLines = 0;
+
+void majestic_config_batch_init(t_majestic_config_batch* pBatch)
+{
+   if ( NULL != pBatch )
+      pBatch->iCountChanges = 0;
+}
+
+static t_majestic_config_change* _majestic_config_batch_get_slot(t_majestic_config_batch* pBatch, const char* szPath)
+{
+   if ( (NULL == pBatch) || (NULL == szPath) || (szPath[0] != '.') || (strlen(szPath) >= MAJESTIC_CONFIG_MAX_PATH) )
+   {
+      log_softerror_and_alarm("[MajesticConfig] Invalid config path: (%s)", (NULL != szPath)?szPath:"null");
+      return NULL;
+   }
+   // Last change for the same path wins
+   for( int i=0; i<pBatch->iCountChanges; i++ )
+   {
+      if ( 0 == strcmp(pBatch->changes[i].szPath, szPath) )
+         return &(pBatch->changes[i]);
+   }
+   if ( pBatch->iCountChanges >= MAJESTIC_CONFIG_MAX_CHANGES )
+   {
+      log_softerror_and_alarm("[MajesticConfig] Too many changes in batch, ignoring %s", szPath);
+      return NULL;
+   }
+   t_majestic_config_change* pChange = &(pBatch->changes[pBatch->iCountChanges]);
+   pBatch->iCountChanges++;
+   strcpy(pChange->szPath, szPath);
+   return pChange;
+}
+
+void majestic_config_batch_set(t_majestic_config_batch* pBatch, const char* szPath, const char* szValue)
+{
+   t_majestic_config_change* pChange = _majestic_config_batch_get_slot(pBatch, szPath);
+   if ( NULL == pChange )
+      return;
+   strncpy(pChange->szValue, (NULL != szValue)?szValue:"", MAJESTIC_CONFIG_MAX_VALUE-1);
+   pChange->szValue[MAJESTIC_CONFIG_MAX_VALUE-1] = 0;
+   pChange->iDelete = 0;
+}
+
+void majestic_config_batch_set_int(t_majestic_config_batch* pBatch, const char* szPath, int iValue)
+{
+   char szValue[24];
+   sprintf(szValue, "%d", iValue);
+   majestic_config_batch_set(pBatch, szPath, szValue);
+}
+
+void majestic_config_batch_set_bool(t_majestic_config_batch* pBatch, const char* szPath, int iValue)
+{
+   majestic_config_batch_set(pBatch, szPath, iValue?"true":"false");
+}
+
+void majestic_config_batch_delete(t_majestic_config_batch* pBatch, const char* szPath)
+{
+   t_majestic_config_change* pChange = _majestic_config_batch_get_slot(pBatch, szPath);
+   if ( NULL == pChange )
+      return;
+   pChange->szValue[0] = 0;
+   pChange->iDelete = 1;
+}
+
+static int _majestic_config_load(const char* szConfigFile)
+{
+   s_iMajesticCountLines = 0;
+   FILE* fd = fopen(szConfigFile, "r");
+   if ( NULL == fd )
+   {
+      log_softerror_and_alarm("[MajesticConfig] Failed to open config file %s", szConfigFile);
+      return -1;
+   }
+   char szLine[MAJESTIC_CONFIG_MAX_LINE_LENGTH+2];
+   while ( NULL != fgets(szLine, sizeof(szLine), fd) )
+   {
+      int iLen = strlen(szLine);
+      if ( (iLen > 0) && (szLine[iLen-1] != '\n') && (! feof(fd)) )
+      {
+         log_softerror_and_alarm("[MajesticConfig] Config file %s has a line too long (over %d chars).", szConfigFile, MAJESTIC_CONFIG_MAX_LINE_LENGTH-1);
+         fclose(fd);
+         return -1;
+      }
+      while ( (iLen > 0) && ((szLine[iLen-1] == '\n') || (szLine[iLen-1] == '\r')) )
+         szLine[--iLen] = 0;
+      if ( s_iMajesticCountLines >= MAJESTIC_CONFIG_MAX_LINES )
+      {
+         log_softerror_and_alarm("[MajesticConfig] Config file %s has too many lines (over %d).", szConfigFile, MAJESTIC_CONFIG_MAX_LINES);
+         fclose(fd);
+         return -1;
+      }
+      strcpy(s_szMajesticLines[s_iMajesticCountLines], szLine);
+      s_iMajesticCountLines++;
+   }
+   fclose(fd);
+   return 0;
+}
+
+static int _majestic_config_save(const char* szConfigFile)
+{
+   char szTmpFile[256];
+   snprintf(szTmpFile, sizeof(szTmpFile), "%s.tmp", szConfigFile);
+   FILE* fd = fopen(szTmpFile, "w");
+   if ( NULL == fd )
+   {
+      log_softerror_and_alarm("[MajesticConfig] Failed to create temp config file %s", szTmpFile);
+      return -1;
+   }
+   int iFailed = 0;
+   for( int i=0; i<s_iMajesticCountLines; i++ )
+   {
+      if ( fprintf(fd, "%s\n", s_szMajesticLines[i]) < 0 )
+         iFailed = 1;
+   }
+   if ( 0 != fflush(fd) )
+      iFailed = 1;
+   if ( 0 != fsync(fileno(fd)) )
+      iFailed = 1;
+   fclose(fd);
+
+   if ( iFailed || (0 != rename(szTmpFile, szConfigFile)) )
+   {
+      log_softerror_and_alarm("[MajesticConfig] Failed to write config file %s, error: %s", szConfigFile, strerror(errno));
+      unlink(szTmpFile);
+      return -1;
+   }
+   return 0;
+}
+
+// Returns the indentation of the line, or -1 for blank/comment lines
+static int _majestic_config_line_indent(int iLine)
+{
+   const char* p = s_szMajesticLines[iLine];
+   int iIndent = 0;
+   while ( *p == ' ' )
+   {
+      p++;
+      iIndent++;
+   }
+   if ( (*p == 0) || (*p == '#') )
+      return -1;
+   return iIndent;
+}
+
+static int _majestic_config_line_has_key(int iLine, int iIndent, const char* szKey)
+{
+   const char* p = s_szMajesticLines[iLine] + iIndent;
+   int iLen = strlen(szKey);
+   if ( 0 != strncmp(p, szKey, iLen) )
+      return 0;
+   return (p[iLen] == ':')?1:0;
+}
+
+// Returns the first line after the block owned by line iLine (its children)
+static int _majestic_config_block_end(int iLine, int iEndLimit)
+{
+   int iIndent = _majestic_config_line_indent(iLine);
+   int iEnd = iLine+1;
+   for( int i=iLine+1; i<iEndLimit; i++ )
+   {
+      int iLineIndent = _majestic_config_line_indent(i);
+      if ( iLineIndent < 0 )
+         continue;
+      if ( iLineIndent <= iIndent )
+         break;
+      iEnd = i+1;
+   }
+   return iEnd;
+}
+
+static int _majestic_config_insert_line(int iPosition, int iIndent, const char* szKey, const char* szValue)
+{
+   if ( s_iMajesticCountLines >= MAJESTIC_CONFIG_MAX_LINES )
+      return -1;
+   for( int i=s_iMajesticCountLines; i>iPosition; i-- )
+      strcpy(s_szMajesticLines[i], s_szMajesticLines[i-1]);
+   s_iMajesticCountLines++;
+   if ( NULL == szValue )
+      snprintf(s_szMajesticLines[iPosition], MAJESTIC_CONFIG_MAX_LINE_LENGTH, "%*s%s:", iIndent, "", szKey);
+   else
+      snprintf(s_szMajesticLines[iPosition], MAJESTIC_CONFIG_MAX_LINE_LENGTH, "%*s%s: %s", iIndent, "", szKey, szValue);
+   return iPosition;
+}
+
+static void _majestic_config_remove_lines(int iStart, int iEnd)
+{
+   int iCount = iEnd - iStart;
+   if ( iCount <= 0 )
+      return;
+   for( int i=iStart; i+iCount<s_iMajesticCountLines; i++ )
+      strcpy(s_szMajesticLines[i], s_szMajesticLines[i+iCount]);
+   s_iMajesticCountLines -= iCount;
+}
+
+static int _majestic_config_split_path(const char* szPath, char szKeys[MAJESTIC_CONFIG_MAX_DEPTH][MAJESTIC_CONFIG_MAX_PATH])
+{
+   int iCount = 0;
+   const char* p = szPath;
+   while ( *p == '.' )
+   {
+      p++;
+      const char* pEnd = strchr(p, '.');
+      int iLen = (NULL != pEnd)?(int)(pEnd - p):(int)strlen(p);
+      if ( (iLen <= 0) || (iCount >= MAJESTIC_CONFIG_MAX_DEPTH) )
+         return -1;
+      memcpy(szKeys[iCount], p, iLen);
+      szKeys[iCount][iLen] = 0;
+      iCount++;
+      p += iLen;
+   }
+   if ( *p != 0 )
+      return -1;
+   return iCount;
+}
+
+// Finds the line of the path. If not found and bCreate is set, creates it (and the missing parents).
+// Returns line index or -1. Sets *piIndent to the indent of the found line.
+static int _majestic_config_find(const char* szPath, int bCreate, int* piIndent)
+{
+   char szKeys[MAJESTIC_CONFIG_MAX_DEPTH][MAJESTIC_CONFIG_MAX_PATH];
+   int iCountKeys = _majestic_config_split_path(szPath, szKeys);
+   if ( iCountKeys <= 0 )
+      return -1;
+
+   int iBlockStart = 0;
+   int iBlockEnd = s_iMajesticCountLines;
+   int iIndent = 0;
+   for( int iKey=0; iKey<iCountKeys; iKey++ )
+   {
+      int iFound = -1;
+      for( int i=iBlockStart; i<iBlockEnd; i++ )
+      {
+         if ( _majestic_config_line_indent(i) != iIndent )
+            continue;
+         if ( _majestic_config_line_has_key(i, iIndent, szKeys[iKey]) )
+         {
+            iFound = i;
+            break;
+         }
+      }
+
+      if ( iFound < 0 )
+      {
+         if ( ! bCreate )
+            return -1;
+         // Create the missing key and its missing children at the end of the parent block
+         int iPos = iBlockEnd;
+         for( ; iKey<iCountKeys; iKey++ )
+         {
+            if ( _majestic_config_insert_line(iPos, iIndent, szKeys[iKey], NULL) < 0 )
+               return -1;
+            iPos++;
+            iIndent += 2;
+         }
+         *piIndent = iIndent - 2;
+         return iPos - 1;
+      }
+
+      if ( iKey == iCountKeys-1 )
+      {
+         *piIndent = iIndent;
+         return iFound;
+      }
+
+      iBlockStart = iFound+1;
+      iBlockEnd = _majestic_config_block_end(iFound, iBlockEnd);
+      int iChildIndent = iIndent + 2;
+      for( int i=iBlockStart; i<iBlockEnd; i++ )
+      {
+         if ( _majestic_config_line_indent(i) > iIndent )
+         {
+            iChildIndent = _majestic_config_line_indent(i);
+            break;
+         }
+      }
+      iIndent = iChildIndent;
+   }
+   return -1;
+}
+
+static const char* _majestic_config_line_value(int iLine, int iIndent, char* szBuffer, int iMaxLength)
+{
+   const char* p = strchr(s_szMajesticLines[iLine] + iIndent, ':');
+   szBuffer[0] = 0;
+   if ( NULL == p )
+      return szBuffer;
+   p++;
+   while ( *p == ' ' )
+      p++;
+   strncpy(szBuffer, p, iMaxLength-1);
+   szBuffer[iMaxLength-1] = 0;
+   int iLen = strlen(szBuffer);
+   while ( (iLen > 0) && (szBuffer[iLen-1] == ' ') )
+      szBuffer[--iLen] = 0;
+   return szBuffer;
+}
+
+int majestic_config_batch_apply(t_majestic_config_batch* pBatch, const char* szConfigFile)
+{
+   if ( (NULL == pBatch) || (NULL == szConfigFile) )
+      return -1;
+   if ( 0 == pBatch->iCountChanges )
+      return 0;
+   if ( _majestic_config_load(szConfigFile) < 0 )
+      return -1;
+
+   int iCountChanged = 0;
+   char szCurrentValue[MAJESTIC_CONFIG_MAX_LINE_LENGTH];
+   for( int i=0; i<pBatch->iCountChanges; i++ )
+   {
+      t_majestic_config_change* pChange = &(pBatch->changes[i]);
+      int iIndent = 0;
+      int iLine = _majestic_config_find(pChange->szPath, !pChange->iDelete, &iIndent);
+      if ( pChange->iDelete )
+      {
+         if ( iLine >= 0 )
+         {
+            _majestic_config_remove_lines(iLine, _majestic_config_block_end(iLine, s_iMajesticCountLines));
+            iCountChanged++;
+         }
+         continue;
+      }
+      if ( iLine < 0 )
+      {
+         log_softerror_and_alarm("[MajesticConfig] Failed to set %s in config file %s", pChange->szPath, szConfigFile);
+         continue;
+      }
+      _majestic_config_line_value(iLine, iIndent, szCurrentValue, sizeof(szCurrentValue));
+      if ( 0 == strcmp(szCurrentValue, pChange->szValue) )
+         continue;
+
+      char szKey[MAJESTIC_CONFIG_MAX_PATH];
+      const char* pKey = strrchr(pChange->szPath, '.') + 1;
+      strcpy(szKey, pKey);
+      snprintf(s_szMajesticLines[iLine], MAJESTIC_CONFIG_MAX_LINE_LENGTH, "%*s%s: %s", iIndent, "", szKey, pChange->szValue);
+      iCountChanged++;
+   }
+
+   if ( 0 == iCountChanged )
+      return 0;
+   if ( _majestic_config_save(szConfigFile) < 0 )
+      return -1;
+   return iCountChanged;
+}
+
+void majestic_config_batch_apply_using_cli(t_majestic_config_batch* pBatch)
+{
+   if ( NULL == pBatch )
+      return;
+   char szComm[160];
+   for( int i=0; i<pBatch->iCountChanges; i++ )
+   {
+      if ( pBatch->changes[i].iDelete )
+         snprintf(szComm, sizeof(szComm), "cli -d %s", pBatch->changes[i].szPath);
+      else
+         snprintf(szComm, sizeof(szComm), "cli -s %s %s", pBatch->changes[i].szPath, pBatch->changes[i].szValue);
+      hw_execute_bash_command_raw(szComm, NULL);
+   }
+}
+
+int majestic_config_signal_reload(const char* szProcessName)
+{
+   if ( (NULL == szProcessName) || (0 == szProcessName[0]) )
+      return 0;
+
+   DIR* pDir = opendir("/proc");
+   if ( NULL == pDir )
+      return 0;
+
+   int iCountSignaled = 0;
+   char szFile[64];
+   char szName[64];
+   struct dirent* pEntry = NULL;
+   while ( NULL != (pEntry = readdir(pDir)) )
+   {
+      if ( ! isdigit(pEntry->d_name[0]) )
+         continue;
+      int iPid = atoi(pEntry->d_name);
+      if ( (iPid <= 0) || (iPid == getpid()) )
+         continue;
+      snprintf(szFile, sizeof(szFile), "/proc/%d/comm", iPid);
+      FILE* fd = fopen(szFile, "r");
+      if ( NULL == fd )
+         continue;
+      szName[0] = 0;
+      if ( NULL == fgets(szName, sizeof(szName), fd) )
+         szName[0] = 0;
+      fclose(fd);
+      int iLen = strlen(szName);
+      if ( (iLen > 0) && (szName[iLen-1] == '\n') )
+         szName[iLen-1] = 0;
+      if ( 0 != strcmp(szName, szProcessName) )
+         continue;
+      if ( 0 == kill(iPid, SIGHUP) )
+         iCountSignaled++;
+   }
+   closedir(pDir);
+   return iCountSignaled;
+}
+
+int majestic_config_get_value(const char* szConfigFile, const char* szPath, char* szOutValue, int iMaxLength)
+{
+   if ( (NULL == szOutValue) || (iMaxLength < 1) )
+      return 0;
+   szOutValue[0] = 0;
+   if ( _majestic_config_load(szConfigFile) < 0 )
+      return 0;
+   int iIndent = 0;
+   int iLine = _majestic_config_find(szPath, 0, &iIndent);
+   if ( iLine < 0 )
+      return 0;
+   _majestic_config_line_value(iLine, iIndent, szOutValue, iMaxLength);
+   return 1;
+}
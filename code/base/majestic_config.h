@@ -0,0 +1,55 @@
+#pragma once
+#include "base.h"
+
+// Native editor for the majestic (OpenIPC streamer) yaml config file.
+// Changes are collected in a batch, then applied with a single write of the config file
+// (temp file + rename, so majestic never reads a half written file) and a single reload signal,
+// instead of one "cli -s" process (fork + exec + full file rewrite) for each parameter.
+// Paths use the same syntax as majestic's cli: ".section.key"
+
+#define MAJESTIC_CONFIG_FILE "/etc/majestic.yaml"
+#define MAJESTIC_PROCESS_NAME "majestic"
+
+#define MAJESTIC_CONFIG_MAX_CHANGES 48
+#define MAJESTIC_CONFIG_MAX_PATH 48
+#define MAJESTIC_CONFIG_MAX_VALUE 48
+
+typedef struct
+{
+   char szPath[MAJESTIC_CONFIG_MAX_PATH];
+   char szValue[MAJESTIC_CONFIG_MAX_VALUE];
+   int iDelete;
+} t_majestic_config_change;
+
+typedef struct
+{
+   t_majestic_config_change changes[MAJESTIC_CONFIG_MAX_CHANGES];
+   int iCountChanges;
+} t_majestic_config_batch;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void majestic_config_batch_init(t_majestic_config_batch* pBatch);
+void majestic_config_batch_set(t_majestic_config_batch* pBatch, const char* szPath, const char* szValue);
+void majestic_config_batch_set_int(t_majestic_config_batch* pBatch, const char* szPath, int iValue);
+void majestic_config_batch_set_bool(t_majestic_config_batch* pBatch, const char* szPath, int iValue);
+void majestic_config_batch_delete(t_majestic_config_batch* pBatch, const char* szPath);
+
+// Applies all the batch changes to szConfigFile in one atomic update.
+// Returns the number of values that actually changed (file is not rewritten if 0), or -1 on error.
+int majestic_config_batch_apply(t_majestic_config_batch* pBatch, const char* szConfigFile);
+
+// Fallback: applies the batch using one "cli" command for each change
+void majestic_config_batch_apply_using_cli(t_majestic_config_batch* pBatch);
+
+// Sends SIGHUP to all processes named szProcessName (no shell). Returns the number of processes signaled.
+int majestic_config_signal_reload(const char* szProcessName);
+
+// Reads a single value from the config file. Returns 1 if found.
+int majestic_config_get_value(const char* szConfigFile, const char* szPath, char* szOutValue, int iMaxLength);
+
+#ifdef __cplusplus
+}
+#endif
@@ -29,10 +29,13 @@
     SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <sys/stat.h>
 #include "base.h"
 #include "hardware.h"
 #include "models.h"
 
+#define MODELS_INDEX_STAMP "models-index-v2"
+
 Model* s_pModelsSpectator[MAX_MODELS_SPECTATOR];
 int s_iModelsSpectatorCount = 0;
 
@@ -43,6 +46,209 @@ Model* s_pCurrentModel = NULL;
 
 static bool s_bLoadedAllModels = false;
 
+// Controller and spectator models are loaded lazily: at start only the vehicle ids are read from the
+// models index file; a model file is loaded the first time the model is used. A model slot that is not
+// loaded yet has a NULL pointer and its vehicle id in the ids lists below. The index entry of a model
+// is used only if the model file size and modification time did not change since the index was saved.
+// Only the process that changes the models list saves the index (other processes might have a stale list);
+// saving a model file just invalidates its index entry, the next full load refreshes it.
+u32 s_uModelsVehicleId[MAX_MODELS];
+u32 s_uModelsSpectatorVehicleId[MAX_MODELS_SPECTATOR];
+
+typedef struct
+{
+   u32 uVehicleId;
+   long lFileSize;
+   long lFileTime;
+   long lFileTimeNs;
+} t_models_index_entry;
+
+static bool s_bRescanningModels = false;
+
+static void _models_get_file_name(bool bSpectator, int iIndex, char* szOutFile)
+{
+   char szFolderM[MAX_FILE_PATH_SIZE];
+   strcpy(szFolderM, FOLDER_CONFIG_MODELS);
+   strcat(szFolderM, bSpectator?FILE_VEHICLE_SPECTATOR:FILE_VEHICLE_CONTROLL);
+   sprintf(szOutFile, szFolderM, iIndex);
+}
+
+static bool _models_get_file_stamp(const char* szFile, long* plFileSize, long* plFileTime, long* plFileTimeNs)
+{
+   struct stat statFile;
+   if ( 0 != stat(szFile, &statFile) )
+      return false;
+   *plFileSize = (long)statFile.st_size;
+   *plFileTime = (long)statFile.st_mtim.tv_sec;
+   *plFileTimeNs = (long)statFile.st_mtim.tv_nsec;
+   return true;
+}
+
+static void _models_index_remove()
+{
+   char szFile[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, FOLDER_CONFIG_MODELS);
+   strcat(szFile, FILE_CONFIG_MODELS_INDEX);
+   unlink(szFile);
+}
+
+static void _models_load_all_slots();
+
+static Model* _models_load_slot(bool bSpectator, int iIndex)
+{
+   Model** ppModel = bSpectator?(&s_pModelsSpectator[iIndex]):(&s_pModels[iIndex]);
+   if ( NULL != *ppModel )
+      return *ppModel;
+
+   u32 uVehicleId = bSpectator?s_uModelsSpectatorVehicleId[iIndex]:s_uModelsVehicleId[iIndex];
+   if ( (NULL != s_pCurrentModel) && (s_pCurrentModel->uVehicleId == uVehicleId) )
+   {
+      *ppModel = s_pCurrentModel;
+      return *ppModel;
+   }
+
+   char szFile[MAX_FILE_PATH_SIZE];
+   _models_get_file_name(bSpectator, iIndex, szFile);
+   *ppModel = new Model();
+   if ( ! (*ppModel)->loadFromFile(szFile, true) )
+   {
+      log_softerror_and_alarm("Failed to load %s model %d (VID %u) from file: %s", bSpectator?"spectator":"controller", iIndex+1, uVehicleId, szFile);
+      (*ppModel)->resetToDefaults(true);
+      (*ppModel)->uVehicleId = uVehicleId;
+   }
+   else if ( (*ppModel)->uVehicleId != uVehicleId )
+   {
+      // The index is out of date (i.e. models list changed by another process): don't trust the ids read from it
+      log_softerror_and_alarm("Loaded %s model %d has VID %u, index had VID %u. Dropping the models index and rescanning the models.", bSpectator?"spectator":"controller", iIndex+1, (*ppModel)->uVehicleId, uVehicleId);
+      if ( bSpectator )
+         s_uModelsSpectatorVehicleId[iIndex] = (*ppModel)->uVehicleId;
+      else
+         s_uModelsVehicleId[iIndex] = (*ppModel)->uVehicleId;
+      _models_index_remove();
+      if ( ! s_bRescanningModels )
+      {
+         Model* pModel = *ppModel;
+         s_bRescanningModels = true;
+         _models_load_all_slots();
+         s_bRescanningModels = false;
+         return pModel;
+      }
+   }
+   return *ppModel;
+}
+
+static u32 _models_get_slot_vehicle_id(bool bSpectator, int iIndex)
+{
+   Model* pModel = bSpectator?s_pModelsSpectator[iIndex]:s_pModels[iIndex];
+   if ( NULL != pModel )
+      return pModel->uVehicleId;
+   return bSpectator?s_uModelsSpectatorVehicleId[iIndex]:s_uModelsVehicleId[iIndex];
+}
+
+// Models list changes (delete, reorder) work on loaded models only
+static void _models_load_all_slots()
+{
+   for( int i=0; i<s_iModelsCount; i++ )
+      _models_load_slot(false, i);
+   for( int i=0; i<s_iModelsSpectatorCount; i++ )
+      _models_load_slot(true, i);
+}
+
+static void _models_index_save()
+{
+   char szFile[MAX_FILE_PATH_SIZE];
+   char szFileTmp[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, FOLDER_CONFIG_MODELS);
+   strcat(szFile, FILE_CONFIG_MODELS_INDEX);
+   // Several processes save the index: each one writes its own tmp file, then renames it (atomic)
+   snprintf(szFileTmp, sizeof(szFileTmp)/sizeof(szFileTmp[0]), "%s.tmp.%d", szFile, (int)getpid());
+
+   FILE* fd = fopen(szFileTmp, "w");
+   if ( NULL == fd )
+   {
+      log_softerror_and_alarm("Failed to save models index file: %s", szFileTmp);
+      return;
+   }
+   fprintf(fd, "%s\n%d %d\n", MODELS_INDEX_STAMP, s_iModelsCount, s_iModelsSpectatorCount);
+   for( int k=0; k<2; k++ )
+   {
+      bool bSpectator = (k == 1);
+      int iCount = bSpectator?s_iModelsSpectatorCount:s_iModelsCount;
+      for( int i=0; i<iCount; i++ )
+      {
+         char szModelFile[MAX_FILE_PATH_SIZE];
+         long lFileSize = -1;
+         long lFileTime = -1;
+         long lFileTimeNs = -1;
+         _models_get_file_name(bSpectator, i, szModelFile);
+         if ( ! _models_get_file_stamp(szModelFile, &lFileSize, &lFileTime, &lFileTimeNs) )
+         {
+            lFileSize = -1;
+            lFileTime = -1;
+            lFileTimeNs = -1;
+         }
+         fprintf(fd, "%u %ld %ld %ld\n", _models_get_slot_vehicle_id(bSpectator, i), lFileSize, lFileTime, lFileTimeNs);
+      }
+   }
+   fclose(fd);
+   if ( 0 != rename(szFileTmp, szFile) )
+   {
+      log_softerror_and_alarm("Failed to update models index file: %s", szFile);
+      unlink(szFileTmp);
+   }
+}
+
+// Returns the count of models read from the index, or -1 if there is no valid index
+static int _models_index_load(int iCountControllerModels, t_models_index_entry* pControllerEntries, t_models_index_entry* pSpectatorEntries, int* piCountSpectatorModels)
+{
+   char szFile[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, FOLDER_CONFIG_MODELS);
+   strcat(szFile, FILE_CONFIG_MODELS_INDEX);
+
+   FILE* fd = fopen(szFile, "r");
+   if ( NULL == fd )
+      return -1;
+
+   char szStamp[64];
+   int iCountCtrl = 0;
+   int iCountSpect = 0;
+   if ( (3 != fscanf(fd, "%63s %d %d", szStamp, &iCountCtrl, &iCountSpect)) ||
+        (0 != strcmp(szStamp, MODELS_INDEX_STAMP)) ||
+        (iCountCtrl != iCountControllerModels) ||
+        (iCountSpect < 0) || (iCountSpect > MAX_MODELS_SPECTATOR) )
+   {
+      fclose(fd);
+      return -1;
+   }
+
+   for( int i=0; i<iCountCtrl + iCountSpect; i++ )
+   {
+      t_models_index_entry* pEntry = (i < iCountCtrl)?&pControllerEntries[i]:&pSpectatorEntries[i-iCountCtrl];
+      if ( 4 != fscanf(fd, "%u %ld %ld %ld", &pEntry->uVehicleId, &pEntry->lFileSize, &pEntry->lFileTime, &pEntry->lFileTimeNs) )
+      {
+         fclose(fd);
+         return -1;
+      }
+   }
+   fclose(fd);
+   *piCountSpectatorModels = iCountSpect;
+   return iCountCtrl + iCountSpect;
+}
+
+static bool _models_index_entry_is_valid(bool bSpectator, int iIndex, t_models_index_entry* pEntry)
+{
+   char szFile[MAX_FILE_PATH_SIZE];
+   long lFileSize = 0;
+   long lFileTime = 0;
+   long lFileTimeNs = 0;
+   _models_get_file_name(bSpectator, iIndex, szFile);
+   if ( ! _models_get_file_stamp(szFile, &lFileSize, &lFileTime, &lFileTimeNs) )
+      return false;
+   if ( (lFileSize != pEntry->lFileSize) || (lFileTime != pEntry->lFileTime) || (lFileTimeNs != pEntry->lFileTimeNs) )
+      return false;
+   return true;
+}
+
 bool loadAllModels()
 {
    log_line("Loading all models from storage...");
@@ -86,46 +292,82 @@ bool loadAllModels()
    int count = load_simple_config_fileI(szFile, 0);
    if (count < 0 )
       count = 0;
-   log_line("Loading %d controller models...", count);
+   if ( count > MAX_MODELS )
+      count = MAX_MODELS;
+
+   t_models_index_entry controllerEntries[MAX_MODELS];
+   t_models_index_entry spectatorEntries[MAX_MODELS_SPECTATOR];
+   int iCountIndexSpectatorModels = 0;
+   bool bHasIndex = (_models_index_load(count, controllerEntries, spectatorEntries, &iCountIndexSpectatorModels) >= 0);
+   int iCountLoaded = 0;
+
+   log_line("Loading %d controller models (%s)...", count, bHasIndex?"from models index":"no models index");
    for( int i=0; i<count; i++ )
    {
-      char szFolderM[MAX_FILE_PATH_SIZE];
-      strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-      strcat(szFolderM, FILE_VEHICLE_CONTROLL);
-      sprintf(szFile, szFolderM, i);
+      s_pModels[i] = NULL;
+      if ( bHasIndex && _models_index_entry_is_valid(false, i, &controllerEntries[i]) )
+      {
+         s_uModelsVehicleId[i] = controllerEntries[i].uVehicleId;
+         if ( s_pCurrentModel->uVehicleId == s_uModelsVehicleId[i] )
+            s_pModels[i] = s_pCurrentModel;
+         s_iModelsCount++;
+         continue;
+      }
+      _models_get_file_name(false, i, szFile);
       s_pModels[i] = new Model();
       if ( ! s_pModels[i]->loadFromFile(szFile, true) )
          break;
 
+      iCountLoaded++;
       if ( s_pCurrentModel->uVehicleId == s_pModels[i]->uVehicleId )
          s_pModels[i] = s_pCurrentModel;
+      s_uModelsVehicleId[i] = s_pModels[i]->uVehicleId;
       s_iModelsCount++;
    }
-   log_line("Loaded %d controller models.", s_iModelsCount);
+   log_line("Found %d controller models.", s_iModelsCount);
 
    s_iModelsSpectatorCount = 0;
    while( s_iModelsSpectatorCount < MAX_MODELS_SPECTATOR )
    {
       char szBuff[256];
-      char szFolderM[MAX_FILE_PATH_SIZE];
-      strcpy(szFolderM, FOLDER_CONFIG_MODELS);
-      strcat(szFolderM, FILE_VEHICLE_SPECTATOR);
-      sprintf(szBuff, szFolderM, s_iModelsSpectatorCount);
-      s_pModelsSpectator[s_iModelsSpectatorCount] = new Model();
+      int iIndex = s_iModelsSpectatorCount;
+      _models_get_file_name(true, iIndex, szBuff);
+      s_pModelsSpectator[iIndex] = NULL;
       if( access( szBuff, R_OK ) == -1 )
          break;
-      if ( ! s_pModelsSpectator[s_iModelsSpectatorCount]->loadFromFile(szBuff, true) )
+      if ( bHasIndex && (iIndex < iCountIndexSpectatorModels) && _models_index_entry_is_valid(true, iIndex, &spectatorEntries[iIndex]) )
+      {
+         s_uModelsSpectatorVehicleId[iIndex] = spectatorEntries[iIndex].uVehicleId;
+         if ( s_pCurrentModel->uVehicleId == s_uModelsSpectatorVehicleId[iIndex] )
+            s_pModelsSpectator[iIndex] = s_pCurrentModel;
+         s_iModelsSpectatorCount++;
+         continue;
+      }
+      s_pModelsSpectator[iIndex] = new Model();
+      if ( ! s_pModelsSpectator[iIndex]->loadFromFile(szBuff, true) )
          break;
-      if ( s_pCurrentModel->uVehicleId == s_pModelsSpectator[s_iModelsSpectatorCount]->uVehicleId )
-         s_pModelsSpectator[s_iModelsSpectatorCount] = s_pCurrentModel;
+      iCountLoaded++;
+      if ( s_pCurrentModel->uVehicleId == s_pModelsSpectator[iIndex]->uVehicleId )
+         s_pModelsSpectator[iIndex] = s_pCurrentModel;
+      s_uModelsSpectatorVehicleId[iIndex] = s_pModelsSpectator[iIndex]->uVehicleId;
       s_iModelsSpectatorCount++;
    }
-   log_line("Loaded %d spectator models.", s_iModelsSpectatorCount);
+   log_line("Found %d spectator models.", s_iModelsSpectatorCount);
 
-   log_line("Loaded controller models:");
-   for( int i=0; i<s_iModelsCount; i++ )
-      log_line("Controller model %d: [%s], VID: %u", i+1, s_pModels[i]->getLongName(), s_pModels[i]->uVehicleId);
+   if ( (! bHasIndex) || (0 != iCountLoaded) || (iCountIndexSpectatorModels != s_iModelsSpectatorCount) )
+   {
+      log_line("Loaded %d models files. Updating the models index.", iCountLoaded);
+      _models_index_save();
+   }
 
+   log_line("Controller models:");
+   for( int i=0; i<s_iModelsCount; i++ )
+   {
+      if ( NULL == s_pModels[i] )
+         log_line("Controller model %d: [not loaded yet], VID: %u", i+1, s_uModelsVehicleId[i]);
+      else
+         log_line("Controller model %d: [%s], VID: %u", i+1, s_pModels[i]->getLongName(), s_pModels[i]->uVehicleId);
+   }
    return true;
 }
 
@@ -149,14 +391,14 @@ bool saveCurrentModel()
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
    {
-      if ( s_pModelsSpectator[i]->uVehicleId != s_pCurrentModel->uVehicleId )
+      if ( _models_get_slot_vehicle_id(true, i) != s_pCurrentModel->uVehicleId )
          continue;
       char szBuff[256];
       char szFolderM[MAX_FILE_PATH_SIZE];
       strcpy(szFolderM, FOLDER_CONFIG_MODELS);
       strcat(szFolderM, FILE_VEHICLE_SPECTATOR);
       sprintf(szBuff, szFolderM, i);
-      s_pModelsSpectator[i]->saveToFile(szBuff, hardware_is_station());
+      _models_load_slot(true, i)->saveToFile(szBuff, hardware_is_station());
    }
 
    log_line("Saving %d controller models.", s_iModelsCount);
@@ -165,13 +407,13 @@ bool saveCurrentModel()
    save_simple_config_fileI(szFile, s_iModelsCount);
    for( int i=0; i<s_iModelsCount; i++ )
    {
-      if ( s_pModels[i]->uVehicleId != s_pCurrentModel->uVehicleId )
+      if ( _models_get_slot_vehicle_id(false, i) != s_pCurrentModel->uVehicleId )
          continue;
       char szFolderM[MAX_FILE_PATH_SIZE];
       strcpy(szFolderM, FOLDER_CONFIG_MODELS);
       strcat(szFolderM, FILE_VEHICLE_CONTROLL);
       sprintf(szFile, szFolderM, i);
-      s_pModels[i]->saveToFile(szFile, hardware_is_station());
+      _models_load_slot(false, i)->saveToFile(szFile, hardware_is_station());
    }
    return true;
 }
@@ -201,19 +443,19 @@ void setCurrentModel(u32 uVehicleId)
 {
    for( int i=0; i<s_iModelsCount; i++ )
    {
-       if ( (NULL != s_pModels[i]) && (s_pModels[i]->uVehicleId == uVehicleId) )
+       if ( _models_get_slot_vehicle_id(false, i) == uVehicleId )
        {
           log_line("Set current vehicle to controller vehicle index %d (VID %u)", i, uVehicleId);
-          s_pCurrentModel = s_pModels[i];
+          s_pCurrentModel = _models_load_slot(false, i);
           return;
        }
    }
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
    {
-       if ( (NULL != s_pModelsSpectator[i]) && (s_pModelsSpectator[i]->uVehicleId == uVehicleId) )
+       if ( _models_get_slot_vehicle_id(true, i) == uVehicleId )
        {
           log_line("Set current vehicle to controller spectator vehicle index %d (VID %u)", i, uVehicleId);
-          s_pCurrentModel = s_pModelsSpectator[i];
+          s_pCurrentModel = _models_load_slot(true, i);
           return;
        }
    }
@@ -237,6 +479,7 @@ void deleteAllModels()
    strcpy(szFile, FOLDER_CONFIG);
    strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_COUNT);
    save_simple_config_fileI(szFile, s_iModelsCount);
+   _models_index_save();
 }
 
 
@@ -244,12 +487,15 @@ Model* getSpectatorModel(int iIndex)
 {
    if ( iIndex < 0 || iIndex > s_iModelsSpectatorCount )
       return NULL;
+   if ( iIndex < s_iModelsSpectatorCount )
+      return _models_load_slot(true, iIndex);
    return s_pModelsSpectator[iIndex];
 }
 
 
 Model* addSpectatorModel(u32 vehicleId)
 {
+   _models_load_all_slots();
    int index = 0;
    for( index = 0; index < s_iModelsSpectatorCount; index++ )
       if ( s_pModelsSpectator[index]->uVehicleId == vehicleId )
@@ -287,6 +533,7 @@ Model* addSpectatorModel(u32 vehicleId)
       sprintf(szBuff, szFolderM, i);
       s_pModelsSpectator[i]->saveToFile(szBuff, true);
    }
+   _models_index_save();
 
    return s_pModelsSpectator[0];
 }
@@ -295,6 +542,7 @@ void moveSpectatorModelToTop(int index)
 {
    if ( index < 0 || index >= s_iModelsSpectatorCount )
       return;
+   _models_load_all_slots();
         
    Model* tmp = s_pModelsSpectator[index];
    for( int i=index-1; i >=0; i-- )
@@ -307,6 +555,8 @@ Model* getModelAtIndex(int index)
 {
    if ( index < 0 || index >= MAX_MODELS )
       return NULL;
+   if ( index < s_iModelsCount )
+      return _models_load_slot(false, index);
    return s_pModels[index];
 }
 
@@ -330,6 +580,7 @@ Model* addNewModel()
    strcpy(szFile, FOLDER_CONFIG);
    strcat(szFile, FILE_CONFIG_CURRENT_VEHICLE_COUNT);
    save_simple_config_fileI(szFile, s_iModelsCount);
+   _models_index_save();
    
    log_line("Added a new model in the controller's models list, VID: %u", s_pModels[s_iModelsCount-1]->uVehicleId);
    return s_pModels[s_iModelsCount-1];
@@ -339,6 +590,8 @@ void replaceModel(int index, Model* pModel)
 {
    if ( index < 0 || index >= MAX_MODELS-1 )
       return;
+   if ( index < s_iModelsCount )
+      _models_load_slot(false, index);
 
    if ( (NULL != s_pCurrentModel) && (NULL != s_pModels[index]) )
    if ( s_pCurrentModel->uVehicleId == s_pModels[index]->uVehicleId )
@@ -372,18 +625,18 @@ Model* findModelWithId(u32 uVehicleId, u32 uSrcId)
       return s_pCurrentModel;
 
    for( int i=0; i<s_iModelsCount; i++ )
-      if ( s_pModels[i]->uVehicleId == uVehicleId )
-         return s_pModels[i];
+      if ( _models_get_slot_vehicle_id(false, i) == uVehicleId )
+         return _models_load_slot(false, i);
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
-      if ( s_pModelsSpectator[i]->uVehicleId == uVehicleId )
-         return s_pModelsSpectator[i];
+      if ( _models_get_slot_vehicle_id(true, i) == uVehicleId )
+         return _models_load_slot(true, i);
 
    log_softerror_and_alarm("Tried to find an inexistent VID: %u (source id: %u). Current loaded vehicles:", uVehicleId, uSrcId);
    for( int i=0; i<s_iModelsCount; i++ )
-      log_softerror_and_alarm("Vehicle Ctrlr %d: %u", i, s_pModels[i]->uVehicleId);
+      log_softerror_and_alarm("Vehicle Ctrlr %d: %u", i, _models_get_slot_vehicle_id(false, i));
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
-      log_softerror_and_alarm("Vehicle Spect %d: %u", i, s_pModelsSpectator[i]->uVehicleId);
+      log_softerror_and_alarm("Vehicle Spect %d: %u", i, _models_get_slot_vehicle_id(true, i));
    if ( NULL == s_pCurrentModel )
       log_softerror_and_alarm("Current vehicle: NULL");
    else
@@ -400,11 +653,11 @@ bool controllerHasModelWithId(u32 uVehicleId)
    }
 
    for( int i=0; i<s_iModelsCount; i++ )
-      if ( s_pModels[i]->uVehicleId == uVehicleId )
+      if ( _models_get_slot_vehicle_id(false, i) == uVehicleId )
          return true;
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
-      if ( s_pModelsSpectator[i]->uVehicleId == uVehicleId )
+      if ( _models_get_slot_vehicle_id(true, i) == uVehicleId )
          return true;
 
    return false;
@@ -432,6 +685,8 @@ Model* deleteModel(Model* pModel)
       return s_pCurrentModel;
    }
 
+   _models_load_all_slots();
+
    char szFile[MAX_FILE_PATH_SIZE];      
    bool bDeletedController = false;
    bool bDeletedSpectator = false;
@@ -533,6 +788,8 @@ Model* deleteModel(Model* pModel)
 
    if ( (!bDeletedSpectator) && (!bDeletedController) )
       log_softerror_and_alarm("Tried to delete a model that is not in the list.");
+   else
+      _models_index_save();
    return s_pCurrentModel;
 }
 
@@ -543,6 +800,9 @@ void saveControllerModel(Model* pModel)
 
    for( int i=0; i<s_iModelsCount; i++ )
    {
+      if ( _models_get_slot_vehicle_id(false, i) != pModel->uVehicleId )
+         continue;
+      _models_load_slot(false, i);
       if ( s_pModels[i]->uVehicleId == pModel->uVehicleId )
       if ( s_pModels[i]->is_spectator == pModel->is_spectator )
       {
@@ -560,6 +820,9 @@ void saveControllerModel(Model* pModel)
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
    {
+      if ( _models_get_slot_vehicle_id(true, i) != pModel->uVehicleId )
+         continue;
+      _models_load_slot(true, i);
       if ( s_pModelsSpectator[i]->uVehicleId == pModel->uVehicleId )
       if ( s_pModelsSpectator[i]->is_spectator == pModel->is_spectator )
       {
@@ -591,9 +854,9 @@ Model* setControllerCurrentModel(u32 uVehicleId)
 {
    for( int i=0; i<s_iModelsCount; i++ )
    {
-      if ( s_pModels[i]->uVehicleId == uVehicleId )
+      if ( _models_get_slot_vehicle_id(false, i) == uVehicleId )
       {
-         s_pCurrentModel = s_pModels[i];
+         s_pCurrentModel = _models_load_slot(false, i);
          log_line("Set VID %u, index %d as current controller model", uVehicleId, i);
          return s_pCurrentModel;
       }
@@ -601,9 +864,9 @@ Model* setControllerCurrentModel(u32 uVehicleId)
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
    {
-      if ( s_pModelsSpectator[i]->uVehicleId == uVehicleId )
+      if ( _models_get_slot_vehicle_id(true, i) == uVehicleId )
       {
-         s_pCurrentModel = s_pModelsSpectator[i];
+         s_pCurrentModel = _models_load_slot(true, i);
          log_line("Set VID %u, index %d as current spectator model", uVehicleId, i);
          return s_pCurrentModel;
       }
@@ -619,7 +882,7 @@ void logControllerModels()
    for( int i=0; i<s_iModelsCount; i++ )
    {
       if ( NULL == s_pModels[i] )
-         log_error_and_alarm("Controller model %d: is NULL.", i+1);
+         log_line("Controller model %d: VID %u, not loaded yet.", i+1, s_uModelsVehicleId[i]);
       else
          log_line("Controller model %d: VID %u, ptr: %X, is spectator: %s, must sync: %s",
             i+1, s_pModels[i]->uVehicleId, s_pModels[i], s_pModels[i]->is_spectator?"yes":"no", s_pModels[i]->b_mustSyncFromVehicle?"yes":"no");
@@ -627,8 +890,8 @@ void logControllerModels()
 
    for( int i=0; i<s_iModelsSpectatorCount; i++ )
    {
-      if ( NULL == s_pModels[i] )
-         log_error_and_alarm("Spectator model %d: is NULL.", i+1);
+      if ( NULL == s_pModelsSpectator[i] )
+         log_line("Spectator model %d: VID %u, not loaded yet.", i+1, s_uModelsSpectatorVehicleId[i]);
       else
          log_line("Spectator model %d: VID %u, ptr: %X, is spectator: %s, must sync: %s",
          i+1, s_pModelsSpectator[i]->uVehicleId, s_pModelsSpectator[i], s_pModelsSpectator[i]->is_spectator?"yes":"no", s_pModelsSpectator[i]->b_mustSyncFromVehicle?"yes":"no");
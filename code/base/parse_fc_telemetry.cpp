@@ -773,6 +773,65 @@ bool parse_telemetry_from_fc( u8* buffer, int length, t_packet_header_fc_telemet
    return ret;
 }
 
+// Messages decoded by _process_mav_message; the other messages are skipped without decoding
+static const u32 s_uMAVLinkMessagesUsed[] =
+{
+   MAVLINK_MSG_ID_STATUSTEXT, MAVLINK_MSG_ID_STATUSTEXT_LONG, MAVLINK_MSG_ID_HEARTBEAT, MAVLINK_MSG_ID_BATTERY_STATUS,
+   MAVLINK_MSG_ID_SYS_STATUS, MAVLINK_MSG_ID_GLOBAL_POSITION_INT, MAVLINK_MSG_ID_GPS_RAW_INT, MAVLINK_MSG_ID_GPS2_RAW,
+   MAVLINK_MSG_ID_VFR_HUD, MAVLINK_MSG_ID_ATTITUDE, MAVLINK_MSG_ID_RC_CHANNELS_RAW, MAVLINK_MSG_ID_RC_CHANNELS,
+   MAVLINK_MSG_ID_RADIO_STATUS, MAVLINK_MSG_ID_HIGH_LATENCY, MAVLINK_MSG_ID_HIGH_LATENCY2, MAVLINK_MSG_ID_SCALED_PRESSURE,
+   MAVLINK_MSG_ID_WIND_COV
+};
+
+int parse_telemetry_get_used_mavlink_messages(const u32** ppMessageIds)
+{
+   if ( NULL != ppMessageIds )
+      *ppMessageIds = s_uMAVLinkMessagesUsed;
+   return (int)(sizeof(s_uMAVLinkMessagesUsed)/sizeof(s_uMAVLinkMessagesUsed[0]));
+}
+
+// pFrame is a complete and valid MAVLink v1 or v2 frame (as validated by the telemetry framer)
+bool parse_telemetry_from_fc_mavlink_frame(const u8* pFrame, int iFrameLength, t_packet_header_fc_telemetry* pphfct, t_packet_header_ruby_telemetry_extended_v3* pPHRTE, u8 vehicleType)
+{
+   if ( (NULL == pFrame) || (iFrameLength < 8) )
+      return false;
+
+   int iHeaderLength = 6;
+   msgMav.magic = pFrame[0];
+   msgMav.len = pFrame[1];
+   if ( pFrame[0] == MAVLINK_STX_MAVLINK1 )
+   {
+      msgMav.incompat_flags = 0;
+      msgMav.compat_flags = 0;
+      msgMav.seq = pFrame[2];
+      msgMav.sysid = pFrame[3];
+      msgMav.compid = pFrame[4];
+      msgMav.msgid = pFrame[5];
+   }
+   else
+   {
+      iHeaderLength = 10;
+      msgMav.incompat_flags = pFrame[2];
+      msgMav.compat_flags = pFrame[3];
+      msgMav.seq = pFrame[4];
+      msgMav.sysid = pFrame[5];
+      msgMav.compid = pFrame[6];
+      msgMav.msgid = (u32)pFrame[7] | (((u32)pFrame[8]) << 8) | (((u32)pFrame[9]) << 16);
+   }
+   if ( iHeaderLength + msgMav.len + 2 > iFrameLength )
+      return false;
+
+   // MAVLink 2 payloads have the trailing zeros removed
+   u8* pPayload = (u8*)_MAV_PAYLOAD_NON_CONST(&msgMav);
+   memcpy(pPayload, pFrame + iHeaderLength, msgMav.len);
+   memset(pPayload + msgMav.len, 0, MAVLINK_MAX_PAYLOAD_LEN - msgMav.len);
+   msgMav.checksum = (u16)pFrame[iHeaderLength + msgMav.len] | (((u16)pFrame[iHeaderLength + msgMav.len + 1]) << 8);
+
+   s_uTimeLastMAVLinkMessageFromFC = get_current_timestamp_ms();
+   _process_mav_message(pphfct, pPHRTE, vehicleType);
+   return true;
+}
+
 bool has_received_gps_info()
 {
    return (s_bHasReceivedGPSInfo && s_bHasReceivedGPSPos);
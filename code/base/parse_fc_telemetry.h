@@ -10,6 +10,10 @@ void parse_telemetry_remove_duplicate_messages(bool bRemove);
 void parse_telemetry_force_always_armed(bool bForce);
 
 bool parse_telemetry_from_fc( u8* buffer, int length, t_packet_header_fc_telemetry* pphfct, t_packet_header_ruby_telemetry_extended_v3* pPHRTE, u8 vehicleType, int telemetry_type );
+// Decodes one complete MAVLink frame, as delivered by the telemetry framer dispatch table
+bool parse_telemetry_from_fc_mavlink_frame(const u8* pFrame, int iFrameLength, t_packet_header_fc_telemetry* pphfct, t_packet_header_ruby_telemetry_extended_v3* pPHRTE, u8 vehicleType);
+// MAVLink message ids that parse_telemetry_from_fc_mavlink_frame uses (the ones to register in the dispatch table)
+int parse_telemetry_get_used_mavlink_messages(const u32** ppMessageIds);
 bool has_received_gps_info();
 bool has_received_flight_mode();
 u32  get_last_message_time();
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <sched.h>
 #include "base.h"
 #include "shared_mem.h"
 #include "../radio/radiopackets2.h"
@@ -306,6 +307,113 @@ void shared_mem_rc_upstream_frame_close(t_packet_header_rc_full_frame_upstream*
    //shm_unlink(SHARED_MEM_RC_UPSTREAM_FRAME);
 }
 
+shared_mem_sequences* shared_mem_sequences_open_for_read()
+{
+   void *retVal = open_shared_mem_for_read(SHARED_MEM_PUBLISH_SEQUENCES, sizeof(shared_mem_sequences));
+   return (shared_mem_sequences*)retVal;
+}
+
+shared_mem_sequences* shared_mem_sequences_open_for_write()
+{
+   void *retVal = open_shared_mem_for_write(SHARED_MEM_PUBLISH_SEQUENCES, sizeof(shared_mem_sequences));
+   shared_mem_sequences* pSequences = (shared_mem_sequences*)retVal;
+   if ( NULL == pSequences )
+      return NULL;
+
+   // Start from a time based even value, so readers that survive a writer restart see all segments as changed
+   u32 uSeed = (get_current_timestamp_ms() << 1) & 0xFFFFFF00;
+   for( int i=0; i<SHARED_MEM_SEQ_MAX_SEGMENTS; i++ )
+      pSequences->uSequence[i] = uSeed;
+   __sync_synchronize();
+   return pSequences;
+}
+
+void shared_mem_sequences_close(shared_mem_sequences* pAddress)
+{
+   if ( NULL != pAddress )
+      munmap(pAddress, sizeof(shared_mem_sequences));
+}
+
+void shared_mem_publish(shared_mem_sequences* pSequences, int iSegment, void* pDest, const void* pSrc, int iSize)
+{
+   if ( (NULL == pDest) || (NULL == pSrc) || (iSize <= 0) )
+      return;
+   if ( (NULL == pSequences) || (iSegment < 0) || (iSegment >= SHARED_MEM_SEQ_MAX_SEGMENTS) )
+   {
+      memcpy(pDest, pSrc, iSize);
+      return;
+   }
+
+   pSequences->uSequence[iSegment]++;
+   __sync_synchronize();
+   memcpy(pDest, pSrc, iSize);
+   __sync_synchronize();
+   pSequences->uSequence[iSegment]++;
+}
+
+#define SHARED_MEM_SNAPSHOT_MAX_RETRIES 20
+
+int shared_mem_snapshot(shared_mem_sequences* pSequences, shared_mem_snapshot_state* pState, int iSegment, void* pDest, const void* pSrc, int iSize)
+{
+   if ( (NULL == pDest) || (NULL == pSrc) || (iSize <= 0) )
+      return SHARED_MEM_SNAPSHOT_UNCHANGED;
+
+   if ( (NULL == pSequences) || (NULL == pState) || (iSegment < 0) || (iSegment >= SHARED_MEM_SEQ_MAX_SEGMENTS) )
+   {
+      memcpy(pDest, pSrc, iSize);
+      if ( NULL != pState )
+      {
+         pState->uCountCopied++;
+         pState->uBytesCopied += (u32)iSize;
+      }
+      return SHARED_MEM_SNAPSHOT_COPIED;
+   }
+
+   for( int iRetry=0; iRetry<SHARED_MEM_SNAPSHOT_MAX_RETRIES; iRetry++ )
+   {
+      u32 uSeqStart = pSequences->uSequence[iSegment];
+      if ( (iRetry == 0) && (uSeqStart == pState->uLastSequence[iSegment]) )
+      {
+         pState->uCountUnchanged++;
+         pState->uBytesSkipped += (u32)iSize;
+         return SHARED_MEM_SNAPSHOT_UNCHANGED;
+      }
+      if ( iRetry > 0 )
+      {
+         pState->uCountRetries++;
+         if ( iRetry > 2 )
+            sched_yield();
+      }
+      // Writer is in the middle of an update
+      if ( uSeqStart & 0x01 )
+         continue;
+
+      __sync_synchronize();
+      memcpy(pDest, pSrc, iSize);
+      __sync_synchronize();
+
+      if ( pSequences->uSequence[iSegment] != uSeqStart )
+         continue;
+
+      pState->uLastSequence[iSegment] = uSeqStart;
+      pState->uCountCopied++;
+      pState->uBytesCopied += (u32)iSize;
+      return SHARED_MEM_SNAPSHOT_COPIED;
+   }
+   pState->uCountTorn++;
+   return SHARED_MEM_SNAPSHOT_TORN;
+}
+
+void shared_mem_snapshot_state_reset(shared_mem_snapshot_state* pState)
+{
+   if ( NULL == pState )
+      return;
+   memset(pState, 0, sizeof(shared_mem_snapshot_state));
+   // Force a first copy of all segments
+   for( int i=0; i<SHARED_MEM_SEQ_MAX_SEGMENTS; i++ )
+      pState->uLastSequence[i] = 0xFFFFFFFF;
+}
+
 void update_shared_mem_video_info_stats(shared_mem_video_info_stats* pSMVIStats, u32 uTimeNow)
 {
    if ( NULL == pSMVIStats )
@@ -19,6 +19,7 @@
 #define SHARED_MEM_VIDEO_LINK_GRAPHS "/SYSTEM_SHARED_MEM_STATION_VIDEO_LINK_GRAPHS"
 #define SHARED_MEM_RC_DOWNLOAD_INFO "R_SHARED_MEM_VEHICLE_RC_DOWNLOAD_INFO"
 #define SHARED_MEM_RC_UPSTREAM_FRAME "R_SHARED_MEM_RC_UPSTREAM_FRAME"
+#define SHARED_MEM_PUBLISH_SEQUENCES "/SYSTEM_SHARED_MEM_RUBY_PUBLISH_SEQUENCES"
 
 #define SHARED_MEM_WATCHDOG_CENTRAL "/SYSTEM_SHARED_MEM_WATCHDOG_CENTRAL"
 #define SHARED_MEM_WATCHDOG_ROUTER_RX "/SYSTEM_SHARED_MEM_WATCHDOG_ROUTER_RX"
@@ -47,6 +48,44 @@ extern "C" {
 
 
 
+// Segments published by the controller router using a sequence counter (seqlock).
+// The writer makes the counter odd before updating the segment and even again after,
+// so readers can skip unchanged segments and detect (and retry) torn copies.
+#define SHARED_MEM_SEQ_RADIO_STATS 0
+#define SHARED_MEM_SEQ_RADIO_STATS_RX_HIST 1
+#define SHARED_MEM_SEQ_RADIO_INTERFACES_RX_GRAPHS 2
+#define SHARED_MEM_SEQ_ROUTER_VEHICLES_RUNTIME_INFO 3
+#define SHARED_MEM_SEQ_VIDEO_STREAM_STATS 4
+#define SHARED_MEM_SEQ_VIDEO_STREAM_STATS_HISTORY 5
+#define SHARED_MEM_SEQ_VIDEO_RETRANSMISSIONS_STATS 6
+#define SHARED_MEM_SEQ_RADIO_RX_QUEUE_INFO 7
+#define SHARED_MEM_SEQ_VIDEO_INFO_STATS_OUTPUT 8
+#define SHARED_MEM_SEQ_VIDEO_INFO_STATS_RADIO_IN 9
+#define SHARED_MEM_SEQ_VIDEO_LINK_STATS 10
+#define SHARED_MEM_SEQ_VIDEO_LINK_GRAPHS 11
+#define SHARED_MEM_SEQ_MAX_SEGMENTS 16
+
+#define SHARED_MEM_SNAPSHOT_TORN -1
+#define SHARED_MEM_SNAPSHOT_UNCHANGED 0
+#define SHARED_MEM_SNAPSHOT_COPIED 1
+
+typedef struct
+{
+   volatile u32 uSequence[SHARED_MEM_SEQ_MAX_SEGMENTS];
+} shared_mem_sequences;
+
+// Reader side state, local to each reader process
+typedef struct
+{
+   u32 uLastSequence[SHARED_MEM_SEQ_MAX_SEGMENTS];
+   u32 uCountCopied;
+   u32 uCountUnchanged;
+   u32 uCountRetries;
+   u32 uCountTorn;
+   u32 uBytesCopied;
+   u32 uBytesSkipped;
+} shared_mem_snapshot_state;
+
 typedef struct
 {
    u32 lastActiveTime;
@@ -271,6 +310,21 @@ t_packet_header_rc_full_frame_upstream* shared_mem_rc_upstream_frame_open_read()
 t_packet_header_rc_full_frame_upstream* shared_mem_rc_upstream_frame_open_write();
 void shared_mem_rc_upstream_frame_close(t_packet_header_rc_full_frame_upstream* pRCFrame);
 
+shared_mem_sequences* shared_mem_sequences_open_for_read();
+shared_mem_sequences* shared_mem_sequences_open_for_write();
+void shared_mem_sequences_close(shared_mem_sequences* pAddress);
+
+// Copies iSize bytes from pSrc (local copy) to pDest (shared segment) bumping the segment sequence around the copy.
+// Plain copy if pSequences is NULL.
+void shared_mem_publish(shared_mem_sequences* pSequences, int iSegment, void* pDest, const void* pSrc, int iSize);
+
+// Copies the shared segment pSrc to pDest only if its sequence changed since the last snapshot.
+// Retries while the writer is updating it. Returns one of SHARED_MEM_SNAPSHOT_* values.
+// On SHARED_MEM_SNAPSHOT_TORN (writer kept updating it) pDest may hold a partial copy; it's refreshed on the next call.
+// Always copies if pSequences is NULL (writer not publishing sequences).
+int shared_mem_snapshot(shared_mem_sequences* pSequences, shared_mem_snapshot_state* pState, int iSegment, void* pDest, const void* pSrc, int iSize);
+void shared_mem_snapshot_state_reset(shared_mem_snapshot_state* pState);
+
 void update_shared_mem_video_info_stats(shared_mem_video_info_stats* pSMVIStats, u32 uTimeNow);
 
 void reset_radio_tx_timers(type_radio_tx_timers* pRadioTxTimers);
@@ -0,0 +1,392 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "telemetry_framer.h"
+#include "hardware.h"
+#include "../../mavlink/common/mavlink.h"
+#include <poll.h>
+
+#define MAVLINK_V1_START_BYTE 0xFE
+#define MAVLINK_V1_HEADER_LENGTH 6
+#define MAVLINK_V2_START_BYTE 0xFD
+#define MAVLINK_V2_HEADER_LENGTH 10
+
+// Result of checking a frame at a buffer position: frame length if it's a valid frame,
+// 0 if more data is needed, -1 if it's not a valid frame (skip the byte)
+#define FRAME_CHECK_INCOMPLETE 0
+#define FRAME_CHECK_INVALID -1
+
+void telemetry_framer_init(t_telemetry_framer* pFramer, int iProtocol, int iAutoConsume, void* pContext)
+{
+   if ( NULL == pFramer )
+      return;
+   pFramer->iFd = -1;
+   pFramer->iProtocol = iProtocol;
+   pFramer->iAutoConsume = iAutoConsume;
+   pFramer->pContext = pContext;
+   for( int i=0; i<TELEMETRY_FRAMER_MAX_HANDLERS; i++ )
+      pFramer->pHandlers[i] = NULL;
+   pFramer->pDefaultHandler = NULL;
+   memset(&pFramer->stats, 0, sizeof(pFramer->stats));
+   telemetry_framer_reset(pFramer);
+}
+
+void telemetry_framer_set_fd(t_telemetry_framer* pFramer, int iFd)
+{
+   if ( (NULL == pFramer) || (pFramer->iFd == iFd) )
+      return;
+   pFramer->iFd = iFd;
+   telemetry_framer_reset(pFramer);
+}
+
+void telemetry_framer_reset(t_telemetry_framer* pFramer)
+{
+   if ( NULL == pFramer )
+      return;
+   pFramer->iStart = 0;
+   pFramer->iParsed = 0;
+   pFramer->iEnd = 0;
+   pFramer->iReadyEndsOnFrame = 0;
+   pFramer->iLastReadBytes = 0;
+}
+
+void telemetry_framer_set_handler(t_telemetry_framer* pFramer, u32 uMessageId, telemetry_framer_handler pHandler)
+{
+   if ( (NULL == pFramer) || (uMessageId >= TELEMETRY_FRAMER_MAX_HANDLERS) )
+      return;
+   pFramer->pHandlers[uMessageId] = pHandler;
+}
+
+void telemetry_framer_set_default_handler(t_telemetry_framer* pFramer, telemetry_framer_handler pHandler)
+{
+   if ( NULL != pFramer )
+      pFramer->pDefaultHandler = pHandler;
+}
+
+static int _telemetry_framer_check_mavlink(const u8* pData, int iLength, u32* puMessageId)
+{
+   int iHeaderLength = 0;
+   int iFrameLength = 0;
+   if ( pData[0] == MAVLINK_V1_START_BYTE )
+   {
+      iHeaderLength = MAVLINK_V1_HEADER_LENGTH;
+      if ( iLength < iHeaderLength )
+         return FRAME_CHECK_INCOMPLETE;
+      iFrameLength = iHeaderLength + pData[1] + MAVLINK_NUM_CHECKSUM_BYTES;
+      *puMessageId = pData[5];
+   }
+   else
+   {
+      iHeaderLength = MAVLINK_V2_HEADER_LENGTH;
+      if ( iLength < iHeaderLength )
+         return FRAME_CHECK_INCOMPLETE;
+      if ( pData[2] & ~MAVLINK_IFLAG_SIGNED )
+         return FRAME_CHECK_INVALID;
+      iFrameLength = iHeaderLength + pData[1] + MAVLINK_NUM_CHECKSUM_BYTES;
+      if ( pData[2] & MAVLINK_IFLAG_SIGNED )
+         iFrameLength += MAVLINK_SIGNATURE_BLOCK_LEN;
+      *puMessageId = (u32)pData[7] | (((u32)pData[8]) << 8) | (((u32)pData[9]) << 16);
+   }
+   if ( iLength < iFrameLength )
+      return FRAME_CHECK_INCOMPLETE;
+
+   // Messages not known to this build can't be validated, accept them as they are
+   const mavlink_msg_entry_t* pEntry = mavlink_get_msg_entry(*puMessageId);
+   if ( NULL == pEntry )
+      return iFrameLength;
+
+   int iCRCOffset = iHeaderLength + pData[1];
+   u16 uCRC = crc_calculate(pData + 1, iCRCOffset - 1);
+   crc_accumulate(pEntry->crc_extra, &uCRC);
+   if ( (pData[iCRCOffset] != (uCRC & 0xFF)) || (pData[iCRCOffset+1] != (uCRC >> 8)) )
+      return FRAME_CHECK_INVALID;
+   return iFrameLength;
+}
+
+static int _telemetry_framer_check_ltm(const u8* pData, int iLength, u32* puMessageId)
+{
+   if ( iLength < 3 )
+      return (iLength < 2 || pData[1] == 'T')?FRAME_CHECK_INCOMPLETE:FRAME_CHECK_INVALID;
+   if ( pData[1] != 'T' )
+      return FRAME_CHECK_INVALID;
+
+   int iFrameLength = 0;
+   switch ( pData[2] )
+   {
+      case 'G': iFrameLength = 18; break;
+      case 'A': iFrameLength = 10; break;
+      case 'S': iFrameLength = 11; break;
+      case 'O': iFrameLength = 18; break;
+      case 'N': iFrameLength = 10; break;
+      case 'X': iFrameLength = 10; break;
+      default: return FRAME_CHECK_INVALID;
+   }
+   if ( iLength < iFrameLength )
+      return FRAME_CHECK_INCOMPLETE;
+
+   // Payload and checksum byte xor to 0
+   u8 uChecksum = 0;
+   for( int i=3; i<iFrameLength; i++ )
+      uChecksum ^= pData[i];
+   if ( 0 != uChecksum )
+      return FRAME_CHECK_INVALID;
+   *puMessageId = pData[2];
+   return iFrameLength;
+}
+
+static int _telemetry_framer_check_msp(const u8* pData, int iLength, u32* puMessageId)
+{
+   if ( (iLength >= 2) && (pData[1] != 'M') )
+      return FRAME_CHECK_INVALID;
+   if ( (iLength >= 3) && (pData[2] != '<') && (pData[2] != '>') )
+      return FRAME_CHECK_INVALID;
+   if ( iLength < 5 )
+      return FRAME_CHECK_INCOMPLETE;
+
+   // $M<dir> size command payload checksum (xor of size, command, payload)
+   int iFrameLength = 6 + pData[3];
+   if ( iLength < iFrameLength )
+      return FRAME_CHECK_INCOMPLETE;
+   u8 uChecksum = 0;
+   for( int i=3; i<iFrameLength-1; i++ )
+      uChecksum ^= pData[i];
+   if ( uChecksum != pData[iFrameLength-1] )
+      return FRAME_CHECK_INVALID;
+   *puMessageId = pData[4];
+   return iFrameLength;
+}
+
+int telemetry_framer_parse(t_telemetry_framer* pFramer)
+{
+   if ( NULL == pFramer )
+      return 0;
+
+   if ( pFramer->iProtocol == TELEMETRY_FRAMER_PROTOCOL_RAW )
+   {
+      pFramer->iParsed = pFramer->iEnd;
+      if ( pFramer->iAutoConsume )
+         pFramer->iStart = pFramer->iParsed;
+      return 0;
+   }
+
+   u8 uStartByte1 = '$';
+   u8 uStartByte2 = '$';
+   if ( pFramer->iProtocol == TELEMETRY_FRAMER_PROTOCOL_MAVLINK )
+   {
+      uStartByte1 = MAVLINK_V1_START_BYTE;
+      uStartByte2 = MAVLINK_V2_START_BYTE;
+   }
+
+   int iCountFrames = 0;
+   while ( pFramer->iParsed < pFramer->iEnd )
+   {
+      u8* pData = &pFramer->uBuffer[pFramer->iParsed];
+      int iLength = pFramer->iEnd - pFramer->iParsed;
+
+      // Skip to the next possible frame start
+      if ( (pData[0] != uStartByte1) && (pData[0] != uStartByte2) )
+      {
+         int iSkip = 1;
+         while ( (iSkip < iLength) && (pData[iSkip] != uStartByte1) && (pData[iSkip] != uStartByte2) )
+            iSkip++;
+         pFramer->iParsed += iSkip;
+         pFramer->stats.uCountSkippedBytes += iSkip;
+         pFramer->iReadyEndsOnFrame = 0;
+         continue;
+      }
+
+      u32 uMessageId = 0;
+      int iFrameLength = FRAME_CHECK_INVALID;
+      if ( pFramer->iProtocol == TELEMETRY_FRAMER_PROTOCOL_MAVLINK )
+         iFrameLength = _telemetry_framer_check_mavlink(pData, iLength, &uMessageId);
+      else if ( pFramer->iProtocol == TELEMETRY_FRAMER_PROTOCOL_LTM )
+         iFrameLength = _telemetry_framer_check_ltm(pData, iLength, &uMessageId);
+      else if ( pFramer->iProtocol == TELEMETRY_FRAMER_PROTOCOL_MSP )
+         iFrameLength = _telemetry_framer_check_msp(pData, iLength, &uMessageId);
+
+      if ( FRAME_CHECK_INCOMPLETE == iFrameLength )
+         break;
+      if ( FRAME_CHECK_INVALID == iFrameLength )
+      {
+         pFramer->iParsed++;
+         pFramer->stats.uCountBadFrames++;
+         pFramer->stats.uCountSkippedBytes++;
+         pFramer->iReadyEndsOnFrame = 0;
+         continue;
+      }
+
+      pFramer->stats.uCountFrames++;
+      iCountFrames++;
+      telemetry_framer_handler pHandler = pFramer->pDefaultHandler;
+      if ( (uMessageId < TELEMETRY_FRAMER_MAX_HANDLERS) && (NULL != pFramer->pHandlers[uMessageId]) )
+         pHandler = pFramer->pHandlers[uMessageId];
+      if ( NULL != pHandler )
+      {
+         pFramer->stats.uCountFramesDispatched++;
+         pHandler(pFramer->pContext, uMessageId, pData, iFrameLength);
+      }
+      pFramer->iParsed += iFrameLength;
+      pFramer->iReadyEndsOnFrame = 1;
+   }
+
+   if ( pFramer->iAutoConsume )
+      pFramer->iStart = pFramer->iParsed;
+   return iCountFrames;
+}
+
+// Makes room at the end of the buffer for new data
+static int _telemetry_framer_get_free_space(t_telemetry_framer* pFramer)
+{
+   if ( pFramer->iStart == pFramer->iEnd )
+   {
+      pFramer->iStart = pFramer->iParsed = pFramer->iEnd = 0;
+      return TELEMETRY_FRAMER_BUFFER_SIZE;
+   }
+   if ( pFramer->iEnd < TELEMETRY_FRAMER_BUFFER_SIZE )
+      return TELEMETRY_FRAMER_BUFFER_SIZE - pFramer->iEnd;
+
+   // Owner did not consume the ready data: drop the oldest half
+   if ( 0 == pFramer->iStart )
+   {
+      int iDrop = (pFramer->iParsed - pFramer->iStart)/2;
+      if ( iDrop < TELEMETRY_FRAMER_BUFFER_SIZE/4 )
+         iDrop = TELEMETRY_FRAMER_BUFFER_SIZE/4;
+      pFramer->iStart += iDrop;
+      if ( pFramer->iParsed < pFramer->iStart )
+         pFramer->iParsed = pFramer->iStart;
+      pFramer->stats.uCountSkippedBytes += iDrop;
+   }
+
+   int iKeep = pFramer->iEnd - pFramer->iStart;
+   memmove(pFramer->uBuffer, &pFramer->uBuffer[pFramer->iStart], iKeep);
+   pFramer->iParsed -= pFramer->iStart;
+   pFramer->iEnd = iKeep;
+   pFramer->iStart = 0;
+   return TELEMETRY_FRAMER_BUFFER_SIZE - pFramer->iEnd;
+}
+
+int telemetry_framer_read(t_telemetry_framer* pFramer)
+{
+   if ( (NULL == pFramer) || (pFramer->iFd < 0) )
+      return -1;
+
+   int iFree = _telemetry_framer_get_free_space(pFramer);
+   int iRead = read(pFramer->iFd, &pFramer->uBuffer[pFramer->iEnd], iFree);
+   pFramer->iLastReadBytes = 0;
+   if ( iRead < 0 )
+   {
+      if ( (errno == EAGAIN) || (errno == EINTR) )
+         return 0;
+      return -1;
+   }
+   pFramer->iLastReadBytes = iRead;
+   pFramer->iEnd += iRead;
+   pFramer->stats.uCountBytesRead += iRead;
+   telemetry_framer_parse(pFramer);
+   return iRead;
+}
+
+int telemetry_framer_add_data(t_telemetry_framer* pFramer, const u8* pData, int iLength)
+{
+   if ( (NULL == pFramer) || (NULL == pData) || (iLength <= 0) )
+      return 0;
+   int iAdded = 0;
+   while ( iAdded < iLength )
+   {
+      int iFree = _telemetry_framer_get_free_space(pFramer);
+      int iChunk = iLength - iAdded;
+      if ( iChunk > iFree )
+         iChunk = iFree;
+      memcpy(&pFramer->uBuffer[pFramer->iEnd], pData + iAdded, iChunk);
+      pFramer->iEnd += iChunk;
+      pFramer->stats.uCountBytesRead += iChunk;
+      iAdded += iChunk;
+      telemetry_framer_parse(pFramer);
+   }
+   pFramer->iLastReadBytes = iAdded;
+   return iAdded;
+}
+
+int telemetry_framer_get_ready_data(t_telemetry_framer* pFramer, u8** ppData)
+{
+   if ( NULL == pFramer )
+      return 0;
+   if ( NULL != ppData )
+      *ppData = &pFramer->uBuffer[pFramer->iStart];
+   return pFramer->iParsed - pFramer->iStart;
+}
+
+void telemetry_framer_consume(t_telemetry_framer* pFramer, int iLength)
+{
+   if ( (NULL == pFramer) || (iLength <= 0) )
+      return;
+   pFramer->iStart += iLength;
+   if ( pFramer->iStart > pFramer->iParsed )
+      pFramer->iStart = pFramer->iParsed;
+}
+
+int telemetry_framer_poll(t_telemetry_framer** pFramers, int iCountFramers, int iTimeoutMs)
+{
+   struct pollfd fds[8];
+   int iFramerIndex[8];
+   int iCountFds = 0;
+   for( int i=0; (i<iCountFramers) && (iCountFds < 8); i++ )
+   {
+      if ( (NULL == pFramers[i]) || (pFramers[i]->iFd < 0) )
+         continue;
+      pFramers[i]->iLastReadBytes = 0;
+      fds[iCountFds].fd = pFramers[i]->iFd;
+      fds[iCountFds].events = POLLIN;
+      fds[iCountFds].revents = 0;
+      iFramerIndex[iCountFds] = i;
+      iCountFds++;
+   }
+   if ( 0 == iCountFds )
+   {
+      if ( iTimeoutMs > 0 )
+         hardware_sleep_ms(iTimeoutMs);
+      return 0;
+   }
+
+   int iRes = poll(fds, iCountFds, iTimeoutMs);
+   if ( iRes < 0 )
+      return (errno == EINTR)?0:-1;
+
+   int iCountRead = 0;
+   for( int i=0; i<iCountFds; i++ )
+   {
+      if ( ! (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) )
+         continue;
+      if ( telemetry_framer_read(pFramers[iFramerIndex[i]]) > 0 )
+         iCountRead++;
+   }
+   return iCountRead;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "base.h"
+
+// Incremental framing of serial telemetry streams (MAVLink v1/v2, LTM, MSP v1).
+// Serial data is read straight into the framer buffer; complete frames are validated in place
+// (no per byte state machine, no copy to a message struct) and dispatched by message id through a
+// jump table of handlers. Only messages that have a handler are decoded by the consumer.
+// The parsed data stays in the buffer until the owner consumes it, so it can also be forwarded
+// as is (raw telemetry forwarding), cut at frame boundaries.
+
+#define TELEMETRY_FRAMER_PROTOCOL_RAW 0     // no framing, all read data is ready as soon as it's read
+#define TELEMETRY_FRAMER_PROTOCOL_MAVLINK 1
+#define TELEMETRY_FRAMER_PROTOCOL_LTM 2
+#define TELEMETRY_FRAMER_PROTOCOL_MSP 3
+
+#define TELEMETRY_FRAMER_BUFFER_SIZE 4096
+// MAVLink ids above this go to the default handler
+#define TELEMETRY_FRAMER_MAX_HANDLERS 512
+
+// pFrame points to the whole frame (start bytes to checksum), valid only during the call
+typedef void (*telemetry_framer_handler)(void* pContext, u32 uMessageId, const u8* pFrame, int iFrameLength);
+
+typedef struct
+{
+   u32 uCountBytesRead;
+   u32 uCountFrames;
+   u32 uCountFramesDispatched;
+   u32 uCountBadFrames; // bad checksum
+   u32 uCountSkippedBytes; // bytes not part of any valid frame
+} t_telemetry_framer_stats;
+
+typedef struct
+{
+   int iFd;
+   int iProtocol;
+   // Consumed (forwarded) data: [0, iStart); ready data (parsed): [iStart, iParsed); not yet complete frame: [iParsed, iEnd)
+   int iStart;
+   int iParsed;
+   int iEnd;
+   int iAutoConsume; // owner does not forward the data, it's discarded once parsed
+   int iReadyEndsOnFrame; // ready data ends with a complete frame
+   int iLastReadBytes;
+   telemetry_framer_handler pHandlers[TELEMETRY_FRAMER_MAX_HANDLERS];
+   telemetry_framer_handler pDefaultHandler;
+   void* pContext;
+   t_telemetry_framer_stats stats;
+   u8 uBuffer[TELEMETRY_FRAMER_BUFFER_SIZE];
+} t_telemetry_framer;
+
+void telemetry_framer_init(t_telemetry_framer* pFramer, int iProtocol, int iAutoConsume, void* pContext);
+// Discards any buffered data if the file descriptor changes
+void telemetry_framer_set_fd(t_telemetry_framer* pFramer, int iFd);
+void telemetry_framer_reset(t_telemetry_framer* pFramer);
+void telemetry_framer_set_handler(t_telemetry_framer* pFramer, u32 uMessageId, telemetry_framer_handler pHandler);
+void telemetry_framer_set_default_handler(t_telemetry_framer* pFramer, telemetry_framer_handler pHandler);
+
+// Reads available data from the framer file descriptor and parses it. Returns the number of bytes read, -1 on error.
+int telemetry_framer_read(t_telemetry_framer* pFramer);
+// Adds data that did not come from the file descriptor (i.e. a test stream) and parses it. Returns the number of bytes added.
+int telemetry_framer_add_data(t_telemetry_framer* pFramer, const u8* pData, int iLength);
+// Parses the buffered data and dispatches the complete frames. Returns the number of complete frames.
+int telemetry_framer_parse(t_telemetry_framer* pFramer);
+
+// Parsed data ready to be forwarded (complete frames and skipped bytes)
+int telemetry_framer_get_ready_data(t_telemetry_framer* pFramer, u8** ppData);
+void telemetry_framer_consume(t_telemetry_framer* pFramer, int iLength);
+
+// Waits up to iTimeoutMs on all the framers file descriptors (one poll set), then reads and parses
+// the data from all the ready ones. Returns the number of framers that read data, -1 on error.
+int telemetry_framer_poll(t_telemetry_framer** pFramers, int iCountFramers, int iTimeoutMs);
@@ -0,0 +1,312 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "base.h"
+#include "config.h"
+#include "models.h"
+#include "utils.h"
+#include "../radio/radiopackets2.h"
+#include "video_link_adaptive_logic.h"
+
+typedef struct
+{
+   int iCountReconstructed;
+   int iLongestReconstruction;
+   int iCountRetransmissions;
+   int iCountReRetransmissions;
+   int iCountMissingSegments;
+} t_adaptive_intervals_counters;
+
+// Counts, going back in time, the intervals that had reconstructed packets, retransmissions, missing packets.
+// Continues from the interval index and counters of a previous call.
+
+static void _video_link_adaptive_count_intervals(shared_mem_controller_adaptive_video_info_vehicle* pInfo, int iCountIntervals, int* piIndex, t_adaptive_intervals_counters* pCounters)
+{
+   int iCurrentReconstructionLength = 0;
+   int iIndex = *piIndex;
+
+   for( int i=0; i<iCountIntervals; i++ )
+   {
+      iIndex--;
+      if ( iIndex < 0 )
+         iIndex = MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-1;
+      pCounters->iCountReconstructed += (pInfo->uIntervalsOuputRecontructedVideoPackets[iIndex]!=0)?1:0;
+      pCounters->iCountRetransmissions += (pInfo->uIntervalsRequestedRetransmissions[iIndex]!=0)?1:0;
+      pCounters->iCountReRetransmissions += (pInfo->uIntervalsRetriedRetransmissions[iIndex]!=0)?1:0;
+      pCounters->iCountMissingSegments += (pInfo->uIntervalsMissingVideoPackets[iIndex]!=0)?1:0;
+
+      if ( pInfo->uIntervalsOuputRecontructedVideoPackets[iIndex] != 0 )
+         iCurrentReconstructionLength++;
+      else
+      {
+         if ( iCurrentReconstructionLength > pCounters->iLongestReconstruction )
+            pCounters->iLongestReconstruction = iCurrentReconstructionLength;
+         iCurrentReconstructionLength = 0;
+      }
+   }
+
+   if ( iCurrentReconstructionLength > pCounters->iLongestReconstruction )
+      pCounters->iLongestReconstruction = iCurrentReconstructionLength;
+   *piIndex = iIndex;
+}
+
+int video_link_adaptive_compute_target_level(Model* pModel, shared_mem_controller_adaptive_video_info_vehicle* pInfo, u32 uTimeNow, u32* puTimeStartGoodInterval)
+{
+   if ( (NULL == pModel) || (NULL == pInfo) || (NULL == puTimeStartGoodInterval) )
+      return 0;
+   if ( 0 == pInfo->uUpdateInterval )
+      return 0;
+   if ( uTimeNow < pInfo->uTimeLastLevelShiftDown + 50 )
+      return 0;
+   if ( uTimeNow < pInfo->uTimeLastLevelShiftUp + 50 )
+      return 0;
+
+   int iInitialTargetLevelShift = pInfo->iCurrentTargetLevelShift;
+
+   int iLevelsHQ = pModel->get_video_profile_total_levels(pModel->video_params.user_selected_video_link_profile);
+   int iLevelsMQ = pModel->get_video_profile_total_levels(VIDEO_PROFILE_MQ);
+   int iLevelsLQ = pModel->get_video_profile_total_levels(VIDEO_PROFILE_LQ);
+   int iMaxLevels = iLevelsHQ;
+   iMaxLevels +=  iLevelsMQ;
+   if ( ! (pModel->video_link_profiles[pModel->video_params.user_selected_video_link_profile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_USE_MEDIUM_ADAPTIVE_VIDEO) )
+      iMaxLevels += iLevelsLQ;
+
+   // videoAdjustmentStrength is 1 (lowest strength) to 10 (highest strength)
+   // fParamsChangeStrength: higher value means more aggresive adjustments. From 0.1 to 1
+   float fParamsChangeStrength = (float)pModel->video_params.videoAdjustmentStrength / 10.0;
+
+   // When in MQ video profile, switch slower to LQ video profile
+
+   if ( pInfo->iCurrentTargetLevelShift > iLevelsHQ )
+   {
+      fParamsChangeStrength -= 0.1;
+      if ( fParamsChangeStrength < 0.1 )
+         fParamsChangeStrength = 0.1;
+   }
+
+   // Max interval time we can check is:
+   // MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS * CONTROLLER_ADAPTIVE_VIDEO_SAMPLE_INTERVAL ms
+   //    = 3.6 seconds
+   // Minus one because the current index is still processing/invalid
+
+   int iIntervalsToCheckDown = (1.0-0.5*fParamsChangeStrength) * MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS;
+   int iIntervalsToCheckUp = (1.0-0.3*fParamsChangeStrength) * MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS;
+   if ( iIntervalsToCheckDown >= MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-1 )
+      iIntervalsToCheckDown = MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-2;
+   if ( iIntervalsToCheckUp >= MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-1 )
+      iIntervalsToCheckUp = MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-2;
+
+   int iIntervalsSinceLastShiftDown = (uTimeNow - pInfo->uTimeLastLevelShiftDown) / pInfo->uUpdateInterval;
+   if ( iIntervalsToCheckDown > iIntervalsSinceLastShiftDown )
+      iIntervalsToCheckDown = iIntervalsSinceLastShiftDown;
+   if ( iIntervalsToCheckDown <= 0 )
+      iIntervalsToCheckDown = 1;
+
+   pInfo->uIntervalsAdaptive1 = ((u16)iIntervalsToCheckDown) | (((u16)iIntervalsToCheckUp)<<16);
+
+   int iIndex = pInfo->iCurrentIntervalIndex - 1;
+   if ( iIndex < 0 )
+      iIndex = MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-1;
+
+   t_adaptive_intervals_counters countersDown;
+   memset(&countersDown, 0, sizeof(t_adaptive_intervals_counters));
+   _video_link_adaptive_count_intervals(pInfo, iIntervalsToCheckDown, &iIndex, &countersDown);
+
+   // Up intervals include the down ones, plus the older ones
+   t_adaptive_intervals_counters countersUp;
+   memcpy(&countersUp, &countersDown, sizeof(t_adaptive_intervals_counters));
+   if ( iIntervalsToCheckUp > iIntervalsToCheckDown )
+      _video_link_adaptive_count_intervals(pInfo, iIntervalsToCheckUp - iIntervalsToCheckDown, &iIndex, &countersUp);
+
+   bool bDidAnyShift = false;
+
+   // Check for shift down
+
+   int iThresholdReconstructedDown = 2 + (1.0-fParamsChangeStrength)*iIntervalsToCheckDown*0.9;
+   int iThresholdLongestRecontructionDown = 2 + (1.0-fParamsChangeStrength)*iIntervalsToCheckDown*0.7;
+   int iThresholdRetransmissionsDown = 1 + (1.0-fParamsChangeStrength)*iIntervalsToCheckDown/8.0;
+   
+   u32 uMinTimeSinceLastShift = iIntervalsToCheckDown * pInfo->uUpdateInterval;
+   if ( iThresholdReconstructedDown * pInfo->uUpdateInterval < uMinTimeSinceLastShift )
+      uMinTimeSinceLastShift = iThresholdReconstructedDown * pInfo->uUpdateInterval;
+   if ( iThresholdRetransmissionsDown * pInfo->uUpdateInterval < uMinTimeSinceLastShift )
+      uMinTimeSinceLastShift = iThresholdRetransmissionsDown * pInfo->uUpdateInterval;
+
+   if ( uMinTimeSinceLastShift < 100 )
+      uMinTimeSinceLastShift = 100;
+   if ( uMinTimeSinceLastShift > 500 )
+      uMinTimeSinceLastShift = 500;
+   if ( uTimeNow > pInfo->uTimeLastLevelShiftDown + uMinTimeSinceLastShift )
+   {
+      if ( countersDown.iCountRetransmissions > iThresholdRetransmissionsDown )
+      {
+         bDidAnyShift = true;
+         pInfo->uTimeLastLevelShiftDown = uTimeNow;
+         
+         // Go directly to next video profile down
+         if ( pInfo->iCurrentTargetLevelShift < iLevelsHQ )
+            pInfo->iCurrentTargetLevelShift = iLevelsHQ;
+         else if ( pInfo->iCurrentTargetLevelShift < iLevelsHQ + iLevelsMQ)
+            pInfo->iCurrentTargetLevelShift = iLevelsHQ+iLevelsMQ;
+         else 
+            pInfo->iCurrentTargetLevelShift = iMaxLevels - 1;
+
+         if ( pInfo->iCurrentTargetLevelShift >= iMaxLevels )
+            pInfo->iCurrentTargetLevelShift = iMaxLevels - 1;
+      }
+
+      if ( ! bDidAnyShift )
+      if ( (countersDown.iCountReconstructed > iThresholdReconstructedDown) ||
+           (countersDown.iLongestReconstruction > iThresholdLongestRecontructionDown) )
+      {
+         bDidAnyShift = true;
+         pInfo->uTimeLastLevelShiftDown = uTimeNow;
+         pInfo->iCurrentTargetLevelShift++;
+         
+         if ( pInfo->iCurrentTargetLevelShift >= iMaxLevels )
+            pInfo->iCurrentTargetLevelShift = iMaxLevels - 1;
+      }
+
+      if ( ! bDidAnyShift )
+      if ( (pInfo->iCurrentTargetLevelShift == 0) ||
+           (pInfo->iCurrentTargetLevelShift == iLevelsHQ) ||
+           (pInfo->iCurrentTargetLevelShift == iLevelsMQ) )
+      if ( (countersDown.iCountReconstructed > iThresholdReconstructedDown/2+1) ||
+           (countersDown.iLongestReconstruction > iThresholdLongestRecontructionDown/2+1) )
+      {
+         bDidAnyShift = true;
+         pInfo->uTimeLastLevelShiftDown = uTimeNow;
+         pInfo->iCurrentTargetLevelShift++;
+         
+         if ( pInfo->iCurrentTargetLevelShift >= iMaxLevels )
+            pInfo->iCurrentTargetLevelShift = iMaxLevels - 1;
+      }
+   }
+
+   // Check for shift up ?
+   // Only if we did not shifted down or up recently
+
+   int iThresholdReconstructedUp = 1 + (1.0-fParamsChangeStrength)*iIntervalsToCheckUp*0.4;
+   int iThresholdLongestRecontructionUp = 1 + (1.0-fParamsChangeStrength)*iIntervalsToCheckUp*0.2;
+   int iThresholdRetransmissionsUp = 1 + (1.0-fParamsChangeStrength)*iIntervalsToCheckUp*0.05;
+
+   u32 uTimeForShiftUp = 1000 - (500.0*fParamsChangeStrength);
+   if ( uTimeForShiftUp < 100 )
+      uTimeForShiftUp = 100;
+   if ( uTimeForShiftUp > 1000 )
+      uTimeForShiftUp = 1000;
+   pInfo->uIntervalsAdaptive2 = ((u32)iThresholdReconstructedUp) | (((u32)iThresholdLongestRecontructionUp)<<8);
+   pInfo->uIntervalsAdaptive2 |= (((u32)iThresholdReconstructedDown)<<16) | (((u32)iThresholdLongestRecontructionDown)<<24);
+   
+   if ( uTimeNow > pInfo->uTimeLastLevelShiftDown + uTimeForShiftUp )
+   if ( uTimeNow > pInfo->uTimeLastLevelShiftUp + uTimeForShiftUp )
+   {
+      if ( countersUp.iCountReconstructed < iThresholdReconstructedUp )
+      if ( countersUp.iLongestReconstruction < iThresholdLongestRecontructionUp )
+      if ( countersUp.iCountRetransmissions < iThresholdRetransmissionsUp )
+      {
+         bDidAnyShift = true;
+
+         if ( 0 == *puTimeStartGoodInterval )
+            *puTimeStartGoodInterval = uTimeNow;
+         else if ( uTimeNow >= *puTimeStartGoodInterval + DEFAULT_MINIMUM_OK_INTERVAL_MS_TO_SWITCH_VIDEO_PROFILE_UP )
+         {
+            *puTimeStartGoodInterval = 0;
+            pInfo->uTimeLastLevelShiftUp = uTimeNow;
+            if ( pInfo->iCurrentTargetLevelShift > 0 )
+            {
+               pInfo->iCurrentTargetLevelShift--;
+               // Skip data:fec == 1:1 leves
+               if ( pInfo->iCurrentTargetLevelShift == iLevelsHQ-1 )
+                  pInfo->iCurrentTargetLevelShift--;
+               if ( pInfo->iCurrentTargetLevelShift == iLevelsHQ + iLevelsMQ - 1 )
+                  pInfo->iCurrentTargetLevelShift--;
+               if ( pInfo->iCurrentTargetLevelShift == iLevelsHQ + iLevelsMQ + iLevelsLQ - 1 )
+                  pInfo->iCurrentTargetLevelShift--;
+            }
+            if ( pInfo->iCurrentTargetLevelShift < 0 )
+               pInfo->iCurrentTargetLevelShift = 0;
+         }
+      }
+   }
+   
+   if ( ! bDidAnyShift )
+      *puTimeStartGoodInterval = 0;
+
+   return (pInfo->iCurrentTargetLevelShift != iInitialTargetLevelShift)?1:0;
+}
+
+u32 video_link_adaptive_get_level_video_bitrate(Model* pModel, int iVideoProfile, int iProfileLevelShift, int iUserVideoProfile, u32 uBitrateOverwriteDown)
+{
+   if ( NULL == pModel )
+      return 0;
+
+   u32 uTargetVideoBitrate = utils_get_max_allowed_video_bitrate_for_profile_and_level(pModel, iVideoProfile, iProfileLevelShift);
+
+   if ( uTargetVideoBitrate > uBitrateOverwriteDown )
+      uTargetVideoBitrate -= uBitrateOverwriteDown;
+   else
+      uTargetVideoBitrate = 0;
+
+   if ( uTargetVideoBitrate < 250000 )
+      uTargetVideoBitrate = 250000;
+
+   if ( iVideoProfile != VIDEO_PROFILE_USER )
+   if ( iVideoProfile != VIDEO_PROFILE_BEST_PERF )
+   if ( iVideoProfile != VIDEO_PROFILE_HIGH_QUALITY )
+   if ( uTargetVideoBitrate < pModel->video_params.lowestAllowedAdaptiveVideoBitrate )
+      uTargetVideoBitrate = pModel->video_params.lowestAllowedAdaptiveVideoBitrate;
+
+   // Minimum for MQ profile, for 12 Mb datarate is at least 2Mb, do not go below that
+   if ( iVideoProfile == VIDEO_PROFILE_MQ )
+   if ( pModel->video_link_profiles[VIDEO_PROFILE_MQ].radio_datarate_video_bps == 0 )
+   if ( getRealDataRateFromRadioDataRate(pModel->video_link_profiles[iUserVideoProfile].radio_datarate_video_bps, 0) >= 12000000 )
+   if ( uTargetVideoBitrate < 2000000 )
+      uTargetVideoBitrate = 2000000;
+     
+   return uTargetVideoBitrate;
+}
+
+void video_link_adaptive_get_level_params(Model* pModel, int iTotalLevelsShift, int iUserVideoProfile, u32 uBitrateOverwriteDown, t_adaptive_video_level_params* pParams)
+{
+   if ( (NULL == pModel) || (NULL == pParams) )
+      return;
+
+   pParams->iVideoProfile = pModel->get_video_profile_from_total_levels_shift(iTotalLevelsShift);
+   pParams->iProfileLevelShift = pModel->get_video_profile_level_shift_from_total_levels_shift(iTotalLevelsShift);
+   pParams->iDataPackets = 0;
+   pParams->iECPackets = 0;
+   pModel->get_level_shift_ec_scheme(iTotalLevelsShift, &pParams->iDataPackets, &pParams->iECPackets);
+   if ( pParams->iECPackets > MAX_FECS_PACKETS_IN_BLOCK )
+      pParams->iECPackets = MAX_FECS_PACKETS_IN_BLOCK;
+   pParams->uVideoBitrate = video_link_adaptive_get_level_video_bitrate(pModel, pParams->iVideoProfile, pParams->iProfileLevelShift, iUserVideoProfile, uBitrateOverwriteDown);
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include "base.h"
+#include "config.h"
+#include "models.h"
+#include "shared_mem_controller_only.h"
+
+// Adaptive video link decision logic, without any dependency on the router globals,
+// so it's used as is by the controller and vehicle routers and by the link simulation test.
+
+typedef struct
+{
+   int iVideoProfile;
+   int iProfileLevelShift;
+   int iDataPackets;
+   int iECPackets;
+   u32 uVideoBitrate; // bps
+} t_adaptive_video_level_params;
+
+// Controller side: checks the received video intervals (ring buffer in pInfo) and shifts the
+// target adaptive level (pInfo->iCurrentTargetLevelShift) down or up.
+// puTimeStartGoodInterval: start time of the current good interval (used to shift up), 0 if none.
+// Returns 1 if the target level was changed.
+int video_link_adaptive_compute_target_level(Model* pModel, shared_mem_controller_adaptive_video_info_vehicle* pInfo, u32 uTimeNow, u32* puTimeStartGoodInterval);
+
+// Vehicle side: video bitrate to use for a video profile and level, after the down overwrite
+u32 video_link_adaptive_get_level_video_bitrate(Model* pModel, int iVideoProfile, int iProfileLevelShift, int iUserVideoProfile, u32 uBitrateOverwriteDown);
+// Vehicle side: video profile, EC scheme and video bitrate to use for a total adaptive level shift
+void video_link_adaptive_get_level_params(Model* pModel, int iTotalLevelsShift, int iUserVideoProfile, u32 uBitrateOverwriteDown, t_adaptive_video_level_params* pParams);
@@ -0,0 +1,367 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "../base/base.h"
+#include "../radio/fec.h"
+#include "audio_rx_jitter.h"
+
+// Block index jumps bigger than this (either way) are a stream restart or a long link loss: resync instead of playing silence
+#define AUDIO_RX_JITTER_RESYNC_BLOCKS 64
+// Missing packets are given up on this long before the sink needs them, as the periodic check runs only every few ms
+#define AUDIO_RX_JITTER_DEADLINE_MARGIN_MICROS 10000
+
+static u8 s_uAudioRxJitterSilence[MAX_PACKET_PAYLOAD];
+
+static int _audio_rx_jitter_block_diff(u32 uBlockA, u32 uBlockB)
+{
+   u32 uDiff = (uBlockA - uBlockB) & AUDIO_RX_JITTER_BLOCK_INDEX_MASK;
+   if ( uDiff & 0x800000 )
+      return (int)uDiff - 0x1000000;
+   return (int)uDiff;
+}
+
+static t_audio_rx_jitter_block* _audio_rx_jitter_get_block(t_audio_rx_jitter* pJitter, u32 uBlockIndex)
+{
+   t_audio_rx_jitter_block* pBlock = &(pJitter->blocks[uBlockIndex % AUDIO_RX_JITTER_MAX_BLOCKS]);
+   if ( pBlock->iUsed && (pBlock->uBlockIndex == uBlockIndex) )
+      return pBlock;
+   return NULL;
+}
+
+// When the sink will start playing the given data packet
+static u32 _audio_rx_jitter_get_playout_time(t_audio_rx_jitter* pJitter, u32 uBlockIndex, int iPacketIndex)
+{
+   int iDiff = _audio_rx_jitter_block_diff(uBlockIndex, pJitter->uAnchorBlock);
+   u32 uPacketMicros = pJitter->uBlockDurationMicros / (u32)pJitter->iDataPackets;
+   return pJitter->uAnchorTimeMicros + pJitter->uPlayoutDelayMicros + (u32)(iDiff * (int)pJitter->uBlockDurationMicros) + (u32)iPacketIndex * uPacketMicros;
+}
+
+static void _audio_rx_jitter_output(t_audio_rx_jitter* pJitter, const u8* pData)
+{
+   if ( NULL != pJitter->pOutputCallback )
+      pJitter->pOutputCallback(pJitter->pOutputContext, pData, pJitter->iPacketSize);
+}
+
+static void _audio_rx_jitter_conceal_next_packet(t_audio_rx_jitter* pJitter)
+{
+   _audio_rx_jitter_output(pJitter, s_uAudioRxJitterSilence);
+   pJitter->iNextPacketToPlay++;
+   pJitter->iCurrentBlockConcealed = 1;
+   pJitter->uCountPacketsConcealed++;
+}
+
+static void _audio_rx_jitter_advance(t_audio_rx_jitter* pJitter)
+{
+   t_audio_rx_jitter_block* pBlock = _audio_rx_jitter_get_block(pJitter, pJitter->uNextBlockToPlay);
+   if ( NULL != pBlock )
+      pBlock->iUsed = 0;
+   if ( pJitter->iCurrentBlockConcealed )
+      pJitter->uCountBlocksConcealed++;
+   pJitter->uCountBlocksPlayed++;
+   pJitter->uNextBlockToPlay = (pJitter->uNextBlockToPlay + 1) & AUDIO_RX_JITTER_BLOCK_INDEX_MASK;
+   pJitter->iNextPacketToPlay = 0;
+   pJitter->iCurrentBlockConcealed = 0;
+}
+
+// Plays what is left of the next block right away, missing packets are replaced by silence
+static void _audio_rx_jitter_play_rest_of_block(t_audio_rx_jitter* pJitter)
+{
+   t_audio_rx_jitter_block* pBlock = _audio_rx_jitter_get_block(pJitter, pJitter->uNextBlockToPlay);
+   while ( pJitter->iNextPacketToPlay < pJitter->iDataPackets )
+   {
+      if ( (NULL != pBlock) && pBlock->uReceived[pJitter->iNextPacketToPlay] )
+      {
+         _audio_rx_jitter_output(pJitter, pBlock->uPackets[pJitter->iNextPacketToPlay]);
+         pJitter->iNextPacketToPlay++;
+      }
+      else
+         _audio_rx_jitter_conceal_next_packet(pJitter);
+   }
+   _audio_rx_jitter_advance(pJitter);
+}
+
+static void _audio_rx_jitter_repair_block(t_audio_rx_jitter* pJitter, t_audio_rx_jitter_block* pBlock)
+{
+   u8* pDataPackets[MAX_BUFFERED_AUDIO_PACKETS];
+   u8* pECPackets[MAX_BUFFERED_AUDIO_PACKETS];
+   unsigned int uECIndexes[MAX_BUFFERED_AUDIO_PACKETS];
+   unsigned int uMissing[MAX_BUFFERED_AUDIO_PACKETS];
+   int iCountMissing = 0;
+
+   for( int i=0; i<pJitter->iDataPackets; i++ )
+   {
+      pDataPackets[i] = pBlock->uPackets[i];
+      if ( ! pBlock->uReceived[i] )
+         uMissing[iCountMissing++] = (unsigned int)i;
+   }
+   int iCountEC = 0;
+   for( int i=0; (i<pJitter->iECPackets) && (iCountEC < iCountMissing); i++ )
+   {
+      if ( ! pBlock->uReceived[pJitter->iDataPackets + i] )
+         continue;
+      pECPackets[iCountEC] = pBlock->uPackets[pJitter->iDataPackets + i];
+      uECIndexes[iCountEC] = (unsigned int)i;
+      iCountEC++;
+   }
+   if ( (0 == iCountMissing) || (iCountEC < iCountMissing) )
+      return;
+
+   fec_decode((unsigned int)pJitter->iPacketSize, pDataPackets, (unsigned int)pJitter->iDataPackets, pECPackets, uECIndexes, uMissing, (unsigned short)iCountMissing);
+   for( int i=0; i<iCountMissing; i++ )
+      pBlock->uReceived[uMissing[i]] = 1;
+   pBlock->iCountData = pJitter->iDataPackets;
+   pJitter->uCountBlocksRepaired++;
+}
+
+// True if anything was received past the next packet to play
+static int _audio_rx_jitter_has_newer_packets(t_audio_rx_jitter* pJitter)
+{
+   for( int i=0; i<AUDIO_RX_JITTER_MAX_BLOCKS; i++ )
+   {
+      t_audio_rx_jitter_block* pBlock = &(pJitter->blocks[i]);
+      if ( ! pBlock->iUsed )
+         continue;
+      int iDiff = _audio_rx_jitter_block_diff(pBlock->uBlockIndex, pJitter->uNextBlockToPlay);
+      if ( iDiff > 0 )
+         return 1;
+      if ( iDiff < 0 )
+         continue;
+      for( int k=pJitter->iNextPacketToPlay; k<pJitter->iDataPackets + pJitter->iECPackets; k++ )
+         if ( pBlock->uReceived[k] )
+            return 1;
+   }
+   return 0;
+}
+
+static void _audio_rx_jitter_release(t_audio_rx_jitter* pJitter, u32 uTimeNowMicros)
+{
+   if ( ! pJitter->iStarted )
+      return;
+
+   // The first output sets the sink playout clock, so hold it back for the playout delay
+   if ( ! pJitter->iPlaying )
+   {
+      if ( (int)(uTimeNowMicros - _audio_rx_jitter_get_playout_time(pJitter, pJitter->uNextBlockToPlay, pJitter->iNextPacketToPlay)) < 0 )
+         return;
+      pJitter->iPlaying = 1;
+   }
+
+   while ( 1 )
+   {
+      t_audio_rx_jitter_block* pBlock = _audio_rx_jitter_get_block(pJitter, pJitter->uNextBlockToPlay);
+      if ( NULL != pBlock )
+      {
+         while ( (pJitter->iNextPacketToPlay < pJitter->iDataPackets) && pBlock->uReceived[pJitter->iNextPacketToPlay] )
+         {
+            _audio_rx_jitter_output(pJitter, pBlock->uPackets[pJitter->iNextPacketToPlay]);
+            pJitter->iNextPacketToPlay++;
+         }
+         if ( pJitter->iNextPacketToPlay >= pJitter->iDataPackets )
+         {
+            _audio_rx_jitter_advance(pJitter);
+            continue;
+         }
+         if ( pBlock->iCountData + pBlock->iCountEC >= pJitter->iDataPackets )
+         {
+            _audio_rx_jitter_repair_block(pJitter, pBlock);
+            continue;
+         }
+      }
+
+      // Wait for the missing packet (or enough EC packets) until the sink is about to need it
+      u32 uDeadline = _audio_rx_jitter_get_playout_time(pJitter, pJitter->uNextBlockToPlay, pJitter->iNextPacketToPlay) - AUDIO_RX_JITTER_DEADLINE_MARGIN_MICROS;
+      if ( (int)(uTimeNowMicros - uDeadline) < 0 )
+         break;
+
+      // Nothing more received: the stream stopped (or the link is lost), don't play silence, start over on the next packet
+      if ( ! _audio_rx_jitter_has_newer_packets(pJitter) )
+      {
+         if ( (int)(uTimeNowMicros - uDeadline) > (int)pJitter->uPlayoutDelayMicros )
+         {
+            log_line("[AudioRxJitter] No audio received for %u ms. Stop playout.", (pJitter->uPlayoutDelayMicros + (uTimeNowMicros - uDeadline))/1000);
+            pJitter->uCountStalls++;
+            audio_rx_jitter_reset(pJitter);
+         }
+         break;
+      }
+      _audio_rx_jitter_conceal_next_packet(pJitter);
+      if ( pJitter->iNextPacketToPlay >= pJitter->iDataPackets )
+         _audio_rx_jitter_advance(pJitter);
+   }
+}
+
+static void _audio_rx_jitter_start(t_audio_rx_jitter* pJitter, u32 uBlockIndex, u32 uPacketIndex, u32 uTimeNowMicros)
+{
+   for( int i=0; i<AUDIO_RX_JITTER_MAX_BLOCKS; i++ )
+      pJitter->blocks[i].iUsed = 0;
+   pJitter->iStarted = 1;
+   pJitter->iPlaying = 0;
+   pJitter->uNextBlockToPlay = uBlockIndex;
+   pJitter->iNextPacketToPlay = 0;
+   pJitter->iCurrentBlockConcealed = 0;
+
+   // Playout clock starts from when the start of this block was (about) received
+   if ( uPacketIndex > (u32)pJitter->iDataPackets )
+      uPacketIndex = (u32)pJitter->iDataPackets;
+   pJitter->uAnchorBlock = uBlockIndex;
+   pJitter->uAnchorTimeMicros = uTimeNowMicros - uPacketIndex * (pJitter->uBlockDurationMicros / (u32)pJitter->iDataPackets);
+}
+
+void audio_rx_jitter_init(t_audio_rx_jitter* pJitter, int iDataPackets, int iECPackets, int iWindowBlocks, u32 uPlayoutDelayMs, u32 uBytesPerSecond,
+   audio_rx_jitter_output_callback pOutputCallback, void* pOutputContext)
+{
+   if ( NULL == pJitter )
+      return;
+   memset(pJitter, 0, sizeof(t_audio_rx_jitter));
+   if ( iDataPackets < 1 )
+      iDataPackets = 1;
+   if ( iDataPackets + iECPackets > MAX_BUFFERED_AUDIO_PACKETS )
+      iECPackets = MAX_BUFFERED_AUDIO_PACKETS - iDataPackets;
+   if ( iECPackets < 0 )
+      iECPackets = 0;
+   if ( iWindowBlocks < 1 )
+      iWindowBlocks = 1;
+   if ( iWindowBlocks > AUDIO_RX_JITTER_MAX_BLOCKS )
+      iWindowBlocks = AUDIO_RX_JITTER_MAX_BLOCKS;
+   if ( 0 == uBytesPerSecond )
+      uBytesPerSecond = 1;
+
+   pJitter->iDataPackets = iDataPackets;
+   pJitter->iECPackets = iECPackets;
+   pJitter->iWindowBlocks = iWindowBlocks;
+   pJitter->uPlayoutDelayMicros = uPlayoutDelayMs * 1000;
+   pJitter->uBytesPerSecond = uBytesPerSecond;
+   pJitter->pOutputCallback = pOutputCallback;
+   pJitter->pOutputContext = pOutputContext;
+   pJitter->iLastPacketIndex = -1;
+   memset(s_uAudioRxJitterSilence, 0, sizeof(s_uAudioRxJitterSilence));
+   log_line("[AudioRxJitter] Init: %d data + %d EC packets per block, window: %d blocks, playout delay: %u ms",
+      iDataPackets, iECPackets, iWindowBlocks, uPlayoutDelayMs);
+}
+
+void audio_rx_jitter_reset(t_audio_rx_jitter* pJitter)
+{
+   if ( NULL == pJitter )
+      return;
+   for( int i=0; i<AUDIO_RX_JITTER_MAX_BLOCKS; i++ )
+      pJitter->blocks[i].iUsed = 0;
+   pJitter->iStarted = 0;
+   pJitter->iPlaying = 0;
+   pJitter->iLastPacketIndex = -1;
+}
+
+void audio_rx_jitter_add_packet(t_audio_rx_jitter* pJitter, u32 uBlockIndex, u32 uPacketIndex, const u8* pData, int iLength, u32 uTimeNowMicros)
+{
+   if ( (NULL == pJitter) || (NULL == pData) || (iLength <= 0) || (iLength > MAX_PACKET_PAYLOAD) )
+      return;
+   if ( uPacketIndex >= (u32)(pJitter->iDataPackets + pJitter->iECPackets) )
+      return;
+   uBlockIndex &= AUDIO_RX_JITTER_BLOCK_INDEX_MASK;
+
+   if ( iLength != pJitter->iPacketSize )
+   {
+      if ( 0 != pJitter->iPacketSize )
+         log_line("[AudioRxJitter] Audio packet size changed from %d to %d bytes. Resync.", pJitter->iPacketSize, iLength);
+      pJitter->iPacketSize = iLength;
+      pJitter->uBlockDurationMicros = (u32)(((unsigned long long)iLength * (unsigned long long)pJitter->iDataPackets * 1000000) / pJitter->uBytesPerSecond);
+      audio_rx_jitter_reset(pJitter);
+   }
+
+   pJitter->uCountPackets++;
+   if ( pJitter->iLastPacketIndex >= 0 )
+   {
+      int iDiff = _audio_rx_jitter_block_diff(uBlockIndex, pJitter->uLastBlockIndex);
+      if ( (iDiff < 0) || ((0 == iDiff) && ((int)uPacketIndex < pJitter->iLastPacketIndex)) )
+         pJitter->uCountOutOfOrder++;
+   }
+   pJitter->uLastBlockIndex = uBlockIndex;
+   pJitter->iLastPacketIndex = (int)uPacketIndex;
+
+   if ( ! pJitter->iStarted )
+      _audio_rx_jitter_start(pJitter, uBlockIndex, uPacketIndex, uTimeNowMicros);
+
+   int iDiff = _audio_rx_jitter_block_diff(uBlockIndex, pJitter->uNextBlockToPlay);
+   if ( (iDiff <= -AUDIO_RX_JITTER_RESYNC_BLOCKS) || (iDiff >= AUDIO_RX_JITTER_RESYNC_BLOCKS) )
+   {
+      log_line("[AudioRxJitter] Audio block index jumped from %u to %u. Resync.", pJitter->uNextBlockToPlay, uBlockIndex);
+      pJitter->uCountResets++;
+      _audio_rx_jitter_start(pJitter, uBlockIndex, uPacketIndex, uTimeNowMicros);
+      iDiff = 0;
+   }
+   if ( iDiff < 0 )
+   {
+      // EC packets of already played blocks are not needed anymore
+      if ( uPacketIndex < (u32)pJitter->iDataPackets )
+         pJitter->uCountLate++;
+      return;
+   }
+
+   // No room for this block: play the oldest ones right away
+   while ( iDiff >= pJitter->iWindowBlocks )
+   {
+      pJitter->uCountWindowOverflows++;
+      _audio_rx_jitter_play_rest_of_block(pJitter);
+      iDiff--;
+   }
+
+   t_audio_rx_jitter_block* pBlock = _audio_rx_jitter_get_block(pJitter, uBlockIndex);
+   if ( NULL == pBlock )
+   {
+      pBlock = &(pJitter->blocks[uBlockIndex % AUDIO_RX_JITTER_MAX_BLOCKS]);
+      pBlock->iUsed = 1;
+      pBlock->uBlockIndex = uBlockIndex;
+      pBlock->iCountData = 0;
+      pBlock->iCountEC = 0;
+      memset(pBlock->uReceived, 0, sizeof(pBlock->uReceived));
+   }
+
+   if ( pBlock->uReceived[uPacketIndex] )
+   {
+      pJitter->uCountDuplicates++;
+      return;
+   }
+   pBlock->uReceived[uPacketIndex] = 1;
+   memcpy(pBlock->uPackets[uPacketIndex], pData, iLength);
+   if ( (int)uPacketIndex < pJitter->iDataPackets )
+      pBlock->iCountData++;
+   else
+      pBlock->iCountEC++;
+
+   _audio_rx_jitter_release(pJitter, uTimeNowMicros);
+}
+
+void audio_rx_jitter_periodic(t_audio_rx_jitter* pJitter, u32 uTimeNowMicros)
+{
+   if ( (NULL == pJitter) || (! pJitter->iStarted) )
+      return;
+   _audio_rx_jitter_release(pJitter, uTimeNowMicros);
+}
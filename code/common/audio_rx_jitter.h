@@ -0,0 +1,82 @@
+#pragma once
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiopackets2.h"
+
+// Audio receive jitter buffer: keeps a window of audio blocks (data + EC packets) so out of order and
+// late packets from the next blocks are still used, repairs blocks with FEC and outputs the audio in order.
+// Output starts after the playout delay, which sets the sink playout clock: from then on each packet has a
+// playout deadline (when the sink will need it). Contiguous data is output as soon as it's received; a gap is
+// waited for (or repaired) until the deadline of the missing packet, then it's replaced with silence,
+// so the output sink always gets a continuous stream and never has to be restarted.
+
+#define AUDIO_RX_JITTER_MAX_BLOCKS 8
+#define AUDIO_RX_JITTER_BLOCK_INDEX_MASK 0xFFFFFF
+
+typedef void (*audio_rx_jitter_output_callback)(void* pContext, const u8* pData, int iLength);
+
+typedef struct
+{
+   int iUsed;
+   u32 uBlockIndex;
+   int iCountData;
+   int iCountEC;
+   u8 uReceived[MAX_BUFFERED_AUDIO_PACKETS];
+   u8 uPackets[MAX_BUFFERED_AUDIO_PACKETS][MAX_PACKET_PAYLOAD];
+} t_audio_rx_jitter_block;
+
+typedef struct
+{
+   int iDataPackets;
+   int iECPackets;
+   int iPacketSize; // set from the first received packet
+   int iWindowBlocks;
+   u32 uPlayoutDelayMicros;
+   u32 uBytesPerSecond;
+   u32 uBlockDurationMicros;
+   audio_rx_jitter_output_callback pOutputCallback;
+   void* pOutputContext;
+
+   t_audio_rx_jitter_block blocks[AUDIO_RX_JITTER_MAX_BLOCKS];
+   int iStarted;
+   int iPlaying;
+   u32 uNextBlockToPlay;
+   int iNextPacketToPlay;
+   int iCurrentBlockConcealed;
+   // Playout clock: block uAnchorBlock is played at uAnchorTimeMicros + playout delay
+   u32 uAnchorBlock;
+   u32 uAnchorTimeMicros;
+
+   u32 uCountPackets;
+   u32 uCountDuplicates;
+   u32 uCountLate; // data packets that arrived after they were played (or concealed)
+   u32 uCountOutOfOrder;
+   u32 uCountBlocksPlayed;
+   u32 uCountBlocksRepaired;
+   u32 uCountBlocksConcealed; // played with some packets replaced by silence
+   u32 uCountPacketsConcealed;
+   u32 uCountWindowOverflows; // blocks played before their deadline to make room for newer blocks
+   u32 uCountResets;
+   u32 uCountStalls; // playout stopped as nothing was received anymore
+   u32 uLastBlockIndex;
+   int iLastPacketIndex;
+} t_audio_rx_jitter;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// iWindowBlocks is capped to AUDIO_RX_JITTER_MAX_BLOCKS. uBytesPerSecond is the output PCM stream rate.
+void audio_rx_jitter_init(t_audio_rx_jitter* pJitter, int iDataPackets, int iECPackets, int iWindowBlocks, u32 uPlayoutDelayMs, u32 uBytesPerSecond,
+   audio_rx_jitter_output_callback pOutputCallback, void* pOutputContext);
+void audio_rx_jitter_reset(t_audio_rx_jitter* pJitter);
+
+// uBlockIndex is the 24 bits block counter from the audio packet, uPacketIndex the data (0..data-1) or EC (data..data+ec-1) index
+void audio_rx_jitter_add_packet(t_audio_rx_jitter* pJitter, u32 uBlockIndex, u32 uPacketIndex, const u8* pData, int iLength, u32 uTimeNowMicros);
+
+// Plays out the blocks that reached their deadline. Should be called every few ms.
+void audio_rx_jitter_periodic(t_audio_rx_jitter* pJitter, u32 uTimeNowMicros);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,214 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "../base/base.h"
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include "config_watch.h"
+
+#define CONFIG_WATCH_EVENTS (IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_TO)
+
+static void _config_watch_get_file_stamp(t_config_watch_file* pFile, long* plFileTime, long* plFileSize)
+{
+   char szFile[MAX_FILE_PATH_SIZE+128];
+   struct stat statFile;
+   snprintf(szFile, sizeof(szFile)/sizeof(szFile[0]), "%s%s", pFile->szFolder, pFile->szFileName);
+   if ( 0 != stat(szFile, &statFile) )
+   {
+      *plFileTime = -1;
+      *plFileSize = -1;
+      return;
+   }
+   *plFileTime = (long)statFile.st_mtime;
+   *plFileSize = (long)statFile.st_size;
+}
+
+int config_watch_init(t_config_watch* pWatch)
+{
+   if ( NULL == pWatch )
+      return 0;
+   memset(pWatch, 0, sizeof(t_config_watch));
+   pWatch->iInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+   if ( pWatch->iInotifyFd < 0 )
+   {
+      log_softerror_and_alarm("[ConfigWatch] Failed to init inotify (error %d). Will check the watched files periodically.", errno);
+      pWatch->iInotifyFd = -1;
+      return 0;
+   }
+   return 1;
+}
+
+void config_watch_close(t_config_watch* pWatch)
+{
+   if ( NULL == pWatch )
+      return;
+   if ( pWatch->iInotifyFd >= 0 )
+      close(pWatch->iInotifyFd);
+   pWatch->iInotifyFd = -1;
+   pWatch->iCountFolders = 0;
+   pWatch->iCountFiles = 0;
+}
+
+int config_watch_add_file(t_config_watch* pWatch, const char* szFolder, const char* szFileName)
+{
+   if ( (NULL == pWatch) || (NULL == szFolder) || (NULL == szFileName) )
+      return -1;
+   if ( pWatch->iCountFiles >= CONFIG_WATCH_MAX_FILES )
+   {
+      log_softerror_and_alarm("[ConfigWatch] Can't watch file %s%s, too many watched files.", szFolder, szFileName);
+      return -1;
+   }
+   if ( (strlen(szFolder) >= MAX_FILE_PATH_SIZE) || (strlen(szFileName) >= 128) )
+      return -1;
+
+   int iFolderIndex = -1;
+   for( int i=0; i<pWatch->iCountFolders; i++ )
+   {
+      if ( 0 == strcmp(pWatch->szFolders[i], szFolder) )
+      {
+         iFolderIndex = i;
+         break;
+      }
+   }
+
+   if ( (iFolderIndex < 0) && (pWatch->iInotifyFd >= 0) )
+   {
+      if ( pWatch->iCountFolders >= CONFIG_WATCH_MAX_FOLDERS )
+      {
+         log_softerror_and_alarm("[ConfigWatch] Can't watch folder %s, too many watched folders.", szFolder);
+         return -1;
+      }
+      int iWD = inotify_add_watch(pWatch->iInotifyFd, szFolder, CONFIG_WATCH_EVENTS);
+      if ( iWD < 0 )
+      {
+         log_softerror_and_alarm("[ConfigWatch] Failed to watch folder %s (error %d).", szFolder, errno);
+         return -1;
+      }
+      iFolderIndex = pWatch->iCountFolders;
+      strcpy(pWatch->szFolders[iFolderIndex], szFolder);
+      pWatch->iFolderWatchDescriptors[iFolderIndex] = iWD;
+      pWatch->iCountFolders++;
+   }
+
+   t_config_watch_file* pFile = &(pWatch->files[pWatch->iCountFiles]);
+   strcpy(pFile->szFolder, szFolder);
+   strcpy(pFile->szFileName, szFileName);
+   pFile->iFolderWatchIndex = iFolderIndex;
+   _config_watch_get_file_stamp(pFile, &pFile->lFileTime, &pFile->lFileSize);
+   pWatch->iCountFiles++;
+
+   log_line("[ConfigWatch] Watching file %s%s (%s)", szFolder, szFileName, (pWatch->iInotifyFd >= 0)?"inotify":"polling");
+   return pWatch->iCountFiles-1;
+}
+
+static u32 _config_watch_poll_files(t_config_watch* pWatch)
+{
+   u32 uChanges = 0;
+   for( int i=0; i<pWatch->iCountFiles; i++ )
+   {
+      t_config_watch_file* pFile = &(pWatch->files[i]);
+      long lFileTime = 0;
+      long lFileSize = 0;
+      _config_watch_get_file_stamp(pFile, &lFileTime, &lFileSize);
+      if ( (lFileTime != pFile->lFileTime) || (lFileSize != pFile->lFileSize) )
+      if ( lFileTime != -1 )
+         uChanges |= (((u32)1) << i);
+      pFile->lFileTime = lFileTime;
+      pFile->lFileSize = lFileSize;
+   }
+   return uChanges;
+}
+
+u32 config_watch_get_changes(t_config_watch* pWatch)
+{
+   if ( (NULL == pWatch) || (0 == pWatch->iCountFiles) )
+      return 0;
+   if ( pWatch->iInotifyFd < 0 )
+      return _config_watch_poll_files(pWatch);
+
+   u32 uChanges = 0;
+   u8 uBuffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+   while ( 1 )
+   {
+      int iLength = read(pWatch->iInotifyFd, uBuffer, sizeof(uBuffer));
+      if ( iLength <= 0 )
+         break;
+
+      int iPos = 0;
+      while ( iPos + (int)sizeof(struct inotify_event) <= iLength )
+      {
+         struct inotify_event* pEvent = (struct inotify_event*)(uBuffer + iPos);
+         iPos += sizeof(struct inotify_event) + pEvent->len;
+
+         if ( pEvent->mask & IN_Q_OVERFLOW )
+         {
+            // Events were lost, report all the files as changed
+            for( int i=0; i<pWatch->iCountFiles; i++ )
+               uChanges |= (((u32)1) << i);
+            continue;
+         }
+         if ( 0 == pEvent->len )
+            continue;
+         pWatch->uCountEvents++;
+         for( int i=0; i<pWatch->iCountFiles; i++ )
+         {
+            t_config_watch_file* pFile = &(pWatch->files[i]);
+            if ( pWatch->iFolderWatchDescriptors[pFile->iFolderWatchIndex] != pEvent->wd )
+               continue;
+            if ( 0 == strcmp(pFile->szFileName, pEvent->name) )
+               uChanges |= (((u32)1) << i);
+         }
+      }
+   }
+
+   // Removing a file also reports an attributes change; only report files that exist
+   for( int i=0; i<pWatch->iCountFiles; i++ )
+   {
+      if ( ! (uChanges & (((u32)1) << i)) )
+         continue;
+      char szFile[MAX_FILE_PATH_SIZE+128];
+      snprintf(szFile, sizeof(szFile)/sizeof(szFile[0]), "%s%s", pWatch->files[i].szFolder, pWatch->files[i].szFileName);
+      if ( access(szFile, F_OK) == -1 )
+         uChanges &= ~(((u32)1) << i);
+   }
+   return uChanges;
+}
+
+int config_watch_get_fd(t_config_watch* pWatch)
+{
+   if ( NULL == pWatch )
+      return -1;
+   return pWatch->iInotifyFd;
+}
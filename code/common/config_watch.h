@@ -0,0 +1,50 @@
+#pragma once
+#include "../base/base.h"
+#include "../base/config_file_names.h"
+
+// Watches configuration and signal files (the ones touched by a process to tell another one that some
+// settings changed) with inotify, so the watching process learns about a change as soon as it happens,
+// with a single non blocking read, instead of polling the files.
+// If inotify is not available, it falls back to checking the files modification stamps on each call.
+// A file that already exists when it is added is not reported as changed; check it once after adding it if needed.
+
+#define CONFIG_WATCH_MAX_FILES 16
+#define CONFIG_WATCH_MAX_FOLDERS 8
+
+typedef struct
+{
+   char szFolder[MAX_FILE_PATH_SIZE];
+   char szFileName[128];
+   int iFolderWatchIndex;
+   long lFileTime; // fallback mode: last seen modification stamp, -1 if the file does not exist
+   long lFileSize;
+} t_config_watch_file;
+
+typedef struct
+{
+   int iInotifyFd;
+   int iFolderWatchDescriptors[CONFIG_WATCH_MAX_FOLDERS];
+   char szFolders[CONFIG_WATCH_MAX_FOLDERS][MAX_FILE_PATH_SIZE];
+   int iCountFolders;
+   t_config_watch_file files[CONFIG_WATCH_MAX_FILES];
+   int iCountFiles;
+   u32 uCountEvents;
+} t_config_watch;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns 1 if inotify is used, 0 if the watch falls back to polling the files
+int config_watch_init(t_config_watch* pWatch);
+void config_watch_close(t_config_watch* pWatch);
+// szFolder must end with a '/'. Returns the index of the watched file (bit in the changes mask) or -1 on error
+int config_watch_add_file(t_config_watch* pWatch, const char* szFolder, const char* szFileName);
+// Non blocking. Returns a bit mask of the watched files that were created, written or touched since the previous call
+u32 config_watch_get_changes(t_config_watch* pWatch);
+// For adding the watch to a poll/select set; -1 in fallback mode
+int config_watch_get_fd(t_config_watch* pWatch);
+
+#ifdef __cplusplus
+}
+#endif
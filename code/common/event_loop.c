@@ -0,0 +1,192 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "../base/base.h"
+#include <poll.h>
+#include "event_loop.h"
+
+static void _event_loop_preempt(void* pContext)
+{
+   t_event_loop* pLoop = (t_event_loop*)pContext;
+   if ( event_loop_service_high_priority(pLoop) > 0 )
+      pLoop->uCountPreemptions++;
+}
+
+void event_loop_init(t_event_loop* pLoop, t_timer_wheel* pTimers)
+{
+   if ( NULL == pLoop )
+      return;
+   memset(pLoop, 0, sizeof(t_event_loop));
+   pLoop->pTimers = pTimers;
+   if ( NULL != pTimers )
+      timer_wheel_set_preempt_callback(pTimers, _event_loop_preempt, pLoop);
+}
+
+int event_loop_add_fd(t_event_loop* pLoop, int iFd, int iHighPriority, event_loop_fd_callback pCallback, void* pContext)
+{
+   if ( (NULL == pLoop) || (iFd < 0) || (NULL == pCallback) )
+      return 0;
+   if ( pLoop->iCountSources >= EVENT_LOOP_MAX_SOURCES )
+   {
+      log_softerror_and_alarm("[EventLoop] Can't add fd %d, no more room (max %d sources).", iFd, EVENT_LOOP_MAX_SOURCES);
+      return 0;
+   }
+
+   // Keep high priority sources first, dispatch order follows the sources order
+   int iPos = pLoop->iCountSources;
+   if ( iHighPriority )
+   {
+      iPos = 0;
+      while ( (iPos < pLoop->iCountSources) && pLoop->sources[iPos].iHighPriority )
+         iPos++;
+      for( int i=pLoop->iCountSources; i>iPos; i-- )
+         memcpy(&(pLoop->sources[i]), &(pLoop->sources[i-1]), sizeof(t_event_loop_source));
+   }
+   pLoop->sources[iPos].iFd = iFd;
+   pLoop->sources[iPos].iHighPriority = iHighPriority;
+   pLoop->sources[iPos].pCallback = pCallback;
+   pLoop->sources[iPos].pContext = pContext;
+   pLoop->iCountSources++;
+   return 1;
+}
+
+void event_loop_remove_fd(t_event_loop* pLoop, int iFd)
+{
+   if ( NULL == pLoop )
+      return;
+   for( int i=0; i<pLoop->iCountSources; i++ )
+   {
+      if ( pLoop->sources[i].iFd != iFd )
+         continue;
+      for( int k=i; k<pLoop->iCountSources-1; k++ )
+         memcpy(&(pLoop->sources[k]), &(pLoop->sources[k+1]), sizeof(t_event_loop_source));
+      pLoop->iCountSources--;
+      return;
+   }
+}
+
+// A closed fd makes poll return POLLNVAL right away on each call, so the loop would just spin.
+// Drop such sources; the owner has to add the fd again if it gets reopened.
+static void _event_loop_remove_invalid_fds(t_event_loop* pLoop, struct pollfd* pFds, int iCount)
+{
+   for( int i=iCount-1; i>=0; i-- )
+   {
+      if ( ! (pFds[i].revents & POLLNVAL) )
+         continue;
+      log_softerror_and_alarm("[EventLoop] Source fd %d is no longer valid, removed it.", pFds[i].fd);
+      event_loop_remove_fd(pLoop, pFds[i].fd);
+      pLoop->uCountInvalidFds++;
+   }
+}
+
+int event_loop_service_high_priority(t_event_loop* pLoop)
+{
+   if ( NULL == pLoop )
+      return 0;
+
+   struct pollfd fds[EVENT_LOOP_MAX_SOURCES];
+   int iCount = 0;
+   while ( (iCount < pLoop->iCountSources) && pLoop->sources[iCount].iHighPriority )
+   {
+      fds[iCount].fd = pLoop->sources[iCount].iFd;
+      fds[iCount].events = POLLIN;
+      fds[iCount].revents = 0;
+      iCount++;
+   }
+   if ( 0 == iCount )
+      return 0;
+   if ( poll(fds, iCount, 0) <= 0 )
+      return 0;
+
+   int iDispatched = 0;
+   u32 uTimeNow = get_current_timestamp_ms();
+   for( int i=0; i<iCount; i++ )
+   {
+      if ( ! (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) )
+         continue;
+      pLoop->sources[i].pCallback(pLoop->sources[i].pContext, fds[i].fd, uTimeNow);
+      iDispatched++;
+   }
+   pLoop->uCountFdEvents += iDispatched;
+   _event_loop_remove_invalid_fds(pLoop, fds, iCount);
+   return iDispatched;
+}
+
+int event_loop_run_once(t_event_loop* pLoop, int iMaxWaitMs)
+{
+   if ( NULL == pLoop )
+      return 0;
+
+   u32 uTimeNow = get_current_timestamp_ms();
+   int iWait = iMaxWaitMs;
+   if ( NULL != pLoop->pTimers )
+      iWait = (int) timer_wheel_get_ms_to_next(pLoop->pTimers, uTimeNow, (u32)iMaxWaitMs);
+
+   struct pollfd fds[EVENT_LOOP_MAX_SOURCES];
+   for( int i=0; i<pLoop->iCountSources; i++ )
+   {
+      fds[i].fd = pLoop->sources[i].iFd;
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+   }
+
+   int iDispatched = 0;
+   int iCountPolled = pLoop->iCountSources;
+   int iRes = poll(fds, iCountPolled, iWait);
+   pLoop->uCountWakeups++;
+   uTimeNow = get_current_timestamp_ms();
+   pLoop->uTimeLastWakeup = uTimeNow;
+
+   if ( iRes < 0 )
+   {
+      if ( errno != EINTR )
+         log_softerror_and_alarm("[EventLoop] Failed to poll sources, error: %d", errno);
+   }
+   else if ( iRes == 0 )
+      pLoop->uCountTimeouts++;
+   else
+   {
+      // Sources are sorted, high priority ones get dispatched first
+      for( int i=0; i<iCountPolled; i++ )
+      {
+         if ( ! (fds[i].revents & (POLLIN | POLLERR | POLLHUP)) )
+            continue;
+         pLoop->sources[i].pCallback(pLoop->sources[i].pContext, fds[i].fd, uTimeNow);
+         iDispatched++;
+      }
+      pLoop->uCountFdEvents += iDispatched;
+      _event_loop_remove_invalid_fds(pLoop, fds, iCountPolled);
+   }
+
+   if ( NULL != pLoop->pTimers )
+      iDispatched += timer_wheel_run_expired(pLoop->pTimers, get_current_timestamp_ms());
+   return iDispatched;
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "../base/base.h"
+#include "timer_wheel.h"
+
+// Single threaded reactor: waits on a set of file descriptors and on a timer wheel.
+// High priority sources are always dispatched first and are also serviced
+// between timer callbacks, so periodic work never delays them by more than one callback.
+
+#define EVENT_LOOP_MAX_SOURCES 16
+
+typedef void (*event_loop_fd_callback)(void* pContext, int iFd, u32 uTimeNow);
+
+typedef struct
+{
+   int iFd;
+   int iHighPriority;
+   event_loop_fd_callback pCallback;
+   void* pContext;
+} t_event_loop_source;
+
+typedef struct
+{
+   t_event_loop_source sources[EVENT_LOOP_MAX_SOURCES];
+   int iCountSources;
+   t_timer_wheel* pTimers;
+
+   u32 uTimeLastWakeup; // when the last wait ended (ms)
+   u32 uCountWakeups;
+   u32 uCountFdEvents;
+   u32 uCountTimeouts;
+   u32 uCountPreemptions;
+   u32 uCountInvalidFds; // sources dropped because poll reported them as not open
+} t_event_loop;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void event_loop_init(t_event_loop* pLoop, t_timer_wheel* pTimers);
+int event_loop_add_fd(t_event_loop* pLoop, int iFd, int iHighPriority, event_loop_fd_callback pCallback, void* pContext);
+void event_loop_remove_fd(t_event_loop* pLoop, int iFd);
+
+// Dispatches ready high priority sources without waiting. Returns number of sources dispatched.
+int event_loop_service_high_priority(t_event_loop* pLoop);
+
+// Waits at most iMaxWaitMs (or less, if a timer is due sooner), then dispatches ready sources and expired timers.
+// Returns number of fd sources plus timers dispatched.
+int event_loop_run_once(t_event_loop* pLoop, int iMaxWaitMs);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,125 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "../base/base.h"
+#include "rc_tx_scheduler.h"
+
+static u32 _rc_tx_scheduler_compute_period(int iFramesPerSecond)
+{
+   if ( iFramesPerSecond < 1 )
+      iFramesPerSecond = 1;
+   return 1000000 / (u32)iFramesPerSecond;
+}
+
+void rc_tx_scheduler_init(t_rc_tx_scheduler* pScheduler, int iFramesPerSecond)
+{
+   if ( NULL == pScheduler )
+      return;
+   memset(pScheduler, 0, sizeof(t_rc_tx_scheduler));
+   pScheduler->uPeriodMicros = _rc_tx_scheduler_compute_period(iFramesPerSecond);
+   rc_tx_scheduler_reset_stats(pScheduler);
+}
+
+void rc_tx_scheduler_set_rate(t_rc_tx_scheduler* pScheduler, int iFramesPerSecond)
+{
+   if ( NULL == pScheduler )
+      return;
+   u32 uPeriod = _rc_tx_scheduler_compute_period(iFramesPerSecond);
+   if ( pScheduler->iStarted )
+      pScheduler->uNextDeadlineMicros = pScheduler->uNextDeadlineMicros - pScheduler->uPeriodMicros + uPeriod;
+   pScheduler->uPeriodMicros = uPeriod;
+}
+
+u32 rc_tx_scheduler_get_micros_to_next(t_rc_tx_scheduler* pScheduler, u32 uTimeNowMicros)
+{
+   if ( (NULL == pScheduler) || (! pScheduler->iStarted) )
+      return 0;
+   int iDelta = (int)(pScheduler->uNextDeadlineMicros - uTimeNowMicros);
+   if ( iDelta <= 0 )
+      return 0;
+   // The deadline can't be more than a period away (i.e. after the rate was lowered)
+   if ( (u32)iDelta > pScheduler->uPeriodMicros )
+   {
+      pScheduler->uNextDeadlineMicros = uTimeNowMicros + pScheduler->uPeriodMicros;
+      return pScheduler->uPeriodMicros;
+   }
+   return (u32)iDelta;
+}
+
+void rc_tx_scheduler_on_frame_sent(t_rc_tx_scheduler* pScheduler, u32 uTimeNowMicros)
+{
+   if ( NULL == pScheduler )
+      return;
+
+   if ( ! pScheduler->iStarted )
+   {
+      pScheduler->iStarted = 1;
+      pScheduler->uLastFrameTimeMicros = uTimeNowMicros;
+      pScheduler->uNextDeadlineMicros = uTimeNowMicros + pScheduler->uPeriodMicros;
+      pScheduler->uLastIntervalMicros = pScheduler->uPeriodMicros;
+      pScheduler->stats.uCountFrames++;
+      return;
+   }
+
+   u32 uLate = 0;
+   if ( (int)(uTimeNowMicros - pScheduler->uNextDeadlineMicros) > 0 )
+      uLate = uTimeNowMicros - pScheduler->uNextDeadlineMicros;
+
+   pScheduler->uLastIntervalMicros = uTimeNowMicros - pScheduler->uLastFrameTimeMicros;
+   pScheduler->uLastFrameTimeMicros = uTimeNowMicros;
+
+   pScheduler->stats.uCountFrames++;
+   pScheduler->stats.uTotalLateMicros += uLate;
+   if ( uLate > pScheduler->stats.uMaxLateMicros )
+      pScheduler->stats.uMaxLateMicros = uLate;
+   if ( pScheduler->uLastIntervalMicros < pScheduler->stats.uMinIntervalMicros )
+      pScheduler->stats.uMinIntervalMicros = pScheduler->uLastIntervalMicros;
+   if ( pScheduler->uLastIntervalMicros > pScheduler->stats.uMaxIntervalMicros )
+      pScheduler->stats.uMaxIntervalMicros = pScheduler->uLastIntervalMicros;
+
+   if ( uLate >= pScheduler->uPeriodMicros )
+   {
+      // Fell behind: restart the cadence from now, don't send the missed frames back to back
+      pScheduler->uNextDeadlineMicros = uTimeNowMicros + pScheduler->uPeriodMicros;
+      pScheduler->stats.uCountResyncs++;
+   }
+   else
+      pScheduler->uNextDeadlineMicros += pScheduler->uPeriodMicros;
+}
+
+void rc_tx_scheduler_reset_stats(t_rc_tx_scheduler* pScheduler)
+{
+   if ( NULL == pScheduler )
+      return;
+   memset(&pScheduler->stats, 0, sizeof(t_rc_tx_scheduler_stats));
+   pScheduler->stats.uMinIntervalMicros = MAX_U32;
+}
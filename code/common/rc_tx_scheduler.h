@@ -0,0 +1,49 @@
+#pragma once
+#include "../base/base.h"
+
+// Schedules the RC frames sent to the vehicle on a fixed cadence, so the frames leave at a steady rate
+// (low jitter) instead of whenever the polling loop happens to notice that a frame is due.
+// Deadlines are absolute: each one is exactly one period after the previous one, so late wakeups don't
+// shift (drift) the next frames. The owner samples the inputs a short lead time before each deadline and
+// sends the frame at the deadline. If the sender falls behind by more than a period (i.e. a stall), the
+// missed frames are skipped instead of being sent in a burst.
+
+// Inputs are sampled this long before the frame deadline
+#define RC_TX_SCHEDULER_INPUT_LEAD_MICROS 1500
+
+typedef struct
+{
+   u32 uCountFrames;
+   u32 uCountResyncs; // the sender fell behind by more than a period
+   u32 uMaxLateMicros; // worst frame send time after its deadline
+   u32 uTotalLateMicros;
+   u32 uMinIntervalMicros;
+   u32 uMaxIntervalMicros;
+} t_rc_tx_scheduler_stats;
+
+typedef struct
+{
+   u32 uPeriodMicros;
+   u32 uNextDeadlineMicros;
+   u32 uLastFrameTimeMicros;
+   u32 uLastIntervalMicros;
+   int iStarted;
+   t_rc_tx_scheduler_stats stats;
+} t_rc_tx_scheduler;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void rc_tx_scheduler_init(t_rc_tx_scheduler* pScheduler, int iFramesPerSecond);
+// Keeps the cadence of the current frames, the new period applies from the next frame
+void rc_tx_scheduler_set_rate(t_rc_tx_scheduler* pScheduler, int iFramesPerSecond);
+// Returns how long until the next frame is due (0 if it is due now)
+u32 rc_tx_scheduler_get_micros_to_next(t_rc_tx_scheduler* pScheduler, u32 uTimeNowMicros);
+// Call right after the frame was sent; moves the deadline to the next period
+void rc_tx_scheduler_on_frame_sent(t_rc_tx_scheduler* pScheduler, u32 uTimeNowMicros);
+void rc_tx_scheduler_reset_stats(t_rc_tx_scheduler* pScheduler);
+
+#ifdef __cplusplus
+}
+#endif
@@ -266,6 +266,8 @@ char* str_get_packet_type(int iPacketType)
       case PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK: strcpy(s_szPacketType, "PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK"); break;
       case PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE:     strcpy(s_szPacketType, "PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE"); break;
       case PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK: strcpy(s_szPacketType, "PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK"); break;
+      case PACKET_TYPE_VIDEO_REQUEST_KEYFRAME:     strcpy(s_szPacketType, "PACKET_TYPE_VIDEO_REQUEST_KEYFRAME"); break;
+      case PACKET_TYPE_VIDEO_REQUEST_KEYFRAME_ACK: strcpy(s_szPacketType, "PACKET_TYPE_VIDEO_REQUEST_KEYFRAME_ACK"); break;
       case PACKET_TYPE_COMMAND:                  strcpy(s_szPacketType, "PACKET_TYPE_COMMAND"); break;
       case PACKET_TYPE_COMMAND_RESPONSE:         strcpy(s_szPacketType, "PACKET_TYPE_COMMAND_RESPONSE"); break;
       case PACKET_TYPE_SIK_CONFIG:               strcpy(s_szPacketType, "PACKET_TYPE_SIK_CONFIG"); break;
@@ -401,7 +403,9 @@ char* str_get_packet_history_symbol(int iPacketType, int iRepeatCount)
    if ( iPacketType == PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL ||
         iPacketType == PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK ||
         iPacketType == PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE ||
-        iPacketType == PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK )
+        iPacketType == PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK ||
+        iPacketType == PACKET_TYPE_VIDEO_REQUEST_KEYFRAME ||
+        iPacketType == PACKET_TYPE_VIDEO_REQUEST_KEYFRAME_ACK )
       s_szOSDRenderRxHistoryPacketSymbol[0] = 'S';
 
    if ( iPacketType == PACKET_TYPE_RUBY_MODEL_SETTINGS )
@@ -0,0 +1,308 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "../base/base.h"
+#include "timer_wheel.h"
+
+static void _timer_wheel_link(t_timer_wheel* pWheel, int iTimerId)
+{
+   t_timer_wheel_entry* pTimer = &(pWheel->timers[iTimerId]);
+   u32 uExpire = pTimer->uExpireTime;
+
+   // Already expired timers go into the slot of the tick that will be processed next
+   if ( (int)(uExpire - pWheel->uCurrentTick) < 0 )
+      uExpire = pWheel->uCurrentTick;
+
+   u32 uBlockNow = pWheel->uCurrentTick >> TIMER_WHEEL_L0_BITS;
+   u32 uBlockExpire = uExpire >> TIMER_WHEEL_L0_BITS;
+
+   if ( uBlockExpire == uBlockNow )
+   {
+      pTimer->iLevel = 0;
+      pTimer->iSlot = uExpire & (TIMER_WHEEL_L0_SLOTS-1);
+      pTimer->iNext = pWheel->iSlotsL0[pTimer->iSlot];
+      pWheel->iSlotsL0[pTimer->iSlot] = iTimerId;
+      return;
+   }
+
+   // Level 1 slots get cascaded when their block starts, so the current block's slot can't be used
+   if ( uBlockExpire - uBlockNow >= TIMER_WHEEL_L1_SLOTS )
+      uBlockExpire = uBlockNow + TIMER_WHEEL_L1_SLOTS - 1;
+
+   pTimer->iLevel = 1;
+   pTimer->iSlot = uBlockExpire % TIMER_WHEEL_L1_SLOTS;
+   pTimer->iNext = pWheel->iSlotsL1[pTimer->iSlot];
+   pWheel->iSlotsL1[pTimer->iSlot] = iTimerId;
+}
+
+static void _timer_wheel_unlink(t_timer_wheel* pWheel, int iTimerId)
+{
+   t_timer_wheel_entry* pTimer = &(pWheel->timers[iTimerId]);
+   if ( pTimer->iLevel < 0 )
+      return;
+
+   int* pHead = (pTimer->iLevel == 0)?&(pWheel->iSlotsL0[pTimer->iSlot]):&(pWheel->iSlotsL1[pTimer->iSlot]);
+   while ( -1 != *pHead )
+   {
+      if ( *pHead == iTimerId )
+      {
+         *pHead = pTimer->iNext;
+         break;
+      }
+      pHead = &(pWheel->timers[*pHead].iNext);
+   }
+   pTimer->iNext = -1;
+   pTimer->iLevel = -1;
+}
+
+static void _timer_wheel_cascade(t_timer_wheel* pWheel)
+{
+   int iSlot = (pWheel->uCurrentTick >> TIMER_WHEEL_L0_BITS) % TIMER_WHEEL_L1_SLOTS;
+   int iTimerId = pWheel->iSlotsL1[iSlot];
+   pWheel->iSlotsL1[iSlot] = -1;
+   while ( -1 != iTimerId )
+   {
+      int iNext = pWheel->timers[iTimerId].iNext;
+      pWheel->timers[iTimerId].iNext = -1;
+      pWheel->timers[iTimerId].iLevel = -1;
+      _timer_wheel_link(pWheel, iTimerId);
+      iTimerId = iNext;
+   }
+}
+
+void timer_wheel_init(t_timer_wheel* pWheel, u32 uTimeNow)
+{
+   if ( NULL == pWheel )
+      return;
+   memset(pWheel, 0, sizeof(t_timer_wheel));
+   for( int i=0; i<TIMER_WHEEL_L0_SLOTS; i++ )
+      pWheel->iSlotsL0[i] = -1;
+   for( int i=0; i<TIMER_WHEEL_L1_SLOTS; i++ )
+      pWheel->iSlotsL1[i] = -1;
+   for( int i=0; i<TIMER_WHEEL_MAX_TIMERS; i++ )
+   {
+      pWheel->timers[i].iNext = -1;
+      pWheel->timers[i].iLevel = -1;
+   }
+   pWheel->uCurrentTick = uTimeNow;
+   pWheel->iCountActiveTimers = 0;
+   pWheel->pPreemptCallback = NULL;
+   pWheel->pPreemptContext = NULL;
+}
+
+void timer_wheel_set_preempt_callback(t_timer_wheel* pWheel, timer_wheel_preempt_callback pCallback, void* pContext)
+{
+   if ( NULL == pWheel )
+      return;
+   pWheel->pPreemptCallback = pCallback;
+   pWheel->pPreemptContext = pContext;
+}
+
+int timer_wheel_add(t_timer_wheel* pWheel, const char* szName, u32 uIntervalMs, int iRepeat, timer_wheel_callback pCallback, void* pContext)
+{
+   if ( (NULL == pWheel) || (NULL == pCallback) )
+      return -1;
+
+   int iTimerId = -1;
+   for( int i=0; i<TIMER_WHEEL_MAX_TIMERS; i++ )
+   {
+      if ( ! pWheel->timers[i].iUsed )
+      {
+         iTimerId = i;
+         break;
+      }
+   }
+   if ( -1 == iTimerId )
+   {
+      log_softerror_and_alarm("[TimerWheel] No more free timers slots (max %d).", TIMER_WHEEL_MAX_TIMERS);
+      return -1;
+   }
+
+   t_timer_wheel_entry* pTimer = &(pWheel->timers[iTimerId]);
+   memset(pTimer, 0, sizeof(t_timer_wheel_entry));
+   pTimer->iUsed = 1;
+   pTimer->iNext = -1;
+   pTimer->iLevel = -1;
+   pTimer->uIntervalMs = uIntervalMs;
+   pTimer->iRepeat = iRepeat;
+   pTimer->pCallback = pCallback;
+   pTimer->pContext = pContext;
+   pTimer->uExpireTime = pWheel->uCurrentTick + uIntervalMs;
+   if ( NULL != szName )
+   {
+      strncpy(pTimer->szName, szName, sizeof(pTimer->szName)-1);
+      pTimer->szName[sizeof(pTimer->szName)-1] = 0;
+   }
+   _timer_wheel_link(pWheel, iTimerId);
+   pWheel->iCountActiveTimers++;
+   return iTimerId;
+}
+
+void timer_wheel_remove(t_timer_wheel* pWheel, int iTimerId)
+{
+   if ( (NULL == pWheel) || (iTimerId < 0) || (iTimerId >= TIMER_WHEEL_MAX_TIMERS) )
+      return;
+   if ( ! pWheel->timers[iTimerId].iUsed )
+      return;
+   _timer_wheel_unlink(pWheel, iTimerId);
+   pWheel->timers[iTimerId].iUsed = 0;
+   pWheel->iCountActiveTimers--;
+}
+
+void timer_wheel_reschedule(t_timer_wheel* pWheel, int iTimerId, u32 uTimeNow, u32 uDelayMs)
+{
+   if ( (NULL == pWheel) || (iTimerId < 0) || (iTimerId >= TIMER_WHEEL_MAX_TIMERS) )
+      return;
+   if ( ! pWheel->timers[iTimerId].iUsed )
+      return;
+   _timer_wheel_unlink(pWheel, iTimerId);
+   pWheel->timers[iTimerId].uExpireTime = uTimeNow + uDelayMs;
+   _timer_wheel_link(pWheel, iTimerId);
+}
+
+int timer_wheel_run_expired(t_timer_wheel* pWheel, u32 uTimeNow)
+{
+   if ( NULL == pWheel )
+      return 0;
+
+   // After a long stall, don't walk each missed ms; just jump ahead and fire everything that is due
+   if ( uTimeNow - pWheel->uCurrentTick > TIMER_WHEEL_MAX_CATCHUP_MS )
+   if ( (int)(uTimeNow - pWheel->uCurrentTick) > 0 )
+   {
+      log_softerror_and_alarm("[TimerWheel] Time jumped by %u ms, relinking all timers.", uTimeNow - pWheel->uCurrentTick);
+      for( int i=0; i<TIMER_WHEEL_MAX_TIMERS; i++ )
+         if ( pWheel->timers[i].iUsed )
+            _timer_wheel_unlink(pWheel, i);
+      pWheel->uCurrentTick = uTimeNow;
+      for( int i=0; i<TIMER_WHEEL_MAX_TIMERS; i++ )
+         if ( pWheel->timers[i].iUsed )
+            _timer_wheel_link(pWheel, i);
+   }
+
+   int iDueTimers[TIMER_WHEEL_MAX_TIMERS];
+   int iCountDue = 0;
+
+   while ( (int)(uTimeNow - pWheel->uCurrentTick) >= 0 )
+   {
+      if ( 0 == (pWheel->uCurrentTick & (TIMER_WHEEL_L0_SLOTS-1)) )
+         _timer_wheel_cascade(pWheel);
+
+      int iSlot = pWheel->uCurrentTick & (TIMER_WHEEL_L0_SLOTS-1);
+      int iTimerId = pWheel->iSlotsL0[iSlot];
+      pWheel->iSlotsL0[iSlot] = -1;
+      while ( -1 != iTimerId )
+      {
+         int iNext = pWheel->timers[iTimerId].iNext;
+         pWheel->timers[iTimerId].iNext = -1;
+         pWheel->timers[iTimerId].iLevel = -1;
+         if ( iCountDue < TIMER_WHEEL_MAX_TIMERS )
+            iDueTimers[iCountDue++] = iTimerId;
+         iTimerId = iNext;
+      }
+      pWheel->uCurrentTick++;
+   }
+
+   int iCountRun = 0;
+   for( int i=0; i<iCountDue; i++ )
+   {
+      t_timer_wheel_entry* pTimer = &(pWheel->timers[iDueTimers[i]]);
+      // Could have been removed or rescheduled by a previous callback
+      if ( (! pTimer->iUsed) || (pTimer->iLevel != -1) )
+         continue;
+
+      if ( (iCountRun > 0) && (NULL != pWheel->pPreemptCallback) )
+         pWheel->pPreemptCallback(pWheel->pPreemptContext);
+
+      u32 uLate = uTimeNow - pTimer->uExpireTime;
+      if ( uLate > pTimer->uMaxLateMs )
+         pTimer->uMaxLateMs = uLate;
+
+      if ( pTimer->iRepeat )
+      {
+         pTimer->uExpireTime += pTimer->uIntervalMs;
+         // Don't try to catch up missed runs, just keep the cadence from now on
+         if ( (int)(pTimer->uExpireTime - uTimeNow) <= 0 )
+            pTimer->uExpireTime = uTimeNow + pTimer->uIntervalMs;
+         _timer_wheel_link(pWheel, iDueTimers[i]);
+      }
+      else
+      {
+         pTimer->iUsed = 0;
+         pWheel->iCountActiveTimers--;
+      }
+
+      u32 uTimeStart = get_current_timestamp_micros();
+      pTimer->pCallback(pTimer->pContext, uTimeNow);
+      u32 uDuration = get_current_timestamp_micros() - uTimeStart;
+      pTimer->uCountRuns++;
+      pTimer->uTotalRunTimeMicros += uDuration;
+      if ( uDuration > pTimer->uMaxRunTimeMicros )
+         pTimer->uMaxRunTimeMicros = uDuration;
+      iCountRun++;
+   }
+   return iCountRun;
+}
+
+u32 timer_wheel_get_ms_to_next(t_timer_wheel* pWheel, u32 uTimeNow, u32 uMaxWaitMs)
+{
+   if ( NULL == pWheel )
+      return uMaxWaitMs;
+
+   u32 uWait = uMaxWaitMs;
+   for( int i=0; i<TIMER_WHEEL_MAX_TIMERS; i++ )
+   {
+      if ( ! pWheel->timers[i].iUsed )
+         continue;
+      int iDelta = (int)(pWheel->timers[i].uExpireTime - uTimeNow);
+      if ( iDelta <= 0 )
+         return 0;
+      if ( (u32)iDelta < uWait )
+         uWait = (u32)iDelta;
+   }
+   return uWait;
+}
+
+void timer_wheel_log_stats(t_timer_wheel* pWheel)
+{
+   if ( NULL == pWheel )
+      return;
+   log_line("[TimerWheel] %d active timers:", pWheel->iCountActiveTimers);
+   for( int i=0; i<TIMER_WHEEL_MAX_TIMERS; i++ )
+   {
+      t_timer_wheel_entry* pTimer = &(pWheel->timers[i]);
+      if ( ! pTimer->iUsed )
+         continue;
+      log_line("[TimerWheel] Timer %d (%s): every %u ms, runs: %u, avg run: %u us, max run: %u us, max late: %u ms",
+         i, pTimer->szName, pTimer->uIntervalMs, pTimer->uCountRuns,
+         (pTimer->uCountRuns > 0)?(pTimer->uTotalRunTimeMicros/pTimer->uCountRuns):0,
+         pTimer->uMaxRunTimeMicros, pTimer->uMaxLateMs);
+   }
+}
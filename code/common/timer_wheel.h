@@ -0,0 +1,72 @@
+#pragma once
+#include "../base/base.h"
+
+// Two level hashed timer wheel with 1 ms resolution.
+// Level 0 covers the next 256 ms (one slot per ms), level 1 covers the next 64*256 ms.
+// Timers further away are parked in the farthest level 1 slot and re-cascaded.
+
+#define TIMER_WHEEL_L0_BITS 8
+#define TIMER_WHEEL_L0_SLOTS (1<<TIMER_WHEEL_L0_BITS)
+#define TIMER_WHEEL_L1_SLOTS 64
+#define TIMER_WHEEL_MAX_TIMERS 32
+#define TIMER_WHEEL_MAX_CATCHUP_MS (TIMER_WHEEL_L0_SLOTS * TIMER_WHEEL_L1_SLOTS)
+
+typedef void (*timer_wheel_callback)(void* pContext, u32 uTimeNow);
+
+// Called between timer callbacks; lets the owner service urgent work (i.e. radio rx) before the next timer runs
+typedef void (*timer_wheel_preempt_callback)(void* pContext);
+
+typedef struct
+{
+   int iUsed;
+   int iNext; // next timer in the same slot, -1 for end of list
+   int iLevel; // -1 if not linked in any slot
+   int iSlot;
+   u32 uExpireTime;
+   u32 uIntervalMs;
+   int iRepeat;
+   timer_wheel_callback pCallback;
+   void* pContext;
+   char szName[32];
+
+   u32 uCountRuns;
+   u32 uTotalRunTimeMicros;
+   u32 uMaxRunTimeMicros;
+   u32 uMaxLateMs;
+} t_timer_wheel_entry;
+
+typedef struct
+{
+   t_timer_wheel_entry timers[TIMER_WHEEL_MAX_TIMERS];
+   int iSlotsL0[TIMER_WHEEL_L0_SLOTS];
+   int iSlotsL1[TIMER_WHEEL_L1_SLOTS];
+   u32 uCurrentTick; // Next tick (ms) to be processed
+   int iCountActiveTimers;
+
+   timer_wheel_preempt_callback pPreemptCallback;
+   void* pPreemptContext;
+} t_timer_wheel;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void timer_wheel_init(t_timer_wheel* pWheel, u32 uTimeNow);
+void timer_wheel_set_preempt_callback(t_timer_wheel* pWheel, timer_wheel_preempt_callback pCallback, void* pContext);
+
+// Returns timer id (>= 0) or -1 on failure
+int timer_wheel_add(t_timer_wheel* pWheel, const char* szName, u32 uIntervalMs, int iRepeat, timer_wheel_callback pCallback, void* pContext);
+void timer_wheel_remove(t_timer_wheel* pWheel, int iTimerId);
+void timer_wheel_reschedule(t_timer_wheel* pWheel, int iTimerId, u32 uTimeNow, u32 uDelayMs);
+
+// Runs all timers expired up to uTimeNow. Returns the number of callbacks invoked.
+int timer_wheel_run_expired(t_timer_wheel* pWheel, u32 uTimeNow);
+
+// Returns how many ms until the next timer expires (0 if one is already due), or uMaxWaitMs if nothing is scheduled sooner
+u32 timer_wheel_get_ms_to_next(t_timer_wheel* pWheel, u32 uTimeNow, u32 uMaxWaitMs);
+
+void timer_wheel_log_stats(t_timer_wheel* pWheel);
+
+#ifdef __cplusplus
+}
+#endif
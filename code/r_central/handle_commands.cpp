@@ -32,6 +32,7 @@
 #include <pthread.h>
 //#include "../base/radio_utils.h"
 #include "../base/ctrl_settings.h"
+#include "../base/file_transfer.h"
 #include "../common/models_connect_frequencies.h"
 #include "../common/string_utils.h"
 #include "handle_commands.h"
@@ -107,6 +108,24 @@ static u32 s_uCountFileSegmentsDownloaded = 0;
 static u32 s_uLastFileSegmentRequestTime = 0;
 static u32 s_uLastTimeDownloadProgress = 0;
 
+// Windowed file transfers (see base/file_transfer.h). If the vehicle does not answer them
+// (older vehicle software), the per segment transfers are used instead.
+#define FILE_TRANSFER_FALLBACK_TIMEOUT_MS 3000
+#define FILE_TRANSFER_ACK_INTERVAL_MS 50
+#define FILE_TRANSFER_SEGMENTS_PER_ACK 4
+
+static bool s_bFileTransferDownloadActive = false;
+static bool s_bFileTransferDownloadReceivedAny = false;
+static t_file_transfer_receiver s_FileTransferReceiver;
+static u32 s_uFileTransferDownloadStartTime = 0;
+static u32 s_uFileTransferLastAckTime = 0;
+static u32 s_uFileTransferSegmentsSinceAck = 0;
+
+static bool s_bFileTransferUploadActive = false;
+static bool s_bFileTransferUploadAcked = false;
+static t_file_transfer_sender s_FileTransferSender;
+static u32 s_uFileTransferUploadStartTime = 0;
+
 Menu* s_pMenuVehicleHWInfo = NULL;
 Menu* s_pMenuUSBInfoVehicle = NULL;
 
@@ -513,6 +532,13 @@ bool handle_commands_stop_on_pairing()
 {
    log_line("[Commands] Handle stop pairing...");
 
+   if ( s_bFileTransferDownloadActive )
+      file_transfer_receiver_close(&s_FileTransferReceiver);
+   s_bFileTransferDownloadActive = false;
+   if ( s_bFileTransferUploadActive )
+      file_transfer_sender_close(&s_FileTransferSender);
+   s_bFileTransferUploadActive = false;
+
    if ( 0 < s_uCountFileSegmentsToDownload )
    {
        for( u32 u=0; u<s_uCountFileSegmentsToDownload; u++ )
@@ -550,6 +576,52 @@ void merge_osd_params(osd_parameters_t* pParamsVehicleSrc, osd_parameters_t* pPa
 }
 
 
+void _file_transfer_download_start()
+{
+   if ( s_bFileTransferDownloadActive )
+      return;
+   char szFile[MAX_FILE_PATH_SIZE];
+   strcpy(szFile, FOLDER_RUBY_TEMP);
+   strcat(szFile, "vehicle_logs.zip");
+   file_transfer_receiver_open(&s_FileTransferReceiver, 0, szFile, FILE_TRANSFER_DEFAULT_WINDOW);
+   s_bFileTransferDownloadActive = true;
+   s_bFileTransferDownloadReceivedAny = false;
+   s_uFileTransferDownloadStartTime = g_TimeNow;
+   s_uFileTransferLastAckTime = 0;
+   s_uFileTransferSegmentsSinceAck = 0;
+}
+
+void _file_transfer_download_fallback()
+{
+   log_line("[Commands] Vehicle does not answer windowed file download. Using per segment download.");
+   file_transfer_receiver_close(&s_FileTransferReceiver);
+   s_bFileTransferDownloadActive = false;
+
+   char szComm[256];
+   sprintf(szComm, "rm -rf %s/vehicle_logs.zip*", FOLDER_RUBY_TEMP);
+   hw_execute_bash_command(szComm, NULL);
+   sprintf(szComm, "touch %s/vehicle_logs.zip", FOLDER_RUBY_TEMP);
+   hw_execute_bash_command(szComm, NULL);
+}
+
+void _file_transfer_download_send_ack()
+{
+   t_file_transfer_ack ack;
+   file_transfer_receiver_get_ack(&s_FileTransferReceiver, &ack);
+   if ( handle_commands_send_single_oneway_command(0, COMMAND_ID_FILE_TRANSFER_ACK, s_uFileIdToDownload, (u8*)&ack, sizeof(t_file_transfer_ack), 0) )
+   {
+      s_uFileTransferLastAckTime = g_TimeNow;
+      s_uFileTransferSegmentsSinceAck = 0;
+   }
+}
+
+int _file_transfer_send_upload_segment(void* pContext, u8* pData, int iLength)
+{
+   if ( ! handle_commands_send_single_oneway_command(0, COMMAND_ID_FILE_TRANSFER_SEGMENT, g_CurrentUploadingFile.uFileId, pData, iLength, 0) )
+      return 0;
+   return iLength;
+}
+
 void _handle_download_file_response()
 {
    u32 uFileId = s_CommandParam;
@@ -587,13 +659,7 @@ void _handle_download_file_response()
       s_uLastTimeDownloadProgress = g_TimeNow;
 
       if ( pFileInfo->file_id == FILE_ID_VEHICLE_LOGS_ARCHIVE )
-      {
-         char szComm[256];
-         sprintf(szComm, "rm -rf %s/vehicle_logs.zip", FOLDER_RUBY_TEMP);
-         hw_execute_bash_command(szComm, NULL);
-         sprintf(szComm, "touch %s/vehicle_logs.zip", FOLDER_RUBY_TEMP);
-         hw_execute_bash_command(szComm, NULL);
-      }
+         _file_transfer_download_start();
    }
    else
    {
@@ -615,6 +681,8 @@ void _handle_download_file_response()
 }
 
 
+void _handle_downloaded_file_complete(u32 uFileId);
+
 void _handle_download_file_segment_response()
 {
    t_packet_header* pPH = (t_packet_header*)s_CommandReplyBuffer;
@@ -699,7 +767,16 @@ void _handle_download_file_segment_response()
       }
       else
          log_softerror_and_alarm("[Commands] Failed to write received vehicle logs zip file to storage (%s).", szFile);
+   }
+   _handle_downloaded_file_complete(uFileId);
+}
 
+// The downloaded file is in FOLDER_RUBY_TEMP
+void _handle_downloaded_file_complete(u32 uFileId)
+{
+   if ( uFileId == FILE_ID_VEHICLE_LOGS_ARCHIVE )
+   {
+      char szComm[256];
       char szFolder[256];
       char szBuff[256];
 
@@ -728,6 +805,85 @@ void _handle_download_file_segment_response()
    s_uCountFileSegmentsToDownload = 0;
 }
 
+void _handle_file_transfer_download_response()
+{
+   if ( ! s_bFileTransferDownloadActive )
+      return;
+   t_packet_header* pPH = (t_packet_header*)s_CommandReplyBuffer;
+   t_packet_header_command_response* pPHCR = (t_packet_header_command_response*)(s_CommandReplyBuffer + sizeof(t_packet_header));
+   int iLength = pPH->total_length - sizeof(t_packet_header) - sizeof(t_packet_header_command_response);
+   u8* pBuffer = &s_CommandReplyBuffer[0] + sizeof(t_packet_header) + sizeof(t_packet_header_command_response);
+
+   if ( pPHCR->command_response_flags & COMMAND_RESPONSE_FLAGS_FAILED )
+   {
+      _file_transfer_download_fallback();
+      return;
+   }
+   if ( file_transfer_receiver_on_segment(&s_FileTransferReceiver, pBuffer, iLength) < 0 )
+      return;
+   s_bFileTransferDownloadReceivedAny = true;
+   s_uFileTransferSegmentsSinceAck++;
+
+   if ( g_TimeNow > s_uLastTimeDownloadProgress + 5000 )
+   {
+      s_uLastTimeDownloadProgress = g_TimeNow;
+      char szBuff[128];
+      sprintf(szBuff, "Downloading %d%%", (int)(s_FileTransferReceiver.uCountReceived*100 / s_FileTransferReceiver.uTotalSegments));
+      warnings_add(0, szBuff);
+   }
+
+   if ( ! file_transfer_receiver_is_complete(&s_FileTransferReceiver) )
+   {
+      if ( s_uFileTransferSegmentsSinceAck >= FILE_TRANSFER_SEGMENTS_PER_ACK )
+         _file_transfer_download_send_ack();
+      return;
+   }
+
+   // Let the vehicle know the transfer is complete
+   _file_transfer_download_send_ack();
+   log_line("[Commands] Received entire file. File size: %u bytes.", s_FileTransferReceiver.uFileSize);
+   file_transfer_receiver_close(&s_FileTransferReceiver);
+   s_bFileTransferDownloadActive = false;
+   if ( s_uFileIdToDownload == FILE_ID_VEHICLE_LOGS_ARCHIVE )
+      warnings_add(0, "Received complete vehicles logs.");
+   _handle_downloaded_file_complete(s_uFileIdToDownload);
+}
+
+void _handle_file_transfer_upload_response()
+{
+   if ( ! s_bFileTransferUploadActive )
+      return;
+   t_packet_header* pPH = (t_packet_header*)s_CommandReplyBuffer;
+   int iLength = pPH->total_length - sizeof(t_packet_header) - sizeof(t_packet_header_command_response);
+   u8* pBuffer = &s_CommandReplyBuffer[0] + sizeof(t_packet_header) + sizeof(t_packet_header_command_response);
+   if ( iLength < (int)sizeof(t_file_transfer_ack) )
+      return;
+
+   t_file_transfer_ack ack;
+   memcpy((u8*)&ack, pBuffer, sizeof(t_file_transfer_ack));
+   file_transfer_sender_on_ack(&s_FileTransferSender, &ack, g_TimeNow);
+   s_bFileTransferUploadAcked = true;
+
+   if ( s_FileTransferSender.iAborted )
+   {
+      warnings_add(0, "Failed to upload core plugins to vehicle.");
+      file_transfer_sender_close(&s_FileTransferSender);
+      s_bFileTransferUploadActive = false;
+      g_bHasFileUploadInProgress = false;
+      return;
+   }
+   if ( file_transfer_sender_is_complete(&s_FileTransferSender) )
+   {
+      warnings_add(0, "Finished uploading core plugins to vehicle.");
+      file_transfer_sender_close(&s_FileTransferSender);
+      s_bFileTransferUploadActive = false;
+      g_bHasFileUploadInProgress = false;
+      return;
+   }
+   // Acks clock out the next segments
+   file_transfer_sender_send(&s_FileTransferSender, g_TimeNow);
+}
+
 
 // Returns true if the command will still be in progress
 
@@ -2066,6 +2222,20 @@ bool _commands_check_download_file_segments()
       return true;
    }
 
+   if ( s_bFileTransferDownloadActive )
+   {
+      if ( (! s_bFileTransferDownloadReceivedAny) && (g_TimeNow > s_uFileTransferDownloadStartTime + FILE_TRANSFER_FALLBACK_TIMEOUT_MS) )
+         _file_transfer_download_fallback();
+      else
+      {
+         // Periodic acks also drive the vehicle retransmissions if acks or segments are lost
+         if ( g_TimeNow < s_uFileTransferLastAckTime + FILE_TRANSFER_ACK_INTERVAL_MS )
+            return false;
+         _file_transfer_download_send_ack();
+         return true;
+      }
+   }
+
    if ( g_TimeNow < s_uLastFileSegmentRequestTime + 100 )
       return false;
 
@@ -2102,6 +2272,22 @@ bool _commands_check_upload_file_segments()
       return false;    
    }
 
+   if ( s_bFileTransferUploadActive )
+   {
+      if ( (! s_bFileTransferUploadAcked) && (g_TimeNow > s_uFileTransferUploadStartTime + FILE_TRANSFER_FALLBACK_TIMEOUT_MS) )
+      {
+         log_line("[Commands] Vehicle does not answer windowed file upload. Using per segment upload.");
+         file_transfer_sender_close(&s_FileTransferSender);
+         s_bFileTransferUploadActive = false;
+      }
+      else
+      {
+         // Resends the timed out segments
+         file_transfer_sender_send(&s_FileTransferSender, g_TimeNow);
+         return false;
+      }
+   }
+
    if ( g_TimeNow < g_CurrentUploadingFile.uTimeLastUploadSegment + 100 )
       return false;
 
@@ -2253,6 +2439,17 @@ void handle_commands_on_response_received(u8* pPacketBuffer, int iLength)
       return;
    }
 
+   if ( (pPHCR->origin_command_type == COMMAND_ID_FILE_TRANSFER_ACK) || (pPHCR->origin_command_type == COMMAND_ID_FILE_TRANSFER_SEGMENT) )
+   {
+      memcpy( s_CommandReplyBuffer, pPacketBuffer, pPH->total_length );
+      s_CommandReplyLength = pPH->total_length;
+      if ( pPHCR->origin_command_type == COMMAND_ID_FILE_TRANSFER_ACK )
+         _handle_file_transfer_download_response();
+      else
+         _handle_file_transfer_upload_response();
+      return;
+   }
+
    // Received a response to an old command? Ignore it
    if ( pPHCR->origin_command_counter != s_CommandCounter )
    {
@@ -2725,6 +2922,16 @@ void handle_commands_initiate_file_upload(u32 uFileId, const char* szFileName)
 
    g_CurrentUploadingFile.uLastSegmentIndexUploaded = 0xFFFFFFFF;
    g_bHasFileUploadInProgress = true;
+
+   if ( s_bFileTransferUploadActive )
+      file_transfer_sender_close(&s_FileTransferSender);
+   s_bFileTransferUploadActive = false;
+   if ( 0 == file_transfer_sender_open_file(&s_FileTransferSender, 0, szFileName, FILE_TRANSFER_DEFAULT_SEGMENT_SIZE, FILE_TRANSFER_DEFAULT_FEC_GROUP, _file_transfer_send_upload_segment, NULL) )
+   {
+      s_bFileTransferUploadActive = true;
+      s_bFileTransferUploadAcked = false;
+      s_uFileTransferUploadStartTime = g_TimeNow;
+   }
 }
 
 bool handle_commands_send_developer_flags(bool bEnableDevMode, u32 uDevFlags)
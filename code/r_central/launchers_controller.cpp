@@ -52,15 +52,8 @@ static int s_iCPUCoresCount = 1;
 
 void controller_compute_cpu_info()
 {
-   char szOutput[128];
-   hw_execute_bash_command_raw("nproc --all", szOutput);
-   s_iCPUCoresCount = 1;
-   if ( 1 != sscanf(szOutput, "%d", &s_iCPUCoresCount) )
-   {
-      log_softerror_and_alarm("Failed to get CPU cores count. Default to 1 core.");
-      return;    
-   }
-   log_line("Detected CPU with %d cores.", s_iCPUCoresCount);
+   s_iCPUCoresCount = hw_get_cpu_cores_count();
+   log_line("Detected CPU with %d online cores.", s_iCPUCoresCount);
 }
 
 void controller_launch_router(bool bSearchMode, int iFirmwareType)
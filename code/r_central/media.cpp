@@ -42,8 +42,12 @@
 #include "timers.h"
 
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 #include <string.h>
+#include <errno.h>
+
+#define MAX_MEDIA_INVALID_FILES_PER_SCAN 32
 
 
 static int s_iScreenshotsCountOnDisk = 0;
@@ -54,74 +58,46 @@ static int s_iMediaInitCount = 0;
 static char s_szMediaCurrentScreenshotFileName[MAX_FILE_PATH_SIZE];
 static char s_szMediaCurrentVideoFileInfo[MAX_FILE_PATH_SIZE];
 
-void _media_remove_invalid_files()
+// Updates the media counters for a valid (more than 3 bytes) media file
+static void _media_count_file(const char* szFileName, int iDelta)
+{
+   if ( NULL != strstr(szFileName, "picture-") )
+      s_iScreenshotsCountOnDisk += iDelta;
+   if ( NULL != strstr(szFileName, ".info") )
+      s_iVideoCountOnDisk += iDelta;
+}
+
+// Removes all the media files of a recording or screenshot: the ones with the same base name (up to the extension)
+// and a .h26*, .info or .png extension
+// Files removed here might have been counted already by the scan, so they are uncounted
+static void _media_remove_files_with_base_name(const char* szBaseName)
 {
    DIR *d;
-   FILE* fd;
    struct dirent *dir;
+   struct stat statFile;
    char szFile[MAX_FILE_PATH_SIZE];
-   char szComm[1024];
-   log_line("Searching and removing invalid media files...");
+   int iBaseLength = strlen(szBaseName);
+
    d = opendir(FOLDER_MEDIA);
-   if (d)
+   if ( NULL == d )
+      return;
+   while ((dir = readdir(d)) != NULL)
    {
-      while ((dir = readdir(d)) != NULL)
-      {
-         if ( strlen(dir->d_name) < 4 )
-            continue;
-
-         snprintf(szFile, sizeof(szFile)/sizeof(szFile[0]), "%s%s", FOLDER_MEDIA, dir->d_name);
-         long lSize = 0;
-         fd = fopen(szFile, "rb");
-         if ( NULL != fd )
-         {
-            fseek(fd, 0, SEEK_END);
-            lSize = ftell(fd);
-            fseek(fd, 0, SEEK_SET);
-            fclose(fd);
-         }
-         else
-            log_softerror_and_alarm("Failed to open file [%s] for checking it's size.", szFile);
-         if ( lSize > 3 )
-            continue;
-
-         // Remove small files (less than 3 bytes)
-
-         log_line("Removing invalid media file: [%s]", dir->d_name);
-
-         // Remove invalid file and info file for it
-
-         strcpy(szFile, dir->d_name);
-         int pos = strlen(szFile);
-         while (pos > 0 && szFile[pos] != '.')
-            pos--;
-         pos++;
-
-         szFile[pos] = 0;
-         strcat(szFile, "h26*");
-         snprintf(szComm, sizeof(szComm)/sizeof(szComm[0]), "rm -rf %s%s", FOLDER_MEDIA, szFile);
-         hw_execute_bash_command(szComm, NULL);
-
-         szFile[pos] = 0;
-         strcat(szFile, "info");
-         snprintf(szComm, sizeof(szComm)/sizeof(szComm[0]), "rm -rf %s%s", FOLDER_MEDIA, szFile);
-         hw_execute_bash_command(szComm, NULL);
-
-         szFile[pos] = 0;
-         strcat(szFile, "png");
-         snprintf(szComm, sizeof(szComm)/sizeof(szComm[0]), "rm -rf %s%s", FOLDER_MEDIA, szFile);
-         hw_execute_bash_command(szComm, NULL);
-
-         ruby_signal_alive();
-      }
-      closedir(d);
+      if ( 0 != strncmp(dir->d_name, szBaseName, iBaseLength) )
+         continue;
+      const char* szExt = dir->d_name + iBaseLength;
+      if ( (0 != strncmp(szExt, "h26", 3)) && (0 != strcmp(szExt, "info")) && (0 != strcmp(szExt, "png")) )
+         continue;
+      snprintf(szFile, sizeof(szFile)/sizeof(szFile[0]), "%s%s", FOLDER_MEDIA, dir->d_name);
+      bool bWasCounted = (0 == stat(szFile, &statFile)) && (statFile.st_size > 3);
+      if ( 0 != unlink(szFile) )
+         log_softerror_and_alarm("Failed to remove media file [%s], error: %d", szFile, errno);
+      else if ( bWasCounted )
+         _media_count_file(dir->d_name, -1);
    }
-   else
-      log_softerror_and_alarm("Failed to open media dir to search for invalid videos.");
-   log_line("Searching and removing invalid media files complete.");
+   closedir(d);
 }
 
-
 bool media_init_and_scan()
 {
    log_line("Media Storage: Init media storage...");
@@ -151,33 +127,85 @@ bool media_init_and_scan()
    return true;
 }
 
+// Counts the media files and removes invalid ones (less than 3 bytes) in a single pass over the media folder,
+// without running shell commands
 void media_scan_files()
 {
-   char szOutBuff[1024];
+   DIR *d;
+   struct dirent *dir;
+   struct stat statFile;
+   char szFile[MAX_FILE_PATH_SIZE];
+   char szInvalidBaseNames[MAX_MEDIA_INVALID_FILES_PER_SCAN][MAX_FILE_PATH_SIZE];
+   int iCountInvalid = 0;
+   int iCountDeferred = 0;
 
-   _media_remove_invalid_files();
- 
+   s_iScreenshotsCountOnDisk = 0;
+   s_iVideoCountOnDisk = 0;
 
-   // Count files in a folder:
-   // ls media/ | grep picture- | wc -l
-   // ls media/ | grep '.info' | wc -l
+   log_line("Media storage: Scanning media files...");
+   d = opendir(FOLDER_MEDIA);
+   if ( NULL == d )
+   {
+      log_softerror_and_alarm("Failed to open media dir to scan media files.");
+      return;
+   }
 
-   s_iScreenshotsCountOnDisk = 0;
-   szOutBuff[0] = 0;
-   hw_execute_bash_command("ls media/ | grep picture- | wc -l", szOutBuff);
-   if ( 0 < strlen(szOutBuff) )
-      s_iScreenshotsCountOnDisk = strtol(szOutBuff, NULL, 10);
+   while ((dir = readdir(d)) != NULL)
+   {
+      if ( strlen(dir->d_name) < 4 )
+         continue;
 
-   s_iVideoCountOnDisk = 0;
-   szOutBuff[0] = 0;
-   hw_execute_bash_command("ls media/ | grep '.info' | wc -l", szOutBuff);
-   if ( 0 < strlen(szOutBuff) )
-      s_iVideoCountOnDisk = strtol(szOutBuff, NULL, 10);
+      snprintf(szFile, sizeof(szFile)/sizeof(szFile[0]), "%s%s", FOLDER_MEDIA, dir->d_name);
+      if ( 0 != stat(szFile, &statFile) )
+      {
+         log_softerror_and_alarm("Failed to get the size of media file [%s].", szFile);
+         continue;
+      }
+      if ( ! S_ISREG(statFile.st_mode) )
+         continue;
+
+      if ( statFile.st_size <= 3 )
+      {
+         // Remove small files (less than 3 bytes) and the other files of the same recording, after the scan.
+         // Past the per scan limit, they are left for the next scan
+         if ( iCountInvalid >= MAX_MEDIA_INVALID_FILES_PER_SCAN )
+         {
+            log_line("Too many invalid media files, deferring removal of: [%s]", dir->d_name);
+            iCountDeferred++;
+         }
+         else
+         {
+            log_line("Removing invalid media file: [%s]", dir->d_name);
+            strncpy(szInvalidBaseNames[iCountInvalid], dir->d_name, MAX_FILE_PATH_SIZE-1);
+            szInvalidBaseNames[iCountInvalid][MAX_FILE_PATH_SIZE-1] = 0;
+            char* pExt = strrchr(szInvalidBaseNames[iCountInvalid], '.');
+            if ( NULL != pExt )
+            {
+               *(pExt+1) = 0;
+               iCountInvalid++;
+            }
+         }
+         continue;
+      }
+
+      _media_count_file(dir->d_name, 1);
+   }
+   closedir(d);
+
+   for( int i=0; i<iCountInvalid; i++ )
+   {
+      _media_remove_files_with_base_name(szInvalidBaseNames[i]);
+      ruby_signal_alive();
+   }
 
    ruby_signal_alive();
 
    log_line("Media storage: Found %d screenshots on storage.", s_iScreenshotsCountOnDisk );
    log_line("Media storage: Found %d videos on storage.", s_iVideoCountOnDisk );
+   if ( iCountInvalid > 0 )
+      log_line("Media storage: Removed %d invalid media files.", iCountInvalid);
+   if ( iCountDeferred > 0 )
+      log_line("Media storage: Deferred the removal of %d invalid media files to the next scan.", iCountDeferred);
 }
 
 int media_get_screenshots_count()
@@ -35,6 +35,7 @@
 #include "menu_confirmation.h"
 
 #include <sys/types.h>
+#include <sys/statvfs.h>
 #include <dirent.h>
 #include <string.h>
 
@@ -85,28 +86,21 @@ void MenuStorage::valuesToUI()
 
 void MenuStorage::onShow()
 {
-   char szBuff[1024];
-   char szComm[256];
    removeAllTopLines();
    removeAllItems();
 
    media_scan_files();
 
-   #ifdef HW_PLATFORM_RASPBERRY
-   sprintf(szComm, "df -m %s | grep root", FOLDER_BINARIES);
-   #endif
-   #ifdef HW_PLATFORM_RADXA_ZERO3
-   sprintf(szComm, "df -m %s | grep mmc", FOLDER_BINARIES);
-   #endif
-
-   if ( 1 == hw_execute_bash_command_raw(szComm, szBuff) )
+   // Same values as "df -m" reports for the storage holding Ruby (used and available Mb)
+   struct statvfs statStorage;
+   if ( 0 == statvfs(FOLDER_BINARIES, &statStorage) )
    {
-      char szTemp[1024];
-      long lb, lu, lf;
-      sscanf(szBuff, "%s %ld %ld %ld", szTemp, &lb, &lu, &lf);
-      m_MemUsed = lu;
-      m_MemFree = lf;
+      unsigned long long uBlockSize = statStorage.f_frsize;
+      m_MemUsed = (long)(((unsigned long long)(statStorage.f_blocks - statStorage.f_bfree) * uBlockSize) / (1024*1024));
+      m_MemFree = (long)(((unsigned long long)statStorage.f_bavail * uBlockSize) / (1024*1024));
    }
+   else
+      log_softerror_and_alarm("Menu Storage: Failed to get the storage free space for %s", FOLDER_BINARIES);
 
    ruby_signal_alive();
    buildFilesListPictures();
@@ -43,6 +43,7 @@
 #include "../shared_vars.h"
 #include "../colors.h"
 #include "../../renderer/render_engine.h"
+#include "../../renderer/render_cache.h"
 #include "osd_common.h"
 #include "osd.h"
 #include "osd_stats_dev.h"
@@ -115,6 +116,15 @@ static u32 s_uOSDMaxFrameDeviationTx = 0;
 static u32 s_uOSDMaxFrameDeviationRx = 0;
 static u32 s_uOSDMaxFrameDeviationPlayer = 0;
 
+// Retained rendering of the stats panels: a panel is drawn again only when its layout or its bound inputs change.
+// Panels bound to radio stats are redrawn when the router recomputes them; the others at most every OSD_STATS_CACHE_REFRESH_MS.
+#define OSD_STATS_CACHE_REFRESH_MS 100
+#define OSD_STATS_CACHE_MAX_AGE_MS 500
+#define OSD_STATS_CACHE_MARGIN_PIXELS 2
+
+static u32 s_uOSDStatsCacheFrameKey = 0;
+static u32 s_uOSDStatsCacheLastLogTime = 0;
+
 void _osd_stats_draw_line(float xLeft, float xRight, float y, u32 uFontId, const char* szTextLeft, const char* szTextRight)
 {
    g_pRenderEngine->drawText(xLeft, y, uFontId, szTextLeft);
@@ -129,6 +139,23 @@ void osd_stats_init()
    s_uOSDMaxFrameDeviationTx = 0;
    s_uOSDMaxFrameDeviationRx = 0;
    s_uOSDMaxFrameDeviationPlayer = 0;
+   render_cache_init();
+}
+
+// Keeps the max frame deviations up to date on every OSD frame, even when the panel showing them is drawn from the render cache
+static void _osd_stats_update_max_frame_deviations()
+{
+   if ( g_TimeNow <= g_RouterIsReadyTimestamp + 6000 )
+      return;
+
+   if ( g_VideoInfoStatsFromVehicleCameraOut.uMaxFrameDeltaTime > s_uOSDMaxFrameDeviationCamera )
+      s_uOSDMaxFrameDeviationCamera = g_VideoInfoStatsFromVehicleCameraOut.uMaxFrameDeltaTime;
+   if ( g_VideoInfoStatsFromVehicleRadioOut.uMaxFrameDeltaTime > s_uOSDMaxFrameDeviationTx )
+      s_uOSDMaxFrameDeviationTx = g_VideoInfoStatsFromVehicleRadioOut.uMaxFrameDeltaTime;
+   if ( g_SM_VideoInfoStatsRadioIn.uMaxFrameDeltaTime > s_uOSDMaxFrameDeviationRx )
+      s_uOSDMaxFrameDeviationRx = g_SM_VideoInfoStatsRadioIn.uMaxFrameDeltaTime;
+   if ( g_SM_VideoInfoStatsOutput.uMaxFrameDeltaTime > s_uOSDMaxFrameDeviationPlayer )
+      s_uOSDMaxFrameDeviationPlayer = g_SM_VideoInfoStatsOutput.uMaxFrameDeltaTime;
 }
 
 void osd_stats_video_decode_snapshot_update(int iDeveloperMode, shared_mem_radio_stats* pSM_RadioStats, shared_mem_video_stream_stats* pVDS, shared_mem_video_stream_stats_history* pVDSH, shared_mem_video_stream_stats_rx_processors* pSM_VideoStats, shared_mem_video_stream_stats_history_rx_processors* pSM_VideoHistoryStats, shared_mem_controller_retransmissions_stats_rx_processors* pSM_ControllerRetransmissionsStats, shared_mem_controller_retransmissions_stats* pCRS)
@@ -3116,20 +3143,6 @@ float osd_render_stats_video_stream_keyframe_info(float xPos, float yPos)
    g_pRenderEngine->drawText(xPos, y, s_idFontStats, szBuff);
    y += height_text*s_OSDStatsLineSpacing;
 
-   if ( g_TimeNow > g_RouterIsReadyTimestamp + 6000 )
-   {
-      if ( g_VideoInfoStatsFromVehicleCameraOut.uMaxFrameDeltaTime > s_uOSDMaxFrameDeviationCamera )
-         s_uOSDMaxFrameDeviationCamera = g_VideoInfoStatsFromVehicleCameraOut.uMaxFrameDeltaTime;
-      if ( g_VideoInfoStatsFromVehicleRadioOut.uMaxFrameDeltaTime > s_uOSDMaxFrameDeviationTx )
-         s_uOSDMaxFrameDeviationTx = g_VideoInfoStatsFromVehicleRadioOut.uMaxFrameDeltaTime;
-      
-      if ( g_SM_VideoInfoStatsRadioIn.uMaxFrameDeltaTime > s_uOSDMaxFrameDeviationRx )
-         s_uOSDMaxFrameDeviationRx = g_SM_VideoInfoStatsRadioIn.uMaxFrameDeltaTime;
-
-      if ( g_SM_VideoInfoStatsOutput.uMaxFrameDeltaTime > s_uOSDMaxFrameDeviationPlayer )
-         s_uOSDMaxFrameDeviationPlayer = g_SM_VideoInfoStatsOutput.uMaxFrameDeltaTime;
-   }
-
    g_pRenderEngine->drawText(xPos, y, s_idFontStats, "Max dev cam/tx/rx all:");
    y += height_text*s_OSDStatsLineSpacing;
    
@@ -4803,6 +4816,72 @@ void _osd_stats_autoarange_bottom()
    }
 }
 
+static u32 _osd_stats_compute_cache_frame_key(Model* pModel)
+{
+   u32 uKey = render_cache_hash_start();
+   uKey = render_cache_hash(uKey, &(pModel->uVehicleId), sizeof(pModel->uVehicleId));
+   uKey = render_cache_hash(uKey, &(pModel->bDeveloperMode), sizeof(pModel->bDeveloperMode));
+   uKey = render_cache_hash(uKey, &(pModel->osd_params), sizeof(pModel->osd_params));
+   uKey = render_cache_hash(uKey, get_Preferences(), sizeof(Preferences));
+   uKey = render_cache_hash(uKey, get_ControllerSettings(), sizeof(ControllerSettings));
+   uKey = render_cache_hash(uKey, &s_idFontStats, sizeof(s_idFontStats));
+   uKey = render_cache_hash(uKey, &s_idFontStatsSmall, sizeof(s_idFontStatsSmall));
+   uKey = render_cache_hash(uKey, &g_fOSDStatsBgTransparency, sizeof(g_fOSDStatsBgTransparency));
+   uKey = render_cache_hash(uKey, &g_fOSDStatsForcePanelWidth, sizeof(g_fOSDStatsForcePanelWidth));
+   uKey = render_cache_hash(uKey, &s_fOSDVideoDecodeWidthZoom, sizeof(s_fOSDVideoDecodeWidthZoom));
+   return uKey;
+}
+
+// Returns the render cache result for the stats panel at index iIndex
+static int _osd_stats_cache_begin(int iIndex)
+{
+   int iPanelId = s_iOSDStatsBoundingBoxesIds[iIndex];
+   u32 uKey = s_uOSDStatsCacheFrameKey;
+   u32 uMaxAgeMs = OSD_STATS_CACHE_MAX_AGE_MS;
+
+   switch ( iPanelId )
+   {
+      // Video decode panels update the discard snapshots while rendering; keyframe info also draws outside its box
+      case 6:
+      case 11:
+      case 12:
+      case 14:
+         return RENDER_CACHE_DRAW;
+
+      case 7:
+      case 8:
+         uKey = render_cache_hash(uKey, &g_SM_RadioStats.lastComputeTime, sizeof(u32));
+         uKey = render_cache_hash(uKey, &g_SM_RadioStats.lastComputeTimeGraph, sizeof(u32));
+         uKey = render_cache_hash(uKey, &g_SM_RadioStats.countLocalRadioInterfaces, sizeof(int));
+         uKey = render_cache_hash(uKey, &g_SM_RadioStats.countLocalRadioLinks, sizeof(int));
+         break;
+
+      default:
+      {
+         u32 uTimeBucket = g_TimeNow / OSD_STATS_CACHE_REFRESH_MS;
+         uKey = render_cache_hash(uKey, &uTimeBucket, sizeof(u32));
+         break;
+      }
+   }
+
+   t_render_surface surface;
+   if ( ! g_pRenderEngine->getBackBufferSurface(&surface) )
+      return RENDER_CACHE_DRAW;
+
+   int iX = s_iOSDStatsBoundingBoxesX[iIndex] * g_pRenderEngine->getScreenWidth() - OSD_STATS_CACHE_MARGIN_PIXELS;
+   int iY = s_iOSDStatsBoundingBoxesY[iIndex] * g_pRenderEngine->getScreenHeight() - OSD_STATS_CACHE_MARGIN_PIXELS;
+   int iWidth = s_iOSDStatsBoundingBoxesW[iIndex] * g_pRenderEngine->getScreenWidth() + 2*OSD_STATS_CACHE_MARGIN_PIXELS + 1;
+   int iHeight = s_iOSDStatsBoundingBoxesH[iIndex] * g_pRenderEngine->getScreenHeight() + 2*OSD_STATS_CACHE_MARGIN_PIXELS + 1;
+   return render_cache_begin(&surface, iPanelId, iX, iY, iWidth, iHeight, uKey, g_TimeNow, uMaxAgeMs);
+}
+
+static void _osd_stats_cache_end(int iIndex)
+{
+   t_render_surface surface;
+   if ( g_pRenderEngine->getBackBufferSurface(&surface) )
+      render_cache_end(&surface, s_iOSDStatsBoundingBoxesIds[iIndex]);
+}
+
 void osd_render_stats_panels()
 {
    if ( NULL == g_pCurrentModel )
@@ -5070,8 +5149,15 @@ void osd_render_stats_panels()
 
    // Draw
 
+   _osd_stats_update_max_frame_deviations();
+   s_uOSDStatsCacheFrameKey = _osd_stats_compute_cache_frame_key(pModel);
+
    for( int i=0; i<s_iCountOSDStatsBoundingBoxes; i++ )
    {
+      int iCacheResult = _osd_stats_cache_begin(i);
+      if ( RENDER_CACHE_HIT == iCacheResult )
+         continue;
+
       if ( s_iOSDStatsBoundingBoxesIds[i] == 14 )
          osd_render_stats_adaptive_video(s_iOSDStatsBoundingBoxesX[i], s_iOSDStatsBoundingBoxesY[i]);
       
@@ -5140,6 +5226,9 @@ void osd_render_stats_panels()
          osd_render_stats_radio_rx_history(s_iOSDStatsBoundingBoxesX[i], s_iOSDStatsBoundingBoxesY[i], false);
       if ( s_iOSDStatsBoundingBoxesIds[i] == 18 )
          osd_render_stats_radio_rx_history(s_iOSDStatsBoundingBoxesX[i], s_iOSDStatsBoundingBoxesY[i], true);
+
+      if ( RENDER_CACHE_DRAW_AND_CAPTURE == iCacheResult )
+         _osd_stats_cache_end(i);
       
       //char szBuff[32];
       //sprintf(szBuff, "%d", i);
@@ -5147,6 +5236,18 @@ void osd_render_stats_panels()
    }
 
 
+   if ( pModel->bDeveloperMode )
+   if ( g_TimeNow >= s_uOSDStatsCacheLastLogTime + 30000 )
+   {
+      s_uOSDStatsCacheLastLogTime = g_TimeNow;
+      t_render_cache_stats cacheStats;
+      render_cache_get_stats(&cacheStats);
+      u32 uTotal = cacheStats.uCountHits + cacheStats.uCountMisses + cacheStats.uCountBypass;
+      log_line("[OSDStats] Panels render cache: %u hits, %u redraws, %u not cacheable (%u%% hit rate)",
+         cacheStats.uCountHits, cacheStats.uCountMisses, cacheStats.uCountBypass, (uTotal > 0)?(cacheStats.uCountHits*100/uTotal):0);
+      render_cache_reset_stats();
+   }
+
    // Draw the ones that should be on top
 
    for( int i=0; i<s_iCountOSDStatsBoundingBoxes; i++ )
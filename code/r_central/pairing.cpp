@@ -283,6 +283,19 @@ void _pairing_open_shared_mem()
    if ( NULL == g_pSM_RCIn )
       iAnyFailed++;
 
+   ruby_signal_alive();
+   for( int i=0; i<20; i++ )
+   {
+      if ( NULL != g_pSM_Sequences )
+         break;
+      g_pSM_Sequences = shared_mem_sequences_open_for_read();
+      hardware_sleep_ms(5);
+      iAnyNewOpen++;
+   }
+   if ( NULL == g_pSM_Sequences )
+      iAnyFailed++;
+   shared_mem_snapshot_state_reset(&g_SM_SnapshotState);
+
    ruby_signal_alive();
    for( int i=0; i<20; i++ )
    {
@@ -491,6 +504,9 @@ void _pairing_close_shared_mem()
 
    shared_mem_i2c_controller_rc_in_close(g_pSM_RCIn);
    g_pSM_RCIn = NULL;
+
+   shared_mem_sequences_close(g_pSM_Sequences);
+   g_pSM_Sequences = NULL;
 }
 
 bool pairing_isStarted()
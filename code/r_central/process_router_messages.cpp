@@ -778,7 +778,12 @@ int _process_received_message_from_router(u8* pPacketBuffer)
       g_bSwitchingRadioLink = false;
 
       if ( NULL != g_pSM_RadioStats )
-         memcpy((u8*)&g_SM_RadioStats, (u8*)g_pSM_RadioStats, sizeof(shared_mem_radio_stats));
+      {
+         // Force a fresh copy, even if the periodic sync already took this sequence
+         shared_mem_snapshot_state sState;
+         shared_mem_snapshot_state_reset(&sState);
+         shared_mem_snapshot(g_pSM_Sequences, &sState, SHARED_MEM_SEQ_RADIO_STATS, (u8*)&g_SM_RadioStats, (u8*)g_pSM_RadioStats, sizeof(shared_mem_radio_stats));
+      }
 
       log_line("Received response from router to switch to vehicle radio link %d: succeeded: %d", iLink+1, iSucceeded);
       warnings_remove_switching_radio_link(iLink, uFreqKhz, (bool) iSucceeded);
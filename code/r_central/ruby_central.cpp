@@ -1977,16 +1977,17 @@ void synchronize_shared_mems()
    if ( NULL != g_pSM_DownstreamInfoRC )
       memcpy((u8*)&g_SM_DownstreamInfoRC, g_pSM_DownstreamInfoRC, sizeof(t_packet_header_rc_info_downstream));
 
+   shared_mem_snapshot_state* pSS = &g_SM_SnapshotState;
    if ( NULL != g_pSM_RouterVehiclesRuntimeInfo )
-      memcpy((u8*)&g_SM_RouterVehiclesRuntimeInfo, g_pSM_RouterVehiclesRuntimeInfo, sizeof(shared_mem_router_vehicles_runtime_info));
+      shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_ROUTER_VEHICLES_RUNTIME_INFO, &g_SM_RouterVehiclesRuntimeInfo, g_pSM_RouterVehiclesRuntimeInfo, sizeof(shared_mem_router_vehicles_runtime_info));
    if ( NULL != g_pSM_RadioStats )
-      memcpy((u8*)&g_SM_RadioStats, g_pSM_RadioStats, sizeof(shared_mem_radio_stats));
+      shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_RADIO_STATS, &g_SM_RadioStats, g_pSM_RadioStats, sizeof(shared_mem_radio_stats));
 
    if ( NULL != g_pSM_RadioStatsInterfaceRxGraph )
-      memcpy((u8*)&g_SM_RadioStatsInterfaceRxGraph, g_pSM_RadioStatsInterfaceRxGraph, sizeof(shared_mem_radio_stats_interfaces_rx_graph));
+      shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_RADIO_INTERFACES_RX_GRAPHS, &g_SM_RadioStatsInterfaceRxGraph, g_pSM_RadioStatsInterfaceRxGraph, sizeof(shared_mem_radio_stats_interfaces_rx_graph));
    
    if ( NULL != g_pSM_HistoryRxStats )
-      memcpy((u8*)&g_SM_HistoryRxStats, g_pSM_HistoryRxStats, sizeof(shared_mem_radio_stats_rx_hist));
+      shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_RADIO_STATS_RX_HIST, &g_SM_HistoryRxStats, g_pSM_HistoryRxStats, sizeof(shared_mem_radio_stats_rx_hist));
    if ( NULL != g_pSM_AudioDecodeStats )
       memcpy((u8*)&g_SM_AudioDecodeStats, g_pSM_AudioDecodeStats, sizeof(shared_mem_audio_decode_stats));
    
@@ -1995,29 +1996,38 @@ void synchronize_shared_mems()
    {
       if ( NULL != g_pSM_VideoInfoStatsOutput )
       if ( g_TimeNow >= g_SM_VideoInfoStatsOutput.uTimeLastUpdate + 200 )
-         memcpy((u8*)&g_SM_VideoInfoStatsOutput, g_pSM_VideoInfoStatsOutput, sizeof(shared_mem_video_info_stats));
+         shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_VIDEO_INFO_STATS_OUTPUT, &g_SM_VideoInfoStatsOutput, g_pSM_VideoInfoStatsOutput, sizeof(shared_mem_video_info_stats));
       if ( NULL != g_pSM_VideoInfoStatsRadioIn )
       if ( g_TimeNow >= g_SM_VideoInfoStatsRadioIn.uTimeLastUpdate + 200 )
-         memcpy((u8*)&g_SM_VideoInfoStatsRadioIn, g_pSM_VideoInfoStatsRadioIn, sizeof(shared_mem_video_info_stats));
+         shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_VIDEO_INFO_STATS_RADIO_IN, &g_SM_VideoInfoStatsRadioIn, g_pSM_VideoInfoStatsRadioIn, sizeof(shared_mem_video_info_stats));
    }
 
    if ( NULL != g_pSM_VideoDecodeStats )
-      memcpy((u8*)&g_SM_VideoDecodeStats, g_pSM_VideoDecodeStats, sizeof(shared_mem_video_stream_stats_rx_processors));
+      shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_VIDEO_STREAM_STATS, &g_SM_VideoDecodeStats, g_pSM_VideoDecodeStats, sizeof(shared_mem_video_stream_stats_rx_processors));
    if ( NULL != g_pSM_VDS_history )
-      memcpy((u8*)&g_SM_VDS_history, g_pSM_VDS_history, sizeof(shared_mem_video_stream_stats_history_rx_processors));
+      shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_VIDEO_STREAM_STATS_HISTORY, &g_SM_VDS_history, g_pSM_VDS_history, sizeof(shared_mem_video_stream_stats_history_rx_processors));
    if ( NULL != g_pSM_ControllerRetransmissionsStats )
-      memcpy((u8*)&g_SM_ControllerRetransmissionsStats, g_pSM_ControllerRetransmissionsStats, sizeof(shared_mem_controller_retransmissions_stats_rx_processors));
+      shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_VIDEO_RETRANSMISSIONS_STATS, &g_SM_ControllerRetransmissionsStats, g_pSM_ControllerRetransmissionsStats, sizeof(shared_mem_controller_retransmissions_stats_rx_processors));
    if ( NULL != g_pSM_RadioRxQueueInfo )
-      memcpy((u8*)&g_SM_RadioRxQueueInfo, g_pSM_RadioRxQueueInfo, sizeof(shared_mem_radio_rx_queue_info));
+      shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_RADIO_RX_QUEUE_INFO, &g_SM_RadioRxQueueInfo, g_pSM_RadioRxQueueInfo, sizeof(shared_mem_radio_rx_queue_info));
    if ( NULL != g_pSM_VideoLinkStats )
-      memcpy((u8*)&g_SM_VideoLinkStats, g_pSM_VideoLinkStats, sizeof(shared_mem_video_link_stats_and_overwrites));
+      shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_VIDEO_LINK_STATS, &g_SM_VideoLinkStats, g_pSM_VideoLinkStats, sizeof(shared_mem_video_link_stats_and_overwrites));
    if ( NULL != g_pSM_VideoLinkGraphs )
-      memcpy((u8*)&g_SM_VideoLinkGraphs, g_pSM_VideoLinkGraphs, sizeof(shared_mem_video_link_graphs));
+      shared_mem_snapshot(g_pSM_Sequences, pSS, SHARED_MEM_SEQ_VIDEO_LINK_GRAPHS, &g_SM_VideoLinkGraphs, g_pSM_VideoLinkGraphs, sizeof(shared_mem_video_link_graphs));
    if ( NULL != g_pSM_RCIn )
       memcpy((u8*)&g_SM_RCIn, g_pSM_RCIn, sizeof(t_shared_mem_i2c_controller_rc_in));
    if ( NULL != g_pSMVoltage )
       memcpy((u8*)&g_SMVoltage, g_pSMVoltage, sizeof(t_shared_mem_i2c_current));
 
+   static u32 s_uTimeLastLogSnapshotStats = 0;
+   if ( g_TimeNow >= s_uTimeLastLogSnapshotStats + 30000 )
+   {
+      s_uTimeLastLogSnapshotStats = g_TimeNow;
+      if ( (NULL != g_pCurrentModel) && g_pCurrentModel->bDeveloperMode )
+         log_line("[SharedMem] Snapshots: %u copied (%u kb), %u unchanged (%u kb skipped), %u retries, %u torn, sequences %s",
+            pSS->uCountCopied, pSS->uBytesCopied/1024, pSS->uCountUnchanged, pSS->uBytesSkipped/1024,
+            pSS->uCountRetries, pSS->uCountTorn, (NULL != g_pSM_Sequences)?"on":"off");
+   }
 }
 
 void ruby_processing_loop(bool bNoKeys)
@@ -51,6 +51,9 @@ t_packet_header_rc_info_downstream g_SM_DownstreamInfoRC; // RC Info received on
 shared_mem_router_vehicles_runtime_info* g_pSM_RouterVehiclesRuntimeInfo = NULL;
 shared_mem_router_vehicles_runtime_info g_SM_RouterVehiclesRuntimeInfo;
 
+shared_mem_sequences* g_pSM_Sequences = NULL;
+shared_mem_snapshot_state g_SM_SnapshotState;
+
 shared_mem_radio_stats* g_pSM_RadioStats = NULL;
 shared_mem_radio_stats g_SM_RadioStats;
 
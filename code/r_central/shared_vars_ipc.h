@@ -26,6 +26,9 @@ extern t_packet_header_rc_info_downstream g_SM_DownstreamInfoRC;
 extern shared_mem_router_vehicles_runtime_info* g_pSM_RouterVehiclesRuntimeInfo;
 extern shared_mem_router_vehicles_runtime_info g_SM_RouterVehiclesRuntimeInfo;
 
+extern shared_mem_sequences* g_pSM_Sequences;
+extern shared_mem_snapshot_state g_SM_SnapshotState;
+
 extern shared_mem_radio_stats* g_pSM_RadioStats;
 extern shared_mem_radio_stats g_SM_RadioStats;
 
@@ -37,6 +37,9 @@
 #include "../base/ctrl_interfaces.h"
 #include "../base/ctrl_settings.h"
 #include "../base/shared_mem_i2c.h"
+#include "../common/config_watch.h"
+#include "../common/timer_wheel.h"
+#include "../common/event_loop.h"
 #include "ruby_i2c.h"
 
 #include <time.h>
@@ -47,15 +50,34 @@
 #include <math.h>
 
 
+// Each I2C device is read on its own timer, only if it is present; between reads the process waits on the
+// settings watch, so with no I2C devices it only wakes up on settings changes.
+#define I2C_INA_READ_INTERVAL_MS 300
+#define I2C_CONFIG_POLL_INTERVAL_MS 500
+// Settings file and signal file are usually updated together; wait for the writes to settle
+#define I2C_SETTINGS_RELOAD_DELAY_MS 100
+#define I2C_LOOP_MAX_WAIT_MS 1000
+
 bool g_bQuit = false;
 u32 g_TimeNow = 0;
-u32 g_TimeLastReloadCheck = 0;
-u32 g_TimeLastINARead = 0;
-u32 g_TimeLastRCInRead = 0;
 u32 g_TimeLastRCInFrameChange = 0;
 u32 g_TimeLastRCInReadFull = 0;
 
-u32 g_SleepTime = 50;
+u32 g_SleepTime = 50; // Read interval for RC input and rotary encoders/buttons devices
+
+t_timer_wheel s_I2CTimers;
+t_event_loop s_I2CEventLoop;
+t_config_watch s_ConfigWatch;
+int s_iWatchI2CUpdated = -1;
+int s_iWatchI2CDevices = -1;
+int s_iWatchControllerSettings = -1;
+char s_szFileI2CUpdated[128];
+
+int s_iTimerIdINA = -1;
+int s_iTimerIdRCIn = -1;
+int s_iTimerIdInputs = -1;
+int s_iTimerIdDevicesSetup = -1;
+int s_iTimerIdSettingsReload = -1;
 
 bool g_bHasINA = false;
 int g_nINAAddress = 0;
@@ -444,14 +466,6 @@ void load_settings()
 void checkReadINA()
 {
 #ifdef HW_CAPABILITY_I2C
-   if (  g_TimeNow < g_TimeLastINARead )
-      g_TimeLastINARead = g_TimeNow;
-
-   if ( g_TimeNow < g_TimeLastINARead + 300 )
-      return;
-
-   g_TimeLastINARead = g_TimeNow;
-
    if ( 0 < g_nINAFd )
    if ( g_pDeviceInfoINA->uParams[0] == 0 || g_pDeviceInfoINA->uParams[0] == 2 )
    {
@@ -589,14 +603,6 @@ void checkReadRCIn()
    if ( NULL == g_pDeviceInfoRCIn && NULL == g_pDeviceInfoPicoExtender && (g_iHasExternalRCInputDevice==0) )
       return;
 
-   if (  g_TimeNow < g_TimeLastRCInRead )
-      g_TimeLastRCInRead = g_TimeNow;
-
-   if ( g_TimeNow < g_TimeLastRCInRead + g_SleepTime )
-      return;
-
-   g_TimeLastRCInRead = g_TimeNow;
- 
    if ( NULL == g_pSMRCIn )
       return;
 
@@ -912,6 +918,139 @@ void checkReadRotaryEncoderAndButtons()
 #endif
 }
 
+void _i2c_update_device_timers();
+
+void _i2c_reload_devices()
+{
+   close_files();
+   load_settings();
+   _i2c_update_device_timers();
+}
+
+void _i2c_on_timer_ina(void* pContext, u32 uTimeNow)
+{
+   g_TimeNow = uTimeNow;
+   checkReadINA();
+}
+
+void _i2c_on_timer_rc_in(void* pContext, u32 uTimeNow)
+{
+   g_TimeNow = uTimeNow;
+   checkReadRCIn();
+
+   if ( g_iReadRCInConsecutiveFailCount > 10 )
+   {
+      g_iReadRCInConsecutiveFailCount = 0;
+      _i2c_reload_devices();
+   }
+}
+
+void _i2c_on_timer_inputs(void* pContext, u32 uTimeNow)
+{
+   g_TimeNow = uTimeNow;
+   checkReadRotaryEncoderAndButtons();
+}
+
+void _i2c_on_timer_devices_setup(void* pContext, u32 uTimeNow)
+{
+   g_TimeNow = uTimeNow;
+   bool bNewSetup = false;
+   for( int i=0; i<g_nCountExternalDevices; i++ )
+   {
+      if ( g_bListExternalDevicesSetupCorrectly[i] )
+         continue;
+      _setup_external_device(i);
+      if ( g_bListExternalDevicesSetupCorrectly[i] )
+         bNewSetup = true;
+   }
+   if ( ! bNewSetup )
+      return;
+
+   // A late device might need reads that were not scheduled at start (and this timer is removed once all are set up)
+   if ( g_iHasExternalRCInputDevice > 0 )
+   if ( g_SleepTime > 20 )
+      g_SleepTime = 20;
+   _i2c_update_device_timers();
+}
+
+void _i2c_on_timer_settings_reload(void* pContext, u32 uTimeNow)
+{
+   g_TimeNow = uTimeNow;
+   s_iTimerIdSettingsReload = -1;
+
+   log_line("I2C devices settings changed. Reloading settings and setting up devices.");
+   _i2c_reload_devices();
+   if ( access(s_szFileI2CUpdated, R_OK) != -1 )
+      unlink(s_szFileI2CUpdated);
+
+   // Loading the I2C devices settings can save them back; don't reload again for that,
+   // but don't lose a controller settings change that came in meanwhile
+   u32 uChanges = config_watch_get_changes(&s_ConfigWatch);
+   if ( (s_iWatchControllerSettings >= 0) && (uChanges & (((u32)1) << s_iWatchControllerSettings)) )
+   {
+      log_line("Controller settings changed. Reloading them.");
+      load_ControllerSettings();
+   }
+   if ( (s_iWatchI2CUpdated >= 0) && (uChanges & (((u32)1) << s_iWatchI2CUpdated)) )
+      s_iTimerIdSettingsReload = timer_wheel_add(&s_I2CTimers, "settings-reload", I2C_SETTINGS_RELOAD_DELAY_MS, 0, _i2c_on_timer_settings_reload, NULL);
+}
+
+void _i2c_check_settings_changes(u32 uTimeNow)
+{
+   g_TimeNow = uTimeNow;
+   u32 uChanges = config_watch_get_changes(&s_ConfigWatch);
+   if ( (s_iWatchControllerSettings >= 0) && (uChanges & (((u32)1) << s_iWatchControllerSettings)) )
+   {
+      log_line("Controller settings changed. Reloading them.");
+      load_ControllerSettings();
+   }
+   if ( -1 != s_iTimerIdSettingsReload )
+      return;
+   if ( ((s_iWatchI2CUpdated >= 0) && (uChanges & (((u32)1) << s_iWatchI2CUpdated))) ||
+        ((s_iWatchI2CDevices >= 0) && (uChanges & (((u32)1) << s_iWatchI2CDevices))) )
+      s_iTimerIdSettingsReload = timer_wheel_add(&s_I2CTimers, "settings-reload", I2C_SETTINGS_RELOAD_DELAY_MS, 0, _i2c_on_timer_settings_reload, NULL);
+}
+
+void _i2c_on_config_watch_ready(void* pContext, int iFd, u32 uTimeNow)
+{
+   _i2c_check_settings_changes(uTimeNow);
+}
+
+void _i2c_on_timer_config_poll(void* pContext, u32 uTimeNow)
+{
+   _i2c_check_settings_changes(uTimeNow);
+}
+
+void _i2c_update_device_timers()
+{
+   timer_wheel_remove(&s_I2CTimers, s_iTimerIdINA);
+   timer_wheel_remove(&s_I2CTimers, s_iTimerIdRCIn);
+   timer_wheel_remove(&s_I2CTimers, s_iTimerIdInputs);
+   timer_wheel_remove(&s_I2CTimers, s_iTimerIdDevicesSetup);
+   s_iTimerIdINA = -1;
+   s_iTimerIdRCIn = -1;
+   s_iTimerIdInputs = -1;
+   s_iTimerIdDevicesSetup = -1;
+
+   if ( g_bHasINA && (g_nINAFd > 0) )
+      s_iTimerIdINA = timer_wheel_add(&s_I2CTimers, "ina", I2C_INA_READ_INTERVAL_MS, 1, _i2c_on_timer_ina, NULL);
+   if ( (NULL != g_pDeviceInfoRCIn) || (NULL != g_pDeviceInfoPicoExtender) || (g_iHasExternalRCInputDevice > 0) )
+      s_iTimerIdRCIn = timer_wheel_add(&s_I2CTimers, "rc-in", g_SleepTime, 1, _i2c_on_timer_rc_in, NULL);
+   if ( (NULL != g_pDeviceInfoPicoExtender) || g_bHasExternalRotaryDevice )
+      s_iTimerIdInputs = timer_wheel_add(&s_I2CTimers, "inputs", g_SleepTime, 1, _i2c_on_timer_inputs, NULL);
+
+   for( int i=0; i<g_nCountExternalDevices; i++ )
+   {
+      if ( g_bListExternalDevicesSetupCorrectly[i] )
+         continue;
+      s_iTimerIdDevicesSetup = timer_wheel_add(&s_I2CTimers, "devices-setup", g_SleepTime, 1, _i2c_on_timer_devices_setup, NULL);
+      break;
+   }
+
+   log_line("I2C devices reads: INA: %s, RC in: %s, rotary encoders/buttons: %s, read interval: %u ms.",
+      (-1 != s_iTimerIdINA)?"yes":"no", (-1 != s_iTimerIdRCIn)?"yes":"no", (-1 != s_iTimerIdInputs)?"yes":"no", g_SleepTime);
+}
+
 void handle_sigint(int sig) 
 { 
    g_bQuit = true;
@@ -975,50 +1114,33 @@ int main(int argc, char *argv[])
 
    load_settings();
 
-   char szFile[128];
-   strcpy(szFile, FOLDER_RUBY_TEMP);
-   strcat(szFile, FILE_TEMP_I2C_UPDATED);
-
-   g_TimeLastReloadCheck = g_TimeNow = get_current_timestamp_ms();
+   strcpy(s_szFileI2CUpdated, FOLDER_RUBY_TEMP);
+   strcat(s_szFileI2CUpdated, FILE_TEMP_I2C_UPDATED);
 
-   while ( !g_bQuit )
-   {
-      hardware_sleep_ms(g_SleepTime);
-      if ( g_bQuit )
-         break;
+   g_TimeNow = get_current_timestamp_ms();
+   timer_wheel_init(&s_I2CTimers, g_TimeNow);
+   event_loop_init(&s_I2CEventLoop, &s_I2CTimers);
 
-      g_TimeNow = get_current_timestamp_ms();
+   // Settings changes are signaled by the i2c updated file and by the settings files themselves
+   bool bHasInotify = (1 == config_watch_init(&s_ConfigWatch));
+   s_iWatchI2CUpdated = config_watch_add_file(&s_ConfigWatch, FOLDER_RUBY_TEMP, FILE_TEMP_I2C_UPDATED);
+   s_iWatchI2CDevices = config_watch_add_file(&s_ConfigWatch, FOLDER_CONFIG, FILE_CONFIG_HARDWARE_I2C_DEVICES);
+   s_iWatchControllerSettings = config_watch_add_file(&s_ConfigWatch, FOLDER_CONFIG, FILE_CONFIG_CONTROLLER_SETTINGS);
+   if ( bHasInotify )
+      event_loop_add_fd(&s_I2CEventLoop, config_watch_get_fd(&s_ConfigWatch), 0, _i2c_on_config_watch_ready, NULL);
+   else
+      timer_wheel_add(&s_I2CTimers, "config-poll", I2C_CONFIG_POLL_INTERVAL_MS, 1, _i2c_on_timer_config_poll, NULL);
 
-      if (  g_TimeNow >= g_TimeLastReloadCheck+500 )
-      {
-         g_TimeLastReloadCheck = g_TimeNow;
-         if ( access(szFile, R_OK) != -1 )
-         {
-         	  log_line("I2C devices settings changed. Reloading settings and setting up devices.");
-            close_files();
-            load_settings();
-            char szBuff[128];
-            sprintf(szBuff, "rm -rf %s%s 2>/dev/null", FOLDER_RUBY_TEMP, FILE_TEMP_I2C_UPDATED);
-            hw_execute_bash_command_silent(szBuff, NULL);
-         }
-      }
+   if ( access(s_szFileI2CUpdated, R_OK) != -1 )
+      s_iTimerIdSettingsReload = timer_wheel_add(&s_I2CTimers, "settings-reload", I2C_SETTINGS_RELOAD_DELAY_MS, 0, _i2c_on_timer_settings_reload, NULL);
 
-      for( int i=0; i<g_nCountExternalDevices; i++ )
-         if ( ! g_bListExternalDevicesSetupCorrectly[i] )
-            _setup_external_device(i);
-      checkReadINA();
-      checkReadRCIn();
-      checkReadRotaryEncoderAndButtons();
+   _i2c_update_device_timers();
 
-      if ( g_iReadRCInConsecutiveFailCount > 10 )
-      {
-          g_iReadRCInConsecutiveFailCount = 0;
-          close_files();
-          load_settings();            
-      }
-   }
+   while ( !g_bQuit )
+      event_loop_run_once(&s_I2CEventLoop, I2C_LOOP_MAX_WAIT_MS);
 
    close_files();
+   config_watch_close(&s_ConfigWatch);
    shared_mem_i2c_current_close(g_pSMCurrent);
    shared_mem_i2c_controller_rc_in_close(g_pSMRCIn);
    shared_mem_i2c_rotary_encoder_buttons_events_close(g_pSMRotaryEncoderButtonsEvents);
@@ -0,0 +1,343 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <pthread.h>
+#include "frame_feeder.h"
+
+typedef struct
+{
+   u32 uStreamPos;
+   u32 uTimeMicros;
+} t_frame_feeder_write_time;
+
+static t_video_decoder* s_pFeederDecoder = NULL;
+static bool s_bFeederIsH265 = false;
+static bool s_bFeederThreadRunning = false;
+static volatile bool s_bFeederStop = false;
+static pthread_t s_pthFeeder;
+static pthread_mutex_t s_FeederMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_FeederCond = PTHREAD_COND_INITIALIZER;
+
+// Ring buffer positions are stream byte counters (wrap around at 4G), index is position % size
+static u8 s_uFeederRing[FRAME_FEEDER_RING_SIZE];
+static u32 s_uFeederRingWritePos = 0;
+static u32 s_uFeederRingReadPos = 0;
+
+// When each written chunk started, to compute frames PTS
+static t_frame_feeder_write_time s_FeederWriteTimes[FRAME_FEEDER_MAX_WRITE_TIMES];
+static int s_iFeederWriteTimesIndex = 0;
+
+// Consumer side (feeder thread only)
+static u8* s_pFeederFrame = NULL;
+static int s_iFeederFrameLength = 0;
+static int s_iFeederScanPos = 0;
+static bool s_bFeederFrameHasVCL = false;
+static u32 s_uFeederFrameStreamPos = 0;
+
+static t_frame_feeder_stats s_FeederStats;
+
+static u32 _frame_feeder_get_write_time(u32 uStreamPos)
+{
+   u32 uBestDiff = 0xFFFFFFFF;
+   u32 uTime = 0;
+   for( int i=0; i<FRAME_FEEDER_MAX_WRITE_TIMES; i++ )
+   {
+      if ( 0 == s_FeederWriteTimes[i].uTimeMicros )
+         continue;
+      u32 uDiff = uStreamPos - s_FeederWriteTimes[i].uStreamPos;
+      if ( (int)uDiff < 0 )
+         continue;
+      if ( uDiff < uBestDiff )
+      {
+         uBestDiff = uDiff;
+         uTime = s_FeederWriteTimes[i].uTimeMicros;
+      }
+   }
+   if ( 0 == uTime )
+      uTime = get_current_timestamp_micros();
+   return uTime;
+}
+
+static void _frame_feeder_submit(int iLength)
+{
+   if ( iLength <= 0 )
+      return;
+
+   pthread_mutex_lock(&s_FeederMutex);
+   u32 uPTS = _frame_feeder_get_write_time(s_uFeederFrameStreamPos);
+   pthread_mutex_unlock(&s_FeederMutex);
+
+   int iStallMs = s_pFeederDecoder->pfSubmit(s_pFeederFrame, iLength, uPTS);
+   s_FeederStats.uCountFrames++;
+   s_FeederStats.uCountBytes += (u32)iLength;
+   if ( (u32)iStallMs > s_FeederStats.uMaxSubmitStallMs )
+      s_FeederStats.uMaxSubmitStallMs = (u32)iStallMs;
+   if ( (u32)iLength > s_FeederStats.uMaxFrameSize )
+      s_FeederStats.uMaxFrameSize = (u32)iLength;
+   if ( iStallMs > 10 )
+      log_line("[FrameFeeder] Decoder stalled for %d ms on a %d bytes frame.", iStallMs, iLength);
+
+   if ( iLength < s_iFeederFrameLength )
+      memmove(s_pFeederFrame, s_pFeederFrame + iLength, s_iFeederFrameLength - iLength);
+   s_iFeederFrameLength -= iLength;
+   s_iFeederScanPos -= iLength;
+   if ( s_iFeederScanPos < 0 )
+      s_iFeederScanPos = 0;
+   s_uFeederFrameStreamPos += (u32)iLength;
+   s_bFeederFrameHasVCL = false;
+
+   if ( s_pFeederDecoder->pfGetClearStreamChangedFlag() )
+   {
+      // Decoder reinitialized for a new stream format: drop what was buffered meanwhile
+      pthread_mutex_lock(&s_FeederMutex);
+      s_uFeederFrameStreamPos += (u32)s_iFeederFrameLength + (s_uFeederRingWritePos - s_uFeederRingReadPos);
+      s_uFeederRingReadPos = s_uFeederRingWritePos;
+      pthread_mutex_unlock(&s_FeederMutex);
+      s_iFeederFrameLength = 0;
+      s_iFeederScanPos = 0;
+   }
+}
+
+// Returns 1 if the NAL unit starting at pNAL (after the start code) is a VCL unit, sets *pbStartsFrame
+// if it starts a new access unit, given the current one already has a VCL unit.
+static int _frame_feeder_classify_nal(const u8* pNAL, bool* pbStartsFrame)
+{
+   *pbStartsFrame = false;
+   if ( s_bFeederIsH265 )
+   {
+      int iType = (pNAL[0] >> 1) & 0x3F;
+      if ( iType <= 31 )
+      {
+         // first_slice_segment_in_pic_flag
+         *pbStartsFrame = (pNAL[2] & 0x80)?true:false;
+         return 1;
+      }
+      // VPS, SPS, PPS, AUD, prefix SEI, reserved
+      if ( ((iType >= 32) && (iType <= 35)) || (iType == 39) || ((iType >= 41) && (iType <= 44)) || ((iType >= 48) && (iType <= 55)) )
+         *pbStartsFrame = true;
+      return 0;
+   }
+
+   int iType = pNAL[0] & 0x1F;
+   if ( (iType == 1) || (iType == 5) )
+   {
+      // first_mb_in_slice == 0 (ue(v) coded as a single 1 bit)
+      *pbStartsFrame = (pNAL[1] & 0x80)?true:false;
+      return 1;
+   }
+   // SEI, SPS, PPS, AUD, reserved 14..18
+   if ( ((iType >= 6) && (iType <= 9)) || ((iType >= 14) && (iType <= 18)) )
+      *pbStartsFrame = true;
+   return 0;
+}
+
+// Scans the newly added data for NAL start codes and submits each completed frame
+static void _frame_feeder_parse()
+{
+   // Bytes needed after a start code to classify the NAL unit
+   int iLookAhead = s_bFeederIsH265?6:5;
+   int i = s_iFeederScanPos;
+   while ( i + iLookAhead <= s_iFeederFrameLength )
+   {
+      u8* p = s_pFeederFrame;
+      if ( (p[i] != 0) || (p[i+1] != 0) || (p[i+2] != 1) )
+      {
+         // Skip fast over bytes that can not be part of a start code
+         if ( p[i+2] > 1 )
+            i += 3;
+         else
+            i++;
+         continue;
+      }
+      int iNALStart = ((i > 0) && (p[i-1] == 0))?(i-1):i;
+      bool bStartsFrame = false;
+      int iIsVCL = _frame_feeder_classify_nal(&p[i+3], &bStartsFrame);
+      if ( bStartsFrame && s_bFeederFrameHasVCL && (iNALStart > 0) )
+      {
+         _frame_feeder_submit(iNALStart);
+         i -= iNALStart;
+      }
+      if ( iIsVCL )
+         s_bFeederFrameHasVCL = true;
+      i += 3;
+   }
+   s_iFeederScanPos = i;
+}
+
+static void* _thread_frame_feeder(void* pParam)
+{
+   log_line("[FrameFeeder] Thread started.");
+   while ( true )
+   {
+      pthread_mutex_lock(&s_FeederMutex);
+      while ( (s_uFeederRingReadPos == s_uFeederRingWritePos) && (! s_bFeederStop) )
+         pthread_cond_wait(&s_FeederCond, &s_FeederMutex);
+
+      if ( s_uFeederRingReadPos == s_uFeederRingWritePos )
+      {
+         pthread_mutex_unlock(&s_FeederMutex);
+         break;
+      }
+
+      // Move available data to the linear frame buffer
+      int iAvailable = (int)(s_uFeederRingWritePos - s_uFeederRingReadPos);
+      int iFree = FRAME_FEEDER_MAX_FRAME_SIZE - s_iFeederFrameLength;
+      int iCopy = (iAvailable < iFree)?iAvailable:iFree;
+      int iIndex = (int)(s_uFeederRingReadPos % FRAME_FEEDER_RING_SIZE);
+      int iFirst = FRAME_FEEDER_RING_SIZE - iIndex;
+      if ( iFirst > iCopy )
+         iFirst = iCopy;
+      memcpy(s_pFeederFrame + s_iFeederFrameLength, &s_uFeederRing[iIndex], iFirst);
+      if ( iCopy > iFirst )
+         memcpy(s_pFeederFrame + s_iFeederFrameLength + iFirst, &s_uFeederRing[0], iCopy - iFirst);
+      s_uFeederRingReadPos += (u32)iCopy;
+      pthread_mutex_unlock(&s_FeederMutex);
+
+      s_iFeederFrameLength += iCopy;
+      _frame_feeder_parse();
+
+      // No frame boundary in a full frame buffer: submit it as it is
+      if ( s_iFeederFrameLength >= FRAME_FEEDER_MAX_FRAME_SIZE )
+      {
+         s_FeederStats.uCountOversizedFrames++;
+         _frame_feeder_submit(s_iFeederFrameLength);
+      }
+   }
+
+   // Last frame of the stream
+   _frame_feeder_parse();
+   if ( s_iFeederFrameLength > 0 )
+      _frame_feeder_submit(s_iFeederFrameLength);
+   log_line("[FrameFeeder] Thread ended. Submitted %u frames (%u bytes), %u overflows, %u oversized frames.",
+      s_FeederStats.uCountFrames, s_FeederStats.uCountBytes, s_FeederStats.uCountOverflows, s_FeederStats.uCountOversizedFrames);
+   return NULL;
+}
+
+int frame_feeder_init(t_video_decoder* pDecoder, bool bIsH265)
+{
+   if ( NULL == pDecoder )
+      return -1;
+   if ( NULL == s_pFeederFrame )
+      s_pFeederFrame = (u8*) malloc(FRAME_FEEDER_MAX_FRAME_SIZE);
+   if ( NULL == s_pFeederFrame )
+   {
+      log_error_and_alarm("[FrameFeeder] Failed to allocate frame buffer.");
+      return -1;
+   }
+   s_pFeederDecoder = pDecoder;
+   s_bFeederIsH265 = bIsH265;
+   s_bFeederStop = false;
+   s_uFeederRingWritePos = 0;
+   s_uFeederRingReadPos = 0;
+   s_iFeederWriteTimesIndex = 0;
+   memset(s_FeederWriteTimes, 0, sizeof(s_FeederWriteTimes));
+   s_iFeederFrameLength = 0;
+   s_iFeederScanPos = 0;
+   s_bFeederFrameHasVCL = false;
+   s_uFeederFrameStreamPos = 0;
+   memset(&s_FeederStats, 0, sizeof(s_FeederStats));
+   log_line("[FrameFeeder] Init for %s stream, decoder: %s", bIsH265?"H265":"H264", pDecoder->szName);
+   return 0;
+}
+
+int frame_feeder_start()
+{
+   if ( (NULL == s_pFeederDecoder) || s_bFeederThreadRunning )
+      return -1;
+   if ( 0 != pthread_create(&s_pthFeeder, NULL, &_thread_frame_feeder, NULL) )
+   {
+      log_softerror_and_alarm("[FrameFeeder] Failed to create thread.");
+      return -1;
+   }
+   s_bFeederThreadRunning = true;
+   return 0;
+}
+
+void frame_feeder_stop()
+{
+   if ( ! s_bFeederThreadRunning )
+      return;
+   pthread_mutex_lock(&s_FeederMutex);
+   s_bFeederStop = true;
+   pthread_cond_signal(&s_FeederCond);
+   pthread_mutex_unlock(&s_FeederMutex);
+   pthread_join(s_pthFeeder, NULL);
+   s_bFeederThreadRunning = false;
+}
+
+void frame_feeder_write(const u8* pData, int iLength)
+{
+   if ( (NULL == pData) || (iLength <= 0) )
+      return;
+
+   pthread_mutex_lock(&s_FeederMutex);
+   s_FeederStats.uCountWrites++;
+   int iFree = FRAME_FEEDER_RING_SIZE - (int)(s_uFeederRingWritePos - s_uFeederRingReadPos);
+   if ( iLength > iFree )
+   {
+      // Decoder can't keep up: drop the oldest buffered input
+      s_FeederStats.uCountOverflows++;
+      s_uFeederRingReadPos += (u32)(iLength - iFree);
+   }
+   if ( iLength > FRAME_FEEDER_RING_SIZE )
+   {
+      pData += iLength - FRAME_FEEDER_RING_SIZE;
+      s_uFeederRingWritePos += (u32)(iLength - FRAME_FEEDER_RING_SIZE);
+      s_uFeederRingReadPos = s_uFeederRingWritePos;
+      iLength = FRAME_FEEDER_RING_SIZE;
+   }
+
+   s_FeederWriteTimes[s_iFeederWriteTimesIndex].uStreamPos = s_uFeederRingWritePos;
+   s_FeederWriteTimes[s_iFeederWriteTimesIndex].uTimeMicros = get_current_timestamp_micros();
+   s_iFeederWriteTimesIndex = (s_iFeederWriteTimesIndex + 1) % FRAME_FEEDER_MAX_WRITE_TIMES;
+
+   int iIndex = (int)(s_uFeederRingWritePos % FRAME_FEEDER_RING_SIZE);
+   int iFirst = FRAME_FEEDER_RING_SIZE - iIndex;
+   if ( iFirst > iLength )
+      iFirst = iLength;
+   memcpy(&s_uFeederRing[iIndex], pData, iFirst);
+   if ( iLength > iFirst )
+      memcpy(&s_uFeederRing[0], pData + iFirst, iLength - iFirst);
+   s_uFeederRingWritePos += (u32)iLength;
+
+   pthread_cond_signal(&s_FeederCond);
+   pthread_mutex_unlock(&s_FeederMutex);
+}
+
+void frame_feeder_get_stats(t_frame_feeder_stats* pStats)
+{
+   if ( NULL == pStats )
+      return;
+   pthread_mutex_lock(&s_FeederMutex);
+   memcpy(pStats, &s_FeederStats, sizeof(t_frame_feeder_stats));
+   pthread_mutex_unlock(&s_FeederMutex);
+}
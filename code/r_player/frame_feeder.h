@@ -0,0 +1,31 @@
+#pragma once
+#include "../base/base.h"
+#include "video_decoder.h"
+
+// Collects the raw H264/H265 stream written by the input thread and submits it to the video decoder
+// from its own thread, as whole access units (frames). The feeder thread sleeps on a condition variable
+// and wakes up as soon as data is written. A frame is submitted as soon as the start of the next one is received.
+// Each frame PTS is the time (micros) its first byte was written to the feeder.
+
+#define FRAME_FEEDER_RING_SIZE 400000
+#define FRAME_FEEDER_MAX_FRAME_SIZE (1024*1024)
+#define FRAME_FEEDER_MAX_WRITE_TIMES 256
+
+typedef struct
+{
+   u32 uCountWrites;
+   u32 uCountFrames;
+   u32 uCountBytes;
+   u32 uCountOverflows; // input data dropped because the ring buffer was full
+   u32 uCountOversizedFrames; // frames submitted in parts as they did not fit the frame buffer
+   u32 uMaxSubmitStallMs;
+   u32 uMaxFrameSize;
+} t_frame_feeder_stats;
+
+int frame_feeder_init(t_video_decoder* pDecoder, bool bIsH265);
+int frame_feeder_start();
+// Stops the feeder thread; any pending frame is submitted first
+void frame_feeder_stop();
+
+void frame_feeder_write(const u8* pData, int iLength);
+void frame_feeder_get_stats(t_frame_feeder_stats* pStats);
@@ -33,6 +33,7 @@
 
 #define READ_VIDEO_BUF_SIZE (1024*1024) // SZ_1M https://github.com/rockchip-linux/mpp/blob/ed377c99a733e2cdbcc457a6aa3f0fcd438a9dff/osal/inc/mpp_common.h#L179
 #define MAX_VIDEO_FRAMES 24  // min 16 and 20+ recommended (mpp/readme.txt)
+#define MPP_INPUT_TIMEOUT_MS 200
 #define CODEC_ALIGN(x, a)   (((x)+(a)-1)&~((a)-1))
 
 typedef struct
@@ -73,6 +74,31 @@ int _mpp_send_command(MpiCmd command, RK_U32 value)
 }
 
 
+// Whole frames: decode_put_packet blocks (up to MPP_INPUT_TIMEOUT_MS) until the decoder has room for it
+int mpp_feed_frame_to_decoder(void* pData, int iLength, u32 uPTSMicros)
+{
+   mpp_packet_set_data(g_MPPInputPacket, pData);
+   mpp_packet_set_size(g_MPPInputPacket, iLength);
+   mpp_packet_set_pos(g_MPPInputPacket, pData);
+   mpp_packet_set_length(g_MPPInputPacket, iLength);
+   mpp_packet_set_pts(g_MPPInputPacket, (RK_S64) uPTSMicros);
+
+   u32 uTimeStart = get_current_timestamp_ms();
+   int iRetries = 0;
+   while ( (!g_bQuit) && (MPP_OK != g_pMPPApi->decode_put_packet(g_MPPCtx, g_MPPInputPacket)) )
+   {
+      iRetries++;
+      if ( get_current_timestamp_ms() > uTimeStart + MPP_INPUT_TIMEOUT_MS )
+      {
+         log_softerror_and_alarm("[MPP] Failed to feed frame (%d bytes) to MPP decoder, stalled for %u ms, retries: %d", iLength, get_current_timestamp_ms() - uTimeStart, iRetries);
+         break;
+      }
+      // Only reached if the decoder returned right away instead of blocking
+      hardware_sleep_micros(500);
+   }
+   return (int)(get_current_timestamp_ms() - uTimeStart);
+}
+
 int mpp_feed_data_to_decoder(void* pData, int iLength)
 {
     mpp_packet_set_data(g_MPPInputPacket, pData);
@@ -338,9 +364,9 @@ int mpp_start_decoding_thread()
 }
 
 
-int mpp_init(bool bUseH265Decoder)
+int mpp_init(bool bUseH265Decoder, bool bFrameAlignedInput)
 {
-   log_line("[MPP] Doing MPP Initialization (for codec %s)...", (bUseH265Decoder?"H265":"H264"));
+   log_line("[MPP] Doing MPP Initialization (for codec %s, %s input)...", (bUseH265Decoder?"H265":"H264"), (bFrameAlignedInput?"frame aligned":"raw stream"));
    g_MPPDecodeType = MPP_VIDEO_CodingAVC;
    if ( bUseH265Decoder )
       g_MPPDecodeType = MPP_VIDEO_CodingHEVC;
@@ -391,7 +417,8 @@ int mpp_init(bool bUseH265Decoder)
       return -4;
    }
 
-   RK_U32 split_video_input = 1;
+   // Frame aligned input is already split in whole frames, so the parser does not have to wait for the next frame start
+   RK_U32 split_video_input = bFrameAlignedInput?0:1;
    iRes = mpp_dec_cfg_set_u32(pMPPConfig, "base:split_parse", split_video_input);
    if ( iRes )
    {
@@ -405,12 +432,20 @@ int mpp_init(bool bUseH265Decoder)
       return -6;
    }
 
-   _mpp_send_command(MPP_DEC_SET_PARSER_SPLIT_MODE, 0xffff);
+   if ( ! bFrameAlignedInput )
+      _mpp_send_command(MPP_DEC_SET_PARSER_SPLIT_MODE, 0xffff);
    _mpp_send_command(MPP_DEC_SET_DISABLE_ERROR, 0xffff);
    _mpp_send_command(MPP_DEC_SET_IMMEDIATE_OUT, 0xffff);
    _mpp_send_command(MPP_DEC_SET_ENABLE_FAST_PLAY, 0xffff);
    _mpp_send_command(MPP_SET_OUTPUT_BLOCK, MPP_POLL_BLOCK);
 
+   if ( bFrameAlignedInput )
+   {
+      RK_S64 iInputTimeout = MPP_INPUT_TIMEOUT_MS;
+      if ( g_pMPPApi->control(g_MPPCtx, MPP_SET_INPUT_TIMEOUT, &iInputTimeout) )
+         log_softerror_and_alarm("[MPP] Failed to set blocking input timeout.");
+   }
+
    // Use faster parallel hardware decoding? false for now
    int iFastDec = 1;
    _mpp_send_command(MPP_DEC_SET_PARSER_FAST_MODE, iFastDec);
@@ -66,6 +66,8 @@
 #include "../renderer/drm_core.h"
 #include "../renderer/render_engine_cairo.h"
 #include "mpp_core.h"
+#include "video_decoder.h"
+#include "frame_feeder.h"
 
 
 bool g_bQuit = false;
@@ -82,10 +84,7 @@ int g_iCustomWidth = 0;
 int g_iCustomHeight = 0;
 int g_iCustomRefresh = 0;
 
-#define PIPE_BUFFER_SIZE 400000
-u8 g_uPipeBuffer[PIPE_BUFFER_SIZE];
-int g_iPipeBufferWritePos = 0;
-int g_iPipeBufferReadPos = 0;
+#define PIPE_READ_SIZE 4096
 
 void _do_test_mode()
 {
@@ -158,7 +157,7 @@ void _do_test_mode()
 
 void _do_player_mode()
 {
-   if ( mpp_init(g_bUseH265Decoder) != 0 )
+   if ( mpp_init(g_bUseH265Decoder, false) != 0 )
       return;
 
    hdmi_enum_modes();
@@ -235,55 +234,17 @@ void _do_player_mode()
    mpp_uninit();
 }
 
-void* _thread_consume_pipe_buffer(void *param)
-{
-   log_line("[Thread] Created pipe consume thread.");
-
-   FILE* fpTmp = NULL;
-   //fpTmp = fopen("rec2.h264", "wb");
-
-   while ( ! g_bQuit )
-   {
-      if ( g_iPipeBufferReadPos == g_iPipeBufferWritePos )
-      {
-         //log_line("[Thread] Wait data (pos %d)...", g_iPipeBufferReadPos);
-         hardware_sleep_ms(5);
-         continue;
-      }
-      int iSize = g_iPipeBufferWritePos - g_iPipeBufferReadPos;
-      if ( g_iPipeBufferWritePos < g_iPipeBufferReadPos )
-         iSize = PIPE_BUFFER_SIZE - g_iPipeBufferReadPos;
-
-      if ( iSize > 1024 )
-         iSize = 1024;
-      //log_line("[Thread] Consume %d", iSize);
-
-      if ( NULL != fpTmp )
-         fwrite( &(g_uPipeBuffer[g_iPipeBufferReadPos]), 1, iSize, fpTmp);
-
-      int iRes = mpp_feed_data_to_decoder(&(g_uPipeBuffer[g_iPipeBufferReadPos]), iSize);
-      if ( iRes > 10 )
-         log_line("[Thread] Stalled consuming %d bytes at pos %d (write pos: %d), stall for %d ms", iSize, g_iPipeBufferReadPos, g_iPipeBufferWritePos, iRes);
-      
-      if ( mpp_get_clear_stream_changed_flag() )
-         g_iPipeBufferReadPos = g_iPipeBufferWritePos;
-      else
-      {
-         g_iPipeBufferReadPos += iSize;
-         if ( g_iPipeBufferReadPos >= PIPE_BUFFER_SIZE )
-            g_iPipeBufferReadPos = 0;
-      }
-   }
-   if ( NULL != fpTmp )
-      fclose(fpTmp);
-   log_line("[Thread] Ended pipe consume thread.");
-   return NULL;
-}
-
 void _do_stream_mode_pipe()
 {
-   if ( mpp_init(g_bUseH265Decoder) != 0 )
+   // Input from pipe is split in whole frames by the frame feeder, on its own thread, as soon as it's read
+   t_video_decoder* pDecoder = video_decoder_get_mpp();
+   if ( pDecoder->pfInit(g_bUseH265Decoder, true) != 0 )
       return;
+   if ( frame_feeder_init(pDecoder, g_bUseH265Decoder) != 0 )
+   {
+      pDecoder->pfUninit();
+      return;
+   }
 
    hdmi_enum_modes();
    int iHDMIIndex = hdmi_load_current_mode();
@@ -294,22 +255,19 @@ void _do_stream_mode_pipe()
 
    hw_increase_current_thread_priority("RubyPlayer", 50);
 
-   pthread_t pDecodeThread;
-   pthread_create(&pDecodeThread, NULL, _thread_consume_pipe_buffer, NULL);
-
-   log_line("Created thread to consume pipe input buffer");
-
    int readfd = open(FIFO_RUBY_STATION_VIDEO_STREAM, O_RDONLY);// | O_NONBLOCK);
    if( -1 == readfd )
    {
       log_error_and_alarm("Failed to open video stream fifo.");
       ruby_drm_core_uninit();
-      mpp_uninit();
+      pDecoder->pfUninit();
       return;
    }
 
    log_line("Opened input video stream fifo (%s)", FIFO_RUBY_STATION_VIDEO_STREAM);
-   mpp_start_decoding_thread();
+   pDecoder->pfStart();
+   frame_feeder_start();
+   log_line("Started frame feeder thread.");
 
    FILE* fpTmp = NULL;
    //fpTmp = fopen("rec.h264", "wb");
@@ -322,6 +280,7 @@ void _do_stream_mode_pipe()
    int iTotalRead = 0;
    bool bAnyInputEver = false;
    fd_set readset;
+   u8 uReadBuffer[PIPE_READ_SIZE];
 
    while ( !g_bQuit )
    {
@@ -344,12 +303,7 @@ void _do_stream_mode_pipe()
       }
       iCount++;
 
-      int iSizeToRead = 4096;
-      if ( g_iPipeBufferWritePos + iSizeToRead > PIPE_BUFFER_SIZE )
-      {
-         iSizeToRead = PIPE_BUFFER_SIZE - g_iPipeBufferWritePos;
-      }
-      nRead = read(readfd, &(g_uPipeBuffer[g_iPipeBufferWritePos]), iSizeToRead); 
+      nRead = read(readfd, uReadBuffer, PIPE_READ_SIZE);
       if ( nRead <= 0 )
       {
          if ( ! bAnyInputEver )
@@ -372,8 +326,7 @@ void _do_stream_mode_pipe()
          u32 uTimeNow = get_current_timestamp_ms();
          if ( (uTimeNow > uTimeLastReadFailedLog + 200) || (nReadFailedCounter > 50) )
          {
-            log_line("No read data. Failed counter: %d. Continue, write pos: %d, write size: %d",
-               nReadFailedCounter, g_iPipeBufferWritePos, iSizeToRead);
+            log_line("No read data. Failed counter: %d. Continue.", nReadFailedCounter);
             nReadFailedCounter = 0;
             uTimeLastReadFailedLog = uTimeNow;
          }
@@ -388,12 +341,9 @@ void _do_stream_mode_pipe()
       }
       
       if ( NULL != fpTmp )
-         fwrite( &(g_uPipeBuffer[g_iPipeBufferWritePos]), 1, nRead, fpTmp);
+         fwrite(uReadBuffer, 1, nRead, fpTmp);
 
-      int iNewWritePos = g_iPipeBufferWritePos + nRead;
-      if ( iNewWritePos >= PIPE_BUFFER_SIZE )
-         iNewWritePos = 0;
-      g_iPipeBufferWritePos = iNewWritePos;
+      frame_feeder_write(uReadBuffer, nRead);
       
       iTotalRead += nRead;
       if ( (iCount % 10) == 0 )
@@ -402,7 +352,10 @@ void _do_stream_mode_pipe()
          if ( uTime > uTimeLastCheck + 4000 )
          {
             uTimeLastCheck = uTime;
-            log_line("Video player alive, reading %d bytes/sec", iTotalRead/4);
+            t_frame_feeder_stats feederStats;
+            frame_feeder_get_stats(&feederStats);
+            log_line("Video player alive, reading %d bytes/sec, frames submitted: %u, max frame: %u bytes, max decoder stall: %u ms, overflows: %u",
+               iTotalRead/4, feederStats.uCountFrames, feederStats.uMaxFrameSize, feederStats.uMaxSubmitStallMs, feederStats.uCountOverflows);
             iTotalRead = 0;
          }
       }
@@ -416,20 +369,20 @@ void _do_stream_mode_pipe()
 
    close(readfd);
 
-   log_line("Ending thread to consume pipe input buffer...");
-   pthread_join(pDecodeThread, NULL );
-   log_line("Ended thread to consume pipe input buffer");
+   log_line("Stopping frame feeder thread...");
+   frame_feeder_stop();
+   log_line("Stopped frame feeder thread.");
 
-   mpp_mark_end_of_stream();
+   pDecoder->pfMarkEndOfStream();
 
    ruby_drm_core_uninit();
-   mpp_uninit();
+   pDecoder->pfUninit();
 }
 
 
 void _do_stream_mode_udp()
 {
-   if ( mpp_init(g_bUseH265Decoder) != 0 )
+   if ( mpp_init(g_bUseH265Decoder, false) != 0 )
       return;
 
    hdmi_enum_modes();
@@ -0,0 +1,28 @@
+#pragma once
+#include "../base/base.h"
+
+// Video decoder interface used by the player input feeders.
+// Implementations: MPP hardware decoder (Radxa) and a null software decoder
+// (accepts and discards frames) used to measure the input path on boxes without a video decoder.
+
+typedef void (*video_decoder_submit_callback)(const u8* pData, int iLength, u32 uPTSMicros, u32 uTimeSubmitMicros);
+
+typedef struct
+{
+   const char* szName;
+   // bFrameAlignedInput: input is submitted as whole access units (frames), decoder does not need to split it
+   int (*pfInit)(bool bUseH265Decoder, bool bFrameAlignedInput);
+   int (*pfStart)();
+   // Submits one access unit (or a raw stream slice, if not frame aligned). uPTSMicros: receive time of the data.
+   // Returns the time (ms) it had to wait for the decoder to accept the data.
+   int (*pfSubmit)(u8* pData, int iLength, u32 uPTSMicros);
+   int (*pfMarkEndOfStream)();
+   int (*pfUninit)();
+   bool (*pfGetClearStreamChangedFlag)();
+} t_video_decoder;
+
+t_video_decoder* video_decoder_get_null();
+void video_decoder_null_set_submit_callback(video_decoder_submit_callback pCallback);
+#ifdef HW_PLATFORM_RADXA_ZERO3
+t_video_decoder* video_decoder_get_mpp();
+#endif
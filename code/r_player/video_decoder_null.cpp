@@ -0,0 +1,98 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "video_decoder.h"
+
+// Software null decoder: accepts every frame right away and only keeps counters.
+
+static video_decoder_submit_callback s_pNullDecoderCallback = NULL;
+static u32 s_uNullDecoderCountSubmits = 0;
+static u32 s_uNullDecoderCountBytes = 0;
+
+static int _video_decoder_null_init(bool bUseH265Decoder, bool bFrameAlignedInput)
+{
+   s_uNullDecoderCountSubmits = 0;
+   s_uNullDecoderCountBytes = 0;
+   log_line("[NullDecoder] Init (%s, %s input)", bUseH265Decoder?"H265":"H264", bFrameAlignedInput?"frame aligned":"raw");
+   return 0;
+}
+
+static int _video_decoder_null_start()
+{
+   return 0;
+}
+
+static int _video_decoder_null_submit(u8* pData, int iLength, u32 uPTSMicros)
+{
+   s_uNullDecoderCountSubmits++;
+   s_uNullDecoderCountBytes += (u32)iLength;
+   if ( NULL != s_pNullDecoderCallback )
+      s_pNullDecoderCallback(pData, iLength, uPTSMicros, get_current_timestamp_micros());
+   return 0;
+}
+
+static int _video_decoder_null_mark_end_of_stream()
+{
+   log_line("[NullDecoder] End of stream after %u submits, %u bytes.", s_uNullDecoderCountSubmits, s_uNullDecoderCountBytes);
+   return 0;
+}
+
+static int _video_decoder_null_uninit()
+{
+   return 0;
+}
+
+static bool _video_decoder_null_get_clear_stream_changed_flag()
+{
+   return false;
+}
+
+static t_video_decoder s_VideoDecoderNull =
+{
+   "null",
+   _video_decoder_null_init,
+   _video_decoder_null_start,
+   _video_decoder_null_submit,
+   _video_decoder_null_mark_end_of_stream,
+   _video_decoder_null_uninit,
+   _video_decoder_null_get_clear_stream_changed_flag
+};
+
+t_video_decoder* video_decoder_get_null()
+{
+   return &s_VideoDecoderNull;
+}
+
+void video_decoder_null_set_submit_callback(video_decoder_submit_callback pCallback)
+{
+   s_pNullDecoderCallback = pCallback;
+}
@@ -1151,12 +1151,6 @@ int main(int argc, char *argv[])
    log_line("Running on OpenIPC hardware");
 #endif
 
-#ifdef FEATURE_CONCATENATE_SMALL_RADIO_PACKETS
-   log_line("Feature to concatenate small radio packets is: On.");
-#else
-   log_line("Feature to concatenate small radio packets is: Off.");
-#endif
-
 #ifdef FEATURE_LOCAL_AUDIO_RECORDING
    log_line("Feature local audio recording is: On.");
 #else
@@ -236,18 +236,9 @@ int compute_packet_uplink_datarate(int iVehicleRadioLink, int iRadioInterface, t
       return nRateTx;
 
    int nVideoProfile = -1;
-   for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
-   {
-      if ( NULL == g_pVideoProcessorRxList[i] )
-         break;
-      if ( NULL == g_pCurrentModel )
-         break;
-      if ( g_pVideoProcessorRxList[i]->m_uVehicleId != g_pCurrentModel->uVehicleId )
-         continue;
-
-      nVideoProfile = g_pVideoProcessorRxList[i]->getCurrentlyReceivedVideoProfile();
-      break;
-   }   
+   ProcessorRxVideo* pProcessorVideo = ProcessorRxVideo::getOutputVideoProcessorForVehicleId(g_pCurrentModel->uVehicleId);
+   if ( NULL != pProcessorVideo )
+      nVideoProfile = pProcessorVideo->getCurrentlyReceivedVideoProfile();
    
    switch ( pRadioLinksParams->uUplinkDataDataRateType[iVehicleRadioLink] )
    {
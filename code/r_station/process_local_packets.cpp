@@ -147,7 +147,7 @@ bool _switch_to_vehicle_radio_link(int iVehicleRadioLinkId)
    // Update the radio state to reflect the new assigned radio links to local radio interfaces
 
    if ( NULL != g_pSM_RadioStats )
-      memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
    return true;
 }
 
@@ -291,7 +291,7 @@ void _process_local_notification_model_changed(t_packet_header* pPH, u8 uChangeT
 
       // Update the radio state to reflect the new radio links
       if ( NULL != g_pSM_RadioStats )
-         memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+         shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
    
       return;
    }
@@ -396,7 +396,9 @@ void _process_local_notification_model_changed(t_packet_header* pPH, u8 uChangeT
                log_line("Removed runtime info at index %d", iIndex);
                bRuntimeFound = true;
             }
-            for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
+            // Remove the video processors of all the video streams of the relayed vehicle
+            int i = 0;
+            while ( i<MAX_VIDEO_PROCESSORS )
             {
                if ( g_pVideoProcessorRxList[i] != NULL )
                if ( g_pVideoProcessorRxList[i]->m_uVehicleId == oldRelayParams.uRelayedVehicleId )
@@ -406,10 +408,12 @@ void _process_local_notification_model_changed(t_packet_header* pPH, u8 uChangeT
                   g_pVideoProcessorRxList[i] = NULL;
                   for( int k=i; k<MAX_VIDEO_PROCESSORS-1; k++ )
                      g_pVideoProcessorRxList[k] = g_pVideoProcessorRxList[k+1];
+                  g_pVideoProcessorRxList[MAX_VIDEO_PROCESSORS-1] = NULL;
                   log_line("Removed video processor at index %d", i);
                   bProcessorFound = true;
-                  break;
+                  continue;
                }
+               i++;
             }
 
             if ( ! bRuntimeFound )
@@ -833,7 +837,7 @@ void process_local_control_packet(t_packet_header* pPH)
       }
 
       if ( NULL != g_pSM_RadioStats )
-         memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+         shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
 
       if ( g_pCurrentModel->hasCamera() )
          rx_video_output_on_controller_settings_changed();
@@ -56,6 +56,7 @@
 #include "test_link_params.h"
 #include "shared_vars.h"
 #include "timers.h"
+#include "video_link_keyframe.h"
 
 #define MAX_PACKETS_IN_ID_HISTORY 6
 
@@ -643,6 +644,13 @@ int _process_received_video_data_packet(int iInterfaceIndex, u8* pPacket, int iP
       pExtraDataU32[5] = get_current_timestamp_ms();
    }
 
+   if ( ! (pPH->packet_flags & PACKET_FLAGS_BIT_RETRANSMITED) )
+   {
+      t_packet_video_latency_trace* pTrace = radio_packet_get_video_latency_trace(pPacket);
+      if ( (NULL != pTrace) && (0 != pTrace->uControllerTimeRxMicros) )
+         pTrace->uDeltaProcessed = radio_packet_latency_trace_delta(pTrace->uControllerTimeRxMicros, get_current_timestamp_micros());
+   }
+
    int nRet = 0;
 
    if ( bIsRelayedPacket )
@@ -1048,12 +1056,12 @@ int process_received_single_radio_packet(int interfaceIndex, u8* pData, int leng
       if ( pPH->packet_type == PACKET_TYPE_RUBY_TELEMETRY_VIDEO_LINK_DEV_STATS )
       if ( NULL != g_pSM_VideoLinkStats )
       if ( pPH->total_length == sizeof(t_packet_header) + sizeof(shared_mem_video_link_stats_and_overwrites) )
-         memcpy(g_pSM_VideoLinkStats, pData+sizeof(t_packet_header), sizeof(shared_mem_video_link_stats_and_overwrites) );
+         shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_VIDEO_LINK_STATS, g_pSM_VideoLinkStats, pData+sizeof(t_packet_header), sizeof(shared_mem_video_link_stats_and_overwrites));
 
       if ( pPH->packet_type == PACKET_TYPE_RUBY_TELEMETRY_VIDEO_LINK_DEV_GRAPHS )
       if ( NULL != g_pSM_VideoLinkGraphs )
       if ( pPH->total_length == sizeof(t_packet_header) + sizeof(shared_mem_video_link_graphs) )
-         memcpy(g_pSM_VideoLinkGraphs, pData+sizeof(t_packet_header), sizeof(shared_mem_video_link_graphs) );
+         shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_VIDEO_LINK_GRAPHS, g_pSM_VideoLinkGraphs, pData+sizeof(t_packet_header), sizeof(shared_mem_video_link_graphs));
 
       if ( NULL != g_pProcessStats )
          g_pProcessStats->lastIPCOutgoingTime = g_TimeNow;
@@ -1135,6 +1143,16 @@ int process_received_single_radio_packet(int interfaceIndex, u8* pData, int leng
          return 0;
       }
 
+      if ( pPH->packet_type == PACKET_TYPE_VIDEO_REQUEST_KEYFRAME_ACK )
+      {
+         if ( pPH->total_length < sizeof(t_packet_header) + sizeof(u32) )
+            return 0;
+         u32 uRequestId = 0;
+         memcpy((u8*)&uRequestId, pData + sizeof(t_packet_header), sizeof(u32));
+         video_link_keyframe_on_request_ack(uVehicleId, uRequestId);
+         return 0;
+      }
+
       if ( pPH->packet_type != PACKET_TYPE_VIDEO_DATA_FULL )
       {
          //log_line("Received unknown video packet type.");
@@ -37,34 +37,26 @@
 #include "../radio/radiopackets2.h"
 #include "../radio/radiolink.h"
 #include "../radio/radiopacketsqueue.h"
-#include "../radio/fec.h" 
+#include "../common/audio_rx_jitter.h"
 #include "packets_utils.h"
 
 #include "shared_vars.h"
 #include "timers.h"
 
+// aplay -c 1 --rate 44100 --format S16_LE
+#define AUDIO_OUTPUT_BYTES_PER_SECOND (44100*2)
+#define AUDIO_PLAYER_RESTART_INTERVAL_MS 2000
+
 bool s_bHasAudioOutputDevice = false;
 int s_fPipeAudio = -1;
+bool s_bAudioPlayerEnabled = false;
+u32 s_uTimeLastAudioPlayerStart = 0;
+u32 s_uAudioSinkDroppedBytes = 0;
+u32 s_uAudioSinkRestarts = 0;
 
-u32 s_uCurrentRxAudioBlockIndex = MAX_U32;
-
-u32 s_AudioPacketsPerBlock = 0;
-u32 s_AudioFECPerBlock = 0;
-u32 s_AudioPacketSize = 0;
-
-u8 s_BufferAudioPackets[MAX_BUFFERED_AUDIO_PACKETS][MAX_PACKET_PAYLOAD];
-bool s_BufferAudioPacketsReceived[MAX_BUFFERED_AUDIO_PACKETS];
-u32 s_uReceivedDataPacketsForCurrentBlock = 0;
-u32 s_uReceivedECPacketsForCurrentBlock = 0;
-
-u32 s_uLastOutputedBlockIndex = MAX_U32;
-u32 s_uLastOutputedPacketIndex = MAX_U32;
-
-unsigned int fec_decode_audio_missing_packets[MAX_TOTAL_PACKETS_IN_BLOCK];
-unsigned int fec_decode_audio_fec_indexes[MAX_TOTAL_PACKETS_IN_BLOCK];
-u8* fec_decode_audio_data_packets[MAX_TOTAL_PACKETS_IN_BLOCK];
-u8* fec_decode_audio_fec_packets[MAX_TOTAL_PACKETS_IN_BLOCK];
-unsigned int missing_audio_packets_count_for_fec = 0;
+static t_audio_rx_jitter s_AudioRxJitter;
+u32 s_uTimeLastAudioRxStatsLog = 0;
+u32 s_uLastLoggedConcealedPackets = 0;
 
 int s_iAudioRecordingSegment = 0;
 FILE* s_pFileAudioRecording = NULL;
@@ -75,16 +67,16 @@ FILE* s_pFileRawStream = NULL;
 
 void _stop_audio_player_and_pipe()
 {
+   if ( -1 != s_fPipeAudio )
+      close(s_fPipeAudio);
+   s_fPipeAudio = -1;
+
    if ( (NULL == g_pCurrentModel) || (! g_pCurrentModel->audio_params.has_audio_device) )
    {
       log_line("[AudioRx] No audio capture device on current vehicle, nothing to stop.");
       return;
    }
 
-   if ( -1 != s_fPipeAudio )
-      close(s_fPipeAudio);
-   s_fPipeAudio = -1;
-
    char szComm[256];
    char szOutput[128];
 
@@ -116,6 +108,9 @@ void _start_audio_player_and_pipe()
       return;
    }
 
+   s_bAudioPlayerEnabled = true;
+   s_uTimeLastAudioPlayerStart = get_current_timestamp_ms();
+
    char szComm[128];
    sprintf(szComm, "aplay -c 1 --rate 44100 --format S16_LE %s 2>/dev/null &", FIFO_RUBY_AUDIO1);
    hw_execute_bash_command(szComm, NULL);
@@ -127,37 +122,61 @@ void _start_audio_player_and_pipe()
       log_error_and_alarm("[AudioRx] Failed to open audio pipe write endpoint: %s",FIFO_RUBY_AUDIO1);
       return;
    }
+   // The player keeps running for the whole session: never block the router on it, drop audio if it falls behind
+   fcntl(s_fPipeAudio, F_SETFL, fcntl(s_fPipeAudio, F_GETFL) | O_NONBLOCK);
    log_line("[AudioRx] Opened successfully audio pipe write endpoint: %s", FIFO_RUBY_AUDIO1);
 }
 
-void _reset_current_audio_rx_block()
+void _write_to_audio_sink(const u8* pData, int iLength)
 {
-   for( int i=0; i<MAX_BUFFERED_AUDIO_PACKETS; i++ )
-      s_BufferAudioPacketsReceived[i] = false;
-   s_uReceivedDataPacketsForCurrentBlock = 0;
-   s_uReceivedECPacketsForCurrentBlock = 0;
+   if ( iLength <= 0 )
+      return;
+
+   // Only restarted if the player process went away
+   if ( (-1 == s_fPipeAudio) && s_bAudioPlayerEnabled )
+   if ( get_current_timestamp_ms() >= s_uTimeLastAudioPlayerStart + AUDIO_PLAYER_RESTART_INTERVAL_MS )
+   {
+      log_softerror_and_alarm("[AudioRx] Audio player is not running. Restarting it.");
+      s_uAudioSinkRestarts++;
+      _stop_audio_player_and_pipe();
+      _start_audio_player_and_pipe();
+   }
+   if ( -1 == s_fPipeAudio )
+      return;
+
+   int iRes = write(s_fPipeAudio, pData, iLength);
+   if ( iRes == iLength )
+      return;
+   if ( iRes >= 0 )
+   {
+      s_uAudioSinkDroppedBytes += (u32)(iLength - iRes);
+      return;
+   }
+   if ( (errno == EAGAIN) || (errno == EWOULDBLOCK) )
+   {
+      s_uAudioSinkDroppedBytes += (u32)iLength;
+      return;
+   }
+   log_softerror_and_alarm("[AudioRx] Failed to write to audio player pipe, error: %d (%s)", errno, strerror(errno));
+   close(s_fPipeAudio);
+   s_fPipeAudio = -1;
 }
 
-void _output_audio_block(u32 uBlockIndex, u32 uPacketIndex, u32 uAudioSize)
+// Called by the jitter buffer with the audio to play, in order
+void _on_audio_rx_output(void* pContext, const u8* pData, int iLength)
 {
-   s_uLastOutputedBlockIndex = uBlockIndex;
-   s_uLastOutputedPacketIndex = uPacketIndex;
-
    int iBreakFoundPosition = -1;
-   u8* pData = &s_BufferAudioPackets[uPacketIndex][0];
-
-   for( int i=0; i<(int)uAudioSize; i++ )
+   for( int i=0; i<iLength; i++ )
    {
-      if ( (*pData) != s_szAudioToken[s_iTokenPositionToCheck] )
+      if ( pData[i] != (u8)s_szAudioToken[s_iTokenPositionToCheck] )
       {
          s_iTokenPositionToCheck = 0;
-         pData++;
          continue;
       }
-      pData++;
       s_iTokenPositionToCheck++;
       if ( s_szAudioToken[s_iTokenPositionToCheck] == 0 )
       {
+         s_iTokenPositionToCheck = 0;
          iBreakFoundPosition = i+1;
          break;
       }
@@ -165,15 +184,17 @@ void _output_audio_block(u32 uBlockIndex, u32 uPacketIndex, u32 uAudioSize)
 
    if ( iBreakFoundPosition == -1 )
    {
-      if ( s_fPipeAudio != -1 )
-         write(s_fPipeAudio, &s_BufferAudioPackets[uPacketIndex][0], uAudioSize);
+      _write_to_audio_sink(pData, iLength);
       #ifdef FEATURE_LOCAL_AUDIO_RECORDING
       if ( NULL != s_pFileAudioRecording )
-        fwrite(&s_BufferAudioPackets[uPacketIndex][0], 1, uAudioSize, s_pFileAudioRecording);
+        fwrite(pData, 1, iLength, s_pFileAudioRecording);
       #endif
       return;
    }
 
+   // New audio segment from vehicle: the player keeps running, just skip the segment token
+   log_line("[AudioRx] New audio segment started.");
+
    #ifdef FEATURE_LOCAL_AUDIO_RECORDING
    if ( NULL != s_pFileAudioRecording )
    {
@@ -182,91 +203,41 @@ void _output_audio_block(u32 uBlockIndex, u32 uPacketIndex, u32 uAudioSize)
    }
    #endif
 
-   if ( iBreakFoundPosition >= 0 )
-   {
-      _stop_audio_player_and_pipe();
-      _start_audio_player_and_pipe();
-
-      int iToOutput = (int)uAudioSize - iBreakFoundPosition;
-
-      if ( (iToOutput > 0) && (s_fPipeAudio != -1) )
-         write(s_fPipeAudio, &s_BufferAudioPackets[uPacketIndex][iBreakFoundPosition], iToOutput);
+   int iToOutput = iLength - iBreakFoundPosition;
+   if ( iToOutput > 0 )
+      _write_to_audio_sink(&pData[iBreakFoundPosition], iToOutput);
    
-      #ifdef FEATURE_LOCAL_AUDIO_RECORDING
-      s_iAudioRecordingSegment++;
-      char szBuff[128];
-      sprintf(szBuff, "%s%s%d", FOLDER_RUBY_TEMP, FILE_TEMP_AUDIO_RECORDING, s_iAudioRecordingSegment);
-      s_pFileAudioRecording = fopen(szBuff, "wb");
-
-      if ( NULL != s_pFileAudioRecording )
-      if ( iToOutput > 0 )
-         fwrite(&s_BufferAudioPackets[uPacketIndex][iBreakFoundPosition], 1, iToOutput, s_pFileAudioRecording);
-      #endif
-   }
-}
-
-
-void _try_reconstruct_and_output_audio()
-{
-   if ( -1 == s_fPipeAudio )
-      return;
-
-   if ( s_uReceivedDataPacketsForCurrentBlock + s_uReceivedECPacketsForCurrentBlock < s_AudioPacketsPerBlock )
-      return;
-
-   // Reconstruct block
-
-   // Add existing data packets, mark and count the ones that are missing
-
-   missing_audio_packets_count_for_fec = 0;
-   for( u32 i=0; i<s_AudioPacketsPerBlock; i++ )
-   {
-      fec_decode_audio_data_packets[i] = &s_BufferAudioPackets[i][0];
-      if ( ! s_BufferAudioPacketsReceived[i] )
-      {
-         fec_decode_audio_missing_packets[missing_audio_packets_count_for_fec] = i;
-         missing_audio_packets_count_for_fec++;
-      }
-   }
-
-   // Add the needed FEC packets to the list
-   unsigned int pos = 0;
-   for( u32 i=0; i<s_AudioFECPerBlock; i++ )
-   {
-      if ( s_BufferAudioPacketsReceived[i+s_AudioPacketsPerBlock] )
-      {
-         fec_decode_audio_fec_packets[pos] = &s_BufferAudioPackets[i+s_AudioPacketsPerBlock][0];
-         fec_decode_audio_fec_indexes[pos] = i;
-         pos++;
-         if ( pos == missing_audio_packets_count_for_fec )
-            break;
-      }
-   }
-
-   fec_decode(s_AudioPacketSize, fec_decode_audio_data_packets, (unsigned int) s_AudioPacketsPerBlock, fec_decode_audio_fec_packets, fec_decode_audio_fec_indexes, fec_decode_audio_missing_packets, missing_audio_packets_count_for_fec );
+   #ifdef FEATURE_LOCAL_AUDIO_RECORDING
+   s_iAudioRecordingSegment++;
+   char szBuff[128];
+   sprintf(szBuff, "%s%s%d", FOLDER_RUBY_TEMP, FILE_TEMP_AUDIO_RECORDING, s_iAudioRecordingSegment);
+   s_pFileAudioRecording = fopen(szBuff, "wb");
 
-   for( u32 i=0; i<s_AudioPacketsPerBlock; i++ )
-      _output_audio_block(s_uCurrentRxAudioBlockIndex, (u32)i, s_AudioPacketSize);
+   if ( NULL != s_pFileAudioRecording )
+   if ( iToOutput > 0 )
+      fwrite(&pData[iBreakFoundPosition], 1, iToOutput, s_pFileAudioRecording);
+   #endif
 }
 
 void init_processing_audio()
 {
-   s_uCurrentRxAudioBlockIndex = MAX_U32;
-   _reset_current_audio_rx_block();
-
-   s_uLastOutputedBlockIndex = MAX_U32;
-   s_uLastOutputedPacketIndex = MAX_U32;
-
-   s_AudioPacketsPerBlock = 4;
-   s_AudioFECPerBlock = 2;
+   int iDataPackets = 4;
+   int iECPackets = 2;
    if ( NULL != g_pCurrentModel )
    {
-      s_AudioPacketsPerBlock = g_pCurrentModel->audio_params.flags & 0xFF;
-      s_AudioFECPerBlock = (g_pCurrentModel->audio_params.flags >> 8) & 0xFF;
+      iDataPackets = g_pCurrentModel->audio_params.flags & 0xFF;
+      iECPackets = (g_pCurrentModel->audio_params.flags >> 8) & 0xFF;
    }
+   audio_rx_jitter_init(&s_AudioRxJitter, iDataPackets, iECPackets, DEFAULT_AUDIO_RX_JITTER_BLOCKS, DEFAULT_AUDIO_RX_PLAYOUT_DELAY_MS,
+      AUDIO_OUTPUT_BYTES_PER_SECOND, _on_audio_rx_output, NULL);
 
    s_fPipeAudio = -1;
+   s_bAudioPlayerEnabled = false;
    s_bHasAudioOutputDevice = false;
+   s_uAudioSinkDroppedBytes = 0;
+   s_uAudioSinkRestarts = 0;
+   s_uTimeLastAudioRxStatsLog = get_current_timestamp_ms();
+   s_uLastLoggedConcealedPackets = 0;
 
    if ( (NULL != g_pCurrentModel) && (! g_pCurrentModel->audio_params.has_audio_device) )
    {
@@ -300,8 +271,13 @@ void init_processing_audio()
 
 void uninit_processing_audio()
 {
-   _stop_audio_player_and_pipe();
+   log_line("[AudioRx] Played %u blocks, repaired: %u, concealed: %u (%u packets), late packets: %u, out of order: %u, player dropped %u bytes, restarts: %u",
+      s_AudioRxJitter.uCountBlocksPlayed, s_AudioRxJitter.uCountBlocksRepaired, s_AudioRxJitter.uCountBlocksConcealed, s_AudioRxJitter.uCountPacketsConcealed,
+      s_AudioRxJitter.uCountLate, s_AudioRxJitter.uCountOutOfOrder, s_uAudioSinkDroppedBytes, s_uAudioSinkRestarts);
 
+   s_bAudioPlayerEnabled = false;
+   _stop_audio_player_and_pipe();
+   audio_rx_jitter_reset(&s_AudioRxJitter);
 
    if ( NULL != s_pFileRawStream )
       fclose(s_pFileRawStream);
@@ -317,77 +293,34 @@ void process_received_audio_packet(u8* pPacketBuffer)
    if ( NULL != s_pFileRawStream )
       fwrite(pPacketBuffer, 1, pPH->total_length, s_pFileRawStream);
 
+   if ( pPH->total_length <= sizeof(t_packet_header) + sizeof(u32) )
+      return;
+
    memcpy((u8*)&uAudioBlockSegmentIndex, pData, sizeof(u32));
    u32 uBlockIndex = uAudioBlockSegmentIndex>>8;
    u32 uPacketIndex = uAudioBlockSegmentIndex & 0xFF;
    pData += sizeof(u32);
 
-   u32 uAudioSize = pPH->total_length-sizeof(u32);
-
-   s_AudioPacketSize = uAudioSize;
-   
-   if ( uPacketIndex >= MAX_BUFFERED_AUDIO_PACKETS )
-      return;
-
-   // First time we try to process audio packets?
-
-   if ( s_uCurrentRxAudioBlockIndex == MAX_U32 )
-   {
-      // Wait for the begining of the next block
-      if ( uPacketIndex >= s_AudioFECPerBlock )
-         return;
-  
-      s_uCurrentRxAudioBlockIndex = uBlockIndex;
-      _reset_current_audio_rx_block();
-   }
+   int iAudioSize = (int)pPH->total_length - (int)sizeof(t_packet_header) - (int)sizeof(u32);
+   audio_rx_jitter_add_packet(&s_AudioRxJitter, uBlockIndex, uPacketIndex, pData, iAudioSize, get_current_timestamp_micros());
+}
 
-   if ( uBlockIndex < s_uCurrentRxAudioBlockIndex )
+void process_audio_periodic_loop()
+{
+   if ( ! s_AudioRxJitter.iStarted )
       return;
+   audio_rx_jitter_periodic(&s_AudioRxJitter, get_current_timestamp_micros());
 
-   if ( uBlockIndex != s_uCurrentRxAudioBlockIndex )
+   u32 uTimeNow = get_current_timestamp_ms();
+   if ( uTimeNow >= s_uTimeLastAudioRxStatsLog + 30000 )
    {
-      // Try reconstruction of last block if needed
-      if ( s_uLastOutputedPacketIndex < s_AudioPacketsPerBlock-1 )
-      if ( s_uReceivedDataPacketsForCurrentBlock + s_uReceivedECPacketsForCurrentBlock >= s_AudioPacketsPerBlock )
+      s_uTimeLastAudioRxStatsLog = uTimeNow;
+      if ( s_AudioRxJitter.uCountPacketsConcealed != s_uLastLoggedConcealedPackets )
       {
-         _try_reconstruct_and_output_audio();
+         s_uLastLoggedConcealedPackets = s_AudioRxJitter.uCountPacketsConcealed;
+         log_line("[AudioRx] Played %u blocks, repaired: %u, concealed: %u (%u packets), late packets: %u, window overflows: %u, player dropped %u bytes",
+            s_AudioRxJitter.uCountBlocksPlayed, s_AudioRxJitter.uCountBlocksRepaired, s_AudioRxJitter.uCountBlocksConcealed,
+            s_AudioRxJitter.uCountPacketsConcealed, s_AudioRxJitter.uCountLate, s_AudioRxJitter.uCountWindowOverflows, s_uAudioSinkDroppedBytes);
       }
-
-      s_uLastOutputedBlockIndex = s_uCurrentRxAudioBlockIndex;
-      s_uLastOutputedPacketIndex = s_AudioPacketsPerBlock-1;
-
-      _reset_current_audio_rx_block();
-      s_uCurrentRxAudioBlockIndex = uBlockIndex;
-
-      // Wait for begining of the next block
-      if ( uPacketIndex >= s_AudioFECPerBlock )
-         return;
-   }
-
-   if ( s_BufferAudioPacketsReceived[uPacketIndex] )
-      return;
-
-   if ( uPacketIndex < s_AudioPacketsPerBlock )
-      s_uReceivedDataPacketsForCurrentBlock++;
-   else
-      s_uReceivedECPacketsForCurrentBlock++;
-
-   s_BufferAudioPacketsReceived[uPacketIndex] = true;
-   memcpy(&s_BufferAudioPackets[uPacketIndex][0], pData, uAudioSize);
-
-   u32 uNextBlockToOutput = s_uLastOutputedBlockIndex;
-   u32 uNextPacketToOutput = s_uLastOutputedPacketIndex;
-
-   uNextPacketToOutput++;
-   if ( uNextPacketToOutput >= s_AudioPacketsPerBlock )
-   {
-      uNextBlockToOutput++;
-      uNextPacketToOutput = 0;
-   }
-
-   if ( uPacketIndex < s_AudioPacketsPerBlock )
-   if ( (uBlockIndex == uNextBlockToOutput) && (uPacketIndex == uNextPacketToOutput) )
-   {
-      _output_audio_block(uBlockIndex, uPacketIndex, uAudioSize);
    }
 }
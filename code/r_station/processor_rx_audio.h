@@ -6,3 +6,5 @@ void init_processing_audio();
 void uninit_processing_audio();
 
 void process_received_audio_packet(u8* pPacketBuffer);
+// Plays out buffered audio that reached its playout deadline
+void process_audio_periodic_loop();
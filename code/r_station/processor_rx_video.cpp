@@ -67,6 +67,7 @@
 #include "rx_video_output.h"
 #include "video_link_adaptive.h"
 #include "video_link_keyframe.h"
+#include "video_latency_trace.h"
 #include "packets_utils.h"
 #include "links_utils.h"
 #include "timers.h"
@@ -99,6 +100,101 @@ void ProcessorRxVideo::oneTimeInit()
       g_pVideoProcessorRxList[i] = NULL;
    log_line("[VideoRx] Did one time initialization.");
 }
+
+ProcessorRxVideo* ProcessorRxVideo::getVideoProcessorForVehicleId(u32 uVehicleId, u32 uVideoStreamIndex)
+{
+   for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
+   {
+      if ( NULL == g_pVideoProcessorRxList[i] )
+         break;
+      if ( g_pVideoProcessorRxList[i]->m_uVehicleId == uVehicleId )
+      if ( g_pVideoProcessorRxList[i]->m_uVideoStreamIndex == uVideoStreamIndex )
+         return g_pVideoProcessorRxList[i];
+   }
+   return NULL;
+}
+
+// Returns the processor of the video stream that is currently sent to the player/recording for this vehicle.
+// Falls back to any video stream of the vehicle if the output one is not received yet.
+ProcessorRxVideo* ProcessorRxVideo::getOutputVideoProcessorForVehicleId(u32 uVehicleId)
+{
+   type_global_state_vehicle_runtime_info* pRuntimeInfo = getVehicleRuntimeInfo(uVehicleId);
+   if ( NULL != pRuntimeInfo )
+   {
+      ProcessorRxVideo* pProcessor = getVideoProcessorForVehicleId(uVehicleId, pRuntimeInfo->uOutputVideoStreamIndex);
+      if ( NULL != pProcessor )
+         return pProcessor;
+   }
+   for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
+   {
+      if ( NULL == g_pVideoProcessorRxList[i] )
+         break;
+      if ( g_pVideoProcessorRxList[i]->m_uVehicleId == uVehicleId )
+         return g_pVideoProcessorRxList[i];
+   }
+   return NULL;
+}
+
+// All video streams of a vehicle are received, reconstructed and tracked in parallel, but only one of them is
+// sent to the output (player, recording, forwarding). The output goes to the lowest index video stream that
+// is still receiving data, so that if the main stream stops, the output switches right away to a backup stream
+// (and back once the main stream resumes).
+void ProcessorRxVideo::checkUpdateOutputVideoStreams(u32 uTimeNow)
+{
+   static u32 s_uTimeLastCheckOutputVideoStreams = 0;
+   if ( uTimeNow < s_uTimeLastCheckOutputVideoStreams + 50 )
+      return;
+   s_uTimeLastCheckOutputVideoStreams = uTimeNow;
+
+   for( int iRuntime=0; iRuntime<MAX_CONCURENT_VEHICLES; iRuntime++ )
+   {
+      u32 uVehicleId = g_State.vehiclesRuntimeInfo[iRuntime].uVehicleId;
+      if ( 0 == uVehicleId )
+         continue;
+
+      ProcessorRxVideo* pBestProcessor = NULL;
+      int iCountStreams = 0;
+      for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
+      {
+         if ( NULL == g_pVideoProcessorRxList[i] )
+            break;
+         if ( g_pVideoProcessorRxList[i]->m_uVehicleId != uVehicleId )
+            continue;
+         iCountStreams++;
+         if ( uTimeNow > g_pVideoProcessorRxList[i]->m_uTimeLastReceivedVideoPacket + DEFAULT_VIDEO_STREAM_OUTPUT_SWITCH_TIMEOUT_MS )
+            continue;
+         if ( (NULL == pBestProcessor) || (g_pVideoProcessorRxList[i]->m_uVideoStreamIndex < pBestProcessor->m_uVideoStreamIndex) )
+            pBestProcessor = g_pVideoProcessorRxList[i];
+      }
+
+      // Single stream or no stream alive: keep the current output
+      if ( (iCountStreams < 2) || (NULL == pBestProcessor) )
+         continue;
+      if ( pBestProcessor->m_uVideoStreamIndex == g_State.vehiclesRuntimeInfo[iRuntime].uOutputVideoStreamIndex )
+         continue;
+
+      ProcessorRxVideo* pOldProcessor = getVideoProcessorForVehicleId(uVehicleId, g_State.vehiclesRuntimeInfo[iRuntime].uOutputVideoStreamIndex);
+      log_line("[VideoRx] VID %u: switching video output from video stream %u to video stream %u.", uVehicleId, g_State.vehiclesRuntimeInfo[iRuntime].uOutputVideoStreamIndex, pBestProcessor->m_uVideoStreamIndex);
+      g_State.vehiclesRuntimeInfo[iRuntime].uOutputVideoStreamIndex = pBestProcessor->m_uVideoStreamIndex;
+
+      // The decoder can only pick up the new stream from an I-frame
+      video_link_keyframe_request_keyframe(uVehicleId, pBestProcessor->m_uVideoStreamIndex);
+
+      if ( NULL != pOldProcessor )
+      if ( (pOldProcessor->getVideoWidth() != pBestProcessor->getVideoWidth()) ||
+           (pOldProcessor->getVideoHeight() != pBestProcessor->getVideoHeight()) ||
+           (pOldProcessor->getVideoType() != pBestProcessor->getVideoType()) )
+         rx_video_output_signal_restart_player();
+   }
+}
+
+bool ProcessorRxVideo::isOutputVideoStream()
+{
+   type_global_state_vehicle_runtime_info* pRuntimeInfo = getVehicleRuntimeInfo(m_uVehicleId);
+   if ( NULL == pRuntimeInfo )
+      return (0 == m_uVideoStreamIndex);
+   return (m_uVideoStreamIndex == pRuntimeInfo->uOutputVideoStreamIndex);
+}
 /*
 void ProcessorRxVideo::log(const char* format, ...)
 {
@@ -653,6 +749,16 @@ void ProcessorRxVideo::sendPacketToOutput(int rx_buffer_block_index, int block_p
    int lengthVideo = m_pRXBlocksStack[rx_buffer_block_index]->packetsInfo[block_packet_index].video_data_length;
    int packet_length = m_pRXBlocksStack[rx_buffer_block_index]->packetsInfo[block_packet_index].packet_length;
 
+   if ( ! isOutputVideoStream() )
+      return;
+
+   if ( m_pRXBlocksStack[rx_buffer_block_index]->packetsInfo[block_packet_index].uState & RX_PACKET_STATE_HAS_LATENCY_TRACE )
+   {
+      int iTraceOffset = packet_length - (int)sizeof(t_packet_header) - (int)sizeof(t_packet_header_video_full_77) - (int)sizeof(t_packet_video_latency_trace);
+      if ( iTraceOffset >= lengthVideo )
+         video_latency_trace_on_output(m_uVehicleId, (t_packet_video_latency_trace*)(pBuffer + iTraceOffset));
+   }
+
    rx_video_output_video_data(m_uVehicleId, (m_SM_VideoDecodeStats.video_stream_and_type >> 4) & 0x0F , m_SM_VideoDecodeStats.width, m_SM_VideoDecodeStats.height, pBuffer, lengthVideo, packet_length);
 }
 
@@ -697,6 +803,7 @@ void ProcessorRxVideo::pushIncompleteBlocksOut(int iStackIndexToDiscardTo, bool
       //   _rx_video_log_line("Discarding Rx stack segment [0-%d] (to make room for newer blocks, discarded blocks indexes [%u-%u], latest received block index: %u", countToPush-1, s_pRXBlocksStack[0]->video_block_index, s_pRXBlocksStack[countToPush-1]->video_block_index, s_LastReceivedVideoPacketInfo.video_block_index);
    }
 
+   bool bLostVideoData = false;
    for( int i=0; i<iStackIndexToDiscardTo; i++ )
    {
       m_SM_VideoDecodeStats.currentPacketsInBuffers -= m_pRXBlocksStack[i]->received_data_packets;
@@ -710,6 +817,8 @@ void ProcessorRxVideo::pushIncompleteBlocksOut(int iStackIndexToDiscardTo, bool
 
       if ( bTooOld )
       {
+         if ( m_pRXBlocksStack[i]->received_data_packets < m_pRXBlocksStack[i]->data_packets )
+            bLostVideoData = true;
          m_SM_VideoDecodeStats.total_DiscardedLostPackets += m_pRXBlocksStack[i]->data_packets - m_pRXBlocksStack[i]->received_data_packets;
          resetReceiveBuffersBlock(i);
          continue;
@@ -739,10 +848,17 @@ void ProcessorRxVideo::pushIncompleteBlocksOut(int iStackIndexToDiscardTo, bool
             sendPacketToOutput(i, k);
       }
       else
+      {
+         bLostVideoData = true;
          m_SM_VideoDecodeStats.total_DiscardedLostPackets += m_pRXBlocksStack[i]->data_packets - m_pRXBlocksStack[i]->received_data_packets;
+      }
 
       resetReceiveBuffersBlock(i);
    }
+
+   // The decoder can't recover from the lost data until the next I-frame, so ask for one now
+   if ( bLostVideoData && isOutputVideoStream() )
+      video_link_keyframe_request_keyframe(m_uVehicleId, m_uVideoStreamIndex);
          
    if ( bFullDiscard )
    {
@@ -1567,6 +1683,10 @@ void ProcessorRxVideo::checkAndRequestMissingPackets()
    if ( ! (pModel->video_link_profiles[pModel->video_params.user_selected_video_link_profile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_ENABLE_RETRANSMISSIONS) )
       return;
 
+   // Retransmissions are only worth the uplink for the video stream that is displayed
+   if ( ! isOutputVideoStream() )
+      return;
+
    if ( g_TimeNow < m_uLastTimeRequestedRetransmission + m_uTimeIntervalMsForRequestingRetransmissions )
       return;
 
@@ -2052,6 +2172,9 @@ void ProcessorRxVideo::addPacketToReceivedBlocksBuffers(u8* pBuffer, int length,
    m_pRXBlocksStack[rx_buffer_block_index]->packetsInfo[pPHVF->video_block_packet_index].uState |= RX_PACKET_STATE_RECEIVED;
    m_pRXBlocksStack[rx_buffer_block_index]->packetsInfo[pPHVF->video_block_packet_index].video_data_length = pPHVF->video_data_length;
    m_pRXBlocksStack[rx_buffer_block_index]->packetsInfo[pPHVF->video_block_packet_index].packet_length = length;
+   if ( ! bWasRetransmitted )
+   if ( NULL != radio_packet_get_video_latency_trace(pBuffer) )
+      m_pRXBlocksStack[rx_buffer_block_index]->packetsInfo[pPHVF->video_block_packet_index].uState |= RX_PACKET_STATE_HAS_LATENCY_TRACE;
 
    if ( length < 100 || length > MAX_PACKET_TOTAL_SIZE )
       log_softerror_and_alarm("Invalid video data size to copy (%d bytes)", length);
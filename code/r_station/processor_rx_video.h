@@ -29,6 +29,7 @@ type_last_rx_packet_info;
 #define RX_PACKET_STATE_EMPTY 0
 #define RX_PACKET_STATE_RECEIVED 0x01
 #define RX_PACKET_STATE_OUTPUTED 0x02
+#define RX_PACKET_STATE_HAS_LATENCY_TRACE 0x04
 
 typedef struct
 {
@@ -68,6 +69,9 @@ class ProcessorRxVideo
       virtual ~ProcessorRxVideo();
 
       static void oneTimeInit();
+      static ProcessorRxVideo* getVideoProcessorForVehicleId(u32 uVehicleId, u32 uVideoStreamIndex);
+      static ProcessorRxVideo* getOutputVideoProcessorForVehicleId(u32 uVehicleId);
+      static void checkUpdateOutputVideoStreams(u32 uTimeNow);
       //static void log(const char* format, ...);
 
       virtual bool init();
@@ -75,6 +79,7 @@ class ProcessorRxVideo
       virtual void resetState();
       void resetRetransmissionsStats();
       void onControllerSettingsChanged();
+      bool isOutputVideoStream();
 
       void pauseProcessing();
       void resumeProcessing();
@@ -212,7 +212,7 @@ void radio_links_close_rxtx_radio_interfaces()
       g_SM_RadioStats.radio_interfaces[i].openedForWrite = 0;
    }
    if ( NULL != g_pSM_RadioStats )
-      memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
    log_line("Closed all radio interfaces (rx/tx)."); 
 }
 
@@ -293,6 +293,9 @@ void radio_links_open_rxtx_radio_interfaces_for_search( u32 uSearchFreq )
    if ( 0 < iCountSikInterfacesOpened )
    {
       radio_tx_set_sik_packet_size(g_pCurrentModel->radioLinksParams.iSiKPacketSize);
+      // Older vehicles drop the data following a completed message in a short packet
+      radio_tx_set_serial_coalescing(((g_pCurrentModel->sw_version>>16) >= RADIO_TX_SERIAL_COALESCING_MIN_SW_BUILD)?1:0);
+      radio_rx_set_serial_peer_marks_start_packets(((g_pCurrentModel->sw_version>>16) >= RADIO_TX_SERIAL_COALESCING_MIN_SW_BUILD)?1:0);
       radio_tx_start_tx_thread();
    }
 
@@ -309,7 +312,7 @@ void radio_links_open_rxtx_radio_interfaces_for_search( u32 uSearchFreq )
    }
    
    if ( NULL != g_pSM_RadioStats )
-      memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
    log_line("Opening RX radio interfaces for search complete. %d interfaces opened for RX:", iCountOpenRead);
    
    for( int i=0; i<hardware_get_radio_interfaces_count(); i++ )
@@ -466,7 +469,7 @@ void radio_links_open_rxtx_radio_interfaces()
    }
 
    if ( NULL != g_pSM_RadioStats )
-      memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
    log_line("Opening RX/TX radio interfaces complete. %d interfaces opened for RX, %d interfaces opened for TX:", totalCountForRead, totalCountForWrite);
 
    if ( totalCountForRead == 0 )
@@ -536,11 +539,14 @@ void radio_links_open_rxtx_radio_interfaces()
    if ( 0 < iCountSikInterfacesOpened )
    {
       radio_tx_set_sik_packet_size(g_pCurrentModel->radioLinksParams.iSiKPacketSize);
+      // Older vehicles drop the data following a completed message in a short packet
+      radio_tx_set_serial_coalescing(((g_pCurrentModel->sw_version>>16) >= RADIO_TX_SERIAL_COALESCING_MIN_SW_BUILD)?1:0);
+      radio_rx_set_serial_peer_marks_start_packets(((g_pCurrentModel->sw_version>>16) >= RADIO_TX_SERIAL_COALESCING_MIN_SW_BUILD)?1:0);
       radio_tx_start_tx_thread();
    }
 
    if ( NULL != g_pSM_RadioStats )
-      memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
    log_line("Finished opening RX/TX radio interfaces.");
    log_line("OPEN RADIO INTERFACES END ===========================================================");
    log_line("");
@@ -583,7 +589,7 @@ bool radio_links_apply_settings(Model* pModel, int iRadioLink, type_radio_links_
 
       hardware_save_radio_info();
       if ( NULL != g_pSM_RadioStats )
-         memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+         shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
    }
 
    // Apply data rates
@@ -213,7 +213,7 @@ static void * _reinit_sik_thread_func(void *ignored_argument)
                    uTxPower, uDataRate, uECC, uLBT, uMCSTR);
                radio_stats_set_card_current_frequency(&g_SM_RadioStats, g_SiKRadiosState.iMustReconfigureSiKInterfaceIndex, uFreqKhz);
                if ( NULL != g_pSM_RadioStats )
-                  memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+                  shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
             }
          }
       }
@@ -48,11 +48,14 @@
 #include "../base/parse_fc_telemetry.h"
 #include "../common/string_utils.h"
 #include "../common/radio_stats.h"
+#include "../common/timer_wheel.h"
+#include "../common/event_loop.h"
 #include "../radio/radiolink.h"
 #include "../radio/radiopackets2.h"
 #include "../radio/radiopacketsqueue.h"
 #include "../radio/radio_rx.h"
 #include "../radio/radio_tx.h"
+#include "../radio/radio_tx_aggregator.h"
 #include "../radio/radio_duplicate_det.h"
 #include "../base/controller_utils.h"
 #include "../base/core_plugins_settings.h"
@@ -88,6 +91,7 @@ u8 s_PipeBufferRCUplink[MAX_PACKET_TOTAL_SIZE];
 int s_PipeBufferRCUplinkPos = 0;  
 
 t_packet_queue s_QueueRadioPackets;
+t_radio_tx_aggregator s_RadioTxAggregator;
 t_packet_queue s_QueueControlPackets;
 
 u32 s_debugLastFPSTime = 0;
@@ -102,6 +106,9 @@ int s_iSearchSikMCSTR = -1;
 
 u32 s_uTimeLastTryReadIPCMessages = 0;
 
+t_timer_wheel s_RouterTimers;
+t_event_loop s_RouterEventLoop;
+
 #define MAX_RADIO_PACKETS_TO_CACHE_LOCALLY 20
 type_received_radio_packet s_ReceivedRadioPacketsBuffer[MAX_RADIO_PACKETS_TO_CACHE_LOCALLY];
 
@@ -333,7 +340,7 @@ void _compute_radio_interfaces_assignment()
       iCountAssignedVehicleRadioLinks = 1;
       g_SM_RadioStats.countLocalRadioLinks = 1;
       if ( NULL != g_pSM_RadioStats )
-         memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+         shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
       if ( 0 == iCountAssignedVehicleRadioLinks )
          send_alarm_to_central(ALARM_ID_CONTROLLER_NO_INTERFACES_FOR_RADIO_LINK,iConnectFirstUsableRadioLinkId, 0);
       
@@ -502,7 +509,7 @@ void _compute_radio_interfaces_assignment()
    log_line("Assigned %d controller local radio links to vehicle radio links (vehicle has %d active radio links)", iCountAssignedVehicleRadioLinks, iCountVehicleActiveUsableRadioLinks);
    
    if ( NULL != g_pSM_RadioStats )
-      memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
 
    //---------------------------------------------------------------
    // Log errors
@@ -662,7 +669,7 @@ bool links_set_cards_frequencies_for_search( u32 uSearchFreq, bool bSiKSearch, i
    }
 
    if ( NULL != g_pSM_RadioStats )
-      memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
    log_line("Links: Set all cards frequencies for search mode to %s. Completed.", str_format_frequency(uSearchFreq));
    return true;
 }
@@ -779,7 +786,7 @@ bool links_set_cards_frequencies_and_params(int iVehicleLinkId)
    }
 
    if ( NULL != g_pSM_RadioStats )
-      memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
 
    hardware_save_radio_info();
 
@@ -1042,12 +1049,44 @@ bool _check_send_or_queue_ping()
    return true;
 }
 
-void _process_and_send_packets_individually()
+// Uplink data rate on the slowest radio link, the aggregated frames must fit its airtime budget
+void _update_radio_tx_aggregator_datarate()
 {
-   Preferences* pP = get_Preferences();
-   int maxLengthAllowedInRadioPacket = pP->iDebugMaxPacketSize;
-   if ( maxLengthAllowedInRadioPacket > MAX_VIDEO_PACKET_DATA_SIZE )
-      maxLengthAllowedInRadioPacket = MAX_VIDEO_PACKET_DATA_SIZE;
+   int iMinDataRate = 0;
+   u32 uMinRealDataRate = MAX_U32;
+   for( int iLocalRadioLinkId=0; iLocalRadioLinkId<g_SM_RadioStats.countLocalRadioLinks; iLocalRadioLinkId++ )
+   {
+      int iVehicleRadioLinkId = g_SM_RadioStats.radio_links[iLocalRadioLinkId].matchingVehicleRadioLinkId;
+      int iRadioInterfaceIndex = get_controller_radio_interface_index_for_radio_link(iLocalRadioLinkId);
+      if ( (iVehicleRadioLinkId < 0) || (iVehicleRadioLinkId >= g_pCurrentModel->radioLinksParams.links_count) || (iRadioInterfaceIndex < 0) )
+         continue;
+      if ( hardware_radio_index_is_serial_radio(iRadioInterfaceIndex) )
+         continue;
+      int iDataRate = compute_packet_uplink_datarate(iVehicleRadioLinkId, iRadioInterfaceIndex, &(g_pCurrentModel->radioLinksParams));
+      u32 uRealDataRate = getRealDataRateFromRadioDataRate(iDataRate, 0);
+      if ( uRealDataRate < uMinRealDataRate )
+      {
+         uMinRealDataRate = uRealDataRate;
+         iMinDataRate = iDataRate;
+      }
+   }
+   radio_tx_aggregator_set_datarate(&s_RadioTxAggregator, iMinDataRate);
+}
+
+void _send_aggregated_radio_packets()
+{
+   if ( ! radio_tx_aggregator_has_packets(&s_RadioTxAggregator) )
+      return;
+   send_packet_to_radio_interfaces(s_RadioTxAggregator.uBuffer, s_RadioTxAggregator.iLength, -1);
+   if ( g_bDebugIsPacketsHistoryGraphOn && (!g_bDebugIsPacketsHistoryGraphPaused) )
+      add_detailed_history_tx_packets(g_pDebug_SM_RouterPacketsStatsHistory, g_TimeNow % 1000, 0, 0, 0, 0, 0, 0);
+   radio_tx_aggregator_on_frame_sent(&s_RadioTxAggregator);
+}
+
+// Small packets pending at the same time are sent together in a single radio frame
+void _send_radio_out_packets()
+{
+   _update_radio_tx_aggregator_datarate();
 
    while ( packets_queue_has_packets(&s_QueueRadioPackets) )
    {
@@ -1104,8 +1143,20 @@ void _process_and_send_packets_individually()
 
       if ( (pPH->packet_type == PACKET_TYPE_VEHICLE_RECORDING) )
          send_count = 5;
-     
-      
+
+      if ( (1 == send_count) && (! g_bUpdateInProgress) && radio_tx_aggregator_can_aggregate_packet(pPacketBuffer, iPacketLength) )
+      {
+         if ( ! radio_tx_aggregator_add_packet(&s_RadioTxAggregator, pPacketBuffer, iPacketLength) )
+         {
+            _send_aggregated_radio_packets();
+            radio_tx_aggregator_add_packet(&s_RadioTxAggregator, pPacketBuffer, iPacketLength);
+         }
+         continue;
+      }
+
+      // Keep the packets order
+      _send_aggregated_radio_packets();
+
       for( int i=0; i<send_count; i++ )
       {
          send_packet_to_radio_interfaces(pPacketBuffer, iPacketLength, -1);
@@ -1113,6 +1164,7 @@ void _process_and_send_packets_individually()
             add_detailed_history_tx_packets(g_pDebug_SM_RouterPacketsStatsHistory, g_TimeNow % 1000, 0, 0, 0, 0, 0, 0);
       }
    }
+   _send_aggregated_radio_packets();
 }
 
 void _process_and_send_packets()
@@ -1128,182 +1180,7 @@ void _process_and_send_packets()
    if ( 0 == iCountPendingPackets )
       return;
 
-   #ifndef FEATURE_CONCATENATE_SMALL_RADIO_PACKETS
-   _process_and_send_packets_individually();
-   return;
-   #endif
-
-   Preferences* pP = get_Preferences();
-   
-   int maxLengthAllowedInRadioPacket = pP->iDebugMaxPacketSize;
-   if ( maxLengthAllowedInRadioPacket > MAX_VIDEO_PACKET_DATA_SIZE )
-      maxLengthAllowedInRadioPacket = MAX_VIDEO_PACKET_DATA_SIZE;
-
-   u8 composed_packet[MAX_PACKET_TOTAL_SIZE];
-   int composed_packet_length = 0;
-   int send_count = 1;
-   int countComm = 0;
-   int countRC = 0;
-  
-   // Send retransmissions first, if any
-
-
-   #ifdef FEATURE_CONCATENATE_SMALL_RADIO_PACKETS
-   u32 uDestinationVehicleIdLastPacket = 0;
-   u32 uLastPacketType = 0;
-   #endif
-   
-   // Send all the other outstanding packets to radio
-
-   while ( packets_queue_has_packets(&s_QueueRadioPackets) )
-   {
-      if ( NULL != g_pProcessStats )
-         g_pProcessStats->lastIPCIncomingTime = g_TimeNow;
-
-      int iPacketLength = -1;
-      u8* pPacketBuffer = packets_queue_pop_packet(&s_QueueRadioPackets, &iPacketLength);
-      if ( NULL == pPacketBuffer || -1 == iPacketLength )
-         break;
-
-      _check_for_atheros_datarate_change_command_to_vehicle(pPacketBuffer);
-
-      t_packet_header* pPH = (t_packet_header*)pPacketBuffer;
-      pPH->vehicle_id_src = g_uControllerId;
-      
-
-      if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_COMMANDS )
-      {
-         t_packet_header_command* pCom = (t_packet_header_command*)(pPacketBuffer + sizeof(t_packet_header));
-         type_global_state_vehicle_runtime_info* pRuntimeInfo = getVehicleRuntimeInfo(pPH->vehicle_id_dest);
-         if ( NULL != pRuntimeInfo )
-         {
-            pRuntimeInfo->uTimeLastCommandIdSent = g_TimeNow;
-            pRuntimeInfo->uLastCommandIdSent = pCom->command_counter;
-            pRuntimeInfo->uLastCommandIdRetrySent = pCom->command_resend_counter;
-         }
-      }
-
-      #ifdef FEATURE_CONCATENATE_SMALL_RADIO_PACKETS
-      
-      bool bSendNow = false;
-
-      if ( (composed_packet_length + iPacketLength > maxLengthAllowedInRadioPacket) )
-         bSendNow = true;
-
-      if ( g_bUpdateInProgress )
-         bSendNow = true;
-
-      if ( (pPH->packet_type == PACKET_TYPE_RUBY_PING_CLOCK) || (uLastPacketType == PACKET_TYPE_RUBY_PING_CLOCK) )
-         bSendNow = true;
-
-      if ( uDestinationVehicleIdLastPacket != pPH->vehicle_id_dest )
-      if ( 0 != uDestinationVehicleIdLastPacket )
-         bSendNow = true;
-
-      uDestinationVehicleIdLastPacket = pPH->vehicle_id_dest;
-
-      if ( bSendNow && (composed_packet_length > 0) )
-      {
-         for( int i=0; i<send_count; i++ )
-         {
-            if ( i != 0 )
-               hardware_sleep_ms(2);
-
-            send_packet_to_radio_interfaces(composed_packet, composed_packet_length, -1);
-            if ( g_bDebugIsPacketsHistoryGraphOn && (!g_bDebugIsPacketsHistoryGraphPaused) )
-               add_detailed_history_tx_packets(g_pDebug_SM_RouterPacketsStatsHistory, g_TimeNow % 1000, 0, countComm, 0, countRC, 0, 0);
-         }
-         iMaxPacketsToSend--;
-         composed_packet_length = 0;
-         send_count = 1;
-         countComm = 0;
-         countRC = 0;
-         uDestinationVehicleIdLastPacket = 0;
-      }
-
-      if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_COMMANDS )
-      if ( pPH->packet_type == COMMAND_ID_SET_RADIO_LINK_FREQUENCY )
-         send_count = 10;
-
-      if ( (pPH->packet_type == PACKET_TYPE_VEHICLE_RECORDING) )
-         send_count = 5;
-        
-      if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_COMMANDS )
-         countComm = 1;
-      if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_RC )
-         countRC = 1;
-
-      memcpy(&composed_packet[composed_packet_length], pPacketBuffer, iPacketLength);
-      composed_packet_length += iPacketLength;
-      uLastPacketType = pPH->packet_type;
-      #else
-      
-      send_count = 1;
-      countComm = 0;
-      countRC = 0;
-
-      if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_COMMANDS )
-      if ( pPH->packet_type == COMMAND_ID_SET_RADIO_LINK_FREQUENCY )
-         send_count = 10;
-
-      if ( (pPH->packet_type == PACKET_TYPE_VEHICLE_RECORDING) )
-         send_count = 5;
-
-      if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_COMMANDS )
-         countComm = 1;
-      if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_RC )
-         countRC = 1;
-
-      if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_COMMANDS )
-      if ( pPH->packet_type == PACKET_TYPE_COMMAND )
-      {
-         t_packet_header_command* pPHC = (t_packet_header_command*)(pPacketBuffer + sizeof(t_packet_header));
-         if ( (pPHC->command_type & COMMAND_TYPE_MASK) == COMMAND_ID_SET_CAMERA_PARAMETERS )
-         {
-            type_camera_parameters* pPHCamP = (type_camera_parameters*)(pPacketBuffer + sizeof(t_packet_header)+sizeof(t_packet_header_command));
-
-            int iProfile = pPHCamP->iCurrentProfile;
-            
-            log_line("Sending cam params: br: %d, co: %d, sa: %d, sh: %d, hue: %d, exp: %d, shutter: %d, drc: %d",
-               (int)pPHCamP->profiles[iProfile].brightness,
-               (int)pPHCamP->profiles[iProfile].contrast,
-               (int)pPHCamP->profiles[iProfile].saturation,
-               (int)pPHCamP->profiles[iProfile].sharpness,
-               (int)pPHCamP->profiles[iProfile].hue,
-               (int)pPHCamP->profiles[iProfile].exposure,
-               (int)pPHCamP->profiles[iProfile].shutterspeed,
-               (int)pPHCamP->profiles[iProfile].drc );
-         }
-      }
-
-      for( int i=0; i<send_count; i++ )
-      {
-         if ( i != 0 )
-            hardware_sleep_ms(2);
-
-         send_packet_to_radio_interfaces(pPacketBuffer, iPacketLength, -1);
-         if ( g_bDebugIsPacketsHistoryGraphOn && (!g_bDebugIsPacketsHistoryGraphPaused) )
-            add_detailed_history_tx_packets(g_pDebug_SM_RouterPacketsStatsHistory, g_TimeNow % 1000, 0, countComm, 0, countRC, 0, 0);
-      }
-
-      composed_packet_length = 0;
-      
-      #endif
-   }
-
-   if ( composed_packet_length > 0 )
-   {
-      for( int i=0; i<send_count; i++ )
-      {
-         if ( i != 0 )
-            hardware_sleep_ms(2);
-
-         send_packet_to_radio_interfaces(composed_packet, composed_packet_length, -1);
-
-         if ( g_bDebugIsPacketsHistoryGraphOn && (!g_bDebugIsPacketsHistoryGraphPaused) )
-            add_detailed_history_tx_packets(g_pDebug_SM_RouterPacketsStatsHistory, g_TimeNow % 1000, 0, countComm, 0, countRC, 0, 0);
-      }
-   }
+   _send_radio_out_packets();
 }
 
 void _preprocess_radio_out_packet(u8* pPacketBuffer)
@@ -1382,6 +1259,12 @@ void init_shared_memory_objects()
    g_TimeNow = get_current_timestamp_ms();
    radio_stats_interfaces_rx_graph_reset(&g_SM_RadioStatsInterfacesRxGraph, 10);
 
+   g_pSM_Sequences = shared_mem_sequences_open_for_write();
+   if ( NULL == g_pSM_Sequences )
+      log_softerror_and_alarm("Failed to open shared mem publish sequences for write.");
+   else
+      log_line("Opened shared mem publish sequences for write: success.");
+
    g_pSM_RadioStatsInterfacesRxGraph = shared_mem_controller_radio_stats_interfaces_rx_graphs_open_for_write();
    if ( NULL == g_pSM_RadioStatsInterfacesRxGraph )
       log_softerror_and_alarm("Failed to open controller radio interfaces rx graphs shared memory for write.");
@@ -1389,7 +1272,7 @@ void init_shared_memory_objects()
       log_line("Opened controller radio interfaces rx graphs shared memory for write: success.");
 
    if ( NULL != g_pSM_RadioStatsInterfacesRxGraph )
-      memcpy((u8*)g_pSM_RadioStatsInterfacesRxGraph, (u8*)&g_SM_RadioStatsInterfacesRxGraph, sizeof(shared_mem_radio_stats_interfaces_rx_graph));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_INTERFACES_RX_GRAPHS, g_pSM_RadioStatsInterfacesRxGraph, &g_SM_RadioStatsInterfacesRxGraph, sizeof(shared_mem_radio_stats_interfaces_rx_graph));
 
    g_pSM_RadioStats = shared_mem_radio_stats_open_for_write();
    if ( NULL == g_pSM_RadioStats )
@@ -1408,7 +1291,7 @@ void init_shared_memory_objects()
    radio_stats_reset(&g_SM_RadioStats, g_pControllerSettings->nGraphRadioRefreshInterval);
 
    if ( NULL != g_pSM_RadioStats )
-      memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
 
 
    if ( (NULL != g_pCurrentModel) && g_pCurrentModel->audio_params.has_audio_device && g_pCurrentModel->audio_params.enabled )
@@ -1490,7 +1373,7 @@ void init_shared_memory_objects()
    }
 
    if ( NULL != g_pSM_RouterVehiclesRuntimeInfo )
-      memcpy( (u8*)g_pSM_RouterVehiclesRuntimeInfo, (u8*)&g_SM_RouterVehiclesRuntimeInfo, sizeof(shared_mem_router_vehicles_runtime_info));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_ROUTER_VEHICLES_RUNTIME_INFO, g_pSM_RouterVehiclesRuntimeInfo, &g_SM_RouterVehiclesRuntimeInfo, sizeof(shared_mem_router_vehicles_runtime_info));
 
    g_pSM_VideoLinkStats = shared_mem_video_link_stats_open_for_write();
    if ( NULL == g_pSM_VideoLinkStats )
@@ -1668,7 +1551,7 @@ int _consume_radio_rx_packets()
      
    u32 uTimeStart = get_current_timestamp_ms();
 
-   int iCount = radio_rx_get_received_packets(iReceivedAnyPackets, s_ReceivedRadioPacketsBuffer);
+   int iCount = radio_rx_get_received_packets_buffers(iReceivedAnyPackets, s_ReceivedRadioPacketsBuffer);
 
    for( int i=0; i<iCount; i++ )
    {
@@ -1697,6 +1580,7 @@ int _consume_radio_rx_packets()
          _read_ipc_pipes(uTime);
       }
    }
+   radio_rx_release_received_packets(s_ReceivedRadioPacketsBuffer, iCount);
    return iCount;
 }
 
@@ -1819,9 +1703,9 @@ void _router_periodic_loop()
       {
          s_uTimeLastRadioStatsSharedMemSync = g_TimeNow;
          if ( NULL != g_pSM_RadioStats )
-            memcpy((u8*)g_pSM_RadioStats, (u8*)&g_SM_RadioStats, sizeof(shared_mem_radio_stats));
+            shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS, g_pSM_RadioStats, &g_SM_RadioStats, sizeof(shared_mem_radio_stats));
          if ( NULL != g_pSM_RadioStatsInterfacesRxGraph )
-            memcpy((u8*)g_pSM_RadioStatsInterfacesRxGraph, (u8*)&g_SM_RadioStatsInterfacesRxGraph, sizeof(shared_mem_radio_stats_interfaces_rx_graph));
+            shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_INTERFACES_RX_GRAPHS, g_pSM_RadioStatsInterfacesRxGraph, &g_SM_RadioStatsInterfacesRxGraph, sizeof(shared_mem_radio_stats_interfaces_rx_graph));
       }
 
       bool bHasRecentRxData = false;
@@ -1924,9 +1808,9 @@ void _router_periodic_loop()
          memcpy((u8*)&(g_SM_ControllerRetransmissionsStats.video_streams[i]), g_pVideoProcessorRxList[i]->getControllerRetransmissionsStats(), sizeof(shared_mem_controller_retransmissions_stats));
       }
 
-      memcpy(g_pSM_VideoDecodeStats, &g_SM_VideoDecodeStats, sizeof(shared_mem_video_stream_stats_rx_processors));
-      memcpy(g_pSM_VideoDecodeStatsHistory, &g_SM_VideoDecodeStatsHistory, sizeof(shared_mem_video_stream_stats_history_rx_processors));
-      memcpy(g_pSM_ControllerRetransmissionsStats, &g_SM_ControllerRetransmissionsStats, sizeof(shared_mem_controller_retransmissions_stats_rx_processors));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_VIDEO_STREAM_STATS, g_pSM_VideoDecodeStats, &g_SM_VideoDecodeStats, sizeof(shared_mem_video_stream_stats_rx_processors));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_VIDEO_STREAM_STATS_HISTORY, g_pSM_VideoDecodeStatsHistory, &g_SM_VideoDecodeStatsHistory, sizeof(shared_mem_video_stream_stats_history_rx_processors));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_VIDEO_RETRANSMISSIONS_STATS, g_pSM_ControllerRetransmissionsStats, &g_SM_ControllerRetransmissionsStats, sizeof(shared_mem_controller_retransmissions_stats_rx_processors));
 
    }
 
@@ -1937,7 +1821,7 @@ void _router_periodic_loop()
       if ( g_SM_RadioRxQueueInfo.uCurrentIndex >= MAX_RADIO_RX_QUEUE_INFO_VALUES )
          g_SM_RadioRxQueueInfo.uCurrentIndex = 0;
       g_SM_RadioRxQueueInfo.uPendingRxPackets[g_SM_RadioRxQueueInfo.uCurrentIndex] = 0;
-      memcpy(g_pSM_RadioRxQueueInfo, &g_SM_RadioRxQueueInfo, sizeof(shared_mem_radio_rx_queue_info));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_RX_QUEUE_INFO, g_pSM_RadioRxQueueInfo, &g_SM_RadioRxQueueInfo, sizeof(shared_mem_radio_rx_queue_info));
    }
 
    static u32 uTimeLastMemoryCheck = 0;
@@ -1965,10 +1849,10 @@ void _synchronize_shared_mems()
    if ( g_TimeNow >= s_TimeLastVideoStatsUpdate + 200 )
    {
       s_TimeLastVideoStatsUpdate = g_TimeNow;
-      memcpy((u8*)g_pSM_VideoDecodeStats, (u8*)(&g_SM_VideoDecodeStats), sizeof(shared_mem_video_stream_stats_rx_processors));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_VIDEO_STREAM_STATS, g_pSM_VideoDecodeStats, &g_SM_VideoDecodeStats, sizeof(shared_mem_video_stream_stats_rx_processors));
    
       if ( NULL != g_pSM_RouterVehiclesRuntimeInfo )
-         memcpy((u8*)g_pSM_RouterVehiclesRuntimeInfo, (u8*)&g_SM_RouterVehiclesRuntimeInfo, sizeof(shared_mem_router_vehicles_runtime_info));
+         shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_ROUTER_VEHICLES_RUNTIME_INFO, g_pSM_RouterVehiclesRuntimeInfo, &g_SM_RouterVehiclesRuntimeInfo, sizeof(shared_mem_router_vehicles_runtime_info));
    }
 
    if ( NULL != g_pCurrentModel )
@@ -1979,9 +1863,9 @@ void _synchronize_shared_mems()
       update_shared_mem_video_info_stats( &g_SM_VideoInfoStatsRadioIn, g_TimeNow);
 
       if ( NULL != g_pSM_VideoInfoStatsOutput )
-         memcpy((u8*)g_pSM_VideoInfoStatsOutput, (u8*)&g_SM_VideoInfoStatsOutput, sizeof(shared_mem_video_info_stats));
+         shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_VIDEO_INFO_STATS_OUTPUT, g_pSM_VideoInfoStatsOutput, &g_SM_VideoInfoStatsOutput, sizeof(shared_mem_video_info_stats));
       if ( NULL != g_pSM_VideoInfoStatsRadioIn )
-         memcpy((u8*)g_pSM_VideoInfoStatsRadioIn, (u8*)&g_SM_VideoInfoStatsRadioIn, sizeof(shared_mem_video_info_stats));
+         shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_VIDEO_INFO_STATS_RADIO_IN, g_pSM_VideoInfoStatsRadioIn, &g_SM_VideoInfoStatsRadioIn, sizeof(shared_mem_video_info_stats));
    }
 
    static u32 s_uTimeLastRxHistorySync = 0;
@@ -1989,10 +1873,11 @@ void _synchronize_shared_mems()
    if ( g_TimeNow >= s_uTimeLastRxHistorySync + 100 )
    {
       s_uTimeLastRxHistorySync = g_TimeNow;
-      memcpy((u8*)g_pSM_HistoryRxStats, (u8*)&g_SM_HistoryRxStats, sizeof(shared_mem_radio_stats_rx_hist));
+      shared_mem_publish(g_pSM_Sequences, SHARED_MEM_SEQ_RADIO_STATS_RX_HIST, g_pSM_HistoryRxStats, &g_SM_HistoryRxStats, sizeof(shared_mem_radio_stats_rx_hist));
    }
 }
 
+void _router_init_event_loop();
 void _main_loop();
 
 void handle_sigint(int sig) 
@@ -2194,6 +2079,11 @@ int main(int argc, char *argv[])
    packets_queue_init(&s_QueueRadioPackets);
    packets_queue_init(&s_QueueControlPackets);
 
+   int iMaxRadioFrameSize = get_Preferences()->iDebugMaxPacketSize;
+   if ( iMaxRadioFrameSize > MAX_VIDEO_PACKET_DATA_SIZE )
+      iMaxRadioFrameSize = MAX_VIDEO_PACKET_DATA_SIZE;
+   radio_tx_aggregator_init(&s_RadioTxAggregator, iMaxRadioFrameSize);
+
    log_line("IPC Queues Init Complete.");
    
    g_TimeStart = get_current_timestamp_ms();
@@ -2244,11 +2134,10 @@ int main(int argc, char *argv[])
          send_alarm_to_central(ALARM_ID_FIRMWARE_OLD, i, 0);
    }
 
-   for( int i=0; i<MAX_RADIO_PACKETS_TO_CACHE_LOCALLY; i++ )
-      s_ReceivedRadioPacketsBuffer[i].pPacketData = (u8*)malloc(MAX_PACKET_TOTAL_SIZE);
-
    hw_increase_current_thread_priority("Main thread", DEFAULT_PRIORITY_THREAD_ROUTER);
 
+   _router_init_event_loop();
+
    log_line("");
    log_line("");
    log_line("----------------------------------------------");
@@ -2301,6 +2190,8 @@ int main(int argc, char *argv[])
    shared_mem_video_info_stats_close(g_pSM_VideoInfoStatsOutput);
    shared_mem_video_info_stats_radio_in_close(g_pSM_VideoInfoStatsRadioIn);
    shared_mem_router_vehicles_runtime_info_close(g_pSM_RouterVehiclesRuntimeInfo);
+   shared_mem_sequences_close(g_pSM_Sequences);
+   g_pSM_Sequences = NULL;
 
    radio_links_close_rxtx_radio_interfaces(); 
   
@@ -2372,88 +2263,12 @@ void video_processors_cleanup()
       rx_video_output_uninit();
 }
 
-void _main_loop()
+void _check_send_radio_out_queue()
 {
-   static u32 uMaxLoopTime = DEFAULT_MAX_LOOP_TIME_MILISECONDS;
-
-   //hardware_sleep_ms(1);
-   //hardware_sleep_micros(300);
-
-   g_TimeNow = get_current_timestamp_ms();
-   g_TimeNowMicros = get_current_timestamp_micros();
-   u32 tTime0 = g_TimeNow;
-
-   if ( (g_pProcessStats->uLoopCounter % 10) == 0 )
-   {
-      _router_periodic_loop();
-      _synchronize_shared_mems();
-      _check_rx_loop_consistency();
-      _check_send_or_queue_ping();
-   }
-
-   u32 tTime1 = get_current_timestamp_ms();
-
-   if ( (g_pProcessStats->uLoopCounter % 5) == 0 )
-   {
-      _read_ipc_pipes(tTime1);
-      _consume_ipc_messages();
-   }
-
-   u32 tTime2 = get_current_timestamp_ms();
-
-   int iCounter = 4;
-   int iRxPackets = 0;
-   while ( iCounter > 0 )
-   {
-      iCounter--;
-      int k = _consume_radio_rx_packets();
-      if ( k <= 0 )
-         break;
-      iRxPackets += k;
-   }
-   if ( iRxPackets == 0 )
-      hardware_sleep_ms(1);
-
-   u32 tTime3 = get_current_timestamp_ms();
-   
-   int nEndOfVideoBlock = 0;
-   /*
-   for( int i=0; i<6; i++ )
-   {
-      if ( receivedAny > 0 )
-         nEndOfVideoBlock |= process_received_radio_packets();
-      else
-         break;
-      receivedAny = try_receive_radio_packets(200);
-   }
-   */
-   u32 tTime4 = get_current_timestamp_ms();
-   
-   if ( g_bSearching )
-   {
-      u32 tNow = get_current_timestamp_ms();
-      if ( tNow > g_TimeNow + uMaxLoopTime )
-         log_softerror_and_alarm("Router loop took too long to complete (%d milisec)!!!", tNow - g_TimeNow);
-      else
-         s_iCountCPULoopOverflows = 0;
+   if ( g_bSearching || (NULL == g_pCurrentModel) )
+      return;
+   if ( ! packets_queue_has_packets(&s_QueueRadioPackets) )
       return;
-   }
-
-   for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
-   {
-      if ( g_pVideoProcessorRxList[i] == NULL )
-         break;
-      g_pVideoProcessorRxList[i]->periodicLoop(g_TimeNow);
-   }
-   
-   if ( (!g_bSearching) && (NULL != g_pCurrentModel) && g_pCurrentModel->hasCamera() )
-   {
-      rx_video_output_periodic_loop();
-      video_link_adaptive_periodic_loop();
-      video_link_keyframe_periodic_loop();
-   }
-
-   u32 tTime5 = get_current_timestamp_ms();
 
    int iCountHighPriorityPackets = 0;   
    for( int i=0; i<packets_queue_has_packets(&s_QueueRadioPackets); i++ )
@@ -2485,7 +2300,7 @@ void _main_loop()
       bSendNow = true;
    if ( g_pCurrentModel->rxtx_sync_type == RXTX_SYNC_TYPE_NONE )
       bSendNow = true;
-   if ( g_bUpdateInProgress || nEndOfVideoBlock )
+   if ( g_bUpdateInProgress )
       bSendNow = true;
    if ( s_QueueRadioPackets.timeFirstPacket + 100 < g_TimeNow )
       bSendNow = true;
@@ -2494,20 +2309,154 @@ void _main_loop()
 
    if ( bSendNow )
       _process_and_send_packets();
+}
+
+void _router_consume_radio_rx()
+{
+   get_current_timestamps(&g_TimeNow, &g_TimeNowMicros);
 
-   u32 tTime6 = get_current_timestamp_ms();
-   if ( (g_TimeNow > g_TimeStart + 10000) && (tTime6 > tTime0 + uMaxLoopTime) )
+   int iCounter = 4;
+   int iRxPackets = 0;
+   while ( iCounter > 0 )
    {
-      log_softerror_and_alarm("Router loop took too long to complete (%d milisec: %u + %u + %u + %u + %u + %u), repeat count: %u!!!", tTime6 - tTime0, tTime1-tTime0, tTime2-tTime1, tTime3-tTime2, tTime4-tTime3, tTime5-tTime4, tTime6-tTime5, s_iCountCPULoopOverflows+1);
+      iCounter--;
+      int k = _consume_radio_rx_packets();
+      if ( k <= 0 )
+         break;
+      iRxPackets += k;
+   }
+   if ( (0 == iRxPackets) || g_bSearching )
+      return;
+
+   // Reconstruct and output video right away, don't wait for the next video timer tick
+   for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
+   {
+      if ( g_pVideoProcessorRxList[i] == NULL )
+         break;
+      g_pVideoProcessorRxList[i]->periodicLoop(g_TimeNow);
+   }
+}
+
+void _router_on_radio_rx_ready(void* pContext, int iFd, u32 uTimeNow)
+{
+   radio_rx_clear_wakeup_fd();
+   _router_consume_radio_rx();
+}
+
+void _router_on_timer_ipc(void* pContext, u32 uTimeNow)
+{
+   get_current_timestamps(&g_TimeNow, &g_TimeNowMicros);
+   _read_ipc_pipes(g_TimeNow);
+   _consume_ipc_messages();
+}
+
+void _router_on_timer_video_rx(void* pContext, u32 uTimeNow)
+{
+   if ( g_bSearching )
+      return;
+   get_current_timestamps(&g_TimeNow, &g_TimeNowMicros);
+   for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
+   {
+      if ( g_pVideoProcessorRxList[i] == NULL )
+         break;
+      g_pVideoProcessorRxList[i]->periodicLoop(g_TimeNow);
+   }
+   ProcessorRxVideo::checkUpdateOutputVideoStreams(g_TimeNow);
+}
+
+void _router_on_timer_video_link(void* pContext, u32 uTimeNow)
+{
+   if ( g_bSearching || (NULL == g_pCurrentModel) || (! g_pCurrentModel->hasCamera()) )
+      return;
+   get_current_timestamps(&g_TimeNow, &g_TimeNowMicros);
+   rx_video_output_periodic_loop();
+   video_link_adaptive_periodic_loop();
+   video_link_keyframe_periodic_loop();
+}
+
+void _router_on_timer_audio(void* pContext, u32 uTimeNow)
+{
+   if ( g_bSearching || (NULL == g_pCurrentModel) || (! g_pCurrentModel->audio_params.enabled) )
+      return;
+   process_audio_periodic_loop();
+}
+
+void _router_on_timer_housekeeping(void* pContext, u32 uTimeNow)
+{
+   get_current_timestamps(&g_TimeNow, &g_TimeNowMicros);
+   _router_periodic_loop();
+   _synchronize_shared_mems();
+   _check_rx_loop_consistency();
+   _check_send_or_queue_ping();
+
+   static u32 s_uTimeLastLogEventLoopStats = 0;
+   if ( g_bDebugState )
+   if ( g_TimeNow >= s_uTimeLastLogEventLoopStats + 20000 )
+   {
+      s_uTimeLastLogEventLoopStats = g_TimeNow;
+      log_line("[EventLoop] Wakeups: %u, fd events: %u, timeouts: %u, preemptions: %u",
+         s_RouterEventLoop.uCountWakeups, s_RouterEventLoop.uCountFdEvents, s_RouterEventLoop.uCountTimeouts, s_RouterEventLoop.uCountPreemptions);
+      timer_wheel_log_stats(&s_RouterTimers);
+   }
+}
+
+void _router_init_event_loop()
+{
+   timer_wheel_init(&s_RouterTimers, get_current_timestamp_ms());
+   event_loop_init(&s_RouterEventLoop, &s_RouterTimers);
+
+   if ( radio_rx_get_wakeup_fd() >= 0 )
+      event_loop_add_fd(&s_RouterEventLoop, radio_rx_get_wakeup_fd(), 1, _router_on_radio_rx_ready, NULL);
+   else
+      log_softerror_and_alarm("No radio rx wakeup fd. Router will poll for radio packets.");
+
+   // IPC channels are SysV message queues, they can't be waited on, so they are read on a short timer
+   timer_wheel_add(&s_RouterTimers, "ipc", ROUTER_TIMER_INTERVAL_IPC_MS, 1, _router_on_timer_ipc, NULL);
+   timer_wheel_add(&s_RouterTimers, "video-rx", ROUTER_TIMER_INTERVAL_VIDEO_RX_MS, 1, _router_on_timer_video_rx, NULL);
+   timer_wheel_add(&s_RouterTimers, "video-link", ROUTER_TIMER_INTERVAL_VIDEO_LINK_MS, 1, _router_on_timer_video_link, NULL);
+   timer_wheel_add(&s_RouterTimers, "audio", ROUTER_TIMER_INTERVAL_AUDIO_MS, 1, _router_on_timer_audio, NULL);
+   timer_wheel_add(&s_RouterTimers, "housekeeping", ROUTER_TIMER_INTERVAL_HOUSEKEEPING_MS, 1, _router_on_timer_housekeeping, NULL);
+   log_line("Router event loop initialized: %d timers, %d fd sources.", s_RouterTimers.iCountActiveTimers, s_RouterEventLoop.iCountSources);
+}
+
+void _main_loop()
+{
+   static u32 uMaxLoopTime = DEFAULT_MAX_LOOP_TIME_MILISECONDS;
+
+   int iMaxWaitMs = ROUTER_LOOP_MAX_WAIT_MS;
+   if ( radio_rx_get_wakeup_fd() < 0 )
+      iMaxWaitMs = 1;
+
+   // Packets left over from a previous capped rx drain don't signal the wakeup fd again
+   if ( radio_rx_has_packets_to_consume() > 0 )
+   {
+      _router_consume_radio_rx();
+      iMaxWaitMs = 0;
+   }
+
+   event_loop_run_once(&s_RouterEventLoop, iMaxWaitMs);
+   if ( g_bQuit )
+      return;
+
+   g_TimeNow = get_current_timestamp_ms();
+   _check_send_radio_out_queue();
+
+   u32 tTime0 = s_RouterEventLoop.uTimeLastWakeup;
+   u32 tTime1 = get_current_timestamp_ms();
+   // While searching, the radio links are reconfigured often; don't raise overload alarms for it
+   if ( (! g_bSearching) && (g_TimeNow > g_TimeStart + 10000) && (tTime1 > tTime0 + uMaxLoopTime) )
+   {
+      log_softerror_and_alarm("Router loop took too long to complete (%d milisec), repeat count: %u!!!", tTime1 - tTime0, s_iCountCPULoopOverflows+1);
+      timer_wheel_log_stats(&s_RouterTimers);
 
       s_iCountCPULoopOverflows++;
       if ( s_iCountCPULoopOverflows > 5 )
       if ( g_TimeNow > g_TimeLastSetRadioFlagsCommandSent + 5000 )
-         send_alarm_to_central(ALARM_ID_CONTROLLER_CPU_LOOP_OVERLOAD,(tTime6-tTime0), 0);
+         send_alarm_to_central(ALARM_ID_CONTROLLER_CPU_LOOP_OVERLOAD,(tTime1-tTime0), 0);
 
-      if ( tTime6 >= tTime0 + 300 )
+      if ( tTime1 >= tTime0 + 300 )
       if ( g_TimeNow > g_TimeLastSetRadioFlagsCommandSent + 5000 )
-         send_alarm_to_central(ALARM_ID_CONTROLLER_CPU_LOOP_OVERLOAD,(tTime6-tTime0)<<16, 0);
+         send_alarm_to_central(ALARM_ID_CONTROLLER_CPU_LOOP_OVERLOAD,(tTime1-tTime0)<<16, 0);
    }
    else
    {
@@ -2516,10 +2465,10 @@ void _main_loop()
 
    if ( NULL != g_pProcessStats )
    {
-      if ( g_pProcessStats->uMaxLoopTimeMs < tTime6 - tTime0 )
-         g_pProcessStats->uMaxLoopTimeMs = tTime6 - tTime0;
-      g_pProcessStats->uTotalLoopTime += tTime6 - tTime0;
+      if ( g_pProcessStats->uMaxLoopTimeMs < tTime1 - tTime0 )
+         g_pProcessStats->uMaxLoopTimeMs = tTime1 - tTime0;
+      g_pProcessStats->uTotalLoopTime += tTime1 - tTime0;
       if ( 0 != g_pProcessStats->uLoopCounter )
          g_pProcessStats->uAverageLoopTimeMs = g_pProcessStats->uTotalLoopTime / g_pProcessStats->uLoopCounter;
    }
-}
\ No newline at end of file
+}
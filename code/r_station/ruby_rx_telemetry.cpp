@@ -42,6 +42,7 @@
 #include "../base/ctrl_interfaces.h"
 #include "../base/controller_utils.h"
 #include "../base/ruby_ipc.h"
+#include "../base/telemetry_framer.h"
 #include "../common/string_utils.h"
 
 #include "timers.h"
@@ -82,14 +83,12 @@ int g_iSerialPortTelemetrySpeed = 0;
 bool g_bOutputTelemetryToSerial = false;
 bool g_bInputTelemetryFromSerial = false;
 
-u8 telemetryBufferToVehicle[RAW_TELEMETRY_MAX_BUFFER];
+// Serial data is read straight into the framers and uploaded from there (no staging buffers).
+// Telemetry input is framed (MAVLink/LTM) so it can be sent as soon as complete messages are read.
+t_telemetry_framer s_TelemetryFramerInput;
+t_telemetry_framer s_TelemetryFramerDataLink;
 int telemetryBufferToVehicleMaxSize = RAW_TELEMETRY_MAX_BUFFER;
-int telemetryBufferToVehicleCount = 0;
 u32 telemetryBufferToVehicleLastSendTime = 0;
-
-u8 dataLinkBufferToVehicle[RAW_TELEMETRY_MAX_BUFFER];
-int dataLinkBufferToVehicleMaxSize = RAW_TELEMETRY_MAX_BUFFER;
-int dataLinkBufferToVehicleCount = 0;
 u32 dataLinkBufferToVehicleLastSendTime = 0;
 
 u32 s_uRawTelemetryUploadTotalReadFromSerial = 0;
@@ -280,7 +279,7 @@ void _process_packet_vehicle_rx_stats(u8* pBuffer, int length)
 }
 
 
-void upload_telemetry_packet()
+void upload_telemetry_packet(u8* pData, int iLength)
 {
    if ( NULL == g_pCurrentModel || g_pCurrentModel->is_spectator )
       return;
@@ -290,14 +289,14 @@ void upload_telemetry_packet()
    if ( NULL != g_pProcessStats )
       g_pProcessStats->lastIPCOutgoingTime = g_TimeNow;
 
-   if ( telemetryBufferToVehicleCount > RAW_TELEMETRY_MAX_BUFFER )
+   if ( iLength > RAW_TELEMETRY_MAX_BUFFER )
    {
-      log_softerror_and_alarm("Trying to send more telemetry data than expected to uplink: %d bytes, max expected: %d bytes. Sending only max allowed.", telemetryBufferToVehicleCount, RAW_TELEMETRY_MAX_BUFFER);
-      telemetryBufferToVehicleCount = RAW_TELEMETRY_MAX_BUFFER;
+      log_softerror_and_alarm("Trying to send more telemetry data than expected to uplink: %d bytes, max expected: %d bytes. Sending only max allowed.", iLength, RAW_TELEMETRY_MAX_BUFFER);
+      iLength = RAW_TELEMETRY_MAX_BUFFER;
    }
 
-   s_uRawTelemetryUploadTotalSend += telemetryBufferToVehicleCount;
-   s_uUplink_bps += telemetryBufferToVehicleCount * 8;
+   s_uRawTelemetryUploadTotalSend += iLength;
+   s_uUplink_bps += iLength * 8;
 
    t_packet_header PH;
    t_packet_header_telemetry_raw PHTR;
@@ -306,30 +305,29 @@ void upload_telemetry_packet()
 
    PH.vehicle_id_src = g_uControllerId;
    PH.vehicle_id_dest = g_pCurrentModel->uVehicleId;
-   PH.total_length = sizeof(t_packet_header)+sizeof(t_packet_header_telemetry_raw) + telemetryBufferToVehicleCount;
+   PH.total_length = sizeof(t_packet_header)+sizeof(t_packet_header_telemetry_raw) + iLength;
       
    PHTR.telem_segment_index = s_uRawTelemetryUploadSegmentIndex;
    PHTR.telem_total_data = s_uRawTelemetryUploadTotalSend;
    PHTR.telem_total_serial = s_uRawTelemetryUploadTotalReadFromSerial;
 
-   //log_line("Sending raw telemetry to controller, segment index: %u, total serial: %u, total data: %u, length: %d", dptr.telem_segment_index, dptr.telem_total_serial, dptr.telem_total_data, telemetryBufferToVehicleCount);
+   //log_line("Sending raw telemetry to controller, segment index: %u, total serial: %u, total data: %u, length: %d", dptr.telem_segment_index, dptr.telem_total_serial, dptr.telem_total_data, iLength);
 
    u8 buffer[MAX_PACKET_TOTAL_SIZE];
    memcpy(buffer, (u8*)&PH, sizeof(t_packet_header));
    memcpy(buffer+sizeof(t_packet_header), (u8*)&PHTR, sizeof(t_packet_header_telemetry_raw));
-   memcpy(buffer+sizeof(t_packet_header)+sizeof(t_packet_header_telemetry_raw), telemetryBufferToVehicle, telemetryBufferToVehicleCount);
+   memcpy(buffer+sizeof(t_packet_header)+sizeof(t_packet_header_telemetry_raw), pData, iLength);
    ruby_ipc_channel_send_message(s_fIPCToRouter, buffer, PH.total_length);
  
    #ifdef LOG_RAW_TELEMETRY
-   log_line("[Raw_Telem] Sent raw telemetry packet to router, index %u, %d / %d bytes", PHTR.telem_segment_index, telemetryBufferToVehicleCount, PH.total_length);
+   log_line("[Raw_Telem] Sent raw telemetry packet to router, index %u, %d / %d bytes", PHTR.telem_segment_index, iLength, PH.total_length);
    #endif
    telemetryBufferToVehicleLastSendTime = g_TimeNow;
-   telemetryBufferToVehicleCount = 0;
    s_uRawTelemetryUploadSegmentIndex++;
 }
 
 
-void upload_datalink_packet()
+void upload_datalink_packet(u8* pData, int iLength)
 {
    if ( NULL == g_pCurrentModel || g_pCurrentModel->is_spectator )
       return;
@@ -338,122 +336,79 @@ void upload_datalink_packet()
 
    if ( NULL != g_pProcessStats )
       g_pProcessStats->lastIPCOutgoingTime = g_TimeNow;
-   if ( dataLinkBufferToVehicleCount > RAW_TELEMETRY_MAX_BUFFER )
+   if ( iLength > RAW_TELEMETRY_MAX_BUFFER )
    {
-      log_softerror_and_alarm("Trying to send more data link data than expected to uplink: %d bytes, max expected: %d bytes. Sending only max allowed.", dataLinkBufferToVehicleCount, RAW_TELEMETRY_MAX_BUFFER);
-      dataLinkBufferToVehicleCount = RAW_TELEMETRY_MAX_BUFFER;
+      log_softerror_and_alarm("Trying to send more data link data than expected to uplink: %d bytes, max expected: %d bytes. Sending only max allowed.", iLength, RAW_TELEMETRY_MAX_BUFFER);
+      iLength = RAW_TELEMETRY_MAX_BUFFER;
    }
 
-   s_uUplink_bps += dataLinkBufferToVehicleCount * 8;
+   s_uUplink_bps += iLength * 8;
 
    t_packet_header PH;
 
    radio_packet_init(&PH, PACKET_COMPONENT_TELEMETRY, PACKET_TYPE_AUX_DATA_LINK_UPLOAD, STREAM_ID_DATA2);
    PH.vehicle_id_src = g_uControllerId;
    PH.vehicle_id_dest = g_pCurrentModel->uVehicleId;
-   PH.total_length = sizeof(t_packet_header) + sizeof(u32) + dataLinkBufferToVehicleCount;
+   PH.total_length = sizeof(t_packet_header) + sizeof(u32) + iLength;
 
    u8 buffer[MAX_PACKET_TOTAL_SIZE];
    memcpy(buffer, (u8*)&PH, sizeof(t_packet_header));
    memcpy(buffer+sizeof(t_packet_header), (u8*)&s_uDataLinkUploadSegmentIndex, sizeof(u32));
-   memcpy(buffer+sizeof(t_packet_header)+sizeof(u32), dataLinkBufferToVehicle, dataLinkBufferToVehicleCount);
+   memcpy(buffer+sizeof(t_packet_header)+sizeof(u32), pData, iLength);
    ruby_ipc_channel_send_message(s_fIPCToRouter, buffer, PH.total_length);
    dataLinkBufferToVehicleLastSendTime = g_TimeNow;
-   dataLinkBufferToVehicleCount = 0;
    s_uDataLinkUploadSegmentIndex++;
 }
 
-void try_read_serial_telemetry()
+// Uploads the telemetry read from the serial port: full packets right away, then the rest when there is
+// enough of it, when it's old enough or, for framed telemetry, when it ends on a complete message
+void upload_serial_telemetry()
 {
-   if ( -1 == g_iSerialPortTelemetry )
-      return;
-   if ( NULL == g_pCurrentModel || g_pCurrentModel->is_spectator )
-      return;
-
-   u8 bufferIn[RAW_TELEMETRY_MAX_BUFFER];
-   struct timeval to;
-   to.tv_sec = 0;
-   to.tv_usec = 2000; // 2 ms
-   fd_set readset;   
-   FD_ZERO(&readset);
-   FD_SET(g_iSerialPortTelemetry, &readset);
-   int res = select(g_iSerialPortTelemetry+1, &readset, NULL, NULL, &to);
-   if ( res <= 0 )
-      return;
-   if ( ! FD_ISSET(g_iSerialPortTelemetry, &readset) )
+   u8* pData = NULL;
+   int iReady = telemetry_framer_get_ready_data(&s_TelemetryFramerInput, &pData);
+   while ( iReady >= telemetryBufferToVehicleMaxSize )
+   {
+      upload_telemetry_packet(pData, telemetryBufferToVehicleMaxSize);
+      telemetry_framer_consume(&s_TelemetryFramerInput, telemetryBufferToVehicleMaxSize);
+      iReady = telemetry_framer_get_ready_data(&s_TelemetryFramerInput, &pData);
+   }
+   if ( iReady <= 0 )
       return;
 
-   int length = read(g_iSerialPortTelemetry, bufferIn, RAW_TELEMETRY_MAX_BUFFER);
-   if ( length <= 0 )
-      return;
+   bool bSend = false;
+   if ( iReady >= RAW_TELEMETRY_MIN_SEND_LENGTH )
+      bSend = true;
+   else if ( g_TimeNow >= telemetryBufferToVehicleLastSendTime + RAW_TELEMETRY_SEND_TIMEOUT )
+      bSend = true;
+   else if ( (s_TelemetryFramerInput.iProtocol != TELEMETRY_FRAMER_PROTOCOL_RAW) && s_TelemetryFramerInput.iReadyEndsOnFrame )
+   if ( g_TimeNow >= telemetryBufferToVehicleLastSendTime + RAW_TELEMETRY_FRAMED_SEND_INTERVAL )
+      bSend = true;
 
-   s_uRawTelemetryUploadTotalReadFromSerial += length;
-   u8* pData = &bufferIn[0];
-   while ( length > 0 )
+   if ( bSend )
    {
-         if ( telemetryBufferToVehicleCount + length < telemetryBufferToVehicleMaxSize )
-         {
-            memcpy(&(telemetryBufferToVehicle[telemetryBufferToVehicleCount]), pData, length);
-            telemetryBufferToVehicleCount += length;
-            return;
-         }
-         int chunkSize = telemetryBufferToVehicleMaxSize-telemetryBufferToVehicleCount;
-         memcpy(&(telemetryBufferToVehicle[telemetryBufferToVehicleCount]), pData, chunkSize);
-         telemetryBufferToVehicleCount += chunkSize;
-         pData += chunkSize;
-         length -= chunkSize;
-         upload_telemetry_packet();
+      upload_telemetry_packet(pData, iReady);
+      telemetry_framer_consume(&s_TelemetryFramerInput, iReady);
    }
-}  
+}
 
-void try_read_serial_datalink()
+void upload_serial_datalink()
 {
-   if ( -1 == g_iSerialPortDataLink )
-      return;
-   if ( NULL == g_pCurrentModel || g_pCurrentModel->is_spectator )
-      return;
-
-   u8 bufferIn[RAW_TELEMETRY_MAX_BUFFER];
-   struct timeval to;
-   to.tv_sec = 0;
-   to.tv_usec = 1000; // 1 ms
-   fd_set readset;   
-   FD_ZERO(&readset);
-   FD_SET(g_iSerialPortDataLink, &readset);
-   int res = select(g_iSerialPortDataLink+1, &readset, NULL, NULL, &to);
-   if ( res <= 0 )
-      return;
-   if ( ! FD_ISSET(g_iSerialPortDataLink, &readset) )
-      return;
-
-   int length = read(g_iSerialPortDataLink, bufferIn, RAW_TELEMETRY_MAX_BUFFER);
-   if ( length <= 0 )
+   u8* pData = NULL;
+   int iReady = telemetry_framer_get_ready_data(&s_TelemetryFramerDataLink, &pData);
+   while ( iReady >= RAW_TELEMETRY_MAX_BUFFER )
+   {
+      upload_datalink_packet(pData, RAW_TELEMETRY_MAX_BUFFER);
+      telemetry_framer_consume(&s_TelemetryFramerDataLink, RAW_TELEMETRY_MAX_BUFFER);
+      iReady = telemetry_framer_get_ready_data(&s_TelemetryFramerDataLink, &pData);
+   }
+   if ( iReady <= 0 )
       return;
-
-   //log_line("Serial datalink read %d bytes.", length);
-   //char szBuff[2000];
-   //memcpy(szBuff, &bufferIn[0], length);
-   //szBuff[length] = 0;
-   //log_line("Sending datalink data: %s", szBuff);
-   
-
-   u8* pData = &bufferIn[0];
-   while ( length > 0 )
+   if ( (iReady >= AUXILIARY_DATA_LINK_MIN_SEND_LENGTH) || (g_TimeNow >= dataLinkBufferToVehicleLastSendTime + AUXILIARY_DATA_LINK_SEND_TIMEOUT) )
    {
-         if ( dataLinkBufferToVehicleCount + length < dataLinkBufferToVehicleMaxSize )
-         {
-            memcpy(&(dataLinkBufferToVehicle[dataLinkBufferToVehicleCount]), pData, length);
-            dataLinkBufferToVehicleCount += length;
-            return;
-         }
-         int chunkSize = dataLinkBufferToVehicleMaxSize-dataLinkBufferToVehicleCount;
-         memcpy(&(dataLinkBufferToVehicle[dataLinkBufferToVehicleCount]), pData, chunkSize);
-         dataLinkBufferToVehicleCount += chunkSize;
-         pData += chunkSize;
-         length -= chunkSize;
-         upload_datalink_packet();
+      upload_datalink_packet(pData, iReady);
+      telemetry_framer_consume(&s_TelemetryFramerDataLink, iReady);
    }
-}  
+}
 
 void try_read_messages_from_router()
 {
@@ -566,6 +521,10 @@ void init_serial_ports()
 {
    ControllerSettings* pCS = get_ControllerSettings();
 
+   // Ports get reopened (maybe with the same file descriptors), discard any partial data
+   telemetry_framer_reset(&s_TelemetryFramerInput);
+   telemetry_framer_reset(&s_TelemetryFramerDataLink);
+
    g_iSerialPortIndexDataLink = -1;
    g_iSerialPortDataLinkSpeed = -1;
    hw_serial_port_info_t* pPortInfo = NULL;
@@ -635,7 +594,6 @@ void init_serial_ports()
    log_line("Using a telemetry serial read buffer of maximum %d bytes", telemetryBufferToVehicleMaxSize);
    log_line("Using a telemetry serial buffer minimum send size of %d bytes", RAW_TELEMETRY_MIN_SEND_LENGTH);
 
-   telemetryBufferToVehicleCount = 0;
    telemetryBufferToVehicleLastSendTime = g_TimeNow;
    
    pPortInfo = hardware_get_serial_port_info(portIndex);
@@ -658,6 +616,11 @@ void init_serial_ports()
    }
 
    log_line("Telemetry is enabled on controller serial port %s (%s). Configuring serial port...", pPortInfo->szName, pPortInfo->szPortDeviceName);
+
+   if ( pPortInfo->iPortUsage == SERIAL_PORT_USAGE_TELEMETRY_LTM )
+      s_TelemetryFramerInput.iProtocol = TELEMETRY_FRAMER_PROTOCOL_LTM;
+   else
+      s_TelemetryFramerInput.iProtocol = TELEMETRY_FRAMER_PROTOCOL_MAVLINK;
    hardware_configure_serial(pPortInfo->szPortDeviceName, pPortInfo->lPortSpeed );
    g_iSerialPortTelemetry = hardware_open_serial_port(pPortInfo->szPortDeviceName, pPortInfo->lPortSpeed);
    if ( -1 == g_iSerialPortTelemetry )
@@ -904,6 +867,8 @@ int main(int argc, char *argv[])
 
    load_ControllerInterfacesSettings();
    load_ControllerSettings();
+   telemetry_framer_init(&s_TelemetryFramerInput, TELEMETRY_FRAMER_PROTOCOL_MAVLINK, 0, NULL);
+   telemetry_framer_init(&s_TelemetryFramerDataLink, TELEMETRY_FRAMER_PROTOCOL_RAW, 0, NULL);
    init_serial_ports();
 
    Preferences* p = get_Preferences();   
@@ -927,10 +892,15 @@ int main(int argc, char *argv[])
    g_TimeStart = get_current_timestamp_ms();
  
    int iSleepTime = 50;
+   t_telemetry_framer* pFramers[2] = { &s_TelemetryFramerInput, &s_TelemetryFramerDataLink };
 
    while (!g_bQuit) 
    {
-      hardware_sleep_ms(iSleepTime);
+      // One poll set for all the serial ports: wakes up as soon as serial data is available
+      bool bCanReadSerial = (NULL != g_pCurrentModel) && (! g_pCurrentModel->is_spectator);
+      telemetry_framer_set_fd(&s_TelemetryFramerInput, (bCanReadSerial && g_bInputTelemetryFromSerial)?g_iSerialPortTelemetry:-1);
+      telemetry_framer_set_fd(&s_TelemetryFramerDataLink, bCanReadSerial?g_iSerialPortDataLink:-1);
+      telemetry_framer_poll(pFramers, 2, iSleepTime);
 
       g_TimeNow = get_current_timestamp_ms();
       if ( NULL != g_pProcessStats )
@@ -945,22 +915,17 @@ int main(int argc, char *argv[])
       periodic_checks();
 
       iSleepTime = 50;
-      if ( g_bInputTelemetryFromSerial )
+      if ( -1 != s_TelemetryFramerInput.iFd )
       {
          iSleepTime = 10;
-         try_read_serial_telemetry();
-         if ( telemetryBufferToVehicleCount >= RAW_TELEMETRY_MIN_SEND_LENGTH || 
-             (telemetryBufferToVehicleCount > 0 && g_TimeNow >= telemetryBufferToVehicleLastSendTime + RAW_TELEMETRY_SEND_TIMEOUT ) )
-            upload_telemetry_packet();
+         s_uRawTelemetryUploadTotalReadFromSerial += s_TelemetryFramerInput.iLastReadBytes;
+         upload_serial_telemetry();
       }
 
-      if ( -1 != g_iSerialPortDataLink )
+      if ( -1 != s_TelemetryFramerDataLink.iFd )
       {
          iSleepTime = 10;
-         try_read_serial_datalink();
-         if ( dataLinkBufferToVehicleCount >= AUXILIARY_DATA_LINK_MIN_SEND_LENGTH || 
-             (dataLinkBufferToVehicleCount > 0 && g_TimeNow >= dataLinkBufferToVehicleLastSendTime + AUXILIARY_DATA_LINK_SEND_TIMEOUT ) )
-            upload_datalink_packet();
+         upload_serial_datalink();
       }
 
       try_read_messages_from_router();
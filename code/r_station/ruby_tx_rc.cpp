@@ -57,6 +57,7 @@
 #include "../base/controller_utils.h"
 #include "../base/ruby_ipc.h"
 #include "../common/string_utils.h"
+#include "../common/rc_tx_scheduler.h"
 
 #include "timers.h"
 #include "shared_vars.h"
@@ -66,6 +67,8 @@
 
 
 #define MAX_SERIAL_BUFFER_SIZE 512
+// Longest sleep while waiting for the next RC frame, so the router messages are still read often
+#define RC_TX_MAX_WAIT_MICROS 10000
 
 u32 g_iFPSFramesCount = 0;
 int g_iFPSMaxJoystickEvents = 0;
@@ -93,8 +96,8 @@ u16 s_ComputedRCValues[MAX_RC_CHANNELS];
 
 u32 s_uLastTimeStampRCInFrame = 0;
 u8 s_uLastFrameIndexRCIn = 0;
-u32 s_uTimeLastRCFrameSent = 0;
-u32 s_uTimeBetweenRCFramesOutput = 100000;
+t_rc_tx_scheduler s_RCTxScheduler;
+u32 s_uTimeLastRCTxSchedulerLog = 0;
 
 void init_controller_settings();
 
@@ -109,7 +112,8 @@ void populate_rc_data( t_packet_header_rc_full_frame_upstream* pPHRCF )
 }
 
 
-bool handle_joysticks()
+// iReadMs: how long to wait for and read the joystick events
+bool handle_joysticks(int iReadMs)
 {
    ControllerInterfacesSettings* pCI = get_ControllerInterfacesSettings();
 
@@ -151,7 +155,7 @@ bool handle_joysticks()
    if ( NULL == s_pJoystick || NULL == s_pCII )
       return false;
    
-   int countEvents = hardware_read_joystick(s_pCII->currentHardwareIndex, 5);
+   int countEvents = hardware_read_joystick(s_pCII->currentHardwareIndex, iReadMs);
    if ( countEvents < 0 )
    {
       log_line("Hardware: failed to read joystick.");
@@ -201,8 +205,8 @@ void try_read_pipes()
                if ( NULL != g_pCurrentModel )
                {
                   log_line("RC is enabled: %s", g_pCurrentModel->rc_params.rc_enabled?"yes":"no");
-                  s_uTimeBetweenRCFramesOutput = 1000/g_pCurrentModel->rc_params.rc_frames_per_second;
-                  log_line("Using a RC rate of %d packets/sec, %u ms between packets", g_pCurrentModel->rc_params.rc_frames_per_second, s_uTimeBetweenRCFramesOutput);
+                  rc_tx_scheduler_set_rate(&s_RCTxScheduler, g_pCurrentModel->rc_params.rc_frames_per_second);
+                  log_line("Using a RC rate of %d packets/sec, %u us between packets", g_pCurrentModel->rc_params.rc_frames_per_second, s_RCTxScheduler.uPeriodMicros);
                }
                load_ControllerInterfacesSettings();
             }
@@ -225,6 +229,47 @@ void try_read_pipes()
    }
 }
 
+void _read_rc_inputs(int iJoystickReadMs)
+{
+   #ifdef FEATURE_ENABLE_RC
+   if ( g_pCurrentModel->rc_params.inputType == RC_INPUT_TYPE_RC_IN_SBUS_IBUS )
+   {
+      g_PHRCFUpstream.flags &= (~RC_FULL_FRAME_FLAGS_HAS_INPUT);
+
+      if ( NULL == s_pSM_RCIn )
+         s_pSM_RCIn = shared_mem_i2c_controller_rc_in_open_for_read();
+      if ( NULL != s_pSM_RCIn )
+      if ( s_pSM_RCIn->uFlags & RC_IN_FLAG_HAS_INPUT )
+      {
+         g_PHRCFUpstream.flags |= RC_FULL_FRAME_FLAGS_HAS_INPUT;
+         if ( (s_uLastTimeStampRCInFrame != s_pSM_RCIn->uTimeStamp) && (s_uLastFrameIndexRCIn != s_pSM_RCIn->uFrameIndex) )
+         {
+            s_uLastTimeStampRCInFrame = s_pSM_RCIn->uTimeStamp;
+            s_uLastFrameIndexRCIn = s_pSM_RCIn->uFrameIndex;
+            int nCh = g_pCurrentModel->rc_params.channelsCount;
+            if ( nCh > (int)(s_pSM_RCIn->uChannelsCount) )
+               nCh = (int)(s_pSM_RCIn->uChannelsCount);
+            for( int i=0; i<nCh; i++ )
+               s_ComputedRCValues[i] = s_pSM_RCIn->uChannels[i];
+
+            //log_line("%d %d %d", s_pSM_RCIn->uChannels[0], s_pSM_RCIn->uChannels[1], s_pSM_RCIn->uChannels[2] );
+         }
+      }
+
+      if ( s_uLastTimeStampRCInFrame + g_pCurrentModel->rc_params.rc_failsafe_timeout_ms < g_TimeNow )
+         g_PHRCFUpstream.flags &= ~RC_FULL_FRAME_FLAGS_HAS_INPUT;
+   }
+
+   if ( g_pCurrentModel->rc_params.inputType == RC_INPUT_TYPE_USB )
+   {
+      if ( handle_joysticks(iJoystickReadMs) )
+         g_PHRCFUpstream.flags |= RC_FULL_FRAME_FLAGS_HAS_INPUT;
+      else
+         g_PHRCFUpstream.flags &= (~RC_FULL_FRAME_FLAGS_HAS_INPUT);
+   }
+   #endif
+}
+
 void init_controller_settings()
 {
    load_ControllerInterfacesSettings();
@@ -301,12 +346,12 @@ int main (int argc, char *argv[])
    else
       log_line("Opened shared mem for RC tx process watchdog stats for writing.");
  
-   s_uTimeBetweenRCFramesOutput = 100000;
+   rc_tx_scheduler_init(&s_RCTxScheduler, DEFAULT_RC_FRAMES_PER_SECOND);
    if ( NULL != g_pCurrentModel )
    {
       log_line("RC is enabled: %s", g_pCurrentModel->rc_params.rc_enabled?"yes":"no");
-      s_uTimeBetweenRCFramesOutput = 1000/g_pCurrentModel->rc_params.rc_frames_per_second;
-      log_line("Using a RC rate of %d packets/sec, %u ms between packets", g_pCurrentModel->rc_params.rc_frames_per_second, s_uTimeBetweenRCFramesOutput);
+      rc_tx_scheduler_set_rate(&s_RCTxScheduler, g_pCurrentModel->rc_params.rc_frames_per_second);
+      log_line("Using a RC rate of %d packets/sec, %u us between packets", g_pCurrentModel->rc_params.rc_frames_per_second, s_RCTxScheduler.uPeriodMicros);
    }
    else
       log_line("No model. RC is inactive.");
@@ -345,12 +390,14 @@ int main (int argc, char *argv[])
       memcpy(s_pPHRCFUpstream, &g_PHRCFUpstream, sizeof(t_packet_header_rc_full_frame_upstream) );
 
    g_TimeStart = get_current_timestamp_ms(); 
+   s_uTimeLastRCTxSchedulerLog = g_TimeStart;
 
-   int iSleepTime = 50;
+   u32 uSleepTimeMicros = 50000;
    while ( !g_bQuit )
    { 
       g_iFPSFramesCount++;
-      hardware_sleep_ms(iSleepTime);
+      if ( uSleepTimeMicros > 0 )
+         hardware_sleep_micros(uSleepTimeMicros);
 
       g_TimeNow = get_current_timestamp_ms();
       u32 tTime0 = g_TimeNow;
@@ -372,7 +419,7 @@ int main (int argc, char *argv[])
       if ( (g_pCurrentModel->rc_params.rc_enabled && (!g_pCurrentModel->is_spectator)) || ((g_iFPSFramesCount % 3) == 0) )
          try_read_pipes();
 
-      iSleepTime = 50;
+      uSleepTimeMicros = 50000;
 
       if ( g_bSearching || g_bUpdateInProgress )
       {
@@ -392,56 +439,41 @@ int main (int argc, char *argv[])
    
       #ifdef FEATURE_ENABLE_RC
 
-      iSleepTime = 5;
-      if ( g_pCurrentModel->rc_params.inputType == RC_INPUT_TYPE_RC_IN_SBUS_IBUS )
+      // Wait for the inputs sampling point of the next frame
+      u32 uMicrosToNext = rc_tx_scheduler_get_micros_to_next(&s_RCTxScheduler, get_current_timestamp_micros());
+      if ( uMicrosToNext > RC_TX_SCHEDULER_INPUT_LEAD_MICROS )
       {
-         g_PHRCFUpstream.flags &= (~RC_FULL_FRAME_FLAGS_HAS_INPUT);
+         uSleepTimeMicros = uMicrosToNext - RC_TX_SCHEDULER_INPUT_LEAD_MICROS;
+         if ( uSleepTimeMicros > RC_TX_MAX_WAIT_MICROS )
+            uSleepTimeMicros = RC_TX_MAX_WAIT_MICROS;
 
-         if ( NULL == s_pSM_RCIn )
-            s_pSM_RCIn = shared_mem_i2c_controller_rc_in_open_for_read();
-         if ( NULL != s_pSM_RCIn )
-         if ( s_pSM_RCIn->uFlags & RC_IN_FLAG_HAS_INPUT )
+         // Joystick reads wait for its events, so they take the place of the loop sleep
+         if ( g_pCurrentModel->rc_params.inputType == RC_INPUT_TYPE_USB )
          {
-            g_PHRCFUpstream.flags |= RC_FULL_FRAME_FLAGS_HAS_INPUT;
-            if ( (s_uLastTimeStampRCInFrame != s_pSM_RCIn->uTimeStamp) && (s_uLastFrameIndexRCIn != s_pSM_RCIn->uFrameIndex) )
+            u32 uReadMs = uSleepTimeMicros/1000;
+            if ( uReadMs > 5 )
+               uReadMs = 5;
+            if ( uReadMs > 0 )
             {
-               s_uLastTimeStampRCInFrame = s_pSM_RCIn->uTimeStamp;
-               s_uLastFrameIndexRCIn = s_pSM_RCIn->uFrameIndex;
-               int nCh = g_pCurrentModel->rc_params.channelsCount;
-               if ( nCh > (int)(s_pSM_RCIn->uChannelsCount) )
-                  nCh = (int)(s_pSM_RCIn->uChannelsCount);
-               for( int i=0; i<nCh; i++ )
-                  s_ComputedRCValues[i] = s_pSM_RCIn->uChannels[i];
-
-               //log_line("%d %d %d", s_pSM_RCIn->uChannels[0], s_pSM_RCIn->uChannels[1], s_pSM_RCIn->uChannels[2] );
+               _read_rc_inputs((int)uReadMs);
+               uSleepTimeMicros -= uReadMs*1000;
             }
          }
-
-         if ( s_uLastTimeStampRCInFrame + g_pCurrentModel->rc_params.rc_failsafe_timeout_ms < g_TimeNow )
-            g_PHRCFUpstream.flags &= ~RC_FULL_FRAME_FLAGS_HAS_INPUT;
-      }
-
-      if ( g_pCurrentModel->rc_params.inputType == RC_INPUT_TYPE_USB )
-      {
-         if ( handle_joysticks() )
-            g_PHRCFUpstream.flags |= RC_FULL_FRAME_FLAGS_HAS_INPUT;
-         else
-            g_PHRCFUpstream.flags &= (~RC_FULL_FRAME_FLAGS_HAS_INPUT);
-      }
-
-      if ( g_TimeNow < s_uTimeLastRCFrameSent + s_uTimeBetweenRCFramesOutput )
-      {
          _update_loop_info(tTime0);
-
-         u32 uDelta = s_uTimeLastRCFrameSent + s_uTimeBetweenRCFramesOutput - g_TimeNow;
-         if ( uDelta > 40 )
-            uDelta = 40;
-         hardware_sleep_ms(uDelta/2);
          continue;
       }
 
-      u32 miliSec = g_TimeNow - s_uTimeLastRCFrameSent;
-      s_uTimeLastRCFrameSent = g_TimeNow;
+      // Sample the inputs as late as possible, then send the frame right at its deadline
+      _read_rc_inputs(1);
+      uMicrosToNext = rc_tx_scheduler_get_micros_to_next(&s_RCTxScheduler, get_current_timestamp_micros());
+      if ( uMicrosToNext > 0 )
+         hardware_sleep_micros(uMicrosToNext);
+      uSleepTimeMicros = 0;
+
+      u32 uTimeNowMicros = get_current_timestamp_micros();
+      u32 miliSec = s_RCTxScheduler.uPeriodMicros/1000;
+      if ( s_RCTxScheduler.iStarted )
+         miliSec = (uTimeNowMicros - s_RCTxScheduler.uLastFrameTimeMicros)/1000;
 
       if ( g_pCurrentModel->rc_params.inputType == RC_INPUT_TYPE_USB )
       {
@@ -463,8 +495,19 @@ int main (int argc, char *argv[])
       memcpy(buffer, &gPH, sizeof(t_packet_header));
       memcpy(buffer+sizeof(t_packet_header), (u8*)&g_PHRCFUpstream, sizeof(t_packet_header_rc_full_frame_upstream));
       ruby_ipc_channel_send_message(s_fIPCToRouter, buffer, gPH.total_length);
+      rc_tx_scheduler_on_frame_sent(&s_RCTxScheduler, uTimeNowMicros);
       //log_line("sending rc frame index: %d", g_PHRCFUpstream.rc_frame_index);
 
+      if ( g_TimeNow >= s_uTimeLastRCTxSchedulerLog + 20000 )
+      {
+         s_uTimeLastRCTxSchedulerLog = g_TimeNow;
+         t_rc_tx_scheduler_stats* pStats = &s_RCTxScheduler.stats;
+         log_line("RC frames: %u, period: %u us, interval min/max: %u/%u us, late avg/max: %u/%u us, resyncs: %u",
+            pStats->uCountFrames, s_RCTxScheduler.uPeriodMicros, pStats->uMinIntervalMicros, pStats->uMaxIntervalMicros,
+            pStats->uTotalLateMicros/pStats->uCountFrames, pStats->uMaxLateMicros, pStats->uCountResyncs);
+         rc_tx_scheduler_reset_stats(&s_RCTxScheduler);
+      }
+
       #endif
 
       _update_loop_info(tTime0);
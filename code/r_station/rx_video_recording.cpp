@@ -191,17 +191,13 @@ void rx_video_recording_stop()
    int height = 720;
    int fps = 30;
    int iVideoType = VIDEO_TYPE_H264;
-   for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
+   ProcessorRxVideo* pProcessorVideo = ProcessorRxVideo::getOutputVideoProcessorForVehicleId(g_pCurrentModel->uVehicleId);
+   if ( NULL != pProcessorVideo )
    {
-      if( NULL == g_pVideoProcessorRxList[i] )
-         break;
-      if ( g_pCurrentModel->uVehicleId != g_pVideoProcessorRxList[i]->m_uVehicleId )
-         continue;
-      width = g_pVideoProcessorRxList[i]->getVideoWidth();
-      height = g_pVideoProcessorRxList[i]->getVideoHeight();
-      fps = g_pVideoProcessorRxList[i]->getVideoFPS();
-      iVideoType = g_pVideoProcessorRxList[i]->getVideoType();
-      break;
+      width = pProcessorVideo->getVideoWidth();
+      height = pProcessorVideo->getVideoHeight();
+      fps = pProcessorVideo->getVideoFPS();
+      iVideoType = pProcessorVideo->getVideoType();
    }
 
    char szFile[128];
@@ -78,6 +78,8 @@ shared_mem_controller_retransmissions_stats_rx_processors* g_pSM_ControllerRetra
 shared_mem_radio_rx_queue_info* g_pSM_RadioRxQueueInfo = NULL;
 shared_mem_radio_rx_queue_info g_SM_RadioRxQueueInfo;
 
+shared_mem_sequences* g_pSM_Sequences = NULL;
+
 shared_mem_radio_stats g_SM_RadioStats;
 shared_mem_radio_stats* g_pSM_RadioStats = NULL;
 
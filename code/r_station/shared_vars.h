@@ -61,6 +61,8 @@ extern shared_mem_controller_retransmissions_stats_rx_processors* g_pSM_Controll
 extern shared_mem_radio_rx_queue_info* g_pSM_RadioRxQueueInfo;
 extern shared_mem_radio_rx_queue_info g_SM_RadioRxQueueInfo;
 
+extern shared_mem_sequences* g_pSM_Sequences;
+
 extern shared_mem_radio_stats g_SM_RadioStats;
 extern shared_mem_radio_stats* g_pSM_RadioStats;
 extern shared_mem_radio_stats_interfaces_rx_graph g_SM_RadioStatsInterfacesRxGraph;
@@ -81,6 +81,7 @@ void resetVehicleRuntimeInfo(int iIndex)
    g_State.vehiclesRuntimeInfo[iIndex].uMaxCommandRoundtripMiliseconds = MAX_U32;
    g_State.vehiclesRuntimeInfo[iIndex].uMinCommandRoundtripMiliseconds = MAX_U32;
    g_State.vehiclesRuntimeInfo[iIndex].bReceivedKeyframeInfoInVideoStream = false;
+   g_State.vehiclesRuntimeInfo[iIndex].uOutputVideoStreamIndex = 0;
    
    // Reset shared mem adaptive info
 
@@ -50,6 +50,9 @@ typedef struct
    
    bool bReceivedKeyframeInfoInVideoStream;
 
+   // Video stream sent to the player/recording (the other video streams of the vehicle are received in parallel)
+   u32 uOutputVideoStreamIndex;
+
 } __attribute__((packed)) type_global_state_vehicle_runtime_info;
 
 
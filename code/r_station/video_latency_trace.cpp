@@ -0,0 +1,147 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiolink.h"
+
+#include "shared_vars.h"
+#include "timers.h"
+#include "video_latency_trace.h"
+
+typedef struct
+{
+   u32 uVehicleId;
+   u32 uTimeLastLog;
+   type_video_latency_trace_stats stats;
+} type_video_latency_trace_vehicle;
+
+static type_video_latency_trace_vehicle s_VideoLatencyTraces[MAX_CONCURENT_VEHICLES];
+
+static const char* s_szVideoLatencyTraceStagesNames[VIDEO_LATENCY_TRACE_STAGES] = { "read->packet", "packet->radio tx", "link", "radio rx->video rx", "video rx->output", "total" };
+
+static void _video_latency_trace_reset_stats(type_video_latency_trace_stats* pStats)
+{
+   pStats->uCountSamples = 0;
+   for( int i=0; i<VIDEO_LATENCY_TRACE_STAGES; i++ )
+   {
+      pStats->uSum[i] = 0;
+      pStats->uMin[i] = MAX_U32;
+      pStats->uMax[i] = 0;
+   }
+}
+
+static type_video_latency_trace_vehicle* _video_latency_trace_get_vehicle(u32 uVehicleId, bool bCreate)
+{
+   int iFreeIndex = -1;
+   for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+   {
+      if ( s_VideoLatencyTraces[i].uVehicleId == uVehicleId )
+         return &s_VideoLatencyTraces[i];
+      if ( (-1 == iFreeIndex) && (0 == s_VideoLatencyTraces[i].uVehicleId) )
+         iFreeIndex = i;
+   }
+   if ( (! bCreate) || (-1 == iFreeIndex) )
+      return NULL;
+
+   s_VideoLatencyTraces[iFreeIndex].uVehicleId = uVehicleId;
+   s_VideoLatencyTraces[iFreeIndex].uTimeLastLog = g_TimeNow;
+   _video_latency_trace_reset_stats(&s_VideoLatencyTraces[iFreeIndex].stats);
+   return &s_VideoLatencyTraces[iFreeIndex];
+}
+
+static void _video_latency_trace_log(type_video_latency_trace_vehicle* pTrace)
+{
+   if ( 0 == pTrace->stats.uCountSamples )
+      return;
+
+   char szLine[512];
+   char szStage[64];
+   snprintf(szLine, sizeof(szLine), "[VideoLatency] VID %u, %u samples, avg/min/max ms:", pTrace->uVehicleId, pTrace->stats.uCountSamples);
+   for( int i=0; i<VIDEO_LATENCY_TRACE_STAGES; i++ )
+   {
+      u32 uAvg = pTrace->stats.uSum[i] / pTrace->stats.uCountSamples;
+      snprintf(szStage, sizeof(szStage), " %s: %u.%u/%u.%u/%u.%u,", s_szVideoLatencyTraceStagesNames[i],
+         uAvg/10, uAvg%10, pTrace->stats.uMin[i]/10, pTrace->stats.uMin[i]%10, pTrace->stats.uMax[i]/10, pTrace->stats.uMax[i]%10);
+      strncat(szLine, szStage, sizeof(szLine) - strlen(szLine) - 1);
+   }
+   szLine[strlen(szLine)-1] = 0;
+   log_line("%s", szLine);
+}
+
+void video_latency_trace_on_output(u32 uVehicleId, t_packet_video_latency_trace* pPacketTrace)
+{
+   if ( NULL == pPacketTrace )
+      return;
+   // Incomplete trace (a stage did not run, i.e. older software on one end)
+   if ( (0 == pPacketTrace->uDeltaPacketized) || (0 == pPacketTrace->uDeltaRadioTx) || (0 == pPacketTrace->uControllerTimeRxMicros) || (0 == pPacketTrace->uDeltaProcessed) )
+      return;
+
+   type_video_latency_trace_vehicle* pTrace = _video_latency_trace_get_vehicle(uVehicleId, true);
+   if ( NULL == pTrace )
+      return;
+
+   u32 uTimeNowMicros = get_current_timestamp_micros();
+   pPacketTrace->uDeltaOutput = radio_packet_latency_trace_delta(pPacketTrace->uControllerTimeRxMicros, uTimeNowMicros);
+
+   // Link stage: both ends use their own clock, so go through the vehicle to controller clock delta
+   u32 uVehicleTimeRadioTxMs = pPacketTrace->uVehicleTimeReadMs + pPacketTrace->uDeltaRadioTx/10;
+   u32 uControllerTimeRxMs = get_current_timestamp_ms() - (uTimeNowMicros - pPacketTrace->uControllerTimeRxMicros)/1000;
+   int iLinkMs = (int)uControllerTimeRxMs - ((int)uVehicleTimeRadioTxMs + radio_get_link_clock_delta());
+   if ( iLinkMs < 0 )
+      iLinkMs = 0;
+
+   u32 uStages[VIDEO_LATENCY_TRACE_STAGES];
+   uStages[VIDEO_LATENCY_TRACE_STAGE_PACKETIZE] = pPacketTrace->uDeltaPacketized;
+   uStages[VIDEO_LATENCY_TRACE_STAGE_TX_QUEUE] = (pPacketTrace->uDeltaRadioTx > pPacketTrace->uDeltaPacketized)?(pPacketTrace->uDeltaRadioTx - pPacketTrace->uDeltaPacketized):0;
+   uStages[VIDEO_LATENCY_TRACE_STAGE_LINK] = (u32)iLinkMs*10;
+   uStages[VIDEO_LATENCY_TRACE_STAGE_RX] = pPacketTrace->uDeltaProcessed;
+   uStages[VIDEO_LATENCY_TRACE_STAGE_REORDER] = (pPacketTrace->uDeltaOutput > pPacketTrace->uDeltaProcessed)?(pPacketTrace->uDeltaOutput - pPacketTrace->uDeltaProcessed):0;
+   uStages[VIDEO_LATENCY_TRACE_STAGE_TOTAL] = pPacketTrace->uDeltaRadioTx + uStages[VIDEO_LATENCY_TRACE_STAGE_LINK] + pPacketTrace->uDeltaOutput;
+
+   pTrace->stats.uCountSamples++;
+   for( int i=0; i<VIDEO_LATENCY_TRACE_STAGES; i++ )
+   {
+      pTrace->stats.uSum[i] += uStages[i];
+      if ( uStages[i] < pTrace->stats.uMin[i] )
+         pTrace->stats.uMin[i] = uStages[i];
+      if ( uStages[i] > pTrace->stats.uMax[i] )
+         pTrace->stats.uMax[i] = uStages[i];
+   }
+
+   if ( g_TimeNow >= pTrace->uTimeLastLog + VIDEO_LATENCY_TRACE_LOG_INTERVAL_MS )
+   {
+      _video_latency_trace_log(pTrace);
+      _video_latency_trace_reset_stats(&pTrace->stats);
+      pTrace->uTimeLastLog = g_TimeNow;
+   }
+}
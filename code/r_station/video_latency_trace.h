@@ -0,0 +1,28 @@
+#pragma once
+
+#include "../base/base.h"
+#include "../radio/radiopackets2.h"
+
+// Aggregates the in-band latency traces of the received video packets, per vehicle, and logs
+// the per stage latencies (average/min/max) periodically.
+
+#define VIDEO_LATENCY_TRACE_STAGE_PACKETIZE 0 // camera read -> video packet complete (vehicle)
+#define VIDEO_LATENCY_TRACE_STAGE_TX_QUEUE 1  // video packet complete -> written to radio (vehicle, includes EC and tx queue)
+#define VIDEO_LATENCY_TRACE_STAGE_LINK 2      // written to radio -> read from radio (needs the vehicle/controller clocks delta)
+#define VIDEO_LATENCY_TRACE_STAGE_RX 3        // read from radio -> video rx processor (controller)
+#define VIDEO_LATENCY_TRACE_STAGE_REORDER 4   // video rx processor -> video output (controller, includes EC and retransmissions wait)
+#define VIDEO_LATENCY_TRACE_STAGE_TOTAL 5     // camera read -> video output
+#define VIDEO_LATENCY_TRACE_STAGES 6
+
+#define VIDEO_LATENCY_TRACE_LOG_INTERVAL_MS 10000
+
+typedef struct
+{
+   u32 uCountSamples;
+   u32 uSum[VIDEO_LATENCY_TRACE_STAGES]; // in 1/10 ms
+   u32 uMin[VIDEO_LATENCY_TRACE_STAGES];
+   u32 uMax[VIDEO_LATENCY_TRACE_STAGES];
+} type_video_latency_trace_stats;
+
+// Called when the video data of a traced packet is sent to the video output
+void video_latency_trace_on_output(u32 uVehicleId, t_packet_video_latency_trace* pTrace);
@@ -33,6 +33,7 @@
 #include "../base/config.h"
 #include "../base/models.h"
 #include "../base/models_list.h"
+#include "../base/video_link_adaptive_logic.h"
 #include "../radio/radiopacketsqueue.h"
 #include "../common/string_utils.h"
 
@@ -202,37 +203,10 @@ void _video_link_adaptive_check_adjust_video_params(u32 uVehicleId)
       return;
    if ( g_TimeNow < g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uTimeLastLevelShiftUp + 50 )
       return;
-     
+
    int iLevelsHQ = pModel->get_video_profile_total_levels(pModel->video_params.user_selected_video_link_profile);
    int iLevelsMQ = pModel->get_video_profile_total_levels(VIDEO_PROFILE_MQ);
    int iLevelsLQ = pModel->get_video_profile_total_levels(VIDEO_PROFILE_LQ);
-   int iMaxLevels = iLevelsHQ;
-   iMaxLevels +=  iLevelsMQ;
-   if ( ! (pModel->video_link_profiles[pModel->video_params.user_selected_video_link_profile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_USE_MEDIUM_ADAPTIVE_VIDEO) )
-      iMaxLevels += iLevelsLQ;
-
-   // videoAdjustmentStrength is 1 (lowest strength) to 10 (highest strength)
-   // fParamsChangeStrength: higher value means more aggresive adjustments. From 0.1 to 1
-   float fParamsChangeStrength = (float)pModel->video_params.videoAdjustmentStrength / 10.0;
-   
-   // When on HQ video profile, switch faster to MQ video profile;
-   /*
-   if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[0].iCurrentTargetLevelShift < iLevelsHQ )
-   {
-      fParamsChangeStrength += 0.2;
-      if ( fParamsChangeStrength > 1.0 )
-         fParamsChangeStrength = 1.0;
-   }
-   */
-
-   // When in MQ video profile, switch slower to LQ video profile
-
-   if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift > iLevelsHQ )
-   {
-      fParamsChangeStrength -= 0.1;
-      if ( fParamsChangeStrength < 0.1 )
-         fParamsChangeStrength = 0.1;
-   }
 
    // Check for video profile received from vehicle missmatch
    if ( g_TimeNow > g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uTimeLastLevelShiftCheckConsistency + 4000 )
@@ -303,213 +277,7 @@ void _video_link_adaptive_check_adjust_video_params(u32 uVehicleId)
       }
    }
 
-   // Max interval time we can check is:
-   // MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS * CONTROLLER_ADAPTIVE_VIDEO_SAMPLE_INTERVAL ms
-   //    = 3.6 seconds
-   // Minus one because the current index is still processing/invalid
-
-   int iIntervalsToCheckDown = (1.0-0.5*fParamsChangeStrength) * MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS;
-   int iIntervalsToCheckUp = (1.0-0.3*fParamsChangeStrength) * MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS;
-   if ( iIntervalsToCheckDown >= MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-1 )
-      iIntervalsToCheckDown = MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-2;
-   if ( iIntervalsToCheckUp >= MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-1 )
-      iIntervalsToCheckUp = MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-2;
-
-   int iIntervalsSinceLastShiftDown = (g_TimeNow - g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uTimeLastLevelShiftDown) / g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uUpdateInterval;
-   if ( iIntervalsToCheckDown > iIntervalsSinceLastShiftDown )
-      iIntervalsToCheckDown = iIntervalsSinceLastShiftDown;
-   if ( iIntervalsToCheckDown <= 0 )
-      iIntervalsToCheckDown = 1;
-
-   g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsAdaptive1 = ((u16)iIntervalsToCheckDown) | (((u16)iIntervalsToCheckUp)<<16);
-   
-   int iCountReconstructedDown = 0;
-   int iLongestReconstructionDown = 0;
-   int iCountRetransmissionsDown = 0;
-   int iCountReRetransmissionsDown = 0;
-   int iCountMissingSegmentsDown = 0;
-
-   int iCountReconstructedUp = 0;
-   int iLongestReconstructionUp = 0;
-   int iCountRetransmissionsUp = 0;
-   int iCountReRetransmissionsUp = 0;
-   int iCountMissingSegmentsUp = 0;
-
-   int iIndex = g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentIntervalIndex - 1;
-   if ( iIndex < 0 )
-      iIndex = MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-1;
-
-   int iCurrentReconstructionLength = 0;
-
-   for( int i=0; i<iIntervalsToCheckDown; i++ )
-   {
-      iIndex--;
-      if ( iIndex < 0 )
-         iIndex = MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-1;
-      iCountReconstructedDown += (g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsOuputRecontructedVideoPackets[iIndex]!=0)?1:0;
-      iCountRetransmissionsDown += (g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsRequestedRetransmissions[iIndex]!=0)?1:0;
-      iCountReRetransmissionsDown += (g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsRetriedRetransmissions[iIndex]!=0)?1:0;
-      iCountMissingSegmentsDown += (g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsMissingVideoPackets[iIndex]!=0)?1:0;
-   
-      if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsOuputRecontructedVideoPackets[iIndex] != 0 )
-         iCurrentReconstructionLength++;
-      else
-      {
-         if ( iCurrentReconstructionLength > iLongestReconstructionDown )
-            iLongestReconstructionDown = iCurrentReconstructionLength;
-         iCurrentReconstructionLength = 0;
-      }
-   }
-
-   if ( iCurrentReconstructionLength > iLongestReconstructionDown )
-      iLongestReconstructionDown = iCurrentReconstructionLength;
-   iCurrentReconstructionLength = 0;
-
-   iCountReconstructedUp = iCountReconstructedDown;
-   iCountRetransmissionsUp = iCountRetransmissionsDown;
-   iCountReRetransmissionsUp = iCountReRetransmissionsDown;
-   iCountMissingSegmentsUp = iCountMissingSegmentsDown;
-   iLongestReconstructionUp = iLongestReconstructionDown;
-
-   for( int i=iIntervalsToCheckDown; i<iIntervalsToCheckUp; i++ )
-   {
-      iIndex--;
-      if ( iIndex < 0 )
-         iIndex = MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS-1;
-      iCountReconstructedUp += (g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsOuputRecontructedVideoPackets[iIndex]!=0)?1:0;
-      iCountRetransmissionsUp += (g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsRequestedRetransmissions[iIndex]!=0)?1:0;
-      iCountReRetransmissionsUp += (g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsRetriedRetransmissions[iIndex]!=0)?1:0;
-      iCountMissingSegmentsUp += (g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsMissingVideoPackets[iIndex]!=0)?1:0;
-   
-      if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsOuputRecontructedVideoPackets[iIndex] != 0 )
-         iCurrentReconstructionLength++;
-      else
-      {
-         if ( iCurrentReconstructionLength > iLongestReconstructionUp )
-            iLongestReconstructionUp = iCurrentReconstructionLength;
-         iCurrentReconstructionLength = 0;
-      }
-   }
-
-   if ( iCurrentReconstructionLength > iLongestReconstructionUp )
-      iLongestReconstructionUp = iCurrentReconstructionLength;
-   iCurrentReconstructionLength = 0;
-
-   bool bDidAnyShift = false;
-
-   // Check for shift down
-
-   int iThresholdReconstructedDown = 2 + (1.0-fParamsChangeStrength)*iIntervalsToCheckDown*0.9;
-   int iThresholdLongestRecontructionDown = 2 + (1.0-fParamsChangeStrength)*iIntervalsToCheckDown*0.7;
-   int iThresholdRetransmissionsDown = 1 + (1.0-fParamsChangeStrength)*iIntervalsToCheckDown/8.0;
-   
-   u32 uMinTimeSinceLastShift = iIntervalsToCheckDown * g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uUpdateInterval;
-   if ( iThresholdReconstructedDown * g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uUpdateInterval < uMinTimeSinceLastShift )
-      uMinTimeSinceLastShift = iThresholdReconstructedDown * g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uUpdateInterval;
-   if ( iThresholdRetransmissionsDown * g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uUpdateInterval < uMinTimeSinceLastShift )
-      uMinTimeSinceLastShift = iThresholdRetransmissionsDown * g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uUpdateInterval;
-
-   if ( uMinTimeSinceLastShift < 100 )
-      uMinTimeSinceLastShift = 100;
-   if ( uMinTimeSinceLastShift > 500 )
-      uMinTimeSinceLastShift = 500;
-   if ( g_TimeNow > g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uTimeLastLevelShiftDown + uMinTimeSinceLastShift )
-   {
-      if ( iCountRetransmissionsDown > iThresholdRetransmissionsDown )
-      {
-         bDidAnyShift = true;
-         g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uTimeLastLevelShiftDown = g_TimeNow;
-         
-         // Go directly to next video profile down
-         if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift < iLevelsHQ )
-            g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift = iLevelsHQ;
-         else if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift < iLevelsHQ + iLevelsMQ)
-            g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift = iLevelsHQ+iLevelsMQ;
-         else 
-            g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift = iMaxLevels - 1;
-
-         if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift >= iMaxLevels )
-            g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift = iMaxLevels - 1;
-      }
-
-      if ( ! bDidAnyShift )
-      if ( (iCountReconstructedDown > iThresholdReconstructedDown) ||
-           (iLongestReconstructionDown > iThresholdLongestRecontructionDown) )
-      {
-         bDidAnyShift = true;
-         g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uTimeLastLevelShiftDown = g_TimeNow;
-         g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift++;
-         
-         if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift >= iMaxLevels )
-            g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift = iMaxLevels - 1;
-      }
-
-      if ( ! bDidAnyShift )
-      if ( (g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift == 0) ||
-           (g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift == iLevelsHQ) ||
-           (g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift == iLevelsMQ) )
-      if ( (iCountReconstructedDown > iThresholdReconstructedDown/2+1) ||
-           (iLongestReconstructionDown > iThresholdLongestRecontructionDown/2+1) )
-      {
-         bDidAnyShift = true;
-         g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uTimeLastLevelShiftDown = g_TimeNow;
-         g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift++;
-         
-         if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift >= iMaxLevels )
-            g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift = iMaxLevels - 1;
-      }
-
-   }
-
-   // Check for shift up ?
-   // Only if we did not shifted down or up recently
-
-   int iThresholdReconstructedUp = 1 + (1.0-fParamsChangeStrength)*iIntervalsToCheckUp*0.4;
-   int iThresholdLongestRecontructionUp = 1 + (1.0-fParamsChangeStrength)*iIntervalsToCheckUp*0.2;
-   int iThresholdRetransmissionsUp = 1 + (1.0-fParamsChangeStrength)*iIntervalsToCheckUp*0.05;
-
-   u32 uTimeForShiftUp = 1000 - (500.0*fParamsChangeStrength);
-   if ( uTimeForShiftUp < 100 )
-      uTimeForShiftUp = 100;
-   if ( uTimeForShiftUp > 1000 )
-      uTimeForShiftUp = 1000;
-   g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsAdaptive2 = ((u32)iThresholdReconstructedUp) | (((u32)iThresholdLongestRecontructionUp)<<8);
-   g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uIntervalsAdaptive2 |= (((u32)iThresholdReconstructedDown)<<16) | (((u32)iThresholdLongestRecontructionDown)<<24);
-   
-   if ( g_TimeNow > g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uTimeLastLevelShiftDown + uTimeForShiftUp )
-   if ( g_TimeNow > g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uTimeLastLevelShiftUp + uTimeForShiftUp )
-   {
-      if ( iCountReconstructedUp < iThresholdReconstructedUp )
-      if ( iLongestReconstructionUp < iThresholdLongestRecontructionUp )
-      if ( iCountRetransmissionsUp < iThresholdRetransmissionsUp )
-      {
-         bDidAnyShift = true;
-
-         if ( 0 == s_uTimeStartGoodIntervalForProfileShiftUp )
-            s_uTimeStartGoodIntervalForProfileShiftUp = g_TimeNow;
-         else if ( g_TimeNow >= s_uTimeStartGoodIntervalForProfileShiftUp + DEFAULT_MINIMUM_OK_INTERVAL_MS_TO_SWITCH_VIDEO_PROFILE_UP )
-         {
-            s_uTimeStartGoodIntervalForProfileShiftUp = 0;
-            g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].uTimeLastLevelShiftUp = g_TimeNow;
-            if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift > 0 )
-            {
-               g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift--;
-               // Skip data:fec == 1:1 leves
-               if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift == iLevelsHQ-1 )
-                  g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift--;
-               if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift == iLevelsHQ + iLevelsMQ - 1 )
-                  g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift--;
-               if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift == iLevelsHQ + iLevelsMQ + iLevelsLQ - 1 )
-                  g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift--;
-            }
-            if ( g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift < 0 )
-               g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex].iCurrentTargetLevelShift = 0;
-         }
-      }
-   }
-   
-   if ( ! bDidAnyShift )
-      s_uTimeStartGoodIntervalForProfileShiftUp = 0;
+   video_link_adaptive_compute_target_level(pModel, &(g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[iVehicleIndex]), g_TimeNow, &s_uTimeStartGoodIntervalForProfileShiftUp);
 }
 
 void video_link_adaptive_periodic_loop()
@@ -45,6 +45,39 @@
 
 extern t_packet_queue s_QueueRadioPackets;
 
+typedef struct
+{
+   u32 uVehicleId;
+   u32 uLastRequestId;
+   u32 uVideoStreamIndex;
+   bool bRequestPending;
+   u32 uTimeRequested;
+   u32 uTimeLastSent;
+   int iRetryCount;
+   u32 uCountRequests;
+   u32 uCountAcks;
+} t_keyframe_request_state;
+
+static t_keyframe_request_state s_KeyframeRequests[MAX_CONCURENT_VEHICLES];
+static u32 s_uKeyframeRequestIdCounter = 0;
+
+static t_keyframe_request_state* _video_link_keyframe_get_request_state(u32 uVehicleId)
+{
+   int iFreeIndex = -1;
+   for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+   {
+      if ( s_KeyframeRequests[i].uVehicleId == uVehicleId )
+         return &s_KeyframeRequests[i];
+      if ( (-1 == iFreeIndex) && (0 == s_KeyframeRequests[i].uVehicleId) )
+         iFreeIndex = i;
+   }
+   if ( -1 == iFreeIndex )
+      return NULL;
+   memset(&s_KeyframeRequests[iFreeIndex], 0, sizeof(t_keyframe_request_state));
+   s_KeyframeRequests[iFreeIndex].uVehicleId = uVehicleId;
+   return &s_KeyframeRequests[iFreeIndex];
+}
+
 void video_link_keyframe_init(u32 uVehicleId)
 {
    Model* pModel = findModelWithId(uVehicleId, 150);
@@ -63,6 +96,99 @@ void video_link_keyframe_init(u32 uVehicleId)
    log_line("Initialized adaptive video keyframe info, default start keyframe interval (last requested): %d ms, for VID %u (name: %s)", g_SM_RouterVehiclesRuntimeInfo.vehicles_adaptive_video[0].iLastRequestedKeyFrameMs, uVehicleId, pModel->getLongName());
 }
 
+// Called when video data from the vehicle was lost and could not be recovered.
+// Asks the vehicle for an I-frame now, instead of waiting for the next regular keyframe.
+void video_link_keyframe_request_keyframe(u32 uVehicleId, u32 uVideoStreamIndex)
+{
+   if ( (0 == uVehicleId) || (MAX_U32 == uVehicleId) )
+      return;
+
+   t_keyframe_request_state* pState = _video_link_keyframe_get_request_state(uVehicleId);
+   if ( NULL == pState )
+      return;
+
+   // One request in flight at a time; the vehicle throttles forced keyframes too.
+   // A request for another video stream (i.e. output switched streams) replaces the pending one.
+   if ( pState->bRequestPending )
+   {
+      if ( pState->uVideoStreamIndex == uVideoStreamIndex )
+         return;
+      log_line("Keyframe request %u to VID %u for video stream %u replaced by a request for video stream %u.", pState->uLastRequestId, uVehicleId, pState->uVideoStreamIndex, uVideoStreamIndex);
+   }
+
+   s_uKeyframeRequestIdCounter++;
+   if ( 0 == s_uKeyframeRequestIdCounter )
+      s_uKeyframeRequestIdCounter = 1;
+   pState->uLastRequestId = s_uKeyframeRequestIdCounter;
+   pState->uVideoStreamIndex = uVideoStreamIndex;
+   pState->bRequestPending = true;
+   pState->uTimeRequested = g_TimeNow;
+   pState->uTimeLastSent = 0;
+   pState->iRetryCount = 0;
+   pState->uCountRequests++;
+}
+
+void video_link_keyframe_on_request_ack(u32 uVehicleId, u32 uRequestId)
+{
+   t_keyframe_request_state* pState = _video_link_keyframe_get_request_state(uVehicleId);
+   if ( NULL == pState )
+      return;
+   if ( (! pState->bRequestPending) || (uRequestId != pState->uLastRequestId) )
+      return;
+
+   pState->bRequestPending = false;
+   pState->uCountAcks++;
+   if ( pState->iRetryCount > 1 )
+      log_line("Keyframe request %u acknowledged by VID %u after %d retries, %u ms", uRequestId, uVehicleId, pState->iRetryCount-1, g_TimeNow - pState->uTimeRequested);
+}
+
+static void _video_link_keyframe_send_pending_requests()
+{
+   for( int i=0; i<MAX_CONCURENT_VEHICLES; i++ )
+   {
+      t_keyframe_request_state* pState = &s_KeyframeRequests[i];
+      if ( (0 == pState->uVehicleId) || (! pState->bRequestPending) )
+         continue;
+
+      if ( (0 != pState->uTimeLastSent) && (g_TimeNow < pState->uTimeLastSent + DEFAULT_VIDEO_KEYFRAME_REQUEST_RETRY_MS) )
+         continue;
+
+      Model* pModel = findModelWithId(pState->uVehicleId, 157);
+      if ( (NULL == pModel) || pModel->is_spectator || pModel->isVideoLinkFixedOneWay() )
+      {
+         pState->bRequestPending = false;
+         continue;
+      }
+
+      if ( pState->iRetryCount >= DEFAULT_VIDEO_KEYFRAME_REQUEST_MAX_RETRIES )
+      {
+         log_line("Keyframe request %u to VID %u was not acknowledged after %d retries.", pState->uLastRequestId, pState->uVehicleId, pState->iRetryCount);
+         pState->bRequestPending = false;
+         continue;
+      }
+
+      t_packet_header PH;
+      radio_packet_init(&PH, PACKET_COMPONENT_VIDEO, PACKET_TYPE_VIDEO_REQUEST_KEYFRAME, STREAM_ID_DATA);
+      PH.vehicle_id_src = g_uControllerId;
+      PH.vehicle_id_dest = pState->uVehicleId;
+      PH.total_length = sizeof(t_packet_header) + sizeof(u32) + sizeof(u8);
+
+      u8 uVideoStreamIndex = (u8) pState->uVideoStreamIndex;
+      u8 packet[MAX_PACKET_TOTAL_SIZE];
+      memcpy(packet, (u8*)&PH, sizeof(t_packet_header));
+      memcpy(packet+sizeof(t_packet_header), (u8*)&(pState->uLastRequestId), sizeof(u32));
+      memcpy(packet+sizeof(t_packet_header) + sizeof(u32), (u8*)&uVideoStreamIndex, sizeof(u8));
+      packets_queue_inject_packet_first(&s_QueueRadioPackets, packet);
+
+      pState->uTimeLastSent = g_TimeNow;
+      pState->iRetryCount++;
+
+      // Older vehicles never acknowledge the request: send it just once
+      if ( (pModel->sw_version>>16) < VIDEO_KEYFRAME_REQUEST_ACK_MIN_SW_BUILD )
+         pState->bRequestPending = false;
+   }
+}
+
 void video_link_keyframe_set_intial_received_level(u32 uVehicleId, int iReceivedKeyframeMs)
 {
    Model* pModel = findModelWithId(uVehicleId, 151);
@@ -188,16 +314,7 @@ void _video_link_keyframe_do_adaptive_check(int iVehicleIndex)
    if ( (NULL == pModel) || (pModel->is_spectator) )
       return;
 
-   ProcessorRxVideo* pProcessorVideo = NULL;
-   for( int i=0; i<MAX_VIDEO_PROCESSORS; i++ )
-   {
-      if ( NULL != g_pVideoProcessorRxList[i] )
-      if ( g_pVideoProcessorRxList[i]->m_uVehicleId == g_State.vehiclesRuntimeInfo[iVehicleIndex].uVehicleId )
-      {
-         pProcessorVideo = g_pVideoProcessorRxList[i];
-         break;
-      }
-   }
+   ProcessorRxVideo* pProcessorVideo = ProcessorRxVideo::getOutputVideoProcessorForVehicleId(g_State.vehiclesRuntimeInfo[iVehicleIndex].uVehicleId);
 
    // Max interval time we can check is:
    // MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS * CONTROLLER_ADAPTIVE_VIDEO_SAMPLE_INTERVAL ms
@@ -400,6 +517,8 @@ void video_link_keyframe_periodic_loop()
    if ( g_bIsControllerLinkToVehicleLost || g_bIsVehicleLinkToControllerLost )
       return;
      
+   _video_link_keyframe_send_pending_requests();
+
    if ( g_bDebugState )
       return;
      
@@ -458,15 +577,11 @@ void video_link_keyframe_periodic_loop()
 
       int iCurrentVideoProfile = 0;
       int iCurrentFPS = 0;
-      for( int k=0; k<MAX_VIDEO_PROCESSORS; k++ )
+      ProcessorRxVideo* pProcessorVideo = ProcessorRxVideo::getOutputVideoProcessorForVehicleId(pModel->uVehicleId);
+      if ( NULL != pProcessorVideo )
       {
-         if ( NULL == g_pVideoProcessorRxList[k] )
-            break;
-         if ( pModel->uVehicleId != g_pVideoProcessorRxList[k]->m_uVehicleId )
-            continue;
-         iCurrentVideoProfile = g_pVideoProcessorRxList[k]->getCurrentlyReceivedVideoProfile();
-         iCurrentFPS = g_pVideoProcessorRxList[k]->getCurrentlyReceivedVideoFPS();
-         break;
+         iCurrentVideoProfile = pProcessorVideo->getCurrentlyReceivedVideoProfile();
+         iCurrentFPS = pProcessorVideo->getCurrentlyReceivedVideoFPS();
       }
       if ( iCurrentVideoProfile == -1 )
          iCurrentVideoProfile = pModel->video_params.user_selected_video_link_profile;
@@ -3,4 +3,6 @@
 void video_link_keyframe_init(u32 uVehicleId);
 void video_link_keyframe_set_intial_received_level(u32 uVehicleId, int iReceivedKeyframeMs);
 void video_link_keyframe_set_current_level_to_request(u32 uVehicleId, int iKeyframeMs);
+void video_link_keyframe_request_keyframe(u32 uVehicleId, u32 uVideoStreamIndex);
+void video_link_keyframe_on_request_ack(u32 uVehicleId, u32 uRequestId);
 void video_link_keyframe_periodic_loop();
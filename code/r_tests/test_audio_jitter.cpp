@@ -0,0 +1,435 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/fec.h"
+#include "../common/audio_rx_jitter.h"
+
+// Offline audio receive test (simulated time, deterministic): generates the vehicle audio stream
+// (4 data + 2 EC packets per block, 1150 bytes packets, 44100 Hz mono S16), passes it through a
+// synthetic network with delay jitter, delay spikes (reordering) and random/burst losses, and plays it into
+// a model of the audio player that consumes the audio in real time, using:
+//  - the legacy receiver: single in-flight block, in order output, FEC only when the next block starts
+//  - the jitter buffer: multi-block reorder/FEC window with playout deadlines
+// Reports audio played, lost, repaired, duplicated and corrupted packets, player underruns and latency
+// (from the end of the packet capture on the vehicle to when the player starts playing it).
+
+#define TEST_DATA_PACKETS 4
+#define TEST_EC_PACKETS 2
+#define TEST_PACKET_SIZE 1150
+#define TEST_BYTES_PER_SEC (44100*2)
+#define TEST_PERIODIC_MICROS (ROUTER_TIMER_INTERVAL_AUDIO_MS*1000)
+#define TEST_NETWORK_BASE_DELAY 3000
+
+typedef struct
+{
+   const char* szName;
+   int iJitterMicros; // uniform extra delay
+   int iSpikePercent; // packets delayed by an extra spike
+   int iSpikeMicros;
+   int iLossPercent; // random loss
+   int iBurstPercent; // chance to enter a loss burst
+   int iBurstLength; // packets lost in a burst
+} t_test_scenario;
+
+static t_test_scenario s_Scenarios[] =
+{
+   { "Clean, 5 ms jitter",              5000, 0, 0,     0, 0, 0 },
+   { "5% loss, 10 ms jitter",           10000, 0, 0,    5, 0, 0 },
+   { "Bursts, 20 ms jitter + spikes",   20000, 3, 40000, 2, 1, 3 },
+};
+
+typedef struct
+{
+   u32 uArrivalMicros;
+   u32 uBlockIndex;
+   u32 uPacketIndex;
+   u8* pData;
+} t_test_event;
+
+int g_iDurationSec = 60;
+u32 g_uPacketMicros = 0;
+int g_iCountBlocks = 0;
+u8* g_pStreamPackets = NULL; // all data + EC packets, in send order
+t_test_event* g_pEvents = NULL;
+int g_iCountEvents = 0;
+u32 g_uRandomSeed = 1;
+
+static u32 _test_random()
+{
+   g_uRandomSeed = g_uRandomSeed * 1103515245 + 12345;
+   return (g_uRandomSeed >> 8) & 0xFFFFFF;
+}
+
+// Packet content: sequence number (7 bits per byte, high bit set), then bytes with the high bit set,
+// so it never matches the audio segment token
+static void _fill_packet(u8* pData, u32 uSeq)
+{
+   for( int i=0; i<4; i++ )
+      pData[i] = 0x80 | ((uSeq >> (7*i)) & 0x7F);
+   for( int i=4; i<TEST_PACKET_SIZE; i++ )
+      pData[i] = 0x80 | ((((uSeq * 2654435761u) >> (i%24)) + i) & 0x7F);
+}
+
+static void _generate_stream()
+{
+   g_uPacketMicros = (u32)(((unsigned long long)TEST_PACKET_SIZE * 1000000) / TEST_BYTES_PER_SEC);
+   g_iCountBlocks = (int)(((unsigned long long)g_iDurationSec * 1000000) / (g_uPacketMicros * TEST_DATA_PACKETS));
+   int iPacketsPerBlock = TEST_DATA_PACKETS + TEST_EC_PACKETS;
+   g_pStreamPackets = (u8*) malloc((size_t)g_iCountBlocks * iPacketsPerBlock * TEST_PACKET_SIZE);
+   g_pEvents = (t_test_event*) malloc((size_t)g_iCountBlocks * iPacketsPerBlock * sizeof(t_test_event));
+
+   u8* pDataPackets[TEST_DATA_PACKETS];
+   u8* pECPackets[TEST_EC_PACKETS];
+   for( int iBlock=0; iBlock<g_iCountBlocks; iBlock++ )
+   {
+      u8* pBlock = g_pStreamPackets + (size_t)iBlock * iPacketsPerBlock * TEST_PACKET_SIZE;
+      for( int i=0; i<iPacketsPerBlock; i++ )
+      {
+         if ( i < TEST_DATA_PACKETS )
+         {
+            pDataPackets[i] = pBlock + i*TEST_PACKET_SIZE;
+            _fill_packet(pDataPackets[i], (u32)(iBlock*TEST_DATA_PACKETS + i));
+         }
+         else
+            pECPackets[i-TEST_DATA_PACKETS] = pBlock + i*TEST_PACKET_SIZE;
+      }
+      fec_encode(TEST_PACKET_SIZE, pDataPackets, TEST_DATA_PACKETS, pECPackets, TEST_EC_PACKETS);
+   }
+}
+
+static int _compare_events(const void* a, const void* b)
+{
+   const t_test_event* pA = (const t_test_event*)a;
+   const t_test_event* pB = (const t_test_event*)b;
+   if ( pA->uArrivalMicros != pB->uArrivalMicros )
+      return (pA->uArrivalMicros < pB->uArrivalMicros)?-1:1;
+   if ( pA->uBlockIndex != pB->uBlockIndex )
+      return (pA->uBlockIndex < pB->uBlockIndex)?-1:1;
+   return (pA->uPacketIndex < pB->uPacketIndex)?-1:1;
+}
+
+// Sends the stream through the network model: each data packet is sent when captured, EC packets right after the last data packet
+static void _build_arrivals(t_test_scenario* pScenario)
+{
+   g_uRandomSeed = 12345;
+   g_iCountEvents = 0;
+   int iBurstLeft = 0;
+   int iPacketsPerBlock = TEST_DATA_PACKETS + TEST_EC_PACKETS;
+   for( int iBlock=0; iBlock<g_iCountBlocks; iBlock++ )
+   for( int i=0; i<iPacketsPerBlock; i++ )
+   {
+      int iCapture = (i < TEST_DATA_PACKETS)?i:(TEST_DATA_PACKETS-1);
+      u32 uSendTime = (u32)(iBlock*TEST_DATA_PACKETS + iCapture + 1) * g_uPacketMicros;
+
+      if ( iBurstLeft > 0 )
+      {
+         iBurstLeft--;
+         continue;
+      }
+      if ( (pScenario->iBurstPercent > 0) && ((int)(_test_random() % 100) < pScenario->iBurstPercent) )
+      {
+         iBurstLeft = pScenario->iBurstLength - 1;
+         continue;
+      }
+      if ( (pScenario->iLossPercent > 0) && ((int)(_test_random() % 100) < pScenario->iLossPercent) )
+         continue;
+
+      u32 uDelay = TEST_NETWORK_BASE_DELAY;
+      if ( pScenario->iJitterMicros > 0 )
+         uDelay += _test_random() % (u32)pScenario->iJitterMicros;
+      if ( (pScenario->iSpikePercent > 0) && ((int)(_test_random() % 100) < pScenario->iSpikePercent) )
+         uDelay += (u32)pScenario->iSpikeMicros;
+
+      t_test_event* pEvent = &g_pEvents[g_iCountEvents++];
+      pEvent->uArrivalMicros = uSendTime + uDelay;
+      pEvent->uBlockIndex = (u32)iBlock;
+      pEvent->uPacketIndex = (u32)i;
+      pEvent->pData = g_pStreamPackets + ((size_t)iBlock * iPacketsPerBlock + i) * TEST_PACKET_SIZE;
+   }
+   qsort(g_pEvents, g_iCountEvents, sizeof(t_test_event), _compare_events);
+}
+
+//-------------------------------------------------------------
+// Audio player model: plays the written audio in real time, from when it's first written
+
+typedef struct
+{
+   u32 uTimeNow;
+   int iStarted;
+   u32 uPlayEnd;
+   u32 uCountUnderruns;
+   u32 uUnderrunMicros;
+   u32 uCountSilence;
+   u32 uCountDuplicates;
+   u32 uCountCorrupted;
+   u8* pPlayed;
+   u32* pLatencies;
+   int iCountLatencies;
+} t_test_player;
+
+t_test_player g_Player;
+
+static void _player_reset()
+{
+   free(g_Player.pPlayed);
+   free(g_Player.pLatencies);
+   memset(&g_Player, 0, sizeof(g_Player));
+   g_Player.pPlayed = (u8*) calloc(g_iCountBlocks * TEST_DATA_PACKETS, 1);
+   g_Player.pLatencies = (u32*) malloc(g_iCountBlocks * TEST_DATA_PACKETS * 2 * sizeof(u32));
+}
+
+static void _player_write(void* pContext, const u8* pData, int iLength)
+{
+   u32 uPlayStart = g_Player.uTimeNow;
+   if ( g_Player.iStarted && ((int)(g_Player.uTimeNow - g_Player.uPlayEnd) > 0) )
+   {
+      g_Player.uCountUnderruns++;
+      g_Player.uUnderrunMicros += g_Player.uTimeNow - g_Player.uPlayEnd;
+   }
+   else if ( g_Player.iStarted )
+      uPlayStart = g_Player.uPlayEnd;
+   g_Player.iStarted = 1;
+   g_Player.uPlayEnd = uPlayStart + (u32)(((unsigned long long)iLength * 1000000) / TEST_BYTES_PER_SEC);
+
+   if ( 0 == (pData[0] & 0x80) )
+   {
+      g_Player.uCountSilence++;
+      return;
+   }
+   u32 uSeq = 0;
+   for( int i=0; i<4; i++ )
+      uSeq |= ((u32)(pData[i] & 0x7F)) << (7*i);
+   u8 uExpected[TEST_PACKET_SIZE];
+   _fill_packet(uExpected, uSeq);
+   if ( (uSeq >= (u32)(g_iCountBlocks * TEST_DATA_PACKETS)) || (iLength != TEST_PACKET_SIZE) || (0 != memcmp(uExpected, pData, TEST_PACKET_SIZE)) )
+   {
+      g_Player.uCountCorrupted++;
+      return;
+   }
+   if ( g_Player.pPlayed[uSeq] )
+   {
+      g_Player.uCountDuplicates++;
+      return;
+   }
+   g_Player.pPlayed[uSeq] = 1;
+   g_Player.pLatencies[g_Player.iCountLatencies++] = uPlayStart - (uSeq+1) * g_uPacketMicros;
+}
+
+//-------------------------------------------------------------
+// Legacy receiver (same logic as the previous processor_rx_audio.cpp)
+
+u32 s_uLegacyCurrentBlock = MAX_U32;
+u8 s_uLegacyPackets[MAX_BUFFERED_AUDIO_PACKETS][TEST_PACKET_SIZE];
+bool s_bLegacyReceived[MAX_BUFFERED_AUDIO_PACKETS];
+u32 s_uLegacyReceivedData = 0;
+u32 s_uLegacyReceivedEC = 0;
+u32 s_uLegacyLastOutputBlock = MAX_U32;
+u32 s_uLegacyLastOutputPacket = MAX_U32;
+u32 s_uLegacyRepaired = 0;
+
+static void _legacy_reset_block()
+{
+   for( int i=0; i<MAX_BUFFERED_AUDIO_PACKETS; i++ )
+      s_bLegacyReceived[i] = false;
+   s_uLegacyReceivedData = 0;
+   s_uLegacyReceivedEC = 0;
+}
+
+static void _legacy_output(u32 uBlockIndex, u32 uPacketIndex)
+{
+   s_uLegacyLastOutputBlock = uBlockIndex;
+   s_uLegacyLastOutputPacket = uPacketIndex;
+   _player_write(NULL, s_uLegacyPackets[uPacketIndex], TEST_PACKET_SIZE);
+}
+
+static void _legacy_reconstruct_and_output()
+{
+   u8* pData[MAX_BUFFERED_AUDIO_PACKETS];
+   u8* pEC[MAX_BUFFERED_AUDIO_PACKETS];
+   unsigned int uECIndexes[MAX_BUFFERED_AUDIO_PACKETS];
+   unsigned int uMissing[MAX_BUFFERED_AUDIO_PACKETS];
+   unsigned int uCountMissing = 0;
+   for( u32 i=0; i<TEST_DATA_PACKETS; i++ )
+   {
+      pData[i] = s_uLegacyPackets[i];
+      if ( ! s_bLegacyReceived[i] )
+         uMissing[uCountMissing++] = i;
+   }
+   unsigned int uPos = 0;
+   for( u32 i=0; i<TEST_EC_PACKETS; i++ )
+   {
+      if ( ! s_bLegacyReceived[i+TEST_DATA_PACKETS] )
+         continue;
+      pEC[uPos] = s_uLegacyPackets[i+TEST_DATA_PACKETS];
+      uECIndexes[uPos] = i;
+      uPos++;
+      if ( uPos == uCountMissing )
+         break;
+   }
+   fec_decode(TEST_PACKET_SIZE, pData, TEST_DATA_PACKETS, pEC, uECIndexes, uMissing, uCountMissing);
+   s_uLegacyRepaired++;
+   for( u32 i=0; i<TEST_DATA_PACKETS; i++ )
+      _legacy_output(s_uLegacyCurrentBlock, i);
+}
+
+static void _legacy_process_packet(u32 uBlockIndex, u32 uPacketIndex, const u8* pData)
+{
+   if ( s_uLegacyCurrentBlock == MAX_U32 )
+   {
+      if ( uPacketIndex >= TEST_EC_PACKETS )
+         return;
+      s_uLegacyCurrentBlock = uBlockIndex;
+      _legacy_reset_block();
+   }
+   if ( uBlockIndex < s_uLegacyCurrentBlock )
+      return;
+
+   if ( uBlockIndex != s_uLegacyCurrentBlock )
+   {
+      if ( s_uLegacyLastOutputPacket < TEST_DATA_PACKETS-1 )
+      if ( s_uLegacyReceivedData + s_uLegacyReceivedEC >= TEST_DATA_PACKETS )
+         _legacy_reconstruct_and_output();
+
+      s_uLegacyLastOutputBlock = s_uLegacyCurrentBlock;
+      s_uLegacyLastOutputPacket = TEST_DATA_PACKETS-1;
+      _legacy_reset_block();
+      s_uLegacyCurrentBlock = uBlockIndex;
+      if ( uPacketIndex >= TEST_EC_PACKETS )
+         return;
+   }
+
+   if ( s_bLegacyReceived[uPacketIndex] )
+      return;
+   if ( uPacketIndex < TEST_DATA_PACKETS )
+      s_uLegacyReceivedData++;
+   else
+      s_uLegacyReceivedEC++;
+   s_bLegacyReceived[uPacketIndex] = true;
+   memcpy(s_uLegacyPackets[uPacketIndex], pData, TEST_PACKET_SIZE);
+
+   u32 uNextBlock = s_uLegacyLastOutputBlock;
+   u32 uNextPacket = s_uLegacyLastOutputPacket + 1;
+   if ( uNextPacket >= TEST_DATA_PACKETS )
+   {
+      uNextBlock++;
+      uNextPacket = 0;
+   }
+   if ( uPacketIndex < TEST_DATA_PACKETS )
+   if ( (uBlockIndex == uNextBlock) && (uPacketIndex == uNextPacket) )
+      _legacy_output(uBlockIndex, uPacketIndex);
+}
+
+static void _run_legacy()
+{
+   s_uLegacyCurrentBlock = MAX_U32;
+   s_uLegacyLastOutputBlock = MAX_U32;
+   s_uLegacyLastOutputPacket = MAX_U32;
+   s_uLegacyRepaired = 0;
+   _legacy_reset_block();
+   for( int i=0; i<g_iCountEvents; i++ )
+   {
+      g_Player.uTimeNow = g_pEvents[i].uArrivalMicros;
+      _legacy_process_packet(g_pEvents[i].uBlockIndex, g_pEvents[i].uPacketIndex, g_pEvents[i].pData);
+   }
+}
+
+//-------------------------------------------------------------
+
+static t_audio_rx_jitter s_Jitter;
+
+static void _run_jitter_buffer()
+{
+   audio_rx_jitter_init(&s_Jitter, TEST_DATA_PACKETS, TEST_EC_PACKETS, DEFAULT_AUDIO_RX_JITTER_BLOCKS, DEFAULT_AUDIO_RX_PLAYOUT_DELAY_MS,
+      TEST_BYTES_PER_SEC, _player_write, NULL);
+
+   u32 uNextPeriodic = 0;
+   for( int i=0; i<g_iCountEvents; i++ )
+   {
+      while ( (int)(g_pEvents[i].uArrivalMicros - uNextPeriodic) >= 0 )
+      {
+         g_Player.uTimeNow = uNextPeriodic;
+         audio_rx_jitter_periodic(&s_Jitter, uNextPeriodic);
+         uNextPeriodic += TEST_PERIODIC_MICROS;
+      }
+      g_Player.uTimeNow = g_pEvents[i].uArrivalMicros;
+      audio_rx_jitter_add_packet(&s_Jitter, g_pEvents[i].uBlockIndex, g_pEvents[i].uPacketIndex, g_pEvents[i].pData, TEST_PACKET_SIZE, g_pEvents[i].uArrivalMicros);
+   }
+   u32 uEnd = uNextPeriodic + 1000000;
+   while ( (int)(uEnd - uNextPeriodic) > 0 )
+   {
+      g_Player.uTimeNow = uNextPeriodic;
+      audio_rx_jitter_periodic(&s_Jitter, uNextPeriodic);
+      uNextPeriodic += TEST_PERIODIC_MICROS;
+   }
+}
+
+static int _compare_u32(const void* a, const void* b)
+{
+   u32 ua = *(const u32*)a;
+   u32 ub = *(const u32*)b;
+   return (ua < ub)?-1:((ua > ub)?1:0);
+}
+
+static int _print_results(const char* szName, u32 uRepaired)
+{
+   int iTotal = g_iCountBlocks * TEST_DATA_PACKETS;
+   int iLost = iTotal - g_Player.iCountLatencies;
+   printf("  %-14s played: %6d, lost: %5d (%5.2f%%), repaired blocks: %4u, duplicates: %4u, corrupted: %u, underruns: %4u (%5u ms)\n",
+      szName, g_Player.iCountLatencies, iLost, 100.0*(double)iLost/(double)iTotal, uRepaired,
+      g_Player.uCountDuplicates, g_Player.uCountCorrupted, g_Player.uCountUnderruns, g_Player.uUnderrunMicros/1000);
+   if ( g_Player.iCountLatencies > 0 )
+   {
+      u32* pValues = g_Player.pLatencies;
+      int iCount = g_Player.iCountLatencies;
+      qsort(pValues, iCount, sizeof(u32), _compare_u32);
+      printf("  %-14s latency p50: %4u ms, p99: %4u ms, max: %4u ms\n", "",
+         pValues[iCount/2]/1000, pValues[(iCount*99)/100]/1000, pValues[iCount-1]/1000);
+   }
+   return (g_Player.uCountCorrupted > 0)?1:0;
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_audio_jitter [simulated_duration_sec]\n");
+      return 0;
+   }
+   if ( argc >= 2 )
+      g_iDurationSec = atoi(argv[1]);
+   if ( g_iDurationSec < 5 )
+      g_iDurationSec = 5;
+
+   log_init_local_only("TestAudioJitter");
+   log_disable_stdout();
+   fec_init();
+
+   _generate_stream();
+   printf("\nAudio jitter buffer test: %d sec simulated, %d blocks of %d+%d packets, %d bytes packets (%u us of audio each)\n",
+      g_iDurationSec, g_iCountBlocks, TEST_DATA_PACKETS, TEST_EC_PACKETS, TEST_PACKET_SIZE, g_uPacketMicros);
+   printf("Jitter buffer: %d blocks window, %d ms playout delay; network base delay %d ms\n",
+      DEFAULT_AUDIO_RX_JITTER_BLOCKS, DEFAULT_AUDIO_RX_PLAYOUT_DELAY_MS, TEST_NETWORK_BASE_DELAY/1000);
+
+   int iFailed = 0;
+   for( int iScenario=0; iScenario<(int)(sizeof(s_Scenarios)/sizeof(s_Scenarios[0])); iScenario++ )
+   {
+      _build_arrivals(&s_Scenarios[iScenario]);
+      printf("\n%s (%d of %d packets received):\n", s_Scenarios[iScenario].szName, g_iCountEvents, g_iCountBlocks*(TEST_DATA_PACKETS+TEST_EC_PACKETS));
+
+      _player_reset();
+      _run_legacy();
+      iFailed += _print_results("Legacy", s_uLegacyRepaired);
+
+      _player_reset();
+      _run_jitter_buffer();
+      iFailed += _print_results("Jitter buffer", s_Jitter.uCountBlocksRepaired);
+      printf("  %-14s late: %u, out of order: %u, concealed packets: %u, window overflows: %u, stalls: %u\n", "",
+         s_Jitter.uCountLate, s_Jitter.uCountOutOfOrder, s_Jitter.uCountPacketsConcealed, s_Jitter.uCountWindowOverflows, s_Jitter.uCountStalls);
+      if ( g_Player.uCountDuplicates > 0 )
+         iFailed++;
+   }
+
+   printf("\n%s\n", iFailed?"Test FAILED":"Test passed");
+   free(g_pStreamPackets);
+   free(g_pEvents);
+   return iFailed?1:0;
+}
@@ -0,0 +1,148 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "../base/base.h"
+#include "../common/config_watch.h"
+#include <sys/stat.h>
+
+// Checks the config watch on a temporary folder: a settings file rewritten and a flag file created/removed
+// by another "process" must be reported on the next check (inotify) and in polling mode, and untouched
+// files must not be reported.
+
+static char s_szFolder[MAX_FILE_PATH_SIZE];
+static int s_iFailed = 0;
+
+static void _test_write_file(const char* szName, const char* szContent)
+{
+   char szFile[MAX_FILE_PATH_SIZE+64];
+   snprintf(szFile, sizeof(szFile)/sizeof(szFile[0]), "%s%s", s_szFolder, szName);
+   FILE* fd = fopen(szFile, "w");
+   if ( NULL == fd )
+      return;
+   fprintf(fd, "%s", szContent);
+   fclose(fd);
+}
+
+static void _test_remove_file(const char* szName)
+{
+   char szFile[MAX_FILE_PATH_SIZE+64];
+   snprintf(szFile, sizeof(szFile)/sizeof(szFile[0]), "%s%s", s_szFolder, szName);
+   unlink(szFile);
+}
+
+static void _test_check(const char* szStep, u32 uChanges, u32 uExpected)
+{
+   printf("   %-36s changes: 0x%02X, expected: 0x%02X %s\n", szStep, uChanges, uExpected, (uChanges == uExpected)?"":"<- wrong");
+   if ( uChanges != uExpected )
+      s_iFailed = 1;
+}
+
+static void _test_run(const char* szName, int bUseInotify)
+{
+   t_config_watch watch;
+   int iInotify = config_watch_init(&watch);
+   if ( (! bUseInotify) && iInotify )
+   {
+      // Force the polling fallback
+      close(watch.iInotifyFd);
+      watch.iInotifyFd = -1;
+   }
+   if ( bUseInotify && (! iInotify) )
+   {
+      printf("%s: inotify not available, skipped.\n", szName);
+      return;
+   }
+   printf("%s:\n", szName);
+
+   _test_write_file("settings.txt", "1");
+   int iSettings = config_watch_add_file(&watch, s_szFolder, "settings.txt");
+   int iFlag = config_watch_add_file(&watch, s_szFolder, "flag.tmp");
+   int iOther = config_watch_add_file(&watch, s_szFolder, "other.txt");
+   if ( (iSettings < 0) || (iFlag < 0) || (iOther < 0) )
+   {
+      printf("   Failed to add watched files.\n");
+      s_iFailed = 1;
+      config_watch_close(&watch);
+      return;
+   }
+
+   _test_check("No change", config_watch_get_changes(&watch), 0);
+
+   // Polling mode only sees the modification stamps, so make the size change too
+   _test_write_file("settings.txt", "22");
+   _test_check("Settings rewritten", config_watch_get_changes(&watch), ((u32)1)<<iSettings);
+
+   _test_write_file("flag.tmp", "");
+   _test_check("Flag created", config_watch_get_changes(&watch), ((u32)1)<<iFlag);
+
+   _test_remove_file("flag.tmp");
+   _test_check("Flag removed", config_watch_get_changes(&watch), 0);
+
+   _test_write_file("unrelated.txt", "x");
+   _test_check("Unrelated file created", config_watch_get_changes(&watch), 0);
+
+   _test_write_file("other.txt", "x");
+   _test_write_file("settings.txt", "333");
+   _test_check("Two files written", config_watch_get_changes(&watch), (((u32)1)<<iOther) | (((u32)1)<<iSettings));
+
+   _test_remove_file("settings.txt");
+   _test_remove_file("other.txt");
+   _test_remove_file("unrelated.txt");
+   config_watch_close(&watch);
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_config_watch\n");
+      return 0;
+   }
+
+   log_init_local_only("TestConfigWatch");
+   log_disable_stdout();
+
+   snprintf(s_szFolder, sizeof(s_szFolder)/sizeof(s_szFolder[0]), "/tmp/test_config_watch_%d/", (int)getpid());
+   if ( 0 != mkdir(s_szFolder, 0755) )
+   {
+      printf("Failed to create test folder %s\n", s_szFolder);
+      return -1;
+   }
+
+   _test_run("Inotify", 1);
+   _test_run("Polling", 0);
+
+   rmdir(s_szFolder);
+
+   printf("\n%s\n", s_iFailed?"Test FAILED":"Test passed");
+   return s_iFailed?1:0;
+}
@@ -0,0 +1,148 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hw_procs.h"
+
+// Reads the CPU topology from fake sysfs trees: a symmetric quad core, an asymmetric (big.LITTLE)
+// six core SoC with an offline core and a CPU without capacity info (max frequency is used).
+// Checks the CPUs order used for placing the processes (fastest first, kernel order for equal CPUs).
+
+static int s_iFailed = 0;
+
+static void _test_write_file(const char* szFolder, const char* szFile, const char* szValue)
+{
+   char szPath[256];
+   char szComm[512];
+   snprintf(szPath, sizeof(szPath), "%s/%s", szFolder, szFile);
+   char* pSlash = strrchr(szPath, '/');
+   *pSlash = 0;
+   snprintf(szComm, sizeof(szComm), "mkdir -p %s", szPath);
+   if ( 0 != system(szComm) )
+      printf("   Failed to create %s\n", szPath);
+   *pSlash = '/';
+   FILE* fd = fopen(szPath, "w");
+   if ( NULL == fd )
+   {
+      printf("   Failed to write %s\n", szPath);
+      s_iFailed = 1;
+      return;
+   }
+   fprintf(fd, "%s\n", szValue);
+   fclose(fd);
+}
+
+static void _test_check(const char* szName, const char* szFolder, int iExpectedCount, int iExpectedFast, const int* piExpectedOrder)
+{
+   t_hw_cpu_topology topology;
+   int iCount = hw_read_cpu_topology(szFolder, &topology);
+   int bOk = (iCount == iExpectedCount) && (topology.iCountCPUs == iExpectedCount) && (topology.iCountFastCPUs == iExpectedFast);
+   for( int i=0; bOk && (i<iExpectedCount); i++ )
+      if ( topology.iCPUs[i] != piExpectedOrder[i] )
+         bOk = 0;
+
+   printf("%-28s %d CPUs, %d fastest, order:", szName, topology.iCountCPUs, topology.iCountFastCPUs);
+   for( int i=0; i<topology.iCountCPUs; i++ )
+      printf(" %d", topology.iCPUs[i]);
+   printf(" %s\n", bOk?"ok":"WRONG");
+   if ( ! bOk )
+      s_iFailed = 1;
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_cpu_topology\n");
+      return 0;
+   }
+
+   log_init_local_only("TestCPUTopology");
+   log_disable_stdout();
+
+   char szRoot[64];
+   snprintf(szRoot, sizeof(szRoot), "/tmp/test_cpu_topology_%d", (int)getpid());
+   char szFolder[128];
+   char szFile[64];
+
+   printf("\nCPU topology and processes placement order:\n\n");
+
+   // Symmetric quad core: kernel order is kept
+   snprintf(szFolder, sizeof(szFolder), "%s/quad", szRoot);
+   _test_write_file(szFolder, "online", "0-3");
+   for( int i=0; i<4; i++ )
+   {
+      snprintf(szFile, sizeof(szFile), "cpu%d/cpufreq/cpuinfo_max_freq", i);
+      _test_write_file(szFolder, szFile, "1800000");
+   }
+   int iOrderQuad[] = {0,1,2,3};
+   _test_check("Symmetric quad core:", szFolder, 4, 4, iOrderQuad);
+
+   // big.LITTLE: 4 little (0-3), 2 big (4-5), cpu 2 offline
+   snprintf(szFolder, sizeof(szFolder), "%s/biglittle", szRoot);
+   _test_write_file(szFolder, "online", "0-1,3-5");
+   for( int i=0; i<6; i++ )
+   {
+      snprintf(szFile, sizeof(szFile), "cpu%d/cpu_capacity", i);
+      _test_write_file(szFolder, szFile, (i<4)?"446":"1024");
+   }
+   int iOrderBigLittle[] = {4,5,0,1,3};
+   _test_check("big.LITTLE, one offline:", szFolder, 5, 2, iOrderBigLittle);
+
+   // No capacity and no frequency info for one CPU: it goes last
+   snprintf(szFolder, sizeof(szFolder), "%s/partial", szRoot);
+   _test_write_file(szFolder, "online", "0-2");
+   _test_write_file(szFolder, "cpu0/cpufreq/cpuinfo_max_freq", "1200000");
+   _test_write_file(szFolder, "cpu2/cpufreq/cpuinfo_max_freq", "1500000");
+   int iOrderPartial[] = {2,0,1};
+   _test_check("Partial info:", szFolder, 3, 1, iOrderPartial);
+
+   // No sysfs info at all: online CPUs count from the system, kernel order
+   snprintf(szFolder, sizeof(szFolder), "%s/missing", szRoot);
+   t_hw_cpu_topology topology;
+   hw_read_cpu_topology(szFolder, &topology);
+   int iSystemCPUs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+   if ( iSystemCPUs > HW_MAX_CPUS )
+      iSystemCPUs = HW_MAX_CPUS;
+   printf("%-28s %d CPUs (system has %d online) %s\n", "No sysfs info:", topology.iCountCPUs, iSystemCPUs, (topology.iCountCPUs == iSystemCPUs)?"ok":"WRONG");
+   if ( topology.iCountCPUs != iSystemCPUs )
+      s_iFailed = 1;
+
+   char szComm[128];
+   snprintf(szComm, sizeof(szComm), "rm -rf %s", szRoot);
+   if ( 0 != system(szComm) )
+      printf("   Failed to remove %s\n", szRoot);
+
+   printf("\n%s\n", s_iFailed?"Test FAILED":"Test passed");
+   return s_iFailed?1:0;
+}
@@ -0,0 +1,588 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/file_transfer.h"
+
+#include <fcntl.h>
+
+// Transfers a file over a simulated radio link (virtual time, one way delay, random loss on each
+// direction, limited air rate) and compares:
+//  - legacy download: controller requests the first missing 1117 bytes segment every 100 ms, the vehicle
+//    opens and reads the file for each request and sends back the segment;
+//  - legacy upload: one 800 bytes segment per command, the command is resent on timeout (50 ms + 10 ms per retry)
+//    until the vehicle responds; the next segment goes at least 100 ms after the previous one;
+//  - windowed transfer (base/file_transfer), without and with XOR parity segments, in both directions,
+//    driven the same way as by the controller and the vehicle (acks every 50 ms or every 4 segments);
+//  - resume: the receiver is closed half way and reopened, the transfer continues from its state file.
+
+#define TEST_LINK_MAX_PACKETS 4096
+#define TEST_LINK_MAX_PACKET_SIZE 1500
+#define TEST_MAX_TIME_MS (20*60*1000)
+
+typedef struct
+{
+   u32 uDeliveryTime;
+   int iLength;
+   u8 uData[TEST_LINK_MAX_PACKET_SIZE];
+} t_test_packet;
+
+typedef struct
+{
+   int iDelayMs;
+   int iLossPercent;
+   int iBytesPerMs;
+   u32 uTimeLinkFree;
+   int iHead;
+   int iCount;
+   u32 uCountPackets;
+   u32 uCountBytes;
+   t_test_packet packets[TEST_LINK_MAX_PACKETS];
+} t_test_link;
+
+typedef struct
+{
+   const char* szName;
+   int iDelayMs;
+   int iLossPercent;
+} t_test_scenario;
+
+static t_test_link s_LinkUp; // controller to vehicle
+static t_test_link s_LinkDown; // vehicle to controller
+static u32 s_uTimeNow = 0;
+static u32 s_uSeed = 1;
+
+static char s_szSourceFile[] = "/tmp/test_file_transfer_src.bin";
+static char s_szOutputFile[] = "/tmp/test_file_transfer_out.bin";
+static u8* s_pSourceData = NULL;
+static int s_iFileSize = 512*1024;
+
+static u32 _random()
+{
+   s_uSeed = s_uSeed * 1103515245 + 12345;
+   return (s_uSeed >> 8) & 0xFFFFFF;
+}
+
+static void _link_init(t_test_link* pLink, int iDelayMs, int iLossPercent)
+{
+   memset(pLink, 0, sizeof(t_test_link));
+   pLink->iDelayMs = iDelayMs;
+   pLink->iLossPercent = iLossPercent;
+   pLink->iBytesPerMs = 200; // about 1.6 Mbps
+}
+
+static void _link_send(t_test_link* pLink, u8* pData, int iLength)
+{
+   if ( (iLength > TEST_LINK_MAX_PACKET_SIZE) || (pLink->iCount >= TEST_LINK_MAX_PACKETS) )
+      return;
+   pLink->uCountPackets++;
+   pLink->uCountBytes += iLength;
+   // Air time is used even if the packet is lost
+   if ( pLink->uTimeLinkFree < s_uTimeNow )
+      pLink->uTimeLinkFree = s_uTimeNow;
+   pLink->uTimeLinkFree += (iLength + pLink->iBytesPerMs - 1) / pLink->iBytesPerMs;
+   if ( (int)(_random() % 100) < pLink->iLossPercent )
+      return;
+   t_test_packet* pPacket = &pLink->packets[(pLink->iHead + pLink->iCount) % TEST_LINK_MAX_PACKETS];
+   pPacket->uDeliveryTime = pLink->uTimeLinkFree + pLink->iDelayMs;
+   pPacket->iLength = iLength;
+   memcpy(pPacket->uData, pData, iLength);
+   pLink->iCount++;
+}
+
+static t_test_packet* _link_receive(t_test_link* pLink)
+{
+   if ( 0 == pLink->iCount )
+      return NULL;
+   t_test_packet* pPacket = &pLink->packets[pLink->iHead];
+   if ( pPacket->uDeliveryTime > s_uTimeNow )
+      return NULL;
+   pLink->iHead = (pLink->iHead + 1) % TEST_LINK_MAX_PACKETS;
+   pLink->iCount--;
+   return pPacket;
+}
+
+static void _links_init(t_test_scenario* pScenario)
+{
+   _link_init(&s_LinkUp, pScenario->iDelayMs, pScenario->iLossPercent);
+   _link_init(&s_LinkDown, pScenario->iDelayMs, pScenario->iLossPercent);
+   s_uTimeNow = 1;
+   s_uSeed = 1;
+}
+
+static int _check_output_file(int iFileSize)
+{
+   FILE* fd = fopen(s_szOutputFile, "rb");
+   if ( NULL == fd )
+      return 0;
+   u8* pData = (u8*)malloc(iFileSize+1);
+   int iRead = fread(pData, 1, iFileSize+1, fd);
+   fclose(fd);
+   int iOk = ((iRead == iFileSize) && (0 == memcmp(pData, s_pSourceData, iFileSize)))?1:0;
+   free(pData);
+   return iOk;
+}
+
+//---------------------------------------------------
+// Legacy transfers
+
+static u32 s_uCountLegacyFileOpens = 0;
+
+static u32 _legacy_download()
+{
+   const int iSegmentSize = 1117;
+   int iCountSegments = (s_iFileSize + iSegmentSize - 1) / iSegmentSize;
+   u8* pReceived = (u8*)calloc(iCountSegments, 1);
+   u8* pOutput = (u8*)malloc(iCountSegments*iSegmentSize);
+   int iCountReceived = 0;
+   u32 uLastRequestTime = 0;
+   s_uCountLegacyFileOpens = 0;
+
+   for( s_uTimeNow=1; s_uTimeNow<TEST_MAX_TIME_MS; s_uTimeNow++ )
+   {
+      t_test_packet* pPacket;
+      // Vehicle: reads the requested segment from the file for each request
+      while ( NULL != (pPacket = _link_receive(&s_LinkUp)) )
+      {
+         u32 uSegment = 0;
+         memcpy(&uSegment, pPacket->uData, sizeof(u32));
+         u8 uBuffer[4+1117];
+         memcpy(uBuffer, &uSegment, sizeof(u32));
+         memset(&uBuffer[4], 0, iSegmentSize);
+         FILE* fd = fopen(s_szSourceFile, "rb");
+         s_uCountLegacyFileOpens++;
+         if ( NULL != fd )
+         {
+            fseek(fd, uSegment*iSegmentSize, SEEK_SET);
+            if ( 0 == fread(&uBuffer[4], 1, iSegmentSize, fd) )
+               printf("Failed to read source file.\n");
+            fclose(fd);
+         }
+         // command response header
+         u8 uPacket[24+4+1117];
+         memset(uPacket, 0, 24);
+         memcpy(&uPacket[24], uBuffer, sizeof(uBuffer));
+         _link_send(&s_LinkDown, uPacket, sizeof(uPacket));
+      }
+      // Controller
+      while ( NULL != (pPacket = _link_receive(&s_LinkDown)) )
+      {
+         u32 uSegment = 0;
+         memcpy(&uSegment, &pPacket->uData[24], sizeof(u32));
+         if ( (uSegment < (u32)iCountSegments) && (! pReceived[uSegment]) )
+         {
+            pReceived[uSegment] = 1;
+            memcpy(pOutput + uSegment*iSegmentSize, &pPacket->uData[28], iSegmentSize);
+            iCountReceived++;
+         }
+      }
+      if ( iCountReceived == iCountSegments )
+         break;
+      if ( s_uTimeNow < uLastRequestTime + 100 )
+         continue;
+      for( int i=0; i<iCountSegments; i++ )
+      {
+         if ( pReceived[i] )
+            continue;
+         u8 uPacket[24];
+         memset(uPacket, 0, sizeof(uPacket));
+         memcpy(uPacket, &i, sizeof(u32));
+         _link_send(&s_LinkUp, uPacket, sizeof(uPacket));
+         uLastRequestTime = s_uTimeNow;
+         break;
+      }
+   }
+
+   FILE* fd = fopen(s_szOutputFile, "wb");
+   if ( NULL != fd )
+   {
+      fwrite(pOutput, 1, s_iFileSize, fd);
+      fclose(fd);
+   }
+   free(pReceived);
+   free(pOutput);
+   return s_uTimeNow;
+}
+
+static u32 _legacy_upload()
+{
+   const int iSegmentSize = 800;
+   int iCountSegments = (s_iFileSize + iSegmentSize - 1) / iSegmentSize;
+   u8* pReceived = (u8*)calloc(iCountSegments, 1);
+   u8* pOutput = (u8*)malloc(iCountSegments*iSegmentSize);
+   int iCurrentSegment = 0;
+   int iCommandTimeout = 50;
+   u32 uCommandSendTime = 0;
+   u32 uLastUploadTime = 0;
+   u32 uLastResponseTime = 0;
+   bool bInProgress = false;
+
+   for( s_uTimeNow=1; s_uTimeNow<TEST_MAX_TIME_MS; s_uTimeNow++ )
+   {
+      t_test_packet* pPacket;
+      // Vehicle: stores the segment, responds to each copy of the command
+      while ( NULL != (pPacket = _link_receive(&s_LinkUp)) )
+      {
+         int iSegment = 0;
+         memcpy(&iSegment, pPacket->uData, sizeof(int));
+         int iLength = pPacket->iLength - 160;
+         if ( ! pReceived[iSegment] )
+         {
+            pReceived[iSegment] = 1;
+            memcpy(pOutput + iSegment*iSegmentSize, &pPacket->uData[160], iLength);
+         }
+         u8 uPacket[24];
+         memset(uPacket, 0, sizeof(uPacket));
+         memcpy(uPacket, &iSegment, sizeof(int));
+         _link_send(&s_LinkDown, uPacket, sizeof(uPacket));
+      }
+      // Controller
+      while ( NULL != (pPacket = _link_receive(&s_LinkDown)) )
+      {
+         int iSegment = 0;
+         memcpy(&iSegment, pPacket->uData, sizeof(int));
+         if ( bInProgress && (iSegment == iCurrentSegment) )
+         {
+            bInProgress = false;
+            iCurrentSegment++;
+            uLastResponseTime = s_uTimeNow;
+         }
+      }
+      if ( iCurrentSegment >= iCountSegments )
+         break;
+
+      int iLength = iSegmentSize;
+      if ( (iCurrentSegment+1)*iSegmentSize > s_iFileSize )
+         iLength = s_iFileSize - iCurrentSegment*iSegmentSize;
+      u8 uPacket[160+800];
+      memcpy(uPacket, &iCurrentSegment, sizeof(int));
+      memcpy(&uPacket[160], s_pSourceData + iCurrentSegment*iSegmentSize, iLength);
+
+      if ( bInProgress )
+      {
+         if ( s_uTimeNow > uCommandSendTime + iCommandTimeout )
+         {
+            if ( iCommandTimeout < 300 )
+               iCommandTimeout += 10;
+            uCommandSendTime = s_uTimeNow;
+            _link_send(&s_LinkUp, uPacket, 160+iLength);
+         }
+         continue;
+      }
+      if ( (s_uTimeNow < uLastUploadTime + 100) || (s_uTimeNow < uLastResponseTime + 50) )
+         continue;
+      bInProgress = true;
+      iCommandTimeout = 50;
+      uCommandSendTime = s_uTimeNow;
+      uLastUploadTime = s_uTimeNow;
+      _link_send(&s_LinkUp, uPacket, 160+iLength);
+   }
+
+   FILE* fd = fopen(s_szOutputFile, "wb");
+   if ( NULL != fd )
+   {
+      fwrite(pOutput, 1, s_iFileSize, fd);
+      fclose(fd);
+   }
+   free(pReceived);
+   free(pOutput);
+   return s_uTimeNow;
+}
+
+//---------------------------------------------------
+// Windowed transfers
+
+// Command and response headers, as added by the commands transport
+#define TEST_COMMAND_OVERHEAD 24
+
+static int _send_segment_downlink(void* pContext, u8* pData, int iLength)
+{
+   u8 uPacket[TEST_LINK_MAX_PACKET_SIZE];
+   memset(uPacket, 0, TEST_COMMAND_OVERHEAD);
+   memcpy(&uPacket[TEST_COMMAND_OVERHEAD], pData, iLength);
+   _link_send(&s_LinkDown, uPacket, TEST_COMMAND_OVERHEAD + iLength);
+   return iLength;
+}
+
+static int _send_segment_uplink(void* pContext, u8* pData, int iLength)
+{
+   u8 uPacket[TEST_LINK_MAX_PACKET_SIZE];
+   memset(uPacket, 0, TEST_COMMAND_OVERHEAD);
+   memcpy(&uPacket[TEST_COMMAND_OVERHEAD], pData, iLength);
+   _link_send(&s_LinkUp, uPacket, TEST_COMMAND_OVERHEAD + iLength);
+   return iLength;
+}
+
+static void _send_ack(t_test_link* pLink, t_file_transfer_receiver* pReceiver)
+{
+   u8 uPacket[TEST_COMMAND_OVERHEAD + sizeof(t_file_transfer_ack)];
+   memset(uPacket, 0, TEST_COMMAND_OVERHEAD);
+   file_transfer_receiver_get_ack(pReceiver, (t_file_transfer_ack*)&uPacket[TEST_COMMAND_OVERHEAD]);
+   _link_send(pLink, uPacket, sizeof(uPacket));
+}
+
+// Downloads (vehicle sends the file) until complete or until iStopAfterSegments segments are received.
+// Returns the transfer time in ms.
+static u32 _windowed_download(int iFECGroup, int iStopAfterSegments, t_file_transfer_sender_stats* pSenderStats, t_file_transfer_receiver_stats* pReceiverStats)
+{
+   t_file_transfer_sender sender;
+   t_file_transfer_receiver receiver;
+   bool bSenderOpen = false;
+   file_transfer_receiver_open(&receiver, 0, s_szOutputFile, FILE_TRANSFER_DEFAULT_WINDOW);
+   u32 uLastAckTime = 0;
+   int iSegmentsSinceAck = 0;
+   u32 uTimeEnd = TEST_MAX_TIME_MS;
+
+   for( s_uTimeNow=1; s_uTimeNow<TEST_MAX_TIME_MS; s_uTimeNow++ )
+   {
+      t_test_packet* pPacket;
+      // Vehicle: answers each ack with the segments the window allows
+      while ( NULL != (pPacket = _link_receive(&s_LinkUp)) )
+      {
+         if ( ! bSenderOpen )
+         {
+            if ( 0 != file_transfer_sender_open_file(&sender, 0, s_szSourceFile, FILE_TRANSFER_DEFAULT_SEGMENT_SIZE, iFECGroup, _send_segment_downlink, NULL) )
+               return 0;
+            bSenderOpen = true;
+         }
+         file_transfer_sender_on_ack(&sender, (t_file_transfer_ack*)&pPacket->uData[TEST_COMMAND_OVERHEAD], s_uTimeNow);
+         file_transfer_sender_send(&sender, s_uTimeNow);
+      }
+      // Controller
+      while ( NULL != (pPacket = _link_receive(&s_LinkDown)) )
+      {
+         if ( file_transfer_receiver_on_segment(&receiver, &pPacket->uData[TEST_COMMAND_OVERHEAD], pPacket->iLength - TEST_COMMAND_OVERHEAD) < 0 )
+            continue;
+         iSegmentsSinceAck++;
+         if ( iSegmentsSinceAck >= 4 )
+         {
+            _send_ack(&s_LinkUp, &receiver);
+            uLastAckTime = s_uTimeNow;
+            iSegmentsSinceAck = 0;
+         }
+      }
+      if ( file_transfer_receiver_is_complete(&receiver) )
+      {
+         uTimeEnd = s_uTimeNow;
+         break;
+      }
+      if ( (iStopAfterSegments > 0) && ((int)receiver.uCountReceived >= iStopAfterSegments) )
+      {
+         uTimeEnd = s_uTimeNow;
+         break;
+      }
+      if ( s_uTimeNow >= uLastAckTime + 50 )
+      {
+         _send_ack(&s_LinkUp, &receiver);
+         uLastAckTime = s_uTimeNow;
+         iSegmentsSinceAck = 0;
+      }
+   }
+   if ( NULL != pReceiverStats )
+      memcpy(pReceiverStats, &receiver.stats, sizeof(t_file_transfer_receiver_stats));
+   if ( bSenderOpen && (NULL != pSenderStats) )
+      memcpy(pSenderStats, &sender.stats, sizeof(t_file_transfer_sender_stats));
+   file_transfer_receiver_close(&receiver);
+   if ( bSenderOpen )
+      file_transfer_sender_close(&sender);
+   return uTimeEnd;
+}
+
+// Uploads (controller sends the file, vehicle acks each segment)
+static u32 _windowed_upload(int iFECGroup, t_file_transfer_sender_stats* pSenderStats)
+{
+   t_file_transfer_sender sender;
+   t_file_transfer_receiver receiver;
+   if ( 0 != file_transfer_sender_open_file(&sender, 0, s_szSourceFile, FILE_TRANSFER_DEFAULT_SEGMENT_SIZE, iFECGroup, _send_segment_uplink, NULL) )
+      return 0;
+   file_transfer_receiver_open(&receiver, 0, s_szOutputFile, FILE_TRANSFER_DEFAULT_WINDOW);
+   u32 uTimeEnd = TEST_MAX_TIME_MS;
+
+   for( s_uTimeNow=1; s_uTimeNow<TEST_MAX_TIME_MS; s_uTimeNow++ )
+   {
+      t_test_packet* pPacket;
+      // Vehicle
+      while ( NULL != (pPacket = _link_receive(&s_LinkUp)) )
+      {
+         file_transfer_receiver_on_segment(&receiver, &pPacket->uData[TEST_COMMAND_OVERHEAD], pPacket->iLength - TEST_COMMAND_OVERHEAD);
+         _send_ack(&s_LinkDown, &receiver);
+      }
+      // Controller
+      while ( NULL != (pPacket = _link_receive(&s_LinkDown)) )
+      {
+         file_transfer_sender_on_ack(&sender, (t_file_transfer_ack*)&pPacket->uData[TEST_COMMAND_OVERHEAD], s_uTimeNow);
+         file_transfer_sender_send(&sender, s_uTimeNow);
+      }
+      if ( file_transfer_sender_is_complete(&sender) )
+      {
+         uTimeEnd = s_uTimeNow;
+         break;
+      }
+      file_transfer_sender_send(&sender, s_uTimeNow);
+   }
+   if ( NULL != pSenderStats )
+      memcpy(pSenderStats, &sender.stats, sizeof(t_file_transfer_sender_stats));
+   file_transfer_receiver_close(&receiver);
+   file_transfer_sender_close(&sender);
+   return uTimeEnd;
+}
+
+//---------------------------------------------------
+
+static int _test_scenario(t_test_scenario* pScenario)
+{
+   int iPassed = 1;
+   t_file_transfer_sender_stats senderStats;
+   t_file_transfer_receiver_stats receiverStats;
+   char szOutputState[MAX_FILE_PATH_SIZE];
+   snprintf(szOutputState, sizeof(szOutputState), "%s.part", s_szOutputFile);
+
+   printf("%s (one way delay %d ms, loss %d%% each way), %d KB file:\n", pScenario->szName, pScenario->iDelayMs, pScenario->iLossPercent, s_iFileSize/1024);
+
+   _links_init(pScenario);
+   unlink(s_szOutputFile);
+   u32 uTimeLegacy = _legacy_download();
+   int iOk = _check_output_file(s_iFileSize);
+   printf("   Download legacy:         %7.1f sec, %5u packets up, %5u packets down, %5u file opens, content %s\n",
+      uTimeLegacy/1000.0, s_LinkUp.uCountPackets, s_LinkDown.uCountPackets, s_uCountLegacyFileOpens, iOk?"ok":"WRONG");
+   iPassed &= iOk;
+
+   u32 uTimeWindowed[2];
+   for( int i=0; i<2; i++ )
+   {
+      int iFECGroup = (0 == i)?0:FILE_TRANSFER_DEFAULT_FEC_GROUP;
+      _links_init(pScenario);
+      unlink(s_szOutputFile);
+      unlink(szOutputState);
+      memset(&senderStats, 0, sizeof(senderStats));
+      memset(&receiverStats, 0, sizeof(receiverStats));
+      uTimeWindowed[i] = _windowed_download(iFECGroup, 0, &senderStats, &receiverStats);
+      iOk = _check_output_file(s_iFileSize);
+      printf("   Download windowed%s:  %7.1f sec, %5u packets up, %5u packets down, %5u resent, %4u rebuilt from parity, content %s\n",
+         iFECGroup?"+FEC":"    ", uTimeWindowed[i]/1000.0, s_LinkUp.uCountPackets, s_LinkDown.uCountPackets,
+         senderStats.uCountSegmentsResent, receiverStats.uCountRecovered, iOk?"ok":"WRONG");
+      iPassed &= iOk;
+   }
+   u32 uTimeBest = (uTimeWindowed[0] < uTimeWindowed[1])?uTimeWindowed[0]:uTimeWindowed[1];
+   printf("   Download speedup: %.1fx\n", (float)uTimeLegacy/(float)uTimeBest);
+   if ( uTimeBest >= uTimeLegacy )
+      iPassed = 0;
+
+   _links_init(pScenario);
+   unlink(s_szOutputFile);
+   uTimeLegacy = _legacy_upload();
+   iOk = _check_output_file(s_iFileSize);
+   printf("   Upload legacy:           %7.1f sec, %5u packets up, %5u packets down, content %s\n",
+      uTimeLegacy/1000.0, s_LinkUp.uCountPackets, s_LinkDown.uCountPackets, iOk?"ok":"WRONG");
+   iPassed &= iOk;
+
+   _links_init(pScenario);
+   unlink(s_szOutputFile);
+   unlink(szOutputState);
+   memset(&senderStats, 0, sizeof(senderStats));
+   u32 uTimeUpload = _windowed_upload(FILE_TRANSFER_DEFAULT_FEC_GROUP, &senderStats);
+   iOk = _check_output_file(s_iFileSize);
+   printf("   Upload windowed+FEC:     %7.1f sec, %5u packets up, %5u packets down, %5u resent, content %s\n",
+      uTimeUpload/1000.0, s_LinkUp.uCountPackets, s_LinkDown.uCountPackets, senderStats.uCountSegmentsResent, iOk?"ok":"WRONG");
+   printf("   Upload speedup: %.1fx\n", (float)uTimeLegacy/(float)uTimeUpload);
+   iPassed &= iOk;
+   if ( uTimeUpload >= uTimeLegacy )
+      iPassed = 0;
+   return iPassed;
+}
+
+static int _test_resume()
+{
+   t_test_scenario scenario = { "Resume", 150, 5 };
+   char szOutputState[MAX_FILE_PATH_SIZE];
+   snprintf(szOutputState, sizeof(szOutputState), "%s.part", s_szOutputFile);
+   t_file_transfer_sender_stats senderStats1, senderStats2;
+   t_file_transfer_receiver_stats receiverStats;
+   int iTotalSegments = (s_iFileSize + FILE_TRANSFER_DEFAULT_SEGMENT_SIZE - 1) / FILE_TRANSFER_DEFAULT_SEGMENT_SIZE;
+
+   _links_init(&scenario);
+   unlink(s_szOutputFile);
+   unlink(szOutputState);
+   memset(&senderStats1, 0, sizeof(senderStats1));
+   _windowed_download(FILE_TRANSFER_DEFAULT_FEC_GROUP, iTotalSegments/2, &senderStats1, NULL);
+   int iHasState = (0 == access(szOutputState, F_OK))?1:0;
+
+   // New link session, new sender: the receiver continues from its state file
+   _links_init(&scenario);
+   memset(&senderStats2, 0, sizeof(senderStats2));
+   memset(&receiverStats, 0, sizeof(receiverStats));
+   _windowed_download(FILE_TRANSFER_DEFAULT_FEC_GROUP, 0, &senderStats2, &receiverStats);
+   int iOk = _check_output_file(s_iFileSize);
+   int iStateRemoved = (0 != access(szOutputState, F_OK))?1:0;
+
+   u32 uTotalSent = senderStats1.uCountSegmentsSent + senderStats2.uCountSegmentsSent;
+   printf("Resume: interrupted at %d of %d segments, state file %s; resumed with %u segments already received,\n",
+      iTotalSegments/2, iTotalSegments, iHasState?"kept":"MISSING", receiverStats.uCountResumedSegments);
+   printf("   %u segments sent in total (%u first session, %u second session), content %s, state file %s\n",
+      uTotalSent, senderStats1.uCountSegmentsSent, senderStats2.uCountSegmentsSent, iOk?"ok":"WRONG", iStateRemoved?"removed":"NOT REMOVED");
+
+   if ( (! iOk) || (! iHasState) || (! iStateRemoved) )
+      return 0;
+   if ( (int)receiverStats.uCountResumedSegments < iTotalSegments/2 )
+      return 0;
+   // The second session must not resend the whole file
+   if ( (int)senderStats2.uCountSegmentsSent >= iTotalSegments )
+      return 0;
+   return 1;
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_file_transfer [file_size_kb]\n");
+      return 0;
+   }
+   if ( argc >= 2 )
+      s_iFileSize = atoi(argv[1])*1024;
+   if ( s_iFileSize < 1024 )
+      s_iFileSize = 1024;
+   // Not a multiple of the segment sizes
+   s_iFileSize += 371;
+
+   log_init_local_only("TestFileTransfer");
+   log_disable_stdout();
+
+   s_pSourceData = (u8*)malloc(s_iFileSize);
+   if ( NULL == s_pSourceData )
+      return -1;
+   for( int i=0; i<s_iFileSize; i++ )
+      s_pSourceData[i] = (u8)(_random() & 0xFF);
+   FILE* fd = fopen(s_szSourceFile, "wb");
+   if ( NULL == fd )
+   {
+      printf("Failed to create source file.\n");
+      return -1;
+   }
+   fwrite(s_pSourceData, 1, s_iFileSize, fd);
+   fclose(fd);
+
+   t_test_scenario scenarios[] =
+   {
+      { "Short range", 5, 1 },
+      { "Long range", 150, 5 },
+      { "Long range, bad link", 300, 15 }
+   };
+
+   int iPassed = 1;
+   printf("\n");
+   for( int i=0; i<(int)(sizeof(scenarios)/sizeof(scenarios[0])); i++ )
+   {
+      iPassed &= _test_scenario(&scenarios[i]);
+      printf("\n");
+   }
+   iPassed &= _test_resume();
+
+   unlink(s_szSourceFile);
+   unlink(s_szOutputFile);
+   free(s_pSourceData);
+
+   if ( iPassed )
+      printf("\nTest passed\n");
+   else
+      printf("\nTest FAILED\n");
+   return iPassed?0:-1;
+}
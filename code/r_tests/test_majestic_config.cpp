@@ -0,0 +1,256 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../base/hw_procs.h"
+#include "../base/majestic_config.h"
+
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+// Applies full camera/video profile switches to a local fake majestic.yaml, with a stub
+// "majestic" process that counts reload signals, using:
+//  - one shell command per parameter (what "cli -s" costs: fork + exec + full file rewrite) plus a shell "kill -HUP"
+//  - the batched native config writer: one atomic file update plus one SIGHUP
+// Verifies the resulting config values and reload counts, and reports the time of a profile switch.
+
+#define TEST_CONFIG_FILE "/tmp/test_majestic.yaml"
+#define TEST_STUB_PROCESS_NAME "fake_majestic"
+
+static const char* s_szFakeConfig =
+   "system:\n"
+   "  webPort: 80\n"
+   "  logLevel: debug\n"
+   "isp:\n"
+   "  sensorConfig: /etc/sensors/imx415.bin\n"
+   "  exposure: 10\n"
+   "image:\n"
+   "  mirror: false\n"
+   "  flip: false\n"
+   "  rotate: 0\n"
+   "  contrast: 50\n"
+   "  hue: 50\n"
+   "  saturation: 50\n"
+   "  luminance: 50\n"
+   "# Main stream\n"
+   "video0:\n"
+   "  enabled: true\n"
+   "  codec: h264\n"
+   "  fps: 30\n"
+   "  bitrate: 4096\n"
+   "  size: 1920x1080\n"
+   "video1:\n"
+   "  enabled: true\n"
+   "  codec: h264\n"
+   "rtsp:\n"
+   "  enabled: true\n"
+   "  port: 554\n"
+   "outgoing:\n"
+   "  enabled: true\n"
+   "  server: udp://127.0.0.1:5600\n"
+   "watchdog:\n"
+   "  enabled: true\n"
+   "  timeout: 10\n";
+
+static volatile u32* s_pReloadCounter = NULL;
+
+static void _stub_on_sighup(int iSignal)
+{
+   (*s_pReloadCounter)++;
+}
+
+static pid_t _start_stub_process()
+{
+   pid_t pid = fork();
+   if ( 0 != pid )
+      return pid;
+   prctl(PR_SET_NAME, TEST_STUB_PROCESS_NAME, 0, 0, 0);
+   signal(SIGHUP, _stub_on_sighup);
+   while ( 1 )
+      pause();
+   return 0;
+}
+
+static void _build_profile(t_majestic_config_batch* pBatch, int iProfile)
+{
+   majestic_config_batch_init(pBatch);
+   majestic_config_batch_set_bool(pBatch, ".watchdog.enabled", 0);
+   majestic_config_batch_set(pBatch, ".system.logLevel", "info");
+   majestic_config_batch_set_bool(pBatch, ".rtsp.enabled", 0);
+   majestic_config_batch_set_bool(pBatch, ".video1.enabled", 0);
+   majestic_config_batch_set_bool(pBatch, ".video0.enabled", 1);
+   majestic_config_batch_set(pBatch, ".video0.rcMode", "cbr");
+   majestic_config_batch_set(pBatch, ".video0.codec", (iProfile & 1)?"h265":"h264");
+   majestic_config_batch_set_int(pBatch, ".video0.fps", (iProfile & 1)?90:60);
+   majestic_config_batch_set_int(pBatch, ".video0.bitrate", (iProfile & 1)?12000:7000);
+   majestic_config_batch_set(pBatch, ".video0.size", (iProfile & 1)?"1280x720":"1920x1080");
+   majestic_config_batch_set_int(pBatch, ".outgoing.naluSize", (iProfile & 1)?1100:1250);
+   majestic_config_batch_set(pBatch, ".video0.gopSize", (iProfile & 1)?"0.2":"0.5");
+   majestic_config_batch_set_int(pBatch, ".image.luminance", 40 + iProfile);
+   majestic_config_batch_set_int(pBatch, ".image.contrast", 60 + iProfile);
+   majestic_config_batch_set_int(pBatch, ".image.saturation", 45 + iProfile);
+   majestic_config_batch_set_int(pBatch, ".image.hue", 50 + (iProfile & 1));
+   majestic_config_batch_set_bool(pBatch, ".image.flip", iProfile & 1);
+   majestic_config_batch_set_bool(pBatch, ".image.mirror", iProfile & 1);
+   if ( iProfile & 1 )
+      majestic_config_batch_delete(pBatch, ".isp.exposure");
+   else
+      majestic_config_batch_set_int(pBatch, ".isp.exposure", 8);
+}
+
+// Stand-in for majestic's cli: rewrites the whole file for a single section.key change
+static void _apply_profile_using_shell(t_majestic_config_batch* pBatch)
+{
+   char szComm[512];
+   for( int i=0; i<pBatch->iCountChanges; i++ )
+   {
+      char szSection[MAJESTIC_CONFIG_MAX_PATH];
+      strcpy(szSection, pBatch->changes[i].szPath+1);
+      char* pKey = strchr(szSection, '.');
+      *pKey = 0;
+      pKey++;
+      snprintf(szComm, sizeof(szComm),
+         "awk -v sec=%s -v key=%s -v val=%s -v del=%d '/^[^ #]/{split($0,a,\":\"); s=a[1]} "
+         "{ if (s==sec && $0 ~ \"^  \"key\":\") { if (!del) print \"  \"key\": \"val } else print }' %s > %s.cli && mv %s.cli %s",
+         szSection, pKey, pBatch->changes[i].iDelete?"-":pBatch->changes[i].szValue, pBatch->changes[i].iDelete,
+         TEST_CONFIG_FILE, TEST_CONFIG_FILE, TEST_CONFIG_FILE, TEST_CONFIG_FILE);
+      hw_execute_bash_command_raw_silent(szComm, NULL);
+   }
+   hw_execute_bash_command_raw_silent("pkill -HUP -x " TEST_STUB_PROCESS_NAME, NULL);
+}
+
+static void _apply_profile_batched(t_majestic_config_batch* pBatch)
+{
+   if ( majestic_config_batch_apply(pBatch, TEST_CONFIG_FILE) > 0 )
+      majestic_config_signal_reload(TEST_STUB_PROCESS_NAME);
+}
+
+static int _verify_profile(t_majestic_config_batch* pBatch, const char* szName)
+{
+   int iFailed = 0;
+   char szValue[128];
+   for( int i=0; i<pBatch->iCountChanges; i++ )
+   {
+      int iFound = majestic_config_get_value(TEST_CONFIG_FILE, pBatch->changes[i].szPath, szValue, sizeof(szValue));
+      if ( pBatch->changes[i].iDelete )
+      {
+         if ( iFound )
+         {
+            printf("  %s: FAIL, %s was not deleted\n", szName, pBatch->changes[i].szPath);
+            iFailed++;
+         }
+         continue;
+      }
+      // The shell stand-in only edits existing keys
+      if ( (! iFound) && (NULL != strstr(szName, "Shell")) )
+         continue;
+      if ( (! iFound) || (0 != strcmp(szValue, pBatch->changes[i].szValue)) )
+      {
+         printf("  %s: FAIL, %s is (%s), expected (%s)\n", szName, pBatch->changes[i].szPath, iFound?szValue:"missing", pBatch->changes[i].szValue);
+         iFailed++;
+      }
+   }
+   return iFailed;
+}
+
+static void _write_fake_config()
+{
+   FILE* fd = fopen(TEST_CONFIG_FILE, "w");
+   if ( NULL != fd )
+   {
+      fputs(s_szFakeConfig, fd);
+      fclose(fd);
+   }
+}
+
+static int _run_test(const char* szName, void (*pfApply)(t_majestic_config_batch*), int iSwitches)
+{
+   static t_majestic_config_batch s_Profiles[2];
+   _build_profile(&s_Profiles[0], 0);
+   _build_profile(&s_Profiles[1], 1);
+   _write_fake_config();
+   *s_pReloadCounter = 0;
+
+   int iFailed = 0;
+   u32 uTotalMicros = 0;
+   u32 uMaxMicros = 0;
+   for( int i=0; i<iSwitches; i++ )
+   {
+      u32 uStart = get_current_timestamp_micros();
+      pfApply(&s_Profiles[i%2]);
+      u32 uDuration = get_current_timestamp_micros() - uStart;
+      uTotalMicros += uDuration;
+      if ( uDuration > uMaxMicros )
+         uMaxMicros = uDuration;
+      if ( i < 2 )
+         iFailed += _verify_profile(&s_Profiles[i%2], szName);
+   }
+
+   // Give the stub time to handle the last signal
+   for( int i=0; (i<50) && (*s_pReloadCounter < (u32)iSwitches); i++ )
+      hardware_sleep_ms(2);
+   if ( *s_pReloadCounter != (u32)iSwitches )
+   {
+      printf("  %s: FAIL, stub got %u reloads, expected %d\n", szName, *s_pReloadCounter, iSwitches);
+      iFailed++;
+   }
+
+   printf("%-22s profile switch (%d params): avg %6u us, max %6u us, reloads: %u, %s\n",
+      szName, s_Profiles[0].iCountChanges, uTotalMicros/iSwitches, uMaxMicros, *s_pReloadCounter, iFailed?"FAILED":"ok");
+   return iFailed;
+}
+
+int main(int argc, char *argv[])
+{
+   int iSwitches = 20;
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_majestic_config [profile_switches]\n");
+      return 0;
+   }
+   if ( argc >= 2 )
+      iSwitches = atoi(argv[1]);
+   if ( iSwitches < 2 )
+      iSwitches = 2;
+
+   log_init_local_only("TestMajesticConfig");
+   log_disable_stdout();
+
+   s_pReloadCounter = (volatile u32*) mmap(NULL, sizeof(u32), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   if ( MAP_FAILED == (void*)s_pReloadCounter )
+   {
+      printf("Failed to map reload counter.\n");
+      return -1;
+   }
+   pid_t pidStub = _start_stub_process();
+   hardware_sleep_ms(50);
+
+   printf("\nMajestic config test: %d profile switches, stub process pid %d\n\n", iSwitches, (int)pidStub);
+
+   int iFailed = 0;
+   iFailed += _run_test("Shell per parameter", _apply_profile_using_shell, iSwitches);
+   iFailed += _run_test("Batched native", _apply_profile_batched, iSwitches);
+
+   // Applying the same profile again must not rewrite the file nor reload
+   t_majestic_config_batch batch;
+   _build_profile(&batch, 0);
+   majestic_config_batch_apply(&batch, TEST_CONFIG_FILE);
+   int iChanged = majestic_config_batch_apply(&batch, TEST_CONFIG_FILE);
+   if ( 0 != iChanged )
+   {
+      printf("Reapplying same profile: FAIL, %d values changed\n", iChanged);
+      iFailed++;
+   }
+   if ( 0 == access(TEST_CONFIG_FILE ".tmp", F_OK) )
+   {
+      printf("FAIL, temp config file left behind\n");
+      iFailed++;
+   }
+
+   kill(pidStub, SIGKILL);
+   waitpid(pidStub, NULL, 0);
+   unlink(TEST_CONFIG_FILE);
+
+   printf("\n%s\n", iFailed?"Test FAILED":"Test passed");
+   return iFailed?1:0;
+}
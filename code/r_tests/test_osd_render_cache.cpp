@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../renderer/render_spans.h"
+#include "../renderer/render_cache.h"
+
+// Headless check of the OSD panels render cache.
+// Renders a scripted telemetry sequence (values changing at 2..10 Hz) at 60 fps into an
+// offscreen 32 bpp surface, once drawing every panel every frame and once through the render cache.
+// Verifies both produce identical frames and reports per frame CPU time and cache hit rate.
+
+#define SCREEN_WIDTH 1280
+#define SCREEN_HEIGHT 720
+#define GLYPH_SIZE 12
+#define COUNT_PANELS 6
+#define FRAME_MS 16
+
+typedef struct
+{
+   const char* szName;
+   int iX, iY, iWidth, iHeight;
+   int iLines;
+   unsigned int uUpdateIntervalMs; // how often its bound input changes
+   unsigned int uValueVersion;
+} t_test_panel;
+
+static unsigned char s_Screen[SCREEN_WIDTH*SCREEN_HEIGHT*4];
+static unsigned char s_Glyphs[16][GLYPH_SIZE*GLYPH_SIZE*4];
+
+static t_test_panel s_Panels[COUNT_PANELS] =
+{
+   { "radio links",   20, 400, 300, 280, 14, 350, 0 },
+   { "radio ifaces", 340, 400, 300, 280, 14, 350, 0 },
+   { "telemetry",    660, 400, 280, 200, 10, 100, 0 },
+   { "rc",           960, 400, 280, 200, 10, 100, 0 },
+   { "efficiency",    20,  40, 260, 120,  6, 500, 0 },
+   { "audio",       1000,  40, 240, 120,  6, 250, 0 },
+};
+
+static void _build_glyphs()
+{
+   srand(42);
+   for( int g=0; g<16; g++ )
+   for( int i=0; i<GLYPH_SIZE*GLYPH_SIZE; i++ )
+   {
+      unsigned char uAlpha = ((rand() % 3) == 0)?(rand() & 0xFF):0;
+      s_Glyphs[g][i*4+0] = 255;
+      s_Glyphs[g][i*4+1] = 255;
+      s_Glyphs[g][i*4+2] = 255;
+      s_Glyphs[g][i*4+3] = uAlpha;
+   }
+}
+
+// Same amount of work as a stats panel: background, then lines of text glyphs whose content depends on the value
+static void _draw_panel(t_test_panel* pPanel)
+{
+   unsigned char uBg[4] = { 20, 20, 20, 0 };
+   for( int y=0; y<pPanel->iHeight; y++ )
+      render_span_blend_color(s_Screen + (pPanel->iY+y)*SCREEN_WIDTH*4 + pPanel->iX*4, pPanel->iWidth, uBg, 160);
+
+   int iCharsPerLine = (pPanel->iWidth - 8) / GLYPH_SIZE;
+   for( int iLine=0; iLine<pPanel->iLines; iLine++ )
+   {
+      int yLine = pPanel->iY + 4 + iLine*(GLYPH_SIZE+6);
+      if ( yLine + GLYPH_SIZE > pPanel->iY + pPanel->iHeight )
+         break;
+      unsigned int uSeed = pPanel->uValueVersion * 31 + iLine * 7;
+      for( int iChar=0; iChar<iCharsPerLine; iChar++ )
+      {
+         int iGlyph = (uSeed + iChar*13) % 16;
+         // Font rendering goes glyph by glyph, row by row
+         for( int y=0; y<GLYPH_SIZE; y++ )
+            render_span_blit_alpha(s_Screen + (yLine+y)*SCREEN_WIDTH*4 + (pPanel->iX + 4 + iChar*GLYPH_SIZE)*4, &s_Glyphs[iGlyph][y*GLYPH_SIZE*4], GLYPH_SIZE, 0);
+      }
+   }
+}
+
+static double _time_now_micros()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec*1000000.0 + ts.tv_nsec/1000.0;
+}
+
+static unsigned int _screen_checksum()
+{
+   return render_cache_hash(render_cache_hash_start(), s_Screen, sizeof(s_Screen));
+}
+
+// Returns average panels render time per frame in microseconds; fills pChecksums with one checksum per frame
+static double _run_sequence(int iFrames, int iUseCache, unsigned int* pChecksums)
+{
+   t_render_surface surface;
+   surface.pData = s_Screen;
+   surface.iStride = SCREEN_WIDTH*4;
+   surface.iBytesPerPixel = 4;
+   surface.iWidth = SCREEN_WIDTH;
+   surface.iHeight = SCREEN_HEIGHT;
+   surface.uClearByte = 0;
+
+   render_cache_init();
+   double fTotalMicros = 0;
+   for( int iFrame=0; iFrame<iFrames; iFrame++ )
+   {
+      unsigned int uTimeNow = 1000 + iFrame * FRAME_MS;
+      // Scripted telemetry: each panel bound input changes at its own rate
+      for( int i=0; i<COUNT_PANELS; i++ )
+         s_Panels[i].uValueVersion = uTimeNow / s_Panels[i].uUpdateIntervalMs;
+
+      // Frame clear is the same in both cases, only panels rendering is timed
+      memset(s_Screen, surface.uClearByte, sizeof(s_Screen));
+      double fStart = _time_now_micros();
+      for( int i=0; i<COUNT_PANELS; i++ )
+      {
+         t_test_panel* pPanel = &s_Panels[i];
+         int iResult = RENDER_CACHE_DRAW;
+         if ( iUseCache )
+         {
+            unsigned int uKey = render_cache_hash(render_cache_hash_start(), &pPanel->uValueVersion, sizeof(unsigned int));
+            iResult = render_cache_begin(&surface, i, pPanel->iX, pPanel->iY, pPanel->iWidth, pPanel->iHeight, uKey, uTimeNow, 500);
+         }
+         if ( RENDER_CACHE_HIT == iResult )
+            continue;
+         _draw_panel(pPanel);
+         if ( RENDER_CACHE_DRAW_AND_CAPTURE == iResult )
+            render_cache_end(&surface, i);
+      }
+      fTotalMicros += _time_now_micros() - fStart;
+      pChecksums[iFrame] = _screen_checksum();
+   }
+   return fTotalMicros / iFrames;
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_osd_render_cache [frames]\n");
+      return 0;
+   }
+   int iFrames = 600;
+   if ( argc >= 2 )
+      iFrames = atoi(argv[1]);
+   if ( iFrames < 10 )
+      iFrames = 10;
+
+   _build_glyphs();
+   unsigned int* pChecksumsDirect = (unsigned int*) malloc(iFrames*sizeof(unsigned int));
+   unsigned int* pChecksumsCached = (unsigned int*) malloc(iFrames*sizeof(unsigned int));
+
+   printf("\nOSD render cache test: %d frames at %d ms, %d panels, %dx%d surface\n", iFrames, FRAME_MS, COUNT_PANELS, SCREEN_WIDTH, SCREEN_HEIGHT);
+
+   double fDirect = _run_sequence(iFrames, 0, pChecksumsDirect);
+   double fCached = _run_sequence(iFrames, 1, pChecksumsCached);
+
+   t_render_cache_stats stats;
+   render_cache_get_stats(&stats);
+   unsigned int uTotal = stats.uCountHits + stats.uCountMisses + stats.uCountBypass;
+
+   int iMismatches = 0;
+   for( int i=0; i<iFrames; i++ )
+      if ( pChecksumsDirect[i] != pChecksumsCached[i] )
+         iMismatches++;
+
+   printf("  Redraw every frame: %8.1f us/frame\n", fDirect);
+   printf("  Render cache:       %8.1f us/frame (x%.1f), hits: %u, redraws: %u, not cacheable: %u, hit rate: %u%%\n",
+      fCached, (fCached > 0.0)?(fDirect/fCached):0.0, stats.uCountHits, stats.uCountMisses, stats.uCountBypass, (uTotal > 0)?(stats.uCountHits*100/uTotal):0);
+   if ( iMismatches )
+      printf("FAILED: %d frames differ from the uncached rendering.\n", iMismatches);
+   else
+      printf("  All frames identical to the uncached rendering.\n");
+
+   render_cache_uninit();
+   free(pChecksumsDirect);
+   free(pChecksumsCached);
+   return iMismatches?1:0;
+}
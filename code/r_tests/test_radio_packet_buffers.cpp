@@ -0,0 +1,227 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include <pthread.h>
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../radio/radio_packet_buffers.h"
+
+// Passes packets from a producer thread (as the radio rx thread does) to a consumer thread through a
+// queue of reference counted packet buffers. A second holder (as a retransmissions cache would) keeps
+// an extra reference to some packets and releases them later from its own thread.
+// Checks that the packets arrive unchanged, that an empty pool fails allocations instead of blocking,
+// and that all buffers are back in the pool at the end.
+
+#define TEST_PACKETS 200000
+#define TEST_POOL_SIZE 64
+#define TEST_QUEUE_SIZE 32
+#define TEST_HELD_PACKETS 16
+
+static t_radio_packet_buffer_pool s_Pool;
+static t_radio_packet_buffer* s_pQueue[TEST_QUEUE_SIZE];
+static volatile int s_iQueueWrite = 0;
+static volatile int s_iQueueRead = 0;
+static t_radio_packet_buffer* s_pHeld[TEST_HELD_PACKETS];
+static volatile int s_iHeldWrite = 0;
+static volatile int s_iHeldRead = 0;
+static volatile int s_iProducerDone = 0;
+static volatile int s_iConsumerDone = 0;
+static int s_iFailed = 0;
+static int s_iCountAllocFailures = 0;
+static int s_iCountReceived = 0;
+
+static int _test_packet_length(int iIndex)
+{
+   return 20 + (iIndex * 37) % (MAX_PACKET_TOTAL_SIZE - 20);
+}
+
+static void* _thread_producer(void* pArg)
+{
+   for( int i=0; i<TEST_PACKETS; i++ )
+   {
+      t_radio_packet_buffer* pBuffer = NULL;
+      while ( NULL == (pBuffer = radio_packet_buffers_alloc(&s_Pool)) )
+      {
+         s_iCountAllocFailures++;
+         hardware_sleep_micros(50);
+      }
+      pBuffer->iLength = _test_packet_length(i);
+      memcpy(pBuffer->uData, &i, sizeof(int));
+      for( int k=sizeof(int); k<pBuffer->iLength; k++ )
+         pBuffer->uData[k] = (u8)(i + k);
+
+      while ( ((s_iQueueWrite + 1) % TEST_QUEUE_SIZE) == s_iQueueRead )
+         hardware_sleep_micros(20);
+      s_pQueue[s_iQueueWrite] = pBuffer;
+      __sync_synchronize();
+      s_iQueueWrite = (s_iQueueWrite + 1) % TEST_QUEUE_SIZE;
+   }
+   s_iProducerDone = 1;
+   return NULL;
+}
+
+static void* _thread_consumer(void* pArg)
+{
+   int iExpected = 0;
+   while ( (! s_iProducerDone) || (s_iQueueRead != s_iQueueWrite) )
+   {
+      if ( s_iQueueRead == s_iQueueWrite )
+      {
+         hardware_sleep_micros(20);
+         continue;
+      }
+      __sync_synchronize();
+      t_radio_packet_buffer* pBuffer = s_pQueue[s_iQueueRead];
+      s_iQueueRead = (s_iQueueRead + 1) % TEST_QUEUE_SIZE;
+
+      int iIndex = 0;
+      memcpy(&iIndex, pBuffer->uData, sizeof(int));
+      int bOk = (iIndex == iExpected) && (pBuffer->iLength == _test_packet_length(iIndex));
+      for( int k=sizeof(int); bOk && (k<pBuffer->iLength); k++ )
+         if ( pBuffer->uData[k] != (u8)(iIndex + k) )
+            bOk = 0;
+      if ( ! bOk )
+      {
+         if ( ! s_iFailed )
+            printf("   Packet %d is wrong (got packet %d, %d bytes)\n", iExpected, iIndex, pBuffer->iLength);
+         s_iFailed = 1;
+      }
+      iExpected++;
+      s_iCountReceived++;
+
+      // Every few packets, hand a reference to the second holder too
+      if ( (0 == (iIndex % 5)) && (((s_iHeldWrite + 1) % TEST_HELD_PACKETS) != s_iHeldRead) )
+      {
+         radio_packet_buffers_ref(pBuffer);
+         s_pHeld[s_iHeldWrite] = pBuffer;
+         __sync_synchronize();
+         s_iHeldWrite = (s_iHeldWrite + 1) % TEST_HELD_PACKETS;
+      }
+      radio_packet_buffers_unref(pBuffer);
+   }
+   s_iConsumerDone = 1;
+   return NULL;
+}
+
+static void* _thread_holder(void* pArg)
+{
+   while ( (! s_iConsumerDone) || (s_iHeldRead != s_iHeldWrite) )
+   {
+      if ( s_iHeldRead == s_iHeldWrite )
+      {
+         hardware_sleep_micros(50);
+         continue;
+      }
+      __sync_synchronize();
+      radio_packet_buffers_unref(s_pHeld[s_iHeldRead]);
+      s_iHeldRead = (s_iHeldRead + 1) % TEST_HELD_PACKETS;
+   }
+   return NULL;
+}
+
+static void _test_exhaustion()
+{
+   t_radio_packet_buffer* pBuffers[TEST_POOL_SIZE];
+   for( int i=0; i<TEST_POOL_SIZE; i++ )
+   {
+      pBuffers[i] = radio_packet_buffers_alloc(&s_Pool);
+      if ( NULL == pBuffers[i] )
+      {
+         printf("   Failed to allocate buffer %d of %d\n", i+1, TEST_POOL_SIZE);
+         s_iFailed = 1;
+      }
+   }
+   if ( NULL != radio_packet_buffers_alloc(&s_Pool) )
+   {
+      printf("   Allocation from an empty pool did not fail\n");
+      s_iFailed = 1;
+   }
+   radio_packet_buffers_ref(pBuffers[0]);
+   for( int i=0; i<TEST_POOL_SIZE; i++ )
+      radio_packet_buffers_unref(pBuffers[i]);
+   if ( radio_packet_buffers_get_free_count(&s_Pool) != TEST_POOL_SIZE-1 )
+   {
+      printf("   A buffer still referenced was returned to the pool\n");
+      s_iFailed = 1;
+   }
+   radio_packet_buffers_unref(pBuffers[0]);
+   printf("Empty pool: allocations fail, referenced buffers are kept.\n");
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_radio_packet_buffers\n");
+      return 0;
+   }
+
+   log_init_local_only("TestRadioPacketBuffers");
+   log_disable_stdout();
+
+   if ( ! radio_packet_buffers_init(&s_Pool, TEST_POOL_SIZE) )
+   {
+      printf("\nFailed to init the buffers pool.\nTest FAILED\n");
+      return 1;
+   }
+
+   printf("\nReference counted radio packet buffers, pool of %d buffers, %d packets:\n\n", TEST_POOL_SIZE, TEST_PACKETS);
+   _test_exhaustion();
+
+   u32 uTimeStart = get_current_timestamp_ms();
+   pthread_t pThreads[3];
+   pthread_create(&pThreads[0], NULL, &_thread_holder, NULL);
+   pthread_create(&pThreads[1], NULL, &_thread_consumer, NULL);
+   pthread_create(&pThreads[2], NULL, &_thread_producer, NULL);
+   for( int i=2; i>=0; i-- )
+      pthread_join(pThreads[i], NULL);
+
+   if ( s_iCountReceived != TEST_PACKETS )
+   {
+      printf("   Lost packets: sent %d, received %d\n", TEST_PACKETS, s_iCountReceived);
+      s_iFailed = 1;
+   }
+   int iFree = radio_packet_buffers_get_free_count(&s_Pool);
+   if ( iFree != TEST_POOL_SIZE )
+   {
+      printf("   Leaked buffers: %d of %d are free\n", iFree, TEST_POOL_SIZE);
+      s_iFailed = 1;
+   }
+   printf("Passed %d packets in %u ms, producer waited for a free buffer %d times, %d buffers free at end.\n",
+      s_iCountReceived, get_current_timestamp_ms() - uTimeStart, s_iCountAllocFailures, iFree);
+
+   radio_packet_buffers_uninit(&s_Pool);
+
+   printf("\n%s\n", s_iFailed?"Test FAILED":"Test passed");
+   return s_iFailed?1:0;
+}
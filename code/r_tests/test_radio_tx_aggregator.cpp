@@ -0,0 +1,228 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/radio_tx_aggregator.h"
+
+// Runs a mixed vehicle downlink load (telemetry, RC telemetry, command responses, pings, alarms and large
+// packets), flushed in bursts the way the router sends its queued packets, through the radio tx aggregator.
+// Each radio frame is split back the way the radio receiver does it. Checks that all packets arrive,
+// in order and unchanged, that frames stay within the size budget of each data rate, and reports
+// how many radio frames were sent compared to one frame per packet.
+
+#define TEST_PACKETS 5000
+
+static u32 s_uRandomSeed = 1;
+static int s_iFailed = 0;
+static u8 s_uSentPackets[TEST_PACKETS][MAX_PACKET_TOTAL_SIZE];
+static int s_iSentLengths[TEST_PACKETS];
+static int s_iCountSent = 0;
+static int s_iCountReceived = 0;
+static int s_iCountFrames = 0;
+static int s_iMaxFrameSize = 0;
+
+static u32 _test_random()
+{
+   s_uRandomSeed = s_uRandomSeed * 1103515245 + 12345;
+   return (s_uRandomSeed >> 8) & 0xFFFFFF;
+}
+
+static int _test_build_packet(u8* pBuffer, int iIndex)
+{
+   t_packet_header* pPH = (t_packet_header*)pBuffer;
+   int iType = _test_random() % 100;
+   int iLength = sizeof(t_packet_header);
+   if ( iType < 40 )
+   {
+      radio_packet_init(pPH, PACKET_COMPONENT_TELEMETRY, PACKET_TYPE_RUBY_TELEMETRY_SHORT, STREAM_ID_TELEMETRY);
+      iLength += 40 + _test_random() % 60;
+   }
+   else if ( iType < 65 )
+   {
+      radio_packet_init(pPH, PACKET_COMPONENT_RC, PACKET_TYPE_RC_TELEMETRY, STREAM_ID_DATA);
+      iLength += 20 + _test_random() % 20;
+   }
+   else if ( iType < 75 )
+   {
+      radio_packet_init(pPH, PACKET_COMPONENT_COMMANDS, PACKET_TYPE_COMMAND_RESPONSE, STREAM_ID_DATA);
+      iLength += 10 + _test_random() % 200;
+   }
+   else if ( iType < 82 )
+   {
+      radio_packet_init(pPH, PACKET_COMPONENT_RUBY, PACKET_TYPE_RUBY_PING_CLOCK_REPLY, STREAM_ID_DATA);
+      iLength += 10;
+   }
+   else if ( iType < 90 )
+   {
+      radio_packet_init(pPH, PACKET_COMPONENT_TELEMETRY, PACKET_TYPE_RUBY_TELEMETRY_SHORT, STREAM_ID_TELEMETRY);
+      iLength += 500 + _test_random() % 600;
+   }
+   else
+   {
+      radio_packet_init(pPH, PACKET_COMPONENT_RUBY, PACKET_TYPE_RUBY_ALARM, STREAM_ID_DATA);
+      iLength += 4*sizeof(u32);
+   }
+   pPH->vehicle_id_src = 1000;
+   pPH->vehicle_id_dest = (0 == (_test_random() % 50))?2000:0;
+   pPH->total_length = iLength;
+   for( int i=sizeof(t_packet_header); i<iLength; i++ )
+      pBuffer[i] = (u8)(iIndex + i);
+   return iLength;
+}
+
+static void _test_on_frame(u8* pFrame, int iLength, int iMaxFrameSize)
+{
+   s_iCountFrames++;
+   if ( iLength > s_iMaxFrameSize )
+      s_iMaxFrameSize = iLength;
+   int iFrameLength = iLength;
+
+   int iCountInFrame = 0;
+   u32 uVehicleIdDest = 0;
+   while ( iLength > 0 )
+   {
+      t_packet_header* pPH = (t_packet_header*)pFrame;
+      if ( (pPH->total_length < sizeof(t_packet_header)) || (pPH->total_length > iLength) )
+      {
+         printf("   Broken radio frame.\n");
+         s_iFailed = 1;
+         return;
+      }
+      if ( (s_iCountReceived >= s_iCountSent) || (pPH->total_length != s_iSentLengths[s_iCountReceived]) ||
+           (0 != memcmp(pFrame, s_uSentPackets[s_iCountReceived], pPH->total_length)) )
+      {
+         printf("   Packet %d received out of order or changed.\n", s_iCountReceived);
+         s_iFailed = 1;
+         return;
+      }
+      if ( (iCountInFrame > 0) && (pPH->vehicle_id_dest != uVehicleIdDest) )
+      {
+         printf("   Radio frame with packets for different vehicles.\n");
+         s_iFailed = 1;
+      }
+      uVehicleIdDest = pPH->vehicle_id_dest;
+      iCountInFrame++;
+      s_iCountReceived++;
+      iLength -= pPH->total_length;
+      pFrame += pPH->total_length;
+   }
+   if ( (iCountInFrame > 1) && (iFrameLength > iMaxFrameSize) )
+   {
+      printf("   Aggregated radio frame over the size budget (%d > %d bytes).\n", iFrameLength, iMaxFrameSize);
+      s_iFailed = 1;
+   }
+}
+
+static void _test_flush(t_radio_tx_aggregator* pAggregator)
+{
+   if ( ! radio_tx_aggregator_has_packets(pAggregator) )
+      return;
+   _test_on_frame(pAggregator->uBuffer, pAggregator->iLength, pAggregator->iMaxFrameSize);
+   radio_tx_aggregator_on_frame_sent(pAggregator);
+}
+
+static void _test_run(const char* szName, int iDataRateBPS)
+{
+   t_radio_tx_aggregator aggregator;
+   radio_tx_aggregator_init(&aggregator, MAX_PACKET_PAYLOAD);
+   radio_tx_aggregator_set_datarate(&aggregator, iDataRateBPS);
+
+   s_uRandomSeed = 1;
+   s_iCountSent = 0;
+   s_iCountReceived = 0;
+   s_iCountFrames = 0;
+   s_iMaxFrameSize = 0;
+
+   while ( s_iCountSent < TEST_PACKETS )
+   {
+      // A burst of packets pending when the router sends its queue
+      int iBurst = 1 + _test_random() % 6;
+      for( int k=0; (k<iBurst) && (s_iCountSent < TEST_PACKETS); k++ )
+      {
+         u8* pPacket = s_uSentPackets[s_iCountSent];
+         int iLength = _test_build_packet(pPacket, s_iCountSent);
+         s_iSentLengths[s_iCountSent] = iLength;
+         s_iCountSent++;
+
+         u8 uCopy[MAX_PACKET_TOTAL_SIZE];
+         memcpy(uCopy, pPacket, iLength);
+         if ( radio_tx_aggregator_can_aggregate_packet(uCopy, iLength) )
+         {
+            if ( ! radio_tx_aggregator_add_packet(&aggregator, uCopy, iLength) )
+            {
+               _test_flush(&aggregator);
+               radio_tx_aggregator_add_packet(&aggregator, uCopy, iLength);
+            }
+         }
+         else
+         {
+            _test_flush(&aggregator);
+            _test_on_frame(uCopy, iLength, MAX_PACKET_TOTAL_SIZE);
+         }
+      }
+      _test_flush(&aggregator);
+   }
+
+   if ( s_iCountReceived != s_iCountSent )
+   {
+      printf("   Lost packets: sent %d, received %d\n", s_iCountSent, s_iCountReceived);
+      s_iFailed = 1;
+   }
+   printf("%-14s frame budget %4d bytes: %d packets in %d radio frames (%d%% fewer), %u aggregated frames, largest frame %d bytes\n",
+      szName, aggregator.iMaxFrameSize, s_iCountSent, s_iCountFrames, 100 - (s_iCountFrames*100)/s_iCountSent,
+      aggregator.stats.uCountAggregatedFrames, s_iMaxFrameSize);
+   if ( s_iCountFrames >= s_iCountSent )
+      s_iFailed = 1;
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_radio_tx_aggregator\n");
+      return 0;
+   }
+
+   log_init_local_only("TestRadioTxAggregator");
+   log_disable_stdout();
+
+   printf("\nRadio tx aggregation of small packets, %d packets:\n\n", TEST_PACKETS);
+   _test_run("1 Mbps", 1);
+   _test_run("6 Mbps", 6000000);
+   _test_run("MCS 2", -3);
+   _test_run("Unknown rate", 0);
+
+   printf("\n%s\n", s_iFailed?"Test FAILED":"Test passed");
+   return s_iFailed?1:0;
+}
@@ -0,0 +1,201 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../common/rc_tx_scheduler.h"
+
+// Simulates the RC tx loop with random wakeup latencies (and a few long stalls) on a simulated clock,
+// once with the previous scheduling (poll every few ms, send when a period passed since the last frame)
+// and once with the RC tx scheduler. Compares the frame rate drift and the frame interval jitter.
+
+#define TEST_DURATION_MICROS 60000000
+#define TEST_POLL_MICROS 5000
+#define TEST_MAX_WAIT_MICROS 10000
+
+static u32 s_uRandomSeed = 1;
+static int s_iFailed = 0;
+
+static u32 _test_random()
+{
+   s_uRandomSeed = s_uRandomSeed * 1103515245 + 12345;
+   return (s_uRandomSeed >> 8) & 0xFFFFFF;
+}
+
+// How late the process wakes up after a sleep
+static u32 _test_wakeup_latency(int bStalls)
+{
+   if ( bStalls && (0 == (_test_random() % 3000)) )
+      return 60000 + _test_random() % 40000;
+   if ( 0 == (_test_random() % 50) )
+      return 1000 + _test_random() % 2000;
+   return 50 + _test_random() % 400;
+}
+
+typedef struct
+{
+   u32 uCountFrames;
+   u32 uMinInterval;
+   u32 uMaxInterval;
+   u32 uCountOutliers; // interval off the period by more than 10%
+} t_test_result;
+
+static void _test_add_interval(t_test_result* pResult, u32 uInterval, u32 uPeriod)
+{
+   if ( uInterval < pResult->uMinInterval )
+      pResult->uMinInterval = uInterval;
+   if ( uInterval > pResult->uMaxInterval )
+      pResult->uMaxInterval = uInterval;
+   if ( (uInterval > uPeriod + uPeriod/10) || (uInterval + uPeriod/10 < uPeriod) )
+      pResult->uCountOutliers++;
+}
+
+static void _test_run_polling(int iFPS, int bStalls, t_test_result* pResult)
+{
+   u32 uPeriod = 1000000/iFPS;
+   u32 uTime = 1000;
+   u32 uLastSent = 0;
+   memset(pResult, 0, sizeof(t_test_result));
+   pResult->uMinInterval = MAX_U32;
+   while ( uTime < TEST_DURATION_MICROS )
+   {
+      uTime += TEST_POLL_MICROS + _test_wakeup_latency(bStalls);
+      if ( uTime < uLastSent + uPeriod )
+      {
+         u32 uDelta = uLastSent + uPeriod - uTime;
+         if ( uDelta > 40000 )
+            uDelta = 40000;
+         uTime += uDelta/2 + _test_wakeup_latency(bStalls);
+         continue;
+      }
+      if ( 0 != uLastSent )
+         _test_add_interval(pResult, uTime - uLastSent, uPeriod);
+      uLastSent = uTime;
+      pResult->uCountFrames++;
+   }
+}
+
+static void _test_run_scheduler(int iFPS, int bStalls, t_test_result* pResult, t_rc_tx_scheduler* pScheduler)
+{
+   u32 uPeriod = 1000000/iFPS;
+   u32 uTime = 1000;
+   u32 uLastSent = 0;
+   memset(pResult, 0, sizeof(t_test_result));
+   pResult->uMinInterval = MAX_U32;
+   rc_tx_scheduler_init(pScheduler, iFPS);
+   u32 uSleep = 0;
+   while ( uTime < TEST_DURATION_MICROS )
+   {
+      if ( uSleep > 0 )
+         uTime += uSleep + _test_wakeup_latency(bStalls);
+      u32 uToNext = rc_tx_scheduler_get_micros_to_next(pScheduler, uTime);
+      if ( uToNext > RC_TX_SCHEDULER_INPUT_LEAD_MICROS )
+      {
+         uSleep = uToNext - RC_TX_SCHEDULER_INPUT_LEAD_MICROS;
+         if ( uSleep > TEST_MAX_WAIT_MICROS )
+            uSleep = TEST_MAX_WAIT_MICROS;
+         continue;
+      }
+      // Inputs sampling, then wait for the deadline
+      uTime += 100;
+      uToNext = rc_tx_scheduler_get_micros_to_next(pScheduler, uTime);
+      if ( uToNext > 0 )
+         uTime += uToNext + _test_wakeup_latency(bStalls);
+      uSleep = 0;
+
+      if ( 0 != uLastSent )
+         _test_add_interval(pResult, uTime - uLastSent, uPeriod);
+      uLastSent = uTime;
+      pResult->uCountFrames++;
+      rc_tx_scheduler_on_frame_sent(pScheduler, uTime);
+   }
+}
+
+static void _test_compare(int iFPS, int bStalls)
+{
+   t_test_result resultPolling;
+   t_test_result resultScheduler;
+   t_rc_tx_scheduler scheduler;
+   _test_run_polling(iFPS, bStalls, &resultPolling);
+   _test_run_scheduler(iFPS, bStalls, &resultScheduler, &scheduler);
+
+   u32 uExpectedFrames = (u32)(TEST_DURATION_MICROS / 1000000) * (u32)iFPS;
+   printf("%3d Hz%s:\n", iFPS, bStalls?", with stalls":"");
+   printf("   polling:   %5u frames (expected %u), interval min/max %6u/%6u us, %5u intervals off by >10%%\n",
+      resultPolling.uCountFrames, uExpectedFrames, resultPolling.uMinInterval, resultPolling.uMaxInterval, resultPolling.uCountOutliers);
+   printf("   scheduler: %5u frames (expected %u), interval min/max %6u/%6u us, %5u intervals off by >10%%, %u resyncs\n",
+      resultScheduler.uCountFrames, uExpectedFrames, resultScheduler.uMinInterval, resultScheduler.uMaxInterval, resultScheduler.uCountOutliers, scheduler.stats.uCountResyncs);
+
+   // No drift: the frame count matches the rate (stalls drop the frames they cover)
+   u32 uMinFrames = uExpectedFrames - uExpectedFrames/100;
+   if ( bStalls )
+      uMinFrames = uExpectedFrames - uExpectedFrames/10;
+   if ( (resultScheduler.uCountFrames < uMinFrames) || (resultScheduler.uCountFrames > uExpectedFrames + 1) )
+   {
+      printf("   Wrong frame rate\n");
+      s_iFailed = 1;
+   }
+   if ( resultScheduler.uCountOutliers > resultPolling.uCountOutliers )
+      s_iFailed = 1;
+   if ( resultScheduler.uCountOutliers * 20 > resultScheduler.uCountFrames )
+   {
+      printf("   Too many jittery frames\n");
+      s_iFailed = 1;
+   }
+   // Missed frames are not sent back to back after a stall
+   if ( resultScheduler.uMinInterval < (u32)(1000000/iFPS)/2 )
+   {
+      printf("   Frames sent in a burst\n");
+      s_iFailed = 1;
+   }
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_rc_tx_scheduler\n");
+      return 0;
+   }
+
+   log_init_local_only("TestRCTxScheduler");
+   log_disable_stdout();
+
+   printf("\nRC frames scheduling, %d seconds of simulated time:\n\n", TEST_DURATION_MICROS/1000000);
+   _test_compare(20, 0);
+   _test_compare(50, 0);
+   _test_compare(100, 0);
+   _test_compare(50, 1);
+
+   printf("\n%s\n", s_iFailed?"Test FAILED":"Test passed");
+   return s_iFailed?1:0;
+}
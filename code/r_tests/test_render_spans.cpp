@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../renderer/render_spans.h"
+
+// Checks the span primitives against the per pixel loops they replaced
+// (random lengths, unaligned pointers, random colors) and reports fill rates.
+
+#define TEST_MAX_PIXELS 4096
+
+unsigned char g_Dest[TEST_MAX_PIXELS*4+64];
+unsigned char g_DestRef[TEST_MAX_PIXELS*4+64];
+unsigned char g_Src[TEST_MAX_PIXELS*4+64];
+
+static void _ref_fill(unsigned char* pDest, int iCount, const unsigned char* pPixel)
+{
+   for( int x=0; x<iCount; x++ )
+   {
+      *pDest++ = pPixel[0];
+      *pDest++ = pPixel[1];
+      *pDest++ = pPixel[2];
+      *pDest++ = pPixel[3];
+   }
+}
+
+// Same as fbg_pixela_fast
+static void _ref_pixela(unsigned char* pixel, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
+{
+   if ( *(pixel+3) == 255 )
+   {
+      *pixel = ((a * r + (255 - a) * (*pixel)) >> 8); pixel++;
+      *pixel = ((a * g + (255 - a) * (*pixel)) >> 8); pixel++;
+      *pixel = ((a * b + (255 - a) * (*pixel)) >> 8);
+   }
+   else
+   {
+      *pixel = ((a * r + (255 - a) * (*pixel)) >> 8); pixel++;
+      *pixel = ((a * g + (255 - a) * (*pixel)) >> 8); pixel++;
+      *pixel = ((a * b + (255 - a) * (*pixel)) >> 8); pixel++;
+      *pixel = (*pixel) + (((255-(*pixel))*a) >> 8);
+   }
+}
+
+static void _ref_blend_color(unsigned char* pDest, int iCount, const unsigned char* pColor, unsigned char uAlpha)
+{
+   for( int x=0; x<iCount; x++ )
+   {
+      _ref_pixela(pDest, pColor[0], pColor[1], pColor[2], uAlpha);
+      pDest += 4;
+   }
+}
+
+// Same as the font/icon blit loops of the cairo renderer (iUpdateDestAlpha = 0) and fbg_imageClipA (1)
+static void _ref_blit_alpha(unsigned char* pDest, const unsigned char* pSrc, int iCount, int iUpdateDestAlpha)
+{
+   for( int x=0; x<iCount; x++ )
+   {
+      if ( iUpdateDestAlpha )
+         _ref_pixela(pDest, pSrc[0], pSrc[1], pSrc[2], pSrc[3]);
+      else
+      {
+         unsigned char uAlpha = pSrc[3];
+         for( int i=0; i<3; i++ )
+            pDest[i] = (pSrc[i] * uAlpha + pDest[i] * (255-uAlpha))/256;
+      }
+      pDest += 4;
+      pSrc += 4;
+   }
+}
+
+static void _ref_blit_alpha_modulated(unsigned char* pDest, const unsigned char* pSrc, int iCount, const unsigned char* pMod)
+{
+   for( int x=0; x<iCount; x++ )
+   {
+      unsigned char r = (pSrc[0]*pMod[0])>>8;
+      unsigned char g = (pSrc[1]*pMod[1])>>8;
+      unsigned char b = (pSrc[2]*pMod[2])>>8;
+      unsigned char a = (pSrc[3]*pMod[3])>>8;
+      _ref_pixela(pDest, r,g,b,a);
+      pDest += 4;
+      pSrc += 4;
+   }
+}
+
+static void _randomize(unsigned char* pBuffer, int iSize)
+{
+   for( int i=0; i<iSize; i++ )
+   {
+      pBuffer[i] = rand() & 0xFF;
+      // Exercise the edge values often
+      if ( (rand() % 8) == 0 )
+         pBuffer[i] = ((rand() % 2) == 0)?0:255;
+   }
+}
+
+static int _compare(const char* szName, int iIteration, int iCount)
+{
+   if ( 0 == memcmp(g_Dest, g_DestRef, sizeof(g_Dest)) )
+      return 0;
+   for( int i=0; i<(int)sizeof(g_Dest); i++ )
+   {
+      if ( g_Dest[i] != g_DestRef[i] )
+      {
+         printf("FAILED: %s, iteration %d, %d pixels: byte %d is %d, expected %d\n", szName, iIteration, iCount, i, g_Dest[i], g_DestRef[i]);
+         break;
+      }
+   }
+   return 1;
+}
+
+static int _run_exactness_tests(int iIterations)
+{
+   int iFailures = 0;
+   for( int k=0; k<iIterations; k++ )
+   {
+      int iCount = rand() % 300;
+      if ( (k % 10) == 0 )
+         iCount = rand() % TEST_MAX_PIXELS;
+      int iOffsetDest = rand() % 16;
+      int iOffsetSrc = rand() % 16;
+      unsigned char uColor[4];
+      _randomize(uColor, 4);
+
+      _randomize(g_Dest, sizeof(g_Dest));
+      _randomize(g_Src, sizeof(g_Src));
+      memcpy(g_DestRef, g_Dest, sizeof(g_Dest));
+      render_span_fill(g_Dest + iOffsetDest, iCount, uColor);
+      _ref_fill(g_DestRef + iOffsetDest, iCount, uColor);
+      iFailures += _compare("fill", k, iCount);
+
+      memcpy(g_DestRef, g_Dest, sizeof(g_Dest));
+      render_span_blend_color(g_Dest + iOffsetDest, iCount, uColor, uColor[3]);
+      _ref_blend_color(g_DestRef + iOffsetDest, iCount, uColor, uColor[3]);
+      iFailures += _compare("blend color", k, iCount);
+
+      for( int iUpdateAlpha=0; iUpdateAlpha<2; iUpdateAlpha++ )
+      {
+         memcpy(g_DestRef, g_Dest, sizeof(g_Dest));
+         render_span_blit_alpha(g_Dest + iOffsetDest, g_Src + iOffsetSrc, iCount, iUpdateAlpha);
+         _ref_blit_alpha(g_DestRef + iOffsetDest, g_Src + iOffsetSrc, iCount, iUpdateAlpha);
+         iFailures += _compare(iUpdateAlpha?"blit alpha (update alpha)":"blit alpha", k, iCount);
+      }
+
+      memcpy(g_DestRef, g_Dest, sizeof(g_Dest));
+      render_span_blit_alpha_modulated(g_Dest + iOffsetDest, g_Src + iOffsetSrc, iCount, uColor);
+      _ref_blit_alpha_modulated(g_DestRef + iOffsetDest, g_Src + iOffsetSrc, iCount, uColor);
+      iFailures += _compare("blit alpha modulated", k, iCount);
+   }
+   return iFailures;
+}
+
+static double _time_now()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec/1000000000.0;
+}
+
+static void _benchmark(const char* szName, int iTest, int iWidth, int iRepeats)
+{
+   unsigned char uColor[4] = { 200, 120, 40, 180 };
+   double fTimes[2];
+   for( int iRef=0; iRef<2; iRef++ )
+   {
+      double fStart = _time_now();
+      for( int i=0; i<iRepeats; i++ )
+      {
+         unsigned char* pDest = g_Dest + (i % 4)*4;
+         switch( iTest )
+         {
+            case 0: if ( iRef ) _ref_fill(pDest, iWidth, uColor); else render_span_fill(pDest, iWidth, uColor); break;
+            case 1: if ( iRef ) _ref_blend_color(pDest, iWidth, uColor, uColor[3]); else render_span_blend_color(pDest, iWidth, uColor, uColor[3]); break;
+            case 2: if ( iRef ) _ref_blit_alpha(pDest, g_Src, iWidth, 0); else render_span_blit_alpha(pDest, g_Src, iWidth, 0); break;
+            default: if ( iRef ) _ref_blit_alpha_modulated(pDest, g_Src, iWidth, uColor); else render_span_blit_alpha_modulated(pDest, g_Src, iWidth, uColor); break;
+         }
+      }
+      fTimes[iRef] = _time_now() - fStart;
+   }
+   double fPixels = (double)iWidth * iRepeats / 1000000.0;
+   printf("  %-22s %4d px spans: per pixel loop %8.1f Mpix/s, span %8.1f Mpix/s (x%.1f)\n",
+      szName, iWidth, fPixels/fTimes[1], fPixels/fTimes[0], fTimes[1]/fTimes[0]);
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_render_spans [iterations]\n");
+      return 0;
+   }
+   int iIterations = 2000;
+   if ( argc >= 2 )
+      iIterations = atoi(argv[1]);
+
+   srand(1234);
+   printf("\nRender spans test, implementation: %s\n", render_span_get_impl_name());
+
+   int iFailures = _run_exactness_tests(iIterations);
+   if ( iFailures )
+      printf("Exactness: %d failures.\n", iFailures);
+   else
+      printf("Exactness: all %d iterations match the per pixel loops.\n", iIterations);
+
+   _randomize(g_Src, sizeof(g_Src));
+   const char* szNames[] = { "fill", "blend color", "blit alpha", "blit alpha modulated" };
+   int iWidths[] = { 16, 200, 1920 };
+   for( int t=0; t<4; t++ )
+   for( int w=0; w<3; w++ )
+      _benchmark(szNames[t], t, iWidths[w], 20000000/iWidths[w]);
+
+   return iFailures?1:0;
+}
@@ -0,0 +1,289 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../common/timer_wheel.h"
+#include "../common/event_loop.h"
+
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/msg.h>
+
+// Injects synthetic radio packets (signaled through an eventfd, like the radio rx thread does)
+// and IPC messages (SysV message queue, like the router IPC channels) into:
+//  - the legacy polling router loop (sleep 1ms, housekeeping every 10 loops, IPC every 5 loops)
+//  - the event loop + timer wheel router loop
+// while housekeeping callbacks burn CPU, and reports packet-to-output latency percentiles.
+
+#define MAX_PENDING_PACKETS 4096
+
+bool g_bQuit = false;
+int g_iDurationSec = 5;
+int g_iPacketsPerSec = 2000;
+int g_iIPCPerSec = 200;
+int g_iHousekeepingLoadMicros = 3000;
+int g_iVideoLinkLoadMicros = 500;
+
+pthread_mutex_t g_Mutex = PTHREAD_MUTEX_INITIALIZER;
+u32 g_uPendingPackets[MAX_PENDING_PACKETS];
+int g_iPendingStart = 0;
+int g_iPendingEnd = 0;
+int g_iWakeupFd = -1;
+int g_iMsgQueue = -1;
+volatile int g_iProducerRunning = 0;
+
+typedef struct
+{
+   long type;
+   u32 uTimeSent;
+} t_test_ipc_msg;
+
+u32* g_pLatencies = NULL;
+int g_iCountLatencies = 0;
+int g_iMaxLatencies = 0;
+u32* g_pIPCLatencies = NULL;
+int g_iCountIPCLatencies = 0;
+int g_iMaxIPCLatencies = 0;
+
+void _burn_cpu(int iMicros)
+{
+   u32 uStart = get_current_timestamp_micros();
+   while ( get_current_timestamp_micros() - uStart < (u32)iMicros ) {}
+}
+
+static void* _thread_producer(void* pArg)
+{
+   u32 uIntervalMicros = 1000000 / g_iPacketsPerSec;
+   int iIPCEvery = g_iPacketsPerSec / g_iIPCPerSec;
+   if ( iIPCEvery < 1 )
+      iIPCEvery = 1;
+   u32 uNext = get_current_timestamp_micros();
+   int iCounter = 0;
+   while ( g_iProducerRunning )
+   {
+      while ( (int)(get_current_timestamp_micros() - uNext) < 0 )
+         hardware_sleep_micros(50);
+      uNext += uIntervalMicros;
+
+      // Small bursts, like a video block arriving
+      int iBurst = ((iCounter % 16) == 0)?4:1;
+      pthread_mutex_lock(&g_Mutex);
+      for( int i=0; i<iBurst; i++ )
+      {
+         g_uPendingPackets[g_iPendingEnd] = get_current_timestamp_micros();
+         g_iPendingEnd = (g_iPendingEnd+1) % MAX_PENDING_PACKETS;
+      }
+      pthread_mutex_unlock(&g_Mutex);
+      uint64_t uValue = 1;
+      if ( write(g_iWakeupFd, &uValue, sizeof(uValue)) < 0 ) {}
+
+      if ( (iCounter % iIPCEvery) == 0 )
+      {
+         t_test_ipc_msg msg;
+         msg.type = 1;
+         msg.uTimeSent = get_current_timestamp_micros();
+         msgsnd(g_iMsgQueue, &msg, sizeof(u32), IPC_NOWAIT);
+      }
+      iCounter++;
+   }
+   return NULL;
+}
+
+int _consume_packets()
+{
+   int iCount = 0;
+   pthread_mutex_lock(&g_Mutex);
+   while ( g_iPendingStart != g_iPendingEnd )
+   {
+      u32 uLatency = get_current_timestamp_micros() - g_uPendingPackets[g_iPendingStart];
+      g_iPendingStart = (g_iPendingStart+1) % MAX_PENDING_PACKETS;
+      if ( g_iCountLatencies < g_iMaxLatencies )
+         g_pLatencies[g_iCountLatencies++] = uLatency;
+      iCount++;
+   }
+   pthread_mutex_unlock(&g_Mutex);
+   return iCount;
+}
+
+void _consume_ipc()
+{
+   t_test_ipc_msg msg;
+   while ( msgrcv(g_iMsgQueue, &msg, sizeof(u32), 0, IPC_NOWAIT) > 0 )
+   {
+      if ( g_iCountIPCLatencies < g_iMaxIPCLatencies )
+         g_pIPCLatencies[g_iCountIPCLatencies++] = get_current_timestamp_micros() - msg.uTimeSent;
+   }
+}
+
+void _on_rx_ready(void* pContext, int iFd, u32 uTimeNow)
+{
+   uint64_t uValue = 0;
+   if ( read(iFd, &uValue, sizeof(uValue)) < 0 ) {}
+   _consume_packets();
+}
+
+void _on_timer_ipc(void* pContext, u32 uTimeNow) { _consume_ipc(); }
+void _on_timer_video_link(void* pContext, u32 uTimeNow) { _burn_cpu(g_iVideoLinkLoadMicros); }
+void _on_timer_housekeeping(void* pContext, u32 uTimeNow)
+{
+   // Housekeeping is split in a few chunks in the router (periodic loop, shared mem sync, consistency checks)
+   _burn_cpu(g_iHousekeepingLoadMicros/2);
+   if ( NULL != pContext )
+      event_loop_service_high_priority((t_event_loop*)pContext);
+   _burn_cpu(g_iHousekeepingLoadMicros/2);
+}
+
+void _run_legacy_loop()
+{
+   u32 uLoopCounter = 0;
+   u32 uEnd = get_current_timestamp_ms() + g_iDurationSec*1000;
+   while ( get_current_timestamp_ms() < uEnd )
+   {
+      uLoopCounter++;
+      if ( (uLoopCounter % 10) == 0 )
+         _on_timer_housekeeping(NULL, 0);
+      if ( (uLoopCounter % 5) == 0 )
+         _consume_ipc();
+      int iCount = _consume_packets();
+      if ( 0 == iCount )
+         hardware_sleep_ms(1);
+      _on_timer_video_link(NULL, 0);
+   }
+}
+
+void _run_event_loop()
+{
+   t_timer_wheel timers;
+   t_event_loop loop;
+   timer_wheel_init(&timers, get_current_timestamp_ms());
+   event_loop_init(&loop, &timers);
+   event_loop_add_fd(&loop, g_iWakeupFd, 1, _on_rx_ready, NULL);
+   timer_wheel_add(&timers, "ipc", ROUTER_TIMER_INTERVAL_IPC_MS, 1, _on_timer_ipc, NULL);
+   timer_wheel_add(&timers, "video-link", ROUTER_TIMER_INTERVAL_VIDEO_LINK_MS, 1, _on_timer_video_link, NULL);
+   timer_wheel_add(&timers, "housekeeping", ROUTER_TIMER_INTERVAL_HOUSEKEEPING_MS, 1, _on_timer_housekeeping, &loop);
+
+   u32 uEnd = get_current_timestamp_ms() + g_iDurationSec*1000;
+   while ( get_current_timestamp_ms() < uEnd )
+      event_loop_run_once(&loop, ROUTER_LOOP_MAX_WAIT_MS);
+
+   printf("Event loop: %u wakeups, %u fd events, %u timeouts, %u preemptions\n",
+      loop.uCountWakeups, loop.uCountFdEvents, loop.uCountTimeouts, loop.uCountPreemptions);
+   for( int i=0; i<TIMER_WHEEL_MAX_TIMERS; i++ )
+   {
+      if ( ! timers.timers[i].iUsed )
+         continue;
+      printf("  timer %-14s runs: %6u, max late: %u ms\n", timers.timers[i].szName, timers.timers[i].uCountRuns, timers.timers[i].uMaxLateMs);
+   }
+}
+
+// A source whose fd got closed must be dropped, not make every poll return right away
+int _test_closed_fd_is_removed()
+{
+   t_event_loop loop;
+   event_loop_init(&loop, NULL);
+   int iFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   event_loop_add_fd(&loop, iFd, 1, _on_rx_ready, NULL);
+   close(iFd);
+   event_loop_run_once(&loop, 10);
+   u32 uStart = get_current_timestamp_ms();
+   event_loop_run_once(&loop, 50);
+   u32 uWaited = get_current_timestamp_ms() - uStart;
+   if ( (0 != loop.iCountSources) || (1 != loop.uCountInvalidFds) || (uWaited < 40) )
+   {
+      printf("Closed fd not removed from event loop: %d sources, %u invalid fds, waited %u ms\n", loop.iCountSources, loop.uCountInvalidFds, uWaited);
+      return 0;
+   }
+   return 1;
+}
+
+int _compare_u32(const void* a, const void* b)
+{
+   u32 ua = *(const u32*)a;
+   u32 ub = *(const u32*)b;
+   return (ua < ub)?-1:((ua > ub)?1:0);
+}
+
+void _print_percentiles(const char* szName, u32* pValues, int iCount)
+{
+   if ( iCount <= 0 )
+   {
+      printf("  %-8s no samples\n", szName);
+      return;
+   }
+   qsort(pValues, iCount, sizeof(u32), _compare_u32);
+   printf("  %-8s samples: %7d, p50: %6u us, p90: %6u us, p99: %6u us, p99.9: %6u us, max: %6u us\n",
+      szName, iCount, pValues[iCount/2], pValues[(iCount*90)/100], pValues[(iCount*99)/100],
+      pValues[(iCount*999)/1000], pValues[iCount-1]);
+}
+
+void _run_test(const char* szName, void (*pfLoop)())
+{
+   g_iCountLatencies = 0;
+   g_iCountIPCLatencies = 0;
+   g_iPendingStart = g_iPendingEnd = 0;
+   t_test_ipc_msg msg;
+   while ( msgrcv(g_iMsgQueue, &msg, sizeof(u32), 0, IPC_NOWAIT) > 0 ) {}
+
+   g_iProducerRunning = 1;
+   pthread_t pth;
+   pthread_create(&pth, NULL, &_thread_producer, NULL);
+   pfLoop();
+   g_iProducerRunning = 0;
+   pthread_join(pth, NULL);
+
+   printf("%s:\n", szName);
+   _print_percentiles("packets", g_pLatencies, g_iCountLatencies);
+   _print_percentiles("ipc", g_pIPCLatencies, g_iCountIPCLatencies);
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_router_event_loop [duration_sec] [packets_per_sec] [housekeeping_load_us]\n");
+      return 0;
+   }
+   if ( argc >= 2 )
+      g_iDurationSec = atoi(argv[1]);
+   if ( argc >= 3 )
+      g_iPacketsPerSec = atoi(argv[2]);
+   if ( argc >= 4 )
+      g_iHousekeepingLoadMicros = atoi(argv[3]);
+   if ( g_iDurationSec < 1 )
+      g_iDurationSec = 1;
+   if ( g_iPacketsPerSec < 10 )
+      g_iPacketsPerSec = 10;
+
+   log_init_local_only("TestRouterEventLoop");
+   log_disable_stdout();
+
+   g_iWakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+   g_iMsgQueue = msgget(IPC_PRIVATE, IPC_CREAT | 0666);
+   if ( (g_iWakeupFd < 0) || (g_iMsgQueue < 0) )
+   {
+      printf("Failed to create eventfd/msgqueue.\n");
+      return -1;
+   }
+
+   g_iMaxLatencies = g_iDurationSec * g_iPacketsPerSec * 2;
+   g_iMaxIPCLatencies = g_iDurationSec * g_iIPCPerSec * 2;
+   g_pLatencies = (u32*) malloc(g_iMaxLatencies * sizeof(u32));
+   g_pIPCLatencies = (u32*) malloc(g_iMaxIPCLatencies * sizeof(u32));
+
+   printf("\nRouter loop latency test: %d sec, %d packets/sec, %d IPC msg/sec, housekeeping load %d us / %d ms\n\n",
+      g_iDurationSec, g_iPacketsPerSec, g_iIPCPerSec, g_iHousekeepingLoadMicros, ROUTER_TIMER_INTERVAL_HOUSEKEEPING_MS);
+
+   if ( ! _test_closed_fd_is_removed() )
+   {
+      printf("Test FAILED\n");
+      return -1;
+   }
+
+   _run_test("Legacy polling loop", _run_legacy_loop);
+   _run_test("Event loop + timer wheel", _run_event_loop);
+
+   msgctl(g_iMsgQueue, IPC_RMID, NULL);
+   close(g_iWakeupFd);
+   free(g_pLatencies);
+   free(g_pIPCLatencies);
+   return 0;
+}
@@ -0,0 +1,499 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../radio/radiopackets2.h"
+#include "../radio/radiopackets_short.h"
+#include "../radio/radio_tx_serial_sched.h"
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <termios.h>
+
+// Sends a mixed RC / commands / telemetry load over a pty pair. The master side emulates a SiK modem:
+// it takes bytes into a small tx buffer only when there is room and sends them on air at a fixed byte rate.
+// The air byte stream is parsed as short packets and reassembled into radio packets, the same way the
+// serial radio receiver does it, and the latency of each message (queued -> last byte on air) is measured.
+//  - legacy: IPC style queue polled with 1..30 ms backoff, one message per short packets, fixed 500 us gap
+//  - scheduler: radio_tx_serial_sched (wake on enqueue, coalesced short packets, priorities, air rate pacing)
+
+#define TEST_AIR_BYTES_PER_SEC 8000
+#define TEST_MODEM_BUFFER_SIZE 512
+#define TEST_SHORT_PACKET_SIZE DEFAULT_SIK_PACKET_SIZE
+#define TEST_CLASSES 3
+#define TEST_MAX_SAMPLES 20000
+
+static const char* s_szClassNames[TEST_CLASSES] = { "RC", "Commands", "Telemetry" };
+static const u8 s_uClassComponents[TEST_CLASSES] = { PACKET_COMPONENT_RC, PACKET_COMPONENT_COMMANDS, PACKET_COMPONENT_TELEMETRY };
+
+typedef struct
+{
+   u32 uClass;
+   u32 uIndex;
+   u32 uTimeQueuedMicros;
+} __attribute__((packed)) t_test_payload;
+
+int g_iDurationSec = 5;
+int g_iFdMaster = -1;
+int g_iFdSlave = -1;
+
+// Modem emulator and receiver state
+static volatile int s_iModemStop = 0;
+static u8 s_uModemBuffer[TEST_MODEM_BUFFER_SIZE];
+static int s_iModemBufferBytes = 0;
+static u32 s_uAirBytes = 0;
+static u32 s_uAirShortPackets = 0;
+static u32 s_uAirPayloadBytes = 0;
+
+static u8 s_uRxShortBuffer[512];
+static int s_iRxShortBytes = 0;
+static u8 s_uRxMessage[MAX_PACKET_TOTAL_SIZE*2];
+static int s_iRxMessageBytes = 0;
+static int s_iRxWaitForStart = 0;
+static int s_iRxLastShortId = -1;
+static u32 s_uRxBadData = 0;
+
+static u32 s_uCountSent[TEST_CLASSES];
+static u32 s_uCountReceived[TEST_CLASSES];
+static u32 s_uCountOutOfOrder[TEST_CLASSES];
+static u32 s_uLatencies[TEST_CLASSES][TEST_MAX_SAMPLES];
+
+static void _on_rx_message(u8* pData, int iLength, u32 uTimeNow)
+{
+   if ( iLength < (int)(sizeof(t_packet_header) + sizeof(t_test_payload)) )
+   {
+      s_uRxBadData++;
+      return;
+   }
+   t_test_payload* pPayload = (t_test_payload*)(pData + sizeof(t_packet_header));
+   if ( pPayload->uClass >= TEST_CLASSES )
+   {
+      s_uRxBadData++;
+      return;
+   }
+   u32 uClass = pPayload->uClass;
+   if ( pPayload->uIndex != s_uCountReceived[uClass] )
+      s_uCountOutOfOrder[uClass]++;
+   if ( s_uCountReceived[uClass] < TEST_MAX_SAMPLES )
+      s_uLatencies[uClass][s_uCountReceived[uClass]] = uTimeNow - pPayload->uTimeQueuedMicros;
+   s_uCountReceived[uClass]++;
+}
+
+// Same reassembly rules as the serial radio receiver
+static void _on_rx_short_packet(u8* pPacket, u32 uTimeNow)
+{
+   t_packet_header_short* pPHS = (t_packet_header_short*)pPacket;
+   s_uAirShortPackets++;
+   s_uAirPayloadBytes += pPHS->data_length;
+
+   if ( pPHS->start_header == SHORT_PACKET_START_BYTE_START_PACKET )
+   {
+      s_iRxMessageBytes = 0;
+      s_iRxWaitForStart = 0;
+   }
+   if ( (s_iRxLastShortId >= 0) && (((s_iRxLastShortId + 1) & 0xFF) != pPHS->packet_id) )
+   {
+      s_iRxMessageBytes = 0;
+      if ( pPHS->start_header != SHORT_PACKET_START_BYTE_START_PACKET )
+         s_iRxWaitForStart = 1;
+   }
+   s_iRxLastShortId = pPHS->packet_id;
+   if ( s_iRxWaitForStart )
+      return;
+
+   memcpy(&s_uRxMessage[s_iRxMessageBytes], pPacket + sizeof(t_packet_header_short), pPHS->data_length);
+   s_iRxMessageBytes += pPHS->data_length;
+
+   while ( s_iRxMessageBytes >= (int)sizeof(t_packet_header) )
+   {
+      t_packet_header* pPH = (t_packet_header*)s_uRxMessage;
+      if ( (pPH->total_length < sizeof(t_packet_header)) || (pPH->total_length > MAX_PACKET_TOTAL_SIZE) )
+      {
+         s_uRxBadData++;
+         s_iRxMessageBytes = 0;
+         s_iRxWaitForStart = 1;
+         break;
+      }
+      if ( s_iRxMessageBytes < pPH->total_length )
+         break;
+      int iLength = pPH->total_length;
+      u32 uCRC = base_compute_crc32(&s_uRxMessage[sizeof(u32)], iLength - sizeof(u32));
+      if ( (uCRC & 0x00FFFFFF) != (pPH->uCRC & 0x00FFFFFF) )
+      {
+         s_uRxBadData++;
+         s_iRxMessageBytes = 0;
+         s_iRxWaitForStart = 1;
+         break;
+      }
+      _on_rx_message(s_uRxMessage, iLength, uTimeNow);
+      s_iRxMessageBytes -= iLength;
+      memmove(s_uRxMessage, &s_uRxMessage[iLength], s_iRxMessageBytes);
+   }
+   if ( s_iRxMessageBytes >= MAX_PACKET_TOTAL_SIZE*2 - 255 )
+      s_iRxMessageBytes = 0;
+}
+
+static void _on_air_byte(u8 uByte, u32 uTimeNow)
+{
+   s_uAirBytes++;
+   s_uRxShortBuffer[s_iRxShortBytes++] = uByte;
+   while ( s_iRxShortBytes >= (int)sizeof(t_packet_header_short) )
+   {
+      t_packet_header_short* pPHS = (t_packet_header_short*)s_uRxShortBuffer;
+      int iTotal = (int)sizeof(t_packet_header_short) + pPHS->data_length;
+      if ( radio_buffer_is_valid_short_packet(s_uRxShortBuffer, s_iRxShortBytes) )
+      {
+         _on_rx_short_packet(s_uRxShortBuffer, uTimeNow);
+         s_iRxShortBytes -= iTotal;
+         memmove(s_uRxShortBuffer, &s_uRxShortBuffer[iTotal], s_iRxShortBytes);
+         continue;
+      }
+      // Wait for the rest of the short packet, or skip a byte to resync
+      if ( (iTotal > s_iRxShortBytes) && (iTotal <= (int)sizeof(s_uRxShortBuffer)) &&
+           ((pPHS->start_header == SHORT_PACKET_START_BYTE_REG_PACKET) ||
+            (pPHS->start_header == SHORT_PACKET_START_BYTE_START_PACKET) ||
+            (pPHS->start_header == SHORT_PACKET_START_BYTE_END_PACKET)) )
+         break;
+      s_uRxBadData++;
+      s_iRxShortBytes--;
+      memmove(s_uRxShortBuffer, &s_uRxShortBuffer[1], s_iRxShortBytes);
+   }
+}
+
+static void* _thread_modem(void* pArg)
+{
+   u32 uLastTime = get_current_timestamp_micros();
+   unsigned long long uAirBudget = 0;
+   while ( ! s_iModemStop )
+   {
+      hardware_sleep_micros(1000);
+      u32 uTimeNow = get_current_timestamp_micros();
+      uAirBudget += (unsigned long long)(uTimeNow - uLastTime) * TEST_AIR_BYTES_PER_SEC;
+      uLastTime = uTimeNow;
+
+      int iAirBytes = (int)(uAirBudget / 1000000);
+      if ( iAirBytes > s_iModemBufferBytes )
+      {
+         iAirBytes = s_iModemBufferBytes;
+         uAirBudget = 0;
+      }
+      else
+         uAirBudget -= (unsigned long long)iAirBytes * 1000000;
+      for( int i=0; i<iAirBytes; i++ )
+         _on_air_byte(s_uModemBuffer[i], uTimeNow);
+      s_iModemBufferBytes -= iAirBytes;
+      memmove(s_uModemBuffer, &s_uModemBuffer[iAirBytes], s_iModemBufferBytes);
+
+      // Take more bytes from the serial port only if there is room in the modem buffer
+      if ( s_iModemBufferBytes < TEST_MODEM_BUFFER_SIZE )
+      {
+         int iRead = read(g_iFdMaster, &s_uModemBuffer[s_iModemBufferBytes], TEST_MODEM_BUFFER_SIZE - s_iModemBufferBytes);
+         if ( iRead > 0 )
+            s_iModemBufferBytes += iRead;
+      }
+   }
+   return NULL;
+}
+
+// Legacy sender: polled queue, one message per short packets, fixed gap
+
+#define TEST_LEGACY_QUEUE_SIZE 256
+static u8 s_uLegacyQueue[TEST_LEGACY_QUEUE_SIZE][MAX_PACKET_TOTAL_SIZE];
+static int s_iLegacyQueueLength[TEST_LEGACY_QUEUE_SIZE];
+static int s_iLegacyQueueRead = 0;
+static int s_iLegacyQueueWrite = 0;
+static volatile int s_iLegacyStop = 0;
+static pthread_mutex_t s_LegacyMutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void _legacy_enqueue(u8* pData, int iLength)
+{
+   pthread_mutex_lock(&s_LegacyMutex);
+   if ( ((s_iLegacyQueueWrite + 1) % TEST_LEGACY_QUEUE_SIZE) != s_iLegacyQueueRead )
+   {
+      memcpy(s_uLegacyQueue[s_iLegacyQueueWrite], pData, iLength);
+      s_iLegacyQueueLength[s_iLegacyQueueWrite] = iLength;
+      s_iLegacyQueueWrite = (s_iLegacyQueueWrite + 1) % TEST_LEGACY_QUEUE_SIZE;
+   }
+   pthread_mutex_unlock(&s_LegacyMutex);
+}
+
+static void _legacy_send_msg(u8* pData, int iLength)
+{
+   u8 uBuffer[256];
+   t_packet_header_short PHS;
+   int iUsable = TEST_SHORT_PACKET_SIZE - sizeof(t_packet_header_short);
+   int iLeft = iLength;
+   u8* pSend = pData;
+   while ( iLeft > 0 )
+   {
+      radio_packet_short_init(&PHS);
+      PHS.start_header = SHORT_PACKET_START_BYTE_REG_PACKET;
+      if ( pData == pSend )
+         PHS.start_header = SHORT_PACKET_START_BYTE_START_PACKET;
+      if ( iLeft <= iUsable )
+         PHS.start_header = SHORT_PACKET_START_BYTE_END_PACKET;
+      int iSize = (iLeft <= iUsable)?iLeft:iUsable;
+      PHS.packet_id = radio_packets_short_get_next_id_for_radio_interface(0);
+      PHS.data_length = (u8)iSize;
+      memcpy(uBuffer, &PHS, sizeof(t_packet_header_short));
+      memcpy(&uBuffer[sizeof(t_packet_header_short)], pSend, iSize);
+      iLeft -= iSize;
+      pSend += iSize;
+      iSize += sizeof(t_packet_header_short);
+      uBuffer[1] = base_compute_crc8(&uBuffer[2], iSize - 2);
+      if ( write(g_iFdSlave, uBuffer, iSize) != iSize )
+         printf("Legacy: write failed\n");
+      hardware_sleep_micros(500);
+   }
+}
+
+static void* _thread_legacy_tx(void* pArg)
+{
+   static u8 s_uMessage[MAX_PACKET_TOTAL_SIZE];
+   u32 uWaitTime = 1;
+   while ( ! s_iLegacyStop )
+   {
+      hardware_sleep_ms(uWaitTime);
+      if ( uWaitTime < 30 )
+         uWaitTime += 5;
+      int iLength = 0;
+      pthread_mutex_lock(&s_LegacyMutex);
+      if ( s_iLegacyQueueRead != s_iLegacyQueueWrite )
+      {
+         iLength = s_iLegacyQueueLength[s_iLegacyQueueRead];
+         memcpy(s_uMessage, s_uLegacyQueue[s_iLegacyQueueRead], iLength);
+         s_iLegacyQueueRead = (s_iLegacyQueueRead + 1) % TEST_LEGACY_QUEUE_SIZE;
+      }
+      pthread_mutex_unlock(&s_LegacyMutex);
+      if ( 0 == iLength )
+         continue;
+      uWaitTime = 1;
+      _legacy_send_msg(s_uMessage, iLength);
+   }
+   return NULL;
+}
+
+// Scheduler sender
+
+static t_radio_tx_serial_sched s_Sched;
+
+static int _sched_write(int iInterfaceIndex, u8* pData, int iLength, void* pContext)
+{
+   return write(g_iFdSlave, pData, iLength);
+}
+
+static void _sched_link_params(int iInterfaceIndex, int* piPacketSize, int* piAirBytesPerSec, void* pContext)
+{
+   *piPacketSize = TEST_SHORT_PACKET_SIZE;
+   *piAirBytesPerSec = TEST_AIR_BYTES_PER_SEC;
+}
+
+static void* _thread_sched_tx(void* pArg)
+{
+   while ( radio_tx_serial_sched_run(&s_Sched, 100000) >= 0 );
+   return NULL;
+}
+
+static void _sched_enqueue(u8* pData, int iLength)
+{
+   radio_tx_serial_sched_enqueue(&s_Sched, 0, pData, iLength);
+}
+
+static void _queue_message(void (*pfEnqueue)(u8*, int), int iClass, int iLength)
+{
+   u8 uBuffer[MAX_PACKET_TOTAL_SIZE];
+   memset(uBuffer, 0, iLength);
+   t_packet_header* pPH = (t_packet_header*)uBuffer;
+   pPH->packet_flags = s_uClassComponents[iClass];
+   pPH->total_length = (u16)iLength;
+   t_test_payload* pPayload = (t_test_payload*)(uBuffer + sizeof(t_packet_header));
+   pPayload->uClass = (u32)iClass;
+   pPayload->uIndex = s_uCountSent[iClass];
+   pPayload->uTimeQueuedMicros = get_current_timestamp_micros();
+   for( int i=sizeof(t_packet_header)+sizeof(t_test_payload); i<iLength; i++ )
+      uBuffer[i] = (u8)(i*7 + s_uCountSent[iClass]);
+   pPH->uCRC = base_compute_crc32(uBuffer + sizeof(u32), iLength - sizeof(u32)) & 0x00FFFFFF;
+   s_uCountSent[iClass]++;
+   pfEnqueue(uBuffer, iLength);
+}
+
+static int _compare_u32(const void* a, const void* b)
+{
+   u32 x = *(const u32*)a;
+   u32 y = *(const u32*)b;
+   return (x < y)?-1:((x > y)?1:0);
+}
+
+// Returns the RC p99 latency (micros), or 0xFFFFFFFF if messages were lost or corrupted
+// iUseSched: 0 - legacy sender, 1 - scheduler, 2 - scheduler with coalescing
+static u32 _run_test(const char* szName, int iUseSched)
+{
+   memset(s_uCountSent, 0, sizeof(s_uCountSent));
+   memset(s_uCountReceived, 0, sizeof(s_uCountReceived));
+   memset(s_uCountOutOfOrder, 0, sizeof(s_uCountOutOfOrder));
+   s_iModemBufferBytes = 0;
+   s_uAirBytes = s_uAirShortPackets = s_uAirPayloadBytes = 0;
+   s_iRxShortBytes = s_iRxMessageBytes = 0;
+   s_iRxWaitForStart = 0;
+   s_iRxLastShortId = -1;
+   s_uRxBadData = 0;
+   tcflush(g_iFdSlave, TCIOFLUSH);
+
+   s_iModemStop = 0;
+   pthread_t pThreadModem;
+   pthread_create(&pThreadModem, NULL, _thread_modem, NULL);
+
+   pthread_t pThreadTx;
+   void (*pfEnqueue)(u8*, int) = _legacy_enqueue;
+   if ( iUseSched )
+   {
+      radio_tx_serial_sched_init(&s_Sched, _sched_write, _sched_link_params, NULL);
+      radio_tx_serial_sched_set_coalescing(&s_Sched, 0, (iUseSched == 2)?1:0);
+      pthread_create(&pThreadTx, NULL, _thread_sched_tx, NULL);
+      pfEnqueue = _sched_enqueue;
+   }
+   else
+   {
+      s_iLegacyStop = 0;
+      s_iLegacyQueueRead = s_iLegacyQueueWrite = 0;
+      pthread_create(&pThreadTx, NULL, _thread_legacy_tx, NULL);
+   }
+
+   // Load: RC at 20 Hz, a command every 500 ms, small telemetry at 10 Hz, large telemetry at 5 Hz
+   // plus a burst of 5 large telemetry messages each second (i.e. a parameters download)
+   u32 uStart = get_current_timestamp_ms();
+   u32 uTick = 0;
+   while ( get_current_timestamp_ms() < uStart + g_iDurationSec*1000 )
+   {
+      u32 uElapsed = get_current_timestamp_ms() - uStart;
+      while ( uTick <= uElapsed )
+      {
+         if ( 0 == (uTick % 50) )
+            _queue_message(pfEnqueue, 0, sizeof(t_packet_header) + 20);
+         if ( 250 == (uTick % 500) )
+            _queue_message(pfEnqueue, 1, sizeof(t_packet_header) + 40);
+         if ( 10 == (uTick % 100) )
+            _queue_message(pfEnqueue, 2, sizeof(t_packet_header) + 60);
+         if ( 20 == (uTick % 200) )
+            _queue_message(pfEnqueue, 2, sizeof(t_packet_header) + 180);
+         if ( 500 == (uTick % 1000) )
+            for( int i=0; i<5; i++ )
+               _queue_message(pfEnqueue, 2, sizeof(t_packet_header) + 180);
+         uTick++;
+      }
+      hardware_sleep_ms(1);
+   }
+   u32 uDurationMs = get_current_timestamp_ms() - uStart;
+   u32 uAirBytesLoad = s_uAirBytes;
+
+   // Let the link drain
+   for( int i=0; i<300; i++ )
+   {
+      u32 uReceived = 0, uSent = 0;
+      for( int k=0; k<TEST_CLASSES; k++ )
+      {
+         uReceived += s_uCountReceived[k];
+         uSent += s_uCountSent[k];
+      }
+      if ( uReceived >= uSent )
+         break;
+      hardware_sleep_ms(10);
+   }
+
+   if ( iUseSched )
+   {
+      radio_tx_serial_sched_signal_stop(&s_Sched);
+      pthread_join(pThreadTx, NULL);
+   }
+   else
+   {
+      s_iLegacyStop = 1;
+      pthread_join(pThreadTx, NULL);
+   }
+   s_iModemStop = 1;
+   pthread_join(pThreadModem, NULL);
+
+   printf("%s:\n", szName);
+   int iFailed = 0;
+   u32 uRCp99 = 0;
+   for( int k=0; k<TEST_CLASSES; k++ )
+   {
+      u32 uCount = s_uCountReceived[k];
+      if ( uCount > TEST_MAX_SAMPLES )
+         uCount = TEST_MAX_SAMPLES;
+      qsort(s_uLatencies[k], uCount, sizeof(u32), _compare_u32);
+      u32 uP50 = uCount?s_uLatencies[k][uCount/2]:0;
+      u32 uP99 = uCount?s_uLatencies[k][(uCount*99)/100]:0;
+      u32 uMax = uCount?s_uLatencies[k][uCount-1]:0;
+      if ( 0 == k )
+         uRCp99 = uP99;
+      printf("   %-10s sent %5u, received %5u, out of order %3u, latency p50 %6.1f ms, p99 %6.1f ms, max %6.1f ms\n",
+         s_szClassNames[k], s_uCountSent[k], s_uCountReceived[k], s_uCountOutOfOrder[k], uP50/1000.0, uP99/1000.0, uMax/1000.0);
+      if ( (s_uCountReceived[k] != s_uCountSent[k]) || (0 != s_uCountOutOfOrder[k]) )
+         iFailed = 1;
+   }
+   if ( 0 != s_uRxBadData )
+      iFailed = 1;
+   if ( (1 == iUseSched) && (0 != s_Sched.stats.uCountShortPacketsCoalesced) )
+      iFailed = 1;
+   printf("   Air: %u short packets, %.1f payload bytes per short packet, link use %.1f%% during load, bad data: %u\n",
+      s_uAirShortPackets, s_uAirShortPackets?((float)s_uAirPayloadBytes/(float)s_uAirShortPackets):0.0,
+      100.0*(float)uAirBytesLoad/((float)TEST_AIR_BYTES_PER_SEC*(float)uDurationMs/1000.0), s_uRxBadData);
+   if ( iUseSched )
+   {
+      printf("   Scheduler: %u messages sent, %u dropped, %u coalesced short packets\n",
+         s_Sched.stats.uCountMessagesSent, s_Sched.stats.uCountMessagesDropped, s_Sched.stats.uCountShortPacketsCoalesced);
+      radio_tx_serial_sched_uninit(&s_Sched);
+   }
+   if ( iFailed )
+      return 0xFFFFFFFF;
+   return uRCp99;
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_serial_tx_sched [duration_sec]\n");
+      return 0;
+   }
+   if ( argc >= 2 )
+      g_iDurationSec = atoi(argv[1]);
+   if ( g_iDurationSec < 1 )
+      g_iDurationSec = 1;
+
+   log_init_local_only("TestSerialTxSched");
+   log_disable_stdout();
+   radio_packets_short_init();
+
+   g_iFdMaster = posix_openpt(O_RDWR | O_NOCTTY);
+   if ( (g_iFdMaster < 0) || (0 != grantpt(g_iFdMaster)) || (0 != unlockpt(g_iFdMaster)) )
+   {
+      printf("Failed to open pty.\n");
+      return -1;
+   }
+   g_iFdSlave = open(ptsname(g_iFdMaster), O_RDWR | O_NOCTTY);
+   if ( g_iFdSlave < 0 )
+   {
+      printf("Failed to open pty slave.\n");
+      return -1;
+   }
+   struct termios tio;
+   tcgetattr(g_iFdSlave, &tio);
+   cfmakeraw(&tio);
+   tcsetattr(g_iFdSlave, TCSANOW, &tio);
+   fcntl(g_iFdMaster, F_SETFL, fcntl(g_iFdMaster, F_GETFL) | O_NONBLOCK);
+
+   printf("\nSerial radio tx test: %d sec, air rate %d bytes/sec, modem buffer %d bytes, short packets of %d bytes\n\n",
+      g_iDurationSec, TEST_AIR_BYTES_PER_SEC, TEST_MODEM_BUFFER_SIZE, TEST_SHORT_PACKET_SIZE);
+
+   u32 uLegacyRC = _run_test("Legacy (polling, fixed gap)", 0);
+   u32 uSchedRC = _run_test("Scheduler (paced)", 1);
+   u32 uSchedCoalescedRC = _run_test("Scheduler (coalesced, paced)", 2);
+
+   close(g_iFdSlave);
+   close(g_iFdMaster);
+
+   int iPassed = (uSchedRC != 0xFFFFFFFF) && (uSchedCoalescedRC != 0xFFFFFFFF) && (uSchedCoalescedRC < uLegacyRC);
+   printf("\n%s\n", iPassed?"Test passed":"Test FAILED");
+   return iPassed?0:1;
+}
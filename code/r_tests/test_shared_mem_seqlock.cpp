@@ -0,0 +1,170 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../base/shared_mem.h"
+
+#include <sys/wait.h>
+
+// Runs a writer process and a reader process over a test shared memory segment shaped like the
+// router published stats (several segments of sizeof(shared_mem_radio_stats) bytes).
+// The writer fills each segment with a generation number; a snapshot is torn if it holds mixed generations.
+//  - stress phase: the writer rewrites one segment continuously, the reader polls it as fast as it can
+//  - volume phase: segments are updated at different rates (like the router does), the reader syncs every 100 ms
+// Each phase is run with plain memcpy (current behaviour) and with the seqlock publish/snapshot protocol.
+
+#define TEST_SHM_NAME "/SYSTEM_SHARED_MEM_RUBY_TEST_SEQLOCK"
+#define TEST_SEGMENTS 4
+
+#define TEST_SEGMENT_WORDS ((sizeof(shared_mem_radio_stats)+3)/4)
+
+typedef struct
+{
+   shared_mem_sequences sequences;
+   volatile u32 uWriterDone;
+   volatile u32 uWriterUpdates;
+   u32 uData[TEST_SEGMENTS][TEST_SEGMENT_WORDS];
+} t_test_shm;
+
+int g_iDurationSec = 3;
+
+// Writer update interval for each segment in the volume phase (ms), 0 for never
+static const u32 s_uWriterIntervalsMs[TEST_SEGMENTS] = { 20, 100, 500, 0 };
+
+static bool _is_torn(const u32* pData)
+{
+   for( u32 i=1; i<TEST_SEGMENT_WORDS; i++ )
+      if ( pData[i] != pData[0] )
+         return true;
+   return false;
+}
+
+static void _run_writer(t_test_shm* pShm, int iUseSeqlock, int iStress)
+{
+   static u32 s_uLocal[TEST_SEGMENT_WORDS];
+   u32 uGeneration[TEST_SEGMENTS];
+   u32 uLastWrite[TEST_SEGMENTS];
+   memset(uGeneration, 0, sizeof(uGeneration));
+   memset(uLastWrite, 0, sizeof(uLastWrite));
+   shared_mem_sequences* pSeq = iUseSeqlock?&pShm->sequences:NULL;
+
+   u32 uEnd = get_current_timestamp_ms() + g_iDurationSec*1000;
+   while ( get_current_timestamp_ms() < uEnd )
+   {
+      for( int iSeg=0; iSeg<TEST_SEGMENTS; iSeg++ )
+      {
+         if ( iStress && (iSeg != 0) )
+            continue;
+         u32 uTimeNow = get_current_timestamp_ms();
+         if ( ! iStress )
+         {
+            if ( (0 == s_uWriterIntervalsMs[iSeg]) || (uTimeNow < uLastWrite[iSeg] + s_uWriterIntervalsMs[iSeg]) )
+               continue;
+         }
+         uLastWrite[iSeg] = uTimeNow;
+         uGeneration[iSeg]++;
+         for( u32 i=0; i<TEST_SEGMENT_WORDS; i++ )
+            s_uLocal[i] = uGeneration[iSeg];
+         shared_mem_publish(pSeq, iSeg, pShm->uData[iSeg], s_uLocal, sizeof(s_uLocal));
+         pShm->uWriterUpdates++;
+      }
+      if ( ! iStress )
+         hardware_sleep_ms(1);
+   }
+   pShm->uWriterDone = 1;
+}
+
+static void _run_phase(t_test_shm* pShm, const char* szName, int iUseSeqlock, int iStress)
+{
+   static u32 s_uSnapshot[TEST_SEGMENTS][TEST_SEGMENT_WORDS];
+   memset(pShm, 0, sizeof(t_test_shm));
+   memset(s_uSnapshot, 0, sizeof(s_uSnapshot));
+   __sync_synchronize();
+
+   pid_t pid = fork();
+   if ( pid < 0 )
+   {
+      printf("Failed to fork writer process.\n");
+      return;
+   }
+   if ( 0 == pid )
+   {
+      _run_writer(pShm, iUseSeqlock, iStress);
+      _exit(0);
+   }
+
+   shared_mem_sequences* pSeq = iUseSeqlock?&pShm->sequences:NULL;
+   shared_mem_snapshot_state sState;
+   shared_mem_snapshot_state_reset(&sState);
+
+   u32 uCountReads = 0;
+   u32 uCountTorn = 0;
+   u32 uCountGaveUp = 0;
+   u32 uStart = get_current_timestamp_ms();
+   while ( ! pShm->uWriterDone )
+   {
+      for( int iSeg=0; iSeg<TEST_SEGMENTS; iSeg++ )
+      {
+         if ( iStress && (iSeg != 0) )
+            continue;
+         uCountReads++;
+         int iRes = SHARED_MEM_SNAPSHOT_COPIED;
+         if ( iUseSeqlock )
+            iRes = shared_mem_snapshot(pSeq, &sState, iSeg, s_uSnapshot[iSeg], pShm->uData[iSeg], sizeof(s_uSnapshot[iSeg]));
+         else
+         {
+            memcpy(s_uSnapshot[iSeg], pShm->uData[iSeg], sizeof(s_uSnapshot[iSeg]));
+            sState.uCountCopied++;
+            sState.uBytesCopied += sizeof(s_uSnapshot[iSeg]);
+         }
+         if ( SHARED_MEM_SNAPSHOT_TORN == iRes )
+            uCountGaveUp++;
+         else if ( (SHARED_MEM_SNAPSHOT_COPIED == iRes) && _is_torn(s_uSnapshot[iSeg]) )
+            uCountTorn++;
+      }
+      if ( ! iStress )
+         hardware_sleep_ms(100);
+   }
+   u32 uDuration = get_current_timestamp_ms() - uStart;
+   waitpid(pid, NULL, 0);
+
+   if ( 0 == uDuration )
+      uDuration = 1;
+   printf("%-28s updates: %7u, reads: %9u, copies: %8u, unchanged: %8u, retries: %7u, gave up: %4u, torn: %6u, copied: %8u kb/s\n",
+      szName, pShm->uWriterUpdates, uCountReads, sState.uCountCopied, sState.uCountUnchanged, sState.uCountRetries, uCountGaveUp, uCountTorn,
+      (u32)(((unsigned long long)sState.uBytesCopied * 1000 / uDuration) / 1024));
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_shared_mem_seqlock [duration_sec]\n");
+      return 0;
+   }
+   if ( argc >= 2 )
+      g_iDurationSec = atoi(argv[1]);
+   if ( g_iDurationSec < 1 )
+      g_iDurationSec = 1;
+
+   log_init_local_only("TestSharedMemSeqlock");
+   log_disable_stdout();
+
+   t_test_shm* pShm = (t_test_shm*) open_shared_mem_for_write(TEST_SHM_NAME, sizeof(t_test_shm));
+   if ( NULL == pShm )
+   {
+      printf("Failed to open test shared memory.\n");
+      return -1;
+   }
+
+   printf("\nShared mem seqlock test: %d sec per phase, %d segments of %d bytes\n\n",
+      g_iDurationSec, TEST_SEGMENTS, (int)(TEST_SEGMENT_WORDS*4));
+
+   _run_phase(pShm, "Stress, memcpy", 0, 1);
+   _run_phase(pShm, "Stress, seqlock", 1, 1);
+   _run_phase(pShm, "Volume (100ms sync), memcpy", 0, 0);
+   _run_phase(pShm, "Volume (100ms sync), seqlock", 1, 0);
+
+   munmap(pShm, sizeof(t_test_shm));
+   shm_unlink(TEST_SHM_NAME);
+   return 0;
+}
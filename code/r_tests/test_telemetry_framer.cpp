@@ -0,0 +1,579 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../base/models.h"
+#include "../base/parse_fc_telemetry.h"
+#include "../base/telemetry_framer.h"
+#include "../radio/radiopackets2.h"
+#include "../../mavlink/common/mavlink.h"
+
+#include <pthread.h>
+#include <fcntl.h>
+#include <termios.h>
+
+// Replays a recorded style MAVLink stream (mixed v1/v2 messages, used and unused by Ruby, line noise):
+//  - parse throughput: legacy byte by byte mavlink_parse_char + decode of every message, vs
+//    the framer (in place frame validation, message id jump table, only used messages decoded)
+//  - read to forward latency over a pty at a given byte rate, as done by the controller raw telemetry upload:
+//    legacy: 10 ms sleep + select + read into a staging buffer, sent at 255 bytes or after 200 ms
+//    framer: poll + read into the framer, sent at 255 bytes, after 200 ms or at complete messages every 20 ms
+// The forwarded bytes are parsed again to find when each message was forwarded.
+
+#define TEST_MAX_MESSAGES 200000
+#define TEST_STREAM_MAX_SIZE (8*1024*1024)
+
+static u8* s_pStream = NULL;
+static int s_iStreamLength = 0;
+static int s_iCountStreamMessages = 0;
+static int s_iMessageEndOffset[TEST_MAX_MESSAGES];
+static u32 s_uMessageWriteTimeMicros[TEST_MAX_MESSAGES];
+static u32 s_uMessageForwardTimeMicros[TEST_MAX_MESSAGES];
+
+static u32 s_uCountRefMessages[TELEMETRY_FRAMER_MAX_HANDLERS];
+static u32 s_uCountFramerMessages[TELEMETRY_FRAMER_MAX_HANDLERS];
+
+static t_packet_header_fc_telemetry s_PHFCT;
+static t_packet_header_ruby_telemetry_extended_v3 s_PHRTE;
+
+int g_iDurationSec = 3;
+int g_iFdMaster = -1;
+int g_iFdSlave = -1;
+
+static void _add_message(mavlink_message_t* pMsg)
+{
+   u8 uBuffer[MAVLINK_MAX_PACKET_LEN];
+   int iLength = mavlink_msg_to_send_buffer(uBuffer, pMsg);
+   if ( (s_iStreamLength + iLength + 8 > TEST_STREAM_MAX_SIZE) || (s_iCountStreamMessages >= TEST_MAX_MESSAGES) )
+      return;
+   memcpy(s_pStream + s_iStreamLength, uBuffer, iLength);
+   s_iStreamLength += iLength;
+   s_iMessageEndOffset[s_iCountStreamMessages++] = s_iStreamLength;
+}
+
+// About 10 Hz attitude, 5 Hz position and HUD, 1 Hz heartbeat and status, plus unused messages and noise
+static void _generate_stream(int iSeconds)
+{
+   mavlink_get_channel_status(MAVLINK_COMM_1)->flags |= MAVLINK_STATUS_FLAG_OUT_MAVLINK1;
+   mavlink_message_t msg;
+   for( int iTick=0; iTick<iSeconds*10; iTick++ )
+   {
+      // Old FCs and companion computers still send MAVLink 1 on the same port
+      u8 uChan = (iTick % 4 == 3)?MAVLINK_COMM_1:MAVLINK_COMM_0;
+
+      mavlink_attitude_t attitude;
+      memset(&attitude, 0, sizeof(attitude));
+      attitude.time_boot_ms = iTick*100;
+      attitude.roll = 0.01f*(iTick % 50);
+      attitude.pitch = -0.02f*(iTick % 30);
+      attitude.yaw = 0.5f;
+      mavlink_msg_attitude_encode_chan(1, 1, uChan, &msg, &attitude);
+      _add_message(&msg);
+
+      if ( 0 == (iTick % 2) )
+      {
+         mavlink_global_position_int_t pos;
+         memset(&pos, 0, sizeof(pos));
+         pos.lat = 445000000 + iTick*10;
+         pos.lon = 261000000 - iTick*10;
+         pos.alt = 100000 + iTick;
+         pos.relative_alt = 5000 + iTick;
+         pos.hdg = (iTick*100) % 36000;
+         mavlink_msg_global_position_int_encode_chan(1, 1, uChan, &msg, &pos);
+         _add_message(&msg);
+
+         mavlink_vfr_hud_t hud;
+         memset(&hud, 0, sizeof(hud));
+         hud.groundspeed = 12.5f;
+         hud.airspeed = 13.0f;
+         hud.throttle = (u16)(iTick % 100);
+         hud.alt = 50.0f;
+         mavlink_msg_vfr_hud_encode_chan(1, 1, uChan, &msg, &hud);
+         _add_message(&msg);
+
+         mavlink_servo_output_raw_t servo;
+         memset(&servo, 0, sizeof(servo));
+         servo.servo1_raw = 1500;
+         mavlink_msg_servo_output_raw_encode_chan(1, 1, uChan, &msg, &servo);
+         _add_message(&msg);
+      }
+      if ( 0 == (iTick % 10) )
+      {
+         mavlink_heartbeat_t hb;
+         memset(&hb, 0, sizeof(hb));
+         hb.type = MAV_TYPE_QUADROTOR;
+         hb.autopilot = MAV_AUTOPILOT_ARDUPILOTMEGA;
+         hb.base_mode = MAV_MODE_FLAG_CUSTOM_MODE_ENABLED;
+         hb.custom_mode = 5;
+         mavlink_msg_heartbeat_encode_chan(1, 1, uChan, &msg, &hb);
+         _add_message(&msg);
+
+         mavlink_sys_status_t st;
+         memset(&st, 0, sizeof(st));
+         st.voltage_battery = 16000 - iTick;
+         st.current_battery = 1200;
+         st.battery_remaining = 80;
+         mavlink_msg_sys_status_encode_chan(1, 1, uChan, &msg, &st);
+         _add_message(&msg);
+
+         mavlink_gps_raw_int_t gps;
+         memset(&gps, 0, sizeof(gps));
+         gps.fix_type = 3;
+         gps.satellites_visible = 12;
+         gps.eph = 90;
+         gps.lat = 445000000 + iTick*10;
+         gps.lon = 261000000 - iTick*10;
+         mavlink_msg_gps_raw_int_encode_chan(1, 1, uChan, &msg, &gps);
+         _add_message(&msg);
+
+         mavlink_timesync_t ts;
+         memset(&ts, 0, sizeof(ts));
+         ts.tc1 = iTick;
+         mavlink_msg_timesync_encode_chan(1, 1, uChan, &msg, &ts);
+         _add_message(&msg);
+
+         mavlink_param_value_t param;
+         memset(&param, 0, sizeof(param));
+         strcpy(param.param_id, "SERIAL1_BAUD");
+         param.param_value = 115.0f;
+         param.param_count = 900;
+         param.param_index = iTick % 900;
+         mavlink_msg_param_value_encode_chan(1, 1, uChan, &msg, &param);
+         _add_message(&msg);
+      }
+      // Line noise between messages
+      if ( 7 == (iTick % 20) )
+      if ( s_iStreamLength + 3 < TEST_STREAM_MAX_SIZE )
+      {
+         s_pStream[s_iStreamLength++] = 0x00;
+         s_pStream[s_iStreamLength++] = 0x55;
+         s_pStream[s_iStreamLength++] = 0x0A;
+      }
+   }
+}
+
+static void _reference_count_messages()
+{
+   memset(s_uCountRefMessages, 0, sizeof(s_uCountRefMessages));
+   mavlink_message_t msg;
+   mavlink_status_t status;
+   memset(&status, 0, sizeof(status));
+   for( int i=0; i<s_iStreamLength; i++ )
+      if ( mavlink_parse_char(MAVLINK_COMM_2, s_pStream[i], &msg, &status) )
+      if ( msg.msgid < TELEMETRY_FRAMER_MAX_HANDLERS )
+         s_uCountRefMessages[msg.msgid]++;
+}
+
+static void _on_used_frame(void* pContext, u32 uMessageId, const u8* pFrame, int iFrameLength)
+{
+   s_uCountFramerMessages[uMessageId]++;
+   parse_telemetry_from_fc_mavlink_frame(pFrame, iFrameLength, &s_PHFCT, &s_PHRTE, MODEL_TYPE_DRONE);
+}
+
+static void _on_other_frame(void* pContext, u32 uMessageId, const u8* pFrame, int iFrameLength)
+{
+   if ( uMessageId < TELEMETRY_FRAMER_MAX_HANDLERS )
+      s_uCountFramerMessages[uMessageId]++;
+}
+
+static void _setup_framer(t_telemetry_framer* pFramer, int iAutoConsume, int iDecode)
+{
+   telemetry_framer_init(pFramer, TELEMETRY_FRAMER_PROTOCOL_MAVLINK, iAutoConsume, NULL);
+   if ( ! iDecode )
+      return;
+   const u32* pIds = NULL;
+   int iCount = parse_telemetry_get_used_mavlink_messages(&pIds);
+   for( int i=0; i<iCount; i++ )
+      telemetry_framer_set_handler(pFramer, pIds[i], _on_used_frame);
+   telemetry_framer_set_default_handler(pFramer, _on_other_frame);
+}
+
+static void _reset_decoder()
+{
+   parse_telemetry_init(1, false);
+   memset(&s_PHFCT, 0, sizeof(s_PHFCT));
+   memset(&s_PHRTE, 0, sizeof(s_PHRTE));
+}
+
+// Returns 1 if the decoded telemetry of the two runs matches
+static int _compare_decoded(t_packet_header_fc_telemetry* pA, t_packet_header_fc_telemetry* pB)
+{
+   return (pA->roll == pB->roll) && (pA->pitch == pB->pitch) && (pA->heading == pB->heading) &&
+          (pA->latitude == pB->latitude) && (pA->longitude == pB->longitude) &&
+          (pA->satelites == pB->satelites) && (pA->gps_fix_type == pB->gps_fix_type) &&
+          (pA->voltage == pB->voltage) && (pA->throttle == pB->throttle) &&
+          (pA->altitude_abs == pB->altitude_abs) && (pA->hspeed == pB->hspeed);
+}
+
+static int _test_throughput()
+{
+   int iLoops = 20;
+   printf("Parse throughput: %d bytes, %d messages, %d passes\n", s_iStreamLength, s_iCountStreamMessages, iLoops);
+
+   _reset_decoder();
+   u32 uStart = get_current_timestamp_micros();
+   for( int k=0; k<iLoops; k++ )
+   for( int i=0; i<s_iStreamLength; i+=256 )
+   {
+      int iChunk = (s_iStreamLength - i < 256)?(s_iStreamLength - i):256;
+      parse_telemetry_from_fc(s_pStream + i, iChunk, &s_PHFCT, &s_PHRTE, MODEL_TYPE_DRONE, TELEMETRY_TYPE_MAVLINK);
+   }
+   u32 uLegacyMicros = get_current_timestamp_micros() - uStart;
+   t_packet_header_fc_telemetry legacyPHFCT = s_PHFCT;
+   int iLegacyHeartbeats = get_heartbeat_msg_count();
+
+   _reset_decoder();
+   static t_telemetry_framer s_Framer;
+   _setup_framer(&s_Framer, 1, 1);
+   memset(s_uCountFramerMessages, 0, sizeof(s_uCountFramerMessages));
+   uStart = get_current_timestamp_micros();
+   for( int k=0; k<iLoops; k++ )
+   for( int i=0; i<s_iStreamLength; i+=256 )
+   {
+      int iChunk = (s_iStreamLength - i < 256)?(s_iStreamLength - i):256;
+      telemetry_framer_add_data(&s_Framer, s_pStream + i, iChunk);
+   }
+   u32 uFramerMicros = get_current_timestamp_micros() - uStart;
+   int iFramerHeartbeats = get_heartbeat_msg_count();
+
+   if ( uLegacyMicros < 1 )
+      uLegacyMicros = 1;
+   if ( uFramerMicros < 1 )
+      uFramerMicros = 1;
+   double dBytes = (double)s_iStreamLength * iLoops;
+   double dMessages = (double)s_iCountStreamMessages * iLoops;
+   printf("   Legacy (parse_char + decode all): %7.1f MB/s, %9.0f msg/s\n", dBytes/uLegacyMicros, dMessages*1000000.0/uLegacyMicros);
+   printf("   Framer (jump table, decode used): %7.1f MB/s, %9.0f msg/s (%.1fx)\n", dBytes/uFramerMicros, dMessages*1000000.0/uFramerMicros, (double)uLegacyMicros/(double)uFramerMicros);
+   printf("   Framer: %u frames, %u dispatched, %u bad, %u skipped bytes\n",
+      s_Framer.stats.uCountFrames, s_Framer.stats.uCountFramesDispatched, s_Framer.stats.uCountBadFrames, s_Framer.stats.uCountSkippedBytes);
+
+   int iPassed = 1;
+   _reference_count_messages();
+   for( int i=0; i<TELEMETRY_FRAMER_MAX_HANDLERS; i++ )
+   {
+      if ( s_uCountFramerMessages[i] == s_uCountRefMessages[i] * iLoops )
+         continue;
+      printf("   Message id %d: framer %u, reference %u\n", i, s_uCountFramerMessages[i], s_uCountRefMessages[i] * iLoops);
+      iPassed = 0;
+   }
+   if ( ! _compare_decoded(&legacyPHFCT, &s_PHFCT) )
+   {
+      printf("   Decoded telemetry differs between legacy and framer.\n");
+      iPassed = 0;
+   }
+   if ( iLegacyHeartbeats != iFramerHeartbeats )
+   {
+      printf("   Heartbeats count differs: legacy %d, framer %d\n", iLegacyHeartbeats, iFramerHeartbeats);
+      iPassed = 0;
+   }
+   return iPassed;
+}
+
+static int _test_ltm_msp()
+{
+   static t_telemetry_framer s_Framer;
+   memset(s_uCountFramerMessages, 0, sizeof(s_uCountFramerMessages));
+   u8 uBuffer[64];
+   int iPassed = 1;
+
+   // LTM attitude frame: $TA pitch roll heading checksum, plus a corrupted one
+   telemetry_framer_init(&s_Framer, TELEMETRY_FRAMER_PROTOCOL_LTM, 1, NULL);
+   telemetry_framer_set_default_handler(&s_Framer, _on_other_frame);
+   u8 uLTM[10] = { '$', 'T', 'A', 10, 0, 20, 0, 90, 0, 0 };
+   for( int i=3; i<9; i++ )
+      uLTM[9] ^= uLTM[i];
+   memcpy(uBuffer, uLTM, 10);
+   memcpy(uBuffer + 10, uLTM, 10);
+   uBuffer[15] ^= 0xFF;
+   memcpy(uBuffer + 20, uLTM, 10);
+   telemetry_framer_add_data(&s_Framer, uBuffer, 30);
+   if ( (s_uCountFramerMessages['A'] != 2) || (0 == s_Framer.stats.uCountBadFrames) )
+      iPassed = 0;
+
+   // MSP response split over two reads
+   telemetry_framer_init(&s_Framer, TELEMETRY_FRAMER_PROTOCOL_MSP, 1, NULL);
+   telemetry_framer_set_default_handler(&s_Framer, _on_other_frame);
+   u8 uMSP[9] = { '$', 'M', '>', 3, 1, 0, 2, 45, 0 };
+   for( int i=3; i<8; i++ )
+      uMSP[8] ^= uMSP[i];
+   telemetry_framer_add_data(&s_Framer, uMSP, 4);
+   telemetry_framer_add_data(&s_Framer, uMSP + 4, 5);
+   if ( s_uCountFramerMessages[1] != 1 )
+      iPassed = 0;
+   printf("LTM/MSP framing: %s\n\n", iPassed?"ok":"failed");
+   return iPassed;
+}
+
+// Pty replay
+
+static volatile int s_iWriterDone = 0;
+static int s_iBytesPerSec = 0;
+
+static void* _thread_writer(void* pArg)
+{
+   u32 uStart = get_current_timestamp_micros();
+   int iOffset = 0;
+   int iMessage = 0;
+   while ( iOffset < s_iStreamLength )
+   {
+      int iChunk = s_iStreamLength - iOffset;
+      if ( s_iBytesPerSec > 0 )
+      {
+         hardware_sleep_micros(1000);
+         u32 uElapsed = get_current_timestamp_micros() - uStart;
+         int iDue = (int)(((unsigned long long)uElapsed * s_iBytesPerSec)/1000000);
+         if ( iDue > s_iStreamLength )
+            iDue = s_iStreamLength;
+         iChunk = iDue - iOffset;
+         if ( iChunk <= 0 )
+            continue;
+      }
+      else if ( iChunk > 1024 )
+         iChunk = 1024;
+
+      u32 uTimeNow = get_current_timestamp_micros();
+      while ( (iMessage < s_iCountStreamMessages) && (s_iMessageEndOffset[iMessage] <= iOffset + iChunk) )
+         s_uMessageWriteTimeMicros[iMessage++] = uTimeNow;
+      int iWritten = 0;
+      while ( iWritten < iChunk )
+      {
+         int iRes = write(g_iFdMaster, s_pStream + iOffset + iWritten, iChunk - iWritten);
+         if ( iRes > 0 )
+            iWritten += iRes;
+         else
+            hardware_sleep_micros(200);
+      }
+      iOffset += iChunk;
+   }
+   s_iWriterDone = 1;
+   return NULL;
+}
+
+static mavlink_status_t s_ForwardStatus;
+static int s_iCountForwarded = 0;
+
+static void _on_forward(u8* pData, int iLength)
+{
+   u32 uTimeNow = get_current_timestamp_micros();
+   mavlink_message_t msg;
+   for( int i=0; i<iLength; i++ )
+      if ( mavlink_parse_char(MAVLINK_COMM_3, pData[i], &msg, &s_ForwardStatus) )
+      {
+         if ( s_iCountForwarded < s_iCountStreamMessages )
+            s_uMessageForwardTimeMicros[s_iCountForwarded] = uTimeNow;
+         s_iCountForwarded++;
+      }
+}
+
+static void _run_legacy_reader()
+{
+   u8 uStaging[RAW_TELEMETRY_MAX_BUFFER];
+   int iStagingCount = 0;
+   u32 uLastSendTime = get_current_timestamp_ms();
+   u32 uIdleSince = 0;
+   while ( 1 )
+   {
+      hardware_sleep_ms(10);
+      u32 uTimeNow = get_current_timestamp_ms();
+
+      struct timeval to;
+      to.tv_sec = 0;
+      to.tv_usec = 2000;
+      fd_set readset;
+      FD_ZERO(&readset);
+      FD_SET(g_iFdSlave, &readset);
+      int iLength = 0;
+      u8 uBufferIn[RAW_TELEMETRY_MAX_BUFFER];
+      if ( select(g_iFdSlave+1, &readset, NULL, NULL, &to) > 0 )
+         iLength = read(g_iFdSlave, uBufferIn, 320);
+      if ( iLength > 0 )
+         uIdleSince = 0;
+      u8* pData = uBufferIn;
+      while ( iLength > 0 )
+      {
+         if ( iStagingCount + iLength < 320 )
+         {
+            memcpy(&uStaging[iStagingCount], pData, iLength);
+            iStagingCount += iLength;
+            break;
+         }
+         int iChunk = 320 - iStagingCount;
+         memcpy(&uStaging[iStagingCount], pData, iChunk);
+         iStagingCount += iChunk;
+         pData += iChunk;
+         iLength -= iChunk;
+         _on_forward(uStaging, iStagingCount);
+         iStagingCount = 0;
+         uLastSendTime = uTimeNow;
+      }
+      if ( (iStagingCount >= RAW_TELEMETRY_MIN_SEND_LENGTH) || ((iStagingCount > 0) && (uTimeNow >= uLastSendTime + RAW_TELEMETRY_SEND_TIMEOUT)) )
+      {
+         _on_forward(uStaging, iStagingCount);
+         iStagingCount = 0;
+         uLastSendTime = uTimeNow;
+      }
+      if ( s_iWriterDone && (0 == iStagingCount) )
+      {
+         if ( 0 == uIdleSince )
+            uIdleSince = uTimeNow;
+         if ( uTimeNow > uIdleSince + 300 )
+            break;
+      }
+   }
+}
+
+static void _run_framer_reader()
+{
+   static t_telemetry_framer s_Framer;
+   _setup_framer(&s_Framer, 0, 0);
+   telemetry_framer_set_fd(&s_Framer, g_iFdSlave);
+   t_telemetry_framer* pFramer = &s_Framer;
+   u32 uLastSendTime = get_current_timestamp_ms();
+   u32 uIdleSince = 0;
+   while ( 1 )
+   {
+      telemetry_framer_poll(&pFramer, 1, 10);
+      u32 uTimeNow = get_current_timestamp_ms();
+      if ( s_Framer.iLastReadBytes > 0 )
+         uIdleSince = 0;
+
+      u8* pData = NULL;
+      int iReady = telemetry_framer_get_ready_data(&s_Framer, &pData);
+      while ( iReady >= 320 )
+      {
+         _on_forward(pData, 320);
+         telemetry_framer_consume(&s_Framer, 320);
+         uLastSendTime = uTimeNow;
+         iReady = telemetry_framer_get_ready_data(&s_Framer, &pData);
+      }
+      if ( (iReady > 0) &&
+           ( (iReady >= RAW_TELEMETRY_MIN_SEND_LENGTH) ||
+             (uTimeNow >= uLastSendTime + RAW_TELEMETRY_SEND_TIMEOUT) ||
+             (s_Framer.iReadyEndsOnFrame && (uTimeNow >= uLastSendTime + RAW_TELEMETRY_FRAMED_SEND_INTERVAL)) ) )
+      {
+         _on_forward(pData, iReady);
+         telemetry_framer_consume(&s_Framer, iReady);
+         uLastSendTime = uTimeNow;
+         iReady = 0;
+      }
+      if ( s_iWriterDone && (0 == iReady) )
+      {
+         if ( 0 == uIdleSince )
+            uIdleSince = uTimeNow;
+         if ( uTimeNow > uIdleSince + 300 )
+            break;
+      }
+   }
+}
+
+static int _compare_u32(const void* a, const void* b)
+{
+   u32 x = *(const u32*)a;
+   u32 y = *(const u32*)b;
+   return (x < y)?-1:((x > y)?1:0);
+}
+
+// Returns the p50 latency in micros, 0xFFFFFFFF if messages were lost
+static u32 _run_replay(const char* szName, int iUseFramer, int iBytesPerSec)
+{
+   tcflush(g_iFdSlave, TCIOFLUSH);
+   memset(&s_ForwardStatus, 0, sizeof(s_ForwardStatus));
+   mavlink_reset_channel_status(MAVLINK_COMM_3);
+   s_iCountForwarded = 0;
+   s_iWriterDone = 0;
+   s_iBytesPerSec = iBytesPerSec;
+
+   u32 uStart = get_current_timestamp_micros();
+   pthread_t pThreadWriter;
+   pthread_create(&pThreadWriter, NULL, _thread_writer, NULL);
+   if ( iUseFramer )
+      _run_framer_reader();
+   else
+      _run_legacy_reader();
+   pthread_join(pThreadWriter, NULL);
+   u32 uDuration = get_current_timestamp_micros() - uStart;
+
+   int iCount = s_iCountForwarded;
+   if ( iCount > s_iCountStreamMessages )
+      iCount = s_iCountStreamMessages;
+   static u32 s_uLatencies[TEST_MAX_MESSAGES];
+   for( int i=0; i<iCount; i++ )
+      s_uLatencies[i] = s_uMessageForwardTimeMicros[i] - s_uMessageWriteTimeMicros[i];
+   qsort(s_uLatencies, iCount, sizeof(u32), _compare_u32);
+   u32 uP50 = iCount?s_uLatencies[iCount/2]:0;
+   u32 uP99 = iCount?s_uLatencies[(iCount*99)/100]:0;
+   u32 uMax = iCount?s_uLatencies[iCount-1]:0;
+   printf("   %-8s forwarded %6d of %6d messages in %5.2f s, latency p50 %6.1f ms, p99 %6.1f ms, max %6.1f ms\n",
+      szName, s_iCountForwarded, s_iCountStreamMessages, uDuration/1000000.0, uP50/1000.0, uP99/1000.0, uMax/1000.0);
+   if ( s_iCountForwarded != s_iCountStreamMessages )
+      return 0xFFFFFFFF;
+   return uP50;
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_telemetry_framer [duration_sec]\n");
+      return 0;
+   }
+   if ( argc >= 2 )
+      g_iDurationSec = atoi(argv[1]);
+   if ( g_iDurationSec < 1 )
+      g_iDurationSec = 1;
+
+   log_init_local_only("TestTelemetryFramer");
+   log_disable_stdout();
+
+   s_pStream = (u8*)malloc(TEST_STREAM_MAX_SIZE);
+   if ( NULL == s_pStream )
+      return -1;
+
+   // Long stream for the throughput test
+   _generate_stream(600);
+   printf("\n");
+   int iPassed = _test_throughput();
+   printf("\n");
+   iPassed &= _test_ltm_msp();
+
+   g_iFdMaster = posix_openpt(O_RDWR | O_NOCTTY);
+   if ( (g_iFdMaster < 0) || (0 != grantpt(g_iFdMaster)) || (0 != unlockpt(g_iFdMaster)) )
+   {
+      printf("Failed to open pty.\n");
+      return -1;
+   }
+   g_iFdSlave = open(ptsname(g_iFdMaster), O_RDWR | O_NOCTTY);
+   if ( g_iFdSlave < 0 )
+   {
+      printf("Failed to open pty slave.\n");
+      return -1;
+   }
+   struct termios tio;
+   tcgetattr(g_iFdSlave, &tio);
+   cfmakeraw(&tio);
+   tcsetattr(g_iFdSlave, TCSANOW, &tio);
+   fcntl(g_iFdMaster, F_SETFL, fcntl(g_iFdMaster, F_GETFL) | O_NONBLOCK);
+
+   // Stream the length of the replay at 115200 bps
+   s_iStreamLength = 0;
+   s_iCountStreamMessages = 0;
+   while ( s_iStreamLength < g_iDurationSec * 11520 )
+      _generate_stream(1);
+
+   printf("Pty replay at 115200 bps (11520 bytes/sec), %d bytes:\n", s_iStreamLength);
+   u32 uLegacy = _run_replay("Legacy", 0, 11520);
+   u32 uFramer = _run_replay("Framer", 1, 11520);
+   printf("Pty replay unthrottled:\n");
+   u32 uLegacyFast = _run_replay("Legacy", 0, 0);
+   u32 uFramerFast = _run_replay("Framer", 1, 0);
+
+   close(g_iFdSlave);
+   close(g_iFdMaster);
+   free(s_pStream);
+
+   if ( (0xFFFFFFFF == uFramer) || (0xFFFFFFFF == uFramerFast) || (uFramer >= uLegacy) )
+      iPassed = 0;
+   if ( (0xFFFFFFFF == uLegacyFast) || (uFramerFast >= uLegacyFast) )
+      iPassed = 0;
+   printf("\n%s\n", iPassed?"Test passed":"Test FAILED");
+   return iPassed?0:1;
+}
@@ -0,0 +1,368 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/models.h"
+#include "../base/shared_mem_controller_only.h"
+#include "../base/video_link_adaptive_logic.h"
+
+// Deterministic simulation of the adaptive video link: the controller decision logic and the vehicle
+// level params run against scripted channel traces (loss, RSSI, loss bursts), in virtual time.
+//  - vehicle: sends video blocks (data + EC packets) at the bitrate / EC scheme of its current level
+//  - channel: per packet loss from the trace segment (base loss + RSSI fade), lost packets can start a burst
+//  - controller: counts clean / reconstructed / retransmitted / missing blocks per sample interval, runs the
+//    adaptive decision logic each interval and sends the target level to the vehicle (the request can be lost)
+// Reports, per trace: convergence time after each channel change, oscillations (level change direction
+// reversals), time spent at each level and the effective video goodput.
+
+#define TEST_PACKET_DATA_SIZE 1100
+#define TEST_RADIO_CAPACITY_BPS 10000000
+#define TEST_MAX_SEGMENTS 32
+#define TEST_MAX_LEVELS 64
+// A level is considered stable if it did not change for this long
+#define TEST_CONVERGED_MS 2000
+
+typedef struct
+{
+   u32 uDurationMs;
+   int iLossPercent;
+   int iRSSI; // dBm
+   int iBurstPackets; // consecutive packets lost after a loss
+} t_trace_segment;
+
+typedef struct
+{
+   const char* szName;
+   int iCountSegments;
+   t_trace_segment segments[TEST_MAX_SEGMENTS];
+} t_trace;
+
+typedef struct
+{
+   int iCountLevelChanges;
+   int iCountOscillations;
+   int iMaxLevel;
+   int iFinalLevel;
+   int iConvergenceMs[TEST_MAX_SEGMENTS]; // -1 if not converged before the segment end
+   u32 uTimeAtLevelMs[TEST_MAX_LEVELS];
+   u32 uGoodputKbps[TEST_MAX_SEGMENTS];
+   u32 uTotalGoodputKbps;
+   u32 uCountMissingBlocks;
+   u32 uHash; // of the levels sequence, to check the simulation is deterministic
+} t_sim_result;
+
+static t_trace s_Traces[] =
+{
+   { "clean", 1, { { 10000, 0, -50, 0 } } },
+   { "steady loss", 3, { { 5000, 0, -50, 0 }, { 12000, 8, -60, 0 }, { 12000, 0, -50, 0 } } },
+   { "rssi fade", 3, { { 5000, 0, -55, 0 }, { 12000, 1, -86, 0 }, { 12000, 0, -55, 0 } } },
+   { "bursts", 3, { { 5000, 0, -50, 0 }, { 12000, 2, -65, 6 }, { 12000, 0, -50, 0 } } },
+   { "intermittent", 7, { { 4000, 0, -50, 0 }, { 1500, 15, -70, 2 }, { 3000, 0, -50, 0 }, { 1500, 15, -70, 2 }, { 3000, 0, -50, 0 }, { 1500, 15, -70, 2 }, { 12000, 0, -50, 0 } } },
+};
+
+static t_trace s_TraceFromFile;
+static u32 s_uRandState = 1;
+
+static u32 _rand()
+{
+   s_uRandState = s_uRandState * 1103515245 + 12345;
+   return (s_uRandState >> 16) & 0x7FFF;
+}
+
+static int _get_loss_per_thousand(const t_trace_segment* pSegment)
+{
+   int iLoss = pSegment->iLossPercent * 10;
+   // RSSI fade: loss rises fast below -80 dBm
+   if ( pSegment->iRSSI < -80 )
+      iLoss += (-80 - pSegment->iRSSI) * 30;
+   if ( iLoss > 950 )
+      iLoss = 950;
+   return iLoss;
+}
+
+static int s_iBurstLeft = 0;
+
+static bool _is_packet_lost(const t_trace_segment* pSegment, int iLossPerThousand)
+{
+   if ( s_iBurstLeft > 0 )
+   {
+      s_iBurstLeft--;
+      return true;
+   }
+   if ( (int)(_rand() % 1000) >= iLossPerThousand )
+      return false;
+   s_iBurstLeft = pSegment->iBurstPackets;
+   return true;
+}
+
+static void _run_trace(Model* pModel, t_trace* pTrace, t_sim_result* pResult, bool bPrint)
+{
+   memset(pResult, 0, sizeof(t_sim_result));
+   s_uRandState = 1;
+   s_iBurstLeft = 0;
+
+   static shared_mem_controller_adaptive_video_info_vehicle s_Info;
+   memset(&s_Info, 0, sizeof(s_Info));
+   u32 uTimeNow = 10000;
+   u32 uTimeStartGoodInterval = 0;
+   s_Info.uUpdateInterval = CONTROLLER_ADAPTIVE_VIDEO_SAMPLE_INTERVAL;
+   s_Info.uLastUpdateTime = uTimeNow;
+   s_Info.iCurrentTargetLevelShift = 0;
+   s_Info.iLastAcknowledgedLevelShift = 0;
+   s_Info.uTimeLastLevelShiftDown = uTimeNow;
+   s_Info.uTimeLastLevelShiftUp = uTimeNow;
+
+   int iVehicleLevel = 0;
+   t_adaptive_video_level_params levelParams;
+   video_link_adaptive_get_level_params(pModel, iVehicleLevel, pModel->video_params.user_selected_video_link_profile, 0, &levelParams);
+
+   int iLastChangeDirection = 0;
+   u32 uPendingDataPackets = 0; // in 1/1000 packets
+   u32 uTotalGoodBytes = 0;
+   u32 uTotalDurationMs = 0;
+   pResult->uHash = 2166136261u;
+
+   if ( bPrint )
+      printf("Trace [%s]:\n", pTrace->szName);
+
+   for( int iSegment=0; iSegment<pTrace->iCountSegments; iSegment++ )
+   {
+      t_trace_segment* pSegment = &pTrace->segments[iSegment];
+      int iLossPerThousand = _get_loss_per_thousand(pSegment);
+      u32 uTimeSegmentStart = uTimeNow;
+      u32 uTimeLastChange = uTimeNow;
+      u32 uSegmentGoodBytes = 0;
+
+      for( u32 uElapsed = 0; uElapsed < pSegment->uDurationMs; uElapsed += CONTROLLER_ADAPTIVE_VIDEO_SAMPLE_INTERVAL )
+      {
+         int iSlot = s_Info.iCurrentIntervalIndex;
+
+         // Vehicle sends the video blocks for this interval, at the current level, capped by the radio capacity
+
+         u32 uDataPacketsPerSec = levelParams.uVideoBitrate / (8 * TEST_PACKET_DATA_SIZE);
+         u32 uMaxPacketsPerSec = TEST_RADIO_CAPACITY_BPS / (8 * TEST_PACKET_DATA_SIZE);
+         int iBlockPackets = levelParams.iDataPackets + levelParams.iECPackets;
+         if ( (levelParams.iDataPackets > 0) && (uDataPacketsPerSec * iBlockPackets / levelParams.iDataPackets > uMaxPacketsPerSec) )
+            uDataPacketsPerSec = uMaxPacketsPerSec * levelParams.iDataPackets / iBlockPackets;
+         uPendingDataPackets += uDataPacketsPerSec * CONTROLLER_ADAPTIVE_VIDEO_SAMPLE_INTERVAL;
+
+         while ( (levelParams.iDataPackets > 0) && (uPendingDataPackets >= (u32)levelParams.iDataPackets * 1000) )
+         {
+            uPendingDataPackets -= levelParams.iDataPackets * 1000;
+            int iLost = 0;
+            for( int k=0; k<iBlockPackets; k++ )
+               if ( _is_packet_lost(pSegment, iLossPerThousand) )
+                  iLost++;
+
+            bool bBlockOk = true;
+            if ( 0 == iLost )
+               s_Info.uIntervalsOuputCleanVideoPackets[iSlot] += levelParams.iDataPackets;
+            else if ( iLost <= levelParams.iECPackets )
+               s_Info.uIntervalsOuputRecontructedVideoPackets[iSlot] += levelParams.iDataPackets;
+            else
+            {
+               // Controller requests the missing packets, then retries once the ones lost again
+               int iMissing = iLost - levelParams.iECPackets;
+               s_Info.uIntervalsRequestedRetransmissions[iSlot] += iMissing;
+               int iLostAgain = 0;
+               for( int k=0; k<iMissing; k++ )
+                  if ( _is_packet_lost(pSegment, iLossPerThousand) )
+                     iLostAgain++;
+               if ( iLostAgain > 0 )
+               {
+                  s_Info.uIntervalsRetriedRetransmissions[iSlot] += iLostAgain;
+                  int iLostFinal = 0;
+                  for( int k=0; k<iLostAgain; k++ )
+                     if ( _is_packet_lost(pSegment, iLossPerThousand) )
+                        iLostFinal++;
+                  if ( iLostFinal > 0 )
+                  {
+                     s_Info.uIntervalsMissingVideoPackets[iSlot] += iLostFinal;
+                     pResult->uCountMissingBlocks++;
+                     bBlockOk = false;
+                  }
+               }
+            }
+            if ( bBlockOk )
+               uSegmentGoodBytes += levelParams.iDataPackets * TEST_PACKET_DATA_SIZE;
+         }
+
+         // Controller: close the interval (same as the router periodic loop) and run the adaptive logic
+
+         uTimeNow += CONTROLLER_ADAPTIVE_VIDEO_SAMPLE_INTERVAL;
+         s_Info.uLastUpdateTime = uTimeNow;
+         s_Info.iCurrentIntervalIndex++;
+         if ( s_Info.iCurrentIntervalIndex >= MAX_CONTROLLER_ADAPTIVE_VIDEO_INFO_INTERVALS )
+            s_Info.iCurrentIntervalIndex = 0;
+         iSlot = s_Info.iCurrentIntervalIndex;
+         s_Info.uIntervalsOuputCleanVideoPackets[iSlot] = 0;
+         s_Info.uIntervalsOuputRecontructedVideoPackets[iSlot] = 0;
+         s_Info.uIntervalsMissingVideoPackets[iSlot] = 0;
+         s_Info.uIntervalsRequestedRetransmissions[iSlot] = 0;
+         s_Info.uIntervalsRetriedRetransmissions[iSlot] = 0;
+         s_Info.uIntervalsFlags[iSlot] = 0;
+
+         int iPrevTarget = s_Info.iCurrentTargetLevelShift;
+         if ( video_link_adaptive_compute_target_level(pModel, &s_Info, uTimeNow, &uTimeStartGoodInterval) )
+         {
+            int iDirection = (s_Info.iCurrentTargetLevelShift > iPrevTarget)?1:-1;
+            if ( (0 != iLastChangeDirection) && (iDirection != iLastChangeDirection) )
+               pResult->iCountOscillations++;
+            iLastChangeDirection = iDirection;
+            pResult->iCountLevelChanges++;
+            uTimeLastChange = uTimeNow;
+            pResult->uHash = (pResult->uHash ^ (u32)(s_Info.iCurrentTargetLevelShift+1) ^ uTimeNow) * 16777619u;
+            if ( s_Info.iCurrentTargetLevelShift > pResult->iMaxLevel )
+               pResult->iMaxLevel = s_Info.iCurrentTargetLevelShift;
+         }
+
+         // The level request reaches the vehicle (and is applied) unless the request packet is lost
+
+         if ( s_Info.iCurrentTargetLevelShift != s_Info.iLastAcknowledgedLevelShift )
+         if ( ! _is_packet_lost(pSegment, iLossPerThousand) )
+         {
+            iVehicleLevel = s_Info.iCurrentTargetLevelShift;
+            s_Info.iLastAcknowledgedLevelShift = iVehicleLevel;
+            video_link_adaptive_get_level_params(pModel, iVehicleLevel, pModel->video_params.user_selected_video_link_profile, 0, &levelParams);
+         }
+         if ( (iVehicleLevel >= 0) && (iVehicleLevel < TEST_MAX_LEVELS) )
+            pResult->uTimeAtLevelMs[iVehicleLevel] += CONTROLLER_ADAPTIVE_VIDEO_SAMPLE_INTERVAL;
+      }
+
+      u32 uSegmentMs = uTimeNow - uTimeSegmentStart;
+      if ( uTimeNow - uTimeLastChange < TEST_CONVERGED_MS )
+         pResult->iConvergenceMs[iSegment] = -1;
+      else
+         pResult->iConvergenceMs[iSegment] = (int)(uTimeLastChange - uTimeSegmentStart);
+      pResult->uGoodputKbps[iSegment] = (u32)(((unsigned long long)uSegmentGoodBytes * 8) / uSegmentMs);
+      uTotalGoodBytes += uSegmentGoodBytes;
+      uTotalDurationMs += uSegmentMs;
+
+      if ( bPrint )
+      {
+         char szConv[32];
+         if ( pResult->iConvergenceMs[iSegment] < 0 )
+            strcpy(szConv, "not converged");
+         else
+            sprintf(szConv, "%d ms", pResult->iConvergenceMs[iSegment]);
+         printf("  segment %d: %5u ms, loss %2d%%, rssi %d dBm, burst %d: converged: %-14s goodput: %5u kbps, end level: %d\n",
+            iSegment+1, pSegment->uDurationMs, pSegment->iLossPercent, pSegment->iRSSI, pSegment->iBurstPackets, szConv, pResult->uGoodputKbps[iSegment], iVehicleLevel);
+      }
+   }
+
+   pResult->iFinalLevel = iVehicleLevel;
+   pResult->uTotalGoodputKbps = (u32)(((unsigned long long)uTotalGoodBytes * 8) / uTotalDurationMs);
+
+   if ( bPrint )
+   {
+      printf("  level changes: %d, oscillations: %d, max level: %d, lost blocks: %u, goodput: %u kbps\n",
+         pResult->iCountLevelChanges, pResult->iCountOscillations, pResult->iMaxLevel, pResult->uCountMissingBlocks, pResult->uTotalGoodputKbps);
+      printf("  time at level:");
+      for( int i=0; i<TEST_MAX_LEVELS; i++ )
+         if ( pResult->uTimeAtLevelMs[i] > 0 )
+            printf(" L%d: %.1f%%", i, 100.0*(float)pResult->uTimeAtLevelMs[i]/(float)uTotalDurationMs);
+      printf("\n\n");
+   }
+}
+
+static bool _load_trace(const char* szFile, t_trace* pTrace)
+{
+   FILE* fd = fopen(szFile, "r");
+   if ( NULL == fd )
+      return false;
+   memset(pTrace, 0, sizeof(t_trace));
+   pTrace->szName = szFile;
+   t_trace_segment segment;
+   while ( (pTrace->iCountSegments < TEST_MAX_SEGMENTS) && (4 == fscanf(fd, "%u %d %d %d", &segment.uDurationMs, &segment.iLossPercent, &segment.iRSSI, &segment.iBurstPackets)) )
+   {
+      if ( segment.uDurationMs < CONTROLLER_ADAPTIVE_VIDEO_SAMPLE_INTERVAL )
+         continue;
+      memcpy(&pTrace->segments[pTrace->iCountSegments], &segment, sizeof(t_trace_segment));
+      pTrace->iCountSegments++;
+   }
+   fclose(fd);
+   return (pTrace->iCountSegments > 0);
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_video_adaptive_sim [trace_file]\n");
+      printf("  trace file: one segment per line: duration_ms loss_percent rssi_dbm burst_packets\n");
+      return 0;
+   }
+
+   log_init_local_only("TestVideoAdaptiveSim");
+   log_disable_stdout();
+
+   static Model s_Model;
+   s_Model.resetVideoParamsToDefaults();
+   Model* pModel = &s_Model;
+
+   int iLevelsHQ = pModel->get_video_profile_total_levels(pModel->video_params.user_selected_video_link_profile);
+   int iLevelsMQ = pModel->get_video_profile_total_levels(VIDEO_PROFILE_MQ);
+   int iLevelsLQ = pModel->get_video_profile_total_levels(VIDEO_PROFILE_LQ);
+   printf("\nAdaptive video link simulation: levels HQ/MQ/LQ: %d/%d/%d, adjustment strength: %d, sample interval: %d ms\n",
+      iLevelsHQ, iLevelsMQ, iLevelsLQ, pModel->video_params.videoAdjustmentStrength, CONTROLLER_ADAPTIVE_VIDEO_SAMPLE_INTERVAL);
+   for( int i=0; i<iLevelsHQ+iLevelsMQ+iLevelsLQ; i++ )
+   {
+      t_adaptive_video_level_params params;
+      video_link_adaptive_get_level_params(pModel, i, pModel->video_params.user_selected_video_link_profile, 0, &params);
+      printf("  L%d: profile %d level %d, data/ec: %d/%d, video bitrate: %u kbps\n",
+         i, params.iVideoProfile, params.iProfileLevelShift, params.iDataPackets, params.iECPackets, params.uVideoBitrate/1000);
+   }
+   printf("\n");
+
+   t_sim_result result;
+   t_sim_result resultRepeat;
+
+   if ( argc >= 2 )
+   {
+      if ( ! _load_trace(argv[1], &s_TraceFromFile) )
+      {
+         printf("Failed to load trace file %s\n", argv[1]);
+         return -1;
+      }
+      _run_trace(pModel, &s_TraceFromFile, &result, true);
+      _run_trace(pModel, &s_TraceFromFile, &resultRepeat, false);
+      int iPassed = (0 == memcmp(&result, &resultRepeat, sizeof(t_sim_result)));
+      printf("%s\n", iPassed?"Test passed":"Test FAILED");
+      return iPassed?0:1;
+   }
+
+   int iPassed = 1;
+   for( int i=0; i<(int)(sizeof(s_Traces)/sizeof(s_Traces[0])); i++ )
+   {
+      _run_trace(pModel, &s_Traces[i], &result, true);
+      _run_trace(pModel, &s_Traces[i], &resultRepeat, false);
+
+      if ( 0 != memcmp(&result, &resultRepeat, sizeof(t_sim_result)) )
+      {
+         printf("  FAILED: simulation is not deterministic\n");
+         iPassed = 0;
+      }
+      // A clean link must stay on the highest quality level
+      if ( 1 == s_Traces[i].iCountSegments )
+      if ( (0 != result.iCountLevelChanges) || (0 != result.iFinalLevel) )
+      {
+         printf("  FAILED: level changed on a clean link\n");
+         iPassed = 0;
+      }
+      // A degraded link must make the controller shift down, and it must come back up once the link is clean
+      if ( s_Traces[i].iCountSegments > 1 )
+      {
+         if ( 0 == result.iMaxLevel )
+         {
+            printf("  FAILED: no shift down on a degraded link\n");
+            iPassed = 0;
+         }
+         if ( (0 != result.iFinalLevel) || (result.iConvergenceMs[s_Traces[i].iCountSegments-1] < 0) )
+         {
+            printf("  FAILED: did not converge back to the highest level on a clean link\n");
+            iPassed = 0;
+         }
+      }
+   }
+
+   printf("%s\n", iPassed?"Test passed":"Test FAILED");
+   return iPassed?0:1;
+}
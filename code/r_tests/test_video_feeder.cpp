@@ -0,0 +1,291 @@
+#include "../base/base.h"
+#include "../base/config.h"
+#include "../base/hardware.h"
+#include "../r_player/video_decoder.h"
+#include "../r_player/frame_feeder.h"
+
+#include <pthread.h>
+
+// Plays a synthetic H264 stream (SPS/PPS + IDR every 30 frames, P frames, 1 to 3 slices per frame,
+// 4 bytes start code on the first NAL of each frame, 3 bytes start codes on the next slices) into the
+// null video decoder, written in packet sized chunks at the stream frame rate, using:
+//  - the legacy pipe consumer: ring buffer polled every 5 ms, fed to the decoder in 1024 bytes slices
+//  - the frame feeder: wakes up on each write and submits whole frames
+// A frame can only be known complete once the next frame header is received (the decoder parser
+// has the same constraint on a raw stream), so latency is measured for both from the write of the
+// chunk holding the next frame header to the moment the decoder has the whole frame.
+// Verifies that the frame feeder submits each frame exactly as it was generated.
+
+#define TEST_PACKET_SIZE 1200
+#define TEST_PIPE_BUFFER_SIZE 400000
+#define TEST_HEADER_LOOKAHEAD 6
+
+int g_iDurationSec = 5;
+int g_iFPS = 60;
+
+u8* g_pStream = NULL;
+int g_iStreamLength = 0;
+int g_iCountFrames = 0;
+int* g_pFrameStart = NULL; // frame start positions in stream, g_iCountFrames+1 entries
+u32* g_pBoundaryWriteTime = NULL;
+u32* g_pFrameCompleteTime = NULL;
+
+// Legacy pipe buffer
+u8 g_uPipeBuffer[TEST_PIPE_BUFFER_SIZE];
+volatile int g_iPipeBufferWritePos = 0;
+volatile int g_iPipeBufferReadPos = 0;
+volatile int g_iProducerRunning = 0;
+
+// Frame feeder output checks
+int g_iCountSubmitted = 0;
+int g_iCountBadFrames = 0;
+
+static u8 _filler_byte(u32 uSeed)
+{
+   uSeed = uSeed * 1103515245 + 12345;
+   return (u8)(((uSeed >> 16) % 255) + 1);
+}
+
+static int _add_nal(u8* pDest, bool bLongStartCode, u8 uHeader, u8 uFirstByte, int iFrame, int iPayload)
+{
+   int iPos = 0;
+   if ( bLongStartCode )
+      pDest[iPos++] = 0;
+   pDest[iPos++] = 0;
+   pDest[iPos++] = 0;
+   pDest[iPos++] = 1;
+   pDest[iPos++] = uHeader;
+   pDest[iPos++] = uFirstByte;
+   // Frame id, no zero bytes
+   for( int i=0; i<4; i++ )
+      pDest[iPos++] = 0x10 + ((iFrame >> (4*i)) & 0x0F);
+   for( int i=0; i<iPayload; i++ )
+      pDest[iPos++] = _filler_byte((u32)(iFrame*7919 + i));
+   return iPos;
+}
+
+static void _generate_stream()
+{
+   g_iCountFrames = g_iDurationSec * g_iFPS;
+   g_pStream = (u8*) malloc(g_iCountFrames * 50000);
+   g_pFrameStart = (int*) malloc((g_iCountFrames+1) * sizeof(int));
+   g_pBoundaryWriteTime = (u32*) malloc(g_iCountFrames * sizeof(u32));
+   g_pFrameCompleteTime = (u32*) malloc(g_iCountFrames * sizeof(u32));
+
+   int iPos = 0;
+   for( int iFrame=0; iFrame<g_iCountFrames; iFrame++ )
+   {
+      g_pFrameStart[iFrame] = iPos;
+      bool bIDR = ((iFrame % 30) == 0);
+      int iSlices = 1 + (iFrame % 3);
+      int iSliceSize = bIDR?(30000/iSlices):((3000 + (iFrame*1237)%9000)/iSlices);
+      if ( bIDR )
+      {
+         iPos += _add_nal(g_pStream + iPos, true, 0x67, 0x42, iFrame, 12);
+         iPos += _add_nal(g_pStream + iPos, true, 0x68, 0xCE, iFrame, 2);
+      }
+      for( int i=0; i<iSlices; i++ )
+      {
+         // first_mb_in_slice == 0 only for the first slice of the frame
+         iPos += _add_nal(g_pStream + iPos, (!bIDR) && (i == 0), bIDR?0x65:0x41, (i == 0)?0x88:0x40, iFrame, iSliceSize);
+      }
+   }
+   g_pFrameStart[g_iCountFrames] = iPos;
+   g_iStreamLength = iPos;
+}
+
+static void _write_legacy(const u8* pData, int iLength)
+{
+   // Same as the old pipe reader: copy at write pos, wrap to start of buffer
+   while ( iLength > 0 )
+   {
+      int iSize = iLength;
+      if ( g_iPipeBufferWritePos + iSize > TEST_PIPE_BUFFER_SIZE )
+         iSize = TEST_PIPE_BUFFER_SIZE - g_iPipeBufferWritePos;
+      memcpy(&g_uPipeBuffer[g_iPipeBufferWritePos], pData, iSize);
+      __sync_synchronize();
+      int iNewWritePos = g_iPipeBufferWritePos + iSize;
+      if ( iNewWritePos >= TEST_PIPE_BUFFER_SIZE )
+         iNewWritePos = 0;
+      g_iPipeBufferWritePos = iNewWritePos;
+      pData += iSize;
+      iLength -= iSize;
+   }
+}
+
+static void _run_producer(void (*pfWrite)(const u8*, int))
+{
+   u32 uFrameIntervalMicros = 1000000 / g_iFPS;
+   u32 uNext = get_current_timestamp_micros();
+   int iNextBoundary = 1;
+   for( int iFrame=0; iFrame<g_iCountFrames; iFrame++ )
+   {
+      while ( (int)(get_current_timestamp_micros() - uNext) < 0 )
+         hardware_sleep_micros(200);
+      uNext += uFrameIntervalMicros;
+
+      // Video packets of a frame arrive close to each other
+      int iPos = g_pFrameStart[iFrame];
+      while ( iPos < g_pFrameStart[iFrame+1] )
+      {
+         int iSize = g_pFrameStart[iFrame+1] - iPos;
+         if ( iSize > TEST_PACKET_SIZE )
+            iSize = TEST_PACKET_SIZE;
+         u32 uTime = get_current_timestamp_micros();
+         while ( (iNextBoundary < g_iCountFrames) && (g_pFrameStart[iNextBoundary] + TEST_HEADER_LOOKAHEAD <= iPos + iSize) )
+         {
+            g_pBoundaryWriteTime[iNextBoundary-1] = uTime;
+            iNextBoundary++;
+         }
+         pfWrite(g_pStream + iPos, iSize);
+         iPos += iSize;
+         hardware_sleep_micros(50);
+      }
+   }
+}
+
+static void* _thread_legacy_consumer(void* pParam)
+{
+   t_video_decoder* pDecoder = video_decoder_get_null();
+   int iStreamPos = 0;
+   int iNextBoundary = 1;
+   while ( g_iProducerRunning || (g_iPipeBufferReadPos != g_iPipeBufferWritePos) )
+   {
+      if ( g_iPipeBufferReadPos == g_iPipeBufferWritePos )
+      {
+         hardware_sleep_ms(5);
+         continue;
+      }
+      int iSize = g_iPipeBufferWritePos - g_iPipeBufferReadPos;
+      if ( g_iPipeBufferWritePos < g_iPipeBufferReadPos )
+         iSize = TEST_PIPE_BUFFER_SIZE - g_iPipeBufferReadPos;
+      if ( iSize > 1024 )
+         iSize = 1024;
+      pDecoder->pfSubmit(&g_uPipeBuffer[g_iPipeBufferReadPos], iSize, 0);
+      iStreamPos += iSize;
+
+      u32 uTime = get_current_timestamp_micros();
+      while ( (iNextBoundary < g_iCountFrames) && (g_pFrameStart[iNextBoundary] + TEST_HEADER_LOOKAHEAD <= iStreamPos) )
+      {
+         g_pFrameCompleteTime[iNextBoundary-1] = uTime;
+         iNextBoundary++;
+      }
+
+      g_iPipeBufferReadPos += iSize;
+      if ( g_iPipeBufferReadPos >= TEST_PIPE_BUFFER_SIZE )
+         g_iPipeBufferReadPos = 0;
+   }
+   return NULL;
+}
+
+static void _on_feeder_submit(const u8* pData, int iLength, u32 uPTSMicros, u32 uTimeSubmitMicros)
+{
+   int iFrame = g_iCountSubmitted++;
+   if ( iFrame >= g_iCountFrames )
+   {
+      g_iCountBadFrames++;
+      return;
+   }
+   g_pFrameCompleteTime[iFrame] = uTimeSubmitMicros;
+   int iExpectedLength = g_pFrameStart[iFrame+1] - g_pFrameStart[iFrame];
+   if ( (iLength != iExpectedLength) || (0 != memcmp(pData, g_pStream + g_pFrameStart[iFrame], iLength)) )
+   {
+      if ( g_iCountBadFrames < 5 )
+         printf("  Frame %d: FAIL, got %d bytes, expected %d bytes\n", iFrame, iLength, iExpectedLength);
+      g_iCountBadFrames++;
+   }
+}
+
+static void _run_legacy()
+{
+   g_iPipeBufferWritePos = g_iPipeBufferReadPos = 0;
+   g_iProducerRunning = 1;
+   pthread_t pth;
+   pthread_create(&pth, NULL, &_thread_legacy_consumer, NULL);
+   _run_producer(_write_legacy);
+   g_iProducerRunning = 0;
+   pthread_join(pth, NULL);
+}
+
+static void _run_frame_feeder()
+{
+   t_video_decoder* pDecoder = video_decoder_get_null();
+   pDecoder->pfInit(false, true);
+   video_decoder_null_set_submit_callback(_on_feeder_submit);
+   g_iCountSubmitted = 0;
+   g_iCountBadFrames = 0;
+   frame_feeder_init(pDecoder, false);
+   frame_feeder_start();
+   _run_producer(frame_feeder_write);
+   frame_feeder_stop();
+   video_decoder_null_set_submit_callback(NULL);
+
+   t_frame_feeder_stats stats;
+   frame_feeder_get_stats(&stats);
+   printf("  feeder: %u writes, %u frames, %u bytes, max frame %u bytes, %u overflows, %u oversized frames\n",
+      stats.uCountWrites, stats.uCountFrames, stats.uCountBytes, stats.uMaxFrameSize, stats.uCountOverflows, stats.uCountOversizedFrames);
+   if ( g_iCountSubmitted != g_iCountFrames )
+   {
+      printf("  FAIL, submitted %d frames, expected %d\n", g_iCountSubmitted, g_iCountFrames);
+      g_iCountBadFrames++;
+   }
+}
+
+static int _compare_u32(const void* a, const void* b)
+{
+   u32 ua = *(const u32*)a;
+   u32 ub = *(const u32*)b;
+   return (ua < ub)?-1:((ua > ub)?1:0);
+}
+
+static void _print_latencies(const char* szName)
+{
+   // Last frame has no next frame header
+   int iCount = g_iCountFrames - 1;
+   u32* pValues = (u32*) malloc(iCount * sizeof(u32));
+   for( int i=0; i<iCount; i++ )
+      pValues[i] = g_pFrameCompleteTime[i] - g_pBoundaryWriteTime[i];
+   qsort(pValues, iCount, sizeof(u32), _compare_u32);
+   printf("%-30s frames: %5d, p50: %6u us, p90: %6u us, p99: %6u us, max: %6u us\n",
+      szName, iCount, pValues[iCount/2], pValues[(iCount*90)/100], pValues[(iCount*99)/100], pValues[iCount-1]);
+   free(pValues);
+}
+
+int main(int argc, char *argv[])
+{
+   if ( argc >= 2 && (0 == strcmp(argv[1], "-help")) )
+   {
+      printf("\nUsage: test_video_feeder [duration_sec] [fps]\n");
+      return 0;
+   }
+   if ( argc >= 2 )
+      g_iDurationSec = atoi(argv[1]);
+   if ( argc >= 3 )
+      g_iFPS = atoi(argv[2]);
+   if ( g_iDurationSec < 1 )
+      g_iDurationSec = 1;
+   if ( (g_iFPS < 10) || (g_iFPS > 240) )
+      g_iFPS = 60;
+
+   log_init_local_only("TestVideoFeeder");
+   log_disable_stdout();
+
+   _generate_stream();
+   printf("\nVideo feeder test: %d sec, %d fps, %d frames, %d bytes, %d bytes packets\n\n",
+      g_iDurationSec, g_iFPS, g_iCountFrames, g_iStreamLength, TEST_PACKET_SIZE);
+
+   memset(g_pFrameCompleteTime, 0, g_iCountFrames * sizeof(u32));
+   _run_legacy();
+   _print_latencies("Legacy 5ms poll, 1k slices");
+
+   memset(g_pFrameCompleteTime, 0, g_iCountFrames * sizeof(u32));
+   _run_frame_feeder();
+   _print_latencies("Frame feeder, wake on data");
+
+   printf("\n%s\n", g_iCountBadFrames?"Test FAILED":"Test passed");
+   free(g_pStream);
+   free(g_pFrameStart);
+   free(g_pBoundaryWriteTime);
+   free(g_pFrameCompleteTime);
+   return g_iCountBadFrames?1:0;
+}
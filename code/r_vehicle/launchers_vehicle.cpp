@@ -260,18 +260,7 @@ static void * _thread_adjust_affinities_vehicle(void *argument)
    log_line("Started background thread to adjust processes affinities (arg: %p, veye: %d (%d))...", argument, (int)bVeYe, (int)s_bAdjustAffinitiesIsVeyeCamera);
    
    if ( s_iCPUCoresCount < 1 )
-   {
-      s_iCPUCoresCount = 1;
-      char szOutput[128];
-      hw_execute_bash_command_raw("nproc --all", szOutput);
-      if ( 1 != sscanf(szOutput, "%d", &s_iCPUCoresCount) )
-      {
-         log_softerror_and_alarm("Failed to get CPU cores count. No affinity adjustments for processes to be done.");
-         s_bThreadBgAffinitiesStarted = false;
-         s_iCPUCoresCount = 1;
-         return NULL;    
-      }
-   }
+      s_iCPUCoresCount = hw_get_cpu_cores_count();
 
    if ( s_iCPUCoresCount < 2 || s_iCPUCoresCount > 32 )
    {
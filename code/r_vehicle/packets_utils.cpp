@@ -430,6 +430,12 @@ bool _send_packet_to_wifi_radio_interface(int iLocalRadioLinkId, int iRadioInter
          u32* pExtraDataU32 = (u32*)pExtraData;
          pExtraDataU32[3] = get_current_timestamp_ms();
       }
+      if ( ! (pPH->packet_flags & PACKET_FLAGS_BIT_RETRANSMITED) )
+      {
+         t_packet_video_latency_trace* pTrace = radio_packet_get_video_latency_trace(pPacketData);
+         if ( (NULL != pTrace) && (0 == pTrace->uDeltaRadioTx) )
+            pTrace->uDeltaRadioTx = radio_packet_latency_trace_delta(pTrace->uVehicleTimeReadMicros, get_current_timestamp_micros());
+      }
    }
    
    int totalLength = radio_build_new_raw_packet(iLocalRadioLinkId, s_RadioRawPacket, pPacketData, nPacketLength, RADIO_PORT_ROUTER_DOWNLINK, be);
@@ -36,6 +36,7 @@
 #include "../base/hardware.h"
 #include "../base/hw_procs.h"
 #include "../base/radio_utils.h"
+#include "../base/video_link_adaptive_logic.h"
 #include "../base/ruby_ipc.h"
 #include "../common/radio_stats.h"
 #include "../common/string_utils.h"
@@ -479,15 +480,15 @@ void process_received_single_radio_packet(int iRadioInterface, u8* pData, int da
          if ( NULL != g_pProcessorTxVideo )
             g_pProcessorTxVideo->setLastRequestedAdaptiveVideoLevelFromController(iAdaptiveLevel);
          
-         int iTargetProfile = g_pCurrentModel->get_video_profile_from_total_levels_shift(iAdaptiveLevel);
-         int iTargetProfileShiftLevel = g_pCurrentModel->get_video_profile_level_shift_from_total_levels_shift(iAdaptiveLevel);
+         t_adaptive_video_level_params levelParams;
+         video_link_adaptive_get_level_params(g_pCurrentModel, iAdaptiveLevel, g_SM_VideoLinkStats.overwrites.userVideoLinkProfile, 0, &levelParams);
          
-         if ( iTargetProfile == g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile )
-         if ( iTargetProfileShiftLevel == g_SM_VideoLinkStats.overwrites.currentProfileShiftLevel )
+         if ( levelParams.iVideoProfile == g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile )
+         if ( levelParams.iProfileLevelShift == g_SM_VideoLinkStats.overwrites.currentProfileShiftLevel )
          {
             return;
          }
-         video_stats_overwrites_switch_to_profile_and_level(iAdaptiveLevel, iTargetProfile, iTargetProfileShiftLevel);
+         video_stats_overwrites_switch_to_profile_and_level(iAdaptiveLevel);
          return;
       }
       
@@ -533,6 +534,33 @@ void process_received_single_radio_packet(int iRadioInterface, u8* pData, int da
          return;
       }
 
+      if ( pPH->packet_type == PACKET_TYPE_VIDEO_REQUEST_KEYFRAME )
+      {
+         if ( pPH->total_length < sizeof(t_packet_header) + sizeof(u32) )
+            return;
+
+         u32 uRequestId = 0;
+         u8 uVideoStreamIndex = 0;
+         memcpy( &uRequestId, pData + sizeof(t_packet_header), sizeof(u32));
+         if ( pPH->total_length >= sizeof(t_packet_header) + sizeof(u32) + sizeof(u8) )
+            uVideoStreamIndex = *(pData + sizeof(t_packet_header) + sizeof(u32));
+
+         // Always acknowledge, so that the controller stops resending the request
+         t_packet_header PH;
+         radio_packet_init(&PH, PACKET_COMPONENT_VIDEO, PACKET_TYPE_VIDEO_REQUEST_KEYFRAME_ACK, STREAM_ID_DATA);
+         PH.vehicle_id_src = g_pCurrentModel->uVehicleId;
+         PH.vehicle_id_dest = pPH->vehicle_id_src;
+         PH.total_length = sizeof(t_packet_header) + sizeof(u32);
+         u8 packet[MAX_PACKET_TOTAL_SIZE];
+         memcpy(packet, (u8*)&PH, sizeof(t_packet_header));
+         memcpy(packet+sizeof(t_packet_header), &uRequestId, sizeof(u32));
+         packets_queue_add_packet(&g_QueueRadioPacketsOut, packet);
+
+         if ( relay_current_vehicle_must_send_own_video_feeds() )
+            process_data_tx_video_request_keyframe(uRequestId, (u32)uVideoStreamIndex);
+         return;
+      }
+
       if ( g_pCurrentModel->hasCamera() )
          process_data_tx_video_command(iRadioInterface, pData);
    }
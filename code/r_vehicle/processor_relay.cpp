@@ -58,6 +58,83 @@ u8 s_uLastLocalRadioLinkUsedForPingToRelayedVehicle = 0;
 
 u32 s_uLastTimeReceivedRubyTelemetryFromRelayedVehicle = 0;
 
+// Radio links/interfaces used to send relayed packets, in each direction.
+// Rebuilt when relay params or radio interfaces change, not for each relayed packet.
+typedef struct
+{
+   int iCount;
+   int iRadioLinkId[MAX_RADIO_INTERFACES];
+   int iRadioInterfaceIndex[MAX_RADIO_INTERFACES];
+} t_relay_tx_interfaces;
+
+t_relay_tx_interfaces s_RelayTxInterfacesToController;
+t_relay_tx_interfaces s_RelayTxInterfacesToRelayedVehicle;
+bool s_bRelayTxInterfacesValid = false;
+u32 s_uTimeLastRelayTxInterfacesUpdate = 0;
+
+static void _relay_add_tx_interface_for_link(t_relay_tx_interfaces* pTxInterfaces, int iRadioLinkId)
+{
+   int iRadioInterfaceIndex = -1;
+   for( int k=0; k<g_pCurrentModel->radioInterfacesParams.interfaces_count; k++ )
+   {
+      if ( g_pCurrentModel->radioInterfacesParams.interface_link_id[k] == iRadioLinkId )
+      {
+         iRadioInterfaceIndex = k;
+         break;
+      }
+   }
+   if ( iRadioInterfaceIndex < 0 )
+      return;
+   if ( g_pCurrentModel->radioInterfacesParams.interface_capabilities_flags[iRadioInterfaceIndex] & RADIO_HW_CAPABILITY_FLAG_DISABLED )
+      return;
+   if ( !(g_pCurrentModel->radioInterfacesParams.interface_capabilities_flags[iRadioInterfaceIndex] & RADIO_HW_CAPABILITY_FLAG_CAN_TX) )
+      return;
+   if ( pTxInterfaces->iCount >= MAX_RADIO_INTERFACES )
+      return;
+   pTxInterfaces->iRadioLinkId[pTxInterfaces->iCount] = iRadioLinkId;
+   pTxInterfaces->iRadioInterfaceIndex[pTxInterfaces->iCount] = iRadioInterfaceIndex;
+   pTxInterfaces->iCount++;
+}
+
+static void _relay_update_tx_interfaces()
+{
+   s_RelayTxInterfacesToController.iCount = 0;
+   s_RelayTxInterfacesToRelayedVehicle.iCount = 0;
+   s_bRelayTxInterfacesValid = true;
+   s_uTimeLastRelayTxInterfacesUpdate = g_TimeNow;
+
+   if ( NULL == g_pCurrentModel )
+      return;
+
+   for( int iRadioLinkId=0; iRadioLinkId<g_pCurrentModel->radioLinksParams.links_count; iRadioLinkId++ )
+   {
+      u32 uLinkFlags = g_pCurrentModel->radioLinksParams.link_capabilities_flags[iRadioLinkId];
+      if ( uLinkFlags & RADIO_HW_CAPABILITY_FLAG_DISABLED )
+         continue;
+      if ( !(uLinkFlags & RADIO_HW_CAPABILITY_FLAG_CAN_TX) )
+         continue;
+
+      if ( uLinkFlags & RADIO_HW_CAPABILITY_FLAG_USED_FOR_RELAY )
+         _relay_add_tx_interface_for_link(&s_RelayTxInterfacesToRelayedVehicle, iRadioLinkId);
+      else if ( g_pCurrentModel->relay_params.isRelayEnabledOnRadioLinkId != iRadioLinkId )
+         _relay_add_tx_interface_for_link(&s_RelayTxInterfacesToController, iRadioLinkId);
+   }
+   log_line("[Relay] Updated relay tx radio interfaces: %d to controller, %d to relayed vehicle.",
+      s_RelayTxInterfacesToController.iCount, s_RelayTxInterfacesToRelayedVehicle.iCount);
+}
+
+static void _relay_check_update_tx_interfaces()
+{
+   // Also refreshed periodically, as radio links flags can be changed by other components
+   if ( (! s_bRelayTxInterfacesValid) || (g_TimeNow >= s_uTimeLastRelayTxInterfacesUpdate + 2000) )
+      _relay_update_tx_interfaces();
+}
+
+void relay_invalidate_tx_interfaces()
+{
+   s_bRelayTxInterfacesValid = false;
+}
+
 u32 relay_get_time_last_received_ruby_telemetry_from_relayed_vehicle()
 {
    return s_uLastTimeReceivedRubyTelemetryFromRelayedVehicle;
@@ -73,6 +150,7 @@ void relay_init_and_set_rx_info_stats(type_uplink_rx_info_stats* pUplinkStats)
    s_pRelayRxInfoStats = pUplinkStats;
    s_bHasEverReceivedDataFromRelayedVehicle = false;
    s_uLastReceivedRelayedVehicleID = MAX_U32;
+   s_bRelayTxInterfacesValid = false;
 }
 
 
@@ -89,6 +167,8 @@ void relay_process_received_single_radio_packet_from_controller_to_relayed_vehic
 }
 
 
+static void _relay_send_packet_to_controller(u8* pBufferData, int iBufferLength, u32 uSourceVehicleId, bool bContainsPairConfirmation);
+
 void relay_process_received_radio_packet_from_relayed_vehicle(int iRadioLink, int iRadioInterfaceIndex, u8* pBufferData, int iBufferLength)
 {
    //log_line("Received packet from relayed vehicle on radio interface %d, %d bytes", iRadioInterfaceIndex+1, iBufferLength);
@@ -143,15 +223,15 @@ void relay_process_received_radio_packet_from_relayed_vehicle(int iRadioLink, in
    int iCountReceivedPackets = 0;
    bool bIsFullComposedPacketOkToForward = true;
    bool bPacketContainsDataToForward = false;
+   bool bContainsPairConfirmation = false;
    
+   // The radio rx thread already checked the CRC of the received packets and decrypted them.
+   // Only walk the chained packets headers here, do not process them again.
    while ( nLength > 0 )
    {
       t_packet_header* pPH = (t_packet_header*)pData;
 
-      int bCRCOk = 0;
-      int iPacketLength = packet_process_and_check(iRadioInterfaceIndex, pData, nLength, &bCRCOk);
-
-      if ( iPacketLength <= 0 )
+      if ( (nLength < (int)sizeof(t_packet_header)) || (pPH->total_length < sizeof(t_packet_header)) || ((int)pPH->total_length > nLength) )
          return;
 
       if ( pPH->vehicle_id_src != g_pCurrentModel->relay_params.uRelayedVehicleId )
@@ -175,10 +255,13 @@ void relay_process_received_radio_packet_from_relayed_vehicle(int iRadioLink, in
            (pPH->packet_type ==  PACKET_TYPE_RUBY_PAIRING_CONFIRMATION) )
       {
          bPacketContainsDataToForward = true;
+         if ( pPH->packet_type == PACKET_TYPE_RUBY_PAIRING_CONFIRMATION )
+            bContainsPairConfirmation = true;
          log_line("Will relay from relayed vehicle to controller the pairing confirmation message.");
       }
       if ( (pPH->packet_type == PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK) ||
-           (pPH->packet_type == PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK) )
+           (pPH->packet_type == PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK) ||
+           (pPH->packet_type == PACKET_TYPE_VIDEO_REQUEST_KEYFRAME_ACK) )
          bPacketContainsDataToForward = true;
 
       if ( g_pCurrentModel->relay_params.uRelayCapabilitiesFlags & RELAY_CAPABILITY_TRANSPORT_VIDEO )
@@ -218,7 +301,7 @@ void relay_process_received_radio_packet_from_relayed_vehicle(int iRadioLink, in
       return;
 
    // Forward the full composed packet to the controller
-   relay_send_packet_to_controller(pBufferData, iBufferLength);
+   _relay_send_packet_to_controller(pBufferData, iBufferLength, g_pCurrentModel->relay_params.uRelayedVehicleId, bContainsPairConfirmation);
 }
 
 
@@ -343,78 +426,27 @@ void relay_on_relayed_vehicle_id_changed(u32 uNewVehicleId)
     (s_bHasEverReceivedDataFromRelayedVehicle?"Yes":"No") );
 
    s_bHasEverReceivedDataFromRelayedVehicle = false;
+   relay_invalidate_tx_interfaces();
 }
 
-void relay_send_packet_to_controller(u8* pBufferData, int iBufferLength)
+static void _relay_send_packet_to_controller(u8* pBufferData, int iBufferLength, u32 uSourceVehicleId, bool bContainsPairConfirmation)
 {
-   if ( iBufferLength <= 0 )
-   {
-      log_softerror_and_alarm("[Relay] Tried to send an empty radio packet (%d bytes) from relayed vehicle to controller.", iBufferLength);
+   if ( uSourceVehicleId != g_pCurrentModel->relay_params.uRelayedVehicleId )
       return;
-   }
 
-   u8* pData = pBufferData;
-   int nLength = iBufferLength;
-   u32 uCountChainedPackets = 0;
-   u32 uStreamId = 0;
-   u32 uSourceVehicleId = 0;
-   bool bContainsPairConfirmation = false;
-
-   while ( nLength > 0 )
-   {
-      t_packet_header* pPH = (t_packet_header*)pData;
-      if ( pPH->packet_type == PACKET_TYPE_RUBY_PAIRING_CONFIRMATION )
-         bContainsPairConfirmation = true;
-      uSourceVehicleId = pPH->vehicle_id_src;
-      uStreamId = (pPH->stream_packet_idx)>>PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX;
-      if ( uStreamId < 0 || uStreamId >= MAX_RADIO_STREAMS )
-         uStreamId = 0;
+   _relay_check_update_tx_interfaces();
 
-      nLength -= pPH->total_length;
-      pData += pPH->total_length;
-      uCountChainedPackets++;
-   }
-
-   if ( uSourceVehicleId != g_pCurrentModel->relay_params.uRelayedVehicleId )
-   {
-      return;
-   } 
    // Send packet on all radio links to controller (that are not set as relay links)
 
    bool bPacketSent = false;
 
-   for( int iRadioLinkId=0; iRadioLinkId<g_pCurrentModel->radioLinksParams.links_count; iRadioLinkId++ )
+   for( int i=0; i<s_RelayTxInterfacesToController.iCount; i++ )
    {
-      if ( g_pCurrentModel->relay_params.isRelayEnabledOnRadioLinkId == iRadioLinkId )
-         continue;
-        
-      if ( g_pCurrentModel->radioLinksParams.link_capabilities_flags[iRadioLinkId] & RADIO_HW_CAPABILITY_FLAG_DISABLED )
-         continue;
-
-      if ( g_pCurrentModel->radioLinksParams.link_capabilities_flags[iRadioLinkId] & RADIO_HW_CAPABILITY_FLAG_USED_FOR_RELAY )
-         continue;
-
-      if ( !(g_pCurrentModel->radioLinksParams.link_capabilities_flags[iRadioLinkId] & RADIO_HW_CAPABILITY_FLAG_CAN_TX) )
-         continue;
-
-      int iRadioInterfaceIndex = -1;
-      for( int k=0; k<g_pCurrentModel->radioInterfacesParams.interfaces_count; k++ )
-      {
-         if ( g_pCurrentModel->radioInterfacesParams.interface_link_id[k] == iRadioLinkId )
-         {
-            iRadioInterfaceIndex = k;
-            break;
-         }
-      }
-      if ( iRadioInterfaceIndex < 0 )
-         continue;
+      int iRadioLinkId = s_RelayTxInterfacesToController.iRadioLinkId[i];
+      int iRadioInterfaceIndex = s_RelayTxInterfacesToController.iRadioInterfaceIndex[i];
 
       radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(iRadioInterfaceIndex);
-      if ( ! pRadioHWInfo->openedForWrite )
-         continue;
-      if ( g_pCurrentModel->radioInterfacesParams.interface_capabilities_flags[iRadioInterfaceIndex] & RADIO_HW_CAPABILITY_FLAG_DISABLED )
-         continue;
-      if ( !(g_pCurrentModel->radioInterfacesParams.interface_capabilities_flags[iRadioInterfaceIndex] & RADIO_HW_CAPABILITY_FLAG_CAN_TX) )
+      if ( (NULL == pRadioHWInfo) || (! pRadioHWInfo->openedForWrite) )
          continue;
       
       int nRateTx = g_pCurrentModel->radioLinksParams.link_datarate_video_bps[iRadioLinkId];
@@ -449,7 +481,35 @@ void relay_send_packet_to_controller(u8* pBufferData, int iBufferLength)
    if ( bContainsPairConfirmation )
      log_line("[RelayTX] Relayed back pairing confirmation from relayed vehicle VID %u to controller %u",
         uSourceVehicleId, g_uControllerId);
-   //log_line("[RelayTX] Sent relayed packet to controller, stream %u, %d bytes, relayed VID: %u, current VID: %u", uStreamId, iBufferLength, uSourceVehicleId, g_pCurrentModel->uVehicleId);
+}
+
+void relay_send_packet_to_controller(u8* pBufferData, int iBufferLength)
+{
+   if ( iBufferLength <= 0 )
+   {
+      log_softerror_and_alarm("[Relay] Tried to send an empty radio packet (%d bytes) from relayed vehicle to controller.", iBufferLength);
+      return;
+   }
+
+   u8* pData = pBufferData;
+   int nLength = iBufferLength;
+   u32 uSourceVehicleId = 0;
+   bool bContainsPairConfirmation = false;
+
+   while ( nLength >= (int)sizeof(t_packet_header) )
+   {
+      t_packet_header* pPH = (t_packet_header*)pData;
+      if ( pPH->total_length < sizeof(t_packet_header) )
+         break;
+      if ( pPH->packet_type == PACKET_TYPE_RUBY_PAIRING_CONFIRMATION )
+         bContainsPairConfirmation = true;
+      uSourceVehicleId = pPH->vehicle_id_src;
+
+      nLength -= pPH->total_length;
+      pData += pPH->total_length;
+   }
+
+   _relay_send_packet_to_controller(pBufferData, iBufferLength, uSourceVehicleId, bContainsPairConfirmation);
 }
 
 void relay_send_single_packet_to_relayed_vehicle(u8* pBufferData, int iBufferLength)
@@ -461,47 +521,22 @@ void relay_send_single_packet_to_relayed_vehicle(u8* pBufferData, int iBufferLen
    }
    t_packet_header* pPH = (t_packet_header*)pBufferData;
 
-   u32 uRelayedVehicleId = pPH->vehicle_id_dest;
-   u32 uStreamId = (pPH->stream_packet_idx)>>PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX;
-   if ( uStreamId < 0 || uStreamId >= MAX_RADIO_STREAMS )
-      uStreamId = 0;
-
-   if ( uRelayedVehicleId != g_pCurrentModel->relay_params.uRelayedVehicleId )
-   {
+   if ( pPH->vehicle_id_dest != g_pCurrentModel->relay_params.uRelayedVehicleId )
       return;
-   }
+
+   _relay_check_update_tx_interfaces();
 
    // Send packet on all radio links to relayed vehicle
 
    bool bPacketSent = false;
 
-   for( int iRadioLinkId=0; iRadioLinkId<g_pCurrentModel->radioLinksParams.links_count; iRadioLinkId++ )
+   for( int i=0; i<s_RelayTxInterfacesToRelayedVehicle.iCount; i++ )
    {
-      if ( g_pCurrentModel->radioLinksParams.link_capabilities_flags[iRadioLinkId] & RADIO_HW_CAPABILITY_FLAG_DISABLED )
-         continue;
-
-      if ( ! (g_pCurrentModel->radioLinksParams.link_capabilities_flags[iRadioLinkId] & RADIO_HW_CAPABILITY_FLAG_USED_FOR_RELAY) )
-         continue;
-
-      if ( !(g_pCurrentModel->radioLinksParams.link_capabilities_flags[iRadioLinkId] & RADIO_HW_CAPABILITY_FLAG_CAN_TX) )
-         continue;
-
-      int iRadioInterfaceIndex = -1;
-      for( int k=0; k<g_pCurrentModel->radioInterfacesParams.interfaces_count; k++ )
-         if ( g_pCurrentModel->radioInterfacesParams.interface_link_id[k] == iRadioLinkId )
-         {
-            iRadioInterfaceIndex = k;
-            break;
-         }
-      if ( iRadioInterfaceIndex < 0 )
-         continue;
+      int iRadioLinkId = s_RelayTxInterfacesToRelayedVehicle.iRadioLinkId[i];
+      int iRadioInterfaceIndex = s_RelayTxInterfacesToRelayedVehicle.iRadioInterfaceIndex[i];
 
       radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(iRadioInterfaceIndex);
-      if ( ! pRadioHWInfo->openedForWrite )
-         continue;
-      if ( g_pCurrentModel->radioInterfacesParams.interface_capabilities_flags[iRadioInterfaceIndex] & RADIO_HW_CAPABILITY_FLAG_DISABLED )
-         continue;
-      if ( !(g_pCurrentModel->radioInterfacesParams.interface_capabilities_flags[iRadioInterfaceIndex] & RADIO_HW_CAPABILITY_FLAG_CAN_TX) )
+      if ( (NULL == pRadioHWInfo) || (! pRadioHWInfo->openedForWrite) )
          continue;
       
       int nRateTx = g_pCurrentModel->radioLinksParams.link_datarate_data_bps[iRadioLinkId];
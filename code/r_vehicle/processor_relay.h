@@ -10,6 +10,8 @@ void relay_on_relay_params_changed();
 void relay_on_relay_mode_changed(u8 uOldMode, u8 uNewMode);
 void relay_on_relay_flags_changed(u32 uNewFlags);
 void relay_on_relayed_vehicle_id_changed(u32 uNewVehicleId);
+// Call when the radio interfaces or links used for relaying change
+void relay_invalidate_tx_interfaces();
 
 u32 relay_get_time_last_received_ruby_telemetry_from_relayed_vehicle();
 
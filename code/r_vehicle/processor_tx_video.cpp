@@ -81,6 +81,8 @@ u8* p_fec_data_fecs[MAX_FECS_PACKETS_IN_BLOCK];
 
 t_packet_header s_CurrentPH;
 t_packet_header_video_full_77 s_CurrentPHVF;
+// Each video stream of the vehicle goes on its own radio stream (STREAM_ID_VIDEO_1 + video stream index)
+u32 s_uCurrentVideoStreamIndex = 0;
 
 bool s_bPauseVideoPacketsTX = false;
 bool s_bPendingEncodingSwitch = false;
@@ -129,6 +131,16 @@ int s_iCountRetransmissionsSegmentsInfo = 0;
 u32 s_listLastRetransmissionsRequestsTimes[MAX_HISTORY_RETRANSMISSION_INFO];
 int s_iCountLastRetransmissionsRequestsTimes = 0;
 
+// Keyframes forced on controller request (after unrecoverable video loss on the controller side)
+u32 s_uLastKeyframeRequestId = 0;
+u32 s_uTimeLastForcedKeyframe = 0;
+bool s_bForcedKeyframePendingOnCSI = false;
+
+// The first video packet of every DEFAULT_VIDEO_LATENCY_TRACE_BLOCKS_INTERVAL video blocks carries a latency trace
+bool s_bLatencyTraceCurrentPacket = false;
+u32 s_uLatencyTraceReadTimeMs = 0;
+u32 s_uLatencyTraceReadTimeMicros = 0;
+
 int ProcessorTxVideo::m_siInstancesCount = 0;
 
 bool process_data_tx_is_on_iframe()
@@ -201,18 +213,24 @@ bool ProcessorTxVideo::uninit()
 
 void ProcessorTxVideo::updateVideoStreamType()
 {
+   s_uCurrentVideoStreamIndex = (u32)m_iVideoStreamIndex;
    if ( g_pCurrentModel->video_params.uVideoExtraFlags & VIDEO_FLAG_GENERATE_H265 )
    {
-      s_CurrentPHVF.video_stream_and_type = 0 | (VIDEO_TYPE_H265<<4);
-      log_line("[VideoTx] Reinit as H265 stream");
+      s_CurrentPHVF.video_stream_and_type = (s_uCurrentVideoStreamIndex & 0x0F) | (VIDEO_TYPE_H265<<4);
+      log_line("[VideoTx] Reinit video stream %u as H265 stream", s_uCurrentVideoStreamIndex);
    }
    else
    {
-      s_CurrentPHVF.video_stream_and_type = 0 | (VIDEO_TYPE_H264<<4);
-      log_line("[VideoTx] Reinit as H264 stream");
+      s_CurrentPHVF.video_stream_and_type = (s_uCurrentVideoStreamIndex & 0x0F) | (VIDEO_TYPE_H264<<4);
+      log_line("[VideoTx] Reinit video stream %u as H264 stream", s_uCurrentVideoStreamIndex);
    }
 }
 
+int ProcessorTxVideo::getVideoStreamIndex()
+{
+   return m_iVideoStreamIndex;
+}
+
 // Returns bps
 u32 ProcessorTxVideo::getCurrentVideoBitrate()
 {
@@ -713,7 +731,7 @@ void _send_packet(int bufferIndex, int packetIndex, bool isRetransmitted, bool i
    pPH->stream_packet_idx = s_CurrentPH.stream_packet_idx;
    s_CurrentPH.stream_packet_idx++;
    s_CurrentPH.stream_packet_idx &= PACKET_FLAGS_MASK_STREAM_PACKET_IDX;
-   s_CurrentPH.stream_packet_idx |= (STREAM_ID_VIDEO_1) << PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX;
+   s_CurrentPH.stream_packet_idx |= (STREAM_ID_VIDEO_1 + s_uCurrentVideoStreamIndex) << PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX;
 
    pPHVF->uLastSetVideoBitrate = g_pProcessorTxVideo->getLastSetCaptureVideoBitrate();
    if ( isRetransmitted )
@@ -1053,6 +1071,21 @@ bool _onNewCompletePacketReadFromInput()
       pExtraDataU32[0] = pExtraDataU32[1] - s_uDebugLastAddedPacketTimestamp;
       s_uDebugLastAddedPacketTimestamp = pExtraDataU32[1];
    }
+
+   if ( s_bLatencyTraceCurrentPacket )
+   {
+      s_bLatencyTraceCurrentPacket = false;
+      pPHVF->uVideoStatusFlags2 |= VIDEO_STATUS_FLAGS2_HAS_LATENCY_TRACE;
+      pPH->total_length += sizeof(t_packet_video_latency_trace);
+      t_packet_video_latency_trace* pTrace = radio_packet_get_video_latency_trace(pPacketData);
+      if ( NULL != pTrace )
+      {
+         memset(pTrace, 0, sizeof(t_packet_video_latency_trace));
+         pTrace->uVehicleTimeReadMs = s_uLatencyTraceReadTimeMs;
+         pTrace->uVehicleTimeReadMicros = s_uLatencyTraceReadTimeMicros;
+         pTrace->uDeltaPacketized = radio_packet_latency_trace_delta(s_uLatencyTraceReadTimeMicros, get_current_timestamp_micros());
+      }
+   }
    // Go to next packet in the buffer
 
    s_currentReadBlockPacketIndex++;
@@ -1189,7 +1222,13 @@ bool process_data_tx_video_init()
 
    log_line("[VideoTx] Allocated %u Mb for video Tx buffers (%d blocks)", (u32)MAX_RXTX_BLOCKS_BUFFER * (u32)s_iCurrentMaxTxPacketsInAVideoBlock * (u32) MAX_PACKET_TOTAL_SIZE / 1000 / 1000, MAX_RXTX_BLOCKS_BUFFER );
 
-   radio_packet_init(&s_CurrentPH, PACKET_COMPONENT_VIDEO | PACKET_FLAGS_BIT_HEADERS_ONLY_CRC, PACKET_TYPE_VIDEO_DATA_FULL, STREAM_ID_VIDEO_1);
+   s_uCurrentVideoStreamIndex = 0;
+   if ( NULL != g_pProcessorTxVideo )
+      s_uCurrentVideoStreamIndex = (u32) g_pProcessorTxVideo->getVideoStreamIndex();
+   if ( s_uCurrentVideoStreamIndex >= MAX_VIDEO_STREAMS )
+      s_uCurrentVideoStreamIndex = 0;
+
+   radio_packet_init(&s_CurrentPH, PACKET_COMPONENT_VIDEO | PACKET_FLAGS_BIT_HEADERS_ONLY_CRC, PACKET_TYPE_VIDEO_DATA_FULL, STREAM_ID_VIDEO_1 + s_uCurrentVideoStreamIndex);
 
    s_CurrentPH.vehicle_id_src = g_pCurrentModel->uVehicleId;
    s_CurrentPH.vehicle_id_dest = 0;
@@ -1198,13 +1237,13 @@ bool process_data_tx_video_init()
 
    if ( g_pCurrentModel->video_params.uVideoExtraFlags & VIDEO_FLAG_GENERATE_H265 )
    {
-      s_CurrentPHVF.video_stream_and_type = 0 | (VIDEO_TYPE_H265<<4);
-      log_line("[VideoTx] Init as H265 stream");
+      s_CurrentPHVF.video_stream_and_type = (s_uCurrentVideoStreamIndex & 0x0F) | (VIDEO_TYPE_H265<<4);
+      log_line("[VideoTx] Init video stream %u as H265 stream", s_uCurrentVideoStreamIndex);
    }
    else
    {
-      s_CurrentPHVF.video_stream_and_type = 0 | (VIDEO_TYPE_H264<<4);
-      log_line("[VideoTx] Init as H264 stream");
+      s_CurrentPHVF.video_stream_and_type = (s_uCurrentVideoStreamIndex & 0x0F) | (VIDEO_TYPE_H264<<4);
+      log_line("[VideoTx] Init video stream %u as H264 stream", s_uCurrentVideoStreamIndex);
    }
 
    s_CurrentPHVF.video_keyframe_interval_ms = g_SM_VideoLinkStats.overwrites.uCurrentActiveKeyframeMs;
@@ -1540,6 +1579,8 @@ int process_data_tx_video_get_current_buffer_to_read_size()
    return s_BlocksTxBuffers[s_currentReadBufferIndex].video_data_length - s_BlocksTxBuffers[s_currentReadBufferIndex].packetsInfo[s_currentReadBlockPacketIndex].currentReadPosition;
 }
 
+void _send_keyframe_interval_to_video_source();
+
 void _parse_camera_source_h264_data(u8* pData, int iDataSize)
 {
    if ( (NULL == g_pCurrentModel) || (NULL == pData) || (iDataSize <= 0) )
@@ -1558,6 +1599,15 @@ void _parse_camera_source_h264_data(u8* pData, int iDataSize)
       g_iDebugShowKeyFramesAfterRelaySwitch--;
    }
 
+   // The forced keyframe was generated, go back to the regular keyframe interval
+   if ( s_bForcedKeyframePendingOnCSI )
+   if ( s_ParserH264CameraOutput.IsInsideIFrame() )
+   {
+      s_bForcedKeyframePendingOnCSI = false;
+      log_line("[KeyFrame] Forced keyframe generated in %u ms. Restore keyframe interval to %u ms.", g_TimeNow - s_uTimeLastForcedKeyframe, g_SM_VideoLinkStats.overwrites.uCurrentActiveKeyframeMs);
+      _send_keyframe_interval_to_video_source();
+   }
+
    u32 uLastFrameDuration = s_ParserH264CameraOutput.getTimeDurationOfLastCompleteFrame();
    if ( uLastFrameDuration > 127 )
       uLastFrameDuration = 127;
@@ -1619,7 +1669,11 @@ void _parse_camera_source_h264_data(u8* pData, int iDataSize)
    g_SM_VideoLinkStats.overwrites.uCurrentActiveKeyframeMs = g_SM_VideoLinkStats.overwrites.uCurrentPendingKeyframeMs;
    
    // Send the actual keyframe change to video source/capture
-   
+   _send_keyframe_interval_to_video_source();
+}
+
+void _send_keyframe_interval_to_video_source()
+{
    int iCurrentFPS = 30;
    if ( NULL != g_pCurrentModel )
      iCurrentFPS = g_pCurrentModel->video_link_profiles[g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile].fps;
@@ -1648,6 +1702,48 @@ void _parse_camera_source_h264_data(u8* pData, int iDataSize)
    }
 }
 
+// Returns true if a keyframe was requested from the video source
+bool process_data_tx_video_request_keyframe(u32 uRequestId, u32 uVideoStreamIndex)
+{
+   if ( (NULL == g_pCurrentModel) || (! g_pCurrentModel->hasCamera()) )
+      return false;
+   if ( uVideoStreamIndex != s_uCurrentVideoStreamIndex )
+      return false;
+
+   // Retries of the same request
+   if ( uRequestId == s_uLastKeyframeRequestId )
+      return false;
+   s_uLastKeyframeRequestId = uRequestId;
+
+   if ( (0 != s_uTimeLastForcedKeyframe) && (g_TimeNow < s_uTimeLastForcedKeyframe + DEFAULT_VIDEO_MIN_FORCED_KEYFRAME_INTERVAL) )
+   {
+      log_line("[KeyFrame] Controller requested a keyframe (request id %u), but one was forced %u ms ago. Ignore it.", uRequestId, g_TimeNow - s_uTimeLastForcedKeyframe);
+      return false;
+   }
+   if ( s_ParserH264CameraOutput.IsInsideIFrame() )
+      return false;
+
+   // The regular keyframe will be generated soon anyway
+   u32 uKeyframeMs = g_SM_VideoLinkStats.overwrites.uCurrentActiveKeyframeMs;
+   u32 uTimeLastIFrame = s_ParserH264CameraOutput.getStartTimeOfLastIFrame();
+   if ( (uKeyframeMs > 0) && (0 != uTimeLastIFrame) )
+   if ( g_TimeNow + DEFAULT_VIDEO_FORCED_KEYFRAME_MIN_GAIN >= uTimeLastIFrame + uKeyframeMs )
+      return false;
+
+   s_uTimeLastForcedKeyframe = g_TimeNow;
+   log_line("[KeyFrame] Controller requested a keyframe (request id %u), %u ms after the last one.", uRequestId, g_TimeNow - uTimeLastIFrame);
+
+   if ( g_pCurrentModel->isActiveCameraCSICompatible() || g_pCurrentModel->isActiveCameraVeye() )
+   {
+      // Keyframe on the next frame; the keyframe interval is restored once the keyframe is read from the camera
+      video_source_csi_send_control_message(RASPIVID_COMMAND_ID_KEYFRAME, 1);
+      s_bForcedKeyframePendingOnCSI = true;
+   }
+   if ( g_pCurrentModel->isActiveCameraOpenIPC() )
+      video_source_majestic_request_keyframe();
+   return true;
+}
+
 // Returns true if a complete block was read
 bool process_data_tx_video_on_new_data(u8* pData, int iDataSize)
 {
@@ -1671,6 +1767,17 @@ bool process_data_tx_video_on_new_data(u8* pData, int iDataSize)
       if ( iBytesToCopy > iBytesLeftInCurrentVideoPacket )
          iBytesToCopy = iBytesLeftInCurrentVideoPacket;
 
+      if ( 0 == s_BlocksTxBuffers[s_currentReadBufferIndex].packetsInfo[s_currentReadBlockPacketIndex].currentReadPosition )
+      if ( 0 == s_currentReadBlockPacketIndex )
+      {
+         s_bLatencyTraceCurrentPacket = ((s_CurrentPHVF.video_block_index % DEFAULT_VIDEO_LATENCY_TRACE_BLOCKS_INTERVAL) == 0);
+         if ( s_bLatencyTraceCurrentPacket )
+         {
+            s_uLatencyTraceReadTimeMs = g_TimeNow;
+            s_uLatencyTraceReadTimeMicros = get_current_timestamp_micros();
+         }
+      }
+
       memcpy(pVideoPacket, pData, iBytesToCopy);
       s_BlocksTxBuffers[s_currentReadBufferIndex].packetsInfo[s_currentReadBlockPacketIndex].currentReadPosition += iBytesToCopy;
 
@@ -22,6 +22,7 @@ class ProcessorTxVideo
       bool uninit();
       
       void updateVideoStreamType();
+      int getVideoStreamIndex();
 
       void periodicLoop();
 
@@ -70,6 +71,8 @@ bool process_data_tx_video_loop();
 u8* process_data_tx_video_get_current_buffer_to_read_pointer();
 int process_data_tx_video_get_current_buffer_to_read_size();
 bool process_data_tx_video_on_new_data(u8* pData, int iDataSize);
+// Generates a keyframe (IDR) as soon as possible, if not done recently. Returns true if a keyframe was requested.
+bool process_data_tx_video_request_keyframe(u32 uRequestId, u32 uVideoStreamIndex);
 
 bool process_data_tx_is_on_iframe();
 int process_data_tx_video_has_packets_ready_to_send();
@@ -39,6 +39,7 @@
 #include "../radio/radio_tx.h"
 #include "shared_vars.h"
 #include "timers.h"
+#include "processor_relay.h"
 
 
 int radio_links_open_rxtx_radio_interfaces()
@@ -258,6 +259,7 @@ int radio_links_open_rxtx_radio_interfaces()
    log_line("OPENING INTERFACES END ============================================================");
 
    g_pCurrentModel->logVehicleRadioInfo();
+   relay_invalidate_tx_interfaces();
 
    log_line("Initializing video data tx...");
    if ( ! process_data_tx_video_init() )
@@ -84,6 +84,7 @@
 #include "../radio/radiopacketsqueue.h"
 #include "../radio/radio_rx.h"
 #include "../radio/radio_tx.h"
+#include "../radio/radio_tx_aggregator.h"
 #include "../radio/radio_duplicate_det.h"
 #include "../radio/fec.h" 
 #include "packets_utils.h"
@@ -131,6 +132,8 @@ extern u32 s_uLastAlarmsCount;
 
 u32 s_uTimeLastTryReadIPCMessages = 0;
 
+t_radio_tx_aggregator s_RadioTxAggregator;
+
 #define MAX_RADIO_PACKETS_TO_CACHE_LOCALLY 20
 type_received_radio_packet s_ReceivedRadioPacketsBuffer[MAX_RADIO_PACKETS_TO_CACHE_LOCALLY];
 
@@ -633,6 +636,8 @@ void send_model_settings_to_controller()
       g_pProcessStats->lastActiveTime = get_current_timestamp_ms();
 }
 
+void _send_radio_packet(u8* pPacketBuffer, int iPacketLength);
+
 void _inject_video_link_dev_stats_packet()
 {
    t_packet_header PH;
@@ -644,8 +649,8 @@ void _inject_video_link_dev_stats_packet()
    memcpy(packet, (u8*)&PH, sizeof(t_packet_header));
    memcpy(packet+sizeof(t_packet_header), &g_SM_VideoLinkStats, sizeof(shared_mem_video_link_stats_and_overwrites));
 
-   // Add it to the start of the queue, so it's extracted (poped) next
-   packets_queue_inject_packet_first(&g_QueueRadioPacketsOut, packet);
+   // Goes out right after the telemetry packet that triggered it, behind any pending aggregated packets
+   _send_radio_packet(packet, PH.total_length);
 }
 
 void _inject_video_link_dev_graphs_packet()
@@ -659,8 +664,8 @@ void _inject_video_link_dev_graphs_packet()
    memcpy(packet, (u8*)&PH, sizeof(t_packet_header));
    memcpy(packet+sizeof(t_packet_header), &g_SM_VideoLinkGraphs, sizeof(shared_mem_video_link_graphs));
 
-   // Add it to the start of the queue, so it's extracted (poped) next
-   packets_queue_inject_packet_first(&g_QueueRadioPacketsOut, packet);
+   // Goes out right after the telemetry packet that triggered it, behind any pending aggregated packets
+   _send_radio_packet(packet, PH.total_length);
 }
 
 void _read_ipc_pipes(u32 uTimeNow)
@@ -753,125 +758,58 @@ void _consume_ipc_messages()
       log_softerror_and_alarm("Consuming %d IPC messages took too long: %d ms", 20 - iMaxToConsume, uTime - uTimeStart);
 }
 
-void _process_and_send_packets_individually()
+// Data rate of the data packets on the slowest radio interface, the aggregated frames must fit its airtime budget
+void _update_radio_tx_aggregator_datarate()
 {
-   bool bMustInjectVideoDevStats = false;
-   bool bMustInjectVideoDevGraphs = false;
-   
-   while ( packets_queue_has_packets(&g_QueueRadioPacketsOut) )
+   int iMinDataRate = 0;
+   u32 uMinRealDataRate = MAX_U32;
+   for( int i=0; i<hardware_get_radio_interfaces_count(); i++ )
    {
-      u32 uTime = get_current_timestamp_ms();
-      if ( (0 != s_uTimeLastTryReadIPCMessages) && (uTime > s_uTimeLastTryReadIPCMessages + 500) )
+      int iDataRate = get_last_tx_used_datarate_bps_data(i);
+      if ( (0 == iDataRate) || hardware_radio_index_is_serial_radio(i) )
+         continue;
+      u32 uRealDataRate = getRealDataRateFromRadioDataRate(iDataRate, 0);
+      if ( uRealDataRate < uMinRealDataRate )
       {
-         log_softerror_and_alarm("Too much time since last ipc messages read (%u ms) while sending radio packets, read ipc messages.", uTime - s_uTimeLastTryReadIPCMessages);
-         _read_ipc_pipes(uTime);
+         uMinRealDataRate = uRealDataRate;
+         iMinDataRate = iDataRate;
       }
+   }
+   radio_tx_aggregator_set_datarate(&s_RadioTxAggregator, iMinDataRate);
+}
 
-      int iPacketLength = -1;
-      u8* pPacketBuffer = packets_queue_pop_packet(&g_QueueRadioPacketsOut, &iPacketLength);
-      if ( NULL == pPacketBuffer || -1 == iPacketLength )
-         break;
-
-      if ( NULL != g_pProcessStats )
-         g_pProcessStats->lastIPCIncomingTime = g_TimeNow;
-
-      bMustInjectVideoDevStats = false;
-      bMustInjectVideoDevGraphs = false;
-
-      t_packet_header* pPH = (t_packet_header*)pPacketBuffer;
-      pPH->packet_flags &= (~PACKET_FLAGS_BIT_CAN_START_TX);
+void _send_aggregated_radio_packets()
+{
+   if ( ! radio_tx_aggregator_has_packets(&s_RadioTxAggregator) )
+      return;
+   send_packet_to_radio_interfaces(s_RadioTxAggregator.uBuffer, s_RadioTxAggregator.iLength, -1);
+   radio_tx_aggregator_on_frame_sent(&s_RadioTxAggregator);
+}
 
-      if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_TELEMETRY )
+// Small packets are added to the pending aggregated frame; any other packet is sent
+// after the pending aggregated frame, to keep the packets order
+void _send_radio_packet(u8* pPacketBuffer, int iPacketLength)
+{
+   if ( radio_tx_aggregator_can_aggregate_packet(pPacketBuffer, iPacketLength) )
+   {
+      if ( ! radio_tx_aggregator_add_packet(&s_RadioTxAggregator, pPacketBuffer, iPacketLength) )
       {
-         //log_line("DBG send telem to radio");
-         // Update Ruby telemetry info if we are sending Ruby telemetry to controller
-         // Update also the telemetry extended extra info: retransmissions info
-
-         if ( pPH->packet_type == PACKET_TYPE_DEBUG_INFO )
-         {
-            type_u32_couters* pCounters = (type_u32_couters*) (pPacketBuffer + sizeof(t_packet_header));
-            memcpy(pCounters, &g_CoutersMainLoop, sizeof(type_u32_couters));
-
-            type_radio_tx_timers* pRadioTxInfo = (type_radio_tx_timers*) (pPacketBuffer + sizeof(t_packet_header) + sizeof(type_u32_couters));
-            memcpy(pRadioTxInfo, &g_RadioTxTimers, sizeof(type_radio_tx_timers));
-         }
-
-         if ( pPH->packet_type == PACKET_TYPE_RUBY_TELEMETRY_EXTENDED )
-         {
-            if ( (NULL != g_pCurrentModel) && (g_pCurrentModel->uDeveloperFlags & DEVELOPER_FLAGS_BIT_ENABLE_VIDEO_LINK_STATS) )
-               bMustInjectVideoDevStats = true;
-            if ( (NULL != g_pCurrentModel) && (g_pCurrentModel->osd_params.osd_flags2[g_pCurrentModel->osd_params.layout] & OSD_FLAG2_SHOW_ADAPTIVE_VIDEO_GRAPH) )
-               bMustInjectVideoDevStats = true;
-            if ( (NULL != g_pCurrentModel) && (g_pCurrentModel->uDeveloperFlags & DEVELOPER_FLAGS_BIT_ENABLE_VIDEO_LINK_GRAPHS) )
-               bMustInjectVideoDevGraphs = true;
-
-            t_packet_header_ruby_telemetry_extended_v3* pPHRTE = (t_packet_header_ruby_telemetry_extended_v3*) (pPacketBuffer + sizeof(t_packet_header));
-            pPHRTE->downlink_tx_video_bitrate_bps = g_pProcessorTxVideo->getCurrentVideoBitrateAverageLastMs(500);
-            pPHRTE->downlink_tx_video_all_bitrate_bps = g_pProcessorTxVideo->getCurrentTotalVideoBitrateAverageLastMs(500);
-            if ( NULL != g_pProcessorTxAudio )
-            {
-               pPHRTE->downlink_tx_data_bitrate_bps += g_pProcessorTxAudio->getAverageAudioInputBps();
-               pPHRTE->downlink_tx_video_all_bitrate_bps += g_pProcessorTxAudio->getAverageAudioInputBps();
-            }
-            pPHRTE->downlink_tx_data_bitrate_bps = 0;
-
-            pPHRTE->downlink_tx_video_packets_per_sec = s_countTXVideoPacketsOutPerSec[0] + s_countTXVideoPacketsOutPerSec[1];
-            pPHRTE->downlink_tx_data_packets_per_sec = s_countTXDataPacketsOutPerSec[0] + s_countTXDataPacketsOutPerSec[1];
-            pPHRTE->downlink_tx_compacted_packets_per_sec = s_countTXCompactedPacketsOutPerSec[0] + s_countTXCompactedPacketsOutPerSec[1];
-
-            for( int i=0; i<hardware_get_radio_interfaces_count(); i++ )
-            {
-               // positive: regular datarates, negative: mcs rates;
-               pPHRTE->last_sent_datarate_bps[i][0] = get_last_tx_used_datarate_bps_video(i);
-               pPHRTE->last_sent_datarate_bps[i][1] = get_last_tx_used_datarate_bps_data(i);
-               //log_line("DBG set last sent data rates for %d: %d / %d", i, pPHRTE->last_sent_datarate_bps[i][0], pPHRTE->last_sent_datarate_bps[i][1]);
-
-               pPHRTE->last_recv_datarate_bps[i] = g_UplinkInfoRxStats[i].lastReceivedDataRate;
-               //log_line("DBG set last recv data rate for %d: %d", i, pPHRTE->last_recv_datarate_bps[i]);
-                 
-               pPHRTE->uplink_rssi_dbm[i] = g_UplinkInfoRxStats[i].lastReceivedDBM + 200;
-               pPHRTE->uplink_link_quality[i] = g_SM_RadioStats.radio_interfaces[i].rxQuality;
-            }
-
-            pPHRTE->txTimePerSec = g_RadioTxTimers.uComputedTotalTxTimeMilisecPerSecondAverage;
-
-            // Update extra info: retransmissions
-            
-            if ( pPHRTE->extraSize > 0 )
-            if ( pPHRTE->extraSize == sizeof(t_packet_header_ruby_telemetry_extended_extra_info_retransmissions) )
-            if ( pPH->total_length == (sizeof(t_packet_header) + sizeof(t_packet_header_ruby_telemetry_extended_v3) + sizeof(t_packet_header_ruby_telemetry_extended_extra_info_retransmissions)) )
-            {
-                memcpy( pPacketBuffer + sizeof(t_packet_header) + sizeof(t_packet_header_ruby_telemetry_extended_v3), (u8*)&g_PHTE_Retransmissions, sizeof(g_PHTE_Retransmissions));
-            }
-         }
+         _send_aggregated_radio_packets();
+         radio_tx_aggregator_add_packet(&s_RadioTxAggregator, pPacketBuffer, iPacketLength);
       }
-      send_packet_to_radio_interfaces(pPacketBuffer, iPacketLength, -1);
-      
-      if ( bMustInjectVideoDevStats )
-         _inject_video_link_dev_stats_packet();
-      if ( bMustInjectVideoDevGraphs )
-         _inject_video_link_dev_graphs_packet();
+      return;
    }
+   _send_aggregated_radio_packets();
+   send_packet_to_radio_interfaces(pPacketBuffer, iPacketLength, -1);
 }
 
+// Small packets pending at the same time are sent together in a single radio frame
 void process_and_send_packets()
 {
-   #ifndef FEATURE_CONCATENATE_SMALL_RADIO_PACKETS
-   _process_and_send_packets_individually();
-   return;
-   #endif
-
-   /*
-   u8 composed_packet[MAX_PACKET_TOTAL_SIZE];
-   int composed_packet_length = 0;
    bool bMustInjectVideoDevStats = false;
    bool bMustInjectVideoDevGraphs = false;
    
-   #ifdef FEATURE_CONCATENATE_SMALL_RADIO_PACKETS
-   bool bLastHasHighCapacityFlag = false;
-   bool bLastHasLowCapacityFlag = false;
-   u32 uLastPacketType = 0;
-   #endif
+   _update_radio_tx_aggregator_datarate();
 
    while ( packets_queue_has_packets(&g_QueueRadioPacketsOut) )
    {
@@ -896,34 +834,6 @@ void process_and_send_packets()
       t_packet_header* pPH = (t_packet_header*)pPacketBuffer;
       pPH->packet_flags &= (~PACKET_FLAGS_BIT_CAN_START_TX);
 
-      #ifdef FEATURE_CONCATENATE_SMALL_RADIO_PACKETS
-
-      bool bHasHighCapacityFlag = false;
-      bool bHasLowCapacityFlag = false;
-      if ( pPH->packet_flags_extended & PACKET_FLAGS_EXTENDED_BIT_SEND_ON_HIGH_CAPACITY_LINK_ONLY )
-         bHasHighCapacityFlag = true;
-      if ( pPH->packet_flags_extended & PACKET_FLAGS_EXTENDED_BIT_SEND_ON_LOW_CAPACITY_LINK_ONLY )
-         bHasLowCapacityFlag = true;
-
-      if ( ( bLastHasLowCapacityFlag != bHasLowCapacityFlag ) ||
-           ( bLastHasHighCapacityFlag != bHasHighCapacityFlag ) ||
-           (composed_packet_length + iPacketLength > MAX_PACKET_PAYLOAD) ||
-           (pPH->packet_type == PACKET_TYPE_RUBY_PING_CLOCK_REPLY) ||
-           (uLastPacketType == PACKET_TYPE_RUBY_PING_CLOCK_REPLY) ||
-           (pPH->packet_type == PACKET_TYPE_RUBY_MODEL_SETTINGS) ||
-           (uLastPacketType == PACKET_TYPE_RUBY_MODEL_SETTINGS) ||
-           (pPH->packet_type == PACKET_TYPE_COMMAND_RESPONSE) ||
-           (uLastPacketType == PACKET_TYPE_COMMAND_RESPONSE) )
-      if ( composed_packet_length > 0 )
-      {
-         send_packet_to_radio_interfaces(composed_packet, composed_packet_length, -1);
-         composed_packet_length = 0;
-      }
-
-      bLastHasHighCapacityFlag = bHasHighCapacityFlag;
-      bLastHasLowCapacityFlag = bHasLowCapacityFlag;
-      #endif
-
       if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_TELEMETRY )
       {
          //log_line("DBG send telem to radio");
@@ -988,39 +898,14 @@ void process_and_send_packets()
             }
          }
       }
- 
-      #ifdef FEATURE_CONCATENATE_SMALL_RADIO_PACKETS
-
-      uLastPacketType = pPH->packet_type;
-
-      memcpy(&composed_packet[composed_packet_length], pPacketBuffer, iPacketLength);
-      composed_packet_length += iPacketLength;
-      
-      if ( bHasLowCapacityFlag )
-      {
-         send_packet_to_radio_interfaces(composed_packet, composed_packet_length, -1);
-         composed_packet_length = 0;
-         continue;
-      }
-
-      #else
-
-      send_packet_to_radio_interfaces(pPacketBuffer, iPacketLength, -1);
-      composed_packet_length = 0;
-      
-      #endif
+      _send_radio_packet(pPacketBuffer, iPacketLength);
 
       if ( bMustInjectVideoDevStats )
          _inject_video_link_dev_stats_packet();
       if ( bMustInjectVideoDevGraphs )
          _inject_video_link_dev_graphs_packet();
    }
-
-   if ( composed_packet_length > 0 )
-   {
-      send_packet_to_radio_interfaces(composed_packet, composed_packet_length, -1);
-   }
-   */
+   _send_aggregated_radio_packets();
 }
 
 void _synchronize_shared_mems()
@@ -1597,6 +1482,7 @@ int main(int argc, char *argv[])
 
    packets_queue_init(&g_QueueRadioPacketsOut);
    packets_queue_init(&s_QueueControlPackets);
+   radio_tx_aggregator_init(&s_RadioTxAggregator, MAX_PACKET_PAYLOAD);
 
    for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
    {
@@ -1685,9 +1571,6 @@ int main(int argc, char *argv[])
 
    log_line("Start sequence: Done creating audio processor.");
 
-   for( int i=0; i<MAX_RADIO_PACKETS_TO_CACHE_LOCALLY; i++ )
-      s_ReceivedRadioPacketsBuffer[i].pPacketData = (u8*)malloc(MAX_PACKET_TOTAL_SIZE);
-
    radio_duplicate_detection_init();
    radio_rx_start_rx_thread(&g_SM_RadioStats, NULL, 0, g_pCurrentModel->getVehicleFirmwareType());
    
@@ -1876,7 +1759,7 @@ void _main_loop()
       if ( iCountRadioRxPacketsToConsume >= MAX_RADIO_PACKETS_TO_CACHE_LOCALLY-2 )
          iCountRadioRxPacketsToConsume = MAX_RADIO_PACKETS_TO_CACHE_LOCALLY-2;
 
-      iCountRadioRxPacketsToProcess = radio_rx_get_received_packets(iCountRadioRxPacketsToConsume, s_ReceivedRadioPacketsBuffer);
+      iCountRadioRxPacketsToProcess = radio_rx_get_received_packets_buffers(iCountRadioRxPacketsToConsume, s_ReceivedRadioPacketsBuffer);
 
       for( int i=0; i<iCountRadioRxPacketsToProcess; i++ )
       {
@@ -1976,6 +1859,7 @@ void _main_loop()
             _read_ipc_pipes(uTime);
          }
       }
+      radio_rx_release_received_packets(s_ReceivedRadioPacketsBuffer, iCountRadioRxPacketsToProcess);
    }
 
    // Check Radio Rx state
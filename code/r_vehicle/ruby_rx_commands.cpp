@@ -47,6 +47,7 @@
 #include "../base/ruby_ipc.h"
 #include "../base/core_plugins_settings.h"
 #include "../base/vehicle_settings.h"
+#include "../base/file_transfer.h"
 #include "../common/string_utils.h"
 #include "../common/relay_utils.h"
 
@@ -117,6 +118,12 @@ typedef struct
 
 t_structure_file_upload_info s_InfoLastFileUploaded;
 
+// Windowed file transfers: one download (sender) and one upload (receiver) at a time
+static t_file_transfer_sender s_FileTransferSender;
+static u32 s_uFileTransferSenderFileId = 0;
+static t_file_transfer_receiver s_FileTransferReceiver;
+static u32 s_uFileTransferReceiverFileId = 0;
+
 
 u8 s_bufferModelSettings[2048];
 int s_bufferModelSettingsLength = 0;
@@ -631,6 +638,11 @@ bool _process_file_download_request( u8* pBuffer, int length)
       }
       else
       {
+         if ( s_uFileTransferSenderFileId == uFileId )
+         {
+            file_transfer_sender_close(&s_FileTransferSender);
+            s_uFileTransferSenderFileId = 0;
+         }
          char szComm[256];
          sprintf(szComm, "rm -rf %s/logs.zip", FOLDER_RUBY_TEMP);
          hw_execute_bash_command(szComm, NULL);
@@ -684,6 +696,21 @@ bool _process_file_segment_download_request( u8* pBuffer, int length)
    return true;
 }
 
+void _process_received_core_plugins_archive()
+{
+   char szComm[128];
+   char szOutput[4096];
+   sprintf(szComm, "chmod 777 %s/core_plugins.zip 2>&1", FOLDER_RUBY_TEMP);
+   hw_execute_bash_command(szComm, NULL);
+   hardware_sleep_ms(100);
+   sprintf(szComm, "unzip %s/core_plugins.zip -d %s 2>&1", FOLDER_RUBY_TEMP, FOLDER_CORE_PLUGINS);
+   hw_execute_bash_command(szComm, szOutput);
+   log_line("Result: [%s]", szOutput);
+   sprintf(szComm, "chmod 777 %s/*", FOLDER_CORE_PLUGINS);
+   hw_execute_bash_command(szComm, NULL);
+   log_line("Finised processing core plugins archive.");
+}
+
 void _process_received_uploaded_file()
 {
    if ( s_InfoLastFileUploaded.uLastFileId == FILE_ID_CORE_PLUGINS_ARCHIVE )
@@ -714,16 +741,7 @@ void _process_received_uploaded_file()
 
       fflush(fd);
       fclose(fd);
-      char szOutput[4096];
-      sprintf(szComm, "chmod 777 %s/core_plugins.zip 2>&1", FOLDER_RUBY_TEMP);
-      hw_execute_bash_command(szComm, NULL);
-      hardware_sleep_ms(100);
-      sprintf(szComm, "unzip %s/core_plugins.zip -d %s 2>&1", FOLDER_RUBY_TEMP, FOLDER_CORE_PLUGINS);
-      hw_execute_bash_command(szComm, szOutput);
-      log_line("Result: [%s]", szOutput);
-      sprintf(szComm, "chmod 777 %s/*", FOLDER_CORE_PLUGINS);
-      hw_execute_bash_command(szComm, NULL);
-      log_line("Finised processing core plugins archive.");
+      _process_received_core_plugins_archive();
    }
 }
 
@@ -825,6 +843,108 @@ bool _process_file_segment_upload_request( u8* pBuffer, int length)
 }
 
 
+int _file_transfer_send_segment_as_reply(void* pContext, u8* pData, int iLength)
+{
+   setCommandReplyBuffer(pData, iLength);
+   sendCommandReply(COMMAND_RESPONSE_FLAGS_OK, 0, 0);
+   return iLength;
+}
+
+// Each ack from the controller is answered with the segments the window allows (zero or more responses)
+bool _process_file_transfer_ack( u8* pBuffer, int length)
+{
+   t_packet_header_command* pPHC = (t_packet_header_command*)(pBuffer + sizeof(t_packet_header));
+   u32 uFileId = pPHC->command_param;
+   if ( length < (int)(sizeof(t_packet_header) + sizeof(t_packet_header_command) + sizeof(t_file_transfer_ack)) )
+      return true;
+
+   t_file_transfer_ack ack;
+   memcpy((u8*)&ack, pBuffer + sizeof(t_packet_header) + sizeof(t_packet_header_command), sizeof(t_file_transfer_ack));
+
+   lastRecvCommandType &= ~COMMAND_TYPE_FLAG_NO_RESPONSE_NEEDED;
+
+   if ( s_uFileTransferSenderFileId != uFileId )
+   {
+      if ( 0 != s_uFileTransferSenderFileId )
+         file_transfer_sender_close(&s_FileTransferSender);
+      s_uFileTransferSenderFileId = 0;
+
+      char szFile[MAX_FILE_PATH_SIZE];
+      szFile[0] = 0;
+      if ( (uFileId == FILE_ID_VEHICLE_LOGS_ARCHIVE) && (! hw_process_exists("zip")) )
+      {
+         strcpy(szFile, FOLDER_RUBY_TEMP);
+         strcat(szFile, "logs.zip");
+      }
+      if ( (0 == szFile[0]) || (0 != file_transfer_sender_open_file(&s_FileTransferSender, 0, szFile, FILE_TRANSFER_DEFAULT_SEGMENT_SIZE, FILE_TRANSFER_DEFAULT_FEC_GROUP, _file_transfer_send_segment_as_reply, NULL)) )
+      {
+         log_softerror_and_alarm("Can't start transfer of file id %u.", uFileId);
+         sendCommandReply(COMMAND_RESPONSE_FLAGS_FAILED, 0, 0);
+         return true;
+      }
+      s_uFileTransferSenderFileId = uFileId;
+   }
+
+   file_transfer_sender_on_ack(&s_FileTransferSender, &ack, g_TimeNow);
+   file_transfer_sender_send(&s_FileTransferSender, g_TimeNow);
+
+   if ( file_transfer_sender_is_complete(&s_FileTransferSender) || s_FileTransferSender.iAborted )
+   {
+      file_transfer_sender_close(&s_FileTransferSender);
+      s_uFileTransferSenderFileId = 0;
+   }
+   return true;
+}
+
+// Each file segment from the controller is answered with an ack
+bool _process_file_transfer_segment( u8* pBuffer, int length)
+{
+   t_packet_header_command* pPHC = (t_packet_header_command*)(pBuffer + sizeof(t_packet_header));
+   u32 uFileId = pPHC->command_param;
+   u8* pData = pBuffer + sizeof(t_packet_header) + sizeof(t_packet_header_command);
+   int iDataLength = length - sizeof(t_packet_header) - sizeof(t_packet_header_command);
+
+   lastRecvCommandType &= ~COMMAND_TYPE_FLAG_NO_RESPONSE_NEEDED;
+
+   t_file_transfer_ack ack;
+   if ( s_uFileTransferReceiverFileId != uFileId )
+   {
+      if ( 0 != s_uFileTransferReceiverFileId )
+         file_transfer_receiver_close(&s_FileTransferReceiver);
+      s_uFileTransferReceiverFileId = 0;
+
+      if ( uFileId != FILE_ID_CORE_PLUGINS_ARCHIVE )
+      {
+         log_softerror_and_alarm("Received upload of unsupported file id %u.", uFileId);
+         memset((u8*)&ack, 0, sizeof(t_file_transfer_ack));
+         if ( iDataLength >= (int)sizeof(t_file_transfer_segment_header) )
+            ack.uTransferId = ((t_file_transfer_segment_header*)pData)->uTransferId;
+         ack.uFlags = FILE_TRANSFER_ACK_FLAG_ABORT;
+         setCommandReplyBuffer((u8*)&ack, sizeof(t_file_transfer_ack));
+         sendCommandReply(COMMAND_RESPONSE_FLAGS_OK, 0, 0);
+         return true;
+      }
+      char szFile[MAX_FILE_PATH_SIZE];
+      strcpy(szFile, FOLDER_RUBY_TEMP);
+      strcat(szFile, "core_plugins.zip");
+      file_transfer_receiver_open(&s_FileTransferReceiver, 0, szFile, FILE_TRANSFER_DEFAULT_WINDOW);
+      s_uFileTransferReceiverFileId = uFileId;
+   }
+
+   int iRes = file_transfer_receiver_on_segment(&s_FileTransferReceiver, pData, iDataLength);
+   file_transfer_receiver_get_ack(&s_FileTransferReceiver, &ack);
+   setCommandReplyBuffer((u8*)&ack, sizeof(t_file_transfer_ack));
+   sendCommandReply(COMMAND_RESPONSE_FLAGS_OK, 0, 0);
+
+   if ( (1 == iRes) && file_transfer_receiver_is_complete(&s_FileTransferReceiver) )
+   {
+      log_line("Received entire uploaded file id %u, %u bytes", uFileId, s_FileTransferReceiver.uFileSize);
+      if ( uFileId == FILE_ID_CORE_PLUGINS_ARCHIVE )
+         _process_received_core_plugins_archive();
+   }
+   return true;
+}
+
 // returns true if it knows about the command, false if it's an unknown command
 
 bool process_command(u8* pBuffer, int length)
@@ -918,6 +1038,16 @@ bool process_command(u8* pBuffer, int length)
       return _process_file_segment_upload_request( pBuffer, length);    
    }
 
+   if ( uCommandType == COMMAND_ID_FILE_TRANSFER_ACK )
+   {
+      return _process_file_transfer_ack( pBuffer, length);
+   }
+
+   if ( uCommandType == COMMAND_ID_FILE_TRANSFER_SEGMENT )
+   {
+      return _process_file_transfer_segment( pBuffer, length);
+   }
+
    if ( uCommandType == COMMAND_ID_CLEAR_LOGS )
    {
       sendCommandReply(COMMAND_RESPONSE_FLAGS_OK, 0, 0);
@@ -3967,6 +4097,12 @@ int r_start_commands_rx(int argc, char* argv[])
    }
 
    log_line("Stopping...");
+
+   // Keeps the state of a partial upload, so it's resumed later
+   if ( 0 != s_uFileTransferReceiverFileId )
+      file_transfer_receiver_close(&s_FileTransferReceiver);
+   if ( 0 != s_uFileTransferSenderFileId )
+      file_transfer_sender_close(&s_FileTransferSender);
    
    ruby_close_ipc_channel(s_fIPCFromRouter);
    ruby_close_ipc_channel(s_fIPCToRouter);
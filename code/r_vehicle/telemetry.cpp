@@ -37,6 +37,7 @@
 #include "timers.h"
 #include "../base/ruby_ipc.h"
 #include "../base/parse_fc_telemetry.h"
+#include "../base/telemetry_framer.h"
 #include "../radio/radiopackets2.h"
 #include "../common/string_utils.h"
 
@@ -51,7 +52,10 @@ int s_iCurrentTelemetrySerialPortSpeed = DEFAULT_FC_TELEMETRY_SERIAL_SPEED;
 int s_iTelemetrySerialPortFile = -1;
 u32 s_uTimeSerialPortOpened = 0;
 
-u8 s_uTelemetrySerialInBuffer[1024];
+// FC serial data is framed in place; decoded messages are dispatched by message id
+t_telemetry_framer s_TelemetryFramerFC;
+int s_iTelemetryFramerFCType = -1;
+bool s_bTelemetryFramerFCNewMessage = false;
 u32 s_uRawTelemetryDownloadTotalReadFromSerial = 0;
 int s_iFCSerialTelemetryReadBytesTempLastSecond = 0;
 int s_iFCSerialTelemetryReadBytesPerSecond = 0;
@@ -354,6 +358,58 @@ void _telemetry_addSerialDataToFCTelemetryBuffer(u8* pData, int dataLength)
    }
 }
 
+static void _telemetry_on_fc_mavlink_frame(void* pContext, u32 uMessageId, const u8* pFrame, int iFrameLength)
+{
+   if ( telemetry_mavlink_on_new_frame(pFrame, iFrameLength) )
+      s_bTelemetryFramerFCNewMessage = true;
+}
+
+// MAVLink messages that are not used are not decoded, they only mark the FC telemetry as alive
+static void _telemetry_on_fc_mavlink_other_frame(void* pContext, u32 uMessageId, const u8* pFrame, int iFrameLength)
+{
+   set_time_last_mavlink_message_from_fc(g_TimeNow);
+   s_bTelemetryFramerFCNewMessage = true;
+}
+
+static void _telemetry_on_fc_ltm_frame(void* pContext, u32 uMessageId, const u8* pFrame, int iFrameLength)
+{
+   if ( telemetry_mavlink_on_new_serial_data((u8*)pFrame, iFrameLength) )
+      s_bTelemetryFramerFCNewMessage = true;
+}
+
+static void _telemetry_on_fc_msp_frame(void* pContext, u32 uMessageId, const u8* pFrame, int iFrameLength)
+{
+   if ( telemetry_msp_on_new_serial_data((u8*)pFrame, iFrameLength) )
+      s_bTelemetryFramerFCNewMessage = true;
+}
+
+static void _telemetry_setup_framer(int iTelemetryType)
+{
+   s_iTelemetryFramerFCType = iTelemetryType;
+   if ( iTelemetryType == TELEMETRY_TYPE_MAVLINK )
+   {
+      telemetry_framer_init(&s_TelemetryFramerFC, TELEMETRY_FRAMER_PROTOCOL_MAVLINK, 1, NULL);
+      const u32* pMessageIds = NULL;
+      int iCount = parse_telemetry_get_used_mavlink_messages(&pMessageIds);
+      for( int i=0; i<iCount; i++ )
+         telemetry_framer_set_handler(&s_TelemetryFramerFC, pMessageIds[i], _telemetry_on_fc_mavlink_frame);
+      telemetry_framer_set_default_handler(&s_TelemetryFramerFC, _telemetry_on_fc_mavlink_other_frame);
+   }
+   else if ( iTelemetryType == TELEMETRY_TYPE_LTM )
+   {
+      telemetry_framer_init(&s_TelemetryFramerFC, TELEMETRY_FRAMER_PROTOCOL_LTM, 1, NULL);
+      telemetry_framer_set_default_handler(&s_TelemetryFramerFC, _telemetry_on_fc_ltm_frame);
+   }
+   else if ( iTelemetryType == TELEMETRY_TYPE_MSP )
+   {
+      telemetry_framer_init(&s_TelemetryFramerFC, TELEMETRY_FRAMER_PROTOCOL_MSP, 1, NULL);
+      telemetry_framer_set_default_handler(&s_TelemetryFramerFC, _telemetry_on_fc_msp_frame);
+   }
+   else
+      telemetry_framer_init(&s_TelemetryFramerFC, TELEMETRY_FRAMER_PROTOCOL_RAW, 1, NULL);
+   log_line("[Telem] Setup FC telemetry framer for telemetry type %d", iTelemetryType);
+}
+
 int telemetry_try_read_serial_port()
 {
    if ( NULL == g_pCurrentModel )
@@ -364,39 +420,40 @@ int telemetry_try_read_serial_port()
    if ( s_iTelemetrySerialPortFile < 0 )
       return -1;
 
-   struct timeval to;
-   to.tv_sec = 0;
-   to.tv_usec = 2000; // 2 ms
+   if ( s_iTelemetryFramerFCType != (int)g_pCurrentModel->telemetry_params.fc_telemetry_type )
+      _telemetry_setup_framer((int)g_pCurrentModel->telemetry_params.fc_telemetry_type);
+   telemetry_framer_set_fd(&s_TelemetryFramerFC, s_iTelemetrySerialPortFile);
 
-   fd_set readset;   
-   FD_ZERO(&readset);
-   FD_SET(s_iTelemetrySerialPortFile, &readset);
-   
-   int res = select(s_iTelemetrySerialPortFile+1, &readset, NULL, NULL, &to);
-   if ( res <= 0 )
-      return 0;
-   if ( ! FD_ISSET(s_iTelemetrySerialPortFile, &readset) )
+   // Raw telemetry forwarding takes the data as read, before the framer parses (and discards) it
+   if ( _telemetry_must_send_raw_telemetry_to_controller() )
+      s_TelemetryFramerFC.iAutoConsume = 0;
+   else
+      s_TelemetryFramerFC.iAutoConsume = 1;
+
+   t_telemetry_framer* pFramer = &s_TelemetryFramerFC;
+   s_bTelemetryFramerFCNewMessage = false;
+   if ( telemetry_framer_poll(&pFramer, 1, 2) <= 0 )
       return 0;
 
-   int length = read(s_iTelemetrySerialPortFile, s_uTelemetrySerialInBuffer, 1023);
+   int length = s_TelemetryFramerFC.iLastReadBytes;
    if ( length <= 0 )
       return 0;
 
    s_uRawTelemetryDownloadTotalReadFromSerial += length;
    s_iFCSerialTelemetryReadBytesTempLastSecond += length;
 
-   if ( _telemetry_must_send_raw_telemetry_to_controller() )
-      _telemetry_addSerialDataToFCTelemetryBuffer(s_uTelemetrySerialInBuffer, length);
-
-   bool bNewFCMessage = false;
-   if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MAVLINK )
-      bNewFCMessage = telemetry_mavlink_on_new_serial_data(s_uTelemetrySerialInBuffer, length);
-   if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_LTM )
-      bNewFCMessage = telemetry_mavlink_on_new_serial_data(s_uTelemetrySerialInBuffer, length);
-   if ( g_pCurrentModel->telemetry_params.fc_telemetry_type == TELEMETRY_TYPE_MSP )
-      bNewFCMessage = telemetry_msp_on_new_serial_data(s_uTelemetrySerialInBuffer, length);
+   if ( ! s_TelemetryFramerFC.iAutoConsume )
+   {
+      u8* pData = NULL;
+      int iReady = telemetry_framer_get_ready_data(&s_TelemetryFramerFC, &pData);
+      if ( iReady > 0 )
+      {
+         _telemetry_addSerialDataToFCTelemetryBuffer(pData, iReady);
+         telemetry_framer_consume(&s_TelemetryFramerFC, iReady);
+      }
+   }
 
-   if ( bNewFCMessage )
+   if ( s_bTelemetryFramerFCNewMessage )
       s_CountMessagesFromFCPerSecondTemp++;
    return length;
 }
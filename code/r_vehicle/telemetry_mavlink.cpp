@@ -357,6 +357,17 @@ bool telemetry_mavlink_on_new_serial_data(u8* pData, int iDataLength)
    return false;
 }
 
+bool telemetry_mavlink_on_new_frame(const u8* pFrame, int iFrameLength)
+{
+   if ( (NULL == pFrame) || (NULL == g_pCurrentModel) || (iFrameLength <= 0) )
+      return false;
+   if ( parse_telemetry_from_fc_mavlink_frame(pFrame, iFrameLength, telemetry_get_fc_telemetry_header(), &sPHRTE, g_pCurrentModel->vehicle_type) )
+   {
+      set_time_last_mavlink_message_from_fc(g_TimeNow);
+      return true;
+   }
+   return false;
+}
 
 void _preprocess_fc_telemetry(t_packet_header_fc_telemetry* pPHFCT)
 {
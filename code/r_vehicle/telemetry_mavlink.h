@@ -9,5 +9,7 @@ void telemetry_mavlink_on_second_lapse();
 
 // Returns true if a new message was found
 bool telemetry_mavlink_on_new_serial_data(u8* pData, int iDataLength);
+// One complete MAVLink frame, from the telemetry framer
+bool telemetry_mavlink_on_new_frame(const u8* pFrame, int iFrameLength);
 
 void telemetry_mavlink_send_to_controller();
@@ -34,6 +34,7 @@
 #include "../base/shared_mem.h"
 #include "../base/ruby_ipc.h"
 #include "../base/utils.h"
+#include "../base/video_link_adaptive_logic.h"
 #include "../common/string_utils.h"
 
 #include "video_link_stats_overwrites.h"
@@ -202,35 +203,21 @@ void video_stats_overwrites_init()
 
 u32 _get_bitrate_for_current_level_and_profile_including_overwrites()
 {
-   u32 uTargetVideoBitrate = utils_get_max_allowed_video_bitrate_for_profile_and_level(g_pCurrentModel, g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile, (int)g_SM_VideoLinkStats.overwrites.currentProfileShiftLevel);
-
-   u32 uOverwriteDown = g_SM_VideoLinkStats.overwrites.profilesTopVideoBitrateOverwritesDownward[g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile];
-   if ( uTargetVideoBitrate > uOverwriteDown )
-      uTargetVideoBitrate -= uOverwriteDown;
-   else
-      uTargetVideoBitrate = 0;
-
-   if ( uTargetVideoBitrate < 250000 )
-      uTargetVideoBitrate = 250000;
-
-   if ( g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile != VIDEO_PROFILE_USER )
-   if ( g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile != VIDEO_PROFILE_BEST_PERF )
-   if ( g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile != VIDEO_PROFILE_HIGH_QUALITY )
-   if ( uTargetVideoBitrate < g_pCurrentModel->video_params.lowestAllowedAdaptiveVideoBitrate )
-      uTargetVideoBitrate = g_pCurrentModel->video_params.lowestAllowedAdaptiveVideoBitrate;
-
-   // Minimum for MQ profile, for 12 Mb datarate is at least 2Mb, do not go below that
-   if ( g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile == VIDEO_PROFILE_MQ )
-   if ( g_pCurrentModel->video_link_profiles[VIDEO_PROFILE_MQ].radio_datarate_video_bps == 0 )
-   if ( getRealDataRateFromRadioDataRate(g_pCurrentModel->video_link_profiles[g_SM_VideoLinkStats.overwrites.userVideoLinkProfile].radio_datarate_video_bps, 0) >= 12000000 )
-   if ( uTargetVideoBitrate < 2000000 )
-      uTargetVideoBitrate = 2000000;
-     
-   return uTargetVideoBitrate;
+   return video_link_adaptive_get_level_video_bitrate(g_pCurrentModel, g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile, (int)g_SM_VideoLinkStats.overwrites.currentProfileShiftLevel,
+      g_SM_VideoLinkStats.overwrites.userVideoLinkProfile, g_SM_VideoLinkStats.overwrites.profilesTopVideoBitrateOverwritesDownward[g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile]);
 }
 
-void video_stats_overwrites_switch_to_profile_and_level(int iTotalLevelsShift, int iVideoProfile, int iLevelShift)
+void video_stats_overwrites_switch_to_profile_and_level(int iTotalLevelsShift)
 {
+   // Same level to profile / EC scheme / bitrate mapping as the adaptive video simulation test uses
+   // (the bitrate overwrite is kept per video profile, so look up the target profile first)
+   t_adaptive_video_level_params levelParams;
+   int iTargetProfile = g_pCurrentModel->get_video_profile_from_total_levels_shift(iTotalLevelsShift);
+   video_link_adaptive_get_level_params(g_pCurrentModel, iTotalLevelsShift, g_SM_VideoLinkStats.overwrites.userVideoLinkProfile,
+      g_SM_VideoLinkStats.overwrites.profilesTopVideoBitrateOverwritesDownward[iTargetProfile], &levelParams);
+   int iVideoProfile = levelParams.iVideoProfile;
+   int iLevelShift = levelParams.iProfileLevelShift;
+
    onEventBeforeRuntimeCurrentVideoProfileChanged(g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile, iVideoProfile);
    
    if ( iTotalLevelsShift > s_iLastTotalLevelsShift )
@@ -263,14 +250,9 @@ void video_stats_overwrites_switch_to_profile_and_level(int iTotalLevelsShift, i
    }
    g_SM_VideoLinkStats.overwrites.currentProfileAndLevelDefaultBitrate = utils_get_max_allowed_video_bitrate_for_profile_and_level(g_pCurrentModel, g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile, (int)g_SM_VideoLinkStats.overwrites.currentProfileShiftLevel);
 
-   int iData = 0;
-   int iEC = 0;
-   g_pCurrentModel->get_level_shift_ec_scheme(iTotalLevelsShift, &iData, &iEC);
-
-   g_SM_VideoLinkStats.overwrites.currentDataBlocks = iData;
-   g_SM_VideoLinkStats.overwrites.currentECBlocks = iEC;
-
-   g_SM_VideoLinkStats.overwrites.currentSetVideoBitrate = _get_bitrate_for_current_level_and_profile_including_overwrites();
+   g_SM_VideoLinkStats.overwrites.currentDataBlocks = levelParams.iDataPackets;
+   g_SM_VideoLinkStats.overwrites.currentECBlocks = levelParams.iECPackets;
+   g_SM_VideoLinkStats.overwrites.currentSetVideoBitrate = levelParams.uVideoBitrate;
 
    g_pCurrentModel->video_link_profiles[g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile].width = g_pCurrentModel->video_link_profiles[g_pCurrentModel->video_params.user_selected_video_link_profile].width;
    g_pCurrentModel->video_link_profiles[g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile].height = g_pCurrentModel->video_link_profiles[g_pCurrentModel->video_params.user_selected_video_link_profile].height;
@@ -284,9 +266,6 @@ void video_stats_overwrites_switch_to_profile_and_level(int iTotalLevelsShift, i
       g_SM_VideoLinkStats.overwrites.currentSetVideoBitrate = _get_bitrate_for_current_level_and_profile_including_overwrites();
    }
 
-   if ( g_SM_VideoLinkStats.overwrites.currentECBlocks > MAX_FECS_PACKETS_IN_BLOCK )
-      g_SM_VideoLinkStats.overwrites.currentECBlocks = MAX_FECS_PACKETS_IN_BLOCK;
-
    g_SM_VideoLinkStats.historySwitches[0] = g_SM_VideoLinkStats.overwrites.currentProfileShiftLevel | (g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile<<4);
    g_SM_VideoLinkStats.totalSwitches++;
 
@@ -1073,14 +1052,14 @@ void video_stats_overwrites_periodic_loop()
       if ( g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile == g_SM_VideoLinkStats.overwrites.userVideoLinkProfile )
       {
          log_line("[Video] Switch to MQ profile due to controller link lost and adaptive video is on.");
-         video_stats_overwrites_switch_to_profile_and_level(g_pCurrentModel->get_video_profile_total_levels(g_pCurrentModel->video_params.user_selected_video_link_profile), VIDEO_PROFILE_MQ,0);
+         video_stats_overwrites_switch_to_profile_and_level(g_pCurrentModel->get_video_profile_total_levels(g_pCurrentModel->video_params.user_selected_video_link_profile));
       }
       else if ( ! (g_pCurrentModel->video_link_profiles[g_pCurrentModel->video_params.user_selected_video_link_profile].uProfileEncodingFlags & VIDEO_PROFILE_ENCODING_FLAG_USE_MEDIUM_ADAPTIVE_VIDEO) )
       {
          if ( g_SM_VideoLinkStats.overwrites.currentVideoLinkProfile == VIDEO_PROFILE_MQ )
          {
             log_line("[Video] Switch to LQ profile due to controller link lost and adaptive video is on (full).");
-            video_stats_overwrites_switch_to_profile_and_level(g_pCurrentModel->get_video_profile_total_levels(g_pCurrentModel->video_params.user_selected_video_link_profile) + g_pCurrentModel->get_video_profile_total_levels(VIDEO_PROFILE_MQ), VIDEO_PROFILE_LQ,0);
+            video_stats_overwrites_switch_to_profile_and_level(g_pCurrentModel->get_video_profile_total_levels(g_pCurrentModel->video_params.user_selected_video_link_profile) + g_pCurrentModel->get_video_profile_total_levels(VIDEO_PROFILE_MQ));
          }
       }
    }
@@ -265,6 +265,12 @@ void video_source_majestic_set_keyframe_value(float fGOP)
    //hw_execute_bash_command_raw("killall -1 majestic", NULL);
 }
 
+void video_source_majestic_request_keyframe()
+{
+   // Do not wait for the response, the router loop must not block on it
+   hw_execute_bash_command_raw("curl -s localhost/request/idr >/dev/null 2>&1 &", NULL);
+}
+
 void video_source_majestic_set_videobitrate_value(u32 uBitrate)
 {
    char szComm[128];
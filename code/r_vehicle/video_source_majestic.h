@@ -11,6 +11,7 @@ void video_source_majestic_start_capture_program();
 void video_source_majestic_stop_capture_program();
 void video_source_majestic_request_update_program(u32 uChangeReason);
 void video_source_majestic_set_keyframe_value(float fGOP);
+void video_source_majestic_request_keyframe();
 void video_source_majestic_set_videobitrate_value(u32 uBitrate);
 
 // Returns the buffer and number of bytes read
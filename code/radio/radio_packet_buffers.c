@@ -0,0 +1,178 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "radio_packet_buffers.h"
+
+int radio_packet_buffers_init(t_radio_packet_buffer_pool* pPool, int iCountBuffers)
+{
+   if ( (NULL == pPool) || (iCountBuffers <= 0) )
+      return 0;
+
+   memset(pPool, 0, sizeof(t_radio_packet_buffer_pool));
+   pPool->pBuffers = (t_radio_packet_buffer*) malloc(iCountBuffers * sizeof(t_radio_packet_buffer));
+   pPool->pFreeIndexes = (int*) malloc(iCountBuffers * sizeof(int));
+   if ( (NULL == pPool->pBuffers) || (NULL == pPool->pFreeIndexes) )
+   {
+      log_error_and_alarm("[RadioPacketBuffers] Failed to allocate %d packet buffers.", iCountBuffers);
+      if ( NULL != pPool->pBuffers )
+         free(pPool->pBuffers);
+      if ( NULL != pPool->pFreeIndexes )
+         free(pPool->pFreeIndexes);
+      pPool->pBuffers = NULL;
+      pPool->pFreeIndexes = NULL;
+      return 0;
+   }
+
+   if ( 0 != pthread_mutex_init(&pPool->mutex, NULL) )
+   {
+      log_error_and_alarm("[RadioPacketBuffers] Failed to init mutex.");
+      free(pPool->pBuffers);
+      free(pPool->pFreeIndexes);
+      pPool->pBuffers = NULL;
+      pPool->pFreeIndexes = NULL;
+      return 0;
+   }
+
+   for( int i=0; i<iCountBuffers; i++ )
+   {
+      pPool->pBuffers[i].iRefCount = 0;
+      pPool->pBuffers[i].iIndex = i;
+      pPool->pBuffers[i].pPool = pPool;
+      pPool->pBuffers[i].iLength = 0;
+      pPool->pFreeIndexes[i] = iCountBuffers - 1 - i;
+   }
+   pPool->iCountBuffers = iCountBuffers;
+   pPool->iCountFree = iCountBuffers;
+   pPool->iMinCountFree = iCountBuffers;
+   pPool->uCountAllocFailures = 0;
+
+   log_line("[RadioPacketBuffers] Allocated %d packet buffers (%u bytes).", iCountBuffers, (u32)(iCountBuffers * sizeof(t_radio_packet_buffer)));
+   return 1;
+}
+
+void radio_packet_buffers_uninit(t_radio_packet_buffer_pool* pPool)
+{
+   if ( (NULL == pPool) || (NULL == pPool->pBuffers) )
+      return;
+
+   if ( pPool->iCountFree != pPool->iCountBuffers )
+      log_softerror_and_alarm("[RadioPacketBuffers] Releasing pool with %d buffers still in use.", pPool->iCountBuffers - pPool->iCountFree);
+
+   pthread_mutex_destroy(&pPool->mutex);
+   free(pPool->pBuffers);
+   free(pPool->pFreeIndexes);
+   pPool->pBuffers = NULL;
+   pPool->pFreeIndexes = NULL;
+   pPool->iCountBuffers = 0;
+   pPool->iCountFree = 0;
+}
+
+t_radio_packet_buffer* radio_packet_buffers_alloc(t_radio_packet_buffer_pool* pPool)
+{
+   if ( (NULL == pPool) || (NULL == pPool->pBuffers) )
+      return NULL;
+
+   t_radio_packet_buffer* pBuffer = NULL;
+
+   pthread_mutex_lock(&pPool->mutex);
+   if ( pPool->iCountFree > 0 )
+   {
+      pPool->iCountFree--;
+      pBuffer = &(pPool->pBuffers[pPool->pFreeIndexes[pPool->iCountFree]]);
+      if ( pPool->iCountFree < pPool->iMinCountFree )
+         pPool->iMinCountFree = pPool->iCountFree;
+   }
+   else
+      pPool->uCountAllocFailures++;
+   pthread_mutex_unlock(&pPool->mutex);
+
+   if ( NULL == pBuffer )
+      return NULL;
+
+   pBuffer->iLength = 0;
+   __sync_lock_test_and_set(&pBuffer->iRefCount, 1);
+   return pBuffer;
+}
+
+void radio_packet_buffers_ref(t_radio_packet_buffer* pBuffer)
+{
+   if ( NULL == pBuffer )
+      return;
+   __sync_add_and_fetch(&pBuffer->iRefCount, 1);
+}
+
+void radio_packet_buffers_unref(t_radio_packet_buffer* pBuffer)
+{
+   if ( NULL == pBuffer )
+      return;
+
+   int iRefCount = __sync_sub_and_fetch(&pBuffer->iRefCount, 1);
+   if ( iRefCount > 0 )
+      return;
+   if ( iRefCount < 0 )
+   {
+      log_softerror_and_alarm("[RadioPacketBuffers] Buffer %d released more times than referenced.", pBuffer->iIndex);
+      return;
+   }
+
+   t_radio_packet_buffer_pool* pPool = pBuffer->pPool;
+   pthread_mutex_lock(&pPool->mutex);
+   if ( pPool->iCountFree < pPool->iCountBuffers )
+   {
+      pPool->pFreeIndexes[pPool->iCountFree] = pBuffer->iIndex;
+      pPool->iCountFree++;
+   }
+   pthread_mutex_unlock(&pPool->mutex);
+}
+
+int radio_packet_buffers_get_free_count(t_radio_packet_buffer_pool* pPool)
+{
+   if ( NULL == pPool )
+      return 0;
+   pthread_mutex_lock(&pPool->mutex);
+   int iCount = pPool->iCountFree;
+   pthread_mutex_unlock(&pPool->mutex);
+   return iCount;
+}
+
+int radio_packet_buffers_get_and_reset_min_free_count(t_radio_packet_buffer_pool* pPool)
+{
+   if ( NULL == pPool )
+      return 0;
+   pthread_mutex_lock(&pPool->mutex);
+   int iCount = pPool->iMinCountFree;
+   pPool->iMinCountFree = pPool->iCountFree;
+   pthread_mutex_unlock(&pPool->mutex);
+   return iCount;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <pthread.h>
+#include "../base/base.h"
+#include "../base/config.h"
+#include "radiopackets2.h"
+
+// Pool of reference counted radio packet buffers.
+// A buffer is filled once (by the radio rx thread) and then handed to the consumers by pointer, instead
+// of copying the packet at each stage. Each holder of a buffer owns a reference; the buffer goes back to
+// the pool when the last reference is released. The pool is allocated once at start, so there are no
+// allocations in the rx/tx loops; when the pool is empty, alloc fails and the caller drops the packet.
+// Ref/unref can be called from any thread.
+
+typedef struct t_radio_packet_buffer_pool t_radio_packet_buffer_pool;
+
+typedef struct
+{
+   int iRefCount;
+   int iIndex; // in the pool
+   t_radio_packet_buffer_pool* pPool;
+   int iLength;
+   u8 uData[MAX_PACKET_TOTAL_SIZE];
+} t_radio_packet_buffer;
+
+struct t_radio_packet_buffer_pool
+{
+   t_radio_packet_buffer* pBuffers;
+   int* pFreeIndexes;
+   int iCountBuffers;
+   int iCountFree;
+   int iMinCountFree;
+   u32 uCountAllocFailures;
+   pthread_mutex_t mutex;
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int radio_packet_buffers_init(t_radio_packet_buffer_pool* pPool, int iCountBuffers);
+// All buffers must be released before
+void radio_packet_buffers_uninit(t_radio_packet_buffer_pool* pPool);
+
+// Returns a buffer with one reference, or NULL if the pool is empty
+t_radio_packet_buffer* radio_packet_buffers_alloc(t_radio_packet_buffer_pool* pPool);
+void radio_packet_buffers_ref(t_radio_packet_buffer* pBuffer);
+// Releases a reference; the buffer is back in its pool after the last one
+void radio_packet_buffers_unref(t_radio_packet_buffer* pBuffer);
+
+int radio_packet_buffers_get_free_count(t_radio_packet_buffer_pool* pPool);
+// Lowest count of free buffers since the last call
+int radio_packet_buffers_get_and_reset_min_free_count(t_radio_packet_buffer_pool* pPool);
+
+#ifdef __cplusplus
+}
+#endif
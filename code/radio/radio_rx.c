@@ -34,6 +34,7 @@
 #include "../base/config_hw.h"
 #include "../base/hw_procs.h"
 #include <pthread.h>
+#include <sys/eventfd.h>
 #include "../common/radio_stats.h"
 #include "../common/string_utils.h"
 #include "radio_rx.h"
@@ -48,8 +49,13 @@ int s_iRadioRxMarkedForQuit = 0;
 int s_iDefaultRxThreadPriority = -1;
 int s_iCustomRxThreadPriority = DEFAULT_PRIORITY_THREAD_RADIO_RX;
 int s_iLastSetCustomRxThreadPriority = DEFAULT_PRIORITY_THREAD_RADIO_RX;
+int s_iRadioRxWakeupFd = -1;
+volatile int s_iRadioRxWakeupFdUsed = 0;
+int s_iRadioRxSerialPeerMarksStartPackets = 0;
 
 t_radio_rx_state s_RadioRxState;
+t_radio_packet_buffer_pool s_RadioRxPacketBuffersPool;
+u32 s_uTimeLastLogRxNoBuffers = 0;
 
 pthread_t s_pThreadRadioRx;
 pthread_mutex_t s_pThreadRadioRxMutex;
@@ -210,14 +216,29 @@ void _radio_rx_update_fd_sets()
 
 void _radio_rx_add_packet_to_rx_queue(u8* pPacket, int iLength, int iRadioInterface)
 {
-   if ( (NULL == pPacket) || (iLength <= 0) || s_iRadioRxMarkedForQuit )
+   if ( (NULL == pPacket) || (iLength <= 0) || (iLength > MAX_PACKET_TOTAL_SIZE) || s_iRadioRxMarkedForQuit )
       return;
 
+   // The packet is copied once, to a pool buffer; the consumer gets the buffer itself
+   t_radio_packet_buffer* pBuffer = radio_packet_buffers_alloc(&s_RadioRxPacketBuffersPool);
+   if ( NULL == pBuffer )
+   {
+      s_RadioRxState.uCountPacketsDroppedNoBuffers++;
+      if ( s_uRadioRxTimeNow > s_uTimeLastLogRxNoBuffers + 1000 )
+      {
+         s_uTimeLastLogRxNoBuffers = s_uRadioRxTimeNow;
+         log_softerror_and_alarm("[RadioRxThread] No free rx packet buffers. Discarded %u packets so far.", s_RadioRxState.uCountPacketsDroppedNoBuffers);
+      }
+      return;
+   }
+   memcpy(pBuffer->uData, pPacket, iLength);
+   pBuffer->iLength = iLength;
+
    // Add the packet to the queue
    s_RadioRxState.iPacketsRxInterface[s_RadioRxState.iCurrentRxPacketIndex] = iRadioInterface;
    s_RadioRxState.iPacketsAreShort[s_RadioRxState.iCurrentRxPacketIndex] = 0;
    s_RadioRxState.iPacketsLengths[s_RadioRxState.iCurrentRxPacketIndex] = iLength;
-   memcpy(s_RadioRxState.pPacketsBuffers[s_RadioRxState.iCurrentRxPacketIndex], pPacket, iLength);
+   s_RadioRxState.pPacketsBuffers[s_RadioRxState.iCurrentRxPacketIndex] = pBuffer;
    
 
    int iPacketsInQueue = 0;
@@ -249,13 +270,16 @@ void _radio_rx_add_packet_to_rx_queue(u8* pPacket, int iLength, int iRadioInterf
    if ( s_RadioRxState.iCurrentRxPacketIndex == s_RadioRxState.iCurrentRxPacketToConsume )
    {
       // No more room. Must skip few pending processing packets
-      log_softerror_and_alarm("[RadioRxThread] No more room in rx buffers. Discarding some unprocessed messages. Max messages in queue: %d, last 10 sec: %d.", s_RadioRxState.iMaxPacketsInQueue, s_RadioRxState.iMaxPacketsInQueueLastMinute);
+      if ( ! s_iSearchMode )
+         log_softerror_and_alarm("[RadioRxThread] No more room in rx buffers. Discarding some unprocessed messages. Max messages in queue: %d, last 10 sec: %d.", s_RadioRxState.iMaxPacketsInQueue, s_RadioRxState.iMaxPacketsInQueueLastMinute);
       if ( iLock != 0 )
       {
          iLock = pthread_mutex_lock(&s_pThreadRadioRxMutex);
       }
       for( int i=0; i<3; i++ )
       {
+         radio_packet_buffers_unref(s_RadioRxState.pPacketsBuffers[s_RadioRxState.iCurrentRxPacketToConsume]);
+         s_RadioRxState.pPacketsBuffers[s_RadioRxState.iCurrentRxPacketToConsume] = NULL;
          s_RadioRxState.iCurrentRxPacketToConsume++;
          if ( s_RadioRxState.iCurrentRxPacketToConsume >= MAX_RX_PACKETS_QUEUE )
             s_RadioRxState.iCurrentRxPacketToConsume = 0;
@@ -264,6 +288,14 @@ void _radio_rx_add_packet_to_rx_queue(u8* pPacket, int iLength, int iRadioInterf
    if ( 0 == iLock )
       pthread_mutex_unlock(&s_pThreadRadioRxMutex);
 
+   // Wake up the consumer (if it waits on the wakeup fd)
+   if ( s_iRadioRxWakeupFdUsed && (s_iRadioRxWakeupFd >= 0) )
+   {
+      uint64_t uValue = 1;
+      if ( sizeof(uValue) != write(s_iRadioRxWakeupFd, &uValue, sizeof(uValue)) )
+         log_softerror_and_alarm("[RadioRxThread] Failed to signal rx wakeup fd.");
+   }
+
    s_uRadioRxLastTimeQueue += get_current_timestamp_ms() - s_uRadioRxTimeNow;
 }
 
@@ -284,6 +316,7 @@ int _radio_rx_process_serial_short_packet(int iInterfaceIndex, u8* pPacketBuffer
    static u8 s_uLastRxShortPacketsIds[MAX_RADIO_INTERFACES];
    static u8 s_uBuffersFullMessages[MAX_RADIO_INTERFACES][MAX_PACKET_TOTAL_SIZE*2];
    static int s_uBuffersFullMessagesReadPos[MAX_RADIO_INTERFACES];
+   static int s_bWaitForStartShortPacket[MAX_RADIO_INTERFACES];
    static int s_bInitializedBuffersFullMessages = 0;
 
    if ( ! s_bInitializedBuffersFullMessages )
@@ -292,6 +325,7 @@ int _radio_rx_process_serial_short_packet(int iInterfaceIndex, u8* pPacketBuffer
       for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
       {
          s_uBuffersFullMessagesReadPos[i] = 0;
+         s_bWaitForStartShortPacket[i] = 0;
          s_uLastRxShortPacketsIds[i] = 0xFF;
          s_uLastRxShortPacketsVehicleIds[i] = 0;
       }
@@ -308,6 +342,7 @@ int _radio_rx_process_serial_short_packet(int iInterfaceIndex, u8* pPacketBuffer
    if ( pPHS->start_header == SHORT_PACKET_START_BYTE_START_PACKET )
    {
      s_uBuffersFullMessagesReadPos[iInterfaceIndex] = 0;
+     s_bWaitForStartShortPacket[iInterfaceIndex] = 0;
      if ( pPHS->data_length >= sizeof(t_packet_header) - sizeof(u32) )
      {
         t_packet_header* pPH = (t_packet_header*)(pPacketBuffer + sizeof(t_packet_header_short));
@@ -322,32 +357,67 @@ int _radio_rx_process_serial_short_packet(int iInterfaceIndex, u8* pPacketBuffer
       radio_stats_update_on_new_radio_packet_received(s_pSMRadioStats, s_pSMRadioRxGraphs, s_uRadioRxTimeNow, iInterfaceIndex, pPacketBuffer, iPacketLength, 1, 0, 1);
    
    // If there are missing packets, reset rx buffer for this interface
+   // and wait for a short packet that starts with a full packet
    
    u32 uNext = (((u32)(s_uLastRxShortPacketsIds[iInterfaceIndex])) + 1) & 0xFF;
    if ( uNext != pPHS->packet_id )
    {
       s_uBuffersFullMessagesReadPos[iInterfaceIndex] = 0;
+      if ( pPHS->start_header != SHORT_PACKET_START_BYTE_START_PACKET )
+         s_bWaitForStartShortPacket[iInterfaceIndex] = 1;
    }
    s_uLastRxShortPacketsIds[iInterfaceIndex] = pPHS->packet_id;
+
+   // Older senders mark a message that fits in a single short packet as an end packet, never as a start one:
+   // resync on a short packet that holds a whole radio packet
+   if ( s_bWaitForStartShortPacket[iInterfaceIndex] && (! s_iRadioRxSerialPeerMarksStartPackets) )
+   if ( pPHS->data_length >= sizeof(t_packet_header) )
+   {
+      t_packet_header* pPH = (t_packet_header*)(pPacketBuffer + sizeof(t_packet_header_short));
+      if ( pPH->total_length == pPHS->data_length )
+      {
+         u32 uCRC = base_compute_crc32(pPacketBuffer + sizeof(t_packet_header_short) + sizeof(u32), pPH->total_length - sizeof(u32));
+         if ( (uCRC & 0x00FFFFFF) == (pPH->uCRC & 0x00FFFFFF) )
+         {
+            s_uBuffersFullMessagesReadPos[iInterfaceIndex] = 0;
+            s_bWaitForStartShortPacket[iInterfaceIndex] = 0;
+         }
+      }
+   }
+   if ( s_bWaitForStartShortPacket[iInterfaceIndex] )
+      return 1;
+
    // Add the content of the packet to the buffer
 
    memcpy(&s_uBuffersFullMessages[iInterfaceIndex][s_uBuffersFullMessagesReadPos[iInterfaceIndex]], pPacketBuffer + sizeof(t_packet_header_short), pPHS->data_length);
    s_uBuffersFullMessagesReadPos[iInterfaceIndex] += pPHS->data_length;
 
-   // Do we have a full valid radio packet?
+   // Do we have full valid radio packets? (a short packet can end one packet and contain the start of the next ones)
 
-   if ( s_uBuffersFullMessagesReadPos[iInterfaceIndex] >= sizeof(t_packet_header) )
+   while ( s_uBuffersFullMessagesReadPos[iInterfaceIndex] >= sizeof(t_packet_header) )
    {
       t_packet_header* pPH = (t_packet_header*) s_uBuffersFullMessages[iInterfaceIndex];
-      if ( (pPH->total_length >= sizeof(t_packet_header)) && (s_uBuffersFullMessagesReadPos[iInterfaceIndex] >= pPH->total_length) )
+      if ( (pPH->total_length < sizeof(t_packet_header)) || (pPH->total_length > MAX_PACKET_TOTAL_SIZE) )
       {
-         u32 uCRC = base_compute_crc32(&s_uBuffersFullMessages[iInterfaceIndex][sizeof(u32)], pPH->total_length - sizeof(u32));
-         if ( (uCRC & 0x00FFFFFF) == (pPH->uCRC & 0x00FFFFFF) )
-         {
-            s_uBuffersFullMessagesReadPos[iInterfaceIndex] = 0;
-            _radio_rx_check_add_packet_to_rx_queue(s_uBuffersFullMessages[iInterfaceIndex], pPH->total_length, iInterfaceIndex);
-         }
+         s_uBuffersFullMessagesReadPos[iInterfaceIndex] = 0;
+         s_bWaitForStartShortPacket[iInterfaceIndex] = 1;
+         break;
+      }
+      if ( s_uBuffersFullMessagesReadPos[iInterfaceIndex] < pPH->total_length )
+         break;
+
+      int iLength = pPH->total_length;
+      u32 uCRC = base_compute_crc32(&s_uBuffersFullMessages[iInterfaceIndex][sizeof(u32)], iLength - sizeof(u32));
+      if ( (uCRC & 0x00FFFFFF) != (pPH->uCRC & 0x00FFFFFF) )
+      {
+         s_uBuffersFullMessagesReadPos[iInterfaceIndex] = 0;
+         s_bWaitForStartShortPacket[iInterfaceIndex] = 1;
+         break;
       }
+      _radio_rx_check_add_packet_to_rx_queue(s_uBuffersFullMessages[iInterfaceIndex], iLength, iInterfaceIndex);
+      s_uBuffersFullMessagesReadPos[iInterfaceIndex] -= iLength;
+      if ( s_uBuffersFullMessagesReadPos[iInterfaceIndex] > 0 )
+         memmove(s_uBuffersFullMessages[iInterfaceIndex], &s_uBuffersFullMessages[iInterfaceIndex][iLength], s_uBuffersFullMessagesReadPos[iInterfaceIndex]);
    }
 
    // Too much data? Then reset the buffer and wait for the start of a new full packet.
@@ -569,6 +639,13 @@ int _radio_rx_parse_received_wifi_radio_data(int iInterfaceIndex)
             iLength -= pPH->total_length; 
             continue;
          }
+         if ( pPH->total_length <= iLength )
+         if ( ! (pPH->packet_flags & PACKET_FLAGS_BIT_RETRANSMITED) )
+         {
+            t_packet_video_latency_trace* pTrace = radio_packet_get_video_latency_trace(pData);
+            if ( NULL != pTrace )
+               pTrace->uControllerTimeRxMicros = get_current_timestamp_micros();
+         }
          _radio_rx_check_add_packet_to_rx_queue(pData, pPH->total_length, iInterfaceIndex);
 
          pData += pPH->total_length;
@@ -637,8 +714,9 @@ void _radio_rx_update_stats(u32 uTimeNow)
    {
       s_RadioRxState.uTimeLastMinute = uTimeNow;
       s_iCounterRadioRxStatsUpdate2++;
-      log_line("[RadioRxThread] Max packets in queue: %d. Max packets in queue in last 10 sec: %d.",
-         s_RadioRxState.iMaxPacketsInQueue, s_RadioRxState.iMaxPacketsInQueueLastMinute);
+      log_line("[RadioRxThread] Max packets in queue: %d. Max packets in queue in last 10 sec: %d. Min free rx buffers in last 10 sec: %d of %d.",
+         s_RadioRxState.iMaxPacketsInQueue, s_RadioRxState.iMaxPacketsInQueueLastMinute,
+         radio_packet_buffers_get_and_reset_min_free_count(&s_RadioRxPacketBuffersPool), s_RadioRxPacketBuffersPool.iCountBuffers);
       s_RadioRxState.iMaxPacketsInQueueLastMinute = 0;
 
       radio_duplicate_detection_log_info();
@@ -741,8 +819,8 @@ static void * _thread_radio_rx(void *argument)
          continue;
       }
 
-      uTimeLastRead = uTime;
-
+      // Read duration stats are in microseconds and cover only the select/read
+      uTimeLastRead = get_current_timestamp_micros();
       int nResult = select(s_iRadioRxMaxFD, &s_RadioRxReadSet, NULL, NULL, &s_iRadioRxReadTimeInterval);
 
       s_uRadioRxLastTimeRead += get_current_timestamp_micros() - uTimeLastRead;
@@ -816,19 +894,29 @@ int radio_rx_start_rx_thread(shared_mem_radio_stats* pSMRadioStats, shared_mem_r
 
    s_iRadioRxAllInterfacesPaused = 0;
 
+   if ( NULL == s_RadioRxPacketBuffersPool.pBuffers )
+   if ( ! radio_packet_buffers_init(&s_RadioRxPacketBuffersPool, MAX_RX_PACKETS_QUEUE + MAX_RX_PACKETS_HELD_BY_CONSUMERS) )
+   {
+      log_error_and_alarm("[RadioRx] Failed to allocate rx packets buffers!");
+      return 0;
+   }
+
+   // Release the packets left in the queue by a previous run
+   while ( s_RadioRxState.iCurrentRxPacketToConsume != s_RadioRxState.iCurrentRxPacketIndex )
+   {
+      radio_packet_buffers_unref(s_RadioRxState.pPacketsBuffers[s_RadioRxState.iCurrentRxPacketToConsume]);
+      s_RadioRxState.iCurrentRxPacketToConsume++;
+      if ( s_RadioRxState.iCurrentRxPacketToConsume >= MAX_RX_PACKETS_QUEUE )
+         s_RadioRxState.iCurrentRxPacketToConsume = 0;
+   }
+
    for( int i=0; i<MAX_RX_PACKETS_QUEUE; i++ )
    {
       s_RadioRxState.iPacketsLengths[i] = 0;
       s_RadioRxState.iPacketsAreShort[i] = 0;
-      s_RadioRxState.pPacketsBuffers[i] = (u8*) malloc(MAX_PACKET_TOTAL_SIZE);
-      if ( NULL == s_RadioRxState.pPacketsBuffers[i] )
-      {
-         log_error_and_alarm("[RadioRx] Failed to allocate rx packets buffers!");
-         return 0;
-      }
+      s_RadioRxState.pPacketsBuffers[i] = NULL;
    }
-
-   log_line("[RadioRx] Allocated %u bytes for %d rx packets.", MAX_RX_PACKETS_QUEUE * MAX_PACKET_TOTAL_SIZE, MAX_RX_PACKETS_QUEUE);
+   s_RadioRxState.uCountPacketsDroppedNoBuffers = 0;
 
    s_RadioRxState.iCurrentRxPacketToConsume = 0;
    s_RadioRxState.iCurrentRxPacketIndex = 0;
@@ -864,6 +952,15 @@ int radio_rx_start_rx_thread(shared_mem_radio_stats* pSMRadioStats, shared_mem_r
       return 0;
    }
 
+   // The wakeup fd lives for the whole process: consumers register it once in their
+   // event loops, while the rx thread gets stopped and started again on links changes.
+   if ( s_iRadioRxWakeupFd < 0 )
+   {
+      s_iRadioRxWakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if ( s_iRadioRxWakeupFd < 0 )
+         log_softerror_and_alarm("[RadioRx] Failed to create rx wakeup fd, error: %d", errno);
+   }
+
    if ( 0 != pthread_create(&s_pThreadRadioRx, NULL, &_thread_radio_rx, (void*)&s_iRadioRxSingalStop) )
    {
       log_error_and_alarm("[RadioRx] Failed to create thread for radio rx.");
@@ -889,6 +986,26 @@ void radio_rx_stop_rx_thread()
 
    pthread_cancel(s_pThreadRadioRx);
    pthread_mutex_destroy(&s_pThreadRadioRxMutex);
+
+   // Keep the wakeup fd open (see radio_rx_start_rx_thread), just drop any pending wakeups
+   radio_rx_clear_wakeup_fd();
+}
+
+int radio_rx_get_wakeup_fd()
+{
+   if ( s_iRadioRxWakeupFd >= 0 )
+      s_iRadioRxWakeupFdUsed = 1;
+   return s_iRadioRxWakeupFd;
+}
+
+void radio_rx_clear_wakeup_fd()
+{
+   if ( s_iRadioRxWakeupFd < 0 )
+      return;
+   uint64_t uValue = 0;
+   if ( read(s_iRadioRxWakeupFd, &uValue, sizeof(uValue)) < 0 )
+   if ( errno != EAGAIN )
+      log_softerror_and_alarm("[RadioRx] Failed to clear rx wakeup fd, error: %d", errno);
 }
 
 void radio_rx_set_custom_thread_priority(int iPriority)
@@ -1003,6 +1120,12 @@ void radio_rx_set_dev_mode()
    log_line("[RadioRx] Set dev mode");
 }
 
+void radio_rx_set_serial_peer_marks_start_packets(int iMarksStartPackets)
+{
+   s_iRadioRxSerialPeerMarksStartPackets = iMarksStartPackets;
+   log_line("[RadioRx] Set serial peer marks start short packets: %s", iMarksStartPackets?"yes":"no");
+}
+
 int radio_rx_detect_firmware_type_from_packet(u8* pPacketBuffer, int nPacketLength)
 {
    if ( (NULL == pPacketBuffer) || (nPacketLength < 4) )
@@ -1112,13 +1235,13 @@ int radio_rx_has_retransmissions_requests_to_consume()
 
    while ( iBottom != iTop )
    {
-      t_packet_header* pPH = (t_packet_header*) s_RadioRxState.pPacketsBuffers[iBottom];
+      t_packet_header* pPH = (t_packet_header*) s_RadioRxState.pPacketsBuffers[iBottom]->uData;
       if ( (pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) == PACKET_COMPONENT_VIDEO )
       if ( (pPH->packet_type == PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS) || (pPH->packet_type == PACKET_TYPE_VIDEO_REQ_MULTIPLE_PACKETS2) )
          iCount++;
       iBottom++;
       if ( iBottom >= MAX_RX_PACKETS_QUEUE )
-         iBottom++;
+         iBottom = 0;
    }
    return iCount;
 }
@@ -1169,18 +1292,20 @@ u8* radio_rx_get_next_received_packet(int* pLength, int* pIsShortPacket, int* pR
    if ( NULL != pRadioInterfaceIndex )
       *pRadioInterfaceIndex = s_RadioRxState.iPacketsRxInterface[s_RadioRxState.iCurrentRxPacketToConsume];
 
-   memcpy( s_tmpLastProcessedRadioRxPacket, s_RadioRxState.pPacketsBuffers[s_RadioRxState.iCurrentRxPacketToConsume], s_RadioRxState.iPacketsLengths[s_RadioRxState.iCurrentRxPacketToConsume]);
-
+   t_radio_packet_buffer* pBuffer = s_RadioRxState.pPacketsBuffers[s_RadioRxState.iCurrentRxPacketToConsume];
+   s_RadioRxState.pPacketsBuffers[s_RadioRxState.iCurrentRxPacketToConsume] = NULL;
    s_RadioRxState.iCurrentRxPacketToConsume++;
    if ( s_RadioRxState.iCurrentRxPacketToConsume >= MAX_RX_PACKETS_QUEUE )
       s_RadioRxState.iCurrentRxPacketToConsume = 0;
 
    pthread_mutex_unlock(&s_pThreadRadioRxMutex);
 
+   memcpy(s_tmpLastProcessedRadioRxPacket, pBuffer->uData, pBuffer->iLength);
+   radio_packet_buffers_unref(pBuffer);
    return s_tmpLastProcessedRadioRxPacket;
 }
 
-int radio_rx_get_received_packets(int iCount, type_received_radio_packet* pOutputArray)
+int _radio_rx_take_received_packets(int iCount, type_received_radio_packet* pOutputArray)
 {
    if ( (iCount <= 0) || (NULL == pOutputArray) )
       return 0;
@@ -1192,6 +1317,7 @@ int radio_rx_get_received_packets(int iCount, type_received_radio_packet* pOutpu
 
    int iRead = 0;
 
+   // Only the buffer pointers are moved out of the queue while holding the lock
    pthread_mutex_lock(&s_pThreadRadioRxMutex);
 
    for( int i=0; i<iCount; i++ )
@@ -1199,7 +1325,8 @@ int radio_rx_get_received_packets(int iCount, type_received_radio_packet* pOutpu
       pOutputArray[i].iPacketLength = s_RadioRxState.iPacketsLengths[s_RadioRxState.iCurrentRxPacketToConsume];
       pOutputArray[i].iPacketIsShort = s_RadioRxState.iPacketsAreShort[s_RadioRxState.iCurrentRxPacketToConsume];
       pOutputArray[i].iPacketRxInterface = s_RadioRxState.iPacketsRxInterface[s_RadioRxState.iCurrentRxPacketToConsume];
-      memcpy( pOutputArray[i].pPacketData, s_RadioRxState.pPacketsBuffers[s_RadioRxState.iCurrentRxPacketToConsume], s_RadioRxState.iPacketsLengths[s_RadioRxState.iCurrentRxPacketToConsume]);
+      pOutputArray[i].pBuffer = s_RadioRxState.pPacketsBuffers[s_RadioRxState.iCurrentRxPacketToConsume];
+      s_RadioRxState.pPacketsBuffers[s_RadioRxState.iCurrentRxPacketToConsume] = NULL;
 
       s_RadioRxState.iCurrentRxPacketToConsume++;
       if ( s_RadioRxState.iCurrentRxPacketToConsume >= MAX_RX_PACKETS_QUEUE )
@@ -1216,6 +1343,40 @@ int radio_rx_get_received_packets(int iCount, type_received_radio_packet* pOutpu
    return iRead;
 }
 
+int radio_rx_get_received_packets(int iCount, type_received_radio_packet* pOutputArray)
+{
+   int iRead = _radio_rx_take_received_packets(iCount, pOutputArray);
+   for( int i=0; i<iRead; i++ )
+   {
+      memcpy(pOutputArray[i].pPacketData, pOutputArray[i].pBuffer->uData, pOutputArray[i].iPacketLength);
+      radio_packet_buffers_unref(pOutputArray[i].pBuffer);
+      pOutputArray[i].pBuffer = NULL;
+   }
+   return iRead;
+}
+
+int radio_rx_get_received_packets_buffers(int iCount, type_received_radio_packet* pOutputArray)
+{
+   int iRead = _radio_rx_take_received_packets(iCount, pOutputArray);
+   for( int i=0; i<iRead; i++ )
+      pOutputArray[i].pPacketData = pOutputArray[i].pBuffer->uData;
+   return iRead;
+}
+
+void radio_rx_release_received_packets(type_received_radio_packet* pArray, int iCount)
+{
+   if ( NULL == pArray )
+      return;
+   for( int i=0; i<iCount; i++ )
+   {
+      if ( NULL == pArray[i].pBuffer )
+         continue;
+      radio_packet_buffers_unref(pArray[i].pBuffer);
+      pArray[i].pBuffer = NULL;
+      pArray[i].pPacketData = NULL;
+   }
+}
+
 u32 radio_rx_get_and_reset_max_loop_time()
 {
    u32 u = s_RadioRxState.uMaxLoopTime;
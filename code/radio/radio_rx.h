@@ -3,12 +3,16 @@
 #include "../base/base.h"
 #include "../base/config.h"
 #include "../base/hardware.h"
+#include "radio_packet_buffers.h"
 
 #if defined (HW_PLATFORM_RASPBERRY) || defined (HW_PLATFORM_RADXA_ZERO3)
 #define MAX_RX_PACKETS_QUEUE 500
 #else
 #define MAX_RX_PACKETS_QUEUE 50
 #endif
+// Extra rx packet buffers, for the packets the consumers hold while processing them
+#define MAX_RX_PACKETS_HELD_BY_CONSUMERS 64
+
 typedef struct
 {
    u32 uVehicleId;
@@ -27,7 +31,7 @@ typedef struct
 
 typedef struct
 {
-   u8* pPacketsBuffers[MAX_RX_PACKETS_QUEUE];
+   t_radio_packet_buffer* pPacketsBuffers[MAX_RX_PACKETS_QUEUE];
    int iPacketsLengths[MAX_RX_PACKETS_QUEUE];
    int iPacketsAreShort[MAX_RX_PACKETS_QUEUE];
    int iPacketsRxInterface[MAX_RX_PACKETS_QUEUE];
@@ -46,6 +50,7 @@ typedef struct
    u32 uTimeLastMinute;
    int iMaxPacketsInQueue;
    int iMaxPacketsInQueueLastMinute;
+   u32 uCountPacketsDroppedNoBuffers;
 } __attribute__((packed)) t_radio_rx_state;
 
 typedef struct
@@ -54,6 +59,7 @@ typedef struct
    int iPacketLength;
    int iPacketIsShort;
    int iPacketRxInterface;
+   t_radio_packet_buffer* pBuffer; // set only by radio_rx_get_received_packets_buffers
 } __attribute__((packed)) type_received_radio_packet;
 
 #ifdef __cplusplus
@@ -63,6 +69,11 @@ extern "C" {
 int radio_rx_start_rx_thread(shared_mem_radio_stats* pSMRadioStats, shared_mem_radio_stats_interfaces_rx_graph* pSMRadioRxGraphs, int iSearchMode, u32 uAcceptedFirmwareType);
 void radio_rx_stop_rx_thread();
 
+// Becomes readable whenever new packets are added to the rx queue,
+// once a consumer got it (processes that don't wait on it are never signaled)
+int radio_rx_get_wakeup_fd();
+void radio_rx_clear_wakeup_fd();
+
 void radio_rx_set_custom_thread_priority(int iPriority);
 void radio_rx_set_timeout_interval(int iMiliSec);
 
@@ -70,6 +81,9 @@ void radio_rx_pause_interface(int iInterfaceIndex, const char* szReason);
 void radio_rx_resume_interface(int iInterfaceIndex);
 void radio_rx_mark_quit();
 void radio_rx_set_dev_mode();
+// Peer sends each message start in a SHORT_PACKET_START_BYTE_START_PACKET short packet (build RADIO_TX_SERIAL_COALESCING_MIN_SW_BUILD or newer).
+// Otherwise, after lost short packets, the receiver also resyncs on a short packet holding a whole valid radio packet.
+void radio_rx_set_serial_peer_marks_start_packets(int iMarksStartPackets);
 
 int radio_rx_detect_firmware_type_from_packet(u8* pPacketBuffer, int nPacketLength);
 
@@ -84,7 +98,11 @@ t_radio_rx_state* radio_rx_get_state();
 int radio_rx_has_retransmissions_requests_to_consume();
 int radio_rx_has_packets_to_consume();
 u8* radio_rx_get_next_received_packet(int* pLength, int* pIsShortPacket, int* pRadioInterfaceIndex);
+// Copies the packets to the pPacketData buffers of the output array
 int radio_rx_get_received_packets(int iCount, type_received_radio_packet* pOutputArray);
+// No copy: pPacketData points to the rx packet buffers, the caller owns them until it releases them
+int radio_rx_get_received_packets_buffers(int iCount, type_received_radio_packet* pOutputArray);
+void radio_rx_release_received_packets(type_received_radio_packet* pArray, int iCount);
 
 u32 radio_rx_get_and_reset_max_loop_time();
 u32 radio_rx_get_and_reset_max_loop_time_read();
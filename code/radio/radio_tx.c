@@ -33,89 +33,41 @@
 #include "../base/hw_procs.h"
 #include "../base/hardware_radio_sik.h"
 #include <pthread.h>
-#include <sys/types.h>
-#include <sys/ipc.h>
-#include <sys/msg.h>
 #include <errno.h>
 
 #include "../common/radio_stats.h"
 #include "../common/string_utils.h"
 #include "radio_tx.h"
+#include "radio_tx_serial_sched.h"
 #include "radiolink.h"
 #include "radio_duplicate_det.h"
 
-typedef struct
-{
-    long type; // type will be the local radio interface index to use for sending the message
-    char data[MAX_PACKET_TOTAL_SIZE];
-} type_ipc_message_tx_packet_buffer;
-
-
-
 int s_iRadioTxInitialized = 0;
 int s_iRadioTxSingalStop = 0;
 int s_iRadioTxMarkedForQuit = 0;
 int s_iRadioTxDevMode = 0;
-int s_iRadioTxIPCQueue = -1;
 int s_iRadioTxSiKPacketSize = DEFAULT_SIK_PACKET_SIZE;
 int s_iRadioTxSerialPacketSize[MAX_RADIO_INTERFACES];
 int s_iRadioTxSerialPacketSizeInitialized = 0;
 int s_iRadioTxInterfacesPaused[MAX_RADIO_INTERFACES];
+int s_iRadioTxSerialCoalescing = 0;
 
 int s_iDefaultTxThreadPriority = -1;
 int s_iCustomTxThreadPriority = DEFAULT_PRIORITY_THREAD_RADIO_TX;
 int s_iLastSetCustomTxThreadPriority = DEFAULT_PRIORITY_THREAD_RADIO_RX;
 
 pthread_t s_pThreadRadioTx;
-pthread_mutex_t s_pThreadRadioTxMutex;
+t_radio_tx_serial_sched s_RadioTxSerialSched;
 
-int _radio_tx_create_msg_queue()
+static int _radio_tx_write_short_packet(int iInterfaceIndex, u8* pData, int iLength, void* pContext)
 {
-   key_t key = generate_msgqueue_key(RADIO_TX_MESSAGE_QUEUE_ID);
-
-   if ( key < 0 )
-   {
-      log_softerror_and_alarm("[RadioTx] Failed to generate message queue key for ipc channel. Error: %d, %s",
-         errno, strerror(errno));
-      log_line("%d %d %d", ENOENT, EACCES, ENOTDIR);
-
-      char szFile[MAX_FILE_PATH_SIZE];
-      strcpy(szFile, FOLDER_BINARIES);
-      strcat(szFile, "ruby_start");
-      key = ftok(szFile, 107);
-
-      if ( key < 0 )
-      {
-         log_softerror_and_alarm("[RadioTx] Failed to generate (2) message queue key for ipc channel. Error: %d, %s",
-            errno, strerror(errno));
-         log_line("%d %d %d", ENOENT, EACCES, ENOTDIR);
-         return 0;
-      }
-   }
-
-   s_iRadioTxIPCQueue = msgget(key, IPC_CREAT | S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-
-   if ( s_iRadioTxIPCQueue < 0 )
-   {
-      log_softerror_and_alarm("[RadioTx] Failed to create IPC message queue, error %d, %s",
-         errno, strerror(errno));
-      log_line("%d %d %d", ENOENT, EACCES, ENOTDIR);
-      return 0;
-   }
-
-   log_line("[RadioTx] Created IPC msg queue, fd: %d, key: %x", s_iRadioTxIPCQueue, key);
-   return 1;
+   if ( hardware_radio_index_is_sik_radio(iInterfaceIndex) )
+      return radio_write_sik_packet(iInterfaceIndex, pData, iLength, get_current_timestamp_ms());
+   return radio_write_serial_packet(iInterfaceIndex, pData, iLength, get_current_timestamp_ms());
 }
 
-int _radio_tx_send_msg(int iInterfaceIndex, u8* pData, int iLength)
+static void _radio_tx_get_link_params(int iInterfaceIndex, int* piPacketSize, int* piAirBytesPerSec, void* pContext)
 {
-   // Split the packet into small serial packets and send it
-   // radio packet header is part of the total packet size, so take it into account
-   
-   t_packet_header_short PHS;
-   u8 uBuffer[1000];
-   int iTotalBytesSent = 0;
-
    if ( ! s_iRadioTxSerialPacketSizeInitialized )
    {
       s_iRadioTxSerialPacketSizeInitialized = 1;
@@ -123,55 +75,17 @@ int _radio_tx_send_msg(int iInterfaceIndex, u8* pData, int iLength)
          s_iRadioTxSerialPacketSize[i] = DEFAULT_RADIO_SERIAL_AIR_PACKET_SIZE;
    }
 
-   int iUsableDataBytesInEachPacket = s_iRadioTxSerialPacketSize[iInterfaceIndex] - sizeof(t_packet_header_short);
+   *piPacketSize = s_iRadioTxSerialPacketSize[iInterfaceIndex];
+   *piAirBytesPerSec = 0;
    if ( hardware_radio_index_is_sik_radio(iInterfaceIndex) )
-      iUsableDataBytesInEachPacket = s_iRadioTxSiKPacketSize - sizeof(t_packet_header_short);
-
-   int iBytesLeftToSend = iLength;
-   u8* pDataToSend = pData;
-
-   while ( iBytesLeftToSend > 0 )
    {
-      radio_packet_short_init(&PHS);
-
-      PHS.start_header = SHORT_PACKET_START_BYTE_REG_PACKET;
-      if ( pData == pDataToSend )
-         PHS.start_header = SHORT_PACKET_START_BYTE_START_PACKET;
-      if ( iBytesLeftToSend <= iUsableDataBytesInEachPacket ) 
-         PHS.start_header = SHORT_PACKET_START_BYTE_END_PACKET;
-
-      int iShortPacketDataSize = iUsableDataBytesInEachPacket;
-      if ( iBytesLeftToSend <= iUsableDataBytesInEachPacket )
-         iShortPacketDataSize = iBytesLeftToSend;
-
-      PHS.packet_id = radio_packets_short_get_next_id_for_radio_interface(iInterfaceIndex);
-      PHS.data_length = (u8)iShortPacketDataSize;
-      memcpy(uBuffer, (u8*)&PHS, sizeof(t_packet_header_short));
-      memcpy(&uBuffer[sizeof(t_packet_header_short)], pDataToSend, iShortPacketDataSize);
-
-      iBytesLeftToSend -= iShortPacketDataSize;
-      pDataToSend += iShortPacketDataSize;
-
-      iShortPacketDataSize += sizeof(t_packet_header_short);
-      uBuffer[1] = base_compute_crc8(&uBuffer[2], iShortPacketDataSize - 2);
-      
-      int iWriteResult = 0;
-      if ( hardware_radio_index_is_sik_radio(iInterfaceIndex) )
-         iWriteResult = radio_write_sik_packet(iInterfaceIndex, uBuffer, iShortPacketDataSize, get_current_timestamp_ms());
-      else
-         iWriteResult = radio_write_serial_packet(iInterfaceIndex, uBuffer, iShortPacketDataSize, get_current_timestamp_ms());
-      if ( iWriteResult != iShortPacketDataSize )
-      {
-         log_softerror_and_alarm("[RadioTx] Failed to send message to serial radio: sent %d bytes, only %d bytes written.",
-            iShortPacketDataSize, iWriteResult);
-         if ( iWriteResult > 0 )
-            iTotalBytesSent += iWriteResult;
-         continue; 
-      }
-      iTotalBytesSent += iWriteResult;
-      hardware_sleep_micros(500);
+      *piPacketSize = s_iRadioTxSiKPacketSize;
+      *piAirBytesPerSec = hardware_radio_sik_get_air_baudrate_in_bytes(iInterfaceIndex);
+      return;
    }
-   return 1;
+   radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(iInterfaceIndex);
+   if ( (NULL != pRadioHWInfo) && (pRadioHWInfo->iCurrentDataRateBPS > 0) )
+      *piAirBytesPerSec = pRadioHWInfo->iCurrentDataRateBPS/8;
 }
 
 static void * _thread_radio_tx(void *argument)
@@ -191,20 +105,13 @@ static void * _thread_radio_tx(void *argument)
    log_line("[RadioTxThread] Initialized State. Waiting for tx messages...");
 
    int* piQuit = (int*) argument;
-   u32 uWaitTime = 1;
    while ( 1 )
    {
-      hardware_sleep_ms(uWaitTime);
-      if ( uWaitTime < 30 )
-         uWaitTime += 5;
-      
       if ( (NULL != piQuit) && (*piQuit != 0 ) )
       {
          log_line("[RadioTxThread] Signaled to stop.");
          break;
       }
-      if ( s_iRadioTxIPCQueue < 0 )
-         continue;
 
       if ( s_iLastSetCustomTxThreadPriority != s_iCustomTxThreadPriority )
       {
@@ -217,36 +124,12 @@ static void * _thread_radio_tx(void *argument)
             hw_increase_current_thread_priority("[RadioTxThread]", s_iDefaultTxThreadPriority);
       }
 
-      type_ipc_message_tx_packet_buffer ipcMessage;
-      int iIPCLength = msgrcv(s_iRadioTxIPCQueue, &ipcMessage, sizeof(ipcMessage), 0, MSG_NOERROR | IPC_NOWAIT);
-      if ( iIPCLength <= 2 )
-         continue;
-      
-      if ( iIPCLength > MAX_PACKET_TOTAL_SIZE )
-      {
-         log_softerror_and_alarm("[RadioTx] Read IPC message too big (%d bytes), skipping it.", iIPCLength);
-         continue;
-      }
-
-      if ( (ipcMessage.type < 0) || (ipcMessage.type >= hardware_get_radio_interfaces_count()) )
-      {
-         log_softerror_and_alarm("[RadioTx] Read IPC message for invalid radio interface %d, skipping it.", ipcMessage.type+1);
-         continue;
-      }
-
-      if ( s_iRadioTxInterfacesPaused[ipcMessage.type] )
-         continue;
-        
-      if ( ! hardware_radio_index_is_serial_radio(ipcMessage.type) )
+      // Sleeps until a message is queued or pacing allows the next write
+      if ( radio_tx_serial_sched_run(&s_RadioTxSerialSched, 100000) < 0 )
       {
-         log_softerror_and_alarm("[RadioTx] Read IPC message for radio interface %d which is not a serial radio, skipping it.", ipcMessage.type+1);
-         continue;
+         log_line("[RadioTxThread] Signaled to stop.");
+         break;
       }
-
-      uWaitTime = 1;
-
-      _radio_tx_send_msg(ipcMessage.type, (u8*)ipcMessage.data, iIPCLength);
-      
    }
 
    log_line("[RadioTxThread] Stopped.");
@@ -270,17 +153,18 @@ int radio_tx_start_tx_thread()
          s_iRadioTxSerialPacketSize[i] = DEFAULT_RADIO_SERIAL_AIR_PACKET_SIZE;
    }
 
-   _radio_tx_create_msg_queue();
-
-   if ( 0 != pthread_mutex_init(&s_pThreadRadioTxMutex, NULL) )
+   if ( ! radio_tx_serial_sched_init(&s_RadioTxSerialSched, _radio_tx_write_short_packet, _radio_tx_get_link_params, NULL) )
    {
-      log_error_and_alarm("[RadioTx] Failed to init mutex.");
+      log_error_and_alarm("[RadioTx] Failed to init serial radio tx scheduler.");
       return 0;
    }
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+      radio_tx_serial_sched_set_coalescing(&s_RadioTxSerialSched, i, s_iRadioTxSerialCoalescing);
 
    if ( 0 != pthread_create(&s_pThreadRadioTx, NULL, &_thread_radio_tx, (void*)&s_iRadioTxSingalStop) )
    {
-      log_error_and_alarm("[RadioTx] Failed to create thread for radio rx.");
+      log_error_and_alarm("[RadioTx] Failed to create thread for radio tx.");
+      radio_tx_serial_sched_uninit(&s_RadioTxSerialSched);
       return 0;
    }
 
@@ -299,15 +183,9 @@ void radio_tx_stop_tx_thread()
    s_iRadioTxSingalStop = 1;
    s_iRadioTxInitialized = 0;
 
-   pthread_mutex_lock(&s_pThreadRadioTxMutex);
-   pthread_mutex_unlock(&s_pThreadRadioTxMutex);
-
-   pthread_cancel(s_pThreadRadioTx);
-   pthread_mutex_destroy(&s_pThreadRadioTxMutex);
-
-   if ( s_iRadioTxIPCQueue >= 0 )
-      msgctl(s_iRadioTxIPCQueue, IPC_RMID, NULL);
-   s_iRadioTxIPCQueue = -1;
+   radio_tx_serial_sched_signal_stop(&s_RadioTxSerialSched);
+   pthread_join(s_pThreadRadioTx, NULL);
+   radio_tx_serial_sched_uninit(&s_RadioTxSerialSched);
 }
 
 void radio_tx_mark_quit()
@@ -332,6 +210,8 @@ void radio_tx_pause_radio_interface(int iRadioInterfaceIndex, const char* szReas
    if ( (iRadioInterfaceIndex < 0) || (iRadioInterfaceIndex >= MAX_RADIO_INTERFACES) )
       return;
    s_iRadioTxInterfacesPaused[iRadioInterfaceIndex]++;
+   if ( s_iRadioTxInitialized )
+      radio_tx_serial_sched_set_paused(&s_RadioTxSerialSched, iRadioInterfaceIndex, 1);
 
 
    radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(iRadioInterfaceIndex);
@@ -355,6 +235,8 @@ void radio_tx_resume_radio_interface(int iRadioInterfaceIndex)
 
    if ( s_iRadioTxInterfacesPaused[iRadioInterfaceIndex] > 0 )
       s_iRadioTxInterfacesPaused[iRadioInterfaceIndex]--;
+   if ( s_iRadioTxInitialized && (0 == s_iRadioTxInterfacesPaused[iRadioInterfaceIndex]) )
+      radio_tx_serial_sched_set_paused(&s_RadioTxSerialSched, iRadioInterfaceIndex, 0);
 
    radio_hw_info_t* pRadioHWInfo = hardware_get_radio_info(iRadioInterfaceIndex);
 
@@ -398,6 +280,16 @@ void radio_tx_set_serial_packet_size(int iRadioInterfaceIndex, int iSerialPacket
    }
 }
 
+void radio_tx_set_serial_coalescing(int iEnable)
+{
+   s_iRadioTxSerialCoalescing = iEnable;
+   log_line("[RadioTx] Set serial messages coalescing: %s", iEnable?"on":"off");
+   if ( ! s_iRadioTxInitialized )
+      return;
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+      radio_tx_serial_sched_set_coalescing(&s_RadioTxSerialSched, i, iEnable);
+}
+
 // Sends a regular radio packet to serial radios. 
 // Returns 1 for success.
 int radio_tx_send_serial_radio_packet(int iRadioInterfaceIndex, u8* pData, int iDataLength)
@@ -414,54 +306,20 @@ int radio_tx_send_serial_radio_packet(int iRadioInterfaceIndex, u8* pData, int i
       return -1;
    }
    
-   if ( s_iRadioTxIPCQueue < 0 )
+   if ( ! hardware_radio_index_is_serial_radio(iRadioInterfaceIndex) )
    {
-      log_softerror_and_alarm("[RadioTx] Tried to write serial packet with no IPC opened.");
-      if ( ! _radio_tx_create_msg_queue() )
-         return -1;
+      log_softerror_and_alarm("[RadioTx] Tried to write serial packet to radio interface %d which is not a serial radio.", iRadioInterfaceIndex+1);
+      return -1;
    }
 
-   type_ipc_message_tx_packet_buffer msg;
-
-   msg.type = iRadioInterfaceIndex;
-   memcpy((u8*)&(msg.data[0]), pData, iDataLength); 
-   
-   int iRetryCounter = 2;
-   int iSucceeded = 0;
-   do
+   if ( ! s_iRadioTxInitialized )
    {
-      if ( 0 == msgsnd(s_iRadioTxIPCQueue, &msg, iDataLength, IPC_NOWAIT) )
-      {
-         iSucceeded = 1;
-         iRetryCounter = 0;
-         break;
-      }
-      
-      if ( errno == EAGAIN )
-         log_softerror_and_alarm("[RadioTx] Failed to write to IPC, error code: EAGAIN" );
-      if ( errno == EACCES )
-         log_softerror_and_alarm("[RadioTx] Failed to write to IPC, error code: EACCESS");
-      if ( errno == EIDRM )
-         log_softerror_and_alarm("[RadioTx] Failed to write to IPC, error code: EIDRM");
-      if ( errno == EINVAL )
-         log_softerror_and_alarm("[RadioTx] Failed to write to IPC, error code: EINVAL");
-
-      struct msqid_ds msg_stats;
-      if ( 0 != msgctl(s_iRadioTxIPCQueue, IPC_STAT, &msg_stats) )
-         log_softerror_and_alarm("[RadioTx] Failed to get statistics on ICP message queue, fd %d",
-            s_iRadioTxIPCQueue );
-      else
-      {
-         log_line("[RadioTx] IPC Info (fd %d) info: %u pending messages, %u used bytes, max bytes in the IPC channel: %u bytes",
-            s_iRadioTxIPCQueue, (u32)msg_stats.msg_qnum, (u32)msg_stats.msg_cbytes, (u32)msg_stats.msg_qbytes);
-      }
-      
-      iRetryCounter--;
-      hardware_sleep_ms(5);
-
-   } while (iRetryCounter > 0);
+      log_softerror_and_alarm("[RadioTx] Tried to write serial packet with no tx thread running.");
+      return -1;
+   }
 
-   if ( iSucceeded )
-     return 1;
-   return -1;
+   // Messages for paused interfaces are discarded
+   if ( radio_tx_serial_sched_enqueue(&s_RadioTxSerialSched, iRadioInterfaceIndex, pData, iDataLength) < 0 )
+      return -1;
+   return 1;
 }
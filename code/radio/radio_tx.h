@@ -19,6 +19,12 @@ void radio_tx_resume_radio_interface(int iRadioInterfaceIndex);
 void radio_tx_set_sik_packet_size(int iSiKPacketSize);
 void radio_tx_set_serial_packet_size(int iRadioInterfaceIndex, int iSerialPacketSize);
 
+// First software build whose serial receiver keeps the bytes following a completed message
+#define RADIO_TX_SERIAL_COALESCING_MIN_SW_BUILD 240
+
+// Allows several messages in the same serial short packet. Only enable it if the peer supports it.
+void radio_tx_set_serial_coalescing(int iEnable);
+
 // Sends a regular radio packet to serial radios.
 // Returns 1 for success.
 int radio_tx_send_serial_radio_packet(int iRadioInterfaceIndex, u8* pData, int iDataLength);
@@ -0,0 +1,145 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "../base/base.h"
+#include "../base/config.h"
+#include "radio_tx_aggregator.h"
+
+void radio_tx_aggregator_init(t_radio_tx_aggregator* pAggregator, int iMaxFrameSize)
+{
+   if ( NULL == pAggregator )
+      return;
+   memset(pAggregator, 0, sizeof(t_radio_tx_aggregator));
+   if ( (iMaxFrameSize <= 0) || (iMaxFrameSize > MAX_PACKET_TOTAL_SIZE) )
+      iMaxFrameSize = MAX_PACKET_TOTAL_SIZE;
+   pAggregator->iMaxFrameSizeLimit = iMaxFrameSize;
+   pAggregator->iMaxFrameSize = iMaxFrameSize;
+}
+
+void radio_tx_aggregator_set_datarate(t_radio_tx_aggregator* pAggregator, int iDataRateBPS)
+{
+   if ( NULL == pAggregator )
+      return;
+   if ( 0 == iDataRateBPS )
+   {
+      pAggregator->iMaxFrameSize = pAggregator->iMaxFrameSizeLimit;
+      return;
+   }
+   u32 uRealDataRate = getRealDataRateFromRadioDataRate(iDataRateBPS, 0);
+   int iMaxFrameSize = (int)((uRealDataRate/8/1000) * RADIO_TX_AGGREGATOR_AIRTIME_BUDGET_MICROS / 1000);
+   if ( iMaxFrameSize < RADIO_TX_AGGREGATOR_MIN_FRAME_SIZE )
+      iMaxFrameSize = RADIO_TX_AGGREGATOR_MIN_FRAME_SIZE;
+   if ( iMaxFrameSize > pAggregator->iMaxFrameSizeLimit )
+      iMaxFrameSize = pAggregator->iMaxFrameSizeLimit;
+   pAggregator->iMaxFrameSize = iMaxFrameSize;
+}
+
+int radio_tx_aggregator_can_aggregate_packet(u8* pPacket, int iLength)
+{
+   if ( (NULL == pPacket) || (iLength < (int)sizeof(t_packet_header)) )
+      return 0;
+   t_packet_header* pPH = (t_packet_header*)pPacket;
+   if ( (pPH->total_length != iLength) || (iLength > RADIO_TX_AGGREGATOR_MAX_SMALL_PACKET_SIZE) )
+      return 0;
+
+   u32 uStreamId = (pPH->stream_packet_idx) >> PACKET_FLAGS_MASK_SHIFT_STREAM_INDEX;
+   if ( uStreamId >= STREAM_ID_VIDEO_1 )
+      return 0;
+   if ( pPH->packet_flags & PACKET_FLAGS_BIT_RETRANSMITED )
+      return 0;
+
+   // The radio links used for a frame are picked from its packets; these must choose them alone
+   if ( pPH->packet_flags_extended & (PACKET_FLAGS_EXTENDED_BIT_SEND_ON_LOW_CAPACITY_LINK_ONLY | PACKET_FLAGS_EXTENDED_BIT_SEND_ON_HIGH_CAPACITY_LINK_ONLY) )
+      return 0;
+
+   switch ( pPH->packet_type )
+   {
+      // Time critical or single radio link packets
+      case PACKET_TYPE_RUBY_PING_CLOCK:
+      case PACKET_TYPE_RUBY_PING_CLOCK_REPLY:
+      case PACKET_TYPE_TEST_RADIO_LINK:
+      // Logged and tracked per radio frame by the senders
+      case PACKET_TYPE_RUBY_MODEL_SETTINGS:
+      case PACKET_TYPE_COMMAND_RESPONSE:
+         return 0;
+      default:
+         break;
+   }
+   if ( radio_packet_type_is_high_priority(pPH->packet_type) )
+      return 0;
+   return 1;
+}
+
+int radio_tx_aggregator_add_packet(t_radio_tx_aggregator* pAggregator, u8* pPacket, int iLength)
+{
+   if ( (NULL == pAggregator) || (NULL == pPacket) || (iLength <= 0) )
+      return 0;
+   t_packet_header* pPH = (t_packet_header*)pPacket;
+   if ( pAggregator->iCountPackets > 0 )
+   {
+      if ( pPH->vehicle_id_dest != pAggregator->uVehicleIdDest )
+         return 0;
+      if ( pAggregator->iLength + iLength > pAggregator->iMaxFrameSize )
+         return 0;
+   }
+   if ( pAggregator->iLength + iLength > MAX_PACKET_TOTAL_SIZE )
+      return 0;
+
+   memcpy(&(pAggregator->uBuffer[pAggregator->iLength]), pPacket, iLength);
+   pAggregator->iLength += iLength;
+   pAggregator->iCountPackets++;
+   pAggregator->uVehicleIdDest = pPH->vehicle_id_dest;
+   return 1;
+}
+
+int radio_tx_aggregator_has_packets(t_radio_tx_aggregator* pAggregator)
+{
+   if ( NULL == pAggregator )
+      return 0;
+   return pAggregator->iCountPackets;
+}
+
+void radio_tx_aggregator_on_frame_sent(t_radio_tx_aggregator* pAggregator)
+{
+   if ( (NULL == pAggregator) || (0 == pAggregator->iCountPackets) )
+      return;
+   pAggregator->stats.uCountPackets += pAggregator->iCountPackets;
+   pAggregator->stats.uCountFrames++;
+   if ( pAggregator->iCountPackets > 1 )
+   {
+      pAggregator->stats.uCountAggregatedFrames++;
+      pAggregator->stats.uCountAggregatedPackets += pAggregator->iCountPackets;
+   }
+   pAggregator->iLength = 0;
+   pAggregator->iCountPackets = 0;
+   pAggregator->uVehicleIdDest = 0;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "../base/base.h"
+#include "radiopackets2.h"
+
+// Aggregates small radio packets (telemetry, commands, RC, link control) that are pending at the same
+// time into a single radio frame, so they share one radio/ieee header, one preamble and one channel
+// access instead of each paying for them. The receivers already split composed radio frames.
+// Packets are never held back waiting for more packets: only the ones already queued when the sender
+// runs are aggregated, so there is no added latency.
+// The aggregated frame size adapts to the radio data rate, so a frame stays under an airtime budget
+// (a lost frame takes less data with it on slow links).
+
+// Max airtime for an aggregated frame
+#define RADIO_TX_AGGREGATOR_AIRTIME_BUDGET_MICROS 1000
+// Aggregated frames can always be at least this long, whatever the data rate
+#define RADIO_TX_AGGREGATOR_MIN_FRAME_SIZE 250
+// Larger packets are always sent in their own radio frame
+#define RADIO_TX_AGGREGATOR_MAX_SMALL_PACKET_SIZE 400
+
+typedef struct
+{
+   u32 uCountPackets;
+   u32 uCountFrames;
+   u32 uCountAggregatedFrames; // frames with more than one packet
+   u32 uCountAggregatedPackets; // packets sent in frames with more than one packet
+} t_radio_tx_aggregator_stats;
+
+typedef struct
+{
+   u8 uBuffer[MAX_PACKET_TOTAL_SIZE];
+   int iLength;
+   int iCountPackets;
+   int iMaxFrameSize; // adapted to the data rate
+   int iMaxFrameSizeLimit; // set by the owner
+   u32 uVehicleIdDest;
+   t_radio_tx_aggregator_stats stats;
+} t_radio_tx_aggregator;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void radio_tx_aggregator_init(t_radio_tx_aggregator* pAggregator, int iMaxFrameSize);
+// iDataRateBPS: radio data rate used for data packets (bps, or negative for MCS rates), 0 if not known
+void radio_tx_aggregator_set_datarate(t_radio_tx_aggregator* pAggregator, int iDataRateBPS);
+// Returns 1 if the packet can share a radio frame with other packets
+int radio_tx_aggregator_can_aggregate_packet(u8* pPacket, int iLength);
+// Returns 1 if the packet was added, 0 if it does not fit with the pending ones (send the pending frame first)
+int radio_tx_aggregator_add_packet(t_radio_tx_aggregator* pAggregator, u8* pPacket, int iLength);
+int radio_tx_aggregator_has_packets(t_radio_tx_aggregator* pAggregator);
+// Call after the pending frame (uBuffer, iLength) was sent; clears it and updates the stats
+void radio_tx_aggregator_on_frame_sent(t_radio_tx_aggregator* pAggregator);
+
+#ifdef __cplusplus
+}
+#endif
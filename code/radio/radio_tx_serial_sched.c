@@ -0,0 +1,460 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "radio_tx_serial_sched.h"
+#include "radiopackets_short.h"
+#include <time.h>
+
+int radio_tx_serial_sched_get_priority(u8* pData, int iLength)
+{
+   if ( (NULL == pData) || (iLength < (int)sizeof(t_packet_header)) )
+      return RADIO_TX_SERIAL_PRIORITY_NORMAL;
+
+   t_packet_header* pPH = (t_packet_header*)pData;
+   switch ( pPH->packet_flags & PACKET_FLAGS_MASK_MODULE )
+   {
+      case PACKET_COMPONENT_RC:
+      case PACKET_COMPONENT_COMMANDS:
+         return RADIO_TX_SERIAL_PRIORITY_HIGH;
+      case PACKET_COMPONENT_TELEMETRY:
+      case PACKET_COMPONENT_VIDEO:
+      case PACKET_COMPONENT_AUDIO:
+      case PACKET_COMPONENT_DATA:
+         return RADIO_TX_SERIAL_PRIORITY_LOW;
+   }
+   return RADIO_TX_SERIAL_PRIORITY_NORMAL;
+}
+
+static void _radio_tx_serial_sched_free_message(t_radio_tx_serial_sched* pSched, int iMessage)
+{
+   pSched->messages[iMessage].iNext = pSched->iFreeMessages;
+   pSched->iFreeMessages = iMessage;
+}
+
+static int _radio_tx_serial_sched_pop_message(t_radio_tx_serial_sched* pSched, int iInterfaceIndex, int iPriority)
+{
+   int iMessage = pSched->iQueueHead[iInterfaceIndex][iPriority];
+   if ( iMessage < 0 )
+      return -1;
+   pSched->iQueueHead[iInterfaceIndex][iPriority] = pSched->messages[iMessage].iNext;
+   if ( pSched->iQueueHead[iInterfaceIndex][iPriority] < 0 )
+      pSched->iQueueTail[iInterfaceIndex][iPriority] = -1;
+   pSched->messages[iMessage].iNext = -1;
+   return iMessage;
+}
+
+// Highest priority queue that has messages on the interface, or -1
+static int _radio_tx_serial_sched_get_next_queue(t_radio_tx_serial_sched* pSched, int iInterfaceIndex)
+{
+   for( int iPriority=0; iPriority<RADIO_TX_SERIAL_PRIORITIES; iPriority++ )
+   {
+      if ( pSched->iQueueHead[iInterfaceIndex][iPriority] >= 0 )
+         return iPriority;
+   }
+   return -1;
+}
+
+static int _radio_tx_serial_sched_has_pending_data(t_radio_tx_serial_sched* pSched, int iInterfaceIndex)
+{
+   if ( pSched->iPaused[iInterfaceIndex] )
+      return 0;
+   if ( pSched->iCurrentMessage[iInterfaceIndex] >= 0 )
+      return 1;
+   if ( _radio_tx_serial_sched_get_next_queue(pSched, iInterfaceIndex) >= 0 )
+      return 1;
+   return 0;
+}
+
+static void _radio_tx_serial_sched_flush_interface(t_radio_tx_serial_sched* pSched, int iInterfaceIndex)
+{
+   if ( pSched->iCurrentMessage[iInterfaceIndex] >= 0 )
+      _radio_tx_serial_sched_free_message(pSched, pSched->iCurrentMessage[iInterfaceIndex]);
+   pSched->iCurrentMessage[iInterfaceIndex] = -1;
+   pSched->iCurrentMessageOffset[iInterfaceIndex] = 0;
+   for( int iPriority=0; iPriority<RADIO_TX_SERIAL_PRIORITIES; iPriority++ )
+   {
+      int iMessage;
+      while ( (iMessage = _radio_tx_serial_sched_pop_message(pSched, iInterfaceIndex, iPriority)) >= 0 )
+         _radio_tx_serial_sched_free_message(pSched, iMessage);
+   }
+}
+
+// Queue is full: drop the oldest message of the lowest priority class (not above iPriority) to make room
+static int _radio_tx_serial_sched_drop_for_priority(t_radio_tx_serial_sched* pSched, int iPriority)
+{
+   for( int iPrio=RADIO_TX_SERIAL_PRIORITIES-1; iPrio>=iPriority; iPrio-- )
+   {
+      for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+      {
+         int iMessage = _radio_tx_serial_sched_pop_message(pSched, i, iPrio);
+         if ( iMessage < 0 )
+            continue;
+         _radio_tx_serial_sched_free_message(pSched, iMessage);
+         pSched->stats.uCountMessagesDropped++;
+         return 1;
+      }
+   }
+   return 0;
+}
+
+int radio_tx_serial_sched_init(t_radio_tx_serial_sched* pSched, radio_tx_serial_write_callback pWriteCallback, radio_tx_serial_link_callback pLinkCallback, void* pContext)
+{
+   if ( (NULL == pSched) || (NULL == pWriteCallback) || (NULL == pLinkCallback) )
+      return 0;
+
+   pSched->iInitialized = 0;
+   pSched->iStop = 0;
+   pSched->pWriteCallback = pWriteCallback;
+   pSched->pLinkCallback = pLinkCallback;
+   pSched->pContext = pContext;
+
+   pSched->iFreeMessages = -1;
+   for( int i=RADIO_TX_SERIAL_MAX_QUEUED_MESSAGES-1; i>=0; i-- )
+      _radio_tx_serial_sched_free_message(pSched, i);
+
+   for( int i=0; i<MAX_RADIO_INTERFACES; i++ )
+   {
+      for( int iPriority=0; iPriority<RADIO_TX_SERIAL_PRIORITIES; iPriority++ )
+      {
+         pSched->iQueueHead[i][iPriority] = -1;
+         pSched->iQueueTail[i][iPriority] = -1;
+      }
+      pSched->iCurrentMessage[i] = -1;
+      pSched->iCurrentMessageOffset[i] = 0;
+      pSched->iPaused[i] = 0;
+      pSched->iCoalesce[i] = 0;
+      pSched->uNextSendTimeMicros[i] = get_current_timestamp_micros();
+   }
+   pSched->iLastInterface = 0;
+   memset(&pSched->stats, 0, sizeof(pSched->stats));
+
+   if ( 0 != pthread_mutex_init(&pSched->mutex, NULL) )
+   {
+      log_softerror_and_alarm("[RadioTxSerialSched] Failed to init mutex.");
+      return 0;
+   }
+
+   pthread_condattr_t attr;
+   pthread_condattr_init(&attr);
+   pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+   if ( 0 != pthread_cond_init(&pSched->cond, &attr) )
+   {
+      pthread_condattr_destroy(&attr);
+      pthread_mutex_destroy(&pSched->mutex);
+      log_softerror_and_alarm("[RadioTxSerialSched] Failed to init condition.");
+      return 0;
+   }
+   pthread_condattr_destroy(&attr);
+   pSched->iInitialized = 1;
+   return 1;
+}
+
+void radio_tx_serial_sched_uninit(t_radio_tx_serial_sched* pSched)
+{
+   if ( (NULL == pSched) || (! pSched->iInitialized) )
+      return;
+   pSched->iInitialized = 0;
+   log_line("[RadioTxSerialSched] Messages queued: %u, sent: %u, dropped: %u; short packets: %u (%u coalesced), %u bytes, %u write errors",
+      pSched->stats.uCountMessagesQueued, pSched->stats.uCountMessagesSent, pSched->stats.uCountMessagesDropped,
+      pSched->stats.uCountShortPackets, pSched->stats.uCountShortPacketsCoalesced, pSched->stats.uCountBytesWritten, pSched->stats.uCountWriteErrors);
+   pthread_cond_destroy(&pSched->cond);
+   pthread_mutex_destroy(&pSched->mutex);
+}
+
+int radio_tx_serial_sched_enqueue(t_radio_tx_serial_sched* pSched, int iInterfaceIndex, u8* pData, int iLength)
+{
+   if ( (NULL == pSched) || (! pSched->iInitialized) )
+      return -1;
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return -1;
+   if ( (NULL == pData) || (iLength <= 0) || (iLength > MAX_PACKET_TOTAL_SIZE) )
+      return -1;
+
+   int iPriority = radio_tx_serial_sched_get_priority(pData, iLength);
+
+   pthread_mutex_lock(&pSched->mutex);
+   if ( pSched->iPaused[iInterfaceIndex] )
+   {
+      pthread_mutex_unlock(&pSched->mutex);
+      return 0;
+   }
+
+   if ( (pSched->iFreeMessages < 0) && (! _radio_tx_serial_sched_drop_for_priority(pSched, iPriority)) )
+   {
+      pthread_mutex_unlock(&pSched->mutex);
+      log_softerror_and_alarm("[RadioTxSerialSched] Tx queue is full, discarded message (%d bytes) for radio interface %d.", iLength, iInterfaceIndex+1);
+      return -1;
+   }
+
+   int iMessage = pSched->iFreeMessages;
+   pSched->iFreeMessages = pSched->messages[iMessage].iNext;
+   pSched->messages[iMessage].iNext = -1;
+   pSched->messages[iMessage].iLength = iLength;
+   memcpy(pSched->messages[iMessage].uData, pData, iLength);
+
+   if ( pSched->iQueueTail[iInterfaceIndex][iPriority] >= 0 )
+      pSched->messages[pSched->iQueueTail[iInterfaceIndex][iPriority]].iNext = iMessage;
+   else
+      pSched->iQueueHead[iInterfaceIndex][iPriority] = iMessage;
+   pSched->iQueueTail[iInterfaceIndex][iPriority] = iMessage;
+   pSched->stats.uCountMessagesQueued++;
+
+   pthread_cond_signal(&pSched->cond);
+   pthread_mutex_unlock(&pSched->mutex);
+   return 1;
+}
+
+void radio_tx_serial_sched_set_coalescing(t_radio_tx_serial_sched* pSched, int iInterfaceIndex, int iEnable)
+{
+   if ( (NULL == pSched) || (! pSched->iInitialized) )
+      return;
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return;
+
+   pthread_mutex_lock(&pSched->mutex);
+   pSched->iCoalesce[iInterfaceIndex] = iEnable;
+   pthread_mutex_unlock(&pSched->mutex);
+}
+
+void radio_tx_serial_sched_set_paused(t_radio_tx_serial_sched* pSched, int iInterfaceIndex, int iPaused)
+{
+   if ( (NULL == pSched) || (! pSched->iInitialized) )
+      return;
+   if ( (iInterfaceIndex < 0) || (iInterfaceIndex >= MAX_RADIO_INTERFACES) )
+      return;
+
+   pthread_mutex_lock(&pSched->mutex);
+   pSched->iPaused[iInterfaceIndex] = iPaused;
+   if ( iPaused )
+      _radio_tx_serial_sched_flush_interface(pSched, iInterfaceIndex);
+   pthread_cond_signal(&pSched->cond);
+   pthread_mutex_unlock(&pSched->mutex);
+}
+
+void radio_tx_serial_sched_signal_stop(t_radio_tx_serial_sched* pSched)
+{
+   if ( (NULL == pSched) || (! pSched->iInitialized) )
+      return;
+   pthread_mutex_lock(&pSched->mutex);
+   pSched->iStop = 1;
+   pthread_cond_broadcast(&pSched->cond);
+   pthread_mutex_unlock(&pSched->mutex);
+}
+
+// Fills a short packet with pending data for the interface. Returns the short packet size (header included).
+static int _radio_tx_serial_sched_build_short_packet(t_radio_tx_serial_sched* pSched, int iInterfaceIndex, int iPacketSize, u8* pOutput)
+{
+   int iUsableBytes = iPacketSize - (int)sizeof(t_packet_header_short);
+   u8* pData = pOutput + sizeof(t_packet_header_short);
+   int iUsedBytes = 0;
+   int iCountMessages = 0;
+   int iStartsWithMessage = 0;
+   int iEndsWithMessage = 0;
+
+   // Continue the message already started
+   int iMessage = pSched->iCurrentMessage[iInterfaceIndex];
+   if ( iMessage >= 0 )
+   {
+      t_radio_tx_serial_message* pMessage = &pSched->messages[iMessage];
+      int iBytes = pMessage->iLength - pSched->iCurrentMessageOffset[iInterfaceIndex];
+      if ( iBytes > iUsableBytes )
+         iBytes = iUsableBytes;
+      memcpy(pData, &pMessage->uData[pSched->iCurrentMessageOffset[iInterfaceIndex]], iBytes);
+      iUsedBytes += iBytes;
+      iCountMessages++;
+      pSched->iCurrentMessageOffset[iInterfaceIndex] += iBytes;
+      if ( pSched->iCurrentMessageOffset[iInterfaceIndex] >= pMessage->iLength )
+      {
+         _radio_tx_serial_sched_free_message(pSched, iMessage);
+         pSched->iCurrentMessage[iInterfaceIndex] = -1;
+         pSched->iCurrentMessageOffset[iInterfaceIndex] = 0;
+         pSched->stats.uCountMessagesSent++;
+         iEndsWithMessage = 1;
+      }
+   }
+   else
+      iStartsWithMessage = 1;
+
+   // Add the next messages, in priority order.
+   // A message that would fit in a short packet by itself is not split, it goes in the next short packet.
+   // Without coalescing, each message starts on a fresh short packet.
+   while ( (iUsedBytes < iUsableBytes) && (pSched->iCurrentMessage[iInterfaceIndex] < 0) )
+   {
+      if ( (iUsedBytes > 0) && (! pSched->iCoalesce[iInterfaceIndex]) )
+         break;
+      int iPriority = _radio_tx_serial_sched_get_next_queue(pSched, iInterfaceIndex);
+      if ( iPriority < 0 )
+         break;
+      t_radio_tx_serial_message* pMessage = &pSched->messages[pSched->iQueueHead[iInterfaceIndex][iPriority]];
+      int iFreeBytes = iUsableBytes - iUsedBytes;
+      if ( (pMessage->iLength > iFreeBytes) && (iUsedBytes > 0) && (pMessage->iLength <= iUsableBytes) )
+         break;
+
+      iMessage = _radio_tx_serial_sched_pop_message(pSched, iInterfaceIndex, iPriority);
+      int iBytes = pMessage->iLength;
+      if ( iBytes > iFreeBytes )
+         iBytes = iFreeBytes;
+      memcpy(pData + iUsedBytes, pMessage->uData, iBytes);
+      iUsedBytes += iBytes;
+      iCountMessages++;
+      if ( iBytes < pMessage->iLength )
+      {
+         pSched->iCurrentMessage[iInterfaceIndex] = iMessage;
+         pSched->iCurrentMessageOffset[iInterfaceIndex] = iBytes;
+         iEndsWithMessage = 0;
+      }
+      else
+      {
+         _radio_tx_serial_sched_free_message(pSched, iMessage);
+         pSched->stats.uCountMessagesSent++;
+         iEndsWithMessage = 1;
+      }
+   }
+
+   if ( 0 == iUsedBytes )
+      return 0;
+
+   t_packet_header_short* pPHS = (t_packet_header_short*)pOutput;
+   radio_packet_short_init(pPHS);
+   pPHS->start_header = SHORT_PACKET_START_BYTE_REG_PACKET;
+   if ( iStartsWithMessage )
+      pPHS->start_header = SHORT_PACKET_START_BYTE_START_PACKET;
+   else if ( iEndsWithMessage )
+      pPHS->start_header = SHORT_PACKET_START_BYTE_END_PACKET;
+   pPHS->packet_id = radio_packets_short_get_next_id_for_radio_interface(iInterfaceIndex);
+   pPHS->data_length = (u8)iUsedBytes;
+
+   int iTotalLength = iUsedBytes + (int)sizeof(t_packet_header_short);
+   pOutput[1] = base_compute_crc8(&pOutput[2], iTotalLength - 2);
+
+   pSched->stats.uCountShortPackets++;
+   if ( iCountMessages > 1 )
+      pSched->stats.uCountShortPacketsCoalesced++;
+   return iTotalLength;
+}
+
+int radio_tx_serial_sched_run(t_radio_tx_serial_sched* pSched, u32 uMaxWaitMicros)
+{
+   if ( (NULL == pSched) || (! pSched->iInitialized) )
+      return -1;
+
+   u8 uShortPacket[DEFAULT_RADIO_SERIAL_AIR_MAX_PACKET_SIZE + sizeof(t_packet_header_short)];
+   int iPacketSize = 0;
+   int iAirBytesPerSec = 0;
+   int iInterfaceIndex = -1;
+   u32 uTimeStart = get_current_timestamp_micros();
+
+   pthread_mutex_lock(&pSched->mutex);
+   while ( 1 )
+   {
+      if ( pSched->iStop )
+      {
+         pthread_mutex_unlock(&pSched->mutex);
+         return -1;
+      }
+
+      // Round robin on interfaces that have data and are allowed to send now
+      u32 uTimeNow = get_current_timestamp_micros();
+      u32 uWaitMicros = uMaxWaitMicros - (uTimeNow - uTimeStart);
+      if ( (uTimeNow - uTimeStart) >= uMaxWaitMicros )
+         uWaitMicros = 0;
+      for( int k=1; k<=MAX_RADIO_INTERFACES; k++ )
+      {
+         int i = (pSched->iLastInterface + k) % MAX_RADIO_INTERFACES;
+         if ( ! _radio_tx_serial_sched_has_pending_data(pSched, i) )
+            continue;
+         int iDelta = (int)(pSched->uNextSendTimeMicros[i] - uTimeNow);
+         if ( iDelta <= 0 )
+         {
+            iInterfaceIndex = i;
+            break;
+         }
+         if ( (u32)iDelta < uWaitMicros )
+            uWaitMicros = (u32)iDelta;
+      }
+      if ( iInterfaceIndex >= 0 )
+         break;
+      if ( 0 == uWaitMicros )
+      {
+         pthread_mutex_unlock(&pSched->mutex);
+         return 0;
+      }
+
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      ts.tv_sec += uWaitMicros / 1000000;
+      ts.tv_nsec += (long)(uWaitMicros % 1000000) * 1000;
+      if ( ts.tv_nsec >= 1000000000 )
+      {
+         ts.tv_sec++;
+         ts.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait(&pSched->cond, &pSched->mutex, &ts);
+   }
+
+   pSched->iLastInterface = iInterfaceIndex;
+   pSched->pLinkCallback(iInterfaceIndex, &iPacketSize, &iAirBytesPerSec, pSched->pContext);
+   if ( iPacketSize > DEFAULT_RADIO_SERIAL_AIR_MAX_PACKET_SIZE )
+      iPacketSize = DEFAULT_RADIO_SERIAL_AIR_MAX_PACKET_SIZE;
+   if ( iPacketSize < DEFAULT_RADIO_SERIAL_AIR_MIN_PACKET_SIZE )
+      iPacketSize = DEFAULT_RADIO_SERIAL_AIR_MIN_PACKET_SIZE;
+   int iLength = _radio_tx_serial_sched_build_short_packet(pSched, iInterfaceIndex, iPacketSize, uShortPacket);
+   pthread_mutex_unlock(&pSched->mutex);
+
+   if ( iLength <= 0 )
+      return 0;
+
+   int iWritten = pSched->pWriteCallback(iInterfaceIndex, uShortPacket, iLength, pSched->pContext);
+
+   // Pace the next write on this interface by the airtime of this one
+   u32 uAirTimeMicros = RADIO_TX_SERIAL_DEFAULT_PACKET_GAP_MICROS;
+   if ( iAirBytesPerSec > 0 )
+      uAirTimeMicros = (u32)(((unsigned long long)iLength * 1000000 * 100) / ((unsigned long long)iAirBytesPerSec * RADIO_TX_SERIAL_PACING_PERCENT));
+
+   pthread_mutex_lock(&pSched->mutex);
+   u32 uTimeNow = get_current_timestamp_micros();
+   if ( (int)(uTimeNow - pSched->uNextSendTimeMicros[iInterfaceIndex]) > RADIO_TX_SERIAL_MAX_BURST_MICROS )
+      pSched->uNextSendTimeMicros[iInterfaceIndex] = uTimeNow - RADIO_TX_SERIAL_MAX_BURST_MICROS;
+   pSched->uNextSendTimeMicros[iInterfaceIndex] += uAirTimeMicros;
+   if ( iWritten != iLength )
+      pSched->stats.uCountWriteErrors++;
+   if ( iWritten > 0 )
+      pSched->stats.uCountBytesWritten += iWritten;
+   pthread_mutex_unlock(&pSched->mutex);
+
+   if ( iWritten != iLength )
+   {
+      log_softerror_and_alarm("[RadioTxSerialSched] Failed to send short packet to serial radio interface %d: sent %d bytes, only %d bytes written.",
+         iInterfaceIndex+1, iLength, iWritten);
+      return 0;
+   }
+   return iWritten;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include "../base/base.h"
+#include "../base/config.h"
+#include "radiopackets2.h"
+#include <pthread.h>
+
+// Transmit scheduler for serial (SiK and other serial) radios.
+// Queued radio messages are sent as short packets (t_packet_header_short + data). When enabled for an
+// interface, pending messages are coalesced into full short packets: a message can start right after the end
+// of a previous message in the same short packet, so the link is not wasted on partially filled short packets.
+// Older receivers drop the bytes following a completed message, so coalescing is off by default and must only
+// be enabled when the peer is known to support it (see radio_tx_set_serial_coalescing).
+// Short packets that start with the start of a message are marked as SHORT_PACKET_START_BYTE_START_PACKET (receiver resync point).
+// Writes are paced at the air data rate of the interface, so the backlog stays in the scheduler queues
+// (where RC and commands get ahead of telemetry) instead of in the modem or serial port buffers.
+// The sender thread sleeps on a condition variable and is woken up when a message is queued.
+
+#define RADIO_TX_SERIAL_PRIORITY_HIGH 0   // RC, commands
+#define RADIO_TX_SERIAL_PRIORITY_NORMAL 1 // link control, everything else
+#define RADIO_TX_SERIAL_PRIORITY_LOW 2    // telemetry and other bulk data
+#define RADIO_TX_SERIAL_PRIORITIES 3
+
+#define RADIO_TX_SERIAL_MAX_QUEUED_MESSAGES 64
+// Sent airtime is paced at this percent of the air data rate, to leave room for the modem framing
+#define RADIO_TX_SERIAL_PACING_PERCENT 90
+// How much a sender can get ahead of the pacing clock after being idle
+#define RADIO_TX_SERIAL_MAX_BURST_MICROS 5000
+// Gap between short packets when the air data rate of the interface is not known
+#define RADIO_TX_SERIAL_DEFAULT_PACKET_GAP_MICROS 500
+
+// Writes one short packet. Returns the number of bytes written.
+typedef int (*radio_tx_serial_write_callback)(int iInterfaceIndex, u8* pData, int iLength, void* pContext);
+// Returns the short packet size (header included) and the air data rate (bytes/sec, 0 or negative if not known)
+typedef void (*radio_tx_serial_link_callback)(int iInterfaceIndex, int* piPacketSize, int* piAirBytesPerSec, void* pContext);
+
+typedef struct
+{
+   int iLength;
+   int iNext;
+   u8 uData[MAX_PACKET_TOTAL_SIZE];
+} t_radio_tx_serial_message;
+
+typedef struct
+{
+   u32 uCountMessagesQueued;
+   u32 uCountMessagesSent;
+   u32 uCountMessagesDropped; // queue full, lower priority messages were dropped
+   u32 uCountShortPackets;
+   u32 uCountShortPacketsCoalesced; // short packets holding data from more than one message
+   u32 uCountBytesWritten;
+   u32 uCountWriteErrors;
+} t_radio_tx_serial_stats;
+
+typedef struct
+{
+   pthread_mutex_t mutex;
+   pthread_cond_t cond;
+   int iInitialized;
+   int iStop;
+   radio_tx_serial_write_callback pWriteCallback;
+   radio_tx_serial_link_callback pLinkCallback;
+   void* pContext;
+
+   t_radio_tx_serial_message messages[RADIO_TX_SERIAL_MAX_QUEUED_MESSAGES];
+   int iFreeMessages; // head of the free list
+   int iQueueHead[MAX_RADIO_INTERFACES][RADIO_TX_SERIAL_PRIORITIES];
+   int iQueueTail[MAX_RADIO_INTERFACES][RADIO_TX_SERIAL_PRIORITIES];
+   // Message already partially sent on each interface: it has to be completed before any other message
+   int iCurrentMessage[MAX_RADIO_INTERFACES];
+   int iCurrentMessageOffset[MAX_RADIO_INTERFACES];
+   int iPaused[MAX_RADIO_INTERFACES];
+   int iCoalesce[MAX_RADIO_INTERFACES];
+   u32 uNextSendTimeMicros[MAX_RADIO_INTERFACES];
+   int iLastInterface;
+
+   t_radio_tx_serial_stats stats;
+} t_radio_tx_serial_sched;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int radio_tx_serial_sched_init(t_radio_tx_serial_sched* pSched, radio_tx_serial_write_callback pWriteCallback, radio_tx_serial_link_callback pLinkCallback, void* pContext);
+void radio_tx_serial_sched_uninit(t_radio_tx_serial_sched* pSched);
+
+// Returns 1 if the message was queued, 0 if it was discarded (paused interface), -1 on error
+int radio_tx_serial_sched_enqueue(t_radio_tx_serial_sched* pSched, int iInterfaceIndex, u8* pData, int iLength);
+
+// Lets messages for the interface share short packets. Only enable it if the peer supports it.
+void radio_tx_serial_sched_set_coalescing(t_radio_tx_serial_sched* pSched, int iInterfaceIndex, int iEnable);
+
+// Discards all queued data for the interface; while paused, new messages for it are discarded
+void radio_tx_serial_sched_set_paused(t_radio_tx_serial_sched* pSched, int iInterfaceIndex, int iPaused);
+
+// Waits up to uMaxWaitMicros for a short packet that can be sent now (pacing allowing) and sends it.
+// Returns the number of bytes written, 0 if nothing was sent, -1 if the scheduler was signaled to stop.
+int radio_tx_serial_sched_run(t_radio_tx_serial_sched* pSched, u32 uMaxWaitMicros);
+
+void radio_tx_serial_sched_signal_stop(t_radio_tx_serial_sched* pSched);
+int radio_tx_serial_sched_get_priority(u8* pData, int iLength);
+
+#ifdef __cplusplus
+}
+#endif
@@ -217,6 +217,7 @@ void radio_reset_packets_default_frequencies(int iRCEnabled)
    s_uFrequencyRadioPacketsOnSlowLinkControllerToVehicle[PACKET_TYPE_COMMAND] = 200;
    s_uFrequencyRadioPacketsOnSlowLinkControllerToVehicle[PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL] = 50;
    s_uFrequencyRadioPacketsOnSlowLinkControllerToVehicle[PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE] = 50;
+   s_uFrequencyRadioPacketsOnSlowLinkControllerToVehicle[PACKET_TYPE_VIDEO_REQUEST_KEYFRAME] = 100;
    s_uFrequencyRadioPacketsOnSlowLinkControllerToVehicle[PACKET_TYPE_RC_FULL_FRAME] = 50;
 
    
@@ -239,6 +240,7 @@ void radio_reset_packets_default_frequencies(int iRCEnabled)
 
    s_uFrequencyRadioPacketsOnSlowLinkVehicleToController[PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK] = 50;
    s_uFrequencyRadioPacketsOnSlowLinkVehicleToController[PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK] = 50;
+   s_uFrequencyRadioPacketsOnSlowLinkVehicleToController[PACKET_TYPE_VIDEO_REQUEST_KEYFRAME_ACK] = 100;
 
    s_uFrequencyRadioPacketsOnSlowLinkVehicleToController[PACKET_TYPE_RUBY_MODEL_SETTINGS] = 0; // Send at any rate
 
@@ -388,7 +390,7 @@ int radio_set_out_datarate(int rate_bps)
       rate_bps = DEFAULT_RADIO_DATARATE_VIDEO_ATHEROS;
 
    if ( (sRadioDataRate_bps != rate_bps) || (s_iLogCount_RadioRate == 0) )
-   if ( s_iLogCount_RadioRate < 4 || (s_uLastTimeLog_RadioRate + 20000) < get_current_timestamp_ms() )
+   if ( s_iLogCount_RadioRate < 4 || (s_uLastTimeLog_RadioRate + 20000) < get_current_timestamp_ms_coarse() )
    {
       if ( s_iLogCount_RadioRate == 4 )
          s_iLogCount_RadioRate = 0;
@@ -400,9 +402,9 @@ int radio_set_out_datarate(int rate_bps)
       if ( s_iLogCount_RadioRate == 3 )
          log_line("Radio: Too many radio datarate changes, pausing log.");
       s_iLogCount_RadioRate++;
-      if ( get_current_timestamp_ms() > s_uLastTimeLog_RadioRate + 1000 )
+      if ( get_current_timestamp_ms_coarse() > s_uLastTimeLog_RadioRate + 1000 )
          s_iLogCount_RadioRate = 0;
-      s_uLastTimeLog_RadioRate = get_current_timestamp_ms();
+      s_uLastTimeLog_RadioRate = get_current_timestamp_ms_coarse();
    }
 
    if ( sRadioDataRate_bps != rate_bps )
@@ -442,7 +444,7 @@ void radio_set_frames_flags(u32 frameFlags)
    u32 frameFlagsFiltered = frameFlags;
 
    if ( (sRadioFrameFlags != frameFlagsFiltered) || (s_iLogCount_RadioFlags == 0) )
-   if ( s_iLogCount_RadioFlags < 10 || (s_uLastTimeLog_RadioFlags + 20000) < get_current_timestamp_ms() )
+   if ( s_iLogCount_RadioFlags < 10 || (s_uLastTimeLog_RadioFlags + 20000) < get_current_timestamp_ms_coarse() )
    {
       if ( s_iLogCount_RadioFlags == 10 )
          s_iLogCount_RadioFlags = 0;
@@ -454,9 +456,9 @@ void radio_set_frames_flags(u32 frameFlags)
       if ( s_iLogCount_RadioFlags == 9 )
          log_line("Radio: Too many radio flags changes, pausing log.");
       s_iLogCount_RadioFlags++;
-      if ( get_current_timestamp_ms() > s_uLastTimeLog_RadioFlags + 1000 )
+      if ( get_current_timestamp_ms_coarse() > s_uLastTimeLog_RadioFlags + 1000 )
          s_iLogCount_RadioFlags = 0;
-      s_uLastTimeLog_RadioFlags = get_current_timestamp_ms();
+      s_uLastTimeLog_RadioFlags = get_current_timestamp_ms_coarse();
    }
 
    if ( sRadioFrameFlags != frameFlagsFiltered )
@@ -54,6 +54,32 @@ void radio_packet_init(t_packet_header* pPH, u8 component, u8 packet_type, u32 u
       pPH->packet_flags_extended = 0xFF & ((SYSTEM_SW_VERSION_MAJOR << 4) | (SYSTEM_SW_VERSION_MINOR/10));
 }
 
+t_packet_video_latency_trace* radio_packet_get_video_latency_trace(u8* pPacket)
+{
+   if ( NULL == pPacket )
+      return NULL;
+   t_packet_header* pPH = (t_packet_header*)pPacket;
+   if ( ((pPH->packet_flags & PACKET_FLAGS_MASK_MODULE) != PACKET_COMPONENT_VIDEO) || (pPH->packet_type != PACKET_TYPE_VIDEO_DATA_FULL) )
+      return NULL;
+   t_packet_header_video_full_77* pPHVF = (t_packet_header_video_full_77*)(pPacket + sizeof(t_packet_header));
+   if ( ! (pPHVF->uVideoStatusFlags2 & VIDEO_STATUS_FLAGS2_HAS_LATENCY_TRACE) )
+      return NULL;
+   if ( pPH->total_length < sizeof(t_packet_header) + sizeof(t_packet_header_video_full_77) + pPHVF->video_data_length + sizeof(t_packet_video_latency_trace) )
+      return NULL;
+   return (t_packet_video_latency_trace*)(pPacket + pPH->total_length - sizeof(t_packet_video_latency_trace));
+}
+
+u16 radio_packet_latency_trace_delta(u32 uTimeStartMicros, u32 uTimeNowMicros)
+{
+   u32 uDelta = (uTimeNowMicros - uTimeStartMicros)/100;
+   if ( uDelta > 0xFFFF )
+      uDelta = 0xFFFF;
+   // 0 is reserved for "stage not reached"
+   if ( 0 == uDelta )
+      uDelta = 1;
+   return (u16)uDelta;
+}
+
 void radio_packet_compute_crc(u8* pBuffer, int length)
 {
    u32 crc = base_compute_crc32(pBuffer + sizeof(u32), length-sizeof(u32)); 
@@ -83,6 +109,8 @@ int radio_packet_type_is_high_priority(u8 uPacketType)
       case PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK:
       case PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE:
       case PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK:
+      case PACKET_TYPE_VIDEO_REQUEST_KEYFRAME:
+      case PACKET_TYPE_VIDEO_REQUEST_KEYFRAME_ACK:
          return 1;
          break;
       default:
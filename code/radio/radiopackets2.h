@@ -156,6 +156,7 @@ typedef struct
       //                  u32 - local timestamp sent to video output;
       //    bit 1  - 0/1: is this video packet part of a I-frame
       //    bit 2  - 1: is on lower video bitrate
+      //    bit 3  - 1: has a latency trace (t_packet_video_latency_trace) at the end of the packet
 
    u16 video_width;
    u16 video_height;
@@ -175,6 +176,20 @@ typedef struct
    u32 uExtraData; // not used, for future
 } __attribute__((packed)) t_packet_header_video_full_77;
 
+// Latency trace carried in-band by a sampled video packet (one every DEFAULT_VIDEO_LATENCY_TRACE_BLOCKS_INTERVAL video blocks),
+// as the last bytes of the packet. Each stage adds its time as it handles the packet.
+// Deltas are in 1/10 miliseconds (saturated at 0xFFFF); 0 means the stage was not reached yet.
+typedef struct
+{
+   u32 uVehicleTimeReadMs; // vehicle clock, first bytes of the packet read from the camera
+   u32 uVehicleTimeReadMicros; // vehicle clock, same moment
+   u16 uDeltaPacketized; // from read: packet complete in the video tx block
+   u16 uDeltaRadioTx; // from read: packet written to the radio interface
+   u32 uControllerTimeRxMicros; // controller clock, packet read from the radio interface
+   u16 uDeltaProcessed; // from controller rx: packet reached the video rx processor
+   u16 uDeltaOutput; // from controller rx: video data sent to the video output
+} __attribute__((packed)) t_packet_video_latency_trace;
+
 
 typedef struct
 {
@@ -793,6 +808,8 @@ byte 4: command type:
 
 #define PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL 60 // From controller to vehicle. Contains an u32 - adaptive video level to switch to (0..N - HQ, M...P - MQ, R...T - LQ) and then u8 video stream index
 #define PACKET_TYPE_VIDEO_SWITCH_TO_ADAPTIVE_VIDEO_LEVEL_ACK 61 // From vehicle to controller. Contains an u32 - adaptive video level to switch to (0..N - HQ, M...P - MQ, R...T - LQ)
+#define PACKET_TYPE_VIDEO_REQUEST_KEYFRAME 62 // From controller to vehicle. Contains an u32 request id and then u8 video stream index. Vehicle generates a keyframe (IDR) as soon as possible
+#define PACKET_TYPE_VIDEO_REQUEST_KEYFRAME_ACK 63 // From vehicle to controller. Contains the acknowledged u32 request id
 
 #define PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE 64 // From controller to vehicle. Contains the deisred keyframe milisec value as an u32 and then u8 video stream index
 #define PACKET_TYPE_VIDEO_SWITCH_VIDEO_KEYFRAME_TO_VALUE_ACK 65 // From vehicle to controller. Contains the acknowledge keyframe milisec value as an u32
@@ -816,6 +833,11 @@ int radio_packet_check_crc(u8* pBuffer, int length);
 
 int radio_packet_type_is_high_priority(u8 uPacketType);
 
+// Returns the latency trace of a video packet, or NULL if the packet does not carry one
+t_packet_video_latency_trace* radio_packet_get_video_latency_trace(u8* pPacket);
+// Returns the time between the two timestamps, in 1/10 miliseconds, as stored in the latency trace
+u16 radio_packet_latency_trace_delta(u32 uTimeStartMicros, u32 uTimeNowMicros);
+
 void radio_populate_ruby_telemetry_v3_from_ruby_telemetry_v1(t_packet_header_ruby_telemetry_extended_v3* pV3, t_packet_header_ruby_telemetry_extended_v1* pV1);
 void radio_populate_ruby_telemetry_v3_from_ruby_telemetry_v2(t_packet_header_ruby_telemetry_extended_v3* pV3, t_packet_header_ruby_telemetry_extended_v2* pV2);
 
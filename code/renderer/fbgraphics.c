@@ -39,6 +39,7 @@
 #endif
 
 #include "fbgraphics.h"
+#include "render_spans.h"
 
 #ifdef FBG_PARALLEL
     void fbg_terminateFragments(struct _fbg *fbg);
@@ -798,24 +799,11 @@ void fbg_hline(struct _fbg *fbg, int x, int y, int w, unsigned char r, unsigned
 {
     unsigned char *pix_pointer = (unsigned char *)(fbg->back_buffer + (y * fbg->line_length + x * fbg->components));
 
+    unsigned char pixel[4] = { r, g, b, a };
     if ( fbg->s_iEnableRectBlending )
-    {
-       for (int xx = 0; xx < w; xx++)
-       {
-         fbg_pixela_fast(fbg, pix_pointer, r,g,b,a);
-         pix_pointer += 4;
-       }
-    }
+       render_span_blend_color(pix_pointer, w, pixel, a);
     else
-    {
-       for (int xx = 0; xx < w; xx++)
-       {
-         *pix_pointer++ = r;
-         *pix_pointer++ = g;
-         *pix_pointer++ = b;
-         *pix_pointer++ = a;
-       }
-    }
+       render_span_fill(pix_pointer, w, pixel);
 }
 
 void fbg_vline(struct _fbg *fbg, int x, int y, int h, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
@@ -924,20 +912,15 @@ void fbg_polygon(struct _fbg *fbg, int num_vertices, int *vertices, unsigned cha
 
 void fbg_recta(struct _fbg *fbg, int x, int y, int w, int h, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
 {
-    int xx = 0, yy = 0, w4 = w * fbg->components;
+    int yy = 0;
+    unsigned char color[4] = { r, g, b, a };
 
     unsigned char *pix_pointer = (unsigned char *)(fbg->back_buffer + (y * fbg->line_length + x * fbg->components));
 
     for (yy = 0; yy < h; yy += 1)
     {
-        for (xx = 0; xx < w; xx += 1)
-        {
-           fbg_pixela_fast(fbg, pix_pointer, r,g,b,a);
-           //fbg_pixela(fbg, x + xx, y + yy, r,g,b,a);
-           pix_pointer += 4;
-        }
-
-        pix_pointer += (fbg->line_length - w4);
+        render_span_blend_color(pix_pointer, w, color, a);
+        pix_pointer += fbg->line_length;
     }
 }
 
@@ -947,6 +930,16 @@ void fbg_rect(struct _fbg *fbg, int x, int y, int w, int h, unsigned char r, uns
 
     unsigned char *pix_pointer = (unsigned char *)(fbg->back_buffer + (y * fbg->line_length + x * fbg->components));
 
+    if ( 4 == fbg->components )
+    {
+        unsigned char pixel[4] = { r, g, b, a };
+        for (yy = 0; yy < h; yy += 1) {
+            render_span_fill(pix_pointer, w, pixel);
+            pix_pointer += fbg->line_length;
+        }
+        return;
+    }
+
     for (yy = 0; yy < h; yy += 1) {
         for (xx = 0; xx < w; xx += 1) {
             *pix_pointer++ = r;
@@ -1584,14 +1577,9 @@ void fbg_imageClipA(struct _fbg *fbg, struct _fbg_img *img, int x, int y, int cx
 
     for (i = 0; i < h; i += 1) 
     {
-       for (int j=0; j<cw; j++ )
-       {
-         fbg_pixela_fast(fbg, pix_pointer, *img_pointer, *(img_pointer+1), *(img_pointer+2), *(img_pointer+3));
-        pix_pointer += 4;
-        img_pointer += 4;
-       }
-       pix_pointer += fbg->line_length - cw*4;
-       img_pointer += img->width * fbg->components - cw*4;
+       render_span_blit_alpha(pix_pointer, img_pointer, cw, 1);
+       pix_pointer += fbg->line_length;
+       img_pointer += img->width * fbg->components;
     }
 }
 
@@ -1667,24 +1655,12 @@ void fbg_imageClipAColor(struct _fbg *fbg, struct _fbg_img *img, int x, int y, i
     }
     else
     {
+       unsigned char mix[4] = { fbg->mix_color.r, fbg->mix_color.g, fbg->mix_color.b, fbg->mix_color.a };
        for (i = 0; i < h; i += 1) 
        {
-          for (int j=0; j<cw; j++ )
-          {
-            r = *pSrcPointer;
-            g = *(pSrcPointer+1);
-            b = *(pSrcPointer+2);
-            a = *(pSrcPointer+3);
-            r = (r*fbg->mix_color.r)>>8;
-            g = (g*fbg->mix_color.g)>>8;
-            b = (b*fbg->mix_color.b)>>8;
-            a = (a*fbg->mix_color.a)>>8;
-            fbg_pixela_fast(fbg, pDestPointer, r,g,b,a);
-            pDestPointer += 4;
-            pSrcPointer += 4;
-          }
-          pDestPointer += fbg->line_length - cw*4;
-          pSrcPointer += img->width * fbg->components - cw*4;
+          render_span_blit_alpha_modulated(pDestPointer, pSrcPointer, cw, mix);
+          pDestPointer += fbg->line_length;
+          pSrcPointer += img->width * fbg->components;
        }
     }
 }
@@ -0,0 +1,224 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "render_cache.h"
+
+#define RENDER_CACHE_MAX_REGION_BYTES (1024*1024)
+
+typedef struct
+{
+   int iValid;
+   int iCapturePending;
+   int iX, iY, iWidth, iHeight;
+   unsigned int uKey;
+   unsigned int uTimeCaptured;
+   unsigned char* pPixels;
+   int iAllocatedSize;
+} t_render_cache_entry;
+
+static t_render_cache_entry s_RenderCacheEntries[RENDER_CACHE_MAX_ENTRIES];
+static t_render_cache_stats s_RenderCacheStats;
+static int s_iRenderCacheInitialized = 0;
+static unsigned char s_uRenderCacheClearRow[4096];
+static unsigned char s_uRenderCacheClearRowByte = 0;
+
+void render_cache_init()
+{
+   if ( s_iRenderCacheInitialized )
+      render_cache_uninit();
+   memset(&s_RenderCacheEntries, 0, sizeof(s_RenderCacheEntries));
+   memset(&s_RenderCacheStats, 0, sizeof(s_RenderCacheStats));
+   s_iRenderCacheInitialized = 1;
+}
+
+void render_cache_uninit()
+{
+   for( int i=0; i<RENDER_CACHE_MAX_ENTRIES; i++ )
+   {
+      if ( NULL != s_RenderCacheEntries[i].pPixels )
+         free(s_RenderCacheEntries[i].pPixels);
+   }
+   memset(&s_RenderCacheEntries, 0, sizeof(s_RenderCacheEntries));
+   s_iRenderCacheInitialized = 0;
+}
+
+void render_cache_invalidate_all()
+{
+   for( int i=0; i<RENDER_CACHE_MAX_ENTRIES; i++ )
+   {
+      s_RenderCacheEntries[i].iValid = 0;
+      s_RenderCacheEntries[i].iCapturePending = 0;
+   }
+   s_RenderCacheStats.uCountInvalidations++;
+}
+
+unsigned int render_cache_hash_start()
+{
+   return 2166136261u;
+}
+
+unsigned int render_cache_hash(unsigned int uHash, const void* pData, int iSize)
+{
+   const unsigned char* pBytes = (const unsigned char*)pData;
+   if ( NULL == pBytes )
+      return uHash;
+   for( int i=0; i<iSize; i++ )
+   {
+      uHash ^= pBytes[i];
+      uHash *= 16777619u;
+   }
+   return uHash;
+}
+
+static int _render_cache_clip_region(const t_render_surface* pSurface, int iX, int iY, int iWidth, int iHeight)
+{
+   if ( (NULL == pSurface) || (NULL == pSurface->pData) )
+      return 0;
+   if ( (iX < 0) || (iY < 0) || (iWidth <= 0) || (iHeight <= 0) )
+      return 0;
+   if ( (iX + iWidth > pSurface->iWidth) || (iY + iHeight > pSurface->iHeight) )
+      return 0;
+   if ( iWidth * iHeight * pSurface->iBytesPerPixel > RENDER_CACHE_MAX_REGION_BYTES )
+      return 0;
+   return 1;
+}
+
+static int _render_cache_is_region_clear(const t_render_surface* pSurface, int iX, int iY, int iWidth, int iHeight)
+{
+   if ( s_uRenderCacheClearRowByte != pSurface->uClearByte )
+   {
+      memset(s_uRenderCacheClearRow, pSurface->uClearByte, sizeof(s_uRenderCacheClearRow));
+      s_uRenderCacheClearRowByte = pSurface->uClearByte;
+   }
+   int iRowBytes = iWidth * pSurface->iBytesPerPixel;
+   for( int y=0; y<iHeight; y++ )
+   {
+      const unsigned char* pRow = pSurface->pData + (iY+y)*pSurface->iStride + iX*pSurface->iBytesPerPixel;
+      for( int i=0; i<iRowBytes; i += (int)sizeof(s_uRenderCacheClearRow) )
+      {
+         int iBytes = iRowBytes - i;
+         if ( iBytes > (int)sizeof(s_uRenderCacheClearRow) )
+            iBytes = sizeof(s_uRenderCacheClearRow);
+         if ( 0 != memcmp(pRow+i, s_uRenderCacheClearRow, iBytes) )
+            return 0;
+      }
+   }
+   return 1;
+}
+
+int render_cache_begin(const t_render_surface* pSurface, int iEntryId, int iX, int iY, int iWidth, int iHeight, unsigned int uKey, unsigned int uTimeNow, unsigned int uMaxAgeMs)
+{
+   if ( (! s_iRenderCacheInitialized) || (iEntryId < 0) || (iEntryId >= RENDER_CACHE_MAX_ENTRIES) )
+      return RENDER_CACHE_DRAW;
+
+   t_render_cache_entry* pEntry = &s_RenderCacheEntries[iEntryId];
+   pEntry->iCapturePending = 0;
+
+   if ( ! _render_cache_clip_region(pSurface, iX, iY, iWidth, iHeight) )
+   {
+      pEntry->iValid = 0;
+      s_RenderCacheStats.uCountBypass++;
+      return RENDER_CACHE_DRAW;
+   }
+
+   // Something else was already drawn under this region in this frame: can't restore or capture it
+   if ( ! _render_cache_is_region_clear(pSurface, iX, iY, iWidth, iHeight) )
+   {
+      s_RenderCacheStats.uCountBypass++;
+      return RENDER_CACHE_DRAW;
+   }
+
+   int iRowBytes = iWidth * pSurface->iBytesPerPixel;
+   if ( pEntry->iValid )
+   if ( pEntry->uKey == uKey )
+   if ( (pEntry->iX == iX) && (pEntry->iY == iY) && (pEntry->iWidth == iWidth) && (pEntry->iHeight == iHeight) )
+   if ( (0 == uMaxAgeMs) || (uTimeNow - pEntry->uTimeCaptured < uMaxAgeMs) )
+   {
+      for( int y=0; y<iHeight; y++ )
+         memcpy(pSurface->pData + (iY+y)*pSurface->iStride + iX*pSurface->iBytesPerPixel, pEntry->pPixels + y*iRowBytes, iRowBytes);
+      s_RenderCacheStats.uCountHits++;
+      return RENDER_CACHE_HIT;
+   }
+
+   int iSize = iRowBytes * iHeight;
+   if ( iSize > pEntry->iAllocatedSize )
+   {
+      unsigned char* pNew = (unsigned char*) realloc(pEntry->pPixels, iSize);
+      if ( NULL == pNew )
+      {
+         pEntry->iValid = 0;
+         s_RenderCacheStats.uCountBypass++;
+         return RENDER_CACHE_DRAW;
+      }
+      pEntry->pPixels = pNew;
+      pEntry->iAllocatedSize = iSize;
+   }
+   pEntry->iValid = 0;
+   pEntry->iCapturePending = 1;
+   pEntry->iX = iX;
+   pEntry->iY = iY;
+   pEntry->iWidth = iWidth;
+   pEntry->iHeight = iHeight;
+   pEntry->uKey = uKey;
+   pEntry->uTimeCaptured = uTimeNow;
+   s_RenderCacheStats.uCountMisses++;
+   return RENDER_CACHE_DRAW_AND_CAPTURE;
+}
+
+void render_cache_end(const t_render_surface* pSurface, int iEntryId)
+{
+   if ( (iEntryId < 0) || (iEntryId >= RENDER_CACHE_MAX_ENTRIES) )
+      return;
+   t_render_cache_entry* pEntry = &s_RenderCacheEntries[iEntryId];
+   if ( ! pEntry->iCapturePending )
+      return;
+   pEntry->iCapturePending = 0;
+   if ( (NULL == pSurface) || (NULL == pSurface->pData) )
+      return;
+
+   int iRowBytes = pEntry->iWidth * pSurface->iBytesPerPixel;
+   for( int y=0; y<pEntry->iHeight; y++ )
+      memcpy(pEntry->pPixels + y*iRowBytes, pSurface->pData + (pEntry->iY+y)*pSurface->iStride + pEntry->iX*pSurface->iBytesPerPixel, iRowBytes);
+   pEntry->iValid = 1;
+}
+
+void render_cache_get_stats(t_render_cache_stats* pStats)
+{
+   if ( NULL != pStats )
+      memcpy(pStats, &s_RenderCacheStats, sizeof(t_render_cache_stats));
+}
+
+void render_cache_reset_stats()
+{
+   memset(&s_RenderCacheStats, 0, sizeof(s_RenderCacheStats));
+}
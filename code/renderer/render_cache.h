@@ -0,0 +1,54 @@
+#pragma once
+
+// Retained rendering of screen regions (OSD panels).
+// A region is drawn once onto the freshly cleared back buffer, its pixels are captured and then
+// copied back on the following frames, as long as its key (layout + bound inputs) does not change.
+// A region is only cached/restored when the back buffer area under it is still cleared, so the
+// result is always identical to drawing it again.
+
+#define RENDER_CACHE_MAX_ENTRIES 32
+
+#define RENDER_CACHE_DRAW 0             // Draw normally, nothing to do after
+#define RENDER_CACHE_DRAW_AND_CAPTURE 1 // Draw, then call render_cache_end()
+#define RENDER_CACHE_HIT 2              // Region was restored from cache, skip drawing
+
+typedef struct
+{
+   unsigned char* pData;
+   int iStride;
+   int iBytesPerPixel;
+   int iWidth;
+   int iHeight;
+   unsigned char uClearByte;
+} t_render_surface;
+
+typedef struct
+{
+   unsigned int uCountHits;
+   unsigned int uCountMisses; // drawn and captured
+   unsigned int uCountBypass; // drawn, could not be cached (area not clear, too big, ...)
+   unsigned int uCountInvalidations;
+} t_render_cache_stats;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void render_cache_init();
+void render_cache_uninit();
+void render_cache_invalidate_all();
+
+// FNV-1a, chainable: uHash = render_cache_hash(uHash, &value, sizeof(value))
+unsigned int render_cache_hash(unsigned int uHash, const void* pData, int iSize);
+unsigned int render_cache_hash_start();
+
+// Region is in pixels. uMaxAgeMs: 0 for no age limit.
+int render_cache_begin(const t_render_surface* pSurface, int iEntryId, int iX, int iY, int iWidth, int iHeight, unsigned int uKey, unsigned int uTimeNow, unsigned int uMaxAgeMs);
+void render_cache_end(const t_render_surface* pSurface, int iEntryId);
+
+void render_cache_get_stats(t_render_cache_stats* pStats);
+void render_cache_reset_stats();
+
+#ifdef __cplusplus
+}
+#endif
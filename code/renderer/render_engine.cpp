@@ -257,6 +257,13 @@ void RenderEngine::setClearBufferByte(u8 uClearByte)
    m_uClearBufferByte = uClearByte;
 }
 
+bool RenderEngine::getBackBufferSurface(t_render_surface* pSurface)
+{
+   if ( NULL != pSurface )
+      memset(pSurface, 0, sizeof(t_render_surface));
+   return false;
+}
+
 void RenderEngine::setColors(double* color)
 {
    setColors(color, 1.0);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "../base/base.h"
+#include "render_cache.h"
 
 #define MAX_FONT_CHARS 256
 #define MAX_FONT_KERINGS 1024
@@ -98,6 +99,9 @@ class RenderEngine
      virtual void startFrame();
      virtual void endFrame();
 
+     // Direct access to the current back buffer, for retained (cached) regions. Returns false if not supported.
+     virtual bool getBackBufferSurface(t_render_surface* pSurface);
+
      virtual void rotate180();
 
      virtual void drawImage(float xPos, float yPos, float fWidth, float fHeight, u32 imageId);
@@ -33,6 +33,7 @@
 #include "../base/config.h"
 #include "render_engine_cairo.h"
 #include "drm_core.h"
+#include "render_spans.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -145,6 +146,27 @@ void RenderEngineCairo::endFrame()
    ruby_drm_swap_mainback_buffers();
 }
 
+bool RenderEngineCairo::getBackBufferSurface(t_render_surface* pSurface)
+{
+   if ( NULL == pSurface )
+      return false;
+   type_drm_buffer* pOutputBufferInfo = ruby_drm_core_get_back_draw_buffer();
+   if ( (NULL == pOutputBufferInfo) || (NULL == pOutputBufferInfo->pData) )
+      return false;
+
+   // Make sure pending cairo drawing is in the buffer before it is read back
+   if ( NULL != m_pCairoCtx )
+      cairo_surface_flush(cairo_get_target(m_pCairoCtx));
+
+   pSurface->pData = pOutputBufferInfo->pData;
+   pSurface->iStride = pOutputBufferInfo->uStride;
+   pSurface->iBytesPerPixel = 4;
+   pSurface->iWidth = pOutputBufferInfo->uWidth;
+   pSurface->iHeight = pOutputBufferInfo->uHeight;
+   pSurface->uClearByte = m_uClearBufferByte;
+   return true;
+}
+
 
 void RenderEngineCairo::setStroke(double* color, float fStrokeSize)
 {
@@ -630,21 +652,8 @@ void RenderEngineCairo::bltIcon(float xPosDest, float yPosDest, int iSrcX, int i
       u8* pSrcLine = pSrcImageData + ((iSrcY +y)* iSrcImageStride);
       pSrcLine += 4 * iSrcX;
 
-      for( int x=0; x<iSrcWidth; x++ )
-      {
-          u8 uAlpha = *(pSrcLine+3);
-          *pDestLine = ((*(pSrcLine)) * uAlpha + (*(pDestLine)) * (255-uAlpha))/256;
-          pDestLine++;
-          pSrcLine++;
-          *pDestLine = ((*(pSrcLine)) * uAlpha + (*(pDestLine)) * (255-uAlpha))/256;
-          pDestLine++;
-          pSrcLine++;
-          *pDestLine = ((*(pSrcLine)) * uAlpha + (*(pDestLine)) * (255-uAlpha))/256;
-          pDestLine++;
-          pSrcLine++;
-          pDestLine++;
-          pSrcLine++;
-      }
+      // Blend color channels using source alpha, keep destination alpha
+      render_span_blit_alpha(pDestLine, pSrcLine, iSrcWidth, 0);
    }
 }
 
@@ -690,13 +699,8 @@ void RenderEngineCairo::_draw_hline(int x, int y, int w, unsigned char r, unsign
 {
    type_drm_buffer* pOutputBufferInfo = ruby_drm_core_get_back_draw_buffer();
    u8* pDestLine = (&(pOutputBufferInfo->pData[0])) + y*pOutputBufferInfo->uStride + 4*x;
-   for( int x=0; x<w; x++ )
-   {
-      *pDestLine++ = b;
-      *pDestLine++ = g;
-      *pDestLine++ = r;
-      *pDestLine++ = a;
-   }
+   u8 uPixel[4] = { b, g, r, a };
+   render_span_fill(pDestLine, w, uPixel);
 }
 
 void RenderEngineCairo::_draw_vline(int x, int y, int h, unsigned char r, unsigned char g, unsigned char b, unsigned char a)
@@ -796,19 +800,12 @@ void RenderEngineCairo::drawRect(float xPos, float yPos, float fWidth, float fHe
    if ( m_ColorFill[3] > 2 )
    {
       type_drm_buffer* pOutputBufferInfo = ruby_drm_core_get_back_draw_buffer();
+      u8 uPixel[4] = { b, g, r, a };
       for( int y=0; y<h; y++ )
       {
          u8* pDestLine = (u8*)&(pOutputBufferInfo->pData[(ySt+y)*pOutputBufferInfo->uStride]);
          pDestLine += 4*xSt;
-         for( int x=0; x<w; x++ )
-         {
-            //_blend_pixel(pDestLine, r,g,b,a);
-            //pDestLine += 4;
-            *pDestLine++ = b;
-            *pDestLine++ = g;
-            *pDestLine++ = r;
-            *pDestLine++ = a;
-         }
+         render_span_fill(pDestLine, w, uPixel);
       }
    }
    if ( m_ColorStroke[3] > 2 )
@@ -885,19 +882,12 @@ void RenderEngineCairo::drawRoundRect(float xPos, float yPos, float fWidth, floa
       u8 b = m_ColorFill[2];
       u8 a = m_ColorFill[3];
       type_drm_buffer* pOutputBufferInfo = ruby_drm_core_get_back_draw_buffer();
+      u8 uPixel[4] = { b, g, r, a };
       for( int y=0; y<h; y++ )
       {
          u8* pDestLine = (u8*)&(pOutputBufferInfo->pData[(ySt+y)*pOutputBufferInfo->uStride]);
          pDestLine += 4*(xSt+3);
-         for( int x=0; x<(w-5); x++ )
-         {
-            //_blend_pixel(pDestLine, r,g,b,a);
-            //pDestLine += 4;
-            *pDestLine++ = b;
-            *pDestLine++ = g;
-            *pDestLine++ = r;
-            *pDestLine++ = a;
-         }
+         render_span_fill(pDestLine, w-5, uPixel);
       }
   
       _draw_vline(xSt+2, ySt+1, h-2 , r,g,b,a);
@@ -1235,20 +1225,7 @@ void RenderEngineCairo::_bltFontChar(int iDestX, int iDestY, int iSrcX, int iSrc
       u8* pSrcLine = pSrcImageData + ((iSrcY +y)* iSrcImageStride);
       pSrcLine += 4 * iSrcX;
 
-      for( int x=0; x<iSrcWidth; x++ )
-      {
-          u8 uAlpha = *(pSrcLine+3);
-          *pDestLine = ((*(pSrcLine)) * uAlpha + (*(pDestLine)) * (255-uAlpha))/256;
-          pDestLine++;
-          pSrcLine++;
-          *pDestLine = ((*(pSrcLine)) * uAlpha + (*(pDestLine)) * (255-uAlpha))/256;
-          pDestLine++;
-          pSrcLine++;
-          *pDestLine = ((*(pSrcLine)) * uAlpha + (*(pDestLine)) * (255-uAlpha))/256;
-          pDestLine++;
-          pSrcLine++;
-          pDestLine++;
-          pSrcLine++;
-      }
+      // Blend color channels using source alpha, keep destination alpha
+      render_span_blit_alpha(pDestLine, pSrcLine, iSrcWidth, 0);
    }
 }
@@ -23,6 +23,7 @@ class RenderEngineCairo: public RenderEngine
      
      virtual void startFrame();
      virtual void endFrame();
+     virtual bool getBackBufferSurface(t_render_surface* pSurface);
      virtual void rotate180();
 
      virtual void drawImage(float xPos, float yPos, float fWidth, float fHeight, u32 uImageId);
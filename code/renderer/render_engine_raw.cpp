@@ -341,6 +341,19 @@ void RenderEngineRaw::endFrame()
    fbg_flip(m_pFBG);
 }
 
+bool RenderEngineRaw::getBackBufferSurface(t_render_surface* pSurface)
+{
+   if ( (NULL == pSurface) || (NULL == m_pFBG) || (NULL == m_pFBG->back_buffer) )
+      return false;
+   pSurface->pData = (unsigned char*)m_pFBG->back_buffer;
+   pSurface->iStride = m_pFBG->line_length;
+   pSurface->iBytesPerPixel = m_pFBG->components;
+   pSurface->iWidth = m_pFBG->width;
+   pSurface->iHeight = m_pFBG->height;
+   pSurface->uClearByte = m_uClearBufferByte;
+   return true;
+}
+
 void RenderEngineRaw::rotate180()
 {
    unsigned char pixel[4];
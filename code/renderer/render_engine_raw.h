@@ -18,6 +18,7 @@ class RenderEngineRaw: public RenderEngine
 
      virtual void startFrame();
      virtual void endFrame();
+     virtual bool getBackBufferSurface(t_render_surface* pSurface);
      virtual void rotate180();
 
      virtual void drawImage(float xPos, float yPos, float fWidth, float fHeight, u32 imageId);
@@ -0,0 +1,309 @@
+/*
+    Ruby Licence
+    Copyright (c) 2024 Petru Soroaga  petrusoroaga@yahoo.com
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+        * Redistributions of source code must retain the above copyright
+        notice, this list of conditions and the following disclaimer.
+        * Redistributions in binary form must reproduce the above copyright
+        notice, this list of conditions and the following disclaimer in the
+        documentation and/or other materials provided with the distribution.
+        * Copyright info and developer info must be preserved as is in the user
+        interface, additions could be made to that info.
+        * Neither the name of the organization nor the
+        names of its contributors may be used to endorse or promote products
+        derived from this software without specific prior written permission.
+        * Military use is not permited.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+    ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+    WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL Julien Verneuil BE LIABLE FOR ANY
+    DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+    (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+    LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+    ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+    SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string.h>
+#include "render_spans.h"
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RENDER_SPANS_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define RENDER_SPANS_SSE2 1
+#endif
+
+const char* render_span_get_impl_name()
+{
+   #if defined(RENDER_SPANS_NEON)
+   return "neon";
+   #elif defined(RENDER_SPANS_SSE2)
+   return "sse2";
+   #else
+   return "scalar";
+   #endif
+}
+
+// ---------------------------------------------------------
+// Scalar versions, also used for the tails of the SIMD loops
+
+static inline void _span_blend_color_pixel(unsigned char* pDest, const unsigned char* pColor, unsigned int uAlpha)
+{
+   unsigned int uInv = 255 - uAlpha;
+   pDest[0] = (uAlpha * pColor[0] + uInv * pDest[0]) >> 8;
+   pDest[1] = (uAlpha * pColor[1] + uInv * pDest[1]) >> 8;
+   pDest[2] = (uAlpha * pColor[2] + uInv * pDest[2]) >> 8;
+   pDest[3] = pDest[3] + (((255 - pDest[3]) * uAlpha) >> 8);
+}
+
+static inline void _span_blit_alpha_pixel(unsigned char* pDest, const unsigned char* pSrc, int iUpdateDestAlpha)
+{
+   unsigned int uAlpha = pSrc[3];
+   unsigned int uInv = 255 - uAlpha;
+   pDest[0] = (uAlpha * pSrc[0] + uInv * pDest[0]) >> 8;
+   pDest[1] = (uAlpha * pSrc[1] + uInv * pDest[1]) >> 8;
+   pDest[2] = (uAlpha * pSrc[2] + uInv * pDest[2]) >> 8;
+   if ( iUpdateDestAlpha )
+      pDest[3] = pDest[3] + (((255 - pDest[3]) * uAlpha) >> 8);
+}
+
+static inline void _span_blit_alpha_modulated_pixel(unsigned char* pDest, const unsigned char* pSrc, const unsigned char* pModulate)
+{
+   unsigned char uSrc[4];
+   uSrc[0] = (pSrc[0] * pModulate[0]) >> 8;
+   uSrc[1] = (pSrc[1] * pModulate[1]) >> 8;
+   uSrc[2] = (pSrc[2] * pModulate[2]) >> 8;
+   uSrc[3] = (pSrc[3] * pModulate[3]) >> 8;
+   _span_blit_alpha_pixel(pDest, uSrc, 1);
+}
+
+void render_span_fill(unsigned char* pDest, int iCount, const unsigned char* pPixel)
+{
+   if ( (NULL == pDest) || (iCount <= 0) )
+      return;
+
+   unsigned int uPixel;
+   memcpy(&uPixel, pPixel, 4);
+
+   #if defined(RENDER_SPANS_NEON)
+   uint32x4_t vPixel = vdupq_n_u32(uPixel);
+   while ( iCount >= 8 )
+   {
+      vst1q_u8(pDest, vreinterpretq_u8_u32(vPixel));
+      vst1q_u8(pDest+16, vreinterpretq_u8_u32(vPixel));
+      pDest += 32;
+      iCount -= 8;
+   }
+   #elif defined(RENDER_SPANS_SSE2)
+   __m128i vPixel = _mm_set1_epi32((int)uPixel);
+   while ( iCount >= 8 )
+   {
+      _mm_storeu_si128((__m128i*)pDest, vPixel);
+      _mm_storeu_si128((__m128i*)(pDest+16), vPixel);
+      pDest += 32;
+      iCount -= 8;
+   }
+   #endif
+
+   while ( iCount > 0 )
+   {
+      memcpy(pDest, &uPixel, 4);
+      pDest += 4;
+      iCount--;
+   }
+}
+
+void render_span_blend_color(unsigned char* pDest, int iCount, const unsigned char* pColor, unsigned char uAlpha)
+{
+   if ( (NULL == pDest) || (NULL == pColor) || (iCount <= 0) )
+      return;
+
+   #if defined(RENDER_SPANS_NEON)
+   uint8x8_t vAlpha = vdup_n_u8(uAlpha);
+   uint8x8_t vInv = vdup_n_u8(255 - uAlpha);
+   uint16x8_t vColor0 = vmull_u8(vdup_n_u8(pColor[0]), vAlpha);
+   uint16x8_t vColor1 = vmull_u8(vdup_n_u8(pColor[1]), vAlpha);
+   uint16x8_t vColor2 = vmull_u8(vdup_n_u8(pColor[2]), vAlpha);
+   uint8x8_t v255 = vdup_n_u8(255);
+   while ( iCount >= 8 )
+   {
+      uint8x8x4_t vDest = vld4_u8(pDest);
+      vDest.val[0] = vshrn_n_u16(vmlal_u8(vColor0, vDest.val[0], vInv), 8);
+      vDest.val[1] = vshrn_n_u16(vmlal_u8(vColor1, vDest.val[1], vInv), 8);
+      vDest.val[2] = vshrn_n_u16(vmlal_u8(vColor2, vDest.val[2], vInv), 8);
+      vDest.val[3] = vadd_u8(vDest.val[3], vshrn_n_u16(vmull_u8(vsub_u8(v255, vDest.val[3]), vAlpha), 8));
+      vst4_u8(pDest, vDest);
+      pDest += 32;
+      iCount -= 8;
+   }
+   #elif defined(RENDER_SPANS_SSE2)
+   // 16 bit lanes: [c0 c1 c2 a] x 2 pixels
+   const __m128i vZero = _mm_setzero_si128();
+   const __m128i v255 = _mm_set1_epi16(255);
+   const __m128i vAlpha = _mm_set1_epi16(uAlpha);
+   const __m128i vInv = _mm_set1_epi16(255 - uAlpha);
+   const __m128i vColorMul = _mm_set_epi16(0, uAlpha*pColor[2], uAlpha*pColor[1], uAlpha*pColor[0], 0, uAlpha*pColor[2], uAlpha*pColor[1], uAlpha*pColor[0]);
+   const __m128i vMaskAlpha = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+   while ( iCount >= 4 )
+   {
+      __m128i vDest = _mm_loadu_si128((const __m128i*)pDest);
+      __m128i vLo = _mm_unpacklo_epi8(vDest, vZero);
+      __m128i vHi = _mm_unpackhi_epi8(vDest, vZero);
+
+      __m128i vColLo = _mm_srli_epi16(_mm_add_epi16(vColorMul, _mm_mullo_epi16(vLo, vInv)), 8);
+      __m128i vColHi = _mm_srli_epi16(_mm_add_epi16(vColorMul, _mm_mullo_epi16(vHi, vInv)), 8);
+      __m128i vAlLo = _mm_add_epi16(vLo, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(v255, vLo), vAlpha), 8));
+      __m128i vAlHi = _mm_add_epi16(vHi, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(v255, vHi), vAlpha), 8));
+
+      vLo = _mm_or_si128(_mm_and_si128(vMaskAlpha, vAlLo), _mm_andnot_si128(vMaskAlpha, vColLo));
+      vHi = _mm_or_si128(_mm_and_si128(vMaskAlpha, vAlHi), _mm_andnot_si128(vMaskAlpha, vColHi));
+      _mm_storeu_si128((__m128i*)pDest, _mm_packus_epi16(vLo, vHi));
+      pDest += 16;
+      iCount -= 4;
+   }
+   #endif
+
+   while ( iCount > 0 )
+   {
+      _span_blend_color_pixel(pDest, pColor, uAlpha);
+      pDest += 4;
+      iCount--;
+   }
+}
+
+#if defined(RENDER_SPANS_SSE2)
+// Blends 4 source pixels (already unpacked to 16 bit lanes, 2 pixels per register) over destination
+static inline __m128i _span_sse2_blit4(__m128i vDest, __m128i vSrcLo, __m128i vSrcHi, int iUpdateDestAlpha)
+{
+   const __m128i vZero = _mm_setzero_si128();
+   const __m128i v255 = _mm_set1_epi16(255);
+   const __m128i vMaskAlpha = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+   __m128i vLo = _mm_unpacklo_epi8(vDest, vZero);
+   __m128i vHi = _mm_unpackhi_epi8(vDest, vZero);
+
+   // Broadcast each pixel alpha to its 4 lanes
+   __m128i vAlphaLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(vSrcLo, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+   __m128i vAlphaHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(vSrcHi, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+
+   __m128i vColLo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(vSrcLo, vAlphaLo), _mm_mullo_epi16(vLo, _mm_sub_epi16(v255, vAlphaLo))), 8);
+   __m128i vColHi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(vSrcHi, vAlphaHi), _mm_mullo_epi16(vHi, _mm_sub_epi16(v255, vAlphaHi))), 8);
+
+   __m128i vAlLo = vLo;
+   __m128i vAlHi = vHi;
+   if ( iUpdateDestAlpha )
+   {
+      vAlLo = _mm_add_epi16(vLo, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(v255, vLo), vAlphaLo), 8));
+      vAlHi = _mm_add_epi16(vHi, _mm_srli_epi16(_mm_mullo_epi16(_mm_sub_epi16(v255, vHi), vAlphaHi), 8));
+   }
+   vLo = _mm_or_si128(_mm_and_si128(vMaskAlpha, vAlLo), _mm_andnot_si128(vMaskAlpha, vColLo));
+   vHi = _mm_or_si128(_mm_and_si128(vMaskAlpha, vAlHi), _mm_andnot_si128(vMaskAlpha, vColHi));
+   return _mm_packus_epi16(vLo, vHi);
+}
+#endif
+
+#if defined(RENDER_SPANS_NEON)
+static inline void _span_neon_blit8(unsigned char* pDest, uint8x8x4_t vSrc, int iUpdateDestAlpha)
+{
+   uint8x8x4_t vDest = vld4_u8(pDest);
+   uint8x8_t vAlpha = vSrc.val[3];
+   uint8x8_t vInv = vsub_u8(vdup_n_u8(255), vAlpha);
+   vDest.val[0] = vshrn_n_u16(vmlal_u8(vmull_u8(vSrc.val[0], vAlpha), vDest.val[0], vInv), 8);
+   vDest.val[1] = vshrn_n_u16(vmlal_u8(vmull_u8(vSrc.val[1], vAlpha), vDest.val[1], vInv), 8);
+   vDest.val[2] = vshrn_n_u16(vmlal_u8(vmull_u8(vSrc.val[2], vAlpha), vDest.val[2], vInv), 8);
+   if ( iUpdateDestAlpha )
+      vDest.val[3] = vadd_u8(vDest.val[3], vshrn_n_u16(vmull_u8(vsub_u8(vdup_n_u8(255), vDest.val[3]), vAlpha), 8));
+   vst4_u8(pDest, vDest);
+}
+#endif
+
+void render_span_blit_alpha(unsigned char* pDest, const unsigned char* pSrc, int iCount, int iUpdateDestAlpha)
+{
+   if ( (NULL == pDest) || (NULL == pSrc) || (iCount <= 0) )
+      return;
+
+   #if defined(RENDER_SPANS_NEON)
+   while ( iCount >= 8 )
+   {
+      _span_neon_blit8(pDest, vld4_u8(pSrc), iUpdateDestAlpha);
+      pDest += 32;
+      pSrc += 32;
+      iCount -= 8;
+   }
+   #elif defined(RENDER_SPANS_SSE2)
+   const __m128i vZero = _mm_setzero_si128();
+   while ( iCount >= 4 )
+   {
+      __m128i vSrc = _mm_loadu_si128((const __m128i*)pSrc);
+      __m128i vDest = _mm_loadu_si128((const __m128i*)pDest);
+      vDest = _span_sse2_blit4(vDest, _mm_unpacklo_epi8(vSrc, vZero), _mm_unpackhi_epi8(vSrc, vZero), iUpdateDestAlpha);
+      _mm_storeu_si128((__m128i*)pDest, vDest);
+      pDest += 16;
+      pSrc += 16;
+      iCount -= 4;
+   }
+   #endif
+
+   while ( iCount > 0 )
+   {
+      _span_blit_alpha_pixel(pDest, pSrc, iUpdateDestAlpha);
+      pDest += 4;
+      pSrc += 4;
+      iCount--;
+   }
+}
+
+void render_span_blit_alpha_modulated(unsigned char* pDest, const unsigned char* pSrc, int iCount, const unsigned char* pModulate)
+{
+   if ( (NULL == pDest) || (NULL == pSrc) || (NULL == pModulate) || (iCount <= 0) )
+      return;
+
+   #if defined(RENDER_SPANS_NEON)
+   uint8x8_t vMod0 = vdup_n_u8(pModulate[0]);
+   uint8x8_t vMod1 = vdup_n_u8(pModulate[1]);
+   uint8x8_t vMod2 = vdup_n_u8(pModulate[2]);
+   uint8x8_t vMod3 = vdup_n_u8(pModulate[3]);
+   while ( iCount >= 8 )
+   {
+      uint8x8x4_t vSrc = vld4_u8(pSrc);
+      vSrc.val[0] = vshrn_n_u16(vmull_u8(vSrc.val[0], vMod0), 8);
+      vSrc.val[1] = vshrn_n_u16(vmull_u8(vSrc.val[1], vMod1), 8);
+      vSrc.val[2] = vshrn_n_u16(vmull_u8(vSrc.val[2], vMod2), 8);
+      vSrc.val[3] = vshrn_n_u16(vmull_u8(vSrc.val[3], vMod3), 8);
+      _span_neon_blit8(pDest, vSrc, 1);
+      pDest += 32;
+      pSrc += 32;
+      iCount -= 8;
+   }
+   #elif defined(RENDER_SPANS_SSE2)
+   const __m128i vZero = _mm_setzero_si128();
+   const __m128i vMod = _mm_set_epi16(pModulate[3], pModulate[2], pModulate[1], pModulate[0], pModulate[3], pModulate[2], pModulate[1], pModulate[0]);
+   while ( iCount >= 4 )
+   {
+      __m128i vSrc = _mm_loadu_si128((const __m128i*)pSrc);
+      __m128i vSrcLo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(vSrc, vZero), vMod), 8);
+      __m128i vSrcHi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(vSrc, vZero), vMod), 8);
+      __m128i vDest = _mm_loadu_si128((const __m128i*)pDest);
+      vDest = _span_sse2_blit4(vDest, vSrcLo, vSrcHi, 1);
+      _mm_storeu_si128((__m128i*)pDest, vDest);
+      pDest += 16;
+      pSrc += 16;
+      iCount -= 4;
+   }
+   #endif
+
+   while ( iCount > 0 )
+   {
+      _span_blit_alpha_modulated_pixel(pDest, pSrc, pModulate);
+      pDest += 4;
+      pSrc += 4;
+      iCount--;
+   }
+}
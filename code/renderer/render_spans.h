@@ -0,0 +1,33 @@
+#pragma once
+
+// Span (row) primitives for 32 bits per pixel surfaces, used by the raw drawing paths.
+// Channel order is whatever the surface uses (RGBA for fbgraphics, BGRA for the DRM/cairo surface):
+// the first three bytes of a pixel are color channels, the fourth one is alpha.
+// All variants (NEON, SSE2, scalar) produce bit exact identical results.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Returns "neon", "sse2" or "scalar"
+const char* render_span_get_impl_name();
+
+// Writes the same 4 bytes pixel to iCount consecutive pixels
+void render_span_fill(unsigned char* pDest, int iCount, const unsigned char* pPixel);
+
+// Blends a constant color (pColor[0..2]) with alpha uAlpha over iCount consecutive pixels:
+//   c = (a*src + (255-a)*dst) >> 8, alpha = dst + (((255-dst)*a) >> 8)
+void render_span_blend_color(unsigned char* pDest, int iCount, const unsigned char* pColor, unsigned char uAlpha);
+
+// Blends iCount source pixels using each source pixel alpha:
+//   c = (a*src + (255-a)*dst) >> 8
+// iUpdateDestAlpha: 0 keeps destination alpha, 1 composites alpha as in render_span_blend_color
+void render_span_blit_alpha(unsigned char* pDest, const unsigned char* pSrc, int iCount, int iUpdateDestAlpha);
+
+// Same as render_span_blit_alpha (with alpha update), but each source channel (alpha included) is first
+// modulated by pModulate: src = (src*mod) >> 8
+void render_span_blit_alpha_modulated(unsigned char* pDest, const unsigned char* pSrc, int iCount, const unsigned char* pModulate);
+
+#ifdef __cplusplus
+}
+#endif